@@ -0,0 +1,26 @@
+﻿#pragma once
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Лучшее из repeats время одного вызова run, мс: меньше всего шума от планировщика ОС
+template <typename Run>
+double BestMs(int repeats, Run&& run)
+{
+    double best = 1e30;
+    for (int i = 0; i < repeats; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+// Необязательный числовой аргумент командной строки
+inline unsigned long ArgOr(int argc, char** argv, int index, unsigned long fallback)
+{
+    return index < argc ? std::strtoul(argv[index], nullptr, 10) : fallback;
+}
@@ -0,0 +1,72 @@
+﻿#include "ClusteredLights.h"
+#include "Bench.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// ClusteredLightsBench [источников = 4096] [повторов = 50] [рабочих потоков максимум = ядер - 1]
+// Сетка приложения (16 x 9 x 24, fov 45 градусов, 16:9, Near 5, Far 1000), источники
+// как в DirectXApp::BuildLights: случайно в боксе размером со Sponza вокруг камеры,
+// радиус 4-10% её размера. Для каждого числа рабочих - лучшее время Build и его доли
+
+int main(int argc, char** argv)
+{
+    uint32_t count = (uint32_t)ArgOr(argc, argv, 1, 4096);
+    int repeats = (int)ArgOr(argc, argv, 2, 50);
+    uint32_t maxWorkers = (uint32_t)ArgOr(argc, argv, 3, (std::max)(std::thread::hardware_concurrency(), 2u) - 1);
+
+    uint32_t random = 1;
+    auto next = [&random](float from, float to)
+    {
+        random = random * 1664525u + 1013904223u;
+        return from + (to - from) * float(random >> 8) / float(1 << 24);
+    };
+
+    const float extent = 3000.0f;
+    std::vector<PointLight> lights(count);
+    for (PointLight& light : lights)
+    {
+        light.Position[0] = next(-0.5f, 0.5f) * extent;
+        light.Position[1] = next(-0.2f, 0.2f) * extent;
+        light.Position[2] = next(-0.3f, 0.3f) * extent;
+        light.Radius = next(0.04f, 0.1f) * extent;
+    }
+
+    ClusterGridDesc grid;
+    grid.TanHalfFovY = std::tan(3.14159265f / 8.0f);
+    grid.TanHalfFovX = grid.TanHalfFovY * 16.0f / 9.0f;
+    grid.Near = 5.0f;
+    grid.Far = 1000.0f;
+
+    // Камера в начале координат смотрит вдоль +z
+    float view[4][4] = {};
+    for (int i = 0; i < 4; i++)
+        view[i][i] = 1.0f;
+
+    std::printf("lights %u, clusters %u\n", count, grid.CountX * grid.CountY * grid.CountZ);
+    std::printf("threads  build ms  transform us  bin us  compact us  visible  refs  overflows\n");
+    for (uint32_t workers = 0; workers <= maxWorkers; workers++)
+    {
+        JobSystem jobs(workers);
+        ClusteredLights clustered(jobs);
+        clustered.SetGrid(grid);
+
+        // Доли - из прогона с лучшим временем, как в BestMs
+        ClusterStats best;
+        double bestMs = 1e30;
+        for (int i = 0; i < repeats; i++)
+        {
+            double ms = BestMs(1, [&]() { clustered.Build(view, lights.data(), lights.size()); });
+            if (ms < bestMs)
+            {
+                bestMs = ms;
+                best = clustered.Stats();
+            }
+        }
+
+        std::printf("%7u  %8.3f  %12.1f  %6.1f  %10.1f  %7u  %5u  %9u\n", workers + 1, bestMs,
+            best.TransformUs, best.BinUs, best.CompactUs, best.VisibleLights, best.Indices, best.Overflows);
+    }
+    return 0;
+}
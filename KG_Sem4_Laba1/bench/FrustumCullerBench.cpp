@@ -0,0 +1,65 @@
+﻿#include "FrustumCuller.h"
+#include "Bench.h"
+#include <cmath>
+#include <vector>
+
+// FrustumCullerBench [боксов = 1000000] [повторов = 50]
+// Случайные боксы вокруг камеры, пирамида 90 градусов на 500 единиц: видна примерно четверть
+
+int main(int argc, char** argv)
+{
+    uint32_t count = (uint32_t)ArgOr(argc, argv, 1, 1000000);
+    int repeats = (int)ArgOr(argc, argv, 2, 50);
+
+    uint32_t random = 1;
+    auto next = [&random](float from, float to)
+    {
+        random = random * 1664525u + 1013904223u;
+        return from + (to - from) * float(random >> 8) / float(1 << 24);
+    };
+
+    FrustumCuller culler;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        float x = next(-500.0f, 500.0f);
+        float y = next(-100.0f, 100.0f);
+        float z = next(-500.0f, 500.0f);
+        float half = next(0.1f, 5.0f);
+
+        Aabb box;
+        box.Extend(x - half, y - half, z - half);
+        box.Extend(x + half, y + half, z + half);
+        culler.Add(box);
+    }
+
+    // Камера в начале координат смотрит вдоль +z (XMMatrixPerspectiveFovLH, fov 90, aspect 1)
+    float zn = 0.1f, zf = 500.0f;
+    float viewProj[4][4] = {};
+    viewProj[0][0] = 1.0f;
+    viewProj[1][1] = 1.0f;
+    viewProj[2][2] = zf / (zf - zn);
+    viewProj[2][3] = 1.0f;
+    viewProj[3][2] = -zn * zf / (zf - zn);
+
+    FrustumPlanes frustum;
+    ExtractFrustumPlanes(viewProj, frustum);
+
+    std::vector<uint32_t> simd, scalar;
+    simd.reserve(count);
+    scalar.reserve(count);
+
+    double simdMs = BestMs(repeats, [&]() { culler.Cull(frustum, simd); });
+    double scalarMs = BestMs(repeats, [&]() { culler.CullScalar(frustum, scalar); });
+
+    if (simd != scalar)
+    {
+        std::printf("SSE and scalar results differ\n");
+        return 1;
+    }
+
+    std::printf("boxes %u, visible %zu\n", count, simd.size());
+    std::printf("SSE    %8.3f ms  %7.1f Mbox/s\n", simdMs, count / simdMs / 1000.0);
+    std::printf("scalar %8.3f ms  %7.1f Mbox/s\n", scalarMs, count / scalarMs / 1000.0);
+    std::printf("speedup %.2fx\n", scalarMs / simdMs);
+    return 0;
+}
@@ -0,0 +1,87 @@
+﻿#include "JobSystem.h"
+#include "Bench.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// JobSystemBench [рабочих потоков максимум = ядер - 1] [задач = 200000]
+// Для каждого числа рабочих: пропускная способность пустых задач (из создающего
+// потока и вложенных из задач) и ускорение ParallelFor на счётной нагрузке
+// относительно того же цикла в одном потоке без JobSystem
+
+namespace
+{
+    const uint32_t Elements = 1 << 22;
+    const uint32_t Chunks = 1024;
+    const uint32_t FanOut = 64;
+
+    double Work(const std::vector<float>& data, uint32_t begin, uint32_t end)
+    {
+        double sum = 0.0;
+        for (uint32_t i = begin; i < end; i++)
+            sum += std::sin(data[i]) * std::cos(data[i]);
+        return sum;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t maxWorkers = (uint32_t)ArgOr(argc, argv, 1, (std::max)(std::thread::hardware_concurrency(), 2u) - 1);
+    uint32_t taskCount = (uint32_t)ArgOr(argc, argv, 2, 200000);
+
+    std::vector<float> data(Elements);
+    for (uint32_t i = 0; i < Elements; i++)
+        data[i] = float(i % 1000) * 0.001f;
+
+    std::vector<double> partial(Chunks);
+    double serialMs = BestMs(5, [&]() { partial[0] = Work(data, 0, Elements); });
+    std::printf("serial loop %.2f ms\n", serialMs);
+    std::printf("threads  flat Mtask/s  nested Mtask/s  ParallelFor ms  speedup\n");
+
+    for (uint32_t workers = 1; workers <= (std::max)(maxWorkers, 1u); workers++)
+    {
+        JobSystem jobs(workers);
+
+        double flatMs = BestMs(5, [&]()
+        {
+            JobCounter counter;
+            for (uint32_t i = 0; i < taskCount; i++)
+                jobs.Run([] {}, &counter);
+            jobs.Wait(counter);
+        });
+
+        // Задачи раздают задачи: идут через деки рабочих, а не общую очередь
+        double nestedMs = BestMs(5, [&]()
+        {
+            JobCounter counter;
+            for (uint32_t i = 0; i < taskCount / FanOut; i++)
+            {
+                jobs.Run([&jobs]
+                {
+                    JobCounter inner;
+                    for (uint32_t k = 0; k < FanOut - 1; k++)
+                        jobs.Run([] {}, &inner);
+                    jobs.Wait(inner);
+                }, &counter);
+            }
+            jobs.Wait(counter);
+        });
+
+        double forMs = BestMs(5, [&]()
+        {
+            jobs.ParallelFor(Elements, [&](uint32_t begin, uint32_t end)
+            {
+                partial[begin / (Elements / Chunks)] = Work(data, begin, end);
+            }, Elements / Chunks);
+        });
+
+        std::printf("%7u  %12.2f  %14.2f  %14.2f  %6.2fx\n",
+            jobs.ThreadCount(),
+            taskCount / flatMs / 1000.0,
+            taskCount / FanOut * FanOut / nestedMs / 1000.0,
+            forMs,
+            serialMs / forMs);
+    }
+
+    return 0;
+}
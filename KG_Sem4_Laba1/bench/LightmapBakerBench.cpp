@@ -0,0 +1,130 @@
+﻿#include "LightmapBaker.h"
+#include "Bench.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// LightmapBakerBench [страница = 512] [непрямых выборок = 64] [рабочих потоков = ядер - 1]
+// Двор 200 x 200: пол, стены с трёх сторон, сетка колонн 5 x 5 и навес над
+// половиной двора с лампой под ним. Солнце, лампа и один отскок с настройками
+// DirectXApp по умолчанию; печатает развёртку, лучи в секунду и время запекания
+// и шумоподавления
+
+namespace
+{
+    struct BenchVertex
+    {
+        float Position[3];
+        float Normal[3];
+    };
+
+    struct Mesh
+    {
+        std::vector<BenchVertex> Vertices;
+        std::vector<uint32_t> Indices;
+
+        void AddQuad(const float a[3], const float b[3], const float c[3], const float d[3], const float n[3])
+        {
+            const float* corners[6] = { a, b, c, a, c, d };
+            for (const float* p : corners)
+            {
+                BenchVertex v;
+                memcpy(v.Position, p, sizeof(v.Position));
+                memcpy(v.Normal, n, sizeof(v.Normal));
+                Indices.push_back((uint32_t)Vertices.size());
+                Vertices.push_back(v);
+            }
+        }
+
+        void AddBox(float x0, float y0, float z0, float x1, float y1, float z1)
+        {
+            float p[8][3];
+            for (int corner = 0; corner < 8; corner++)
+            {
+                p[corner][0] = (corner & 1) ? x1 : x0;
+                p[corner][1] = (corner & 2) ? y1 : y0;
+                p[corner][2] = (corner & 4) ? z1 : z0;
+            }
+            const float nx[3] = { -1, 0, 0 }, px[3] = { 1, 0, 0 };
+            const float ny[3] = { 0, -1, 0 }, py[3] = { 0, 1, 0 };
+            const float nz[3] = { 0, 0, -1 }, pz[3] = { 0, 0, 1 };
+            AddQuad(p[0], p[4], p[6], p[2], nx);
+            AddQuad(p[1], p[3], p[7], p[5], px);
+            AddQuad(p[0], p[1], p[5], p[4], ny);
+            AddQuad(p[2], p[6], p[7], p[3], py);
+            AddQuad(p[0], p[2], p[3], p[1], nz);
+            AddQuad(p[4], p[5], p[7], p[6], pz);
+        }
+    };
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t pageSize = (uint32_t)ArgOr(argc, argv, 1, 512);
+    uint32_t indirectSamples = (uint32_t)ArgOr(argc, argv, 2, 64);
+    uint32_t workers = (uint32_t)ArgOr(argc, argv, 3, (std::max)(std::thread::hardware_concurrency(), 2u) - 1);
+
+    Mesh mesh;
+    mesh.AddBox(-100.0f, -2.0f, -100.0f, 100.0f, 0.0f, 100.0f);
+    mesh.AddBox(-100.0f, 0.0f, 98.0f, 100.0f, 40.0f, 100.0f);
+    mesh.AddBox(-100.0f, 0.0f, -100.0f, -98.0f, 40.0f, 100.0f);
+    mesh.AddBox(98.0f, 0.0f, -100.0f, 100.0f, 40.0f, 100.0f);
+    for (int z = 0; z < 5; z++)
+    {
+        for (int x = 0; x < 5; x++)
+        {
+            float cx = -80.0f + x * 40.0f, cz = -80.0f + z * 40.0f;
+            mesh.AddBox(cx - 3.0f, 0.0f, cz - 3.0f, cx + 3.0f, 30.0f, cz + 3.0f);
+        }
+    }
+    mesh.AddBox(-98.0f, 30.0f, 0.0f, 98.0f, 32.0f, 98.0f);
+
+    std::vector<LightmapDraw> draws(1);
+    draws[0].TriangleCount = (uint32_t)(mesh.Indices.size() / 3);
+
+    LightmapAreaLight lamp;
+    lamp.Corner[0] = -5.0f;
+    lamp.Corner[1] = 25.0f;
+    lamp.Corner[2] = 35.0f;
+    lamp.EdgeU[0] = 10.0f;
+    lamp.EdgeV[2] = 10.0f;      // EdgeU x EdgeV - вниз, как у лампы DirectXApp
+    lamp.Color[0] = 20.0f;
+    lamp.Color[1] = 16.0f;
+    lamp.Color[2] = 12.0f;
+
+    LightmapMesh view;
+    view.Vertices = reinterpret_cast<const uint8_t*>(mesh.Vertices.data());
+    view.VertexStride = sizeof(BenchVertex);
+    view.PositionOffset = offsetof(BenchVertex, Position);
+    view.NormalOffset = offsetof(BenchVertex, Normal);
+    view.VertexCount = (uint32_t)mesh.Vertices.size();
+    view.Indices = mesh.Indices.data();
+    view.IndexCount = mesh.Indices.size();
+
+    JobSystem jobs(workers);
+    TriangleBvh bvh;
+    bvh.Build(mesh.Vertices[0].Position, sizeof(BenchVertex), mesh.Indices.data(), mesh.Indices.size(), &jobs);
+
+    LightmapUnwrapDesc unwrap;
+    unwrap.PageSize = pageSize;
+    unwrap.MaxPages = 1;
+    LightmapBaker baker;
+    std::vector<LightmapUv> uvs;
+    baker.Unwrap(view, unwrap, uvs);
+
+    LightmapBakeDesc desc;
+    desc.IndirectSamples = indirectSamples;
+    baker.Bake(view, bvh, draws, { lamp }, desc, jobs);
+
+    const LightmapStats& stats = baker.Stats();
+    std::printf("triangles %zu, threads %u\n", mesh.Indices.size() / 3, jobs.ThreadCount());
+    std::printf("unwrap %.1f ms: %u charts, %u pages of %u, %.2f texels per unit, %u texels\n",
+        stats.UnwrapMs, stats.Charts, stats.Pages, pageSize, stats.TexelsPerUnit, stats.Texels);
+    std::printf("trace %.1f ms: %.1f Mrays (%u sun, %u lamp, %u indirect per texel), %.2f Mrays/s\n",
+        stats.TraceMs, stats.Rays / 1e6, desc.SunSamples, desc.AreaSamples, desc.IndirectSamples,
+        stats.RaysPerSecond / 1e6);
+    std::printf("denoise %.1f ms (%u passes), bake %.1f ms\n", stats.DenoiseMs, desc.DenoisePasses, stats.BakeMs);
+    return 0;
+}
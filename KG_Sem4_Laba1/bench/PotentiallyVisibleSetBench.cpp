@@ -0,0 +1,158 @@
+﻿#include "PotentiallyVisibleSet.h"
+#include "Bench.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// PotentiallyVisibleSetBench [ячейка = 50] [лучей на ячейку = 2048] [MergeSlack x 10000 = 200] [рабочих потоков = ядер - 1]
+// Сетка 8 x 8 комнат 200 x 120 x 200 с проёмами 60 x 80 в стенах: у каждой
+// комнаты пол, потолок, западная и южная стены (по два куска и перемычка над
+// проёмом) и четыре предмета на полу - 768 отрисовок-боксов, 9216 треугольников.
+// Время запекания, объём данных до и после слияния строк и доля отрисовок,
+// которую отсекает PVS в случайных точках комнат, и время поиска строки
+
+namespace
+{
+    struct Scene
+    {
+        std::vector<float> Positions;
+        std::vector<uint32_t> Indices;
+        std::vector<PvsDraw> Draws;
+
+        void AddBox(float x0, float y0, float z0, float x1, float y1, float z1)
+        {
+            uint32_t base = (uint32_t)(Positions.size() / 3);
+            PvsDraw draw;
+            draw.FirstTriangle = (uint32_t)(Indices.size() / 3);
+            draw.TriangleCount = 12;
+            for (int corner = 0; corner < 8; corner++)
+            {
+                float p[3] = { (corner & 1) ? x1 : x0, (corner & 2) ? y1 : y0, (corner & 4) ? z1 : z0 };
+                Positions.insert(Positions.end(), p, p + 3);
+                draw.Bounds.Extend(p[0], p[1], p[2]);
+            }
+
+            const uint32_t faces[6][4] = {
+                { 0, 2, 6, 4 }, { 1, 5, 7, 3 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 1, 3, 2 }, { 4, 6, 7, 5 } };
+            for (const auto& f : faces)
+                Indices.insert(Indices.end(), { base + f[0], base + f[1], base + f[2], base + f[0], base + f[2], base + f[3] });
+
+            Draws.push_back(draw);
+        }
+    };
+
+    const uint32_t Rooms = 8;
+    const float RoomSize = 200.0f;
+    const float RoomHeight = 120.0f;
+    const float Wall = 5.0f;        // Полутолщина стены
+    const float DoorWidth = 60.0f;
+    const float DoorHeight = 80.0f;
+}
+
+int main(int argc, char** argv)
+{
+    float cellSize = (float)ArgOr(argc, argv, 1, 50);
+    uint32_t raysPerCell = (uint32_t)ArgOr(argc, argv, 2, 2048);
+    float slack = (float)ArgOr(argc, argv, 3, 200) / 10000.0f;
+    uint32_t workers = (uint32_t)ArgOr(argc, argv, 4, (std::max)(std::thread::hardware_concurrency(), 2u) - 1);
+
+    uint32_t random = 1;
+    auto next = [&random](float from, float to)
+    {
+        random = random * 1664525u + 1013904223u;
+        return from + (to - from) * float(random >> 8) / float(1 << 24);
+    };
+
+    Scene scene;
+    for (uint32_t rz = 0; rz < Rooms; rz++)
+    {
+        for (uint32_t rx = 0; rx < Rooms; rx++)
+        {
+            float x0 = rx * RoomSize, z0 = rz * RoomSize;
+            float x1 = x0 + RoomSize, z1 = z0 + RoomSize;
+            float doorX = x0 + RoomSize * 0.5f, doorZ = z0 + RoomSize * 0.5f;
+            float half = DoorWidth * 0.5f;
+
+            scene.AddBox(x0, -2 * Wall, z0, x1, 0.0f, z1);
+            scene.AddBox(x0, RoomHeight, z0, x1, RoomHeight + 2 * Wall, z1);
+
+            // Западная стена x = x0 и южная z = z0
+            scene.AddBox(x0 - Wall, 0.0f, z0, x0 + Wall, RoomHeight, doorZ - half);
+            scene.AddBox(x0 - Wall, 0.0f, doorZ + half, x0 + Wall, RoomHeight, z1);
+            scene.AddBox(x0 - Wall, DoorHeight, doorZ - half, x0 + Wall, RoomHeight, doorZ + half);
+            scene.AddBox(x0, 0.0f, z0 - Wall, doorX - half, RoomHeight, z0 + Wall);
+            scene.AddBox(doorX + half, 0.0f, z0 - Wall, x1, RoomHeight, z0 + Wall);
+            scene.AddBox(doorX - half, DoorHeight, z0 - Wall, doorX + half, RoomHeight, z0 + Wall);
+
+            for (int prop = 0; prop < 4; prop++)
+            {
+                float px = next(x0 + 20.0f, x1 - 50.0f), pz = next(z0 + 20.0f, z1 - 50.0f);
+                scene.AddBox(px, 0.0f, pz, px + next(10.0f, 30.0f), next(10.0f, 60.0f), pz + next(10.0f, 30.0f));
+            }
+        }
+    }
+
+    JobSystem jobs(workers);
+    TriangleBvh bvh;
+    bvh.Build(scene.Positions.data(), 3 * sizeof(float), scene.Indices.data(), scene.Indices.size(), &jobs);
+
+    Aabb bounds;
+    bounds.Extend(0.0f, 0.0f, 0.0f);
+    bounds.Extend(Rooms * RoomSize, RoomHeight, Rooms * RoomSize);
+
+    PvsBakeDesc desc;
+    desc.CellSize = cellSize;
+    desc.RaysPerCell = raysPerCell;
+    desc.MergeSlack = slack;
+
+    std::printf("draws %zu, triangles %zu, threads %u\n", scene.Draws.size(), scene.Indices.size() / 3, jobs.ThreadCount());
+    std::printf("cell %.0f, rays per cell %u, slack %.4f\n", cellSize, raysPerCell, slack);
+
+    PotentiallyVisibleSet pvs;
+    pvs.Bake(bvh, scene.Draws, bounds, desc, jobs);
+    const PvsStats& stats = pvs.Stats();
+    std::printf("bake %.1f ms, %.2f Mrays/s\n", stats.BakeMs, stats.Rays / (stats.BakeMs * 1000.0));
+    std::printf("cells %u (walkable %u), rows %u\n", stats.Cells, stats.WalkableCells, stats.UniqueRows);
+    std::printf("raw %.1f KB, stored %.1f KB (%.1fx)\n",
+        stats.RawBytes / 1024.0, stats.StoredBytes / 1024.0, (double)stats.RawBytes / (std::max)(stats.StoredBytes, (uint64_t)1));
+
+    // Случайные точки в комнатах, как камера у пола и под потолком
+    const uint32_t Samples = 1000000;
+    std::vector<float> points(Samples * 3);
+    for (uint32_t i = 0; i < Samples; i++)
+    {
+        points[i * 3 + 0] = next(0.0f, Rooms * RoomSize);
+        points[i * 3 + 1] = next(1.0f, RoomHeight - 1.0f);
+        points[i * 3 + 2] = next(0.0f, Rooms * RoomSize);
+    }
+
+    uint32_t words = (pvs.DrawCount() + 63) / 64;
+    uint64_t rejected = 0, found = 0;
+    for (uint32_t i = 0; i < Samples; i++)
+    {
+        const uint64_t* row = pvs.VisibleSet(&points[i * 3]);
+        if (row == nullptr)
+            continue;
+
+        found++;
+        uint32_t visible = 0;
+        for (uint32_t w = 0; w < words; w++)
+            visible += (uint32_t)std::popcount(row[w]);
+        rejected += pvs.DrawCount() - visible;
+    }
+    std::printf("visible %.1f%% per cell, rejected %.1f%% of draws at %llu of %u points\n",
+        stats.AverageVisible * 100.0, found > 0 ? 100.0 * rejected / ((double)found * pvs.DrawCount()) : 0.0,
+        (unsigned long long)found, Samples);
+
+    // Счётчик найденных строк печатается, чтобы цикл не выбросил оптимизатор
+    uint64_t hits = 0;
+    double ms = BestMs(5, [&]()
+    {
+        for (uint32_t i = 0; i < Samples; i++)
+            hits += pvs.VisibleSet(&points[i * 3]) != nullptr ? 1 : 0;
+    });
+    std::printf("lookup %.1f ns (%llu rows found)\n", ms * 1e6 / Samples, (unsigned long long)hits);
+    return 0;
+}
@@ -0,0 +1,117 @@
+﻿#include "TriangleBvh.h"
+#include "Bench.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// TriangleBvhBench [сторона сетки = 700] [лучей = 1000000] [рабочих потоков максимум = ядер - 1]
+// Рельеф из 2 * сторона^2 треугольников. Сборка - для каждого числа рабочих;
+// лучи - пакетами по 4 и по одному: первичные из камеры над рельефом (соседние
+// лучи пакета почти параллельны) и случайные из точек над ним (пакет расходится)
+
+int main(int argc, char** argv)
+{
+    uint32_t side = (uint32_t)ArgOr(argc, argv, 1, 700);
+    uint32_t rayCount = (uint32_t)ArgOr(argc, argv, 2, 1000000) & ~3u;
+    uint32_t maxWorkers = (uint32_t)ArgOr(argc, argv, 3, (std::max)(std::thread::hardware_concurrency(), 2u) - 1);
+
+    uint32_t random = 1;
+    auto next = [&random](float from, float to)
+    {
+        random = random * 1664525u + 1013904223u;
+        return from + (to - from) * float(random >> 8) / float(1 << 24);
+    };
+
+    // Рельеф 1000 x 1000 по xz, холмы до 60 по y
+    const float size = 1000.0f;
+    std::vector<float> positions;
+    positions.reserve((size_t)(side + 1) * (side + 1) * 3);
+    for (uint32_t z = 0; z <= side; z++)
+    {
+        for (uint32_t x = 0; x <= side; x++)
+        {
+            float px = size * x / side;
+            float pz = size * z / side;
+            float py = 30.0f * std::sin(px * 0.013f) * std::cos(pz * 0.011f) + 10.0f * std::sin(px * 0.07f + pz * 0.05f);
+            positions.insert(positions.end(), { px, py, pz });
+        }
+    }
+
+    std::vector<uint32_t> indices;
+    indices.reserve((size_t)side * side * 6);
+    for (uint32_t z = 0; z < side; z++)
+    {
+        for (uint32_t x = 0; x < side; x++)
+        {
+            uint32_t i = z * (side + 1) + x;
+            indices.insert(indices.end(), { i, i + side + 1, i + 1, i + 1, i + side + 1, i + side + 2 });
+        }
+    }
+
+    std::printf("triangles %zu\n", indices.size() / 3);
+    std::printf("threads  build ms\n");
+    TriangleBvh bvh;
+    for (uint32_t workers = 0; workers <= maxWorkers; workers++)
+    {
+        JobSystem jobs(workers);
+        double ms = BestMs(3, [&]() { bvh.Build(positions.data(), 3 * sizeof(float), indices.data(), indices.size(), &jobs); });
+        std::printf("%7u  %8.1f\n", workers + 1, ms);
+    }
+    std::printf("nodes %u, depth %u\n", bvh.NodeCount(), bvh.Depth());
+
+    // Первичные: камера над углом смотрит на центр, квадратный кадр строками
+    std::vector<Ray> primary(rayCount);
+    uint32_t width = (uint32_t)std::sqrt((double)rayCount);
+    const float eye[3] = { -100.0f, 250.0f, -100.0f };
+    const float target[3] = { 500.0f, 0.0f, 500.0f };
+    float forward[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+    float length = std::sqrt(forward[0] * forward[0] + forward[1] * forward[1] + forward[2] * forward[2]);
+    for (float& f : forward)
+        f /= length;
+    float right[3] = { forward[2], 0.0f, -forward[0] };
+    float up[3] = {
+        forward[1] * right[2] - forward[2] * right[1],
+        forward[2] * right[0] - forward[0] * right[2],
+        forward[0] * right[1] - forward[1] * right[0] };
+    for (uint32_t i = 0; i < rayCount; i++)
+    {
+        float sx = 2.0f * (i % width) / width - 1.0f;
+        float sy = 1.0f - 2.0f * (i / width) / width;
+        Ray& ray = primary[i];
+        for (int k = 0; k < 3; k++)
+        {
+            ray.Origin[k] = eye[k];
+            ray.Dir[k] = forward[k] + 0.6f * (sx * right[k] + sy * up[k]);
+        }
+    }
+
+    // Случайные: из точек над рельефом во все стороны
+    std::vector<Ray> incoherent(rayCount);
+    for (Ray& ray : incoherent)
+    {
+        ray.Origin[0] = next(0.0f, size);
+        ray.Origin[1] = next(45.0f, 100.0f);
+        ray.Origin[2] = next(0.0f, size);
+        for (int k = 0; k < 3; k++)
+            ray.Dir[k] = next(-1.0f, 1.0f);
+    }
+
+    std::vector<RayHit> hits(rayCount);
+    std::printf("rays       packet Mray/s  single Mray/s  hit %%\n");
+    auto measure = [&](const char* name, const std::vector<Ray>& rays)
+    {
+        double packetMs = BestMs(3, [&]() { bvh.Intersect(rays.data(), rays.size(), hits.data()); });
+        size_t hitCount = std::count_if(hits.begin(), hits.end(), [](const RayHit& h) { return h.IsHit(); });
+        double singleMs = BestMs(3, [&]()
+        {
+            for (size_t i = 0; i < rays.size(); i++)
+                hits[i] = bvh.Intersect(rays[i]);
+        });
+        std::printf("%-10s %13.2f  %13.2f  %5.1f\n", name,
+            rays.size() / packetMs / 1000.0, rays.size() / singleMs / 1000.0, 100.0 * hitCount / rays.size());
+    };
+    measure("primary", primary);
+    measure("random", incoherent);
+    return 0;
+}
@@ -0,0 +1,31 @@
+﻿#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+struct Aabb
+{
+    float Min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float Max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    void Extend(float x, float y, float z)
+    {
+        Min[0] = (std::min)(Min[0], x);
+        Min[1] = (std::min)(Min[1], y);
+        Min[2] = (std::min)(Min[2], z);
+        Max[0] = (std::max)(Max[0], x);
+        Max[1] = (std::max)(Max[1], y);
+        Max[2] = (std::max)(Max[2], z);
+    }
+
+    bool IsEmpty() const { return Min[0] > Max[0]; }
+
+    // Расстояние от точки до бокса (0, если точка внутри)
+    float Distance(float x, float y, float z) const
+    {
+        float dx = (std::max)({ Min[0] - x, 0.0f, x - Max[0] });
+        float dy = (std::max)({ Min[1] - y, 0.0f, y - Max[1] });
+        float dz = (std::max)({ Min[2] - z, 0.0f, z - Max[2] });
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+};
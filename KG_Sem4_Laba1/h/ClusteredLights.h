@@ -0,0 +1,109 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include "JobSystem.h"
+
+// Точечный источник в мировых координатах
+struct PointLight
+{
+    float Position[3] = {};
+    float Radius = 1.0f;
+    float Color[3] = { 1.0f, 1.0f, 1.0f };
+    float Intensity = 1.0f;
+};
+
+// Как LightData в shaders.hlsl: центр уже в пространстве вида
+struct ClusterLight
+{
+    float Position[3];
+    float Radius;
+    float Color[3];
+    float Intensity;
+};
+
+struct ClusterGridDesc
+{
+    uint32_t CountX = 16;
+    uint32_t CountY = 9;
+    uint32_t CountZ = 24;
+    float TanHalfFovX = 1.0f;
+    float TanHalfFovY = 1.0f;
+    float Near = 1.0f;          // Всё ближе - в нулевом слое
+    float Far = 1000.0f;
+    uint32_t MaxLightsPerCluster = 128;
+
+    bool operator==(const ClusterGridDesc&) const = default;
+};
+
+struct ClusterStats
+{
+    uint32_t Lights = 0;
+    uint32_t VisibleLights = 0;    // Пересекли пирамиду видимости
+    uint32_t Clusters = 0;
+    uint32_t NonEmptyClusters = 0;
+    uint32_t Indices = 0;
+    uint32_t Overflows = 0;        // Источников не влезло в MaxLightsPerCluster
+    double TransformUs = 0.0;
+    double BinUs = 0.0;
+    double CompactUs = 0.0;
+};
+
+// Кластерное отсечение источников для forward-освещения. Пирамида видимости
+// делится на CountX x CountY плиток экрана и CountZ слоёв глубины (экспоненциально
+// от Near до Far), у каждого кластера - бокс в пространстве вида. Источники
+// переводятся в пространство вида и раскладываются по слоям задачами JobSystem:
+// в слое сфера проверяется сразу с четырьмя кластерами (SSE, квадрат расстояния
+// до бокса). Итог - на кластер пара (смещение, число) в общем массиве индексов
+// источников; его и массив источников кадр загружает на GPU один раз.
+// Кластер пикселя: x, y - SV_Position / размер плитки, z - log(z) * ZScale() + ZBias().
+class ClusteredLights
+{
+public:
+    explicit ClusteredLights(JobSystem& jobs);
+
+    ClusteredLights(const ClusteredLights&) = delete;
+    ClusteredLights& operator=(const ClusteredLights&) = delete;
+
+    // Боксы кластеров пересчитываются только при смене сетки или проекции
+    void SetGrid(const ClusterGridDesc& desc);
+    const ClusterGridDesc& Grid() const { return mDesc; }
+
+    // view - матрица вида DirectXMath (строки, левая система, z - вперёд)
+    void Build(const float view[4][4], const PointLight* lights, size_t count);
+
+    float ZScale() const { return mZScale; }
+    float ZBias() const { return mZBias; }
+
+    // Видимые источники в пространстве вида; индексы ссылаются на них
+    const std::vector<ClusterLight>& Lights() const { return mLights; }
+    // По два uint32 на кластер (x + CountX * (y + CountY * z)): смещение, число
+    const std::vector<uint32_t>& Ranges() const { return mRanges; }
+    const std::vector<uint32_t>& Indices() const { return mIndices; }
+    const ClusterStats& Stats() const { return mStats; }
+
+private:
+    void BuildBoxes();
+    void BinSlice(uint32_t z);
+
+    JobSystem& mJobs;
+    ClusterGridDesc mDesc;
+    float mZScale = 0.0f;
+    float mZBias = 0.0f;
+
+    // Границы слоёв по z и боксы плиток слоя по x, y (SoA, строка дополнена до 4)
+    std::vector<float> mSliceZ;     // CountZ + 1
+    uint32_t mRowPadded = 0;
+    std::vector<float> mMinX, mMaxX, mMinY, mMaxY;  // mRowPadded * CountY на слой
+
+    std::vector<ClusterLight> mLights;
+    std::vector<uint16_t> mFirstSlice, mLastSlice;  // Слои, которые задевает источник
+
+    std::vector<uint32_t> mSliceLists;   // MaxLightsPerCluster на кластер
+    std::vector<uint32_t> mCounts;       // Число в списке кластера
+    std::vector<uint32_t> mSliceTotals;  // Сумма по слою, затем смещение слоя
+    std::vector<uint32_t> mSliceOverflows;
+
+    std::vector<uint32_t> mRanges;
+    std::vector<uint32_t> mIndices;
+    ClusterStats mStats;
+};
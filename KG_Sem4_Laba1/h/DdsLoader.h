@@ -0,0 +1,67 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Значения совпадают с DXGI_FORMAT, чтобы загрузчик не зависел от dxgi.h
+namespace DdsFormat
+{
+    constexpr uint32_t Unknown = 0;
+    constexpr uint32_t R8G8B8A8_UNORM = 28;
+    constexpr uint32_t R8G8B8A8_UNORM_SRGB = 29;
+    constexpr uint32_t BC1_UNORM = 71;
+    constexpr uint32_t BC1_UNORM_SRGB = 72;
+    constexpr uint32_t BC2_UNORM = 74;
+    constexpr uint32_t BC2_UNORM_SRGB = 75;
+    constexpr uint32_t BC3_UNORM = 77;
+    constexpr uint32_t BC3_UNORM_SRGB = 78;
+    constexpr uint32_t BC4_UNORM = 80;
+    constexpr uint32_t BC4_SNORM = 81;
+    constexpr uint32_t BC5_UNORM = 83;
+    constexpr uint32_t BC5_SNORM = 84;
+    constexpr uint32_t B8G8R8A8_UNORM = 87;
+    constexpr uint32_t B8G8R8X8_UNORM = 88;
+    constexpr uint32_t B8G8R8A8_UNORM_SRGB = 91;
+    constexpr uint32_t BC6H_UF16 = 95;
+    constexpr uint32_t BC6H_SF16 = 96;
+    constexpr uint32_t BC7_UNORM = 98;
+    constexpr uint32_t BC7_UNORM_SRGB = 99;
+}
+
+// Подресурс лежит в файле как есть: Offset от начала файла, строки по RowPitch
+struct DdsSubresource
+{
+    size_t Offset = 0;
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint32_t RowPitch = 0; // байт на строку (для BC - на строку блоков 4x4)
+    uint32_t NumRows = 0;  // строк пикселей (для BC - строк блоков)
+};
+
+struct DdsImage
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint32_t MipCount = 0;
+    uint32_t ArraySize = 0; // для кубических карт - 6 * число кубов
+    uint32_t Format = DdsFormat::Unknown;
+    bool IsCubemap = false;
+
+    // В порядке D3D12: индекс = mip + slice * MipCount
+    std::vector<DdsSubresource> Subresources;
+};
+
+bool IsBlockCompressed(uint32_t format);
+uint32_t FormatBitsPerPixel(uint32_t format);
+
+// Разбирает заголовок (legacy или DX10) и раскладку подресурсов без копирования данных.
+// Отвергает то, что D3D12 всё равно не создаст: стороны больше 16384, массивы
+// длиннее 2048 слоёв, BC-текстуры со сторонами не кратными 4
+bool ParseDDS(const uint8_t* data, size_t size, DdsImage& outImage);
+
+// Несжатые подресурсы в порядке D3D12 (mip + slice * mipCount), строки без
+// выравнивания; заголовок всегда DX10
+bool SaveDDS(
+    const std::string& filename, uint32_t format, uint32_t width, uint32_t height,
+    uint32_t mipCount, uint32_t arraySize, const uint8_t* const* subresources);
@@ -0,0 +1,60 @@
+﻿#pragma once
+#include <cstdint>
+#include <map>
+#include "UploadRing.h"
+
+struct DescriptorAllocatorStats
+{
+    uint32_t PersistentUsed = 0;
+    uint32_t PersistentCapacity = 0;
+    uint32_t FreeRanges = 0;
+    uint32_t LargestFreeRange = 0; // Больше подряд не выделить без роста
+    uint32_t TransientUsed = 0;
+    uint32_t TransientPeak = 0;
+    uint32_t TransientCapacity = 0;
+    uint64_t Failures = 0;
+    uint32_t Grows = 0;
+};
+
+// Раздача дескрипторов CBV/SRV/UAV в две области:
+//  - постоянная: непрерывные диапазоны из списка свободных (лучший подходящий,
+//    соседние при освобождении сливаются); живут, пока их не вернут;
+//  - временная: кольцо на кадр, освобождается по fence, как UploadRing.
+// Хранит только смещения, кучи создаёт и копирует вызывающий.
+class DescriptorAllocator
+{
+public:
+    static constexpr uint32_t InvalidOffset = UINT32_MAX;
+
+    DescriptorAllocator(uint32_t persistentCapacity, uint32_t transientCapacity);
+
+    // InvalidOffset - нет непрерывного диапазона, нужен Resize
+    uint32_t AllocatePersistent(uint32_t count);
+    void FreePersistent(uint32_t offset, uint32_t count);
+
+    // Конец последнего занятого постоянного дескриптора: столько копировать при росте
+    uint32_t PersistentHighWater() const;
+
+    uint32_t AllocateTransient(uint32_t count);
+    void FinishFrame(uint64_t fenceValue);
+    void Reclaim(uint64_t completedValue);
+
+    // Постоянные диапазоны сохраняют смещения, кольцо начинается с нуля -
+    // GPU к этому моменту не должен читать временные дескрипторы
+    void Resize(uint32_t persistentCapacity, uint32_t transientCapacity);
+
+    uint32_t PersistentCapacity() const { return mPersistentCapacity; }
+    uint32_t TransientCapacity() const { return (uint32_t)mTransient.Capacity(); }
+    DescriptorAllocatorStats Stats() const;
+
+private:
+    void InsertFree(uint32_t offset, uint32_t count);
+
+    std::map<uint32_t, uint32_t> mFree; // смещение -> длина, соседей нет
+    uint32_t mPersistentCapacity = 0;
+    uint32_t mPersistentUsed = 0;
+
+    UploadRing mTransient;
+    uint64_t mFailures = 0;
+    uint32_t mGrows = 0;
+};
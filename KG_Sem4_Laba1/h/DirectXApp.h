@@ -11,11 +11,33 @@
 #include <wrl/client.h>
 #include "../h/ObjectConstants.h"
 #include "../h/Timer.h"
-#include "../h/UploadBuffer.h"
 #include "../h/vertex.h"
+#include "ClusteredLights.h"
+#include "DdsLoader.h"
+#include "DescriptorAllocator.h"
+#include "FrameGraph.h"
+#include "FrameScheduler.h"
+#include "FrustumCuller.h"
+#include "JobSystem.h"
+#include "LightmapBaker.h"
 #include "Material.h"
+#include "MappedFile.h"
 #include "MathHelper.h"
+#include "OcclusionCuller.h"
+#include "ParallelRecorder.h"
+#include "PotentiallyVisibleSet.h"
+#include "RenderQueue.h"
+#include "SectorStreamer.h"
+#include "ShaderCache.h"
+#include "SoftRasterizer.h"
+#include "StressScene.h"
 #include "Submesh.h"
+#include "TextureStreamer.h"
+#include "TlsfAllocator.h"
+#include "TransparentSorter.h"
+#include "TriangleBvh.h"
+#include "UploadRing.h"
+#include "VirtualTexture.h"
 #include "ThrowIfFailed.h"
 #include "Window.h"
 
@@ -72,9 +94,103 @@ private:
 
     std::vector<Submesh> mSubmeshes;
     std::vector<Material> mMaterials;
-    void CreateTextureFromTGA(
+    int CreateMaterialTexture(
         const std::string& path,
         Microsoft::WRL::ComPtr<ID3D12Resource>& texture);
+    int CreateTextureFromTGA(
+        const std::string& path,
+        Microsoft::WRL::ComPtr<ID3D12Resource>& texture);
+    int CreateTextureFromDDS(
+        const std::string& path,
+        Microsoft::WRL::ComPtr<ID3D12Resource>& texture);
+    void CreateTextureSrv(ID3D12Resource* texture, UINT srvHeapIndex);
+    Material* FindMaterial(const std::string& name);
+
+    // =========== GPU Memory ===========
+    // Ресурсы DEFAULT-кучи размещаются в больших кучах через TLSF: буферы и
+    // текстуры в разных кучах (Heap Tier 1). Не хватило места - добавляется
+    // куча, ресурс больше кучи получает свою. Память освобождается по fence.
+    static const UINT64 GpuHeapBytes = 64ull << 20;
+    static const UINT GpuHeapBuffers = 0;
+    static const UINT GpuHeapTextures = 1;
+
+    struct GpuHeap
+    {
+        ComPtr<ID3D12Heap> Heap;
+        TlsfAllocator Allocator;
+        UINT Kind;
+    };
+
+    struct GpuAllocation
+    {
+        UINT Heap = UINT_MAX;
+        TlsfAllocation Range;
+    };
+
+    std::vector<GpuHeap> mGpuHeaps;
+    FenceRetireQueue<GpuAllocation> mRetiredAllocations;
+
+    GpuAllocation PlaceResource(
+        UINT kind,
+        D3D12_RESOURCE_DESC desc,
+        D3D12_RESOURCE_STATES initialState,
+        ComPtr<ID3D12Resource>& resource);
+    void FreeGpuAllocation(const GpuAllocation& allocation);
+    TlsfStats GpuMemoryStats() const;
+
+    // =========== Texture Streaming ===========
+    struct StreamedTexture
+    {
+        DXGI_FORMAT Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+        UINT Width = 0;
+        UINT Height = 0;
+        UINT MipCount = 0;
+        UINT ArraySize = 1;
+
+        // Подресурсы (mip + slice * MipCount): первые FileMips мипов каждого слоя
+        // читаются прямо из отображённого файла (DDS - все, TGA - нулевой),
+        // остальные лежат в OwnedMips
+        std::vector<DdsSubresource> Subresources;
+        std::vector<std::vector<uint8_t>> OwnedMips;
+        std::shared_ptr<MappedFile> File;
+        UINT FileMips = 0;
+        UINT FileBytesPerPixel = 0; // 3 - BGR8 из TGA, альфа дописывается при копировании
+
+        Microsoft::WRL::ComPtr<ID3D12Resource> Resource; // Только резидентные мипы
+        GpuAllocation Memory;
+
+        const uint8_t* SubresourceData(UINT index) const
+        {
+            return index % MipCount < FileMips
+                ? File->Data() + Subresources[index].Offset
+                : OwnedMips[index].data();
+        }
+    };
+
+    static const UINT TextureStartupSize = 64;                  // При старте грузим мипы не больше 64x64
+    static const UINT64 TextureBudgetBytes = 256ull << 20;
+    static const UINT64 TextureUploadBytesPerFrame = 4ull << 20;
+
+    std::vector<StreamedTexture> mStreamedTextures;
+    TextureStreamer mTextureStreamer{ TextureBudgetBytes, TextureUploadBytesPerFrame };
+    std::vector<MipChange> mMipChanges;
+
+    // Новый ресурс смены мипов, в COPY_DEST
+    struct MipTarget
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> Texture;
+        GpuAllocation Memory;
+    };
+    std::vector<MipTarget> mMipTargets;
+    FenceRetireQueue<Microsoft::WRL::ComPtr<ID3D12Resource>> mRetiredResources; // Живут, пока их читает GPU
+    uint64_t mTextureBytesTouched = 0; // Байты, прочитанные и записанные CPU при загрузке текстур
+
+    void UpdateTextureStreaming(float fovY);
+    void PrepareTextureStreaming();
+    MipTarget CreateStreamedResource(UINT id, UINT newMip);
+    void RecordTextureStreaming();
+    void RecordTextureMipChange(UINT id, UINT oldMip, UINT newMip, const MipTarget& target);
+    int AddStreamedTexture(StreamedTexture&& streamed, UINT bitsPerPixel);
 
     DirectXApp* dxApp = nullptr;
 
@@ -93,7 +209,124 @@ private:
     ComPtr<ID3D12CommandAllocator> mDirectCmdListAlloc;
     ComPtr<ID3D12GraphicsCommandList> mCommandList;
     ComPtr<ID3D12Fence> mFence;
-    UINT64 mFenceValue = 0;
+
+    // =========== Jobs ===========
+    // Общий планировщик задач: отсечение, запись команд, построение BVH.
+    // Объявлен раньше всех, кто держит на него ссылку.
+    JobSystem mJobs;
+
+    // =========== Frames In Flight ===========
+    static const UINT FrameCount = 3;
+
+    // Отрисовки пишутся параллельно: задача на кусок очереди, у каждого куска
+    // свой список и свой аллокатор в каждом кадре
+    static const UINT RecordListCount = 8; // Не больше кусков, чем потоков в mJobs
+    static const size_t MinDrawsPerSlice = 256;
+
+    struct FrameResource
+    {
+        ComPtr<ID3D12CommandAllocator> CmdListAlloc;
+        ComPtr<ID3D12CommandAllocator> SliceAllocs[RecordListCount];
+    };
+
+    FrameResource mFrames[FrameCount];
+    FrameScheduler mFrameScheduler{ FrameCount };
+    double mFrameWaitMs = 0.0; // Ожидание GPU за секунду статистики
+
+    ComPtr<ID3D12GraphicsCommandList> mSliceLists[RecordListCount];
+    ParallelRecorder mRecorder{ mJobs };
+    std::vector<DrawSlice> mDrawSlices;
+
+    struct SliceBinds
+    {
+        UINT Tables = 0;
+        UINT Psos = 0;
+    };
+    SliceBinds mSliceBinds[RecordListCount];
+
+    void RecordDrawSlice(uint32_t slice, const DrawSlice& range, D3D12_GPU_VIRTUAL_ADDRESS cbAddress);
+
+    void BeginFrame();
+    void WaitForFence(UINT64 value);
+
+    // =========== Descriptors ===========
+    // Постоянные SRV материалов лежат в невидимой шейдерам куче и переписываются
+    // в любой момент; каждый кадр копирует их в своё место кольца видимой кучи.
+    // Не хватило места - обе кучи пересоздаются вдвое больше
+    static const UINT InitialSrvDescriptors = 256;
+
+    DescriptorAllocator mSrvAllocator{ InitialSrvDescriptors, (FrameCount + 1) * InitialSrvDescriptors };
+    ComPtr<ID3D12DescriptorHeap> mSrvStagingHeap;
+    std::vector<ComPtr<ID3D12Resource>> mSrvTextures; // Что записано в постоянные SRV
+    UINT mFrameSrvBase = 0;                           // Начало таблицы текущего кадра в mCbvHeap
+
+    bool CreateSrvHeaps(UINT persistentCapacity, UINT transientCapacity);
+    bool GrowSrvHeaps(UINT persistentCapacity);
+    UINT AllocateSrvs(UINT count);
+    void SyncFrameSrvs();
+    D3D12_GPU_DESCRIPTOR_HANDLE FrameDescriptor(UINT index) const;
+
+    // =========== Frame Graph ===========
+    // Проходы кадра объявляют, что читают и пишут; переходы между ними ставит граф.
+    // Временные цели (только RT/DS-текстуры) лежат в одной куче по смещениям
+    // из графа, размещённый ресурс пересоздаётся, только если сменилась раскладка.
+    // Вместе с ресурсом переписывается его RTV или DSV (по флагам описания)
+    struct GraphTargetDesc
+    {
+        D3D12_RESOURCE_DESC Desc = {};
+        D3D12_CPU_DESCRIPTOR_HANDLE View = {};
+        D3D12_CLEAR_VALUE Clear = {};   // Оптимальная очистка
+    };
+
+    struct GraphTarget
+    {
+        std::string Name;
+        UINT64 Offset = 0;
+        D3D12_RESOURCE_DESC Desc = {};
+        FrameGraphState Home = FrameGraphState::Undefined;
+        ComPtr<ID3D12Resource> Resource;
+    };
+
+    FrameGraph mFrameGraph;
+    std::vector<ID3D12Resource*> mGraphResources; // По FrameGraphResource
+    std::vector<GraphTargetDesc> mGraphDescs;     // Заполнены только у временных
+    ComPtr<ID3D12Heap> mTransientHeap;
+    UINT64 mTransientHeapSize = 0;
+    std::vector<GraphTarget> mGraphTargets;
+
+    FrameGraphResource ImportGraphResource(
+        const std::string& name,
+        ID3D12Resource* resource,
+        FrameGraphState initial,
+        FrameGraphState finalState = FrameGraphState::Undefined);
+    FrameGraphResource CreateGraphTarget(
+        const std::string& name,
+        const D3D12_RESOURCE_DESC& desc,
+        D3D12_CPU_DESCRIPTOR_HANDLE view,
+        const D3D12_CLEAR_VALUE& clear);
+    void BuildFrameGraph();
+    void RealizeGraphTargets();
+    void RecordGraphBarriers(ID3D12GraphicsCommandList* cmdList, const FrameGraphBarrier* barriers, size_t count) const;
+    void RecordClearPass();
+    void RecordScenePass();
+
+    // =========== Upload Ring ===========
+    static const UINT64 UploadRingBytes = 64ull << 20;
+
+    struct UploadAllocation
+    {
+        ID3D12Resource* Resource = nullptr;
+        UINT64 Offset = 0;
+        BYTE* Mapped = nullptr; // Уже со смещением
+    };
+
+    UploadRing mUploadRing{ UploadRingBytes };
+    ComPtr<ID3D12Resource> mUploadRingBuffer;
+    BYTE* mUploadRingMapped = nullptr;
+    UINT mUploadFallbacks = 0; // Отдельные буферы для того, что не влезло в кольцо
+
+    bool CreateUploadRing();
+    UploadAllocation AllocateUpload(UINT64 size, UINT64 alignment);
 
     // SwapChain
     ComPtr<IDXGISwapChain> mSwapChain;
@@ -104,8 +337,7 @@ private:
     // Дескрипторы
     ComPtr<ID3D12DescriptorHeap> mRtvHeap;
     ComPtr<ID3D12DescriptorHeap> mDsvHeap;
-    ComPtr<ID3D12DescriptorHeap> mCbvHeap;  // Для CBV дескрипторов
-    ComPtr<ID3D12Resource> mDepthStencilBuffer;
+    ComPtr<ID3D12DescriptorHeap> mCbvHeap;  // Видимая шейдерам: кольцо SRV-таблиц кадров
 
     UINT mRtvDescriptorSize = 0;
     UINT mDsvDescriptorSize = 0;
@@ -133,24 +365,290 @@ private:
 
     // =========== Geometry ===========
     std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
-    Microsoft::WRL::ComPtr<ID3D12Resource> mVertexBufferGPU;
-    Microsoft::WRL::ComPtr<ID3D12Resource> mVertexBufferUploader;
-    D3D12_VERTEX_BUFFER_VIEW mVertexBufferView;
-    Microsoft::WRL::ComPtr<ID3D12Resource> mIndexBufferGPU;
-    Microsoft::WRL::ComPtr<ID3D12Resource> mIndexBufferUploader;
-    D3D12_INDEX_BUFFER_VIEW mIndexBufferView;
 
     // =========== Shaders ===========
     Microsoft::WRL::ComPtr<ID3DBlob> mvsByteCode = nullptr;
-    Microsoft::WRL::ComPtr<ID3DBlob> mpsByteCode = nullptr;
+    Microsoft::WRL::ComPtr<ID3DBlob> mpsByteCode[MaterialPermutationCount]; // По ключу перестановки
+    Microsoft::WRL::ComPtr<ID3DBlob> mvsInstancedByteCode = nullptr; // shaders.hlsl с INSTANCED
+
+    // Байткод и кэшированные драйвером PSO на диске; промахи компилируются
+    // задачами параллельно, PSO тоже создаются задачами
+    ShaderCache mShaderCache{ "../cache" };
+    double mShaderMs = 0.0;    // Загрузка/компиляция шейдеров при старте
+    double mPsoMs = 0.0;       // Создание всех PSO при старте
+
+    // Бит (1 << ключ) для каждого ключа перестановки, который есть у материалов:
+    // только для них компилируются PS и создаются PSO
+    uint32_t mPermutations = 0;
+    uint32_t mTransparentPermutations = 0; // То же для полупрозрачных материалов
+
+    HRESULT CreateCachedPipelineState(
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC desc,
+        Microsoft::WRL::ComPtr<ID3D12PipelineState>& pso);
 
     // =========== Constant Buffer ===========
-    std::unique_ptr<UploadBuffer<ObjectConstants>> mObjectCB = nullptr;
+    // Общие для кадра константы; WVP своя у каждой отрисовки, а слот
+    // в кольцевом upload-буфере привязывается root CBV
+    ObjectConstants mFrameConstants;
+    XMFLOAT4X4 mViewProj = MathHelper::Identity4x4();
+    double mConstantFillUs = 0.0;   // За секунду статистики
+    UINT64 mConstantFillDraws = 0;
+
+    D3D12_GPU_VIRTUAL_ADDRESS WriteDrawConstants();
+
+    // =========== Culling ===========
+    FrustumCuller mSubmeshCuller;
+    std::vector<uint32_t> mVisibleDraws; // Индексы сабмешей для Draw
+    double mCullUs = 0.0;                // Время отсечения последнего кадра
+
+    static const UINT MaxOccluderTriangles = 4096;
+    static constexpr double OcclusionBudgetUs = 1000.0;
+
+    OcclusionCuller mOcclusionCuller{ mJobs, OcclusionBudgetUs };
+    bool mOcclusionCulling = true;
+
+    // PVS сабмешей по ячейкам сцены: запекается лучами по mSceneBvh при первом
+    // запуске и лежит в кэше шейдеров. P - вкл/выкл
+    static const UINT PvsCellsPerAxis = 32;     // По наибольшей стороне сцены
+    static const UINT PvsRaysPerCell = 2048;
+
+    PotentiallyVisibleSet mPvs;
+    bool mPvsCulling = true;
+    UINT mPvsRejected = 0;  // Отброшено PVS в последнем кадре
+
+    void BuildPvs();
+    void CullSubmeshes();
+
+    // =========== World Streaming ===========
+    // BuildObj режет сцену на сектора сетки XZ, у каждого свои вершинный и
+    // индексный буферы в кучах TLSF. SectorStreamer грузит их файлы вокруг
+    // камеры (с упреждением по её скорости), дальние выгружаются; отрисовки
+    // и экземпляры невыгруженных секторов отбрасываются до отсечения
+    static const UINT SectorsPerAxis = 8;
+    static constexpr float SectorLoadRadius = 1200.0f;
+    static constexpr float SectorUnloadRadius = 1600.0f;
+    static constexpr float SectorVisibleRadius = 1000.0f;  // Дальняя плоскость
+    static constexpr float SectorLookAhead = 1.5f;          // Секунд
+    static constexpr float VelocitySmoothing = 0.25f;       // Секунд
+
+    struct SectorGeometry
+    {
+        ComPtr<ID3D12Resource> VertexBuffer;
+        ComPtr<ID3D12Resource> IndexBuffer;
+        GpuAllocation VertexMemory;
+        GpuAllocation IndexMemory;
+        D3D12_VERTEX_BUFFER_VIEW VertexView = {};
+        D3D12_INDEX_BUFFER_VIEW IndexView = {};
+    };
+
+    // Пришедшие данные: буферы создаёт PrepareSectorStreaming, заполняет проход стриминга
+    struct SectorArrival
+    {
+        uint32_t Sector = 0;
+        SectorData Data;
+    };
+
+    SectorStreamer mSectorStreamer;
+    std::vector<SectorGeometry> mSectorGeometry;
+    std::vector<SectorArrival> mSectorArrivals;
+    std::vector<uint64_t> mResidentDraws;   // Бит на сабмеш: его сектор на GPU
+    std::vector<uint64_t> mCullMask;        // mResidentDraws и строка PVS
+    XMFLOAT3 mLastEyePos = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    XMFLOAT3 mEyeVelocity = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    uint64_t mSectorUploadBytes = 0;        // За секунду статистики
+
+    void BuildSectors();
+    void UpdateSectorStreaming(float dt);
+    void SetSectorResident(uint32_t sector, bool resident);
+    void PrepareSectorStreaming();
+    void RecordSectorUploads(ID3D12GraphicsCommandList* cmdList);
+
+    // =========== Render Queue ===========
+    // Видимые отрисовки, отсортированные по ключу (проход, PSO, материал, глубина).
+    // PSO в ключе - вариант конвейера в старших битах и ключ перестановки
+    // материала в младших: отрисовки одной перестановки идут подряд
+    static const uint32_t RenderPassOpaque = 0;
+    static const uint32_t RenderPassTransparent = 1;
+    static const uint32_t PsoSolid = 0;
+    static const uint32_t PsoWireframe = 1;
+    static const uint32_t PsoInstanced = 2;
+    static const uint32_t PsoInstancedWireframe = 3;
+    static const uint32_t PsoTransparent = 4;
+    static const uint32_t PsoInstancedTransparent = 5;
+    static constexpr float MaxSortDistance = 1000.0f; // Дальняя плоскость
+
+    RenderQueue mRenderQueue;
+    double mSortUs = 0.0;   // Время заполнения и сортировки последнего кадра
+    UINT mTableBinds = 0;   // Смен SRV-таблицы и PSO в последнем кадре
+    UINT mPsoBinds = 0;
+
+    static uint32_t PsoKey(uint32_t pipeline, uint32_t features)
+    {
+        return (pipeline << MaterialFeatureBits) | features;
+    }
+
+    // Полупрозрачные: порядок прошлого кадра досортировывается каждый кадр;
+    // mTransparentItems - отрисовка по id сортировщика
+    TransparentSorter mTransparentSorter;
+    std::vector<RenderItem> mTransparentItems;
+
+    void BuildRenderQueue();
+    ID3D12PipelineState* PipelineState(uint32_t pso) const;
+
+    // =========== Clustered Lighting ===========
+    // Точечные источники кружат внутри сцены. Каждый кадр ClusteredLights
+    // раскладывает их по кластерам пирамиды вида, а источники, диапазоны
+    // кластеров и индексы уходят в upload-кольцо и привязываются root SRV
+    // (t0-t2, space2). L - вкл/выкл: без освещения ambient 1 и кластеры пусты.
+    static const UINT LightCount = 256;
+    static const UINT LightSeed = 4321;
+    static constexpr float ClusterNear = 5.0f;     // Ближе - один слой
+    static constexpr float LightAmbient = 0.25f;
+
+    struct LightOrbit
+    {
+        float Center[3];
+        float Radius;
+        float Speed;    // Радиан в секунду
+        float Phase;
+    };
+
+    std::vector<PointLight> mPointLights;
+    std::vector<LightOrbit> mLightOrbits;
+    ClusteredLights mClusteredLights{ mJobs };
+    bool mLighting = true;
+    D3D12_GPU_VIRTUAL_ADDRESS mLightBuffers[3] = {}; // Источники, диапазоны, индексы
+
+    void BuildPointLights();
+    void UpdateLights(float totalTime, float fovY);
+    void WriteLightClusters();
+
+    // =========== Lightmaps ===========
+    // Вторые UV раскладывает BuildObj, свет солнца, неба и прямоугольной лампы
+    // с одним отскоком запекается LightmapBaker при первом запуске и лежит
+    // в кэше шейдеров массивом страниц DDS (t0, space3). В шейдере лайтмап
+    // заменяет ambient; экземпляры стресс-сцены его не читают. K - вкл/выкл
+    static const UINT LightmapPageSize = 1024;
+    static const UINT LightmapMaxPages = 4;
+    static const UINT LightmapIndirectSamples = 64;
+
+    LightmapBaker mLightmapBaker;
+    ComPtr<ID3D12Resource> mLightmapTexture;
+    int mLightmapStreamId = -1;
+    UINT mLightmapSrv = 0;
+    float mLightmapRange = 1.0f;
+    bool mLightmaps = true;
+
+    void BuildLightmaps();
+
+    // =========== Virtual Texturing ===========
+    // Самая большая карта непрозрачного материала читается тайлами: файл тайлов
+    // запекается при первом запуске в кэш шейдеров, физический кэш - текстура
+    // VtCacheSlots x VtCacheSlots тайлов, таблица страниц - R32_UINT (t0-t1, space4).
+    // PS пишет нужный тайл в буфер обратной связи (u0), следующий кадр копирует
+    // его в readback своего слота, BeginFrame этого слота отдаёт запросы в
+    // VirtualTextureSystem, а проход стриминга заливает выбранные тайлы.
+    static const UINT VtCacheSlots = 16;         // 2176x2176 BGRA8
+    static const UINT VtUploadsPerFrame = 16;
+    static const UINT VtFeedbackCell = 8;        // Пикселей по стороне ячейки
+    static const UINT VtStampPeriod = (1u << 24) - 1; // Метка кадра точна во float
+
+    VirtualTextureSystem mVirtualTextures{ VtCacheSlots, VtCacheSlots, VtUploadsPerFrame };
+    TileFile mVtTileFile;
+    int mVtMaterial = -1;
+    uint16_t mVtTexture = 0;
+    ComPtr<ID3D12Resource> mVtCache;
+    ComPtr<ID3D12Resource> mVtPageTable;         // Мипы друг под другом
+    ComPtr<ID3D12Resource> mVtFeedback;
+    ComPtr<ID3D12Resource> mVtReadback[FrameCount];
+    GpuAllocation mVtCacheMemory;
+    GpuAllocation mVtPageTableMemory;
+    GpuAllocation mVtFeedbackMemory;
+    UINT mVtSrv = 0;                             // Кэш и таблица страниц подряд
+    UINT mVtFeedbackPitch = 0;                   // Ячеек в строке
+    UINT mVtFeedbackCells = 0;
+    UINT mVtPageTableRows = 0;
+    std::vector<UINT> mVtMipRows;                // Первая строка мипа в таблице страниц
+    bool mVtFeedbackReady = false;               // Буфер обратной связи обнулён
+    uint64_t mVtFrame = 0;
+    uint32_t mVtReadbackStamp[FrameCount] = {};  // Чья обратная связь в readback слота, 0 - ничья
+    std::vector<uint64_t> mVtRequests;
+    std::vector<TileUpload> mVtUploads;          // Заливает проход стриминга
+    std::vector<uint8_t> mVtTileScratch;
+    VirtualTextureStats mVtStats;                // Сумма за секунду статистики
+
+    static uint32_t VtStamp(uint64_t frame) { return 1 + uint32_t(frame % VtStampPeriod); }
+
+    void BuildVirtualTexture();
+    void ReadVirtualTextureFeedback(UINT slot);
+    void PrepareVirtualTexture();
+    void RecordVirtualTextureUploads(ID3D12GraphicsCommandList* cmdList);
+
+    // =========== Stress Scene ===========
+    // Размноженные пропы Sponza для замеров стоимости отправки: I - вкл/выкл,
+    // J - партия одной инстансированной отрисовкой или по отрисовке на экземпляр
+    static const UINT StressSeed = 1234;
+    static const UINT StressGridX = 100;
+    static const UINT StressGridZ = 100;
+    static const UINT StressPropCount = 8;
+
+    std::vector<InstanceData> mInstances;
+    std::vector<InstanceBatch> mInstanceBatches;
+    ComPtr<ID3D12Resource> mInstanceBuffer;
+    bool mStressScene = false;
+    bool mStressInstanced = true;
+    double mSubmitUs = 0.0; // Константы, запись и отправка списков последнего кадра
+
+    void BuildStressScene();
+
+    // =========== Ray Queries ===========
+    // BVH по треугольникам сцены: выбор сабмеша мышью и столкновения камеры
+    static constexpr float CameraRadius = 10.0f;
+
+    TriangleBvh mSceneBvh;
+    int mPickedSubmesh = -1;
+    bool mCameraCollision = true;
+
+    void PickSubmesh(int x, int y);
+    XMVECTOR CollideCamera(FXMVECTOR from, FXMVECTOR to) const;
+
+    // =========== Software Rasterizer ===========
+    // F9 - текущий кадр программным растеризатором в ../frame_cpu.tga: те же
+    // видимые отрисовки и константы, что у GPU (без стресс-сцены и каркаса)
+    std::vector<Vertex> mCpuVertices;
+    std::vector<uint32_t> mCpuIndices;
+    std::vector<SoftTexture> mSoftTextures; // По две на материал, пустая - нет CPU-копии
+    std::unique_ptr<SoftRasterizer> mSoftRasterizer;
+    double mSoftFrameMs = 0.0;
+
+    void BuildSoftTextures();
+    void RenderSoftFrame();
+
+    // =========== Camera Path ===========
+    // Запись и проигрывание пути камеры для замеров отсечения
+    struct CameraKey
+    {
+        XMFLOAT3 Position;
+        float Yaw;
+        float Pitch;
+    };
+
+    std::vector<CameraKey> mCameraPath;
+    bool mRecordingPath = false;
+    bool mPlayingPath = false;
+    size_t mPlaybackFrame = 0;
+    UINT64 mPathTested = 0;
+    UINT64 mPathOccluded = 0;
 
     // =========== Root Signature и PSO ===========
     Microsoft::WRL::ComPtr<ID3D12RootSignature> mRootSignature;
-    Microsoft::WRL::ComPtr<ID3D12PipelineState> mPSO;
-    Microsoft::WRL::ComPtr<ID3D12PipelineState> mWireframePSO;  // Второй PSO для проволочного каркаса
+    // Каждый - по ключу перестановки материала
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mPSO[MaterialPermutationCount];
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mWireframePSO[MaterialPermutationCount];  // Проволочный каркас
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mInstancedPSO[MaterialPermutationCount];
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mInstancedWireframePSO[MaterialPermutationCount];
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mTransparentPSO[MaterialPermutationCount];  // Смешивание, без записи глубины
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mInstancedTransparentPSO[MaterialPermutationCount];
     bool mWireframeMode = false;  // Флаг режима отображения
 
     // Математика для камеры
@@ -175,22 +673,19 @@ private:
     void QueryDescriptorSizes();
     bool CreateDescriptorHeaps();
     bool CreateRenderTargetViews();
-    bool CreateDepthStencilBuffer();
     void CreateViewportAndScissor();
-    void SetViewportAndScissor();
+    void SetViewportAndScissor(ID3D12GraphicsCommandList* cmdList);
 
     // Методы для геометрии и шейдеров
     void BuildInputLayout();
     //void BuildVertexBuffer();
     //void BuildIndexBuffer();
     void BuildShaders();
-    void BuildConstantBuffer();
     void BuildRootSignature();
-    void BuildPSO();
-    void BuildWireframePSO();  // Новый метод для создания проволочного PSO
-    void CreateColorTexture(
-        const DirectX::XMFLOAT3& color,
-        Microsoft::WRL::ComPtr<ID3D12Resource>& texture);
+    void BuildPSO(uint32_t features);
+    void BuildWireframePSO(uint32_t features);  // Проволочный каркас
+    void BuildInstancedPSOs(uint32_t features);
+    void BuildTransparentPSOs(uint32_t features);
 
     // Методы для доступа к ресурсам
     ID3D12Resource* CurrentBackBuffer() const;
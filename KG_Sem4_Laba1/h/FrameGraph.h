@@ -0,0 +1,155 @@
+﻿#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Состояния без привязки к API: DirectXApp переводит их в D3D12_RESOURCE_STATES
+enum class FrameGraphState : uint8_t
+{
+    Undefined,    // Нет требования (конечное состояние импортированного ресурса)
+    Present,
+    RenderTarget,
+    DepthWrite,
+    DepthRead,
+    ShaderRead,
+    CopySource,
+    CopyDest,
+    VertexBuffer,
+    IndexBuffer,
+    UnorderedAccess,
+};
+
+using FrameGraphResource = uint32_t;
+using FrameGraphPass = uint32_t;
+
+struct FrameGraphBarrier
+{
+    enum class Kind : uint8_t
+    {
+        Transition,
+        Aliasing,     // Resource занимает память Before; Before == Invalid - любого
+    };
+
+    Kind Type = Kind::Transition;
+    FrameGraphResource Resource = 0;
+    FrameGraphResource Before = 0;
+    FrameGraphState From = FrameGraphState::Undefined;
+    FrameGraphState To = FrameGraphState::Undefined;
+};
+
+struct FrameGraphStats
+{
+    uint32_t Passes = 0;
+    uint32_t CulledPasses = 0;
+    uint32_t Barriers = 0;
+    uint32_t Batches = 0;         // Непустых ResourceBarrier
+    uint32_t Transients = 0;
+    uint64_t TransientBytes = 0;  // Каждый временный ресурс в своей памяти
+    uint64_t HeapBytes = 0;       // После наложения
+};
+
+// Граф кадра: проходы объявляют, что читают и пишут и в каком состоянии,
+// Compile выбрасывает проходы, чей результат никому не нужен, расставляет
+// переходы пачками перед проходами и раскладывает временные ресурсы с
+// непересекающимися временами жизни в одну память. Порядок - порядок
+// объявления (зависимости всегда смотрят назад). Ни ресурсов, ни списков
+// команд граф не создаёт: смещения и барьеры переводит в D3D12 вызывающий.
+//
+// Проход нужен, если у него есть побочный эффект или он пишет ресурс, который
+// читает нужный проход позже, или импортированный ресурс с конечным состоянием.
+//
+// Временный ресурс между кадрами живёт в «домашнем» состоянии - состоянии первой
+// записи (в нём его и создают); после последнего использования граф возвращает
+// его туда. Первым использованием должна быть запись, очищающая содержимое:
+// память могла достаться от другого ресурса.
+class FrameGraph
+{
+public:
+    static constexpr uint32_t Invalid = UINT32_MAX;
+
+    // Проходы и ресурсы прошлого кадра забываются, ёмкость массивов остаётся
+    void Reset();
+
+    FrameGraphResource Import(const std::string& name, FrameGraphState initial, FrameGraphState finalState = FrameGraphState::Undefined);
+    FrameGraphResource CreateTransient(const std::string& name, uint64_t sizeBytes, uint64_t alignment);
+
+    FrameGraphPass AddPass(const std::string& name, std::function<void()> execute, bool sideEffect = false);
+    void Read(FrameGraphPass pass, FrameGraphResource resource, FrameGraphState state);
+    void Write(FrameGraphPass pass, FrameGraphResource resource, FrameGraphState state);
+
+    // std::runtime_error при чтении временного ресурса до записи и при разных
+    // состояниях одного ресурса внутри прохода
+    void Compile();
+
+    // Для каждого оставшегося прохода: его барьеры (если есть), затем сам проход
+    void Execute(const std::function<void(const FrameGraphBarrier*, size_t)>& recordBarriers) const;
+
+    // После последнего прохода: импортированные - в конечное состояние,
+    // временные - в домашнее
+    const std::vector<FrameGraphBarrier>& FinalBarriers() const { return mFinalBarriers; }
+
+    const std::vector<FrameGraphPass>& Order() const { return mOrder; }
+    const std::vector<FrameGraphBarrier>& Barriers(FrameGraphPass pass) const { return mPasses[pass].Barriers; }
+    bool IsCulled(FrameGraphPass pass) const { return mPasses[pass].Culled; }
+    const std::string& PassName(FrameGraphPass pass) const { return mPasses[pass].Name; }
+
+    // Для временных: Invalid, если ресурс никто не использует
+    uint64_t TransientOffset(FrameGraphResource resource) const { return mResources[resource].Offset; }
+    FrameGraphState HomeState(FrameGraphResource resource) const { return mResources[resource].Home; }
+    uint64_t HeapSize() const { return mStats.HeapBytes; }
+    uint64_t HeapAlignment() const { return mHeapAlignment; }
+
+    const std::string& ResourceName(FrameGraphResource resource) const { return mResources[resource].Name; }
+    size_t ResourceCount() const { return mResources.size(); }
+    bool IsTransient(FrameGraphResource resource) const { return !mResources[resource].Imported; }
+
+    const FrameGraphStats& Stats() const { return mStats; }
+
+private:
+    struct Use
+    {
+        FrameGraphResource Resource;
+        FrameGraphState State;
+        bool Write;
+    };
+
+    struct Pass
+    {
+        std::string Name;
+        std::function<void()> Execute;
+        bool SideEffect = false;
+        bool Culled = false;
+        std::vector<Use> Uses;
+        std::vector<FrameGraphBarrier> Barriers;
+    };
+
+    struct Resource
+    {
+        std::string Name;
+        bool Imported = false;
+        FrameGraphState Initial = FrameGraphState::Undefined;
+        FrameGraphState Final = FrameGraphState::Undefined;
+        uint64_t Size = 0;
+        uint64_t Alignment = 1;
+
+        // Результаты Compile; First/Last - позиции в mOrder
+        uint32_t First = Invalid;
+        uint32_t Last = Invalid;
+        FrameGraphState Home = FrameGraphState::Undefined;
+        uint64_t Offset = Invalid;
+    };
+
+    void AddUse(FrameGraphPass pass, FrameGraphResource resource, FrameGraphState state, bool write);
+    void CullPasses();
+    void ComputeLifetimes();
+    void PlaceTransients();
+    void BuildBarriers();
+
+    std::vector<Pass> mPasses;
+    std::vector<Resource> mResources;
+    std::vector<FrameGraphPass> mOrder;
+    std::vector<FrameGraphBarrier> mFinalBarriers;
+    uint64_t mHeapAlignment = 1;
+    FrameGraphStats mStats;
+};
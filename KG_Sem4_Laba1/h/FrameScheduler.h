@@ -0,0 +1,86 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct FrameSchedulerStats
+{
+    uint64_t FramesSubmitted = 0;
+    uint64_t FramesWaited = 0; // кадры, на которых CPU догнал GPU и ждал слот
+};
+
+// Кольцо из frameCount кадров в полёте. Сам fence не трогает: вызывающий
+// сигналит и ждёт значения, которые выдаёт планировщик, а сюда передаёт
+// последнее завершённое GPU значение.
+class FrameScheduler
+{
+public:
+    explicit FrameScheduler(uint32_t frameCount);
+
+    uint32_t FrameCount() const { return (uint32_t)mSlotFences.size(); }
+    uint32_t CurrentSlot() const { return mSlot; }
+
+    // Значение fence, которое нужно дождаться перед записью в текущий слот (0 - слот свободен)
+    uint64_t BeginFrame(uint64_t completedValue);
+
+    // Значение для Signal после отправки кадра; слот переходит к следующему
+    uint64_t EndFrame();
+
+    // Внеочередной Signal (например, для полного ожидания очереди)
+    uint64_t Signal() { return ++mLastSignaled; }
+
+    uint64_t LastSignaled() const { return mLastSignaled; }
+
+    // Значение, которое получит текущий кадр в EndFrame
+    uint64_t PendingFenceValue() const { return mLastSignaled + 1; }
+
+    const FrameSchedulerStats& Stats() const { return mStats; }
+
+private:
+    std::vector<uint64_t> mSlotFences;
+    uint32_t mSlot = 0;
+    uint64_t mLastSignaled = 0;
+    FrameSchedulerStats mStats;
+};
+
+// Объекты, которые GPU может ещё читать: живут, пока fence не дойдёт до их значения
+template <typename T>
+class FenceRetireQueue
+{
+public:
+    void Retire(T item, uint64_t fenceValue)
+    {
+        mItems.push_back({ std::move(item), fenceValue });
+    }
+
+    // Освобождает всё, что завершено к completedValue; значения не убывают,
+    // поэтому достаточно снять префикс
+    size_t Collect(uint64_t completedValue)
+    {
+        size_t count = 0;
+        while (count < mItems.size() && mItems[count].second <= completedValue)
+            count++;
+
+        mItems.erase(mItems.begin(), mItems.begin() + count);
+        return count;
+    }
+
+    // То же, но каждый снятый объект сначала отдаётся release
+    template <typename Release>
+    size_t Collect(uint64_t completedValue, Release&& release)
+    {
+        size_t count = 0;
+        while (count < mItems.size() && mItems[count].second <= completedValue)
+            release(mItems[count++].first);
+
+        mItems.erase(mItems.begin(), mItems.begin() + count);
+        return count;
+    }
+
+    void Clear() { mItems.clear(); }
+    size_t Size() const { return mItems.size(); }
+
+private:
+    std::vector<std::pair<T, uint64_t>> mItems;
+};
@@ -0,0 +1,36 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include "Aabb.h"
+
+// Плоскости (a, b, c, d): точка внутри, если a*x + b*y + c*z + d >= 0
+struct FrustumPlanes
+{
+    float Planes[6][4] = {};
+};
+
+// viewProj - матрица DirectXMath в строковом порядке (clip = [x y z 1] * M), глубина 0..w
+void ExtractFrustumPlanes(const float viewProj[4][4], FrustumPlanes& out);
+
+// Боксы хранятся SoA (центр и полуразмер по осям), массивы дополнены до кратного 4,
+// так что тест идёт по четыре бокса за раз
+class FrustumCuller
+{
+public:
+    void Clear();
+    uint32_t Add(const Aabb& box);
+    void Set(uint32_t index, const Aabb& box);
+    uint32_t Count() const { return mCount; }
+
+    // Индексы боксов, пересекающих пирамиду видимости. mask - бит на бокс
+    // (слово - 64 бокса), например строка PVS: боксы с нулевым битом не проверяются
+    void Cull(const FrustumPlanes& frustum, std::vector<uint32_t>& visible, const uint64_t* mask = nullptr) const;
+
+    // То же без SIMD - для сравнения
+    void CullScalar(const FrustumPlanes& frustum, std::vector<uint32_t>& visible, const uint64_t* mask = nullptr) const;
+
+private:
+    std::vector<float> mCenterX, mCenterY, mCenterZ;
+    std::vector<float> mExtentX, mExtentY, mExtentZ;
+    uint32_t mCount = 0;
+};
@@ -0,0 +1,115 @@
+﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+struct Job
+{
+    std::function<void()> Task;
+    class JobCounter* Counter = nullptr; // Уменьшается, когда задача выполнена
+};
+
+// Счётчик незавершённых задач. Задачи, запущенные после него (RunAfter),
+// ждут здесь, пока счётчик не станет нулём, и только потом попадают в очереди.
+class JobCounter
+{
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool IsDone() const { return mValue.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> mValue{ 0 };
+    std::mutex mMutex;
+    std::vector<Job*> mContinuations;
+};
+
+// Дек Чейза - Лева: владелец кладёт и берёт с нижнего конца без блокировок,
+// остальные потоки крадут с верхнего. Ёмкость фиксирована - если дек полон,
+// Push возвращает false и задача выполняется сразу.
+class WorkStealingDeque
+{
+public:
+    static const int64_t Capacity = 4096;
+
+    bool Push(Job* job);
+    Job* Pop();
+    Job* Steal();
+
+private:
+    alignas(64) std::atomic<int64_t> mTop{ 0 };
+    alignas(64) std::atomic<int64_t> mBottom{ 0 };
+    std::atomic<Job*> mJobs[Capacity] = {};
+};
+
+struct JobSystemStats
+{
+    uint64_t Executed = 0;
+    uint64_t Stolen = 0;
+};
+
+// Планировщик задач с кражей работы. Поток, создавший систему, - участник 0,
+// у него и у каждого рабочего потока свой дек. Ожидание (Wait) не простаивает,
+// а выполняет чужие задачи, поэтому задачи могут ждать вложенные задачи.
+class JobSystem
+{
+public:
+    // workerCount - потоков помимо создавшего; 0 - по числу ядер
+    explicit JobSystem(uint32_t workerCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    uint32_t ThreadCount() const { return (uint32_t)mDeques.size(); }
+
+    void Run(std::function<void()> task, JobCounter* counter = nullptr);
+
+    // Задача станет доступной, когда dependency дойдёт до нуля
+    void RunAfter(JobCounter& dependency, std::function<void()> task, JobCounter* counter = nullptr);
+
+    // Выполняет задачи, пока counter не станет нулём
+    void Wait(JobCounter& counter);
+
+    // body(begin, end) по кускам [0, count). grain = 0 - около четырёх кусков на поток
+    void ParallelFor(uint32_t count, const std::function<void(uint32_t begin, uint32_t end)>& body, uint32_t grain = 0);
+
+    JobSystemStats Stats() const;
+
+private:
+    void Submit(Job* job);
+    void Execute(Job* job);
+    Job* FindJob(uint32_t self);
+    void WorkerLoop(uint32_t index);
+    uint32_t CurrentIndex() const;
+
+    std::vector<std::unique_ptr<WorkStealingDeque>> mDeques;
+    std::vector<std::thread> mWorkers;
+
+    // Задачи от потоков вне системы
+    std::mutex mInjectMutex;
+    std::vector<Job*> mInjected;
+    std::atomic<uint32_t> mInjectedCount{ 0 };
+
+    // Засыпание рабочих, когда задач нет
+    std::mutex mSleepMutex;
+    std::condition_variable mWake;
+    std::atomic<int64_t> mQueued{ 0 };
+    std::atomic<uint32_t> mSleeping{ 0 };
+    std::atomic<bool> mQuit{ false };
+
+    std::atomic<uint64_t> mExecuted{ 0 };
+    std::atomic<uint64_t> mStolen{ 0 };
+};
@@ -0,0 +1,170 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "JobSystem.h"
+#include "TriangleBvh.h"
+
+// Вершины как есть (например, Vertex): позиция и нормаль по смещениям
+struct LightmapMesh
+{
+    const uint8_t* Vertices = nullptr;
+    size_t VertexStride = 0;
+    size_t PositionOffset = 0;
+    size_t NormalOffset = 0;
+    uint32_t VertexCount = 0;
+    const uint32_t* Indices = nullptr;
+    size_t IndexCount = 0;
+};
+
+// Вторые UV вершины: координаты в странице атласа и номер страницы
+struct LightmapUv
+{
+    float U = 0.0f;
+    float V = 0.0f;
+    float Page = 0.0f;
+};
+
+struct LightmapUnwrapDesc
+{
+    uint32_t PageSize = 1024;
+    uint32_t MaxPages = 8;
+    float Fill = 0.6f;          // Доля страниц под карты при выборе плотности
+    uint32_t Gutter = 2;        // Пустых текселей между картами (фильтрация и мипы)
+    float ChartCos = 0.9f;      // Косинус угла между нормалями треугольников одной карты
+};
+
+// Отрисовка для запекания: её треугольники в индексном буфере и отражающая способность
+struct LightmapDraw
+{
+    uint32_t FirstTriangle = 0;
+    uint32_t TriangleCount = 0;
+    float Albedo[3] = { 0.5f, 0.5f, 0.5f };
+    bool SeeThrough = false;    // Альфа-тест и полупрозрачные: лучи идут сквозь них
+};
+
+// Прямоугольник, светящий в сторону EdgeU x EdgeV
+struct LightmapAreaLight
+{
+    float Corner[3] = {};
+    float EdgeU[3] = { 1.0f, 0.0f, 0.0f };
+    float EdgeV[3] = { 0.0f, 0.0f, 1.0f };
+    float Color[3] = { 1.0f, 1.0f, 1.0f }; // Яркость поверхности источника
+};
+
+struct LightmapBakeDesc
+{
+    float SunDirection[3] = { 0.3f, 1.0f, 0.2f };   // На солнце
+    float SunColor[3] = { 1.0f, 0.95f, 0.85f };     // Освещённость при нормальном падении
+    float SunAngle = 0.01f;                         // Угловой радиус диска, рад: мягкость теней
+    float SkyColor[3] = { 0.2f, 0.25f, 0.3f };      // Освещённость от полностью открытого неба
+    uint32_t SunSamples = 8;
+    uint32_t AreaSamples = 8;       // На источник
+    uint32_t IndirectSamples = 64;
+    uint32_t SeeThroughLayers = 4;  // Сколько раз луч продолжается за SeeThrough
+    uint32_t DenoisePasses = 3;     // Шаги à-trous 1, 2, 4...
+    float Range = 4.0f;             // В RGBA8 хранится освещённость / Range
+    uint32_t Seed = 1;
+};
+
+struct LightmapStats
+{
+    uint32_t Charts = 0;
+    uint32_t Pages = 0;
+    float TexelsPerUnit = 0.0f;
+    uint32_t Texels = 0;        // Покрытых треугольниками
+    uint64_t Rays = 0;
+    double UnwrapMs = 0.0;
+    double TraceMs = 0.0;
+    double DenoiseMs = 0.0;
+    double BakeMs = 0.0;        // Всё запекание, с растеризацией, шумоподавлением и мипами
+    double RaysPerSecond = 0.0;
+};
+
+// Лайтмапы статичной сцены. Unwrap режет сцену на карты - связные куски
+// треугольников с близкими нормалями, каждая проецируется на плоскость нормали
+// первого треугольника - и раскладывает их полками по страницам атласа
+// (плотность текселей общая, подбирается под число страниц). Bake растеризует
+// треугольники в тексели, из каждого пускает пакеты лучей по TriangleBvh
+// (тексели считаются задачами JobSystem): прямой свет солнца и прямоугольных
+// источников и один отскок от них, плюс открытое небо. Непрямая часть шумит -
+// её сглаживает à-trous с весами по нормали, положению и яркости (допуск по
+// дисперсии выборок текселя), затем строятся мипы
+// по покрытым текселям. Save пишет страницы массивом текстур RGBA8 в DDS.
+// Вершины у углов треугольников не общие (как у LoadOBJ): у каждой - своя карта.
+class LightmapBaker
+{
+public:
+    // outUvs - по вершине mesh
+    void Unwrap(const LightmapMesh& mesh, const LightmapUnwrapDesc& desc, std::vector<LightmapUv>& outUvs);
+
+    // Та же сетка, что у Unwrap; bvh построен по ней же
+    void Bake(
+        const LightmapMesh& mesh, const TriangleBvh& bvh, const std::vector<LightmapDraw>& draws,
+        const std::vector<LightmapAreaLight>& areaLights, const LightmapBakeDesc& desc, JobSystem& jobs);
+
+    // Массив страниц R8G8B8A8_UNORM с полной цепочкой мипов; альфа - покрытие
+    bool Save(const std::string& path) const;
+
+    uint32_t PageSize() const { return mUnwrap.PageSize; }
+    uint32_t PageCount() const { return mStats.Pages; }
+    const uint8_t* PagePixels(uint32_t page) const { return mMips[page * mMipCount].data(); }
+    const LightmapStats& Stats() const { return mStats; }
+
+private:
+    struct Chart
+    {
+        uint32_t FirstTriangle = 0;     // В mChartTriangles
+        uint32_t TriangleCount = 0;
+        float Axis[2][3] = {};
+        float Min[2] = {};
+        float Max[2] = {};
+        float Density = 0.0f;           // Текселей на единицу длины
+        uint32_t Width = 0;             // Прямоугольник в атласе с отступом Gutter справа и снизу
+        uint32_t Height = 0;
+        uint32_t X = 0;
+        uint32_t Y = 0;
+        uint32_t Page = 0;
+    };
+
+    struct Texel
+    {
+        uint32_t Pixel = 0;     // page * PageSize^2 + y * PageSize + x
+        uint32_t Triangle = 0;
+        float B1 = 0.0f;        // Барицентрические координаты центра (или ближайшей точки треугольника)
+        float B2 = 0.0f;
+        float Distance = 0.0f;  // От центра до треугольника, текселей
+        float Position[3] = {};
+        float Normal[3] = {};
+        float Offset[3] = {};   // Начало лучей: над поверхностью по геометрической нормали
+        float Size = 0.0f;      // Размер текселя в мире
+    };
+
+    void BuildCharts(
+        const LightmapMesh& mesh, const std::vector<float>& normals, const std::vector<uint32_t>& neighbourStart,
+        const std::vector<uint32_t>& neighbours, float density);
+    bool Pack();
+    void Rasterize(const LightmapMesh& mesh);
+    void TraceTexels(
+        const LightmapMesh& mesh, const TriangleBvh& bvh, const std::vector<LightmapDraw>& draws,
+        const std::vector<LightmapAreaLight>& areaLights, const LightmapBakeDesc& desc, JobSystem& jobs);
+    void Denoise(uint32_t passes, JobSystem& jobs);
+    void BuildMips(const LightmapBakeDesc& desc, JobSystem& jobs);
+
+    LightmapUnwrapDesc mUnwrap;
+    std::vector<Chart> mCharts;
+    std::vector<uint32_t> mChartTriangles;
+    std::vector<uint32_t> mTriangleChart;
+    std::vector<float> mCornerTexels;       // x, y в странице на угол треугольника
+
+    std::vector<Texel> mTexels;
+    std::vector<uint32_t> mPixelTexels;     // Пиксель страницы -> тексель (UINT32_MAX - пусто)
+    std::vector<float> mDirect;             // RGB на тексель
+    std::vector<float> mIndirect;
+    std::vector<float> mVariance;           // Дисперсия яркости непрямой части на тексель
+
+    uint32_t mMipCount = 0;
+    std::vector<std::vector<uint8_t>> mMips;    // Порядок D3D12: mip + page * mMipCount
+    LightmapStats mStats;
+};
@@ -0,0 +1,31 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Файл, отображённый в память только для чтения
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+
+    const uint8_t* Data() const { return mData; }
+    size_t Size() const { return mSize; }
+
+private:
+#ifdef _WIN32
+    void* mFile = nullptr;    // HANDLE
+    void* mMapping = nullptr; // HANDLE
+#else
+    int mFd = -1;
+#endif
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+};
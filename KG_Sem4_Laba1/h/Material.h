@@ -1,9 +1,22 @@
-#pragma once
+﻿#pragma once
 
 #include <string>
 #include <wrl/client.h>
 #include <d3d12.h>
 
+// Возможности материала - define'ы пиксельного шейдера. Маска из них - ключ
+// перестановки: по нему выбирается заранее собранный PSO
+enum MaterialFeature : uint32_t
+{
+    MaterialFeatureMap1 = 1u << 0,       // HAS_MAP1: первая карта, иначе цвет gColor1
+    MaterialFeatureMap2 = 1u << 1,       // HAS_MAP2: вторая карта, иначе цвет gColor2
+    MaterialFeatureAlphaTest = 1u << 2,  // ALPHA_TEST: отсечение по альфе первой карты (map_d)
+    MaterialFeatureVirtual = 1u << 3,    // VIRTUAL_TEXTURE: первая карта - тайлы виртуальной текстуры
+};
+
+constexpr uint32_t MaterialFeatureBits = 4;
+constexpr uint32_t MaterialPermutationCount = 1u << MaterialFeatureBits;
+
 struct Material
 {
     std::string Name;
@@ -16,4 +29,14 @@ struct Material
 
     Microsoft::WRL::ComPtr<ID3D12Resource> DiffuseTexture1;
     Microsoft::WRL::ComPtr<ID3D12Resource> DiffuseTexture2;
+
+    int StreamId1 = -1;           // Индекс в TextureStreamer (-1 - карты нет)
+    int StreamId2 = -1;
+
+    float Color1[3] = { 1.0f, 1.0f, 1.0f }; // Цвет вместо карты (StreamId == -1)
+    float Color2[3] = { 1.0f, 1.0f, 1.0f };
+
+    uint32_t Features = 0;        // MaterialFeature*, ключ перестановки шейдера
+    bool Transparent = false;     // Полупрозрачная map_d: смешивание, проход от дальних к ближним
+    float AlphaCutoff = 0.5f;     // ALPHA_TEST: порог маски; у полупрозрачных - только почти пустое
 };
\ No newline at end of file
@@ -0,0 +1,22 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include "TgaLoader.h"
+
+// Полное число мипов до 1x1
+uint32_t FullMipCount(uint32_t width, uint32_t height);
+
+// TGA хранит пиксели как BGR(A) - дополняем до BGRA8 (DXGI_FORMAT_B8G8R8A8_UNORM)
+void TgaToBGRA(const TgaImage& image, std::vector<uint8_t>& out);
+
+// Одна строка BGR(A) -> BGRA8, dst может указывать прямо в upload-буфер
+void TgaRowToBGRA(const uint8_t* src, uint32_t width, uint32_t channels, uint8_t* dst);
+
+// Первый уменьшенный мип прямо из пикселей TGA, без BGRA-копии исходного размера
+void DownsampleTgaToBGRA(const TgaView& view, std::vector<uint8_t>& dst);
+
+// Уменьшает BGRA8 изображение вдвое box-фильтром 2x2, нечётный край дублируется
+void DownsampleBGRA(const std::vector<uint8_t>& src, uint32_t width, uint32_t height, std::vector<uint8_t>& dst);
+
+// Полная цепочка мипов BGRA8, mips[0] - исходный размер
+void BuildMipChain(const TgaImage& image, std::vector<std::vector<uint8_t>>& mips);
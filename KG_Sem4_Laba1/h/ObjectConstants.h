@@ -4,13 +4,27 @@
 struct ObjectConstants
 {
     DirectX::XMFLOAT4X4 mWorldViewProj;
+    DirectX::XMFLOAT4X4 mWorldView;        // Для освещения в пространстве вида
     DirectX::XMFLOAT4 mUVTransform;      // xy = scale, zw = offset
-    DirectX::XMFLOAT4 mBlendFactor;      // x = blend factor для интерполяции текстур
+    DirectX::XMFLOAT4 mBlendFactor;      // x = blend factor для интерполяции текстур, y = порог ALPHA_TEST
+    DirectX::XMFLOAT4 mColor1;           // Цвет материала вместо первой карты (без HAS_MAP1)
+    DirectX::XMFLOAT4 mColor2;           // То же для второй (без HAS_MAP2)
+    DirectX::XMFLOAT4 mClusterTile;      // xy = плиток на пиксель, z/w = масштаб и сдвиг слоя по log(z)
+    DirectX::XMFLOAT4 mClusterGrid;      // xyz = число кластеров, w = ambient
+    DirectX::XMFLOAT4 mLightmap;         // x = 1 - свет из лайтмапа вместо ambient, y = Range
+    DirectX::XMFLOAT4 mVirtual;          // xy = размер виртуальной текстуры, z = ячеек обратной связи в строке, w = метка кадра
 
     ObjectConstants()
     {
         DirectX::XMStoreFloat4x4(&mWorldViewProj, DirectX::XMMatrixIdentity());
+        DirectX::XMStoreFloat4x4(&mWorldView, DirectX::XMMatrixIdentity());
         mUVTransform = DirectX::XMFLOAT4(1.0f, 1.0f, 0.0f, 0.0f);
         mBlendFactor = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+        mColor1 = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+        mColor2 = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+        mClusterTile = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+        mClusterGrid = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+        mLightmap = DirectX::XMFLOAT4(0.0f, 1.0f, 0.0f, 0.0f);
+        mVirtual = DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
     }
 };
\ No newline at end of file
@@ -0,0 +1,71 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include "Aabb.h"
+#include "JobSystem.h"
+
+struct OcclusionStats
+{
+    uint32_t OccluderTriangles = 0; // растеризовано в последнем кадре
+    uint32_t Tested = 0;
+    uint32_t Occluded = 0;
+    double RenderUs = 0.0;          // растеризация и иерархия
+};
+
+// Программный отсекатель перекрытых объектов. Крупнейшие треугольники сцены
+// растеризуются в маленький буфер глубины (SSE, по 4 пикселя), по нему строится
+// иерархия min/max, и боксы проверяются по ней до записи отрисовок.
+// Глубина - z/w из матрицы DirectXMath (0 - ближняя плоскость).
+class OcclusionCuller
+{
+public:
+    static const uint32_t Width = 256;
+    static const uint32_t Height = 128;
+
+    // Буфер делится на полосы по числу потоков jobs, полосы растеризуются задачами
+    OcclusionCuller(JobSystem& jobs, double budgetUs);
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    // Из меша выбираются до maxTriangles треугольников с наибольшей площадью
+    void SetOccluderMesh(
+        const float* positions, size_t vertexStride, const uint32_t* indices, size_t indexCount,
+        uint32_t maxTriangles);
+
+    // Растеризует окклюдеры; число треугольников подстраивается под бюджет времени
+    void Render(const float viewProj[4][4]);
+
+    // false - бокс целиком за окклюдерами
+    bool IsVisible(const Aabb& box);
+
+    void ResetStats() { mStats.Tested = 0; mStats.Occluded = 0; }
+    const OcclusionStats& Stats() const { return mStats; }
+
+private:
+    struct ScreenTriangle
+    {
+        float X[3];
+        float Y[3];
+        float Z[3];
+    };
+
+    void RasterizeBand(uint32_t band);
+    void BuildHierarchy();
+
+    std::vector<float> mOccluders; // 9 float на треугольник, по убыванию площади
+    uint32_t mTriangleLimit = 0;
+    double mBudgetUs = 0.0;
+
+    float mViewProj[4][4] = {};
+    std::vector<ScreenTriangle> mTriangles;
+
+    // Уровень 0 - сам буфер глубины, дальше каждый уровень вдвое меньше
+    std::vector<std::vector<float>> mMinDepth;
+    std::vector<std::vector<float>> mMaxDepth;
+
+    JobSystem& mJobs;
+    uint32_t mBandCount = 1;
+
+    OcclusionStats mStats;
+};
@@ -0,0 +1,39 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "JobSystem.h"
+
+// Непрерывный кусок отсортированной очереди отрисовок [Begin, End)
+struct DrawSlice
+{
+    size_t Begin = 0;
+    size_t End = 0;
+
+    size_t Count() const { return End - Begin; }
+};
+
+// Делит count отрисовок на не более чем maxSlices непрерывных кусков почти
+// равной длины, в каждом не меньше minPerSlice (кроме единственного куска).
+// Куски идут по порядку и покрывают всю очередь; пустая очередь - один пустой кусок.
+void SplitDraws(size_t count, uint32_t maxSlices, size_t minPerSlice, std::vector<DrawSlice>& out);
+
+// Параллельная запись кусков очереди задачами jobs. Каждый кусок пишется
+// в свой командный список; списки отправляются в порядке кусков, так что
+// итоговый порядок отрисовок тот же, что при записи в один поток.
+class ParallelRecorder
+{
+public:
+    using RecordFn = std::function<void(uint32_t slice, const DrawSlice& range)>;
+
+    explicit ParallelRecorder(JobSystem& jobs) : mJobs(jobs) {}
+
+    uint32_t MaxSlices() const { return mJobs.ThreadCount(); }
+
+    // Возвращается, когда записаны все куски
+    void Record(const std::vector<DrawSlice>& slices, const RecordFn& record);
+
+private:
+    JobSystem& mJobs;
+};
@@ -3,11 +3,30 @@
 #include <string>
 #include <vector>
 #include "Submesh.h"
-#include "Vertex.h"
 
+// Без DirectXMath: парсер собирается и вне Windows (HeadlessRender, тесты).
+// Поля - как первые три у Vertex
+struct ObjFloat3
+{
+    float x, y, z;
+};
+
+struct ObjFloat2
+{
+    float x, y;
+};
+
+struct ObjVertex
+{
+    ObjFloat3 position;
+    ObjFloat3 normal;
+    ObjFloat2 texcoord;
+};
+
+// Позиции масштабируются в 0.01 и центрируются по боксу; вершины у треугольников не общие
 bool LoadOBJ(
     const std::string& filename,
-    std::vector<Vertex>& outVertices,
+    std::vector<ObjVertex>& outVertices,
     std::vector<uint32_t>& outIndices,
     std::vector<Submesh>& outSubmeshes);
 
@@ -16,7 +35,8 @@ struct ParsedMaterial
     std::string Name;
     std::string DiffuseMap;  // Первая текстура (map_Kd)
     std::string DiffuseMap2; // Вторая текстура (map_Kd2)
-    DirectX::XMFLOAT3 Kd = { 1.0f, 1.0f, 1.0f };
+    std::string AlphaMap;    // Маска прозрачности (map_d)
+    ObjFloat3 Kd = { 1.0f, 1.0f, 1.0f };
 };
 
 bool LoadMTL(
@@ -0,0 +1,89 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Aabb.h"
+#include "JobSystem.h"
+#include "TriangleBvh.h"
+
+// Отрисовка для запекания: её треугольники в индексном буфере BVH
+struct PvsDraw
+{
+    uint32_t FirstTriangle = 0;
+    uint32_t TriangleCount = 0;
+    Aabb Bounds;
+    bool SeeThrough = false;    // Альфа-тест и полупрозрачные: лучи идут сквозь них
+};
+
+struct PvsBakeDesc
+{
+    float CellSize = 100.0f;
+    uint32_t RaysPerCell = 2048;    // Из случайных точек ячейки в случайных направлениях
+    uint32_t SeeThroughLayers = 4;  // Сколько раз луч продолжается за SeeThrough
+    uint32_t Dilation = 1;          // Строка ячейки объединяется с соседями на столько ячеек
+    float MergeSlack = 0.05f;       // Доля отрисовок, которую слияние строк может добавить ячейке
+    uint32_t Seed = 1;
+};
+
+struct PvsStats
+{
+    uint32_t Cells = 0;
+    uint32_t WalkableCells = 0;
+    uint32_t Draws = 0;
+    uint32_t UniqueRows = 0;    // Строк после слияния соседей
+    uint64_t Rays = 0;
+    uint64_t RawBytes = 0;      // Полная матрица ячейка x отрисовка по биту
+    uint64_t StoredBytes = 0;   // Таблица ячеек и строки
+    double AverageVisible = 0.0; // Доля видимых отрисовок в средней проходимой ячейке
+    double BakeMs = 0.0;
+};
+
+// Потенциально видимые множества для статичной сцены. Ограничивающий бокс
+// делится на кубические ячейки; проходимы те, под центром которых есть
+// геометрия. Из каждой проходимой ячейки пускаются лучи по BVH (ячейки
+// считаются задачами JobSystem), попавшие отрисовки и отрисовки у самой ячейки
+// отмечаются в её строке битов. Строки расширяются соседями (лучи из ячейки
+// внутри колонны ничего не видят, а недобранные выборкой отрисовки видны
+// соседям) и сжимаются: почти одинаковые строки соседних ячеек сливаются
+// в одну (объединением, с ограничением на добавленные отрисовки), ячейка
+// держит номер строки.
+// В кадре позиция камеры за O(1) даёт строку - маску для FrustumCuller.
+class PotentiallyVisibleSet
+{
+public:
+    void Bake(
+        const TriangleBvh& bvh, const std::vector<PvsDraw>& draws, const Aabb& bounds,
+        const PvsBakeDesc& desc, JobSystem& jobs);
+
+    // key - хеш сцены и параметров: чужой или битый файл не загружается
+    bool Save(const std::string& path, uint64_t key) const;
+    bool Load(const std::string& path, uint64_t key);
+
+    bool IsEmpty() const { return mRows.empty(); }
+
+    // Биты видимых отрисовок (DrawCount() бит, слово - 64 отрисовки);
+    // nullptr - точка вне проходимых ячеек, видимо всё
+    const uint64_t* VisibleSet(const float position[3]) const;
+
+    uint32_t DrawCount() const { return mDrawCount; }
+    const PvsStats& Stats() const { return mStats; }
+
+private:
+    uint32_t CellIndex(uint32_t x, uint32_t y, uint32_t z) const { return (z * mDims[1] + y) * mDims[0] + x; }
+    // Возвращает число пущенных лучей
+    uint64_t BakeCell(
+        const TriangleBvh& bvh, const std::vector<PvsDraw>& draws, const std::vector<uint32_t>& triangleDraws,
+        const PvsBakeDesc& desc, uint32_t cell, uint64_t* row) const;
+    void Compress(const std::vector<uint64_t>& rows, const std::vector<uint8_t>& walkableCells, uint32_t maxExtra);
+    void FillStats();
+
+    float mOrigin[3] = {};
+    float mCellSize = 1.0f;
+    uint32_t mDims[3] = {};
+    uint32_t mDrawCount = 0;
+    uint32_t mWords = 0;            // uint64 на строку
+
+    std::vector<uint32_t> mCellRows;    // Ячейка -> номер строки + 1 (0 - не проходима)
+    std::vector<uint64_t> mRows;        // Уникальные строки по mWords слов
+    PvsStats mStats;
+};
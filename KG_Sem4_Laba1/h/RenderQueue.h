@@ -0,0 +1,59 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Ключ отрисовки, от старших битов к младшим:
+//   63..60 - проход, 59..52 - PSO, 51..36 - материал, 35..12 - глубина (ближние раньше)
+// Сортировка по ключу группирует отрисовки так, чтобы состояние менялось реже всего.
+constexpr uint32_t DrawKeyPassBits = 4;
+constexpr uint32_t DrawKeyPsoBits = 8;
+constexpr uint32_t DrawKeyMaterialBits = 16;
+constexpr uint32_t DrawKeyDepthBits = 24;
+
+constexpr uint32_t DrawKeyDepthShift = 12;
+constexpr uint32_t DrawKeyMaterialShift = DrawKeyDepthShift + DrawKeyDepthBits;
+constexpr uint32_t DrawKeyPsoShift = DrawKeyMaterialShift + DrawKeyMaterialBits;
+constexpr uint32_t DrawKeyPassShift = DrawKeyPsoShift + DrawKeyPsoBits;
+
+// depth01 - расстояние, отнормированное в 0..1 (за пределами обрезается)
+uint64_t MakeDrawKey(uint32_t pass, uint32_t pso, uint32_t material, float depth01);
+
+inline uint32_t DrawKeyPass(uint64_t key) { return uint32_t(key >> DrawKeyPassShift) & ((1u << DrawKeyPassBits) - 1); }
+inline uint32_t DrawKeyPso(uint64_t key) { return uint32_t(key >> DrawKeyPsoShift) & ((1u << DrawKeyPsoBits) - 1); }
+inline uint32_t DrawKeyMaterial(uint64_t key) { return uint32_t(key >> DrawKeyMaterialShift) & ((1u << DrawKeyMaterialBits) - 1); }
+
+struct RenderItem
+{
+    uint64_t Key = 0;
+    uint32_t DrawIndex = 0;
+    uint32_t FirstInstance = 0;
+    uint32_t InstanceCount = 0; // 0 - обычная отрисовка без буфера экземпляров
+};
+
+// Очередь отрисовок кадра: заполняется после отсечения, сортируется
+// поразрядно (LSD, по байту за проход) и записывается в командный список по порядку
+class RenderQueue
+{
+public:
+    void Clear() { mItems.clear(); }
+    void Add(uint64_t key, uint32_t drawIndex, uint32_t firstInstance = 0, uint32_t instanceCount = 0)
+    {
+        mItems.push_back({ key, drawIndex, firstInstance, instanceCount });
+    }
+
+    // Устойчивая сортировка по возрастанию ключа. Байты, одинаковые у всех
+    // ключей, пропускаются, так что неиспользуемые поля ничего не стоят.
+    void Sort();
+
+    const std::vector<RenderItem>& Items() const { return mItems; }
+    size_t Size() const { return mItems.size(); }
+
+    // Число проходов радикс-сортировки в последнем Sort (0 - короткая очередь)
+    uint32_t LastSortPasses() const { return mLastSortPasses; }
+
+private:
+    std::vector<RenderItem> mItems;
+    std::vector<RenderItem> mScratch;
+    uint32_t mLastSortPasses = 0;
+};
@@ -0,0 +1,164 @@
+﻿#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Aabb.h"
+#include "Submesh.h"
+
+struct SectorGridDesc
+{
+    uint32_t SectorsPerAxis = 4;    // По большей стороне сцены в плоскости XZ
+};
+
+// Сектор: свои сабмеши (куски исходных, треугольники подряд), их материалы
+// и файл с вершинами и индексами
+struct SectorInfo
+{
+    Aabb Bounds;
+    std::vector<uint32_t> Draws;        // Номера сабмешей
+    std::vector<uint32_t> Materials;    // MaterialIndex сабмешей без повторов
+    uint32_t VertexCount = 0;
+    uint32_t IndexCount = 0;
+    uint64_t FileBytes = 0;
+};
+
+// Геометрия сектора из файла: только его вершины, индексы - в них.
+// Сабмеш сектора - IndexCount индексов с SectorIndexStart
+struct SectorData
+{
+    std::vector<uint8_t> Vertices;
+    std::vector<uint32_t> Indices;
+};
+
+struct SectorStreamingDesc
+{
+    float LoadRadius = 1200.0f;     // Сектор запрашивается, когда его бокс ближе
+    float UnloadRadius = 1600.0f;   // и выгружается, когда дальше этого (гистерезис)
+    float VisibleRadius = 1000.0f;  // Ближе - сектор нужен кадру, без данных это рывок
+    float LookAhead = 1.0f;         // Секунд упреждения по скорости камеры
+    uint64_t ArrivalBytes = 16ull << 20;    // Данных за Update (загрузка на GPU), не меньше сектора
+    float RetryDelay = 2.0f;        // Секунд до повторного запроса сектора, который не прочитался
+};
+
+struct SectorStreamingStats
+{
+    uint32_t Sectors = 0;
+    uint32_t Resident = 0;
+    uint32_t Pending = 0;           // Запрошены, читаются или ждут выдачи
+    uint64_t ResidentBytes = 0;
+    uint64_t ReadBytes = 0;         // За всё время
+    double ReadMBps = 0.0;          // За последнюю секунду
+    uint32_t Loads = 0;
+    uint32_t Unloads = 0;
+    uint32_t Failures = 0;          // Битые или чужие файлы - сектор запрашивается снова через RetryDelay
+    uint32_t Missing = 0;           // Видимых секторов без данных в последнем Update
+    uint32_t Hitches = 0;           // Update, в которых такие были
+    double LastLatencyMs = 0.0;     // От запроса до выдачи
+    double MaxLatencyMs = 0.0;
+};
+
+// Стриминг мира по секторам. Partition офлайн режет сабмеши по сетке XZ, Build
+// пишет геометрию каждого сектора в свой файл кэша. Update по расстоянию до
+// секторов от камеры и от точки, куда она придёт за LookAhead, запрашивает
+// ближние и выгружает дальние; файлы читает отдельный поток (не JobSystem:
+// Wait главного потока не должен подхватить чтение с диска), готовые
+// выдаются через Arrived в пределах ArrivalBytes, ближние первыми.
+class SectorStreamer
+{
+public:
+    SectorStreamer() = default;
+    ~SectorStreamer();
+
+    SectorStreamer(const SectorStreamer&) = delete;
+    SectorStreamer& operator=(const SectorStreamer&) = delete;
+
+    // Треугольники сабмешей раскладываются по секторам по центру; кусок сабмеша
+    // в секторе становится отдельным сабмешем с номером сектора. Пустые ячейки
+    // сетки не нумеруются. Bounds сабмешей сбрасываются - их считает вызывающий
+    void Partition(
+        const float* positions, size_t stride, std::vector<uint32_t>& indices,
+        std::vector<Submesh>& submeshes, const SectorGridDesc& desc);
+
+    // После Partition и подсчёта Bounds и MaterialIndex: таблица секторов и
+    // SectorIndexStart сабмешей. Файлы с ключом key пишутся в directory, если их нет
+    bool Build(
+        const uint8_t* vertices, size_t vertexStride, const std::vector<uint32_t>& indices,
+        std::vector<Submesh>& submeshes, const std::string& directory, uint64_t key);
+
+    void SetDesc(const SectorStreamingDesc& desc) { mDesc = desc; }
+    const SectorStreamingDesc& Desc() const { return mDesc; }
+
+    // velocity - единиц в секунду
+    void Update(const float eye[3], const float velocity[3]);
+
+    // Старт: нужное в eye читается сразу и попадает в Arrived без ограничения
+    void LoadNow(const float eye[3]);
+
+    // Сектора, выданные последним Update/LoadNow: их данные забирает TakeData
+    const std::vector<uint32_t>& Arrived() const { return mArrived; }
+    // Выгруженные последним Update - их ресурсы освобождаются
+    const std::vector<uint32_t>& Evicted() const { return mEvicted; }
+    SectorData TakeData(uint32_t sector);
+
+    uint32_t SectorCount() const { return (uint32_t)mInfos.size(); }
+    const SectorInfo& Sector(uint32_t sector) const { return mInfos[sector]; }
+    uint32_t WrittenFiles() const { return mWrittenFiles; }
+    const SectorStreamingStats& Stats() const { return mStats; }
+
+private:
+    enum class SectorState : uint8_t
+    {
+        Unloaded,
+        Queued,
+        Loading,    // Читает поток
+        Ready,      // Прочитан, ждёт выдачи
+        Resident,
+        Failed,
+    };
+
+    struct SectorSlot
+    {
+        SectorState State = SectorState::Unloaded;
+        bool Cancelled = false;     // Стал не нужен, пока читался
+        float Distance = 0.0f;      // Приоритет последнего Update
+        std::chrono::steady_clock::time_point Requested;
+        std::chrono::steady_clock::time_point FailedAt;
+        SectorData Data;
+    };
+
+    std::string SectorPath(uint32_t sector) const;
+    bool ReadSector(uint32_t sector, SectorData& out) const;
+    void Deliver(uint32_t sector, std::chrono::steady_clock::time_point now);
+    void Evict(uint32_t sector);
+    void StartThread();
+    void IoLoop();
+
+    SectorStreamingDesc mDesc;
+    std::vector<SectorInfo> mInfos;
+    std::string mDirectory;
+    uint64_t mKey = 0;
+    size_t mVertexStride = 0;
+    uint32_t mWrittenFiles = 0;
+
+    // Состояния секторов и очередь общие с потоком чтения
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::vector<SectorSlot> mSectors;
+    std::vector<uint32_t> mQueue;   // Ближние в конце
+    bool mQuit = false;
+    std::thread mThread;
+    uint64_t mReadBytes = 0;
+
+    std::vector<uint32_t> mArrived;
+    std::vector<uint32_t> mEvicted;
+    std::vector<uint32_t> mOrder;
+
+    std::chrono::steady_clock::time_point mWindowStart;
+    uint64_t mWindowBytes = 0;
+    SectorStreamingStats mStats;
+};
@@ -0,0 +1,74 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// FNV-1a, 64 бита: ключи кэша и контрольные суммы
+class ContentHash
+{
+public:
+    void Add(const void* data, size_t size);
+    void Add(const std::string& text); // С длиной: "ab"+"c" и "a"+"bc" различаются
+    void Add(uint64_t value) { Add(&value, sizeof(value)); }
+
+    uint64_t Value() const { return mHash; }
+
+private:
+    uint64_t mHash = 14695981039346656037ull;
+};
+
+struct ShaderDefine
+{
+    std::string Name;
+    std::string Value;
+};
+
+// Всё, от чего зависит байткод одного шейдера
+struct ShaderKey
+{
+    std::string SourcePath;
+    std::vector<ShaderDefine> Defines;
+    std::string EntryPoint;
+    std::string Target;
+    uint32_t Flags = 0;
+};
+
+struct ShaderCacheStats
+{
+    uint32_t Hits = 0;
+    uint32_t Misses = 0;
+    uint32_t Stores = 0;
+    uint32_t Rejected = 0; // Файл есть, но битый или от другого ключа
+};
+
+// Дисковый кэш блобов (байткод шейдеров, кэшированные PSO): файл на ключ,
+// "<ключ hex>.bin" с заголовком и контрольной суммой. Load и Store можно
+// звать из задач, если у них разные ключи.
+class ShaderCache
+{
+public:
+    explicit ShaderCache(std::string directory);
+
+    // Хеш исходника вместе со всеми #include (рекурсивно, относительно файла),
+    // defines, точки входа, профиля и флагов; 0 - исходник не прочитался
+    static uint64_t HashKey(const ShaderKey& key);
+
+    bool Load(uint64_t key, std::vector<uint8_t>& blob);
+    bool Store(uint64_t key, const void* data, size_t size);
+
+    ShaderCacheStats Stats() const;
+
+    // Там же лежат и другие запечённые данные (PVS)
+    const std::string& Directory() const { return mDirectory; }
+
+private:
+    std::string PathFor(uint64_t key) const;
+
+    void Count(uint32_t ShaderCacheStats::* counter);
+
+    std::string mDirectory;
+    mutable std::mutex mMutex; // Только для статистики
+    ShaderCacheStats mStats;
+};
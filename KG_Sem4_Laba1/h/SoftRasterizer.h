@@ -0,0 +1,143 @@
+﻿#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "JobSystem.h"
+
+// Текстура BGRA8 с цепочкой мипов (как из BuildMipChain), строки в порядке файла -
+// так же, как их получает GPU
+struct SoftTexture
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    std::vector<std::vector<uint8_t>> Mips;
+};
+
+// Вершины с произвольным шагом: позиция - float3, текстурные координаты - float2
+struct SoftMesh
+{
+    const uint8_t* Vertices = nullptr;
+    size_t VertexStride = 0;
+    size_t PositionOffset = 0;
+    size_t TexcoordOffset = 0;
+    uint32_t VertexCount = 0;
+    const uint32_t* Indices = nullptr;
+};
+
+// То же, что cbuffer ObjectConstants в shaders.hlsl. Матрица - для вектора-строки
+// и не транспонирована (как mViewProj, а не как в константном буфере)
+struct SoftConstants
+{
+    float WorldViewProj[4][4] = {};
+    float UVTransform[4] = { 1.0f, 1.0f, 0.0f, 0.0f }; // xy - масштаб, zw - сдвиг
+    float BlendFactor = 0.0f;
+};
+
+// nullptr вместо текстуры - белый цвет
+struct SoftDraw
+{
+    uint32_t IndexStart = 0;
+    uint32_t IndexCount = 0;
+    const SoftTexture* Texture1 = nullptr;
+    const SoftTexture* Texture2 = nullptr;
+};
+
+struct SoftRasterStats
+{
+    uint32_t Triangles = 0;  // после отсечения и отбрасывания задних граней
+    uint32_t BinEntries = 0; // пар треугольник - тайл
+    uint64_t Pixels = 0;     // прошли тест глубины
+    double TransformUs = 0.0;
+    double BinUs = 0.0;
+    double RasterUs = 0.0;
+};
+
+// Программный растеризатор с семантикой shaders.hlsl (VS/PS без INSTANCED):
+// gWorldViewProj, UV * scale + offset, lerp двух билинейных выборок по BlendFactor.
+// Состояние - как у mPSO: отсечение задних граней (по часовой - лицевые),
+// глубина LESS, без смешивания. Кадр идёт в три прохода задачами jobs:
+// вершины, отсечение и раскладка треугольников по тайлам (своя корзина у каждой
+// порции треугольников - порядок отрисовки сохраняется), растеризация тайлов
+// по 4 пикселя (SSE2). Вершины привязываются к сетке 1/16 пикселя, рёбра считаются
+// в целых: у сетки треугольников каждый пиксель закрашивается ровно один раз. Мип выбирается на треугольник по отношению площадей
+// в текселях и пикселях, внутри мипа - билинейная фильтрация с повтором.
+class SoftRasterizer
+{
+public:
+    static const uint32_t TileSize = 64; // Кратно 4
+
+    SoftRasterizer(JobSystem& jobs, uint32_t width, uint32_t height);
+
+    SoftRasterizer(const SoftRasterizer&) = delete;
+    SoftRasterizer& operator=(const SoftRasterizer&) = delete;
+
+    void Clear(uint32_t bgra, float depth = 1.0f);
+    void Render(const SoftMesh& mesh, const SoftConstants& constants, const SoftDraw* draws, size_t drawCount);
+
+    uint32_t Width() const { return mWidth; }
+    uint32_t Height() const { return mHeight; }
+    uint32_t Pitch() const { return mPitch; } // В пикселях, кратно 4
+
+    // BGRA8, mPitch пикселей на строку
+    const std::vector<uint32_t>& Color() const { return mColor; }
+    const std::vector<float>& Depth() const { return mDepth; }
+
+    bool SaveTga(const std::string& path) const;
+
+    const SoftRasterStats& Stats() const { return mStats; }
+
+private:
+    struct ClipVertex
+    {
+        float X, Y, Z, W;
+        float U, V;
+    };
+
+    // Рёбра - A * x + B * y + C в 1/16 пикселя от начала экрана, атрибуты - плоскости
+    // в пикселях от начала тайла треугольника
+    struct SetupTriangle
+    {
+        int32_t EdgeA[3], EdgeB[3];         // Внутри E >= 0 (правило верхнего/левого ребра - в C)
+        int64_t EdgeC[3];
+        float Z[3];
+        float InvW[3];
+        float UOverW[3];
+        float VOverW[3];
+        float LodBase;                      // log2 отношения площадей UV и пикселей / 2
+        uint32_t Draw;
+        int MinX, MinY, MaxX, MaxY;
+    };
+
+    void BinTriangles(uint32_t chunk);
+    void SetupAndBin(uint32_t chunk, uint32_t draw, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2);
+    void RasterizeTile(uint32_t tile);
+    uint64_t RasterizeTriangle(const SetupTriangle& tri, int x0, int y0, int x1, int y1);
+    void ShadePixel(
+        const SoftDraw& draw, uint32_t level1, uint32_t level2, uint32_t index, float invW, float uw, float vw);
+
+    JobSystem& mJobs;
+    uint32_t mWidth = 0;
+    uint32_t mHeight = 0;
+    uint32_t mPitch = 0;
+    uint32_t mTilesX = 0;
+    uint32_t mTilesY = 0;
+
+    std::vector<uint32_t> mColor;
+    std::vector<float> mDepth;
+
+    // Данные текущего Render
+    SoftConstants mConstants;
+    const SoftDraw* mDraws = nullptr;
+    std::vector<uint32_t> mDrawFirstTriangle; // Префиксные суммы треугольников по отрисовкам
+    std::vector<ClipVertex> mClipVertices;
+    const uint32_t* mIndices = nullptr;
+
+    uint32_t mChunkCount = 1;
+    std::vector<std::vector<SetupTriangle>> mChunkTriangles;
+    std::vector<std::vector<uint32_t>> mBins; // [chunk * тайлов + тайл] -> индексы в mChunkTriangles[chunk]
+
+    std::atomic<uint64_t> mPixels{ 0 };
+    SoftRasterStats mStats;
+};
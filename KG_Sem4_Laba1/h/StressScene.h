@@ -0,0 +1,46 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+
+// Мировая матрица экземпляра в строковом порядке DirectXMath ([x y z 1] * World);
+// в шейдере читается как row_major float4x4 из StructuredBuffer
+struct InstanceData
+{
+    float World[4][4];
+};
+
+// Непрерывный диапазон экземпляров одного сабмеша - одна инстансированная отрисовка
+struct InstanceBatch
+{
+    uint32_t Submesh = 0;
+    uint32_t FirstInstance = 0;
+    uint32_t InstanceCount = 0;
+};
+
+// Проп для размножения: сабмеш и его центр, который встаёт в узел сетки
+struct StressProp
+{
+    uint32_t Submesh = 0;
+    float Center[3] = {};
+};
+
+struct StressSceneDesc
+{
+    uint32_t Seed = 1;
+    uint32_t CountX = 100;
+    uint32_t CountZ = 100;
+    float Spacing = 50.0f;
+    float Origin[3] = {};   // Центр сетки
+    float Jitter = 0.3f;    // Доля шага, на которую узел сдвигается случайно
+    float MinScale = 0.5f;
+    float MaxScale = 1.5f;
+};
+
+// Раскладывает CountX x CountZ экземпляров пропов сеткой со случайными сдвигом,
+// поворотом вокруг Y и масштабом. Один и тот же Seed даёт одну и ту же сцену на любой
+// платформе. Экземпляры сгруппированы по пропу, batches - по партии на проп.
+void GenerateStressScene(
+    const StressSceneDesc& desc,
+    const std::vector<StressProp>& props,
+    std::vector<InstanceData>& instances,
+    std::vector<InstanceBatch>& batches);
@@ -1,10 +1,18 @@
-#pragma once
+﻿#pragma once
 #include <string>
 #include <cstdint>
+#include "Aabb.h"
 
 struct Submesh
 {
     uint32_t IndexStart = 0;
     uint32_t IndexCount = 0;
     std::string MaterialName;
-};
\ No newline at end of file
+    int MaterialIndex = -1; // Индекс в mMaterials, -1 - материал не найден
+
+    Aabb Bounds;            // Границы в мировых координатах
+    float UvDensity = 0.0f; // UV-единиц на единицу длины (sqrt площади UV / площади в мире)
+
+    uint32_t Sector = 0;            // SectorStreamer: сектор и начало в его индексном буфере
+    uint32_t SectorIndexStart = 0;
+};
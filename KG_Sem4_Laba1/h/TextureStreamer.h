@@ -0,0 +1,80 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+
+// Смена резидентного мипа текстуры: OldMip -> NewMip (меньше = детальнее)
+struct MipChange
+{
+    uint32_t Texture = 0;
+    uint32_t OldMip = 0;
+    uint32_t NewMip = 0;
+};
+
+struct TextureStreamingStats
+{
+    uint64_t ResidentBytes = 0;
+    uint64_t BudgetBytes = 0;
+    uint64_t UploadedBytes = 0;   // за кадр
+    uint32_t PendingRequests = 0; // текстуры, которым не хватило бюджета
+    uint32_t Upgrades = 0;        // за кадр
+    uint32_t Evictions = 0;       // понижений мипа за всё время
+};
+
+// Решает, какой самый детальный мип держать в видеопамяти для каждой текстуры.
+// Запросы мипов приходят каждый кадр от плотности текселей на экране, а
+// повышения ограничены общим бюджетом и числом байт загрузки за кадр.
+class TextureStreamer
+{
+public:
+    TextureStreamer(uint64_t budgetBytes, uint64_t uploadBytesPerFrame);
+
+    // blockSize - сторона блока сжатия (4 для BC, 1 без сжатия): размер мипа считается
+    // целыми блоками, а верхним резидентным становится только мип из целых блоков.
+    // startupMip - самый грубый резидентный мип, ниже него текстура не опускается
+    uint32_t AddTexture(
+        uint32_t width, uint32_t height, uint32_t mipCount, uint32_t bitsPerPixel,
+        uint32_t blockSize, uint32_t startupMip);
+
+    // Первый мип, у которого большая сторона не превышает maxSize
+    static uint32_t MipForSize(uint32_t width, uint32_t height, uint32_t maxSize);
+
+    void BeginFrame();
+    // Можно вызывать несколько раз за кадр - берётся самый детальный запрос
+    void RequestMip(uint32_t texture, float mip);
+    const std::vector<MipChange>& Update();
+
+    uint32_t ResidentMip(uint32_t texture) const { return mTextures[texture].ResidentMip; }
+    uint32_t StartupMip(uint32_t texture) const { return mTextures[texture].StartupMip; }
+    uint64_t MipBytes(uint32_t texture, uint32_t mip) const;
+
+    void SetBudget(uint64_t budgetBytes) { mBudgetBytes = budgetBytes; }
+    void SetUploadBytesPerFrame(uint64_t bytes) { mUploadBytesPerFrame = bytes; }
+    const TextureStreamingStats& Stats() const { return mStats; }
+
+private:
+    struct Texture
+    {
+        uint32_t Width = 0;
+        uint32_t Height = 0;
+        uint32_t MipCount = 0;
+        uint32_t BitsPerPixel = 0;
+        uint32_t BlockSize = 1;
+        uint32_t TopMip = 0;       // Самый детальный мип, который может стать верхним
+        uint32_t StartupMip = 0;
+        uint32_t ResidentMip = 0;
+        uint32_t FrameStartMip = 0;
+        uint32_t TargetMip = 0;
+        float WantedMip = 0.0f;
+    };
+
+    bool EvictFor(uint64_t bytes);
+
+    std::vector<Texture> mTextures;
+    std::vector<uint32_t> mUpgradeOrder;
+    std::vector<uint32_t> mEvictOrder;
+    std::vector<MipChange> mChanges;
+
+    uint64_t mBudgetBytes = 0;
+    uint64_t mUploadBytesPerFrame = 0;
+    TextureStreamingStats mStats;
+};
@@ -10,4 +10,32 @@ struct TgaImage
     std::vector<unsigned char> data;
 };
 
-bool LoadTGA(const std::string& filename, TgaImage& outImage);
\ No newline at end of file
+// Пиксели TGA без копирования (например, прямо из отображённого файла)
+struct TgaView
+{
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    const unsigned char* pixels = nullptr;
+};
+
+bool LoadTGA(const std::string& filename, TgaImage& outImage);
+
+// Только несжатый truecolor 24/32 бит; строки идут в порядке файла, как и в LoadTGA
+bool ParseTGA(const unsigned char* data, size_t size, TgaView& outView);
+
+// Как используется альфа карты: маска (почти все тексели пусты или непрозрачны,
+// полоса сглаживания по краям не в счёт) или настоящая полупрозрачность
+enum TgaAlphaKind
+{
+    TgaAlphaOpaque,       // Канала нет или он весь непрозрачный
+    TgaAlphaMask,
+    TgaAlphaTranslucent,  // Промежуточных значений больше 1/TgaTranslucentShare текселей
+};
+
+constexpr int TgaTranslucentShare = 4;
+
+TgaAlphaKind ClassifyTgaAlpha(const TgaView& view);
+
+// BGRA8 -> несжатый 24-битный TGA, строки сверху вниз; rowPitch - байт на строку источника
+bool SaveTGA(const std::string& filename, int width, int height, const unsigned char* bgra, size_t rowPitch);
\ No newline at end of file
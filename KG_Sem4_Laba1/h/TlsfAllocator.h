@@ -0,0 +1,96 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+
+struct TlsfAllocation
+{
+    uint64_t Offset = 0;
+    uint64_t Size = 0;        // Кратно гранулярности
+    uint32_t Block = UINT32_MAX;
+
+    bool Valid() const { return Block != UINT32_MAX; }
+};
+
+struct TlsfStats
+{
+    uint64_t Capacity = 0;
+    uint64_t UsedBytes = 0;
+    uint64_t FreeBytes = 0;
+    uint64_t LargestFreeBlock = 0;
+    uint32_t Allocations = 0;
+    uint32_t FreeBlocks = 0;
+    uint64_t Failures = 0;
+
+    // 0 - всё свободное одним куском, ближе к 1 - мелкими дырами
+    double Fragmentation() const
+    {
+        return FreeBytes > 0 ? 1.0 - (double)LargestFreeBlock / (double)FreeBytes : 0.0;
+    }
+};
+
+// Two-Level Segregated Fit для смещений в одной куче: свободные блоки лежат
+// в корзинах (степень двойки x 16 делений), поиск и освобождение - O(1) по
+// битовым маскам, соседние свободные блоки сливаются сразу. Выравнивание -
+// любая степень двойки не меньше гранулярности; отступ перед выровненным
+// началом остаётся свободным блоком. Когда по маскам с запасом на выравнивание
+// ничего нет (вся куча одним куском, почти полная куча), проверяются блоки корзин
+// между размером и запасом - не больше MaxFallbackVisits. Память не трогает -
+// только смещения.
+class TlsfAllocator
+{
+public:
+    TlsfAllocator(uint64_t capacity, uint64_t granularity);
+
+    // !Valid() - нет подходящего свободного блока
+    TlsfAllocation Allocate(uint64_t size, uint64_t alignment);
+    void Free(const TlsfAllocation& allocation);
+
+    uint64_t Capacity() const { return mCapacity; }
+    uint64_t Granularity() const { return mGranularity; }
+    TlsfStats Stats() const;
+
+    // Обходит все блоки и сверяет списки, маски и слияние соседей - для тестов
+    bool Validate() const;
+
+private:
+    static constexpr uint32_t SlLog2 = 4;
+    static constexpr uint32_t SlCount = 1u << SlLog2;
+    static constexpr uint32_t FlCount = 64 - SlLog2 + 1;
+    static constexpr uint32_t None = UINT32_MAX;
+    static constexpr uint32_t MaxFallbackVisits = 64;
+
+    struct Block
+    {
+        uint64_t Offset = 0;
+        uint64_t Size = 0;
+        uint32_t PrevPhys = None;
+        uint32_t NextPhys = None;
+        uint32_t PrevFree = None;
+        uint32_t NextFree = None;
+        bool Free = false;
+    };
+
+    void Mapping(uint64_t size, uint32_t& fl, uint32_t& sl) const;
+    uint32_t FindFree(uint64_t size, uint64_t alignment) const;
+    void InsertFree(uint32_t block);
+    void RemoveFree(uint32_t block);
+    uint32_t NewBlock();
+    void ReleaseBlock(uint32_t block);
+
+    // Отрезает от block хвост начиная с offset; хвост свободен
+    void SplitTail(uint32_t block, uint64_t offset);
+
+    uint64_t mCapacity = 0;
+    uint64_t mGranularity = 1;
+
+    std::vector<Block> mBlocks;
+    std::vector<uint32_t> mUnusedBlocks;
+    uint64_t mFlBitmap = 0;
+    uint32_t mSlBitmap[FlCount] = {};
+    uint32_t mHeads[FlCount][SlCount];
+
+    uint64_t mUsedBytes = 0;
+    uint32_t mAllocations = 0;
+    uint32_t mFreeBlocks = 0;
+    uint64_t mFailures = 0;
+};
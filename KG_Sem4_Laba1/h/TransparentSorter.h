@@ -0,0 +1,68 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct TransparentSortStats
+{
+    uint32_t Items = 0;
+    uint32_t NewItems = 0;     // Не было в порядке прошлого кадра
+    uint32_t Descents = 0;     // Соседних пар не по порядку (счёт обрывается на пороге)
+    uint64_t Moves = 0;        // Сдвигов вставками (до отказа от них)
+    bool Radix = false;        // Вставки превысили бюджет - досортировано поразрядно
+    bool Predicted = false;    // Отказ от вставок до их начала - по числу спусков
+    double Us = 0.0;
+};
+
+// Полупрозрачные отрисовки от дальних к ближним. Между кадрами камера сдвигается
+// мало, поэтому порядок прошлого кадра почти верен: его досортировывают вставками
+// за O(n + сдвиги). Новые сортируются отдельно и вливаются за O(n); если новых
+// больше 1/FreshRatio, сразу поразрядно сортируется всё. Если сдвигов больше
+// MovesPerItem на элемент (резкий поворот, телепорт, много новых), вставки
+// бросаются и порядок досортировывается поразрядно (LSD, по байту ключа).
+// Чтобы не тратить бюджет впустую, сдвиги предсказываются заранее: спуски
+// (соседние пары не по порядку) считаются до порога, каждый стоит столько
+// сдвигов, сколько в среднем стоил в последнем кадре со вставками (не меньше
+// MovesPerDescent). Пока камера вращается, предсказание держит кадры на
+// поразрядной; остановилась - порядок прошлого кадра снова верен, спусков
+// почти нет, и вставки возвращаются.
+// Обе сортировки устойчивы: равные глубины сохраняют прошлый порядок и не мерцают.
+class TransparentSorter
+{
+public:
+    static const uint32_t MovesPerItem = 2;
+    static const uint32_t MovesPerDescent = 8;  // Длина сдвига на спуск до первых замеров
+    static const uint32_t FreshRatio = 4;
+
+    // Начало кадра: элементы прошлого кадра остаются только как подсказка порядка
+    void Begin();
+
+    // id - устойчивый между кадрами номер отрисовки (не больше нескольких
+    // миллионов: под него заводится таблица); depth - глубина в пространстве вида
+    void Add(uint32_t id, float depth);
+
+    void Sort();
+
+    // id от дальнего к ближнему
+    const std::vector<uint32_t>& Order() const { return mOrder; }
+    const TransparentSortStats& Stats() const { return mStats; }
+
+private:
+    struct Entry
+    {
+        uint32_t Key;   // Растёт от дальних к ближним
+        uint32_t Id;
+    };
+
+    bool InsertionSort(uint64_t budget, uint32_t& descents);
+    void RadixSort();
+
+    std::vector<Entry> mAdded;     // Элементы кадра в порядке Add
+    std::vector<uint32_t> mSlot;   // id -> индекс в mAdded + 1 (0 - нет в кадре)
+    std::vector<Entry> mEntries;   // Прошлый порядок, затем результат
+    std::vector<Entry> mFresh;     // Новые в кадре
+    std::vector<Entry> mScratch;
+    std::vector<uint32_t> mOrder;
+    float mMovesPerDescent = (float)MovesPerDescent;  // Замер последних вставок
+    TransparentSortStats mStats;
+};
@@ -0,0 +1,86 @@
+﻿#pragma once
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "JobSystem.h"
+
+struct Ray
+{
+    float Origin[3] = {};
+    float Dir[3] = { 0.0f, 0.0f, 1.0f };
+    float MaxT = FLT_MAX;
+};
+
+struct RayHit
+{
+    float T = FLT_MAX;
+    uint32_t Triangle = UINT32_MAX; // номер треугольника в исходном индексном буфере (index / 3)
+    float U = 0.0f;
+    float V = 0.0f;
+
+    bool IsHit() const { return Triangle != UINT32_MAX; }
+};
+
+// BVH по треугольникам сцены: SAH-разбиение по корзинам, узлы по 32 байта в
+// порядке обхода в глубину (левый ребёнок всегда следующий). Лучи идут пакетами
+// по 4 (SSE), пакет спускается в узел, если в него попал хотя бы один луч.
+// Глубина не больше MaxDepth - под неё рассчитан стек обхода: за MedianDepth
+// SAH не спрашивается, диапазон делится медианой по центрам.
+class TriangleBvh
+{
+public:
+    static constexpr uint32_t MaxDepth = 64;
+    static constexpr uint32_t MedianDepth = MaxDepth - 32;  // 32 деления пополам исчерпают любой uint32_t диапазон
+
+    // Верхние поддеревья строятся параллельно задачами jobs (nullptr - в одном потоке)
+    void Build(
+        const float* positions, size_t vertexStride, const uint32_t* indices, size_t indexCount,
+        JobSystem* jobs);
+
+    // Ближайшие пересечения, rays и hits - count элементов
+    void Intersect(const Ray* rays, size_t count, RayHit* hits) const;
+    RayHit Intersect(const Ray& ray) const;
+
+    // Выталкивает сферу из всех треугольников, в которые она вошла; true - если сдвинул
+    bool ResolveSphere(float center[3], float radius, int iterations) const;
+
+    uint32_t NodeCount() const { return (uint32_t)mNodes.size(); }
+    uint32_t TriangleCount() const { return (uint32_t)mTriangleIds.size(); }
+    uint32_t Depth() const { return mDepth; }  // Самый глубокий лист, корень - 0
+    double BuildMs() const { return mBuildMs; }
+
+private:
+    struct Node
+    {
+        float Min[3];
+        uint32_t RightOrFirst; // внутренний - индекс правого ребёнка, лист - первый треугольник
+        float Max[3];
+        uint32_t Count;        // 0 - внутренний узел
+    };
+
+    void BuildSubtree(std::vector<Node>& nodes, uint32_t first, uint32_t count, uint32_t depth) const;
+    bool SplitRange(uint32_t first, uint32_t count, uint32_t depth, uint32_t& mid) const;
+    void SplitMedian(uint32_t first, uint32_t count, uint32_t& mid) const;
+    void ComputeBounds(uint32_t first, uint32_t count, float outMin[3], float outMax[3]) const;
+    void IntersectPacket(const Ray* rays, uint32_t count, RayHit* hits) const;
+
+    // Порядок обхода детей внутреннего узла: сначала ближний по направлению луча
+    bool RightIsNearer(uint32_t nodeIndex, const float dir[3]) const;
+
+    std::vector<Node> mNodes;
+
+    // Треугольники в порядке листьев: вершина v0 и рёбра e1 = v1 - v0, e2 = v2 - v0 (SoA)
+    std::vector<float> mV0[3];
+    std::vector<float> mE1[3];
+    std::vector<float> mE2[3];
+    std::vector<uint32_t> mTriangleIds;
+
+    // Только на время построения
+    std::vector<float> mCentroids[3];
+    std::vector<float> mBoundsMin[3];
+    std::vector<float> mBoundsMax[3];
+
+    uint32_t mDepth = 0;
+    double mBuildMs = 0.0;
+};
@@ -0,0 +1,52 @@
+﻿#pragma once
+#include <cstdint>
+#include <deque>
+
+// Выравнивания D3D12: константные буферы и размещение текстурных данных
+constexpr uint64_t UploadConstantAlignment = 256;
+constexpr uint64_t UploadTextureAlignment = 512;
+
+struct UploadRingStats
+{
+    uint64_t Allocations = 0;
+    uint64_t Failures = 0;  // не нашлось места - вызывающий ждёт GPU или берёт отдельный буфер
+    uint64_t Wraps = 0;
+    uint64_t PeakUsed = 0;
+};
+
+// Кольцевой линейный аллокатор поверх одного постоянно отображённого upload-буфера.
+// Хранит только смещения; всё выделенное между FinishFrame освобождается разом,
+// когда GPU пройдёт соответствующее значение fence.
+class UploadRing
+{
+public:
+    static constexpr uint64_t InvalidOffset = UINT64_MAX;
+
+    explicit UploadRing(uint64_t capacity);
+
+    // alignment - степень двойки
+    uint64_t Allocate(uint64_t size, uint64_t alignment);
+
+    // Закрывает текущую порцию выделений значением fence, после которого она свободна
+    void FinishFrame(uint64_t fenceValue);
+
+    void Reclaim(uint64_t completedValue);
+
+    uint64_t Capacity() const { return mCapacity; }
+    uint64_t UsedBytes() const { return mUsed; }
+    const UploadRingStats& Stats() const { return mStats; }
+
+private:
+    struct Batch
+    {
+        uint64_t FenceValue = 0;
+        uint64_t Bytes = 0;
+    };
+
+    uint64_t mCapacity = 0;
+    uint64_t mHead = 0;       // следующий свободный байт
+    uint64_t mUsed = 0;       // занято от хвоста до головы, включая пропуски при переносе
+    uint64_t mOpenBytes = 0;  // выделено после последнего FinishFrame
+    std::deque<Batch> mBatches;
+    UploadRingStats mStats;
+};
@@ -6,4 +6,5 @@ struct Vertex
     DirectX::XMFLOAT3 position;
     DirectX::XMFLOAT3 normal;
     DirectX::XMFLOAT2 texcoord;
+    DirectX::XMFLOAT3 lightmapUv;   // u, v и страница атласа лайтмапов (LightmapBaker::Unwrap)
 };
\ No newline at end of file
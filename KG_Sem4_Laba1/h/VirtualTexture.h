@@ -0,0 +1,183 @@
+﻿#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "TgaLoader.h"
+
+// Размер тайла виртуальной текстуры (без рамки) и ширина рамки для билинейной фильтрации
+constexpr uint32_t VtTileSize = 128;
+constexpr uint32_t VtTileBorder = 4;
+constexpr uint32_t VtPaddedTileSize = VtTileSize + 2 * VtTileBorder;
+constexpr uint32_t VtTileBytes = VtPaddedTileSize * VtPaddedTileSize * 4; // BGRA8
+
+struct TileKey
+{
+    uint16_t Texture = 0;
+    uint8_t Mip = 0;
+    uint16_t X = 0;
+    uint16_t Y = 0;
+
+    uint64_t Pack() const
+    {
+        return (uint64_t(Texture) << 40) | (uint64_t(Mip) << 32) | (uint64_t(Y) << 16) | uint64_t(X);
+    }
+
+    static TileKey Unpack(uint64_t packed)
+    {
+        TileKey key;
+        key.Texture = uint16_t(packed >> 40);
+        key.Mip = uint8_t(packed >> 32);
+        key.Y = uint16_t(packed >> 16);
+        key.X = uint16_t(packed);
+        return key;
+    }
+};
+
+// =========== Tile File ===========
+struct TileFileHeader
+{
+    uint32_t Magic = 0;
+    uint32_t Version = 0;
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint32_t TileSize = 0;
+    uint32_t Border = 0;
+    uint32_t MipCount = 0;
+    uint32_t Reserved = 0;
+};
+
+// Число мипов, пока уровень не поместится в один тайл
+uint32_t VtMipCount(uint32_t width, uint32_t height);
+uint32_t VtTilesX(uint32_t width, uint32_t mip);
+uint32_t VtTilesY(uint32_t height, uint32_t mip);
+
+// Режет TGA на тайлы с рамкой (вместе с цепочкой мипов) и пишет их в файл
+bool BakeTileFile(const TgaImage& image, const std::string& outPath);
+
+class TileFile
+{
+public:
+    bool Open(const std::string& path);
+
+    const TileFileHeader& Header() const { return mHeader; }
+
+    // dst должен вмещать VtTileBytes байт
+    bool ReadTile(uint32_t mip, uint32_t x, uint32_t y, void* dst);
+
+private:
+    std::ifstream mFile;
+    TileFileHeader mHeader;
+    std::vector<uint32_t> mMipFirstTile;
+};
+
+// =========== Physical Tile Cache ===========
+class TileCache
+{
+public:
+    static constexpr uint32_t InvalidSlot = UINT32_MAX;
+
+    explicit TileCache(uint32_t slotCount);
+
+    uint32_t SlotCount() const { return (uint32_t)mSlots.size(); }
+    size_t ResidentCount() const { return mLookup.size(); }
+
+    uint32_t Find(uint64_t key) const;
+    void Touch(uint32_t slot, uint64_t frame);
+
+    // Свободный слот или самый старый тайл, не использованный в кадре frame.
+    // evictedKey получает ключ вытесненного тайла (или UINT64_MAX).
+    uint32_t Allocate(uint64_t key, uint64_t frame, bool pinned, uint64_t& evictedKey);
+
+private:
+    struct Slot
+    {
+        uint64_t Key = 0;
+        uint64_t LastUsed = 0;
+        uint32_t Prev = InvalidSlot;
+        uint32_t Next = InvalidSlot;
+        bool Used = false;
+        bool Pinned = false;
+    };
+
+    void Unlink(uint32_t slot);
+    void PushFront(uint32_t slot);
+
+    std::vector<Slot> mSlots;
+    std::vector<uint32_t> mFreeSlots;
+    std::unordered_map<uint64_t, uint32_t> mLookup;
+    uint32_t mHead = InvalidSlot; // самый свежий
+    uint32_t mTail = InvalidSlot; // кандидат на вытеснение
+};
+
+// =========== Virtual Texture System ===========
+struct TileUpload
+{
+    TileKey Key;
+    uint32_t Slot = 0;
+};
+
+struct VirtualTextureStats
+{
+    uint32_t FeedbackEntries = 0;
+    uint32_t UniqueRequests = 0;
+    uint32_t CacheHits = 0;
+    uint32_t Uploads = 0;
+    uint32_t Evictions = 0;
+    uint32_t Deferred = 0; // не влезли в бюджет загрузок или в кэш
+};
+
+class VirtualTextureSystem
+{
+public:
+    VirtualTextureSystem(uint32_t cacheSlotsX, uint32_t cacheSlotsY, uint32_t maxUploadsPerFrame);
+
+    uint16_t AddTexture(uint32_t width, uint32_t height);
+
+    // Обрабатывает feedback одного кадра (упакованные TileKey, с повторами) и
+    // возвращает тайлы, которые нужно скопировать в физический кэш в этом кадре.
+    const std::vector<TileUpload>& Update(const uint64_t* feedback, size_t count);
+
+    // Запись таблицы страниц: x | y << 8 | mip << 16 | valid << 24
+    const std::vector<uint32_t>& PageTable(uint16_t texture, uint32_t mip) const;
+    uint32_t MipCount(uint16_t texture) const { return mTextures[texture].MipCount; }
+    bool IsPageTableDirty(uint16_t texture) const { return mTextures[texture].Dirty; }
+    void ClearPageTableDirty(uint16_t texture) { mTextures[texture].Dirty = false; }
+
+    uint32_t SlotX(uint32_t slot) const { return slot % mSlotsX; }
+    uint32_t SlotY(uint32_t slot) const { return slot / mSlotsX; }
+
+    void SetMaxUploadsPerFrame(uint32_t count) { mMaxUploadsPerFrame = count; }
+    const VirtualTextureStats& Stats() const { return mStats; }
+
+private:
+    struct TextureInfo
+    {
+        uint32_t Width = 0;
+        uint32_t Height = 0;
+        uint32_t MipCount = 0;
+        bool Changed = false; // резидентность поменялась в этом кадре
+        bool Dirty = true;    // таблицу страниц нужно перезалить на GPU
+        std::vector<std::vector<uint32_t>> PageTable;
+    };
+
+    struct Request
+    {
+        uint64_t Key = 0;
+        uint32_t Count = 0;
+    };
+
+    void RebuildPageTable(uint16_t texture);
+
+    TileCache mCache;
+    uint32_t mSlotsX = 0;
+    uint32_t mMaxUploadsPerFrame = 0;
+    uint64_t mFrame = 0;
+
+    std::vector<TextureInfo> mTextures;
+    std::vector<uint64_t> mScratchKeys;
+    std::vector<Request> mRequests;
+    std::vector<TileUpload> mUploads;
+    VirtualTextureStats mStats;
+};
@@ -13,5 +13,17 @@ namespace d3dUtil
         const std::string& entrypoint,
         const std::string& target);
 
+    // Без исключений и окон - для компиляции в задачах; текст ошибок в errors
+    HRESULT TryCompileShader(
+        const std::wstring& filename,
+        const D3D_SHADER_MACRO* defines,
+        const std::string& entrypoint,
+        const std::string& target,
+        Microsoft::WRL::ComPtr<ID3DBlob>& byteCode,
+        std::string& errors);
+
+    // Флаги компиляции шейдеров, входят в ключ кэша байткода
+    UINT ShaderCompileFlags();
+
     UINT CalcConstantBufferByteSize(UINT byteSize);
 }
\ No newline at end of file
@@ -0,0 +1,313 @@
+﻿#include "../h/ClusteredLights.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define CLUSTERED_LIGHTS_SSE 1
+#endif
+
+namespace
+{
+    // Боксы дополнения: до них от любой точки дальше любого радиуса
+    const float Empty = 1e30f;
+
+    // Ближе этого z сфера проецируется на весь слой
+    const float MinProjectedZ = 1e-3f;
+
+    double MicrosecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+ClusteredLights::ClusteredLights(JobSystem& jobs)
+    : mJobs(jobs)
+{
+    BuildBoxes();
+}
+
+void ClusteredLights::SetGrid(const ClusterGridDesc& desc)
+{
+    if (desc == mDesc)
+        return;
+
+    mDesc = desc;
+    BuildBoxes();
+}
+
+void ClusteredLights::BuildBoxes()
+{
+    uint32_t tiles = mDesc.CountX * mDesc.CountY;
+    uint32_t clusters = tiles * mDesc.CountZ;
+    mRowPadded = (mDesc.CountX + 3) & ~3u;
+    size_t boxes = (size_t)mRowPadded * mDesc.CountY * mDesc.CountZ;
+
+    // slice = log(z) * scale + bias: 0 на Near, CountZ на Far
+    float logRatio = std::log(mDesc.Far / mDesc.Near);
+    mZScale = (float)mDesc.CountZ / logRatio;
+    mZBias = -(float)mDesc.CountZ * std::log(mDesc.Near) / logRatio;
+
+    mSliceZ.resize(mDesc.CountZ + 1);
+    for (uint32_t z = 0; z <= mDesc.CountZ; z++)
+    {
+        mSliceZ[z] = mDesc.Near * std::pow(mDesc.Far / mDesc.Near, (float)z / (float)mDesc.CountZ);
+    }
+    mSliceZ[0] = 0.0f;
+
+    mMinX.assign(boxes, Empty);
+    mMaxX.assign(boxes, -Empty);
+    mMinY.assign(boxes, Empty);
+    mMaxY.assign(boxes, -Empty);
+
+    // Плитка - отрезок NDC; y плиток растёт вниз, как у SV_Position
+    for (uint32_t z = 0; z < mDesc.CountZ; z++)
+    {
+        float z0 = mSliceZ[z];
+        float z1 = mSliceZ[z + 1];
+
+        for (uint32_t y = 0; y < mDesc.CountY; y++)
+        {
+            float top = (1.0f - 2.0f * y / mDesc.CountY) * mDesc.TanHalfFovY;
+            float bottom = (1.0f - 2.0f * (y + 1) / mDesc.CountY) * mDesc.TanHalfFovY;
+
+            for (uint32_t x = 0; x < mDesc.CountX; x++)
+            {
+                float left = (-1.0f + 2.0f * x / mDesc.CountX) * mDesc.TanHalfFovX;
+                float right = (-1.0f + 2.0f * (x + 1) / mDesc.CountX) * mDesc.TanHalfFovX;
+
+                size_t i = ((size_t)z * mDesc.CountY + y) * mRowPadded + x;
+                mMinX[i] = (std::min)(left * z0, left * z1);
+                mMaxX[i] = (std::max)(right * z0, right * z1);
+                mMinY[i] = (std::min)(bottom * z0, bottom * z1);
+                mMaxY[i] = (std::max)(top * z0, top * z1);
+            }
+        }
+    }
+
+    mSliceLists.resize((size_t)clusters * mDesc.MaxLightsPerCluster);
+    mCounts.assign(clusters, 0);
+    mSliceTotals.assign(mDesc.CountZ, 0);
+    mSliceOverflows.assign(mDesc.CountZ, 0);
+    mRanges.assign((size_t)clusters * 2, 0);
+}
+
+void ClusteredLights::Build(const float view[4][4], const PointLight* lights, size_t count)
+{
+    mStats = {};
+    mStats.Lights = (uint32_t)count;
+    mStats.Clusters = mDesc.CountX * mDesc.CountY * mDesc.CountZ;
+
+    // =========== Пространство вида и отсечение пирамидой ===========
+    auto start = std::chrono::steady_clock::now();
+
+    float sideX = 1.0f / std::sqrt(1.0f + mDesc.TanHalfFovX * mDesc.TanHalfFovX);
+    float sideY = 1.0f / std::sqrt(1.0f + mDesc.TanHalfFovY * mDesc.TanHalfFovY);
+    float lastSlice = (float)(mDesc.CountZ - 1);
+
+    mLights.clear();
+    mFirstSlice.clear();
+    mLastSlice.clear();
+    for (size_t i = 0; i < count; i++)
+    {
+        const PointLight& light = lights[i];
+        float p[3];
+        for (int j = 0; j < 3; j++)
+        {
+            p[j] = light.Position[0] * view[0][j] + light.Position[1] * view[1][j] +
+                light.Position[2] * view[2][j] + view[3][j];
+        }
+
+        float r = light.Radius;
+        if (p[2] + r < 0.0f || p[2] - r > mDesc.Far)
+            continue;
+
+        // Боковые плоскости x = +-z * tan проходят через камеру
+        if ((std::fabs(p[0]) - p[2] * mDesc.TanHalfFovX) * sideX > r ||
+            (std::fabs(p[1]) - p[2] * mDesc.TanHalfFovY) * sideY > r)
+            continue;
+
+        ClusterLight cl;
+        memcpy(cl.Position, p, sizeof(p));
+        cl.Radius = r;
+        memcpy(cl.Color, light.Color, sizeof(cl.Color));
+        cl.Intensity = light.Intensity;
+        mLights.push_back(cl);
+
+        auto slice = [&](float z)
+        {
+            float s = z > 0.0f ? std::log(z) * mZScale + mZBias : 0.0f;
+            return (uint16_t)std::clamp(s, 0.0f, lastSlice);
+        };
+        mFirstSlice.push_back(slice(p[2] - r));
+        mLastSlice.push_back(slice(p[2] + r));
+    }
+    mStats.VisibleLights = (uint32_t)mLights.size();
+    mStats.TransformUs = MicrosecondsSince(start);
+
+    // =========== Раскладка по кластерам ===========
+    start = std::chrono::steady_clock::now();
+    mJobs.ParallelFor(mDesc.CountZ, [this](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t z = begin; z < end; z++)
+            BinSlice(z);
+    }, 1);
+    mStats.BinUs = MicrosecondsSince(start);
+
+    // =========== Сжатие в общий массив ===========
+    start = std::chrono::steady_clock::now();
+    uint32_t total = 0;
+    for (uint32_t z = 0; z < mDesc.CountZ; z++)
+    {
+        uint32_t sliceTotal = mSliceTotals[z];
+        mSliceTotals[z] = total;
+        total += sliceTotal;
+        mStats.Overflows += mSliceOverflows[z];
+    }
+    mIndices.resize(total);
+
+    uint32_t tiles = mDesc.CountX * mDesc.CountY;
+    uint32_t capacity = mDesc.MaxLightsPerCluster;
+    mJobs.ParallelFor(mDesc.CountZ, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t z = begin; z < end; z++)
+        {
+            uint32_t offset = mSliceTotals[z];
+            for (uint32_t t = 0; t < tiles; t++)
+            {
+                uint32_t c = z * tiles + t;
+                uint32_t n = mCounts[c];
+                mRanges[c * 2 + 0] = offset;
+                mRanges[c * 2 + 1] = n;
+                if (n > 0)
+                    memcpy(&mIndices[offset], &mSliceLists[(size_t)c * capacity], n * sizeof(uint32_t));
+                offset += n;
+            }
+        }
+    }, 1);
+
+    for (uint32_t n : mCounts)
+    {
+        mStats.NonEmptyClusters += n > 0 ? 1 : 0;
+    }
+    mStats.Indices = total;
+    mStats.CompactUs = MicrosecondsSince(start);
+}
+
+// Слой пишет только в свои кластеры - задачам не нужна синхронизация
+void ClusteredLights::BinSlice(uint32_t z)
+{
+    uint32_t tiles = mDesc.CountX * mDesc.CountY;
+    uint32_t capacity = mDesc.MaxLightsPerCluster;
+    uint32_t* counts = &mCounts[(size_t)z * tiles];
+    uint32_t* lists = &mSliceLists[(size_t)z * tiles * capacity];
+    size_t boxes = (size_t)z * mDesc.CountY * mRowPadded;
+    const float* minX = &mMinX[boxes];
+    const float* maxX = &mMaxX[boxes];
+    const float* minY = &mMinY[boxes];
+    const float* maxY = &mMaxY[boxes];
+    float z0 = mSliceZ[z];
+    float z1 = mSliceZ[z + 1];
+
+    std::fill(counts, counts + tiles, 0u);
+    uint32_t overflows = 0;
+
+    auto append = [&](uint32_t tile, uint32_t light)
+    {
+        if (counts[tile] < capacity)
+            lists[tile * capacity + counts[tile]++] = light;
+        else
+            overflows++;
+    };
+
+    for (uint32_t i = 0; i < (uint32_t)mLights.size(); i++)
+    {
+        if (z < mFirstSlice[i] || z > mLastSlice[i])
+            continue;
+
+        const ClusterLight& light = mLights[i];
+        float cx = light.Position[0];
+        float cy = light.Position[1];
+        float cz = light.Position[2];
+        float r = light.Radius;
+        float dz = (std::max)((std::max)(z0 - cz, cz - z1), 0.0f);
+
+        // Сколько квадрата радиуса осталось на x и y
+        float rest = r * r - dz * dz;
+        if (rest < 0.0f)
+            continue;
+
+        // Плитки под боксом сферы в пределах слоя: x / z монотонно по z, крайние
+        // значения - в углах. У самой камеры проекция вырождается - весь слой
+        uint32_t col0 = 0, col1 = mDesc.CountX - 1;
+        uint32_t row0 = 0, row1 = mDesc.CountY - 1;
+        float nearZ = (std::max)(z0, cz - r);
+        float farZ = (std::min)(z1, cz + r);
+        if (nearZ > MinProjectedZ)
+        {
+            auto cell = [](float ndc, uint32_t n)
+            {
+                return (uint32_t)std::clamp(ndc * 0.5f * n, 0.0f, (float)(n - 1));
+            };
+
+            float left = (std::min)((cx - r) / nearZ, (cx - r) / farZ) / mDesc.TanHalfFovX;
+            float right = (std::max)((cx + r) / nearZ, (cx + r) / farZ) / mDesc.TanHalfFovX;
+            float bottom = (std::min)((cy - r) / nearZ, (cy - r) / farZ) / mDesc.TanHalfFovY;
+            float top = (std::max)((cy + r) / nearZ, (cy + r) / farZ) / mDesc.TanHalfFovY;
+
+            col0 = cell(left + 1.0f, mDesc.CountX);
+            col1 = cell(right + 1.0f, mDesc.CountX);
+            row0 = cell(1.0f - top, mDesc.CountY);
+            row1 = cell(1.0f - bottom, mDesc.CountY);
+        }
+
+#ifdef CLUSTERED_LIGHTS_SSE
+        __m128 px = _mm_set1_ps(cx);
+        __m128 py = _mm_set1_ps(cy);
+        __m128 limit = _mm_set1_ps(rest);
+        __m128 zero = _mm_setzero_ps();
+
+        // Строки дополнены до 4: лишние столбцы - соседние или пустые кластеры
+        for (uint32_t y = row0; y <= row1; y++)
+        {
+            for (uint32_t x = col0 & ~3u; x <= col1; x += 4)
+            {
+                uint32_t b = y * mRowPadded + x;
+                __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minX + b), px), _mm_sub_ps(px, _mm_loadu_ps(maxX + b))), zero);
+                __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minY + b), py), _mm_sub_ps(py, _mm_loadu_ps(maxY + b))), zero);
+                __m128 d = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+                int mask = _mm_movemask_ps(_mm_cmple_ps(d, limit));
+                while (mask != 0)
+                {
+                    append(y * mDesc.CountX + x + (uint32_t)std::countr_zero((uint32_t)mask), i);
+                    mask &= mask - 1;
+                }
+            }
+        }
+#else
+        for (uint32_t y = row0; y <= row1; y++)
+        {
+            for (uint32_t x = col0; x <= col1; x++)
+            {
+                uint32_t b = y * mRowPadded + x;
+                float dx = (std::max)((std::max)(minX[b] - cx, cx - maxX[b]), 0.0f);
+                float dy = (std::max)((std::max)(minY[b] - cy, cy - maxY[b]), 0.0f);
+                if (dx * dx + dy * dy <= rest)
+                    append(y * mDesc.CountX + x, i);
+            }
+        }
+#endif
+    }
+
+    uint32_t total = 0;
+    for (uint32_t t = 0; t < tiles; t++)
+    {
+        total += counts[t];
+    }
+    mSliceTotals[z] = total;
+    mSliceOverflows[z] = overflows;
+}
@@ -0,0 +1,328 @@
+﻿#include "../h/DdsLoader.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+    constexpr uint32_t DdsMagic = 0x20534444; // 'DDS '
+
+    constexpr uint32_t DDSD_CAPS = 0x1;
+    constexpr uint32_t DDSD_HEIGHT = 0x2;
+    constexpr uint32_t DDSD_WIDTH = 0x4;
+    constexpr uint32_t DDSD_PITCH = 0x8;
+    constexpr uint32_t DDSD_PIXELFORMAT = 0x1000;
+    constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+    constexpr uint32_t DDPF_ALPHAPIXELS = 0x1;
+    constexpr uint32_t DDPF_FOURCC = 0x4;
+    constexpr uint32_t DDPF_RGB = 0x40;
+    constexpr uint32_t DDSCAPS_COMPLEX = 0x8;
+    constexpr uint32_t DDSCAPS_TEXTURE = 0x1000;
+    constexpr uint32_t DDSCAPS_MIPMAP = 0x400000;
+    constexpr uint32_t DDSCAPS2_CUBEMAP = 0x200;
+    constexpr uint32_t DDSCAPS2_VOLUME = 0x200000;
+
+    constexpr uint32_t D3D10_RESOURCE_DIMENSION_TEXTURE2D = 3;
+    constexpr uint32_t D3D10_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+    // D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION и D3D12_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION
+    constexpr uint32_t MaxTextureDimension = 16384;
+    constexpr uint32_t MaxArraySize = 2048;
+
+    struct DdsPixelFormat
+    {
+        uint32_t Size;
+        uint32_t Flags;
+        uint32_t FourCC;
+        uint32_t RGBBitCount;
+        uint32_t RBitMask;
+        uint32_t GBitMask;
+        uint32_t BBitMask;
+        uint32_t ABitMask;
+    };
+
+    struct DdsHeader
+    {
+        uint32_t Size;
+        uint32_t Flags;
+        uint32_t Height;
+        uint32_t Width;
+        uint32_t PitchOrLinearSize;
+        uint32_t Depth;
+        uint32_t MipMapCount;
+        uint32_t Reserved1[11];
+        DdsPixelFormat PixelFormat;
+        uint32_t Caps;
+        uint32_t Caps2;
+        uint32_t Caps3;
+        uint32_t Caps4;
+        uint32_t Reserved2;
+    };
+
+    struct DdsHeaderDx10
+    {
+        uint32_t DxgiFormat;
+        uint32_t ResourceDimension;
+        uint32_t MiscFlag;
+        uint32_t ArraySize;
+        uint32_t MiscFlags2;
+    };
+
+    static_assert(sizeof(DdsHeader) == 124, "DDS_HEADER layout");
+    static_assert(sizeof(DdsHeaderDx10) == 20, "DDS_HEADER_DXT10 layout");
+
+    constexpr uint32_t MakeFourCC(char a, char b, char c, char d)
+    {
+        return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) |
+               (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+    }
+
+    uint32_t LegacyFormat(const DdsPixelFormat& pf)
+    {
+        if (pf.Flags & DDPF_FOURCC)
+        {
+            switch (pf.FourCC)
+            {
+                case MakeFourCC('D', 'X', 'T', '1'): return DdsFormat::BC1_UNORM;
+                case MakeFourCC('D', 'X', 'T', '2'):
+                case MakeFourCC('D', 'X', 'T', '3'): return DdsFormat::BC2_UNORM;
+                case MakeFourCC('D', 'X', 'T', '4'):
+                case MakeFourCC('D', 'X', 'T', '5'): return DdsFormat::BC3_UNORM;
+                case MakeFourCC('A', 'T', 'I', '1'):
+                case MakeFourCC('B', 'C', '4', 'U'): return DdsFormat::BC4_UNORM;
+                case MakeFourCC('B', 'C', '4', 'S'): return DdsFormat::BC4_SNORM;
+                case MakeFourCC('A', 'T', 'I', '2'):
+                case MakeFourCC('B', 'C', '5', 'U'): return DdsFormat::BC5_UNORM;
+                case MakeFourCC('B', 'C', '5', 'S'): return DdsFormat::BC5_SNORM;
+                default: return DdsFormat::Unknown;
+            }
+        }
+
+        if ((pf.Flags & DDPF_RGB) && pf.RGBBitCount == 32)
+        {
+            bool hasAlpha = (pf.Flags & DDPF_ALPHAPIXELS) && pf.ABitMask == 0xff000000;
+            if (pf.RBitMask == 0x00ff0000 && pf.GBitMask == 0x0000ff00 && pf.BBitMask == 0x000000ff)
+                return hasAlpha ? DdsFormat::B8G8R8A8_UNORM : DdsFormat::B8G8R8X8_UNORM;
+            if (pf.RBitMask == 0x000000ff && pf.GBitMask == 0x0000ff00 && pf.BBitMask == 0x00ff0000 && hasAlpha)
+                return DdsFormat::R8G8B8A8_UNORM;
+        }
+
+        return DdsFormat::Unknown;
+    }
+
+    // Строка для BC - строка блоков 4x4; размеры уже не больше MaxTextureDimension
+    void MipLayout(uint32_t width, uint32_t height, uint32_t bitsPerPixel, bool compressed, DdsSubresource& sub)
+    {
+        sub.Width = width;
+        sub.Height = height;
+
+        if (compressed)
+        {
+            sub.RowPitch = uint32_t(size_t((width + 3) / 4) * bitsPerPixel * 2); // 16 пикселей в блоке
+            sub.NumRows = (height + 3) / 4;
+        }
+        else
+        {
+            sub.RowPitch = uint32_t(size_t(width) * bitsPerPixel / 8);
+            sub.NumRows = height;
+        }
+    }
+}
+
+bool IsBlockCompressed(uint32_t format)
+{
+    return (format >= DdsFormat::BC1_UNORM && format <= DdsFormat::BC5_SNORM) ||
+           (format >= DdsFormat::BC6H_UF16 && format <= DdsFormat::BC7_UNORM_SRGB);
+}
+
+uint32_t FormatBitsPerPixel(uint32_t format)
+{
+    switch (format)
+    {
+        case DdsFormat::BC1_UNORM:
+        case DdsFormat::BC1_UNORM_SRGB:
+        case DdsFormat::BC4_UNORM:
+        case DdsFormat::BC4_SNORM:
+            return 4;
+        case DdsFormat::BC2_UNORM:
+        case DdsFormat::BC2_UNORM_SRGB:
+        case DdsFormat::BC3_UNORM:
+        case DdsFormat::BC3_UNORM_SRGB:
+        case DdsFormat::BC5_UNORM:
+        case DdsFormat::BC5_SNORM:
+        case DdsFormat::BC6H_UF16:
+        case DdsFormat::BC6H_SF16:
+        case DdsFormat::BC7_UNORM:
+        case DdsFormat::BC7_UNORM_SRGB:
+            return 8;
+        case DdsFormat::R8G8B8A8_UNORM:
+        case DdsFormat::R8G8B8A8_UNORM_SRGB:
+        case DdsFormat::B8G8R8A8_UNORM:
+        case DdsFormat::B8G8R8X8_UNORM:
+        case DdsFormat::B8G8R8A8_UNORM_SRGB:
+            return 32;
+        default:
+            return 0;
+    }
+}
+
+bool ParseDDS(const uint8_t* data, size_t size, DdsImage& outImage)
+{
+    if (size < 4 + sizeof(DdsHeader))
+        return false;
+
+    uint32_t magic;
+    memcpy(&magic, data, 4);
+    if (magic != DdsMagic)
+        return false;
+
+    DdsHeader header;
+    memcpy(&header, data + 4, sizeof(header));
+    if (header.Size != sizeof(DdsHeader) || header.PixelFormat.Size != sizeof(DdsPixelFormat))
+        return false;
+
+    // До любой арифметики с размерами
+    if (header.Width == 0 || header.Height == 0 ||
+        header.Width > MaxTextureDimension || header.Height > MaxTextureDimension)
+        return false;
+
+    size_t offset = 4 + sizeof(DdsHeader);
+
+    outImage = DdsImage{};
+    outImage.Width = header.Width;
+    outImage.Height = header.Height;
+    outImage.MipCount = (header.Flags & DDSD_MIPMAPCOUNT) ? std::max(1u, header.MipMapCount) : 1;
+    outImage.ArraySize = 1;
+
+    if ((header.PixelFormat.Flags & DDPF_FOURCC) && header.PixelFormat.FourCC == MakeFourCC('D', 'X', '1', '0'))
+    {
+        if (size < offset + sizeof(DdsHeaderDx10))
+            return false;
+
+        DdsHeaderDx10 dx10;
+        memcpy(&dx10, data + offset, sizeof(dx10));
+        offset += sizeof(dx10);
+
+        if (dx10.ResourceDimension != D3D10_RESOURCE_DIMENSION_TEXTURE2D)
+            return false;
+
+        bool cube = (dx10.MiscFlag & D3D10_RESOURCE_MISC_TEXTURECUBE) != 0;
+        if (dx10.ArraySize > (cube ? MaxArraySize / 6 : MaxArraySize))
+            return false;
+
+        outImage.Format = dx10.DxgiFormat;
+        outImage.ArraySize = std::max(1u, dx10.ArraySize);
+        if (cube)
+        {
+            outImage.IsCubemap = true;
+            outImage.ArraySize *= 6;
+        }
+    }
+    else
+    {
+        if (header.Caps2 & DDSCAPS2_VOLUME)
+            return false;
+
+        outImage.Format = LegacyFormat(header.PixelFormat);
+        if (header.Caps2 & DDSCAPS2_CUBEMAP)
+        {
+            // Неполные кубы (не все грани) не поддерживаем
+            if ((header.Caps2 & 0xFC00) != 0xFC00)
+                return false;
+            outImage.IsCubemap = true;
+            outImage.ArraySize = 6;
+        }
+    }
+
+    uint32_t bitsPerPixel = FormatBitsPerPixel(outImage.Format);
+    if (bitsPerPixel == 0)
+        return false;
+
+    // Верхний мип BC-текстуры D3D12 принимает только целыми блоками
+    bool compressed = IsBlockCompressed(outImage.Format);
+    if (compressed && (outImage.Width % 4 != 0 || outImage.Height % 4 != 0))
+        return false;
+
+    // Цепочка не может быть длиннее полной
+    uint32_t maxMips = 1;
+    while (std::max(outImage.Width, outImage.Height) >> maxMips)
+        ++maxMips;
+    if (outImage.MipCount > maxMips)
+        return false;
+
+    // Все слои одинаковы: сначала размер цепочки одного слоя, и только если файл
+    // вмещает все слои - память под подресурсы
+    size_t sliceBytes = 0;
+    for (uint32_t mip = 0; mip < outImage.MipCount; ++mip)
+    {
+        DdsSubresource sub;
+        MipLayout(std::max(1u, outImage.Width >> mip), std::max(1u, outImage.Height >> mip), bitsPerPixel, compressed, sub);
+        sliceBytes += size_t(sub.RowPitch) * sub.NumRows;
+    }
+    if (offset > size || sliceBytes > (size - offset) / outImage.ArraySize)
+        return false;
+
+    outImage.Subresources.reserve(size_t(outImage.ArraySize) * outImage.MipCount);
+
+    // В файле: для каждого слоя вся цепочка мипов
+    for (uint32_t slice = 0; slice < outImage.ArraySize; ++slice)
+    {
+        for (uint32_t mip = 0; mip < outImage.MipCount; ++mip)
+        {
+            DdsSubresource sub;
+            MipLayout(std::max(1u, outImage.Width >> mip), std::max(1u, outImage.Height >> mip), bitsPerPixel, compressed, sub);
+            sub.Offset = offset;
+            offset += size_t(sub.RowPitch) * sub.NumRows;
+
+            outImage.Subresources.push_back(sub);
+        }
+    }
+
+    return true;
+}
+
+bool SaveDDS(
+    const std::string& filename, uint32_t format, uint32_t width, uint32_t height,
+    uint32_t mipCount, uint32_t arraySize, const uint8_t* const* subresources)
+{
+    uint32_t bitsPerPixel = FormatBitsPerPixel(format);
+    if (bitsPerPixel == 0 || IsBlockCompressed(format) || width == 0 || height == 0 || mipCount == 0 || arraySize == 0)
+        return false;
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    DdsHeader header = {};
+    header.Size = sizeof(DdsHeader);
+    header.Flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PITCH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT;
+    header.Height = height;
+    header.Width = width;
+    header.PitchOrLinearSize = width * bitsPerPixel / 8;
+    header.MipMapCount = mipCount;
+    header.PixelFormat.Size = sizeof(DdsPixelFormat);
+    header.PixelFormat.Flags = DDPF_FOURCC;
+    header.PixelFormat.FourCC = MakeFourCC('D', 'X', '1', '0');
+    header.Caps = DDSCAPS_TEXTURE | (mipCount > 1 || arraySize > 1 ? DDSCAPS_COMPLEX : 0) | (mipCount > 1 ? DDSCAPS_MIPMAP : 0);
+
+    DdsHeaderDx10 dx10 = {};
+    dx10.DxgiFormat = format;
+    dx10.ResourceDimension = D3D10_RESOURCE_DIMENSION_TEXTURE2D;
+    dx10.ArraySize = arraySize;
+
+    file.write(reinterpret_cast<const char*>(&DdsMagic), 4);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(&dx10), sizeof(dx10));
+
+    // Слой за слоем, в слое - вся цепочка мипов (как читает ParseDDS)
+    for (uint32_t slice = 0; slice < arraySize; ++slice)
+    {
+        for (uint32_t mip = 0; mip < mipCount; ++mip)
+        {
+            size_t bytes = size_t(std::max(1u, width >> mip)) * std::max(1u, height >> mip) * bitsPerPixel / 8;
+            file.write(reinterpret_cast<const char*>(subresources[mip + slice * mipCount]), (std::streamsize)bytes);
+        }
+    }
+
+    return (bool)file;
+}
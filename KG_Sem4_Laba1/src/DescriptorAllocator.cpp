@@ -0,0 +1,139 @@
+﻿#include "../h/DescriptorAllocator.h"
+#include <iterator>
+
+DescriptorAllocator::DescriptorAllocator(uint32_t persistentCapacity, uint32_t transientCapacity)
+    : mPersistentCapacity(persistentCapacity)
+    , mTransient(transientCapacity)
+{
+    if (persistentCapacity > 0)
+        mFree[0] = persistentCapacity;
+}
+
+uint32_t DescriptorAllocator::AllocatePersistent(uint32_t count)
+{
+    if (count == 0)
+        return InvalidOffset;
+
+    // Лучший подходящий: меньше дробим большие свободные куски
+    auto best = mFree.end();
+    for (auto it = mFree.begin(); it != mFree.end(); ++it)
+    {
+        if (it->second >= count && (best == mFree.end() || it->second < best->second))
+        {
+            best = it;
+            if (it->second == count)
+                break;
+        }
+    }
+
+    if (best == mFree.end())
+    {
+        mFailures++;
+        return InvalidOffset;
+    }
+
+    uint32_t offset = best->first;
+    uint32_t rest = best->second - count;
+    mFree.erase(best);
+    if (rest > 0)
+        mFree[offset + count] = rest;
+
+    mPersistentUsed += count;
+    return offset;
+}
+
+void DescriptorAllocator::FreePersistent(uint32_t offset, uint32_t count)
+{
+    if (offset == InvalidOffset || count == 0)
+        return;
+
+    mPersistentUsed -= count;
+    InsertFree(offset, count);
+}
+
+void DescriptorAllocator::InsertFree(uint32_t offset, uint32_t count)
+{
+    auto next = mFree.lower_bound(offset);
+
+    // Сливаем с правым соседом
+    if (next != mFree.end() && offset + count == next->first)
+    {
+        count += next->second;
+        next = mFree.erase(next);
+    }
+
+    // И с левым
+    if (next != mFree.begin())
+    {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset)
+        {
+            prev->second += count;
+            return;
+        }
+    }
+
+    mFree.emplace_hint(next, offset, count);
+}
+
+uint32_t DescriptorAllocator::PersistentHighWater() const
+{
+    if (mFree.empty())
+        return mPersistentCapacity;
+
+    auto last = std::prev(mFree.end());
+    return last->first + last->second == mPersistentCapacity ? last->first : mPersistentCapacity;
+}
+
+uint32_t DescriptorAllocator::AllocateTransient(uint32_t count)
+{
+    uint64_t offset = mTransient.Allocate(count, 1);
+    if (offset == UploadRing::InvalidOffset)
+    {
+        mFailures++;
+        return InvalidOffset;
+    }
+    return (uint32_t)offset;
+}
+
+void DescriptorAllocator::FinishFrame(uint64_t fenceValue)
+{
+    mTransient.FinishFrame(fenceValue);
+}
+
+void DescriptorAllocator::Reclaim(uint64_t completedValue)
+{
+    mTransient.Reclaim(completedValue);
+}
+
+void DescriptorAllocator::Resize(uint32_t persistentCapacity, uint32_t transientCapacity)
+{
+    if (persistentCapacity > mPersistentCapacity)
+    {
+        InsertFree(mPersistentCapacity, persistentCapacity - mPersistentCapacity);
+        mPersistentCapacity = persistentCapacity;
+    }
+
+    mTransient = UploadRing(transientCapacity);
+    mGrows++;
+}
+
+DescriptorAllocatorStats DescriptorAllocator::Stats() const
+{
+    DescriptorAllocatorStats stats;
+    stats.PersistentUsed = mPersistentUsed;
+    stats.PersistentCapacity = mPersistentCapacity;
+    stats.FreeRanges = (uint32_t)mFree.size();
+    for (const auto& range : mFree)
+    {
+        if (range.second > stats.LargestFreeRange)
+            stats.LargestFreeRange = range.second;
+    }
+
+    stats.TransientUsed = (uint32_t)mTransient.UsedBytes();
+    stats.TransientPeak = (uint32_t)mTransient.Stats().PeakUsed;
+    stats.TransientCapacity = (uint32_t)mTransient.Capacity();
+    stats.Failures = mFailures;
+    stats.Grows = mGrows;
+    return stats;
+}
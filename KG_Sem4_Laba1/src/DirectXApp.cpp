@@ -2,9 +2,15 @@
 #include <DirectXMath.h>
 #include <d3d12.h>
 #include <d3dcompiler.h>
+#include <algorithm>
+#include <bit>
+#include <chrono>
 #include <dxgi1_6.h>
+#include <filesystem>
+#include <random>
 #include <string>
 #include "../h/ThrowIfFailed.h"
+#include "../h/MipChain.h"
 #include "../h/Parser.h"
 #include "../h/TgaLoader.h"
 #include "../h/d3dUtil.h"
@@ -33,6 +39,25 @@ struct CD3DX12_RESOURCE_BARRIER_HELPER {
     }
 };
 
+// Текстуры читает только пиксельный шейдер - как у созданных вне графа
+static D3D12_RESOURCE_STATES ToD3DState(FrameGraphState state)
+{
+    switch (state)
+    {
+    case FrameGraphState::Present:      return D3D12_RESOURCE_STATE_PRESENT;
+    case FrameGraphState::RenderTarget: return D3D12_RESOURCE_STATE_RENDER_TARGET;
+    case FrameGraphState::DepthWrite:   return D3D12_RESOURCE_STATE_DEPTH_WRITE;
+    case FrameGraphState::DepthRead:    return D3D12_RESOURCE_STATE_DEPTH_READ;
+    case FrameGraphState::ShaderRead:   return D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+    case FrameGraphState::CopySource:   return D3D12_RESOURCE_STATE_COPY_SOURCE;
+    case FrameGraphState::CopyDest:     return D3D12_RESOURCE_STATE_COPY_DEST;
+    case FrameGraphState::VertexBuffer: return D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
+    case FrameGraphState::IndexBuffer:  return D3D12_RESOURCE_STATE_INDEX_BUFFER;
+    case FrameGraphState::UnorderedAccess: return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    default:                            return D3D12_RESOURCE_STATE_COMMON;
+    }
+}
+
 struct CD3DX12_DEFAULT {};
 extern const DECLSPEC_SELECTANY CD3DX12_DEFAULT D3D12_DEFAULT;
 
@@ -113,6 +138,9 @@ void DirectXApp::OnMouseDown(WPARAM btnState, int x, int y)
     mLastMousePos.x = x;
     mLastMousePos.y = y;
 
+    if (btnState & MK_LBUTTON)
+        PickSubmesh(x, y);
+
     SetCapture(window.GetHwnd());
 }
 
@@ -156,81 +184,116 @@ void DirectXApp::BuildInputLayout()
           D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 
         { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24,
+          D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+
+        { "TEXCOORD", 1, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32,
           D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
     };
 }
 
 // =========== Shader ===========
+// Байткод берётся из кэша по хешу исходника и настроек, промахи компилируются
+// задачами параллельно и сохраняются
 void DirectXApp::BuildShaders()
 {
-    mvsByteCode = d3dUtil::CompileShader(
-        L"../src/shaders.hlsl",
-        nullptr,
-        "VS",
-        "vs_5_0"
-    );
+    auto start = std::chrono::steady_clock::now();
 
-    mpsByteCode = d3dUtil::CompileShader(
-        L"../src/shaders.hlsl",
-        nullptr,
-        "PS",
-        "ps_5_0"
-    );
+    const std::string shaderPath = "../src/shaders.hlsl";
+    const UINT flags = d3dUtil::ShaderCompileFlags();
 
-    MessageBox(NULL, L"SUCCESS! Shaders compiled", L"Info", MB_OK);
-}
+    struct ShaderBuild
+    {
+        ShaderKey Key;
+        Microsoft::WRL::ComPtr<ID3DBlob>* ByteCode = nullptr;
+        uint64_t Hash = 0;
+        bool Compiled = false;
+        HRESULT Result = S_OK;
+        std::string Errors;
+    };
 
-// =========== CBV ===========
-void DirectXApp::BuildConstantBuffer()
-{
-    // Upload Buffer
-    mObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(
-        device.Get(),
-        1,
-        true
-    );
+    std::vector<ShaderBuild> builds =
+    {
+        { { shaderPath, {}, "VS", "vs_5_0", flags }, &mvsByteCode },
+        // Тот же VS, но мировая матрица берётся из буфера экземпляров
+        { { shaderPath, { { "INSTANCED", "1" } }, "VS", "vs_5_0", flags }, &mvsInstancedByteCode },
+    };
+
+    // PS - по перестановке на каждый ключ, который есть у материалов
+    for (uint32_t features = 0; features < MaterialPermutationCount; features++)
+    {
+        if ((mPermutations & (1u << features)) == 0)
+            continue;
+
+        ShaderBuild build;
+        build.Key = { shaderPath, {}, "PS", "ps_5_0", flags };
+        if (features & MaterialFeatureMap1)
+            build.Key.Defines.push_back({ "HAS_MAP1", "1" });
+        if (features & MaterialFeatureMap2)
+            build.Key.Defines.push_back({ "HAS_MAP2", "1" });
+        if (features & MaterialFeatureAlphaTest)
+            build.Key.Defines.push_back({ "ALPHA_TEST", "1" });
+        if (features & MaterialFeatureVirtual)
+            build.Key.Defines.push_back({ "VIRTUAL_TEXTURE", "1" });
+        build.ByteCode = &mpsByteCode[features];
+        builds.push_back(build);
+    }
 
-    // Initialization of matrix
-    ObjectConstants objConstants;
-    XMMATRIX view = XMMatrixIdentity();
-    XMMATRIX proj = XMMatrixOrthographicLH(10.0f, 10.0f, 0.1f, 100.0f);
-    XMMATRIX viewProj = view * proj;
-    XMStoreFloat4x4(&objConstants.mWorldViewProj, XMMatrixTranspose(viewProj));
+    JobCounter compiled;
+    for (auto& build : builds)
+    {
+        build.Hash = ShaderCache::HashKey(build.Key);
 
-    // Initialization UV transform
-    objConstants.mUVTransform = XMFLOAT4(1.0f, 1.0f, 0.0f, 0.0f);
+        std::vector<uint8_t> blob;
+        if (build.Hash != 0 && mShaderCache.Load(build.Hash, blob))
+        {
+            ThrowIfFailed(D3DCreateBlob(blob.size(), build.ByteCode->ReleaseAndGetAddressOf()));
+            memcpy((*build.ByteCode)->GetBufferPointer(), blob.data(), blob.size());
+            continue;
+        }
 
-    // Initialization blend factor (0.0f = только первая текстура)
-    objConstants.mBlendFactor = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+        build.Compiled = true;
+        mJobs.Run([&build]()
+        {
+            std::vector<D3D_SHADER_MACRO> macros;
+            for (const auto& define : build.Key.Defines)
+                macros.push_back({ define.Name.c_str(), define.Value.c_str() });
+            macros.push_back({ nullptr, nullptr });
+
+            std::wstring path(build.Key.SourcePath.begin(), build.Key.SourcePath.end());
+            build.Result = d3dUtil::TryCompileShader(
+                path, macros.data(), build.Key.EntryPoint, build.Key.Target, *build.ByteCode, build.Errors);
+        }, &compiled);
+    }
+    mJobs.Wait(compiled);
 
-    mObjectCB->CopyData(0, objConstants);
+    for (auto& build : builds)
+    {
+        if (!build.Errors.empty())
+        {
+            std::string errorStr = "Shader Compile Error:\n" + build.Errors;
+            OutputDebugStringA(errorStr.c_str());
+        }
 
-    // Make CBV (Constant Buffer View) in a heap of descriptors
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-    D3D12_GPU_VIRTUAL_ADDRESS cbAddress = mObjectCB->Resource()->GetGPUVirtualAddress();
+        if (FAILED(build.Result))
+        {
+            MessageBoxA(0, build.Errors.c_str(), "Shader Compile Error", MB_OK);
+            ThrowIfFailed(build.Result);
+        }
 
-    D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc;
-    cbvDesc.BufferLocation = cbAddress;
-    cbvDesc.SizeInBytes = objCBByteSize;
+        if (build.Compiled && build.Hash != 0)
+        {
+            mShaderCache.Store(build.Hash, (*build.ByteCode)->GetBufferPointer(), (*build.ByteCode)->GetBufferSize());
+        }
+    }
 
-    // Getting descriptors from CBV heap
-    D3D12_CPU_DESCRIPTOR_HANDLE cbvHandle = mCbvHeap->GetCPUDescriptorHandleForHeapStart();
-    device->CreateConstantBufferView(&cbvDesc, cbvHandle);
+    mShaderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 
-    MessageBox(NULL, L"Constant buffer and CBV created", L"Info", MB_OK);
+    MessageBox(NULL, L"SUCCESS! Shaders compiled", L"Info", MB_OK);
 }
 
 // =========== Root Signature ===========
 void DirectXApp::BuildRootSignature()
 {
-    // ===== CBV range (b0)
-    D3D12_DESCRIPTOR_RANGE cbvRange = {};
-    cbvRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_CBV;
-    cbvRange.NumDescriptors = 1;
-    cbvRange.BaseShaderRegister = 0;
-    cbvRange.RegisterSpace = 0;
-    cbvRange.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-
     // ===== SRV range (t0 и t1) - ТЕПЕРЬ ДВА ДЕСКРИПТОРА!
     D3D12_DESCRIPTOR_RANGE srvRange[2] = {};
 
@@ -248,12 +311,28 @@ void DirectXApp::BuildRootSignature()
     srvRange[1].RegisterSpace = 0;
     srvRange[1].OffsetInDescriptorsFromTableStart = 1;
 
-    D3D12_ROOT_PARAMETER rootParameters[2];
-
-    // Slot 0 → CBV (b0)
-    rootParameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    rootParameters[0].DescriptorTable.NumDescriptorRanges = 1;
-    rootParameters[0].DescriptorTable.pDescriptorRanges = &cbvRange;
+    // Атлас лайтмапов (t0, space3)
+    D3D12_DESCRIPTOR_RANGE lightmapRange = {};
+    lightmapRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+    lightmapRange.NumDescriptors = 1;
+    lightmapRange.BaseShaderRegister = 0;
+    lightmapRange.RegisterSpace = 3;
+    lightmapRange.OffsetInDescriptorsFromTableStart = 0;
+
+    // Кэш тайлов и таблица страниц виртуальной текстуры (t0-t1, space4)
+    D3D12_DESCRIPTOR_RANGE virtualRange = {};
+    virtualRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+    virtualRange.NumDescriptors = 2;
+    virtualRange.BaseShaderRegister = 0;
+    virtualRange.RegisterSpace = 4;
+    virtualRange.OffsetInDescriptorsFromTableStart = 0;
+
+    D3D12_ROOT_PARAMETER rootParameters[9];
+
+    // Slot 0 → root CBV (b0): адрес ObjectConstants своей отрисовки
+    rootParameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+    rootParameters[0].Descriptor.ShaderRegister = 0;
+    rootParameters[0].Descriptor.RegisterSpace = 0;
     rootParameters[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
 
     // Slot 1 → SRV (t0 и t1)
@@ -262,22 +341,67 @@ void DirectXApp::BuildRootSignature()
     rootParameters[1].DescriptorTable.pDescriptorRanges = srvRange;
     rootParameters[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
 
-    // ===== Static Sampler (s0)
-    D3D12_STATIC_SAMPLER_DESC sampler = {};
-    sampler.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
-    sampler.AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-    sampler.AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-    sampler.AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-    sampler.ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER;
-    sampler.ShaderRegister = 0;
-    sampler.RegisterSpace = 0;
-    sampler.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+    // Slot 2 → root SRV (t0, space1): матрицы экземпляров, адрес смещён на первый экземпляр отрисовки
+    rootParameters[2].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+    rootParameters[2].Descriptor.ShaderRegister = 0;
+    rootParameters[2].Descriptor.RegisterSpace = 1;
+    rootParameters[2].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+
+    // Slots 3-5 → root SRV (t0-t2, space2): источники, диапазоны кластеров и индексы кадра
+    for (UINT i = 0; i < 3; i++)
+    {
+        rootParameters[3 + i].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+        rootParameters[3 + i].Descriptor.ShaderRegister = i;
+        rootParameters[3 + i].Descriptor.RegisterSpace = 2;
+        rootParameters[3 + i].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+    }
+
+    // Slot 6 → SRV (t0, space3): лайтмапы
+    rootParameters[6].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+    rootParameters[6].DescriptorTable.NumDescriptorRanges = 1;
+    rootParameters[6].DescriptorTable.pDescriptorRanges = &lightmapRange;
+    rootParameters[6].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+
+    // Slot 7 → SRV (t0-t1, space4): виртуальная текстура
+    rootParameters[7].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+    rootParameters[7].DescriptorTable.NumDescriptorRanges = 1;
+    rootParameters[7].DescriptorTable.pDescriptorRanges = &virtualRange;
+    rootParameters[7].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+
+    // Slot 8 → root UAV (u0): обратная связь виртуальной текстуры
+    rootParameters[8].ParameterType = D3D12_ROOT_PARAMETER_TYPE_UAV;
+    rootParameters[8].Descriptor.ShaderRegister = 0;
+    rootParameters[8].Descriptor.RegisterSpace = 0;
+    rootParameters[8].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+
+    // ===== Static Samplers (s0, s1, s2)
+    D3D12_STATIC_SAMPLER_DESC samplers[3] = {};
+    samplers[0].Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
+    samplers[0].AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+    samplers[0].AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+    samplers[0].AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+    samplers[0].ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER;
+    samplers[0].ShaderRegister = 0;
+    samplers[0].RegisterSpace = 0;
+    samplers[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+
+    // Лайтмапы: карта у края страницы не должна читать противоположный край
+    samplers[1] = samplers[0];
+    samplers[1].AddressU = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+    samplers[1].AddressV = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+    samplers[1].AddressW = D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+    samplers[1].ShaderRegister = 1;
+
+    // Кэш тайлов: рамка тайла уже повторяет соседей, мипов нет
+    samplers[2] = samplers[1];
+    samplers[2].Filter = D3D12_FILTER_MIN_MAG_LINEAR_MIP_POINT;
+    samplers[2].ShaderRegister = 2;
 
     D3D12_ROOT_SIGNATURE_DESC rootSigDesc = {};
-    rootSigDesc.NumParameters = 2;
+    rootSigDesc.NumParameters = 9;
     rootSigDesc.pParameters = rootParameters;
-    rootSigDesc.NumStaticSamplers = 1;
-    rootSigDesc.pStaticSamplers = &sampler;
+    rootSigDesc.NumStaticSamplers = 3;
+    rootSigDesc.pStaticSamplers = samplers;
     rootSigDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
 
     ComPtr<ID3DBlob> serializedRootSig = nullptr;
@@ -303,7 +427,57 @@ void DirectXApp::BuildRootSignature()
 }
 
 // =========== PSO (Pipeline State Object) ===========
-void DirectXApp::BuildPSO()
+// Блоб, который драйвер отдал для PSO с теми же шейдерами и состоянием, лежит
+// в mShaderCache. Блоб от другого драйвера или GPU создание отвергает - тогда
+// PSO собирается заново и блоб перезаписывается.
+HRESULT DirectXApp::CreateCachedPipelineState(
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC desc,
+    Microsoft::WRL::ComPtr<ID3D12PipelineState>& pso)
+{
+    ContentHash hash;
+    hash.Add(std::string("pso"));
+    hash.Add(desc.VS.pShaderBytecode, desc.VS.BytecodeLength);
+    hash.Add(desc.PS.pShaderBytecode, desc.PS.BytecodeLength);
+    hash.Add(&desc.BlendState, sizeof(desc.BlendState));
+    hash.Add(&desc.RasterizerState, sizeof(desc.RasterizerState));
+    hash.Add(&desc.DepthStencilState, sizeof(desc.DepthStencilState));
+    hash.Add((uint64_t)desc.SampleMask);
+    hash.Add((uint64_t)desc.PrimitiveTopologyType);
+    hash.Add((uint64_t)desc.NumRenderTargets);
+    hash.Add(desc.RTVFormats, sizeof(desc.RTVFormats));
+    hash.Add((uint64_t)desc.DSVFormat);
+    hash.Add(&desc.SampleDesc, sizeof(desc.SampleDesc));
+    for (UINT i = 0; i < desc.InputLayout.NumElements; i++)
+    {
+        const D3D12_INPUT_ELEMENT_DESC& element = desc.InputLayout.pInputElementDescs[i];
+        hash.Add(std::string(element.SemanticName));
+        hash.Add((uint64_t)element.SemanticIndex);
+        hash.Add((uint64_t)element.Format);
+        hash.Add((uint64_t)element.AlignedByteOffset);
+    }
+    uint64_t key = hash.Value();
+
+    std::vector<uint8_t> blob;
+    if (mShaderCache.Load(key, blob))
+    {
+        desc.CachedPSO = { blob.data(), blob.size() };
+        if (SUCCEEDED(device->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pso))))
+            return S_OK;
+
+        desc.CachedPSO = {};
+    }
+
+    HRESULT hr = device->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pso));
+    if (SUCCEEDED(hr))
+    {
+        Microsoft::WRL::ComPtr<ID3DBlob> cached;
+        if (SUCCEEDED(pso->GetCachedBlob(&cached)))
+            mShaderCache.Store(key, cached->GetBufferPointer(), cached->GetBufferSize());
+    }
+    return hr;
+}
+
+void DirectXApp::BuildPSO(uint32_t features)
 {
     // Making description PSO
     D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc;
@@ -316,8 +490,8 @@ void DirectXApp::BuildPSO()
     };
     // PS shader
     psoDesc.PS = {
-        reinterpret_cast<BYTE*>(mpsByteCode->GetBufferPointer()),
-        mpsByteCode->GetBufferSize()
+        reinterpret_cast<BYTE*>(mpsByteCode[features]->GetBufferPointer()),
+        mpsByteCode[features]->GetBufferSize()
     };
 
     // 2. Input Layout
@@ -375,17 +549,17 @@ void DirectXApp::BuildPSO()
     psoDesc.SampleDesc.Quality = 0;
 
     // 12. Создание PSO
-    HRESULT hr = device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&mPSO));
+    HRESULT hr = CreateCachedPipelineState(psoDesc, mPSO[features]);
     if (FAILED(hr)) {
         MessageBox(NULL, L"Failed to create PSO", L"Error", MB_OK);
         return;
     }
 
-    MessageBox(NULL, L"PSO created successfully (Solid Mode)", L"Info", MB_OK);
+    OutputDebugStringA("PSO created successfully (Solid Mode)\n");
 }
 
 // =========== Wireframe PSO ===========
-void DirectXApp::BuildWireframePSO()
+void DirectXApp::BuildWireframePSO(uint32_t features)
 {
     // Создаем описание PSO для проволочного каркаса
     D3D12_GRAPHICS_PIPELINE_STATE_DESC wireframePsoDesc;
@@ -397,8 +571,8 @@ void DirectXApp::BuildWireframePSO()
         mvsByteCode->GetBufferSize()
     };
     wireframePsoDesc.PS = {
-        reinterpret_cast<BYTE*>(mpsByteCode->GetBufferPointer()),
-        mpsByteCode->GetBufferSize()
+        reinterpret_cast<BYTE*>(mpsByteCode[features]->GetBufferPointer()),
+        mpsByteCode[features]->GetBufferSize()
     };
 
     // 2. Input Layout
@@ -436,14 +610,120 @@ void DirectXApp::BuildWireframePSO()
     wireframePsoDesc.SampleDesc.Quality = 0;
 
     // 12. Создание PSO
-    HRESULT hr = device->CreateGraphicsPipelineState(&wireframePsoDesc, IID_PPV_ARGS(&mWireframePSO));
+    HRESULT hr = CreateCachedPipelineState(wireframePsoDesc, mWireframePSO[features]);
     if (FAILED(hr)) {
         MessageBox(NULL, L"Failed to create Wireframe PSO", L"Error", MB_OK);
         return;
     }
 
-    MessageBox(NULL, L"Wireframe PSO created successfully", L"Info", MB_OK);
+    OutputDebugStringA("Wireframe PSO created successfully\n");
+}
+// =========== Instanced PSO ===========
+// Сплошной и каркасный PSO для инстансированного VS; остальное как у mPSO и mWireframePSO
+void DirectXApp::BuildInstancedPSOs(uint32_t features)
+{
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc;
+    ZeroMemory(&psoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
+
+    psoDesc.VS = {
+        reinterpret_cast<BYTE*>(mvsInstancedByteCode->GetBufferPointer()),
+        mvsInstancedByteCode->GetBufferSize()
+    };
+    psoDesc.PS = {
+        reinterpret_cast<BYTE*>(mpsByteCode[features]->GetBufferPointer()),
+        mpsByteCode[features]->GetBufferSize()
+    };
+
+    psoDesc.InputLayout = { mInputLayout.data(), (UINT)mInputLayout.size() };
+    psoDesc.pRootSignature = mRootSignature.Get();
+    psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+    psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+    psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+    psoDesc.SampleMask = UINT_MAX;
+    psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+    psoDesc.NumRenderTargets = 1;
+    psoDesc.RTVFormats[0] = mBackBufferFormat;
+    psoDesc.DSVFormat = mDepthStencilFormat;
+    psoDesc.SampleDesc.Count = 1;
+    psoDesc.SampleDesc.Quality = 0;
+
+    HRESULT hr = CreateCachedPipelineState(psoDesc, mInstancedPSO[features]);
+    if (FAILED(hr)) {
+        MessageBox(NULL, L"Failed to create instanced PSO", L"Error", MB_OK);
+        return;
+    }
+
+    psoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
+    psoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+
+    hr = CreateCachedPipelineState(psoDesc, mInstancedWireframePSO[features]);
+    if (FAILED(hr)) {
+        MessageBox(NULL, L"Failed to create instanced wireframe PSO", L"Error", MB_OK);
+        return;
+    }
+}
+
+// =========== Transparent PSO ===========
+// Обычный и инстансированный PSO прохода полупрозрачных: смешивание по альфе,
+// тест глубины без записи - непрозрачные уже в буфере глубины, а полупрозрачные
+// друг друга не закрывают (их порядок задаёт сортировка)
+void DirectXApp::BuildTransparentPSOs(uint32_t features)
+{
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc;
+    ZeroMemory(&psoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
+
+    psoDesc.VS = {
+        reinterpret_cast<BYTE*>(mvsByteCode->GetBufferPointer()),
+        mvsByteCode->GetBufferSize()
+    };
+    psoDesc.PS = {
+        reinterpret_cast<BYTE*>(mpsByteCode[features]->GetBufferPointer()),
+        mpsByteCode[features]->GetBufferSize()
+    };
+
+    psoDesc.InputLayout = { mInputLayout.data(), (UINT)mInputLayout.size() };
+    psoDesc.pRootSignature = mRootSignature.Get();
+    psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+
+    psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+    auto& rtBlend = psoDesc.BlendState.RenderTarget[0];
+    rtBlend.BlendEnable = TRUE;
+    rtBlend.SrcBlend = D3D12_BLEND_SRC_ALPHA;
+    rtBlend.DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+    rtBlend.BlendOp = D3D12_BLEND_OP_ADD;
+    rtBlend.SrcBlendAlpha = D3D12_BLEND_ONE;
+    rtBlend.DestBlendAlpha = D3D12_BLEND_ZERO;
+    rtBlend.BlendOpAlpha = D3D12_BLEND_OP_ADD;
+
+    psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+    psoDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+
+    psoDesc.SampleMask = UINT_MAX;
+    psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+    psoDesc.NumRenderTargets = 1;
+    psoDesc.RTVFormats[0] = mBackBufferFormat;
+    psoDesc.DSVFormat = mDepthStencilFormat;
+    psoDesc.SampleDesc.Count = 1;
+    psoDesc.SampleDesc.Quality = 0;
+
+    HRESULT hr = CreateCachedPipelineState(psoDesc, mTransparentPSO[features]);
+    if (FAILED(hr)) {
+        MessageBox(NULL, L"Failed to create transparent PSO", L"Error", MB_OK);
+        return;
+    }
+
+    psoDesc.VS = {
+        reinterpret_cast<BYTE*>(mvsInstancedByteCode->GetBufferPointer()),
+        mvsInstancedByteCode->GetBufferSize()
+    };
+
+    hr = CreateCachedPipelineState(psoDesc, mInstancedTransparentPSO[features]);
+    if (FAILED(hr)) {
+        MessageBox(NULL, L"Failed to create instanced transparent PSO", L"Error", MB_OK);
+        return;
+    }
 }
+
 // =========== Остальные методы ===========
 void DirectXApp::BuildObj(const std::string& path)
 {
@@ -452,105 +732,175 @@ void DirectXApp::BuildObj(const std::string& path)
     // Очистить старые данные
     mSubmeshes.clear();
 
-    std::vector<Vertex> vertices;
+    std::vector<ObjVertex> objVertices;
     std::vector<uint32_t> indices;
 
     // Загружаем OBJ с сабмешами
-    if (!LoadOBJ(path, vertices, indices, mSubmeshes))
+    if (!LoadOBJ(path, objVertices, indices, mSubmeshes))
     {
         MessageBoxA(nullptr, "Failed to load OBJ", "Error", MB_OK);
         return;
     }
 
-    mIndexCount = static_cast<UINT>(indices.size());
-
-    UINT vbByteSize = static_cast<UINT>(vertices.size() * sizeof(Vertex));
-    UINT ibByteSize = static_cast<UINT>(indices.size() * sizeof(uint32_t));
-
-    // ====================================================
-    //                VERTEX BUFFER
-    // ====================================================
+    std::vector<Vertex> vertices(objVertices.size());
+    for (size_t i = 0; i < objVertices.size(); i++)
+    {
+        const ObjVertex& v = objVertices[i];
+        vertices[i].position = XMFLOAT3(v.position.x, v.position.y, v.position.z);
+        vertices[i].normal = XMFLOAT3(v.normal.x, v.normal.y, v.normal.z);
+        vertices[i].texcoord = XMFLOAT2(v.texcoord.x, v.texcoord.y);
+    }
+    objVertices = {};
 
-    D3D12_HEAP_PROPERTIES heapProps = {};
-    heapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
+    mIndexCount = static_cast<UINT>(indices.size());
 
-    D3D12_RESOURCE_DESC vbDesc = {};
-    vbDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-    vbDesc.Width = vbByteSize;
-    vbDesc.Height = 1;
-    vbDesc.DepthOrArraySize = 1;
-    vbDesc.MipLevels = 1;
-    vbDesc.SampleDesc.Count = 1;
-    vbDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    // Сабмеши режутся по секторам до всего, что зависит от порядка треугольников
+    SectorGridDesc gridDesc;
+    gridDesc.SectorsPerAxis = SectorsPerAxis;
+    mSectorStreamer.Partition(&vertices[0].position.x, sizeof(Vertex), indices, mSubmeshes, gridDesc);
 
-    ThrowIfFailed(device->CreateCommittedResource(
-        &heapProps,
-        D3D12_HEAP_FLAG_NONE,
-        &vbDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(&mVertexBufferGPU)));
-
-    void* mappedData = nullptr;
-    mVertexBufferGPU->Map(0, nullptr, &mappedData);
-    memcpy(mappedData, vertices.data(), vbByteSize);
-    mVertexBufferGPU->Unmap(0, nullptr);
-
-    mVertexBufferView.BufferLocation = mVertexBufferGPU->GetGPUVirtualAddress();
-    mVertexBufferView.StrideInBytes = sizeof(Vertex);
-    mVertexBufferView.SizeInBytes = vbByteSize;
-
-    // ====================================================
-    //                INDEX BUFFER
-    // ====================================================
-
-    D3D12_RESOURCE_DESC ibDesc = {};
-    ibDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-    ibDesc.Width = ibByteSize;
-    ibDesc.Height = 1;
-    ibDesc.DepthOrArraySize = 1;
-    ibDesc.MipLevels = 1;
-    ibDesc.SampleDesc.Count = 1;
-    ibDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    // Границы и плотность UV сабмешей - по ним стримятся мипы
+    for (auto& sm : mSubmeshes)
+    {
+        float worldArea = 0.0f;
+        float uvArea = 0.0f;
 
-    ThrowIfFailed(device->CreateCommittedResource(
-        &heapProps,
-        D3D12_HEAP_FLAG_NONE,
-        &ibDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(&mIndexBufferGPU)));
+        for (uint32_t i = sm.IndexStart; i + 2 < sm.IndexStart + sm.IndexCount; i += 3)
+        {
+            const Vertex& v0 = vertices[indices[i + 0]];
+            const Vertex& v1 = vertices[indices[i + 1]];
+            const Vertex& v2 = vertices[indices[i + 2]];
+
+            sm.Bounds.Extend(v0.position.x, v0.position.y, v0.position.z);
+            sm.Bounds.Extend(v1.position.x, v1.position.y, v1.position.z);
+            sm.Bounds.Extend(v2.position.x, v2.position.y, v2.position.z);
+
+            XMVECTOR p0 = XMLoadFloat3(&v0.position);
+            XMVECTOR p1 = XMLoadFloat3(&v1.position);
+            XMVECTOR p2 = XMLoadFloat3(&v2.position);
+            worldArea += 0.5f * XMVectorGetX(XMVector3Length(XMVector3Cross(p1 - p0, p2 - p0)));
+
+            float du1 = v1.texcoord.x - v0.texcoord.x;
+            float dv1 = v1.texcoord.y - v0.texcoord.y;
+            float du2 = v2.texcoord.x - v0.texcoord.x;
+            float dv2 = v2.texcoord.y - v0.texcoord.y;
+            uvArea += 0.5f * fabsf(du1 * dv2 - du2 * dv1);
+        }
 
-    mIndexBufferGPU->Map(0, nullptr, &mappedData);
-    memcpy(mappedData, indices.data(), ibByteSize);
-    mIndexBufferGPU->Unmap(0, nullptr);
+        sm.UvDensity = worldArea > 0.0f ? sqrtf(uvArea / worldArea) : 0.0f;
+    }
 
-    mIndexBufferView.BufferLocation = mIndexBufferGPU->GetGPUVirtualAddress();
-    mIndexBufferView.Format = DXGI_FORMAT_R32_UINT;
-    mIndexBufferView.SizeInBytes = ibByteSize;
+    mSubmeshCuller.Clear();
+    for (const auto& sm : mSubmeshes)
+        mSubmeshCuller.Add(sm.Bounds);
+
+    // Окклюдеры - крупнейшие треугольники сцены (стены, пол, колонны)
+    mOcclusionCuller.SetOccluderMesh(
+        &vertices[0].position.x,
+        sizeof(Vertex),
+        indices.data(),
+        indices.size(),
+        MaxOccluderTriangles);
+
+    // BVH для пикинга и столкновений камеры
+    mSceneBvh.Build(
+        &vertices[0].position.x,
+        sizeof(Vertex),
+        indices.data(),
+        indices.size(),
+        &mJobs);
+    mPickedSubmesh = -1;
+
+    std::string bvhMsg = "BVH: " + std::to_string(mSceneBvh.TriangleCount()) + " triangles, " +
+        std::to_string(mSceneBvh.NodeCount()) + " nodes, " +
+        std::to_string(mSceneBvh.BuildMs()) + " ms\n";
+    OutputDebugStringA(bvhMsg.c_str());
+
+    // Вторые UV для лайтмапов - до загрузки вершин на GPU
+    LightmapMesh lightmapMesh;
+    lightmapMesh.Vertices = reinterpret_cast<const uint8_t*>(vertices.data());
+    lightmapMesh.VertexStride = sizeof(Vertex);
+    lightmapMesh.PositionOffset = offsetof(Vertex, position);
+    lightmapMesh.NormalOffset = offsetof(Vertex, normal);
+    lightmapMesh.VertexCount = (uint32_t)vertices.size();
+    lightmapMesh.Indices = indices.data();
+    lightmapMesh.IndexCount = indices.size();
+
+    LightmapUnwrapDesc unwrapDesc;
+    unwrapDesc.PageSize = LightmapPageSize;
+    unwrapDesc.MaxPages = LightmapMaxPages;
+
+    std::vector<LightmapUv> lightmapUvs;
+    mLightmapBaker.Unwrap(lightmapMesh, unwrapDesc, lightmapUvs);
+    for (size_t i = 0; i < vertices.size(); i++)
+        vertices[i].lightmapUv = XMFLOAT3(lightmapUvs[i].U, lightmapUvs[i].V, lightmapUvs[i].Page);
+
+    // На GPU геометрия попадает по секторам (BuildSectors). Копия остаётся для
+    // запеканий, столкновений и программного растеризатора
+    mCpuVertices = std::move(vertices);
+    mCpuIndices = std::move(indices);
 }
 
 void DirectXApp::Shutdown() {
     FlushCommandQueue();
 
     // Освобождаем PSO
-    mPSO.Reset();
-    mWireframePSO.Reset();
+    for (uint32_t features = 0; features < MaterialPermutationCount; features++) {
+        mPSO[features].Reset();
+        mWireframePSO[features].Reset();
+        mInstancedPSO[features].Reset();
+        mInstancedWireframePSO[features].Reset();
+        mTransparentPSO[features].Reset();
+        mInstancedTransparentPSO[features].Reset();
+    }
+    mInstanceBuffer.Reset();
     mRootSignature.Reset();
 
     for (int i = 0; i < SwapChainBufferCount; i++) {
         mSwapChainBuffer[i].Reset();
     }
-    mDepthStencilBuffer.Reset();
+    mGraphTargets.clear();
+    mTransientHeap.Reset();
+    mTransientHeapSize = 0;
     mRtvHeap.Reset();
     mDsvHeap.Reset();
     mCbvHeap.Reset();
+    mSrvStagingHeap.Reset();
+    mSrvTextures.clear();
     mSwapChain.Reset();
 
-    mVertexBufferGPU.Reset();
-    mVertexBufferUploader.Reset();
-    mIndexBufferGPU.Reset();
-    mIndexBufferUploader.Reset();
+    mSectorGeometry.clear();
+    mSectorArrivals.clear();
+
+    mStreamedTextures.clear();
+
+    // Размещённые в mGpuHeaps - до самих куч
+    mVtCache.Reset();
+    mVtPageTable.Reset();
+    mVtFeedback.Reset();
+    for (UINT i = 0; i < FrameCount; i++)
+        mVtReadback[i].Reset();
+
+    mRetiredResources.Clear();
+    mRetiredAllocations.Clear();
+    mGpuHeaps.clear();
+
+    if (mUploadRingBuffer) {
+        mUploadRingBuffer->Unmap(0, nullptr);
+        mUploadRingBuffer.Reset();
+        mUploadRingMapped = nullptr;
+    }
+
+    for (UINT i = 0; i < FrameCount; i++) {
+        mFrames[i].CmdListAlloc.Reset();
+        for (UINT s = 0; s < RecordListCount; s++) {
+            mFrames[i].SliceAllocs[s].Reset();
+        }
+    }
+
+    for (UINT s = 0; s < RecordListCount; s++) {
+        mSliceLists[s].Reset();
+    }
 
     if (mCommandList) {
         mCommandList.Reset();
@@ -645,6 +995,29 @@ bool DirectXApp::CreateCommandObjects() {
         return false;
     }
 
+    // Свой аллокатор на каждый кадр в полёте
+    for (UINT i = 0; i < FrameCount; i++) {
+        hr = device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            IID_PPV_ARGS(&mFrames[i].CmdListAlloc)
+        );
+        if (FAILED(hr)) {
+            MessageBox(NULL, L"Failed to create frame command allocator", L"Error", MB_OK);
+            return false;
+        }
+
+        for (UINT s = 0; s < RecordListCount; s++) {
+            hr = device->CreateCommandAllocator(
+                D3D12_COMMAND_LIST_TYPE_DIRECT,
+                IID_PPV_ARGS(&mFrames[i].SliceAllocs[s])
+            );
+            if (FAILED(hr)) {
+                MessageBox(NULL, L"Failed to create slice command allocator", L"Error", MB_OK);
+                return false;
+            }
+        }
+    }
+
     hr = device->CreateCommandList(
         0,
         D3D12_COMMAND_LIST_TYPE_DIRECT,
@@ -658,6 +1031,24 @@ bool DirectXApp::CreateCommandObjects() {
     }
 
     mCommandList->Close();
+
+    // Списки кусков очереди отрисовок, каждый сбрасывается на аллокатор своего куска в кадре
+    for (UINT s = 0; s < RecordListCount; s++) {
+        hr = device->CreateCommandList(
+            0,
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            mFrames[0].SliceAllocs[s].Get(),
+            nullptr,
+            IID_PPV_ARGS(&mSliceLists[s])
+        );
+        if (FAILED(hr)) {
+            MessageBox(NULL, L"Failed to create slice command list", L"Error", MB_OK);
+            return false;
+        }
+
+        mSliceLists[s]->Close();
+    }
+
     return true;
 }
 
@@ -667,17 +1058,105 @@ bool DirectXApp::CreateFence() {
         MessageBox(NULL, L"Failed to create fence", L"Error", MB_OK);
         return false;
     }
-    mFenceValue = 0;
     return true;
 }
 
+bool DirectXApp::CreateUploadRing() {
+    D3D12_HEAP_PROPERTIES uploadHeap = {};
+    uploadHeap.Type = D3D12_HEAP_TYPE_UPLOAD;
+
+    D3D12_RESOURCE_DESC bufferDesc = {};
+    bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    bufferDesc.Width = mUploadRing.Capacity();
+    bufferDesc.Height = 1;
+    bufferDesc.DepthOrArraySize = 1;
+    bufferDesc.MipLevels = 1;
+    bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    bufferDesc.SampleDesc.Count = 1;
+
+    HRESULT hr = device->CreateCommittedResource(
+        &uploadHeap,
+        D3D12_HEAP_FLAG_NONE,
+        &bufferDesc,
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&mUploadRingBuffer));
+    if (FAILED(hr)) {
+        MessageBox(NULL, L"Failed to create upload ring", L"Error", MB_OK);
+        return false;
+    }
+
+    // Отображён всё время работы
+    mUploadRingBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mUploadRingMapped));
+    return true;
+}
+
+// Кусок кольцевого upload-буфера. Если места нет - ждём уже отправленные кадры,
+// а то, что больше кольца, получает свой буфер, живущий до конца текущего кадра
+DirectXApp::UploadAllocation DirectXApp::AllocateUpload(UINT64 size, UINT64 alignment) {
+    UINT64 offset = mUploadRing.Allocate(size, alignment);
+    if (offset == UploadRing::InvalidOffset) {
+        WaitForFence(mFrameScheduler.LastSignaled());
+        mUploadRing.Reclaim(mFrameScheduler.LastSignaled());
+        offset = mUploadRing.Allocate(size, alignment);
+    }
+
+    UploadAllocation upload;
+    if (offset != UploadRing::InvalidOffset) {
+        upload.Resource = mUploadRingBuffer.Get();
+        upload.Offset = offset;
+        upload.Mapped = mUploadRingMapped + offset;
+        return upload;
+    }
+
+    D3D12_HEAP_PROPERTIES uploadHeap = {};
+    uploadHeap.Type = D3D12_HEAP_TYPE_UPLOAD;
+
+    D3D12_RESOURCE_DESC bufferDesc = {};
+    bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    bufferDesc.Width = size;
+    bufferDesc.Height = 1;
+    bufferDesc.DepthOrArraySize = 1;
+    bufferDesc.MipLevels = 1;
+    bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    bufferDesc.SampleDesc.Count = 1;
+
+    Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
+    ThrowIfFailed(device->CreateCommittedResource(
+        &uploadHeap,
+        D3D12_HEAP_FLAG_NONE,
+        &bufferDesc,
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&buffer)));
+
+    buffer->Map(0, nullptr, reinterpret_cast<void**>(&upload.Mapped));
+    upload.Resource = buffer.Get();
+    mRetiredResources.Retire(buffer, mFrameScheduler.PendingFenceValue());
+    mUploadFallbacks++;
+    return upload;
+}
+
 void DirectXApp::FlushCommandQueue() {
-    mFenceValue++;
-    mCommandQueue->Signal(mFence.Get(), mFenceValue);
+    UINT64 fenceValue = mFrameScheduler.Signal();
+    mUploadRing.FinishFrame(fenceValue);
+    mSrvAllocator.FinishFrame(fenceValue);
+    mCommandQueue->Signal(mFence.Get(), fenceValue);
+
+    WaitForFence(fenceValue);
+    mUploadRing.Reclaim(fenceValue);
+    mSrvAllocator.Reclaim(fenceValue);
+    mRetiredResources.Collect(fenceValue);
+    mRetiredAllocations.Collect(fenceValue, [this](const GpuAllocation& allocation)
+    {
+        FreeGpuAllocation(allocation);
+    });
+}
 
-    if (mFence->GetCompletedValue() < mFenceValue) {
+void DirectXApp::WaitForFence(UINT64 value) {
+    if (mFence->GetCompletedValue() < value) {
         HANDLE eventHandle = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
-        mFence->SetEventOnCompletion(mFenceValue, eventHandle);
+        mFence->SetEventOnCompletion(value, eventHandle);
         WaitForSingleObject(eventHandle, INFINITE);
         CloseHandle(eventHandle);
     }
@@ -753,9 +1232,27 @@ bool DirectXApp::CreateDescriptorHeaps() {
         return false;
     }
 
-    // 3. CBV/SRV/UAV куча
+    // 3. CBV/SRV/UAV: постоянные SRV и кольцо таблиц кадров
+    return CreateSrvHeaps(mSrvAllocator.PersistentCapacity(), mSrvAllocator.TransientCapacity());
+}
+
+bool DirectXApp::CreateSrvHeaps(UINT persistentCapacity, UINT transientCapacity) {
+    // Постоянные SRV: только CPU, отсюда копируются таблицы кадров
+    D3D12_DESCRIPTOR_HEAP_DESC stagingHeapDesc;
+    stagingHeapDesc.NumDescriptors = persistentCapacity;
+    stagingHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    stagingHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+    stagingHeapDesc.NodeMask = 0;
+
+    HRESULT hr = device->CreateDescriptorHeap(&stagingHeapDesc, IID_PPV_ARGS(&mSrvStagingHeap));
+    if (FAILED(hr)) {
+        MessageBox(NULL, L"Failed to create SRV staging descriptor heap", L"Error", MB_OK);
+        return false;
+    }
+
+    // Видимая шейдерам куча целиком под кольцо таблиц кадров
     D3D12_DESCRIPTOR_HEAP_DESC cbvHeapDesc;
-    cbvHeapDesc.NumDescriptors = 1 + 200; // 1 CBV + 1 SRV
+    cbvHeapDesc.NumDescriptors = transientCapacity;
     cbvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
     cbvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
     cbvHeapDesc.NodeMask = 0;
@@ -766,9 +1263,50 @@ bool DirectXApp::CreateDescriptorHeaps() {
         return false;
     }
 
+    mSrvTextures.resize(persistentCapacity);
+    return true;
+}
+
+// Пересоздаёт обе кучи: занятые постоянные SRV копируются со своими смещениями,
+// кольцо начинается заново, поэтому сначала ждём все кадры в полёте
+bool DirectXApp::GrowSrvHeaps(UINT persistentCapacity) {
+    FlushCommandQueue();
+
+    ComPtr<ID3D12DescriptorHeap> oldStaging = mSrvStagingHeap;
+    UINT used = mSrvAllocator.PersistentHighWater();
+    UINT transientCapacity = (FrameCount + 1) * persistentCapacity;
+
+    if (!CreateSrvHeaps(persistentCapacity, transientCapacity)) {
+        return false;
+    }
+
+    if (used > 0) {
+        device->CopyDescriptorsSimple(
+            used,
+            mSrvStagingHeap->GetCPUDescriptorHandleForHeapStart(),
+            oldStaging->GetCPUDescriptorHandleForHeapStart(),
+            D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    }
+
+    mSrvAllocator.Resize(persistentCapacity, transientCapacity);
+
+    std::string msg = "SRV heap grown to " + std::to_string(persistentCapacity) + " descriptors\n";
+    OutputDebugStringA(msg.c_str());
     return true;
 }
 
+// Непрерывный диапазон постоянных SRV (таблица материала), при нехватке кучи растут
+UINT DirectXApp::AllocateSrvs(UINT count) {
+    UINT offset = mSrvAllocator.AllocatePersistent(count);
+    if (offset == DescriptorAllocator::InvalidOffset) {
+        UINT capacity = (std::max)(mSrvAllocator.PersistentCapacity() * 2, mSrvAllocator.PersistentCapacity() + count);
+        if (GrowSrvHeaps(capacity)) {
+            offset = mSrvAllocator.AllocatePersistent(count);
+        }
+    }
+    return offset;
+}
+
 bool DirectXApp::CreateRenderTargetViews() {
     D3D12_CPU_DESCRIPTOR_HANDLE rtvHeapHandle = mRtvHeap->GetCPUDescriptorHandleForHeapStart();
 
@@ -788,51 +1326,6 @@ bool DirectXApp::CreateRenderTargetViews() {
     return true;
 }
 
-bool DirectXApp::CreateDepthStencilBuffer() {
-    D3D12_RESOURCE_DESC depthStencilDesc = {};
-    depthStencilDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-    depthStencilDesc.Width = mClientWidth;
-    depthStencilDesc.Height = mClientHeight;
-    depthStencilDesc.DepthOrArraySize = 1;
-    depthStencilDesc.MipLevels = 1;
-    depthStencilDesc.Format = mDepthStencilFormat;
-    depthStencilDesc.SampleDesc.Count = 1;
-    depthStencilDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
-
-    D3D12_CLEAR_VALUE optClear = {};
-    optClear.Format = mDepthStencilFormat;
-    optClear.DepthStencil.Depth = 1.0f;
-
-    D3D12_HEAP_PROPERTIES heapProps = {};
-    heapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
-
-    HRESULT hr = device->CreateCommittedResource(
-        &heapProps,
-        D3D12_HEAP_FLAG_NONE,
-        &depthStencilDesc,
-        D3D12_RESOURCE_STATE_COMMON,
-        &optClear,
-        IID_PPV_ARGS(&mDepthStencilBuffer)
-    );
-
-    if (FAILED(hr)) {
-        MessageBox(NULL, L"Failed to create depth stencil buffer", L"Error", MB_OK);
-        return false;
-    }
-
-    D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
-    dsvDesc.Format = mDepthStencilFormat;
-    dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
-
-    device->CreateDepthStencilView(
-        mDepthStencilBuffer.Get(),
-        &dsvDesc,
-        mDsvHeap->GetCPUDescriptorHandleForHeapStart()
-    );
-
-    return true;
-}
-
 void DirectXApp::CreateViewportAndScissor() {
     mScreenViewport.TopLeftX = 0.0f;
     mScreenViewport.TopLeftY = 0.0f;
@@ -844,9 +1337,9 @@ void DirectXApp::CreateViewportAndScissor() {
     mScissorRect = { 0, 0, mClientWidth, mClientHeight };
 }
 
-void DirectXApp::SetViewportAndScissor() {
-    mCommandList->RSSetViewports(1, &mScreenViewport);
-    mCommandList->RSSetScissorRects(1, &mScissorRect);
+void DirectXApp::SetViewportAndScissor(ID3D12GraphicsCommandList* cmdList) {
+    cmdList->RSSetViewports(1, &mScreenViewport);
+    cmdList->RSSetScissorRects(1, &mScissorRect);
 }
 
 bool DirectXApp::Initialize() {
@@ -866,13 +1359,13 @@ bool DirectXApp::Initialize() {
     if (!CreateD3DDevice()) return false;
     if (!CreateCommandObjects()) return false;
     if (!CreateFence()) return false;
+    if (!CreateUploadRing()) return false;
     if (!CreateSwapChain()) return false;
 
     QueryDescriptorSizes();
 
     if (!CreateDescriptorHeaps()) return false;
     if (!CreateRenderTargetViews()) return false;
-    if (!CreateDepthStencilBuffer()) return false;
 
     CreateViewportAndScissor();
 
@@ -881,24 +1374,53 @@ bool DirectXApp::Initialize() {
     BuildObj("../assets/sponza.obj");
 
        std::vector<ParsedMaterial> parsed;
-    LoadMTL("../assets/sponza.mtl", parsed);
-
-    UINT srvIndex = 0;
+    if (!LoadMTL("../assets/sponza.mtl", parsed))
+        MessageBoxA(nullptr, "Failed to load MTL file: ../assets/sponza.mtl", "MTL Error", MB_OK);
 
     for (auto& p : parsed)
     {
         Material mat;
         mat.Name = p.Name;
+        mat.DiffuseMap1 = p.DiffuseMap;
+        mat.DiffuseMap2 = p.DiffuseMap2;
+
+        // Таблица материала: t0 и t1 подряд
+        UINT srvs = AllocateSrvs(2);
+        if (srvs == DescriptorAllocator::InvalidOffset)
+            return false;
 
-        // Индекс для первой текстуры
-        mat.SrvHeapIndex1 = srvIndex++;
+        mat.SrvHeapIndex1 = srvs;
+        mat.SrvHeapIndex2 = srvs + 1;
 
         // Загрузка первой текстуры
         if (!p.DiffuseMap.empty())
         {
-            CreateTextureFromTGA(
+            mat.StreamId1 = CreateMaterialTexture(
                 "../assets/" + p.DiffuseMap,
                 mat.DiffuseTexture1);
+            mat.Features |= MaterialFeatureMap1;
+
+            // Маска map_d лежит в альфе самой карты - отдельная текстура не нужна.
+            // Двоичная маска (листья, цепи) остаётся в непрозрачном проходе:
+            // ALPHA_TEST по порогу 0.5 и запись глубины. Смешиваются и сортируются
+            // только карты с настоящей полупрозрачностью - у них отсекается лишь
+            // почти пустое. Карту без разбора (только .dds) считаем маской.
+            if (!p.AlphaMap.empty())
+            {
+                MappedFile file;
+                TgaView view;
+                TgaAlphaKind alpha = TgaAlphaMask;
+                if (file.Open("../assets/" + p.DiffuseMap) && ParseTGA(file.Data(), file.Size(), view))
+                    alpha = ClassifyTgaAlpha(view);
+
+                if (alpha != TgaAlphaOpaque)
+                    mat.Features |= MaterialFeatureAlphaTest;
+                if (alpha == TgaAlphaTranslucent)
+                {
+                    mat.Transparent = true;
+                    mat.AlphaCutoff = 0.1f;
+                }
+            }
 
             // Выводим информацию для отладки
             std::string msg = "Loaded texture1: " + p.DiffuseMap + " for material: " + p.Name;
@@ -906,25 +1428,27 @@ bool DirectXApp::Initialize() {
         }
         else
         {
-            CreateColorTexture(p.Kd, mat.DiffuseTexture1);
+            // Карты нет - цвет идёт в константы, слот t0 остаётся пустым
+            CreateTextureSrv(nullptr, mat.SrvHeapIndex1);
+            mat.Color1[0] = p.Kd.x;
+            mat.Color1[1] = p.Kd.y;
+            mat.Color1[2] = p.Kd.z;
         }
 
-        // Индекс для второй текстуры
-        mat.SrvHeapIndex2 = srvIndex++;
-
         // Загрузка второй текстуры
         if (!p.DiffuseMap2.empty())
         {
-            CreateTextureFromTGA(
+            mat.StreamId2 = CreateMaterialTexture(
                 "../assets/" + p.DiffuseMap2,
                 mat.DiffuseTexture2);
+            mat.Features |= MaterialFeatureMap2;
 
             std::string msg = "Loaded texture2: " + p.DiffuseMap2 + " for material: " + p.Name;
             MessageBoxA(nullptr, msg.c_str(), "Texture Info", MB_OK);
         }
         else
         {
-            // Если второй текстуры нет, создаем контрастную цветную текстуру
+            // Если второй текстуры нет, берём контрастный цвет
             XMFLOAT3 secondColor;
 
             // Создаем контрастный цвет на основе оригинального
@@ -935,41 +1459,65 @@ bool DirectXApp::Initialize() {
             // Или можно сделать красноватый оттенок
             // secondColor = XMFLOAT3(1.0f, 0.2f, 0.2f);
 
-            CreateColorTexture(secondColor, mat.DiffuseTexture2);
+            CreateTextureSrv(nullptr, mat.SrvHeapIndex2);
+            mat.Color2[0] = secondColor.x;
+            mat.Color2[1] = secondColor.y;
+            mat.Color2[2] = secondColor.z;
         }
 
-        // Создаем SRV для первой текстуры
-        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-        srvDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
-        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-        srvDesc.Texture2D.MipLevels = 1;
-
-        D3D12_CPU_DESCRIPTOR_HANDLE hDescriptor =
-            mCbvHeap->GetCPUDescriptorHandleForHeapStart();
+        // SRV для первой (t0) и второй (t1) текстуры пишет SyncFrameSrvs
 
-        // SRV для первой текстуры (t0)
-        hDescriptor.ptr += (1 + mat.SrvHeapIndex1) * mCbvSrvUavDescriptorSize;
-        device->CreateShaderResourceView(
-            mat.DiffuseTexture1.Get(),
-            &srvDesc,
-            hDescriptor);
+        mPermutations |= 1u << mat.Features;
+        if (mat.Transparent)
+            mTransparentPermutations |= 1u << mat.Features;
+        mMaterials.push_back(mat);
+    }
 
-        // SRV для второй текстуры (t1)
-        hDescriptor.ptr += (mat.SrvHeapIndex2 - mat.SrvHeapIndex1) * mCbvSrvUavDescriptorSize;
-        device->CreateShaderResourceView(
-            mat.DiffuseTexture2.Get(),
-            &srvDesc,
-            hDescriptor);
+    // Материал сабмеша ищется по имени один раз, а не в каждой отрисовке
+    for (auto& sm : mSubmeshes)
+    {
+        Material* mat = FindMaterial(sm.MaterialName);
+        sm.MaterialIndex = mat ? (int)(mat - mMaterials.data()) : -1;
 
-        mMaterials.push_back(mat);
+        if (!mat)
+            MessageBoxA(nullptr, sm.MaterialName.c_str(), "Missing Material", MB_OK);
     }
 
+    BuildSectors();
+
+    BuildStressScene();
+    BuildPointLights();
+    BuildPvs();
+    BuildLightmaps();
+    BuildVirtualTexture();
+
     BuildRootSignature();
     BuildShaders();
-    BuildPSO();
-    BuildWireframePSO();  
-    BuildConstantBuffer();
+
+    // PSO независимы друг от друга - каждый набор каждой перестановки создаётся своей задачей
+    auto psoStart = std::chrono::steady_clock::now();
+    JobCounter psosBuilt;
+    for (uint32_t features = 0; features < MaterialPermutationCount; features++)
+    {
+        if ((mPermutations & (1u << features)) == 0)
+            continue;
+
+        mJobs.Run([this, features]() { BuildPSO(features); }, &psosBuilt);
+        mJobs.Run([this, features]() { BuildWireframePSO(features); }, &psosBuilt);
+        mJobs.Run([this, features]() { BuildInstancedPSOs(features); }, &psosBuilt);
+
+        if (mTransparentPermutations & (1u << features))
+            mJobs.Run([this, features]() { BuildTransparentPSOs(features); }, &psosBuilt);
+    }
+    mJobs.Wait(psosBuilt);
+    mPsoMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - psoStart).count();
+
+    const ShaderCacheStats cs = mShaderCache.Stats();
+    std::string startupMsg = "Startup (" + std::string(cs.Misses == 0 ? "warm" : "cold") + " cache): " +
+        std::to_string(std::popcount(mPermutations)) + " material permutations, shaders " +
+        std::to_string(mShaderMs) + " ms, PSO " + std::to_string(mPsoMs) + " ms, hits " +
+        std::to_string(cs.Hits) + ", misses " + std::to_string(cs.Misses) + "\n";
+    OutputDebugStringA(startupMsg.c_str());
 
     // Инициализация проекционной матрицы
     XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f * XM_PI,
@@ -1031,6 +1579,11 @@ void DirectXApp::OnKeyDown(WPARAM wParam)
         mUVOffsetV = 0.0f;
     }
 
+    // L включает/выключает кластерное освещение
+    if (wParam == 'L') {
+        mLighting = !mLighting;
+    }
+
     // Пробел переключает направление интерполяции
     if (wParam == VK_SPACE) {
         mBlendDirection = !mBlendDirection;
@@ -1040,6 +1593,55 @@ void DirectXApp::OnKeyDown(WPARAM wParam)
     if (wParam == '0') {
         mBlendFactor = 0.0f;
     }
+
+    // C включает/выключает столкновения камеры со сценой
+    if (wParam == 'C') {
+        mCameraCollision = !mCameraCollision;
+    }
+
+    // I включает/выключает стресс-сцену, J - инстансинг партий или отрисовка на экземпляр
+    if (wParam == 'I') {
+        mStressScene = !mStressScene;
+    }
+
+    if (wParam == 'J') {
+        mStressInstanced = !mStressInstanced;
+    }
+
+    // O включает/выключает программное отсечение перекрытых объектов
+    if (wParam == 'O') {
+        mOcclusionCulling = !mOcclusionCulling;
+    }
+
+    // P включает/выключает отсечение по PVS
+    if (wParam == 'P') {
+        mPvsCulling = !mPvsCulling;
+    }
+
+    // K включает/выключает лайтмапы
+    if (wParam == 'K') {
+        mLightmaps = !mLightmaps;
+    }
+
+    // F9 сохраняет кадр программного растеризатора
+    if (wParam == VK_F9) {
+        RenderSoftFrame();
+    }
+
+    // F5 начинает/заканчивает запись пути камеры, F6 проигрывает его
+    if (wParam == VK_F5 && !mPlayingPath) {
+        mRecordingPath = !mRecordingPath;
+        if (mRecordingPath) {
+            mCameraPath.clear();
+        }
+    }
+
+    if (wParam == VK_F6 && !mRecordingPath && !mCameraPath.empty()) {
+        mPlayingPath = true;
+        mPlaybackFrame = 0;
+        mPathTested = 0;
+        mPathOccluded = 0;
+    }
 }
 
 int DirectXApp::Run() {
@@ -1055,6 +1657,7 @@ int DirectXApp::Run() {
             mTimer.Tick();
             if (!mAppPaused) {
                 CalculateFrameStats();
+                BeginFrame();
                 Update(mTimer);
                 Draw(mTimer);
             }
@@ -1081,11 +1684,86 @@ void DirectXApp::CalculateFrameStats() {
         }
         windowText += L" FPS: " + std::to_wstring(fps);
         windowText += L" MSPF: " + std::to_wstring(mspf);
+        windowText += L" GPU wait: " + std::to_wstring(mFrameWaitMs / fps) + L" ms";
+        windowText += L" Draws: " + std::to_wstring(mVisibleDraws.size()) +
+            L"/" + std::to_wstring(mSubmeshCuller.Count());
+        windowText += L" Cull: " + std::to_wstring(mCullUs) + L" us";
+        windowText += L" PVS: " + std::to_wstring(mPvsRejected) + L" rejected";
+        windowText += L" Binds: " + std::to_wstring(mTableBinds) + L" tables, " +
+            std::to_wstring(mPsoBinds) + L" PSO";
+        windowText += L" Sort: " + std::to_wstring(mSortUs) + L" us";
+        const TransparentSortStats& tss = mTransparentSorter.Stats();
+        windowText += L" Transparent: " + std::to_wstring(tss.Items) + L" (" + std::to_wstring(tss.Us) + L" us, " +
+            (tss.Radix ? L"radix)" : L"insertion)");
+        const ClusterStats& ls = mClusteredLights.Stats();
+        windowText += L" Lights: " + std::to_wstring(ls.VisibleLights) + L"/" + std::to_wstring(ls.Lights) +
+            L" (" + std::to_wstring(ls.Indices) + L" refs, " +
+            std::to_wstring(ls.TransformUs + ls.BinUs + ls.CompactUs) + L" us)";
+        windowText += L" Lists: " + std::to_wstring(mDrawSlices.size());
+        windowText += L" Submit: " + std::to_wstring(mSubmitUs) + L" us";
+        if (mStressScene)
+        {
+            windowText += L" Instances: " + std::to_wstring(mInstances.size()) +
+                (mStressInstanced ? L" (instanced)" : L" (draw per instance)");
+        }
+        windowText += L" Occluded: " + std::to_wstring(mOcclusionCuller.Stats().Occluded) +
+            L" (" + std::to_wstring(mOcclusionCuller.Stats().OccluderTriangles) + L" tris, " +
+            std::to_wstring(mOcclusionCuller.Stats().RenderUs) + L" us)";
+        if (mConstantFillDraws > 0)
+            windowText += L" CB: " + std::to_wstring(mConstantFillUs * 10000.0 / mConstantFillDraws) + L" us/10K draws";
+
+        const SectorStreamingStats& ss = mSectorStreamer.Stats();
+        windowText += L" Sectors: " + std::to_wstring(ss.Resident) + L"/" + std::to_wstring(ss.Sectors) +
+            L" (" + std::to_wstring(ss.ResidentBytes >> 20) + L" MB, pending " + std::to_wstring(ss.Pending) +
+            L") read " + std::to_wstring(ss.ReadMBps) + L" MB/s, upload " +
+            std::to_wstring(mSectorUploadBytes >> 20) + L" MB/s, latency " + std::to_wstring(ss.LastLatencyMs) +
+            L" ms (max " + std::to_wstring(ss.MaxLatencyMs) + L"), hitches " + std::to_wstring(ss.Hitches);
+
+        const TextureStreamingStats& ts = mTextureStreamer.Stats();
+        windowText += L" Tex: " + std::to_wstring(ts.ResidentBytes >> 20) +
+            L"/" + std::to_wstring(ts.BudgetBytes >> 20) + L" MB";
+        windowText += L" Pending: " + std::to_wstring(ts.PendingRequests);
+        windowText += L" Evicted: " + std::to_wstring(ts.Evictions);
+        if (mVtMaterial >= 0)
+        {
+            windowText += L" VT: " + std::to_wstring(mVtStats.UniqueRequests) + L" requests, " +
+                std::to_wstring(mVtStats.CacheHits) + L" hits, " + std::to_wstring(mVtStats.Uploads) +
+                L" uploads, " + std::to_wstring(mVtStats.Evictions) + L" evicted, " +
+                std::to_wstring(mVtStats.Deferred) + L" deferred";
+        }
+        windowText += L" Upload peak: " + std::to_wstring(mUploadRing.Stats().PeakUsed >> 20) +
+            L"/" + std::to_wstring(mUploadRing.Capacity() >> 20) + L" MB";
+        windowText += L" Startup: " + std::to_wstring((int)(mShaderMs + mPsoMs)) + L" ms" +
+            (mShaderCache.Stats().Misses == 0 ? L" (warm)" : L" (cold)");
+        const DescriptorAllocatorStats ds = mSrvAllocator.Stats();
+        windowText += L" SRV: " + std::to_wstring(ds.PersistentUsed) + L"/" + std::to_wstring(ds.PersistentCapacity) +
+            L" (ring peak " + std::to_wstring(ds.TransientPeak) + L"/" + std::to_wstring(ds.TransientCapacity) + L")";
+        const TlsfStats gm = GpuMemoryStats();
+        windowText += L" VRAM: " + std::to_wstring(gm.UsedBytes >> 20) + L"/" + std::to_wstring(gm.Capacity >> 20) +
+            L" MB in " + std::to_wstring(mGpuHeaps.size()) + L" heaps (frag " +
+            std::to_wstring((int)(gm.Fragmentation() * 100.0)) + L"%)";
+        const FrameGraphStats& gs = mFrameGraph.Stats();
+        windowText += L" Graph: " + std::to_wstring(gs.Passes) + L" passes (" +
+            std::to_wstring(gs.CulledPasses) + L" culled), " + std::to_wstring(gs.Barriers) + L" barriers in " +
+            std::to_wstring(gs.Batches) + L" batches, transient " + std::to_wstring(gs.HeapBytes >> 20) +
+            L"/" + std::to_wstring(gs.TransientBytes >> 20) + L" MB";
+        if (mSoftFrameMs > 0.0)
+            windowText += L" CPU frame: " + std::to_wstring(mSoftFrameMs) + L" ms";
+        if (mPickedSubmesh >= 0)
+        {
+            const std::string& name = mSubmeshes[mPickedSubmesh].MaterialName;
+            windowText += L" Picked: " + std::wstring(name.begin(), name.end());
+        }
         windowText += L" (Press SPACE to switch modes)";
 
         SetWindowText(window.GetHandle(), windowText.c_str());
 
         mFrameCount = 0;
+        mFrameWaitMs = 0.0;
+        mConstantFillUs = 0.0;
+        mConstantFillDraws = 0;
+        mSectorUploadBytes = 0;
+        mVtStats = {};
         mTimeElapsed += 1.0f;
     }
 }
@@ -1095,6 +1773,15 @@ void DirectXApp::Update(const Timer& gt)
     float dt = gt.DeltaTime();
     float speed = 50.0f;
 
+    // При проигрывании записанного пути камера берётся из него
+    if (mPlayingPath)
+    {
+        const CameraKey& key = mCameraPath[mPlaybackFrame];
+        mEyePos = key.Position;
+        mYaw = key.Yaw;
+        mPitch = key.Pitch;
+    }
+
     // ===== Forward Vector =====
     XMFLOAT3 forward =
     {
@@ -1112,7 +1799,8 @@ void DirectXApp::Update(const Timer& gt)
             forwardVec));
 
     // ===== Movement =====
-    XMVECTOR pos = XMLoadFloat3(&mEyePos);
+    XMVECTOR startPos = XMLoadFloat3(&mEyePos);
+    XMVECTOR pos = startPos;
 
     if (GetAsyncKeyState('W') & 0x8000)
         pos += forwardVec * speed * dt;
@@ -1132,6 +1820,9 @@ void DirectXApp::Update(const Timer& gt)
     if (GetAsyncKeyState(VK_DOWN) & 0x8000)
         pos -= XMVectorSet(0, 1, 0, 0) * speed * dt;
 
+    if (mCameraCollision && !mPlayingPath)
+        pos = CollideCamera(startPos, pos);
+
     XMStoreFloat3(&mEyePos, pos);
 
     // ===== View Matrix =====
@@ -1142,8 +1833,9 @@ void DirectXApp::Update(const Timer& gt)
     XMStoreFloat4x4(&mView, view);
 
     // ===== Projection =====
+    const float fovY = XM_PIDIV4;
     XMMATRIX proj = XMMatrixPerspectiveFovLH(
-        XM_PIDIV4,
+        fovY,
         (float)mClientWidth / (float)mClientHeight,
         0.1f,
         1000.0f);
@@ -1168,6 +1860,12 @@ void DirectXApp::Update(const Timer& gt)
     mUVScaleU = max(0.1f, mUVScaleU);
     mUVScaleV = max(0.1f, mUVScaleV);
 
+    // ===== WORLD STREAMING =====
+    UpdateSectorStreaming(dt);
+
+    // ===== TEXTURE STREAMING =====
+    UpdateTextureStreaming(fovY);
+
     // ===== BLEND FACTOR ANIMATION =====
     // Автоматическая плавная интерполяция между текстурами
     if (mBlendDirection)
@@ -1204,360 +1902,1053 @@ void DirectXApp::Update(const Timer& gt)
         mBlendFactor = 0.0f;
     }
 
-    // ===== WVP и параметры =====
-    XMMATRIX world = XMMatrixIdentity();
-    XMMATRIX worldViewProj = world * view * proj;
+    // ===== ViewProj и параметры =====
+    // WVP каждой отрисовки собирается в WriteDrawConstants
+    XMStoreFloat4x4(&mViewProj, view * proj);
 
-    ObjectConstants objConstants;
-    XMStoreFloat4x4(&objConstants.mWorldViewProj,
-        XMMatrixTranspose(worldViewProj));
+    UpdateLights(gt.TotalTime(), fovY);
 
     // UV transform
-    objConstants.mUVTransform.x = mUVScaleU;
-    objConstants.mUVTransform.y = mUVScaleV;
-    objConstants.mUVTransform.z = mUVOffsetU;
-    objConstants.mUVTransform.w = mUVOffsetV;
+    mFrameConstants.mUVTransform.x = mUVScaleU;
+    mFrameConstants.mUVTransform.y = mUVScaleV;
+    mFrameConstants.mUVTransform.z = mUVOffsetU;
+    mFrameConstants.mUVTransform.w = mUVOffsetV;
 
     // Blend factor для интерполяции текстур
-    objConstants.mBlendFactor.x = mBlendFactor;
-
-    mObjectCB->CopyData(0, objConstants);
-}
-
-void DirectXApp::Draw(const Timer& gt)
-{
-    if (mIndexCount == 0)
-        return;
+    mFrameConstants.mBlendFactor.x = mBlendFactor;
 
-    mDirectCmdListAlloc->Reset();
+    // ===== CULLING =====
+    CullSubmeshes();
+    BuildRenderQueue();
 
-    if (mWireframeMode)
-        mCommandList->Reset(mDirectCmdListAlloc.Get(), mWireframePSO.Get());
-    else
-        mCommandList->Reset(mDirectCmdListAlloc.Get(), mPSO.Get());
+    // ===== CAMERA PATH =====
+    if (mRecordingPath)
+    {
+        mCameraPath.push_back({ mEyePos, mYaw, mPitch });
+    }
+    else if (mPlayingPath)
+    {
+        mPathTested += mOcclusionCuller.Stats().Tested;
+        mPathOccluded += mOcclusionCuller.Stats().Occluded;
 
-    D3D12_RESOURCE_BARRIER barrier =
-        CD3DX12_RESOURCE_BARRIER_HELPER::Transition(
-            CurrentBackBuffer(),
-            D3D12_RESOURCE_STATE_PRESENT,
-            D3D12_RESOURCE_STATE_RENDER_TARGET);
+        if (++mPlaybackFrame >= mCameraPath.size())
+        {
+            mPlayingPath = false;
+
+            double percent = mPathTested > 0 ? 100.0 * mPathOccluded / mPathTested : 0.0;
+            std::string msg = "Camera path: " + std::to_string(mCameraPath.size()) + " frames, " +
+                std::to_string(mPathOccluded) + " of " + std::to_string(mPathTested) +
+                " draws occluded (" + std::to_string(percent) + "%)\n";
+            OutputDebugStringA(msg.c_str());
+            MessageBoxA(nullptr, msg.c_str(), "Occlusion", MB_OK);
+        }
+    }
+}
 
-    mCommandList->ResourceBarrier(1, &barrier);
+// Отрисовки PVS - сабмеши; сквозь альфа-тест и полупрозрачные лучи проходят.
+// Ключ кэша - диапазоны и границы сабмешей, их прозрачность и параметры запекания
+void DirectXApp::BuildPvs()
+{
+    Aabb sceneBounds;
+    std::vector<PvsDraw> draws(mSubmeshes.size());
+    for (size_t i = 0; i < mSubmeshes.size(); i++)
+    {
+        const Submesh& sm = mSubmeshes[i];
+        PvsDraw& draw = draws[i];
+        draw.FirstTriangle = sm.IndexStart / 3;
+        draw.TriangleCount = sm.IndexCount / 3;
+        draw.Bounds = sm.Bounds;
+        draw.SeeThrough = sm.MaterialIndex >= 0 &&
+            ((mMaterials[sm.MaterialIndex].Features & MaterialFeatureAlphaTest) || mMaterials[sm.MaterialIndex].Transparent);
+
+        if (!sm.Bounds.IsEmpty())
+        {
+            sceneBounds.Extend(sm.Bounds.Min[0], sm.Bounds.Min[1], sm.Bounds.Min[2]);
+            sceneBounds.Extend(sm.Bounds.Max[0], sm.Bounds.Max[1], sm.Bounds.Max[2]);
+        }
+    }
 
-    SetViewportAndScissor();
+    if (sceneBounds.IsEmpty())
+        return;
 
-    const float clearColor[] = { 0.53f, 0.81f, 0.98f, 1.0f };
+    float extent = 0.0f;
+    for (int k = 0; k < 3; k++)
+        extent = (std::max)(extent, sceneBounds.Max[k] - sceneBounds.Min[k]);
 
-    auto rtvHandle = CurrentBackBufferView();
-    auto dsvHandle = mDsvHeap->GetCPUDescriptorHandleForHeapStart();
+    PvsBakeDesc desc;
+    desc.CellSize = extent / PvsCellsPerAxis;
+    desc.RaysPerCell = PvsRaysPerCell;
 
-    mCommandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
-    mCommandList->ClearDepthStencilView(
-        dsvHandle,
-        D3D12_CLEAR_FLAG_DEPTH,
-        1.0f,
-        0,
-        0,
-        nullptr);
+    ContentHash key;
+    key.Add(std::string("pvs"));
+    key.Add((uint64_t)mSceneBvh.TriangleCount());
+    for (const PvsDraw& draw : draws)
+    {
+        key.Add((uint64_t)draw.FirstTriangle << 32 | draw.TriangleCount);
+        key.Add(draw.Bounds.Min, sizeof(draw.Bounds.Min));
+        key.Add(draw.Bounds.Max, sizeof(draw.Bounds.Max));
+        key.Add((uint64_t)draw.SeeThrough);
+    }
+    key.Add(&desc, sizeof(desc));
 
-    mCommandList->OMSetRenderTargets(1, &rtvHandle, true, &dsvHandle);
+    std::string path = mShaderCache.Directory() + "/" + std::to_string(key.Value()) + ".pvs";
+    bool cached = mPvs.Load(path, key.Value());
+    if (!cached)
+    {
+        mPvs.Bake(mSceneBvh, draws, sceneBounds, desc, mJobs);
+        mPvs.Save(path, key.Value());
+    }
 
-    mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+    const PvsStats& ps = mPvs.Stats();
+    std::string msg = "PVS (" + std::string(cached ? "cached" : "baked") + "): " +
+        std::to_string(ps.WalkableCells) + "/" + std::to_string(ps.Cells) + " cells, " +
+        std::to_string(ps.UniqueRows) + " rows, " + std::to_string(ps.StoredBytes >> 10) + "/" +
+        std::to_string(ps.RawBytes >> 10) + " KB, visible " + std::to_string((int)(ps.AverageVisible * 100.0)) +
+        "% of " + std::to_string(ps.Draws) + " draws";
+    if (!cached)
+        msg += ", " + std::to_string(ps.Rays) + " rays in " + std::to_string(ps.BakeMs) + " ms";
+    msg += "\n";
+    OutputDebugStringA(msg.c_str());
+}
 
-    ID3D12DescriptorHeap* heaps[] = { mCbvHeap.Get() };
-    mCommandList->SetDescriptorHeaps(1, heaps);
+// Отрисовки для запекания - сабмеши: отражают цвет материала (у карты - её
+// последний мип, то есть средний цвет), альфа-тест и полупрозрачные пропускают
+// лучи. Ключ кэша - вершины с разложенными UV, индексы, отрисовки, источники
+// и параметры запекания
+void DirectXApp::BuildLightmaps()
+{
+    mLightmapSrv = AllocateSrvs(1);
+    if (mLightmapSrv == DescriptorAllocator::InvalidOffset)
+        throw std::runtime_error("No descriptor for lightmaps");
+
+    // Пока лайтмапа нет, в таблице нулевой дескриптор массива - шейдер его не читает
+    D3D12_SHADER_RESOURCE_VIEW_DESC nullDesc = {};
+    nullDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    nullDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    nullDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+    nullDesc.Texture2DArray.MipLevels = 1;
+    nullDesc.Texture2DArray.ArraySize = 1;
+
+    D3D12_CPU_DESCRIPTOR_HANDLE nullHandle = mSrvStagingHeap->GetCPUDescriptorHandleForHeapStart();
+    nullHandle.ptr += (SIZE_T)mLightmapSrv * mCbvSrvUavDescriptorSize;
+    device->CreateShaderResourceView(nullptr, &nullDesc, nullHandle);
+
+    if (mSceneBvh.TriangleCount() == 0)
+        return;
 
-    // CBV (b0)
-    mCommandList->SetGraphicsRootDescriptorTable(
-        0,
-        mCbvHeap->GetGPUDescriptorHandleForHeapStart());
+    std::vector<LightmapDraw> draws(mSubmeshes.size());
+    for (size_t i = 0; i < mSubmeshes.size(); i++)
+    {
+        const Submesh& sm = mSubmeshes[i];
+        LightmapDraw& draw = draws[i];
+        draw.FirstTriangle = sm.IndexStart / 3;
+        draw.TriangleCount = sm.IndexCount / 3;
 
-    mCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    mCommandList->IASetVertexBuffers(0, 1, &mVertexBufferView);
-    mCommandList->IASetIndexBuffer(&mIndexBufferView);
+        if (sm.MaterialIndex < 0)
+            continue;
 
-    for (auto& sm : mSubmeshes)
-    {
-        // Найти материал
-        Material* mat = nullptr;
+        const Material& mat = mMaterials[sm.MaterialIndex];
+        draw.SeeThrough = (mat.Features & MaterialFeatureAlphaTest) || mat.Transparent;
 
-        for (auto& m : mMaterials)
+        if (mat.StreamId1 < 0)
+        {
+            for (int c = 0; c < 3; c++)
+                draw.Albedo[c] = mat.Color1[c];
+        }
+        else
         {
-            if (m.Name == sm.MaterialName)
+            // Последний мип 1x1 в BGRA8 есть только у текстур из TGA, у DDS альбедо остаётся серым
+            const StreamedTexture& st = mStreamedTextures[mat.StreamId1];
+            if (st.FileMips < st.MipCount && st.OwnedMips.back().size() >= 4)
             {
-                mat = &m;
-                break;
+                const uint8_t* bgra = st.OwnedMips.back().data();
+                for (int c = 0; c < 3; c++)
+                    draw.Albedo[c] = bgra[2 - c] / 255.0f;
             }
         }
+    }
 
-        if (!mat)
+    // Солнце светит в атриум сверху, лампа висит над его центром
+    Aabb sceneBounds;
+    for (const Submesh& sm : mSubmeshes)
+    {
+        if (!sm.Bounds.IsEmpty())
         {
-            MessageBoxA(nullptr, sm.MaterialName.c_str(), "Missing Material", MB_OK);
-            continue;
+            sceneBounds.Extend(sm.Bounds.Min[0], sm.Bounds.Min[1], sm.Bounds.Min[2]);
+            sceneBounds.Extend(sm.Bounds.Max[0], sm.Bounds.Max[1], sm.Bounds.Max[2]);
         }
-
-        D3D12_GPU_DESCRIPTOR_HANDLE srvTableHandle =
-            mCbvHeap->GetGPUDescriptorHandleForHeapStart();
-
-        srvTableHandle.ptr += (1 + mat->SrvHeapIndex1) * mCbvSrvUavDescriptorSize;
-
-        mCommandList->SetGraphicsRootDescriptorTable(1, srvTableHandle);
-
-        mCommandList->DrawIndexedInstanced(
-            sm.IndexCount,
-            1,
-            sm.IndexStart,
-            0,
-            0);
     }
 
-    // === PRESENT ===
-
-    barrier =
-        CD3DX12_RESOURCE_BARRIER_HELPER::Transition(
-            CurrentBackBuffer(),
-            D3D12_RESOURCE_STATE_RENDER_TARGET,
-            D3D12_RESOURCE_STATE_PRESENT);
-
-    mCommandList->ResourceBarrier(1, &barrier);
-
-    mCommandList->Close();
+    float lampSize = 0.05f * (sceneBounds.Max[0] - sceneBounds.Min[0]);
+    LightmapAreaLight lamp;
+    lamp.Corner[0] = 0.5f * (sceneBounds.Min[0] + sceneBounds.Max[0]) - 0.5f * lampSize;
+    lamp.Corner[1] = sceneBounds.Min[1] + 0.6f * (sceneBounds.Max[1] - sceneBounds.Min[1]);
+    lamp.Corner[2] = 0.5f * (sceneBounds.Min[2] + sceneBounds.Max[2]) - 0.5f * lampSize;
+    lamp.EdgeU[0] = lampSize;
+    lamp.EdgeV[2] = lampSize;
+    lamp.Color[0] = 20.0f;
+    lamp.Color[1] = 16.0f;
+    lamp.Color[2] = 12.0f;
+    std::vector<LightmapAreaLight> areaLights = { lamp };
+
+    LightmapBakeDesc desc;
+    desc.IndirectSamples = LightmapIndirectSamples;
+    mLightmapRange = desc.Range;
+
+    ContentHash key;
+    key.Add(std::string("lightmap"));
+    key.Add(mCpuVertices.data(), mCpuVertices.size() * sizeof(Vertex));
+    key.Add(mCpuIndices.data(), mCpuIndices.size() * sizeof(uint32_t));
+    for (const LightmapDraw& draw : draws)
+    {
+        key.Add((uint64_t)draw.FirstTriangle << 32 | draw.TriangleCount);
+        key.Add(draw.Albedo, sizeof(draw.Albedo));
+        key.Add((uint64_t)draw.SeeThrough);
+    }
+    key.Add(areaLights.data(), areaLights.size() * sizeof(LightmapAreaLight));
+    key.Add(&desc, sizeof(desc));
 
-    ID3D12CommandList* cmdLists[] = { mCommandList.Get() };
-    mCommandQueue->ExecuteCommandLists(1, cmdLists);
+    std::string path = mShaderCache.Directory() + "/" + std::to_string(key.Value()) + ".lightmap.dds";
+    bool cached = std::filesystem::exists(path);
+    if (!cached)
+    {
+        LightmapMesh mesh;
+        mesh.Vertices = reinterpret_cast<const uint8_t*>(mCpuVertices.data());
+        mesh.VertexStride = sizeof(Vertex);
+        mesh.PositionOffset = offsetof(Vertex, position);
+        mesh.NormalOffset = offsetof(Vertex, normal);
+        mesh.VertexCount = (uint32_t)mCpuVertices.size();
+        mesh.Indices = mCpuIndices.data();
+        mesh.IndexCount = mCpuIndices.size();
+
+        mLightmapBaker.Bake(mesh, mSceneBvh, draws, areaLights, desc, mJobs);
+        if (!mLightmapBaker.Save(path))
+        {
+            OutputDebugStringA(("Failed to save " + path + "\n").c_str());
+            return;
+        }
+    }
 
-    mSwapChain->Present(0, 0);
-    mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
+    mLightmapStreamId = CreateTextureFromDDS(path, mLightmapTexture);
 
-    FlushCommandQueue();
+    const LightmapStats& ls = mLightmapBaker.Stats();
+    std::string msg = "Lightmaps (" + std::string(cached ? "cached" : "baked") + "): " +
+        std::to_string(ls.Charts) + " charts, " + std::to_string(ls.Pages) + " pages of " +
+        std::to_string(LightmapPageSize) + ", " + std::to_string(ls.TexelsPerUnit) + " texels per unit";
+    if (!cached)
+    {
+        msg += ", " + std::to_string(ls.Texels) + " texels, " + std::to_string(ls.Rays) + " rays, trace " +
+            std::to_string(ls.TraceMs) + " ms (" + std::to_string(ls.RaysPerSecond / 1e6) + " Mrays/s), denoise " +
+            std::to_string(ls.DenoiseMs) + " ms, bake " + std::to_string(ls.BakeMs) + " ms";
+    }
+    msg += "\n";
+    OutputDebugStringA(msg.c_str());
 }
 
-void DirectXApp::CreateTextureFromTGA(
-    const std::string& path,
-    Microsoft::WRL::ComPtr<ID3D12Resource>& texture)
+// =========== Virtual Texturing ===========
+// Виртуальной становится самая большая первая карта непрозрачного материала без
+// map_d. Файл тайлов запекается из её TGA при первом запуске; ключ кэша - путь,
+// размер и время изменения TGA и раскладка тайла
+void DirectXApp::BuildVirtualTexture()
 {
-    TgaImage image;
-    if (!LoadTGA(path, image))
+    int best = -1;
+    UINT64 bestTexels = 0;
+    for (size_t i = 0; i < mMaterials.size(); i++)
     {
-        throw std::runtime_error("Failed to load TGA: " + path);
+        const Material& mat = mMaterials[i];
+        if (mat.StreamId1 < 0 || mat.Transparent || (mat.Features & MaterialFeatureAlphaTest))
+            continue;
+        if (!std::filesystem::exists("../assets/" + mat.DiffuseMap1))
+            continue;
+
+        const StreamedTexture& st = mStreamedTextures[mat.StreamId1];
+        UINT64 texels = (UINT64)st.Width * st.Height;
+        if (texels > bestTexels)
+        {
+            best = (int)i;
+            bestTexels = texels;
+        }
     }
 
-    // ===== FIX RGB → RGBA =====
-    UINT pixelSize = image.data.size() / (image.width * image.height);
+    if (best < 0)
+        return;
+
+    std::string source = "../assets/" + mMaterials[best].DiffuseMap1;
 
-    if (pixelSize == 3)
+    ContentHash key;
+    key.Add(std::string("vtex"));
+    key.Add(source);
+    key.Add((uint64_t)std::filesystem::file_size(source));
+    key.Add((uint64_t)std::filesystem::last_write_time(source).time_since_epoch().count());
+    key.Add((uint64_t)VtTileSize << 32 | VtTileBorder);
+
+    std::string path = mShaderCache.Directory() + "/" + std::to_string(key.Value()) + ".vtex";
+    bool cached = mVtTileFile.Open(path);
+    if (!cached)
     {
-        std::vector<uint8_t> converted;
-        converted.resize(image.width * image.height * 4);
+        mVtTileFile = TileFile();
 
-        for (UINT i = 0; i < image.width * image.height; i++)
+        TgaImage image;
+        if (!LoadTGA(source, image) || !BakeTileFile(image, path) || !mVtTileFile.Open(path))
         {
-            converted[i * 4 + 0] = image.data[i * 3 + 0];
-            converted[i * 4 + 1] = image.data[i * 3 + 1];
-            converted[i * 4 + 2] = image.data[i * 3 + 2];
-            converted[i * 4 + 3] = 255;
+            OutputDebugStringA(("Failed to bake virtual texture " + path + "\n").c_str());
+            return;
         }
-
-        image.data = std::move(converted);
-        pixelSize = 4;
     }
 
-    // ===== TEXTURE RESOURCE =====
+    const TileFileHeader& header = mVtTileFile.Header();
+    mVtTexture = mVirtualTextures.AddTexture(header.Width, header.Height);
+
+    // Физический кэш тайлов; до первой заливки его читают только слоты из таблицы
     D3D12_RESOURCE_DESC texDesc = {};
     texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-    texDesc.Width = image.width;
-    texDesc.Height = image.height;
+    texDesc.Width = VtCacheSlots * VtPaddedTileSize;
+    texDesc.Height = VtCacheSlots * VtPaddedTileSize;
     texDesc.DepthOrArraySize = 1;
     texDesc.MipLevels = 1;
     texDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
     texDesc.SampleDesc.Count = 1;
     texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+    mVtCacheMemory = PlaceResource(GpuHeapTextures, texDesc, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, mVtCache);
 
-    D3D12_HEAP_PROPERTIES heapProps = {};
-    heapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
-
-    ThrowIfFailed(device->CreateCommittedResource(
-        &heapProps,
-        D3D12_HEAP_FLAG_NONE,
-        &texDesc,
-        D3D12_RESOURCE_STATE_COPY_DEST,
-        nullptr,
-        IID_PPV_ARGS(&texture)));
+    // Таблица страниц: мипы друг под другом, у мипа m строки [mVtMipRows[m], +VtTilesY).
+    // Цепочка мипов D3D12 не подходит: число тайлов округляется вверх, а мипы - вниз
+    mVtMipRows.resize(header.MipCount);
+    mVtPageTableRows = 0;
+    for (uint32_t mip = 0; mip < header.MipCount; mip++)
+    {
+        mVtMipRows[mip] = mVtPageTableRows;
+        mVtPageTableRows += VtTilesY(header.Height, mip);
+    }
 
-    // ===== UPLOAD BUFFER =====
-    UINT64 uploadSize = 0;
-    device->GetCopyableFootprints(
-        &texDesc, 0, 1, 0,
-        nullptr, nullptr, nullptr,
-        &uploadSize);
+    texDesc.Width = VtTilesX(header.Width, 0);
+    texDesc.Height = mVtPageTableRows;
+    texDesc.Format = DXGI_FORMAT_R32_UINT;
+    mVtPageTableMemory = PlaceResource(GpuHeapTextures, texDesc, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, mVtPageTable);
 
-    D3D12_HEAP_PROPERTIES uploadHeap = {};
-    uploadHeap.Type = D3D12_HEAP_TYPE_UPLOAD;
+    // Обратная связь: uint2 на ячейку VtFeedbackCell x VtFeedbackCell пикселей,
+    // в первом кадре буфер обнуляет проход стриминга
+    mVtFeedbackPitch = (mClientWidth + VtFeedbackCell - 1) / VtFeedbackCell;
+    mVtFeedbackCells = mVtFeedbackPitch * ((mClientHeight + VtFeedbackCell - 1) / VtFeedbackCell);
 
     D3D12_RESOURCE_DESC bufferDesc = {};
     bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-    bufferDesc.Width = uploadSize;
+    bufferDesc.Width = (UINT64)mVtFeedbackCells * 2 * sizeof(uint32_t);
     bufferDesc.Height = 1;
     bufferDesc.DepthOrArraySize = 1;
     bufferDesc.MipLevels = 1;
-    bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    bufferDesc.Format = DXGI_FORMAT_UNKNOWN;
     bufferDesc.SampleDesc.Count = 1;
+    bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    bufferDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+    mVtFeedbackMemory = PlaceResource(GpuHeapBuffers, bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST, mVtFeedback);
 
-    Microsoft::WRL::ComPtr<ID3D12Resource> uploadBuffer;
-
-    ThrowIfFailed(device->CreateCommittedResource(
-        &uploadHeap,
-        D3D12_HEAP_FLAG_NONE,
-        &bufferDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(&uploadBuffer)));
-
-    // ===== COPY DATA =====
-    void* mapped = nullptr;
-    uploadBuffer->Map(0, nullptr, &mapped);
+    D3D12_HEAP_PROPERTIES readbackHeap = {};
+    readbackHeap.Type = D3D12_HEAP_TYPE_READBACK;
+    bufferDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+    for (UINT i = 0; i < FrameCount; i++)
+    {
+        ThrowIfFailed(device->CreateCommittedResource(
+            &readbackHeap,
+            D3D12_HEAP_FLAG_NONE,
+            &bufferDesc,
+            D3D12_RESOURCE_STATE_COPY_DEST,
+            nullptr,
+            IID_PPV_ARGS(&mVtReadback[i])));
+    }
 
-    BYTE* dest = reinterpret_cast<BYTE*>(mapped);
-    BYTE* srcData = image.data.data();
+    // SRV кэша и таблицы страниц пишет SyncFrameSrvs
+    mVtSrv = AllocateSrvs(2);
+    if (mVtSrv == DescriptorAllocator::InvalidOffset)
+        throw std::runtime_error("No descriptors for the virtual texture");
 
-    UINT rowPitch = (image.width * 4 + 255) & ~255;
+    mVtTileScratch.resize(VtTileBytes);
+    mVtMaterial = best;
+    mMaterials[best].Features |= MaterialFeatureVirtual;
 
-    for (UINT y = 0; y < image.height; y++)
+    // Маски перестановок собраны до выбора материала
+    mPermutations = 0;
+    mTransparentPermutations = 0;
+    for (const Material& mat : mMaterials)
     {
-        memcpy(
-            dest + y * rowPitch,
-            srcData + y * image.width * 4,
-            image.width * 4);
+        mPermutations |= 1u << mat.Features;
+        if (mat.Transparent)
+            mTransparentPermutations |= 1u << mat.Features;
     }
 
-    uploadBuffer->Unmap(0, nullptr);
+    std::string msg = "Virtual texture (" + std::string(cached ? "cached" : "baked") + "): " +
+        mMaterials[best].Name + ", " + std::to_string(header.Width) + "x" + std::to_string(header.Height) +
+        ", " + std::to_string(header.MipCount) + " mips, cache " + std::to_string(VtCacheSlots * VtCacheSlots) +
+        " tiles\n";
+    OutputDebugStringA(msg.c_str());
+}
 
-    D3D12_TEXTURE_COPY_LOCATION dst = {};
-    dst.pResource = texture.Get();
-    dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-    dst.SubresourceIndex = 0;
+// Запросы кадра, чья обратная связь лежит в readback слота: ячейки с его меткой
+// (остальные не перезаписаны с прошлых кадров) и весь самый грубый мип - запасной
+// вариант нужен с первого кадра. Выбранные тайлы заливает проход стриминга
+void DirectXApp::ReadVirtualTextureFeedback(UINT slot)
+{
+    if (mVtMaterial < 0)
+        return;
 
-    D3D12_TEXTURE_COPY_LOCATION src = {};
-    src.pResource = uploadBuffer.Get();
-    src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+    const TileFileHeader& header = mVtTileFile.Header();
+    mVtRequests.clear();
 
-    device->GetCopyableFootprints(
-        &texDesc, 0, 1, 0,
-        &src.PlacedFootprint,
-        nullptr, nullptr, nullptr);
+    TileKey key;
+    key.Texture = mVtTexture;
+    key.Mip = uint8_t(header.MipCount - 1);
+    for (uint32_t y = 0; y < VtTilesY(header.Height, key.Mip); y++)
+    {
+        for (uint32_t x = 0; x < VtTilesX(header.Width, key.Mip); x++)
+        {
+            key.X = uint16_t(x);
+            key.Y = uint16_t(y);
+            mVtRequests.push_back(key.Pack());
+        }
+    }
 
-    mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr);
-    mCommandList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+    uint32_t stamp = mVtReadbackStamp[slot];
+    if (stamp != 0)
+    {
+        D3D12_RANGE readRange = { 0, (SIZE_T)mVtFeedbackCells * 2 * sizeof(uint32_t) };
+        const uint32_t* cells = nullptr;
+        ThrowIfFailed(mVtReadback[slot]->Map(0, &readRange, (void**)&cells));
 
-    D3D12_RESOURCE_BARRIER barrier = {};
-    barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-    barrier.Transition.pResource = texture.Get();
-    barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-    barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
-    barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+        // Ячейка: x | y << 12 | mip << 24 и метка кадра
+        for (UINT i = 0; i < mVtFeedbackCells; i++)
+        {
+            if (cells[i * 2 + 1] != stamp)
+                continue;
+
+            uint32_t packed = cells[i * 2];
+            key.X = uint16_t(packed & 0xFFF);
+            key.Y = uint16_t((packed >> 12) & 0xFFF);
+            key.Mip = uint8_t(packed >> 24);
+            mVtRequests.push_back(key.Pack());
+        }
 
-    mCommandList->ResourceBarrier(1, &barrier);
-    mCommandList->Close();
+        D3D12_RANGE written = { 0, 0 };
+        mVtReadback[slot]->Unmap(0, &written);
+        mVtReadbackStamp[slot] = 0;
+    }
 
-    ID3D12CommandList* cmdLists[] = { mCommandList.Get() };
-    mCommandQueue->ExecuteCommandLists(1, cmdLists);
+    const std::vector<TileUpload>& uploads = mVirtualTextures.Update(mVtRequests.data(), mVtRequests.size());
+    mVtUploads.insert(mVtUploads.end(), uploads.begin(), uploads.end());
 
-    FlushCommandQueue();
+    const VirtualTextureStats& vs = mVirtualTextures.Stats();
+    mVtStats.FeedbackEntries += vs.FeedbackEntries;
+    mVtStats.UniqueRequests += vs.UniqueRequests;
+    mVtStats.CacheHits += vs.CacheHits;
+    mVtStats.Uploads += vs.Uploads;
+    mVtStats.Evictions += vs.Evictions;
+    mVtStats.Deferred += vs.Deferred;
 }
 
-void DirectXApp::CreateColorTexture(
-    const DirectX::XMFLOAT3& color,
-    Microsoft::WRL::ComPtr<ID3D12Resource>& texture)
+// Метка кадра: её пишет PS в обратную связь и по ней ReadVirtualTextureFeedback
+// отличает свежие ячейки
+void DirectXApp::PrepareVirtualTexture()
 {
-    UINT r = (UINT)(color.x * 255.0f);
-    UINT g = (UINT)(color.y * 255.0f);
-    UINT b = (UINT)(color.z * 255.0f);
-
-    UINT pixel = (255 << 24) | (b << 16) | (g << 8) | r;
+    if (mVtMaterial < 0)
+        return;
 
-    // ---- TEXTURE (DEFAULT heap) ----
-    D3D12_RESOURCE_DESC texDesc = {};
-    texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-    texDesc.Width = 1;
-    texDesc.Height = 1;
-    texDesc.DepthOrArraySize = 1;
-    texDesc.MipLevels = 1;
-    texDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
-    texDesc.SampleDesc.Count = 1;
-    texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+    mVtFrame++;
+    const TileFileHeader& header = mVtTileFile.Header();
+    mFrameConstants.mVirtual = XMFLOAT4(
+        (float)header.Width, (float)header.Height, (float)mVtFeedbackPitch, (float)VtStamp(mVtFrame));
+}
 
-    D3D12_HEAP_PROPERTIES heapProps = {};
-    heapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
+// Обратная связь прошлого кадра - в readback слота, тайлы - в кэш, таблица
+// страниц - целиком, если менялась. Переходы ставит граф кадра
+void DirectXApp::RecordVirtualTextureUploads(ID3D12GraphicsCommandList* cmdList)
+{
+    if (mVtMaterial < 0)
+        return;
 
-    ThrowIfFailed(device->CreateCommittedResource(
-        &heapProps,
-        D3D12_HEAP_FLAG_NONE,
-        &texDesc,
-        D3D12_RESOURCE_STATE_COPY_DEST,
-        nullptr,
-        IID_PPV_ARGS(&texture)));
+    UINT slot = mFrameScheduler.CurrentSlot();
+    UINT64 feedbackBytes = (UINT64)mVtFeedbackCells * 2 * sizeof(uint32_t);
+    if (mVtFeedbackReady)
+    {
+        cmdList->CopyBufferRegion(mVtReadback[slot].Get(), 0, mVtFeedback.Get(), 0, feedbackBytes);
+        mVtReadbackStamp[slot] = VtStamp(mVtFrame - 1);
+    }
+    else
+    {
+        // Нулевая метка не совпадает ни с одним кадром
+        UploadAllocation zeros = AllocateUpload(feedbackBytes, 16);
+        memset(zeros.Mapped, 0, feedbackBytes);
+        cmdList->CopyBufferRegion(mVtFeedback.Get(), 0, zeros.Resource, zeros.Offset, feedbackBytes);
+        mVtFeedbackReady = true;
+    }
 
-    // ---- UPLOAD BUFFER ----
-    UINT64 uploadSize = 0;
-    device->GetCopyableFootprints(
-        &texDesc, 0, 1, 0,
-        nullptr, nullptr, nullptr,
-        &uploadSize);
+    const UINT tileRowBytes = VtPaddedTileSize * 4;
+    const UINT tilePitch = (tileRowBytes + D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1) &
+        ~(D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1);
 
-    D3D12_HEAP_PROPERTIES uploadHeap = {};
-    uploadHeap.Type = D3D12_HEAP_TYPE_UPLOAD;
+    for (const TileUpload& tile : mVtUploads)
+    {
+        if (!mVtTileFile.ReadTile(tile.Key.Mip, tile.Key.X, tile.Key.Y, mVtTileScratch.data()))
+            continue;
 
-    D3D12_RESOURCE_DESC bufferDesc = {};
-    bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-    bufferDesc.Width = uploadSize;
-    bufferDesc.Height = 1;
-    bufferDesc.DepthOrArraySize = 1;
-    bufferDesc.MipLevels = 1;
-    bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-    bufferDesc.SampleDesc.Count = 1;
+        UploadAllocation upload = AllocateUpload((UINT64)tilePitch * VtPaddedTileSize, UploadTextureAlignment);
+        for (UINT y = 0; y < VtPaddedTileSize; y++)
+            memcpy(upload.Mapped + (size_t)y * tilePitch, &mVtTileScratch[(size_t)y * tileRowBytes], tileRowBytes);
+        mTextureBytesTouched += 2ull * VtTileBytes;
+
+        D3D12_TEXTURE_COPY_LOCATION dst = {};
+        dst.pResource = mVtCache.Get();
+        dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+        dst.SubresourceIndex = 0;
+
+        D3D12_TEXTURE_COPY_LOCATION src = {};
+        src.pResource = upload.Resource;
+        src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+        src.PlacedFootprint.Offset = upload.Offset;
+        src.PlacedFootprint.Footprint.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+        src.PlacedFootprint.Footprint.Width = VtPaddedTileSize;
+        src.PlacedFootprint.Footprint.Height = VtPaddedTileSize;
+        src.PlacedFootprint.Footprint.Depth = 1;
+        src.PlacedFootprint.Footprint.RowPitch = tilePitch;
+
+        cmdList->CopyTextureRegion(
+            &dst,
+            mVirtualTextures.SlotX(tile.Slot) * VtPaddedTileSize,
+            mVirtualTextures.SlotY(tile.Slot) * VtPaddedTileSize,
+            0,
+            &src,
+            nullptr);
+    }
+    mVtUploads.clear();
 
-    Microsoft::WRL::ComPtr<ID3D12Resource> uploadBuffer;
+    if (!mVirtualTextures.IsPageTableDirty(mVtTexture))
+        return;
 
-    ThrowIfFailed(device->CreateCommittedResource(
-        &uploadHeap,
-        D3D12_HEAP_FLAG_NONE,
-        &bufferDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(&uploadBuffer)));
+    const TileFileHeader& header = mVtTileFile.Header();
+    UINT width = VtTilesX(header.Width, 0);
+    UINT pitch = (width * 4 + D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1) & ~(D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1);
 
-    // ---- MAP ----
-    void* mapped = nullptr;
-    uploadBuffer->Map(0, nullptr, &mapped);
-    memcpy(mapped, &pixel, sizeof(UINT));
-    uploadBuffer->Unmap(0, nullptr);
+    UploadAllocation upload = AllocateUpload((UINT64)pitch * mVtPageTableRows, UploadTextureAlignment);
+    memset(upload.Mapped, 0, (size_t)pitch * mVtPageTableRows);
+    for (uint32_t mip = 0; mip < header.MipCount; mip++)
+    {
+        const std::vector<uint32_t>& entries = mVirtualTextures.PageTable(mVtTexture, mip);
+        UINT tilesX = VtTilesX(header.Width, mip);
+        for (UINT y = 0; y < VtTilesY(header.Height, mip); y++)
+        {
+            memcpy(upload.Mapped + (size_t)(mVtMipRows[mip] + y) * pitch, &entries[(size_t)y * tilesX], tilesX * 4);
+        }
+    }
 
-    // ---- COPY ----
     D3D12_TEXTURE_COPY_LOCATION dst = {};
-    dst.pResource = texture.Get();
+    dst.pResource = mVtPageTable.Get();
     dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
     dst.SubresourceIndex = 0;
 
     D3D12_TEXTURE_COPY_LOCATION src = {};
-    src.pResource = uploadBuffer.Get();
+    src.pResource = upload.Resource;
     src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+    src.PlacedFootprint.Offset = upload.Offset;
+    src.PlacedFootprint.Footprint.Format = DXGI_FORMAT_R32_UINT;
+    src.PlacedFootprint.Footprint.Width = width;
+    src.PlacedFootprint.Footprint.Height = mVtPageTableRows;
+    src.PlacedFootprint.Footprint.Depth = 1;
+    src.PlacedFootprint.Footprint.RowPitch = pitch;
+
+    cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+    mVirtualTextures.ClearPageTableDirty(mVtTexture);
+}
+
+// Сабмеши вне пирамиды видимости не попадают в mVisibleDraws
+void DirectXApp::CullSubmeshes()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // Невыгруженные сектора и строка PVS ячейки камеры - маска до проверки пирамиды
+    const uint64_t* pvs = mPvsCulling ? mPvs.VisibleSet(&mEyePos.x) : nullptr;
+    mPvsRejected = 0;
+    if (pvs)
+    {
+        UINT visible = 0;
+        for (UINT w = 0; w < (mPvs.DrawCount() + 63) / 64; w++)
+            visible += (UINT)std::popcount(pvs[w]);
+        mPvsRejected = mPvs.DrawCount() - visible;
+    }
+
+    FrustumPlanes frustum;
+    ExtractFrustumPlanes(mViewProj.m, frustum);
+    mCullMask = mResidentDraws;
+    if (pvs)
+    {
+        for (size_t w = 0; w < mCullMask.size(); w++)
+            mCullMask[w] &= pvs[w];
+    }
+    mSubmeshCuller.Cull(frustum, mVisibleDraws, mCullMask.data());
+
+    // ===== ПЕРЕКРЫТИЯ =====
+    mOcclusionCuller.ResetStats();
+    if (mOcclusionCulling)
+    {
+        mOcclusionCuller.Render(mViewProj.m);
+
+        size_t visibleCount = 0;
+        for (uint32_t index : mVisibleDraws)
+        {
+            if (mOcclusionCuller.IsVisible(mSubmeshes[index].Bounds))
+                mVisibleDraws[visibleCount++] = index;
+        }
+        mVisibleDraws.resize(visibleCount);
+    }
+
+    mCullUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Сабмеши уже разрезаны по секторам (BuildObj), границы и материалы известны.
+// Ключ файлов - вершины, индексы и разбиение. Сектора вокруг стартовой позиции
+// читаются сразу и загружаются на GPU до первого кадра
+void DirectXApp::BuildSectors()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    ContentHash key;
+    key.Add(std::string("sectors"));
+    key.Add(mCpuVertices.data(), mCpuVertices.size() * sizeof(Vertex));
+    key.Add(mCpuIndices.data(), mCpuIndices.size() * sizeof(uint32_t));
+    for (const Submesh& sm : mSubmeshes)
+    {
+        key.Add((uint64_t)sm.IndexStart << 32 | sm.IndexCount);
+        key.Add((uint64_t)sm.Sector);
+    }
+
+    mSectorStreamer.Build(
+        reinterpret_cast<const uint8_t*>(mCpuVertices.data()), sizeof(Vertex), mCpuIndices,
+        mSubmeshes, mShaderCache.Directory(), key.Value());
+
+    SectorStreamingDesc desc;
+    desc.LoadRadius = SectorLoadRadius;
+    desc.UnloadRadius = SectorUnloadRadius;
+    desc.VisibleRadius = SectorVisibleRadius;
+    desc.LookAhead = SectorLookAhead;
+    mSectorStreamer.SetDesc(desc);
 
-    device->GetCopyableFootprints(
-        &texDesc, 0, 1, 0,
-        &src.PlacedFootprint,
-        nullptr, nullptr, nullptr);
+    mSectorGeometry.assign(mSectorStreamer.SectorCount(), SectorGeometry());
+    mResidentDraws.assign((mSubmeshes.size() + 63) / 64, 0);
+    mLastEyePos = mEyePos;
 
+    mSectorStreamer.LoadNow(&mEyePos.x);
+    for (uint32_t sector : mSectorStreamer.Arrived())
+    {
+        mSectorArrivals.push_back({ sector, mSectorStreamer.TakeData(sector) });
+        SetSectorResident(sector, true);
+    }
+
+    // Копии и переходы вне графа кадра - как у остальной загрузки при старте
+    std::vector<uint32_t> loaded;
+    for (const SectorArrival& arrival : mSectorArrivals)
+        loaded.push_back(arrival.Sector);
+
+    PrepareSectorStreaming();
     mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr);
+    RecordSectorUploads(mCommandList.Get());
+
+    std::vector<D3D12_RESOURCE_BARRIER> barriers;
+    for (uint32_t sector : loaded)
+    {
+        const SectorGeometry& geometry = mSectorGeometry[sector];
+        barriers.push_back(CD3DX12_RESOURCE_BARRIER_HELPER::Transition(geometry.VertexBuffer.Get(),
+            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER));
+        barriers.push_back(CD3DX12_RESOURCE_BARRIER_HELPER::Transition(geometry.IndexBuffer.Get(),
+            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_INDEX_BUFFER));
+    }
+    if (!barriers.empty())
+        mCommandList->ResourceBarrier((UINT)barriers.size(), barriers.data());
+
+    mCommandList->Close();
+    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+    FlushCommandQueue();
+    mSectorUploadBytes = 0;
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    uint32_t sectorCount = mSectorStreamer.SectorCount();
+    size_t materials = 0;
+    for (uint32_t s = 0; s < sectorCount; s++)
+        materials += mSectorStreamer.Sector(s).Materials.size();
+
+    const SectorStreamingStats& ss = mSectorStreamer.Stats();
+    std::string msg = "Sectors: " + std::to_string(sectorCount) + " (" + std::to_string(mSubmeshes.size()) +
+        " draws, " + std::to_string(sectorCount ? (double)materials / sectorCount : 0.0) +
+        " materials each), written " + std::to_string(mSectorStreamer.WrittenFiles()) + " files, resident " +
+        std::to_string(ss.Resident) + " (" + std::to_string(ss.ResidentBytes >> 20) + " MB) in " +
+        std::to_string(ms) + " ms\n";
+    OutputDebugStringA(msg.c_str());
+}
+
+// Скорость камеры сглажена: рывок мыши или телепорт по пути не должен
+// перезапрашивать полмира
+void DirectXApp::UpdateSectorStreaming(float dt)
+{
+    if (dt > 0.0f)
+    {
+        float blend = 1.0f - expf(-dt / VelocitySmoothing);
+        mEyeVelocity.x += ((mEyePos.x - mLastEyePos.x) / dt - mEyeVelocity.x) * blend;
+        mEyeVelocity.y += ((mEyePos.y - mLastEyePos.y) / dt - mEyeVelocity.y) * blend;
+        mEyeVelocity.z += ((mEyePos.z - mLastEyePos.z) / dt - mEyeVelocity.z) * blend;
+    }
+    mLastEyePos = mEyePos;
+
+    mSectorStreamer.Update(&mEyePos.x, &mEyeVelocity.x);
+
+    // Буферы выгруженных живут, пока их читают кадры в полёте
+    for (uint32_t sector : mSectorStreamer.Evicted())
+    {
+        SectorGeometry& geometry = mSectorGeometry[sector];
+        if (geometry.VertexBuffer)
+        {
+            mRetiredResources.Retire(geometry.VertexBuffer, mFrameScheduler.PendingFenceValue());
+            mRetiredResources.Retire(geometry.IndexBuffer, mFrameScheduler.PendingFenceValue());
+            mRetiredAllocations.Retire(geometry.VertexMemory, mFrameScheduler.PendingFenceValue());
+            mRetiredAllocations.Retire(geometry.IndexMemory, mFrameScheduler.PendingFenceValue());
+        }
+        geometry = SectorGeometry();
+
+        mSectorArrivals.erase(
+            std::remove_if(mSectorArrivals.begin(), mSectorArrivals.end(),
+                [sector](const SectorArrival& arrival) { return arrival.Sector == sector; }),
+            mSectorArrivals.end());
+        SetSectorResident(sector, false);
+    }
+
+    for (uint32_t sector : mSectorStreamer.Arrived())
+    {
+        mSectorArrivals.push_back({ sector, mSectorStreamer.TakeData(sector) });
+        SetSectorResident(sector, true);
+    }
+}
+
+void DirectXApp::SetSectorResident(uint32_t sector, bool resident)
+{
+    for (uint32_t draw : mSectorStreamer.Sector(sector).Draws)
+    {
+        uint64_t bit = 1ull << (draw & 63);
+        if (resident)
+            mResidentDraws[draw >> 6] |= bit;
+        else
+            mResidentDraws[draw >> 6] &= ~bit;
+    }
+}
+
+// Буферы пришедших секторов в COPY_DEST - до графа кадра, как у текстур
+void DirectXApp::PrepareSectorStreaming()
+{
+    for (const SectorArrival& arrival : mSectorArrivals)
+    {
+        SectorGeometry& geometry = mSectorGeometry[arrival.Sector];
+        UINT vbByteSize = (UINT)arrival.Data.Vertices.size();
+        UINT ibByteSize = (UINT)(arrival.Data.Indices.size() * sizeof(uint32_t));
+
+        D3D12_RESOURCE_DESC bufferDesc = {};
+        bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+        bufferDesc.Height = 1;
+        bufferDesc.DepthOrArraySize = 1;
+        bufferDesc.MipLevels = 1;
+        bufferDesc.Format = DXGI_FORMAT_UNKNOWN;
+        bufferDesc.SampleDesc.Count = 1;
+        bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+        bufferDesc.Width = vbByteSize;
+        geometry.VertexMemory = PlaceResource(
+            GpuHeapBuffers, bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST, geometry.VertexBuffer);
+        bufferDesc.Width = ibByteSize;
+        geometry.IndexMemory = PlaceResource(
+            GpuHeapBuffers, bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST, geometry.IndexBuffer);
+
+        geometry.VertexView.BufferLocation = geometry.VertexBuffer->GetGPUVirtualAddress();
+        geometry.VertexView.StrideInBytes = sizeof(Vertex);
+        geometry.VertexView.SizeInBytes = vbByteSize;
+
+        geometry.IndexView.BufferLocation = geometry.IndexBuffer->GetGPUVirtualAddress();
+        geometry.IndexView.Format = DXGI_FORMAT_R32_UINT;
+        geometry.IndexView.SizeInBytes = ibByteSize;
+    }
+}
+
+// Данные секторов через upload-кольцо; переходы в VB/IB ставит граф кадра
+void DirectXApp::RecordSectorUploads(ID3D12GraphicsCommandList* cmdList)
+{
+    for (const SectorArrival& arrival : mSectorArrivals)
+    {
+        const SectorGeometry& geometry = mSectorGeometry[arrival.Sector];
+        UINT64 vbByteSize = arrival.Data.Vertices.size();
+        UINT64 ibByteSize = arrival.Data.Indices.size() * sizeof(uint32_t);
+
+        UploadAllocation vertices = AllocateUpload(vbByteSize, 16);
+        memcpy(vertices.Mapped, arrival.Data.Vertices.data(), vbByteSize);
+        cmdList->CopyBufferRegion(geometry.VertexBuffer.Get(), 0, vertices.Resource, vertices.Offset, vbByteSize);
+
+        UploadAllocation indices = AllocateUpload(ibByteSize, 16);
+        memcpy(indices.Mapped, arrival.Data.Indices.data(), ibByteSize);
+        cmdList->CopyBufferRegion(geometry.IndexBuffer.Get(), 0, indices.Resource, indices.Offset, ibByteSize);
+
+        mSectorUploadBytes += vbByteSize + ibByteSize;
+    }
+
+    mSectorArrivals.clear();
+}
+
+// Ключи видимых отрисовок и их сортировка: сначала по состоянию, внутри
+// одного материала - от ближних к дальним, чтобы ранний Z отбрасывал больше.
+// Полупрозрачные идут отдельным проходом после непрозрачных, от дальних
+// к ближним по глубине вида - их упорядочивает mTransparentSorter.
+void DirectXApp::BuildRenderQueue()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    uint32_t pipeline = mWireframeMode ? PsoWireframe : PsoSolid;
+    uint32_t transparentPipeline = mWireframeMode ? PsoWireframe : PsoTransparent;
+
+    // Без материала отрисовка пропускается при записи - её перестановка не важна
+    auto features = [this](const Submesh& sm)
+    {
+        return sm.MaterialIndex >= 0 ? mMaterials[sm.MaterialIndex].Features : 0u;
+    };
+    auto transparent = [this](const Submesh& sm)
+    {
+        return sm.MaterialIndex >= 0 && mMaterials[sm.MaterialIndex].Transparent;
+    };
+
+    // Глубина вида - третий столбец mView: при сдвиге камеры меняется у всех
+    // одинаково, порядок ломают только повороты
+    auto viewDepth = [this](float x, float y, float z)
+    {
+        return x * mView._13 + y * mView._23 + z * mView._33 + mView._43;
+    };
+
+    // id сортировщика: сабмеши, затем экземпляры, затем партии стресс-сцены
+    uint32_t instanceBase = (uint32_t)mSubmeshes.size();
+    uint32_t batchBase = instanceBase + (uint32_t)mInstances.size();
+    mTransparentItems.resize(batchBase + mInstanceBatches.size());
+
+    auto addTransparent = [&](uint32_t id, float depth, uint32_t pso, const RenderItem& item)
+    {
+        mTransparentItems[id] = item;
+        mTransparentItems[id].Key = MakeDrawKey(RenderPassTransparent, pso,
+            (uint32_t)mSubmeshes[item.DrawIndex].MaterialIndex, 0.0f);
+        mTransparentSorter.Add(id, depth);
+    };
+
+    mRenderQueue.Clear();
+    mTransparentSorter.Begin();
+
+    for (uint32_t index : mVisibleDraws)
+    {
+        const Submesh& sm = mSubmeshes[index];
+
+        if (transparent(sm))
+        {
+            float depth = viewDepth(
+                0.5f * (sm.Bounds.Min[0] + sm.Bounds.Max[0]),
+                0.5f * (sm.Bounds.Min[1] + sm.Bounds.Max[1]),
+                0.5f * (sm.Bounds.Min[2] + sm.Bounds.Max[2]));
+            addTransparent(index, depth, PsoKey(transparentPipeline, features(sm)), { 0, index, 0, 0 });
+            continue;
+        }
+
+        float distance = sm.Bounds.Distance(mEyePos.x, mEyePos.y, mEyePos.z);
+
+        mRenderQueue.Add(
+            MakeDrawKey(RenderPassOpaque, PsoKey(pipeline, features(sm)), (uint32_t)sm.MaterialIndex,
+                distance / MaxSortDistance),
+            index);
+    }
+    // Стресс-сцена: партия целиком или каждый экземпляр отдельной отрисовкой
+    if (mStressScene)
+    {
+        uint32_t instancedPipeline = mWireframeMode ? PsoInstancedWireframe : PsoInstanced;
+        uint32_t instancedTransparentPipeline = mWireframeMode ? PsoInstancedWireframe : PsoInstancedTransparent;
+
+        for (size_t b = 0; b < mInstanceBatches.size(); b++)
+        {
+            const InstanceBatch& batch = mInstanceBatches[b];
+            const Submesh& sm = mSubmeshes[batch.Submesh];
+            uint32_t material = (uint32_t)sm.MaterialIndex;
+
+            // Геометрия пропа - в буферах его сектора
+            if ((mResidentDraws[batch.Submesh >> 6] >> (batch.Submesh & 63) & 1) == 0)
+                continue;
+
+            if (transparent(sm))
+            {
+                uint32_t transparentPso = PsoKey(instancedTransparentPipeline, features(sm));
+
+                // Партия одной отрисовкой сортируется целиком по средней глубине;
+                // экземпляры внутри неё остаются в порядке буфера
+                if (mStressInstanced)
+                {
+                    float depth = 0.0f;
+                    for (uint32_t i = batch.FirstInstance; i < batch.FirstInstance + batch.InstanceCount; i++)
+                    {
+                        const float* t = mInstances[i].World[3];
+                        depth += viewDepth(t[0], t[1], t[2]);
+                    }
+                    depth /= (float)(std::max)(batch.InstanceCount, 1u);
+
+                    addTransparent(batchBase + (uint32_t)b, depth, transparentPso,
+                        { 0, batch.Submesh, batch.FirstInstance, batch.InstanceCount });
+                    continue;
+                }
+
+                for (uint32_t i = batch.FirstInstance; i < batch.FirstInstance + batch.InstanceCount; i++)
+                {
+                    const float* t = mInstances[i].World[3];
+                    addTransparent(instanceBase + i, viewDepth(t[0], t[1], t[2]), transparentPso,
+                        { 0, batch.Submesh, i, 1 });
+                }
+                continue;
+            }
+
+            uint32_t instancedPso = PsoKey(instancedPipeline, features(sm));
+
+            if (mStressInstanced)
+            {
+                mRenderQueue.Add(
+                    MakeDrawKey(RenderPassOpaque, instancedPso, material, 0.0f),
+                    batch.Submesh, batch.FirstInstance, batch.InstanceCount);
+                continue;
+            }
+
+            for (uint32_t i = batch.FirstInstance; i < batch.FirstInstance + batch.InstanceCount; i++)
+            {
+                const float* t = mInstances[i].World[3];
+                float dx = t[0] - mEyePos.x;
+                float dy = t[1] - mEyePos.y;
+                float dz = t[2] - mEyePos.z;
+                float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+
+                mRenderQueue.Add(
+                    MakeDrawKey(RenderPassOpaque, instancedPso, material, distance / MaxSortDistance),
+                    batch.Submesh, i, 1);
+            }
+        }
+    }
+
+    mRenderQueue.Sort();
+
+    // Проход полупрозрачных старше непрозрачного - очередь остаётся отсортированной
+    mTransparentSorter.Sort();
+    for (uint32_t id : mTransparentSorter.Order())
+    {
+        const RenderItem& item = mTransparentItems[id];
+        mRenderQueue.Add(item.Key, item.DrawIndex, item.FirstInstance, item.InstanceCount);
+    }
+
+    mSortUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+ID3D12PipelineState* DirectXApp::PipelineState(uint32_t pso) const
+{
+    uint32_t features = pso & (MaterialPermutationCount - 1);
+
+    switch (pso >> MaterialFeatureBits)
+    {
+    case PsoWireframe: return mWireframePSO[features].Get();
+    case PsoInstanced: return mInstancedPSO[features].Get();
+    case PsoInstancedWireframe: return mInstancedWireframePSO[features].Get();
+    case PsoTransparent: return mTransparentPSO[features].Get();
+    case PsoInstancedTransparent: return mInstancedTransparentPSO[features].Get();
+    default: return mPSO[features].Get();
+    }
+}
+
+// Пропы - самые детальные из небольших сабмешей сцены (вазы, растения, ...);
+// экземпляры раскладываются сеткой над центром сцены, матрицы лежат в DEFAULT-буфере
+void DirectXApp::BuildStressScene()
+{
+    Aabb sceneBounds;
+    for (const auto& sm : mSubmeshes)
+    {
+        sceneBounds.Extend(sm.Bounds.Min[0], sm.Bounds.Min[1], sm.Bounds.Min[2]);
+        sceneBounds.Extend(sm.Bounds.Max[0], sm.Bounds.Max[1], sm.Bounds.Max[2]);
+    }
+
+    if (sceneBounds.IsEmpty())
+        return;
+
+    auto diagonal = [](const Aabb& box)
+    {
+        float dx = box.Max[0] - box.Min[0];
+        float dy = box.Max[1] - box.Min[1];
+        float dz = box.Max[2] - box.Min[2];
+        return sqrtf(dx * dx + dy * dy + dz * dz);
+    };
+
+    float sceneDiagonal = diagonal(sceneBounds);
+
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < (uint32_t)mSubmeshes.size(); i++)
+    {
+        const Submesh& sm = mSubmeshes[i];
+        if (sm.MaterialIndex >= 0 && !sm.Bounds.IsEmpty() && diagonal(sm.Bounds) < 0.1f * sceneDiagonal)
+            candidates.push_back(i);
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b)
+    {
+        return mSubmeshes[a].IndexCount > mSubmeshes[b].IndexCount;
+    });
+    candidates.resize((std::min)(candidates.size(), (size_t)StressPropCount));
+
+    float propSize = 0.0f;
+    std::vector<StressProp> props;
+    for (uint32_t index : candidates)
+    {
+        const Aabb& box = mSubmeshes[index].Bounds;
+
+        StressProp prop;
+        prop.Submesh = index;
+        for (int k = 0; k < 3; k++)
+            prop.Center[k] = 0.5f * (box.Min[k] + box.Max[k]);
+        props.push_back(prop);
+
+        propSize = (std::max)(propSize, diagonal(box));
+    }
+
+    StressSceneDesc sceneDesc;
+    sceneDesc.Seed = StressSeed;
+    sceneDesc.CountX = StressGridX;
+    sceneDesc.CountZ = StressGridZ;
+    sceneDesc.Spacing = (std::max)(propSize, 1.0f);
+    sceneDesc.Origin[0] = 0.5f * (sceneBounds.Min[0] + sceneBounds.Max[0]);
+    sceneDesc.Origin[1] = sceneBounds.Max[1] + propSize;
+    sceneDesc.Origin[2] = 0.5f * (sceneBounds.Min[2] + sceneBounds.Max[2]);
 
-    mCommandList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+    GenerateStressScene(sceneDesc, props, mInstances, mInstanceBatches);
 
-    D3D12_RESOURCE_BARRIER barrier = {};
-    barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-    barrier.Transition.pResource = texture.Get();
-    barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-    barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
-    barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    if (mInstances.empty())
+        return;
+
+    UINT64 byteSize = mInstances.size() * sizeof(InstanceData);
+
+    D3D12_RESOURCE_DESC bufferDesc = {};
+    bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    bufferDesc.Width = byteSize;
+    bufferDesc.Height = 1;
+    bufferDesc.DepthOrArraySize = 1;
+    bufferDesc.MipLevels = 1;
+    bufferDesc.SampleDesc.Count = 1;
+    bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+    PlaceResource(GpuHeapBuffers, bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST, mInstanceBuffer);
+
+    UploadAllocation upload = AllocateUpload(byteSize, 16);
+    memcpy(upload.Mapped, mInstances.data(), byteSize);
 
+    mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr);
+    mCommandList->CopyBufferRegion(mInstanceBuffer.Get(), 0, upload.Resource, upload.Offset, byteSize);
+
+    D3D12_RESOURCE_BARRIER barrier =
+        CD3DX12_RESOURCE_BARRIER_HELPER::Transition(
+            mInstanceBuffer.Get(),
+            D3D12_RESOURCE_STATE_COPY_DEST,
+            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
     mCommandList->ResourceBarrier(1, &barrier);
 
     mCommandList->Close();
@@ -1566,4 +2957,1444 @@ void DirectXApp::CreateColorTexture(
     mCommandQueue->ExecuteCommandLists(1, cmdLists);
 
     FlushCommandQueue();
-}
\ No newline at end of file
+
+    std::string msg = "Stress scene: " + std::to_string(mInstances.size()) + " instances of " +
+        std::to_string(props.size()) + " props\n";
+    OutputDebugStringA(msg.c_str());
+}
+
+// Источники в нижней половине сцены, каждый на своей окружности вокруг
+// случайной точки; радиус и цвет тоже случайные, но повторяются от запуска к запуску
+void DirectXApp::BuildPointLights()
+{
+    Aabb sceneBounds;
+    for (const auto& sm : mSubmeshes)
+    {
+        sceneBounds.Extend(sm.Bounds.Min[0], sm.Bounds.Min[1], sm.Bounds.Min[2]);
+        sceneBounds.Extend(sm.Bounds.Max[0], sm.Bounds.Max[1], sm.Bounds.Max[2]);
+    }
+
+    if (sceneBounds.IsEmpty())
+        return;
+
+    float size[3];
+    for (int k = 0; k < 3; k++)
+        size[k] = sceneBounds.Max[k] - sceneBounds.Min[k];
+    float extent = (std::max)(size[0], size[2]);
+
+    std::mt19937 random(LightSeed);
+    auto uniform = [&random](float a, float b) { return std::uniform_real_distribution<float>(a, b)(random); };
+
+    mPointLights.resize(LightCount);
+    mLightOrbits.resize(LightCount);
+    for (UINT i = 0; i < LightCount; i++)
+    {
+        LightOrbit& orbit = mLightOrbits[i];
+        orbit.Center[0] = uniform(sceneBounds.Min[0], sceneBounds.Max[0]);
+        orbit.Center[1] = sceneBounds.Min[1] + uniform(0.05f, 0.5f) * size[1];
+        orbit.Center[2] = uniform(sceneBounds.Min[2], sceneBounds.Max[2]);
+        orbit.Radius = uniform(0.01f, 0.04f) * extent;
+        orbit.Speed = uniform(-1.5f, 1.5f);
+        orbit.Phase = uniform(0.0f, 2.0f * XM_PI);
+
+        // Насыщенный цвет: одна компонента полная, остальные случайные
+        PointLight& light = mPointLights[i];
+        for (int k = 0; k < 3; k++)
+            light.Color[k] = uniform(0.0f, 1.0f);
+        light.Color[i % 3] = 1.0f;
+        light.Radius = uniform(0.04f, 0.1f) * extent;
+        light.Intensity = uniform(0.8f, 1.5f);
+    }
+}
+
+void DirectXApp::UpdateLights(float totalTime, float fovY)
+{
+    for (size_t i = 0; i < mPointLights.size(); i++)
+    {
+        const LightOrbit& orbit = mLightOrbits[i];
+        float angle = orbit.Phase + orbit.Speed * totalTime;
+        mPointLights[i].Position[0] = orbit.Center[0] + orbit.Radius * cosf(angle);
+        mPointLights[i].Position[1] = orbit.Center[1];
+        mPointLights[i].Position[2] = orbit.Center[2] + orbit.Radius * sinf(angle);
+    }
+
+    // Сетка следует за проекцией из Update; боксы кластеров пересчитываются только при её смене
+    ClusterGridDesc grid;
+    grid.TanHalfFovY = tanf(0.5f * fovY);
+    grid.TanHalfFovX = grid.TanHalfFovY * (float)mClientWidth / (float)mClientHeight;
+    grid.Near = ClusterNear;
+    grid.Far = MaxSortDistance;
+    mClusteredLights.SetGrid(grid);
+
+    mClusteredLights.Build(mView.m, mPointLights.data(), mLighting ? mPointLights.size() : 0);
+
+    mFrameConstants.mClusterTile = XMFLOAT4(
+        (float)grid.CountX / (float)mClientWidth,
+        (float)grid.CountY / (float)mClientHeight,
+        mClusteredLights.ZScale(),
+        mClusteredLights.ZBias());
+    mFrameConstants.mClusterGrid = XMFLOAT4(
+        (float)grid.CountX, (float)grid.CountY, (float)grid.CountZ, mLighting ? LightAmbient : 1.0f);
+}
+
+// Три куска upload-кольца на кадр. Пустой массив всё равно получает адрес:
+// root SRV привязан всегда, а читается не дальше числа в диапазоне кластера
+void DirectXApp::WriteLightClusters()
+{
+    auto write = [this](const void* data, size_t bytes)
+    {
+        UploadAllocation upload = AllocateUpload((std::max)((UINT64)bytes, (UINT64)16), 16);
+        if (bytes > 0)
+            memcpy(upload.Mapped, data, bytes);
+        return upload.Resource->GetGPUVirtualAddress() + upload.Offset;
+    };
+
+    const std::vector<ClusterLight>& lights = mClusteredLights.Lights();
+    const std::vector<uint32_t>& ranges = mClusteredLights.Ranges();
+    const std::vector<uint32_t>& indices = mClusteredLights.Indices();
+
+    mLightBuffers[0] = write(lights.data(), lights.size() * sizeof(ClusterLight));
+    mLightBuffers[1] = write(ranges.data(), ranges.size() * sizeof(uint32_t));
+    mLightBuffers[2] = write(indices.data(), indices.size() * sizeof(uint32_t));
+}
+
+// Луч из камеры через пиксель (x, y); запоминает сабмеш, в который он попал
+void DirectXApp::PickSubmesh(int x, int y)
+{
+    float ndcX = 2.0f * x / mClientWidth - 1.0f;
+    float ndcY = 1.0f - 2.0f * y / mClientHeight;
+
+    XMMATRIX invViewProj = XMMatrixInverse(nullptr, XMLoadFloat4x4(&mViewProj));
+    XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 0.0f, 1.0f), invViewProj);
+    XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), invViewProj);
+    XMVECTOR dir = XMVector3Normalize(farPoint - nearPoint);
+
+    Ray ray;
+    XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(ray.Origin), nearPoint);
+    XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(ray.Dir), dir);
+
+    RayHit hit = mSceneBvh.Intersect(ray);
+
+    mPickedSubmesh = -1;
+    if (!hit.IsHit())
+        return;
+
+    uint32_t index = hit.Triangle * 3;
+    for (size_t i = 0; i < mSubmeshes.size(); i++)
+    {
+        if (index >= mSubmeshes[i].IndexStart && index < mSubmeshes[i].IndexStart + mSubmeshes[i].IndexCount)
+        {
+            mPickedSubmesh = (int)i;
+            break;
+        }
+    }
+}
+
+// Сфера камеры не проходит сквозь геометрию: длинный шаг обрезается лучом,
+// затем сфера выталкивается из треугольников и скользит вдоль стен
+XMVECTOR DirectXApp::CollideCamera(FXMVECTOR from, FXMVECTOR to) const
+{
+    XMVECTOR pos = to;
+    XMVECTOR delta = to - from;
+    float length = XMVectorGetX(XMVector3Length(delta));
+
+    if (length > CameraRadius)
+    {
+        Ray ray;
+        XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(ray.Origin), from);
+        XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(ray.Dir), delta / length);
+        ray.MaxT = length + CameraRadius;
+
+        RayHit hit = mSceneBvh.Intersect(ray);
+        if (hit.IsHit())
+            pos = from + delta * ((std::max)(hit.T - CameraRadius, 0.0f) / length);
+    }
+
+    XMFLOAT3 center;
+    XMStoreFloat3(&center, pos);
+    mSceneBvh.ResolveSphere(&center.x, CameraRadius, 4);
+
+    return XMLoadFloat3(&center);
+}
+
+// Ждём GPU, только если он ещё не закончил кадр, который последним писал в этот слот
+void DirectXApp::BeginFrame()
+{
+    UINT64 waitValue = mFrameScheduler.BeginFrame(mFence->GetCompletedValue());
+    if (waitValue != 0)
+    {
+        auto start = std::chrono::steady_clock::now();
+        WaitForFence(waitValue);
+        mFrameWaitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    UINT64 completedValue = mFence->GetCompletedValue();
+    mUploadRing.Reclaim(completedValue);
+    mSrvAllocator.Reclaim(completedValue);
+    mRetiredResources.Collect(completedValue);
+    mRetiredAllocations.Collect(completedValue, [this](const GpuAllocation& allocation)
+    {
+        FreeGpuAllocation(allocation);
+    });
+
+    // Readback слота GPU уже записал - запросы тайлов кадра, что в нём копировался
+    ReadVirtualTextureFeedback(mFrameScheduler.CurrentSlot());
+}
+
+// SRV материала из таблицы текущего кадра
+D3D12_GPU_DESCRIPTOR_HANDLE DirectXApp::FrameDescriptor(UINT index) const
+{
+    D3D12_GPU_DESCRIPTOR_HANDLE handle = mCbvHeap->GetGPUDescriptorHandleForHeapStart();
+    handle.ptr += (UINT64)(mFrameSrvBase + index) * mCbvSrvUavDescriptorSize;
+    return handle;
+}
+
+// Один 256-байтный слот ObjectConstants на каждую отрисовку. Слоты идут подряд
+// в кольцевом upload-буфере и освобождаются вместе с кадром по fence.
+D3D12_GPU_VIRTUAL_ADDRESS DirectXApp::WriteDrawConstants()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    UINT cbStride = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+    UINT drawCount = (UINT)mRenderQueue.Size();
+    UploadAllocation upload = AllocateUpload((UINT64)cbStride * max(drawCount, 1u), UploadConstantAlignment);
+
+    XMMATRIX viewProj = XMLoadFloat4x4(&mViewProj);
+    XMMATRIX view = XMLoadFloat4x4(&mView);
+    XMMATRIX world = XMLoadFloat4x4(&mWorld);
+    ObjectConstants constants = mFrameConstants;
+    constants.mLightmap.y = mLightmapRange;
+
+    // У инстансированных отрисовок мир берётся из буфера экземпляров, в b0 - только ViewProj и View
+    XMFLOAT4X4 worldViewProj;
+    XMFLOAT4X4 viewProjOnly;
+    XMFLOAT4X4 worldView;
+    XMFLOAT4X4 viewOnly;
+    XMStoreFloat4x4(&worldViewProj, XMMatrixTranspose(world * viewProj));
+    XMStoreFloat4x4(&viewProjOnly, XMMatrixTranspose(viewProj));
+    XMStoreFloat4x4(&worldView, XMMatrixTranspose(world * view));
+    XMStoreFloat4x4(&viewOnly, XMMatrixTranspose(view));
+
+    const std::vector<RenderItem>& items = mRenderQueue.Items();
+    for (UINT i = 0; i < drawCount; i++)
+    {
+        constants.mWorldViewProj = items[i].InstanceCount > 0 ? viewProjOnly : worldViewProj;
+        constants.mWorldView = items[i].InstanceCount > 0 ? viewOnly : worldView;
+
+        // Цвета вместо отсутствующих карт (перестановки без HAS_MAP1/HAS_MAP2)
+        int material = mSubmeshes[items[i].DrawIndex].MaterialIndex;
+        if (material >= 0)
+        {
+            const Material& mat = mMaterials[material];
+            constants.mColor1 = XMFLOAT4(mat.Color1[0], mat.Color1[1], mat.Color1[2], 1.0f);
+            constants.mColor2 = XMFLOAT4(mat.Color2[0], mat.Color2[1], mat.Color2[2], 1.0f);
+            constants.mBlendFactor.y = mat.AlphaCutoff;
+        }
+
+        // Лайтмап запечён для сцены на своём месте - размноженные экземпляры его не читают
+        constants.mLightmap.x = mLightmaps && mLightmapTexture && items[i].InstanceCount == 0 ? 1.0f : 0.0f;
+
+        memcpy(upload.Mapped + (size_t)i * cbStride, &constants, sizeof(ObjectConstants));
+    }
+
+    mConstantFillUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    mConstantFillDraws += drawCount;
+
+    return upload.Resource->GetGPUVirtualAddress() + upload.Offset;
+}
+
+// Кусок отсортированной очереди в свой командный список. Состояние списка
+// с нуля, поэтому первые PSO и SRV-таблица куска привязываются всегда.
+void DirectXApp::RecordDrawSlice(uint32_t slice, const DrawSlice& range, D3D12_GPU_VIRTUAL_ADDRESS cbAddress)
+{
+    FrameResource& frame = mFrames[mFrameScheduler.CurrentSlot()];
+    ID3D12CommandAllocator* alloc = frame.SliceAllocs[slice].Get();
+    ID3D12GraphicsCommandList* cmdList = mSliceLists[slice].Get();
+
+    alloc->Reset();
+
+    // PSO зависит от перестановки материала - его ставит первая отрисовка куска
+    uint32_t currentPso = UINT32_MAX;
+    cmdList->Reset(alloc, nullptr);
+
+    SliceBinds& binds = mSliceBinds[slice];
+    binds.Psos = 0;
+    binds.Tables = 0;
+
+    auto rtvHandle = CurrentBackBufferView();
+    auto dsvHandle = mDsvHeap->GetCPUDescriptorHandleForHeapStart();
+
+    SetViewportAndScissor(cmdList);
+    cmdList->OMSetRenderTargets(1, &rtvHandle, true, &dsvHandle);
+    cmdList->SetGraphicsRootSignature(mRootSignature.Get());
+
+    ID3D12DescriptorHeap* heaps[] = { mCbvHeap.Get() };
+    cmdList->SetDescriptorHeaps(1, heaps);
+
+    // Кластеры источников общие для всех отрисовок кадра
+    for (UINT i = 0; i < 3; i++)
+        cmdList->SetGraphicsRootShaderResourceView(3 + i, mLightBuffers[i]);
+    cmdList->SetGraphicsRootDescriptorTable(6, FrameDescriptor(mLightmapSrv));
+    if (mVtMaterial >= 0)
+    {
+        cmdList->SetGraphicsRootDescriptorTable(7, FrameDescriptor(mVtSrv));
+        cmdList->SetGraphicsRootUnorderedAccessView(8, mVtFeedback->GetGPUVirtualAddress());
+    }
+
+    cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+    // Очередь отсортирована по состоянию - повторные привязки PSO и SRV пропускаются
+    UINT cbStride = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+    UINT currentTable = UINT_MAX;
+    uint32_t currentSector = UINT32_MAX;
+    const std::vector<RenderItem>& items = mRenderQueue.Items();
+
+    for (size_t i = range.Begin; i < range.End; i++)
+    {
+        const RenderItem& item = items[i];
+        const Submesh& sm = mSubmeshes[item.DrawIndex];
+        const SectorGeometry& geometry = mSectorGeometry[sm.Sector];
+
+        if (sm.MaterialIndex < 0 || !geometry.IndexBuffer)
+            continue;
+
+        const Material& mat = mMaterials[sm.MaterialIndex];
+
+        // У каждого сектора свои вершины и индексы: привязка при смене сектора
+        if (sm.Sector != currentSector)
+        {
+            cmdList->IASetVertexBuffers(0, 1, &geometry.VertexView);
+            cmdList->IASetIndexBuffer(&geometry.IndexView);
+            currentSector = sm.Sector;
+        }
+
+        uint32_t pso = DrawKeyPso(item.Key);
+        if (pso != currentPso)
+        {
+            cmdList->SetPipelineState(PipelineState(pso));
+            currentPso = pso;
+            binds.Psos++;
+        }
+
+        // Без карт перестановка не читает t0/t1 - таблица не нужна
+        bool usesTable = (mat.Features & (MaterialFeatureMap1 | MaterialFeatureMap2)) != 0;
+        if (usesTable && mat.SrvHeapIndex1 != currentTable)
+        {
+            cmdList->SetGraphicsRootDescriptorTable(1, FrameDescriptor(mat.SrvHeapIndex1));
+            currentTable = mat.SrvHeapIndex1;
+            binds.Tables++;
+        }
+
+        // Свой слот констант у каждой отрисовки (b0), по номеру в очереди
+        cmdList->SetGraphicsRootConstantBufferView(0, cbAddress + (UINT64)i * cbStride);
+
+        // Инстансированная: root SRV указывает на первый экземпляр диапазона
+        if (item.InstanceCount > 0)
+        {
+            cmdList->SetGraphicsRootShaderResourceView(
+                2,
+                mInstanceBuffer->GetGPUVirtualAddress() + (UINT64)item.FirstInstance * sizeof(InstanceData));
+        }
+
+        cmdList->DrawIndexedInstanced(
+            sm.IndexCount,
+            (std::max)(item.InstanceCount, 1u),
+            sm.SectorIndexStart,
+            0,
+            0);
+    }
+
+    // === PRESENT ===
+    // Последний кусок выполняется последним: конечные переходы графа здесь
+    if (range.End == mRenderQueue.Size())
+    {
+        const std::vector<FrameGraphBarrier>& finalBarriers = mFrameGraph.FinalBarriers();
+        RecordGraphBarriers(cmdList, finalBarriers.data(), finalBarriers.size());
+    }
+
+    cmdList->Close();
+}
+
+// Постоянные SRV переписываются сразу после смены ресурса (GPU их не читает),
+// затем занятая часть одним копированием уходит в кольцо - кадры в полёте
+// продолжают читать свои копии
+void DirectXApp::SyncFrameSrvs()
+{
+    for (auto& m : mMaterials)
+    {
+        if (mSrvTextures[m.SrvHeapIndex1] != m.DiffuseTexture1)
+        {
+            CreateTextureSrv(m.DiffuseTexture1.Get(), m.SrvHeapIndex1);
+            mSrvTextures[m.SrvHeapIndex1] = m.DiffuseTexture1;
+        }
+        if (mSrvTextures[m.SrvHeapIndex2] != m.DiffuseTexture2)
+        {
+            CreateTextureSrv(m.DiffuseTexture2.Get(), m.SrvHeapIndex2);
+            mSrvTextures[m.SrvHeapIndex2] = m.DiffuseTexture2;
+        }
+    }
+
+    if (mLightmapTexture && mSrvTextures[mLightmapSrv] != mLightmapTexture)
+    {
+        CreateTextureSrv(mLightmapTexture.Get(), mLightmapSrv);
+        mSrvTextures[mLightmapSrv] = mLightmapTexture;
+    }
+
+    if (mVtCache && mSrvTextures[mVtSrv] != mVtCache)
+    {
+        CreateTextureSrv(mVtCache.Get(), mVtSrv);
+        CreateTextureSrv(mVtPageTable.Get(), mVtSrv + 1);
+        mSrvTextures[mVtSrv] = mVtCache;
+        mSrvTextures[mVtSrv + 1] = mVtPageTable;
+    }
+
+    UINT count = mSrvAllocator.PersistentHighWater();
+    if (count == 0)
+        return;
+
+    UINT base = mSrvAllocator.AllocateTransient(count);
+    if (base == DescriptorAllocator::InvalidOffset)
+    {
+        WaitForFence(mFrameScheduler.LastSignaled());
+        mSrvAllocator.Reclaim(mFrameScheduler.LastSignaled());
+        base = mSrvAllocator.AllocateTransient(count);
+    }
+    mFrameSrvBase = base;
+
+    D3D12_CPU_DESCRIPTOR_HANDLE dest = mCbvHeap->GetCPUDescriptorHandleForHeapStart();
+    dest.ptr += (SIZE_T)base * mCbvSrvUavDescriptorSize;
+
+    device->CopyDescriptorsSimple(
+        count,
+        dest,
+        mSrvStagingHeap->GetCPUDescriptorHandleForHeapStart(),
+        D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+}
+
+void DirectXApp::Draw(const Timer& gt)
+{
+    if (mIndexCount == 0)
+        return;
+
+    // Слот свободен: BeginFrame дождался GPU
+    FrameResource& frame = mFrames[mFrameScheduler.CurrentSlot()];
+    frame.CmdListAlloc->Reset();
+
+    // Первый список: стриминг и очистка, отрисовки пишут списки кусков
+    mCommandList->Reset(frame.CmdListAlloc.Get(), nullptr);
+
+    // Ресурсы и кучи - до первой записи в кольцо: рост кучи сбрасывает очередь
+    PrepareTextureStreaming();
+    PrepareSectorStreaming();
+    PrepareVirtualTexture();
+    BuildFrameGraph();
+    RealizeGraphTargets();
+
+    mFrameGraph.Execute([this](const FrameGraphBarrier* barriers, size_t count)
+    {
+        RecordGraphBarriers(mCommandList.Get(), barriers, count);
+    });
+
+    auto submitStart = std::chrono::steady_clock::now();
+
+    mTableBinds = 0;
+    mPsoBinds = 0;
+
+    ID3D12CommandList* cmdLists[RecordListCount + 1] = { mCommandList.Get() };
+    for (size_t s = 0; s < mDrawSlices.size(); s++)
+    {
+        cmdLists[s + 1] = mSliceLists[s].Get();
+        mTableBinds += mSliceBinds[s].Tables;
+        mPsoBinds += mSliceBinds[s].Psos;
+    }
+
+    mCommandQueue->ExecuteCommandLists((UINT)mDrawSlices.size() + 1, cmdLists);
+
+    mSubmitUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - submitStart).count();
+
+    mSwapChain->Present(0, 0);
+    mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
+
+    // Без ожидания: CPU ждёт только в BeginFrame, когда снова дойдёт до этого слота
+    UINT64 fenceValue = mFrameScheduler.EndFrame();
+    mUploadRing.FinishFrame(fenceValue);
+    mSrvAllocator.FinishFrame(fenceValue);
+    mCommandQueue->Signal(mFence.Get(), fenceValue);
+}
+
+// =========== GPU Memory ===========
+// Текстуры сначала пробуют малое выравнивание (4 КБ) - 1x1 и мелкие мипы не
+// занимают по 64 КБ. Место ищется в кучах своего вида по порядку создания.
+DirectXApp::GpuAllocation DirectXApp::PlaceResource(
+    UINT kind,
+    D3D12_RESOURCE_DESC desc,
+    D3D12_RESOURCE_STATES initialState,
+    ComPtr<ID3D12Resource>& resource)
+{
+    D3D12_RESOURCE_ALLOCATION_INFO info = {};
+    if (kind == GpuHeapTextures)
+    {
+        desc.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+        info = device->GetResourceAllocationInfo(0, 1, &desc);
+        if (info.Alignment != D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT)
+        {
+            desc.Alignment = 0;
+            info = device->GetResourceAllocationInfo(0, 1, &desc);
+        }
+    }
+    else
+    {
+        info = device->GetResourceAllocationInfo(0, 1, &desc);
+    }
+
+    GpuAllocation allocation;
+    for (UINT h = 0; h < (UINT)mGpuHeaps.size(); h++)
+    {
+        if (mGpuHeaps[h].Kind != kind)
+            continue;
+
+        allocation.Range = mGpuHeaps[h].Allocator.Allocate(info.SizeInBytes, info.Alignment);
+        if (allocation.Range.Valid())
+        {
+            allocation.Heap = h;
+            break;
+        }
+    }
+
+    if (!allocation.Range.Valid())
+    {
+        const UINT64 heapAlignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+        D3D12_HEAP_DESC heapDesc = {};
+        heapDesc.SizeInBytes = (std::max)(GpuHeapBytes, (info.SizeInBytes + heapAlignment - 1) / heapAlignment * heapAlignment);
+        heapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+        heapDesc.Alignment = heapAlignment;
+        heapDesc.Flags = kind == GpuHeapBuffers
+            ? D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS
+            : D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+
+        GpuHeap heap{ nullptr, TlsfAllocator(heapDesc.SizeInBytes, D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT), kind };
+        ThrowIfFailed(device->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap.Heap)));
+        mGpuHeaps.push_back(std::move(heap));
+
+        allocation.Heap = (UINT)mGpuHeaps.size() - 1;
+        allocation.Range = mGpuHeaps.back().Allocator.Allocate(info.SizeInBytes, info.Alignment);
+
+        std::string msg = std::string("GPU heap ") + (kind == GpuHeapBuffers ? "(buffers)" : "(textures)") + ": " +
+            std::to_string(heapDesc.SizeInBytes >> 20) + " MB, total " + std::to_string(mGpuHeaps.size()) + " heaps\n";
+        OutputDebugStringA(msg.c_str());
+    }
+
+    ThrowIfFailed(device->CreatePlacedResource(
+        mGpuHeaps[allocation.Heap].Heap.Get(),
+        allocation.Range.Offset,
+        &desc,
+        initialState,
+        nullptr,
+        IID_PPV_ARGS(&resource)));
+
+    return allocation;
+}
+
+// Пустые кучи не отдаются: следующая волна стриминга займёт их снова
+void DirectXApp::FreeGpuAllocation(const GpuAllocation& allocation)
+{
+    if (allocation.Heap < mGpuHeaps.size())
+        mGpuHeaps[allocation.Heap].Allocator.Free(allocation.Range);
+}
+
+TlsfStats DirectXApp::GpuMemoryStats() const
+{
+    TlsfStats total;
+    for (const GpuHeap& heap : mGpuHeaps)
+    {
+        TlsfStats s = heap.Allocator.Stats();
+        total.Capacity += s.Capacity;
+        total.UsedBytes += s.UsedBytes;
+        total.FreeBytes += s.FreeBytes;
+        total.LargestFreeBlock = (std::max)(total.LargestFreeBlock, s.LargestFreeBlock);
+        total.Allocations += s.Allocations;
+        total.FreeBlocks += s.FreeBlocks;
+        total.Failures += s.Failures;
+    }
+    return total;
+}
+
+// =========== Frame Graph ===========
+// Кадр: стриминг (копии мипов и секторов, SRV) -> очистка -> сцена. Back buffer
+// импортирован, глубина - временная цель в куче графа; новые ресурсы стриминга идут из COPY_DEST в SRV
+// (буферы секторов - в VB/IB) одной пачкой перед сценой, старые - в источник
+// копий перед стримингом.
+void DirectXApp::BuildFrameGraph()
+{
+    mFrameGraph.Reset();
+    mGraphResources.clear();
+    mGraphDescs.clear();
+
+    FrameGraphResource backBuffer = ImportGraphResource(
+        "BackBuffer", CurrentBackBuffer(), FrameGraphState::Present, FrameGraphState::Present);
+    // Глубина нужна только внутри кадра (очистка -> сцена) - временная цель графа,
+    // её DSV пишет RealizeGraphTargets
+    D3D12_RESOURCE_DESC depthDesc = {};
+    depthDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    depthDesc.Width = mClientWidth;
+    depthDesc.Height = mClientHeight;
+    depthDesc.DepthOrArraySize = 1;
+    depthDesc.MipLevels = 1;
+    depthDesc.Format = mDepthStencilFormat;
+    depthDesc.SampleDesc.Count = 1;
+    depthDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+
+    D3D12_CLEAR_VALUE depthClear = {};
+    depthClear.Format = mDepthStencilFormat;
+    depthClear.DepthStencil.Depth = 1.0f;
+
+    FrameGraphResource depth = CreateGraphTarget("Depth", depthDesc, DepthStencilView(), depthClear);
+
+    FrameGraphPass streaming = mFrameGraph.AddPass("Streaming", [this]
+    {
+        RecordTextureStreaming();
+        RecordSectorUploads(mCommandList.Get());
+        RecordVirtualTextureUploads(mCommandList.Get());
+        SyncFrameSrvs();
+    }, true);
+
+    std::vector<FrameGraphResource> streamed;
+    for (size_t i = 0; i < mMipChanges.size(); i++)
+    {
+        const StreamedTexture& st = mStreamedTextures[mMipChanges[i].Texture];
+        std::string name = "Texture " + std::to_string(mMipChanges[i].Texture);
+
+        if (st.Resource)
+        {
+            FrameGraphResource old = ImportGraphResource(
+                name + " (old)", st.Resource.Get(), FrameGraphState::ShaderRead);
+            mFrameGraph.Read(streaming, old, FrameGraphState::CopySource);
+        }
+
+        FrameGraphResource texture = ImportGraphResource(
+            name, mMipTargets[i].Texture.Get(), FrameGraphState::CopyDest, FrameGraphState::ShaderRead);
+        mFrameGraph.Write(streaming, texture, FrameGraphState::CopyDest);
+        streamed.push_back(texture);
+    }
+
+    std::vector<FrameGraphResource> sectorBuffers;
+    for (const SectorArrival& arrival : mSectorArrivals)
+    {
+        const SectorGeometry& geometry = mSectorGeometry[arrival.Sector];
+        std::string name = "Sector " + std::to_string(arrival.Sector);
+
+        FrameGraphResource vertices = ImportGraphResource(
+            name + " VB", geometry.VertexBuffer.Get(), FrameGraphState::CopyDest, FrameGraphState::VertexBuffer);
+        FrameGraphResource indices = ImportGraphResource(
+            name + " IB", geometry.IndexBuffer.Get(), FrameGraphState::CopyDest, FrameGraphState::IndexBuffer);
+        mFrameGraph.Write(streaming, vertices, FrameGraphState::CopyDest);
+        mFrameGraph.Write(streaming, indices, FrameGraphState::CopyDest);
+        sectorBuffers.push_back(vertices);
+        sectorBuffers.push_back(indices);
+    }
+
+    // Виртуальная текстура: проход стриминга копирует обратную связь прошлого
+    // кадра в readback (или обнуляет буфер в первом кадре) и заливает тайлы и
+    // таблицу страниц, сцена пишет обратную связь этого кадра
+    FrameGraphResource vtFeedback = FrameGraph::Invalid;
+    FrameGraphResource vtCache = FrameGraph::Invalid;
+    FrameGraphResource vtPageTable = FrameGraph::Invalid;
+    if (mVtMaterial >= 0)
+    {
+        FrameGraphState feedbackState = mVtFeedbackReady ? FrameGraphState::UnorderedAccess : FrameGraphState::CopyDest;
+        vtFeedback = ImportGraphResource(
+            "VT Feedback", mVtFeedback.Get(), feedbackState, FrameGraphState::UnorderedAccess);
+        if (mVtFeedbackReady)
+            mFrameGraph.Read(streaming, vtFeedback, FrameGraphState::CopySource);
+        else
+            mFrameGraph.Write(streaming, vtFeedback, FrameGraphState::CopyDest);
+
+        if (!mVtUploads.empty())
+        {
+            vtCache = ImportGraphResource(
+                "VT Cache", mVtCache.Get(), FrameGraphState::ShaderRead, FrameGraphState::ShaderRead);
+            mFrameGraph.Write(streaming, vtCache, FrameGraphState::CopyDest);
+        }
+        if (mVirtualTextures.IsPageTableDirty(mVtTexture))
+        {
+            vtPageTable = ImportGraphResource(
+                "VT Page Table", mVtPageTable.Get(), FrameGraphState::ShaderRead, FrameGraphState::ShaderRead);
+            mFrameGraph.Write(streaming, vtPageTable, FrameGraphState::CopyDest);
+        }
+    }
+
+    FrameGraphPass clear = mFrameGraph.AddPass("Clear", [this] { RecordClearPass(); });
+    mFrameGraph.Write(clear, backBuffer, FrameGraphState::RenderTarget);
+    mFrameGraph.Write(clear, depth, FrameGraphState::DepthWrite);
+
+    FrameGraphPass scene = mFrameGraph.AddPass("Scene", [this] { RecordScenePass(); });
+    mFrameGraph.Write(scene, backBuffer, FrameGraphState::RenderTarget);
+    mFrameGraph.Write(scene, depth, FrameGraphState::DepthWrite);
+    for (FrameGraphResource texture : streamed)
+    {
+        mFrameGraph.Read(scene, texture, FrameGraphState::ShaderRead);
+    }
+    for (size_t i = 0; i < sectorBuffers.size(); i += 2)
+    {
+        mFrameGraph.Read(scene, sectorBuffers[i], FrameGraphState::VertexBuffer);
+        mFrameGraph.Read(scene, sectorBuffers[i + 1], FrameGraphState::IndexBuffer);
+    }
+    if (vtFeedback != FrameGraph::Invalid)
+        mFrameGraph.Write(scene, vtFeedback, FrameGraphState::UnorderedAccess);
+    if (vtCache != FrameGraph::Invalid)
+        mFrameGraph.Read(scene, vtCache, FrameGraphState::ShaderRead);
+    if (vtPageTable != FrameGraph::Invalid)
+        mFrameGraph.Read(scene, vtPageTable, FrameGraphState::ShaderRead);
+
+    mFrameGraph.Compile();
+}
+
+FrameGraphResource DirectXApp::ImportGraphResource(
+    const std::string& name,
+    ID3D12Resource* resource,
+    FrameGraphState initial,
+    FrameGraphState finalState)
+{
+    mGraphResources.push_back(resource);
+    mGraphDescs.push_back({});
+    return mFrameGraph.Import(name, initial, finalState);
+}
+
+FrameGraphResource DirectXApp::CreateGraphTarget(
+    const std::string& name,
+    const D3D12_RESOURCE_DESC& desc,
+    D3D12_CPU_DESCRIPTOR_HANDLE view,
+    const D3D12_CLEAR_VALUE& clear)
+{
+    D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo(0, 1, &desc);
+
+    mGraphResources.push_back(nullptr);
+    mGraphDescs.push_back({ desc, view, clear });
+    return mFrameGraph.CreateTransient(name, info.SizeInBytes, info.Alignment);
+}
+
+// Куча только растёт (со сбросом очереди - старую может читать GPU). Ресурс цели
+// живёт, пока у неё те же смещение, описание и домашнее состояние; иначе старый
+// уходит в mRetiredResources.
+void DirectXApp::RealizeGraphTargets()
+{
+    UINT64 heapSize = mFrameGraph.HeapSize();
+    if (heapSize == 0)
+        return;
+
+    if (heapSize > mTransientHeapSize)
+    {
+        FlushCommandQueue();
+        mGraphTargets.clear();
+        mTransientHeap.Reset();
+
+        D3D12_HEAP_DESC heapDesc = {};
+        heapDesc.SizeInBytes = heapSize;
+        heapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+        heapDesc.Alignment = mFrameGraph.HeapAlignment() > D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT
+            ? D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT
+            : D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+        heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+
+        ThrowIfFailed(device->CreateHeap(&heapDesc, IID_PPV_ARGS(&mTransientHeap)));
+        mTransientHeapSize = heapSize;
+    }
+
+    for (FrameGraphResource r = 0; r < (FrameGraphResource)mFrameGraph.ResourceCount(); r++)
+    {
+        if (!mFrameGraph.IsTransient(r) || mFrameGraph.TransientOffset(r) == FrameGraph::Invalid)
+            continue;
+
+        const D3D12_RESOURCE_DESC& desc = mGraphDescs[r].Desc;
+        const std::string& name = mFrameGraph.ResourceName(r);
+        UINT64 offset = mFrameGraph.TransientOffset(r);
+        FrameGraphState home = mFrameGraph.HomeState(r);
+
+        auto it = std::find_if(mGraphTargets.begin(), mGraphTargets.end(), [&name](const GraphTarget& t)
+        {
+            return t.Name == name;
+        });
+        if (it == mGraphTargets.end())
+        {
+            mGraphTargets.push_back({ name });
+            it = mGraphTargets.end() - 1;
+        }
+
+        bool same = it->Resource && it->Offset == offset && it->Home == home &&
+            it->Desc.Dimension == desc.Dimension && it->Desc.Width == desc.Width &&
+            it->Desc.Height == desc.Height && it->Desc.DepthOrArraySize == desc.DepthOrArraySize &&
+            it->Desc.MipLevels == desc.MipLevels && it->Desc.Format == desc.Format &&
+            it->Desc.SampleDesc.Count == desc.SampleDesc.Count && it->Desc.Flags == desc.Flags;
+
+        if (!same)
+        {
+            if (it->Resource)
+                mRetiredResources.Retire(it->Resource, mFrameScheduler.PendingFenceValue());
+
+            it->Resource.Reset();
+            ThrowIfFailed(device->CreatePlacedResource(
+                mTransientHeap.Get(),
+                offset,
+                &desc,
+                ToD3DState(home),
+                &mGraphDescs[r].Clear,
+                IID_PPV_ARGS(&it->Resource)));
+
+            if (desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)
+                device->CreateDepthStencilView(it->Resource.Get(), nullptr, mGraphDescs[r].View);
+            else if (desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET)
+                device->CreateRenderTargetView(it->Resource.Get(), nullptr, mGraphDescs[r].View);
+
+            it->Offset = offset;
+            it->Desc = desc;
+            it->Home = home;
+        }
+
+        mGraphResources[r] = it->Resource.Get();
+    }
+}
+
+void DirectXApp::RecordGraphBarriers(
+    ID3D12GraphicsCommandList* cmdList,
+    const FrameGraphBarrier* barriers,
+    size_t count) const
+{
+    if (count == 0)
+        return;
+
+    std::vector<D3D12_RESOURCE_BARRIER> d3dBarriers(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const FrameGraphBarrier& b = barriers[i];
+
+        if (b.Type == FrameGraphBarrier::Kind::Aliasing)
+        {
+            d3dBarriers[i] = {};
+            d3dBarriers[i].Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+            d3dBarriers[i].Aliasing.pResourceBefore = b.Before == FrameGraph::Invalid ? nullptr : mGraphResources[b.Before];
+            d3dBarriers[i].Aliasing.pResourceAfter = mGraphResources[b.Resource];
+        }
+        else
+        {
+            d3dBarriers[i] = CD3DX12_RESOURCE_BARRIER_HELPER::Transition(
+                mGraphResources[b.Resource],
+                ToD3DState(b.From),
+                ToD3DState(b.To));
+        }
+    }
+
+    cmdList->ResourceBarrier((UINT)count, d3dBarriers.data());
+}
+
+void DirectXApp::RecordClearPass()
+{
+    const float clearColor[] = { 0.53f, 0.81f, 0.98f, 1.0f };
+
+    auto rtvHandle = CurrentBackBufferView();
+    auto dsvHandle = mDsvHeap->GetCPUDescriptorHandleForHeapStart();
+
+    mCommandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
+    mCommandList->ClearDepthStencilView(
+        dsvHandle,
+        D3D12_CLEAR_FLAG_DEPTH,
+        1.0f,
+        0,
+        0,
+        nullptr);
+}
+
+// Первый список закрывается здесь: дальше отрисовки пишутся параллельно в списки
+// кусков, последний из них ставит конечные барьеры графа
+void DirectXApp::RecordScenePass()
+{
+    mCommandList->Close();
+
+    auto submitStart = std::chrono::steady_clock::now();
+
+    // Константы всех отрисовок кадра пишутся одним линейным проходом
+    WriteLightClusters();
+    D3D12_GPU_VIRTUAL_ADDRESS cbAddress = WriteDrawConstants();
+
+    SplitDraws(mRenderQueue.Size(), (std::min)(mRecorder.MaxSlices(), RecordListCount), MinDrawsPerSlice, mDrawSlices);
+    mRecorder.Record(mDrawSlices, [this, cbAddress](uint32_t slice, const DrawSlice& range)
+    {
+        RecordDrawSlice(slice, range, cbAddress);
+    });
+
+    mSubmitUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - submitStart).count();
+}
+
+int DirectXApp::CreateMaterialTexture(
+    const std::string& path,
+    Microsoft::WRL::ComPtr<ID3D12Resource>& texture)
+{
+    auto start = std::chrono::steady_clock::now();
+    uint64_t bytesBefore = mTextureBytesTouched;
+
+    // Если рядом с .tga лежит .dds - берём готовые сжатие и мипы
+    std::string ddsPath = path.substr(0, path.find_last_of('.')) + ".dds";
+    int id = std::filesystem::exists(ddsPath)
+        ? CreateTextureFromDDS(ddsPath, texture)
+        : CreateTextureFromTGA(path, texture);
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::string msg = "Texture " + path + ": " +
+        std::to_string((mTextureBytesTouched - bytesBefore) / 1024) + " KB touched, " +
+        std::to_string(ms) + " ms\n";
+    OutputDebugStringA(msg.c_str());
+
+    return id;
+}
+
+int DirectXApp::CreateTextureFromTGA(
+    const std::string& path,
+    Microsoft::WRL::ComPtr<ID3D12Resource>& texture)
+{
+    // Несжатый TGA не копируется: нулевой мип при стриминге пишется из отображённого
+    // файла прямо в upload-буфер, первый мип строится из него же. Остальные форматы
+    // идут старым путём через TgaImage.
+    StreamedTexture streamed;
+    auto file = std::make_shared<MappedFile>();
+    TgaView view;
+
+    if (file->Open(path) && ParseTGA(file->Data(), file->Size(), view))
+    {
+        streamed.Width = view.width;
+        streamed.Height = view.height;
+        streamed.MipCount = FullMipCount(view.width, view.height);
+        streamed.FileMips = 1;
+        streamed.FileBytesPerPixel = view.channels;
+
+        streamed.OwnedMips.resize(streamed.MipCount);
+        if (streamed.MipCount > 1)
+        {
+            DownsampleTgaToBGRA(view, streamed.OwnedMips[1]);
+            mTextureBytesTouched += (uint64_t)view.width * view.height * view.channels;
+        }
+        for (UINT mip = 2; mip < streamed.MipCount; mip++)
+        {
+            DownsampleBGRA(
+                streamed.OwnedMips[mip - 1],
+                max(1u, streamed.Width >> (mip - 1)),
+                max(1u, streamed.Height >> (mip - 1)),
+                streamed.OwnedMips[mip]);
+        }
+
+        streamed.File = std::move(file);
+    }
+    else
+    {
+        TgaImage image;
+        if (!LoadTGA(path, image))
+        {
+            throw std::runtime_error("Failed to load TGA: " + path);
+        }
+
+        streamed.Width = image.width;
+        streamed.Height = image.height;
+        BuildMipChain(image, streamed.OwnedMips);
+        streamed.MipCount = (UINT)streamed.OwnedMips.size();
+
+        // Чтение файла в TgaImage и его перевод в BGRA8
+        mTextureBytesTouched += (uint64_t)image.data.size() * 2 + streamed.OwnedMips[0].size();
+    }
+
+    // Каждый уменьшенный мип записан один раз и прочитан при построении следующего
+    for (UINT mip = 1; mip < streamed.MipCount; mip++)
+        mTextureBytesTouched += streamed.OwnedMips[mip].size() * (mip + 1 < streamed.MipCount ? 2 : 1);
+
+    streamed.Subresources.resize(streamed.MipCount);
+    for (UINT mip = 0; mip < streamed.MipCount; mip++)
+    {
+        DdsSubresource& sub = streamed.Subresources[mip];
+        sub.Width = max(1u, streamed.Width >> mip);
+        sub.Height = max(1u, streamed.Height >> mip);
+        sub.RowPitch = sub.Width * (mip < streamed.FileMips ? streamed.FileBytesPerPixel : 4);
+        sub.NumRows = sub.Height;
+        sub.Offset = mip < streamed.FileMips ? (size_t)(view.pixels - streamed.File->Data()) : 0;
+    }
+
+    int id = AddStreamedTexture(std::move(streamed), 32);
+    texture = mStreamedTextures[id].Resource;
+    return id;
+}
+
+int DirectXApp::CreateTextureFromDDS(
+    const std::string& path,
+    Microsoft::WRL::ComPtr<ID3D12Resource>& texture)
+{
+    // Файл остаётся отображённым: подресурсы копируются в upload-буфер прямо из него
+    auto file = std::make_shared<MappedFile>();
+    if (!file->Open(path))
+    {
+        throw std::runtime_error("Failed to open DDS: " + path);
+    }
+
+    DdsImage image;
+    if (!ParseDDS(file->Data(), file->Size(), image))
+    {
+        throw std::runtime_error("Unsupported DDS: " + path);
+    }
+
+    StreamedTexture streamed;
+    streamed.Format = (DXGI_FORMAT)image.Format;
+    streamed.Width = image.Width;
+    streamed.Height = image.Height;
+    streamed.MipCount = image.MipCount;
+    streamed.ArraySize = image.ArraySize;
+    streamed.Subresources = std::move(image.Subresources);
+    streamed.File = std::move(file);
+    streamed.FileMips = image.MipCount;
+
+    int id = AddStreamedTexture(std::move(streamed), FormatBitsPerPixel(image.Format));
+    texture = mStreamedTextures[id].Resource;
+    return id;
+}
+
+int DirectXApp::AddStreamedTexture(StreamedTexture&& streamed, UINT bitsPerPixel)
+{
+    UINT startupMip = TextureStreamer::MipForSize(streamed.Width, streamed.Height, TextureStartupSize);
+
+    // Верхний мип BC-текстуры должен быть кратен блоку 4x4: стример держит
+    // стартовый мип и повышения в пределах таких мипов
+    UINT id = mTextureStreamer.AddTexture(
+        streamed.Width,
+        streamed.Height,
+        streamed.MipCount,
+        bitsPerPixel * streamed.ArraySize,
+        IsBlockCompressed(streamed.Format) ? 4 : 1,
+        startupMip);
+    mStreamedTextures.push_back(std::move(streamed));
+
+    UINT residentMip = mTextureStreamer.ResidentMip(id);
+    MipTarget target = CreateStreamedResource(id, residentMip);
+
+    mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr);
+
+    RecordTextureMipChange(id, mStreamedTextures[id].MipCount, residentMip, target);
+
+    // Вне кадра графа нет: переход ставится здесь
+    D3D12_RESOURCE_BARRIER barrier =
+        CD3DX12_RESOURCE_BARRIER_HELPER::Transition(
+            target.Texture.Get(),
+            D3D12_RESOURCE_STATE_COPY_DEST,
+            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    mCommandList->ResourceBarrier(1, &barrier);
+
+    mCommandList->Close();
+
+    ID3D12CommandList* cmdLists[] = { mCommandList.Get() };
+    mCommandQueue->ExecuteCommandLists(1, cmdLists);
+
+    FlushCommandQueue();
+
+    return (int)id;
+}
+
+// nullptr - нулевой дескриптор: слот таблицы занят, но перестановка шейдера его не читает
+void DirectXApp::CreateTextureSrv(ID3D12Resource* texture, UINT srvHeapIndex)
+{
+    D3D12_RESOURCE_DESC texDesc = {};
+    texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    texDesc.DepthOrArraySize = 1;
+    if (texture)
+        texDesc = texture->GetDesc();
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srvDesc.Format = texDesc.Format;
+
+    // Все мипы ресурса
+    if (texDesc.DepthOrArraySize > 1)
+    {
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+        srvDesc.Texture2DArray.MipLevels = (UINT)-1;
+        srvDesc.Texture2DArray.ArraySize = texDesc.DepthOrArraySize;
+    }
+    else
+    {
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels = texture ? (UINT)-1 : 1;
+    }
+
+    // Постоянная копия, в таблицы кадров её переносит SyncFrameSrvs
+    D3D12_CPU_DESCRIPTOR_HANDLE hDescriptor =
+        mSrvStagingHeap->GetCPUDescriptorHandleForHeapStart();
+    hDescriptor.ptr += (SIZE_T)srvHeapIndex * mCbvSrvUavDescriptorSize;
+
+    device->CreateShaderResourceView(texture, &srvDesc, hDescriptor);
+}
+
+Material* DirectXApp::FindMaterial(const std::string& name)
+{
+    for (auto& m : mMaterials)
+    {
+        if (m.Name == name)
+            return &m;
+    }
+    return nullptr;
+}
+
+// =========== Texture Streaming ===========
+void DirectXApp::UpdateTextureStreaming(float fovY)
+{
+    mTextureStreamer.BeginFrame();
+
+    // Пикселей на единицу длины на расстоянии 1
+    float pixelsPerUnit = (float)mClientHeight / (2.0f * tanf(0.5f * fovY));
+    float uvScale = max(mUVScaleU, mUVScaleV);
+
+    // Запросы только от невыгруженных секторов: текстуры остальных хотят стартовый
+    // мип и первыми отдают память, когда бюджета не хватает
+    for (size_t i = 0; i < mSubmeshes.size(); i++)
+    {
+        const Submesh& sm = mSubmeshes[i];
+        if ((mResidentDraws[i >> 6] >> (i & 63) & 1) == 0)
+            continue;
+
+        const Material* mat = FindMaterial(sm.MaterialName);
+        if (!mat || sm.UvDensity <= 0.0f)
+            continue;
+
+        float distance = max(sm.Bounds.Distance(mEyePos.x, mEyePos.y, mEyePos.z), 0.1f);
+
+        // Первую карту виртуальной текстуры читают тайлы - её мипы остаются стартовыми
+        int firstMap = (mat->Features & MaterialFeatureVirtual) ? -1 : mat->StreamId1;
+        for (int id : { firstMap, mat->StreamId2 })
+        {
+            if (id < 0)
+                continue;
+
+            const StreamedTexture& st = mStreamedTextures[id];
+            float texelsPerUnit = sm.UvDensity * uvScale * sqrtf((float)st.Width * (float)st.Height);
+            float texelsPerPixel = texelsPerUnit * distance / pixelsPerUnit;
+
+            mTextureStreamer.RequestMip((UINT)id, log2f(max(texelsPerPixel, 1.0f)));
+        }
+    }
+
+    // Лайтмап мал и нужен целиком везде
+    if (mLightmapStreamId >= 0)
+        mTextureStreamer.RequestMip((UINT)mLightmapStreamId, 0.0f);
+
+    mMipChanges = mTextureStreamer.Update();
+}
+
+// Новые ресурсы создаются до графа кадра: он ставит их переходы
+void DirectXApp::PrepareTextureStreaming()
+{
+    mMipTargets.clear();
+
+    for (const MipChange& change : mMipChanges)
+    {
+        mMipTargets.push_back(CreateStreamedResource(change.Texture, change.NewMip));
+    }
+}
+
+// Ресурс с мипами [newMip, end) в COPY_DEST
+DirectXApp::MipTarget DirectXApp::CreateStreamedResource(UINT id, UINT newMip)
+{
+    const StreamedTexture& st = mStreamedTextures[id];
+
+    D3D12_RESOURCE_DESC texDesc = {};
+    texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    texDesc.Width = max(1u, st.Width >> newMip);
+    texDesc.Height = max(1u, st.Height >> newMip);
+    texDesc.DepthOrArraySize = (UINT16)st.ArraySize;
+    texDesc.MipLevels = (UINT16)(st.MipCount - newMip);
+    texDesc.Format = st.Format;
+    texDesc.SampleDesc.Count = 1;
+    texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+
+    MipTarget target;
+    target.Memory = PlaceResource(GpuHeapTextures, texDesc, D3D12_RESOURCE_STATE_COPY_DEST, target.Texture);
+    return target;
+}
+
+void DirectXApp::RecordTextureStreaming()
+{
+    for (size_t i = 0; i < mMipChanges.size(); i++)
+    {
+        const MipChange& change = mMipChanges[i];
+        RecordTextureMipChange(change.Texture, change.OldMip, change.NewMip, mMipTargets[i]);
+
+        // Новый ресурс у всех материалов с этой текстурой, SRV перепишет SyncFrameSrvs
+        const auto& resource = mStreamedTextures[change.Texture].Resource;
+        for (auto& m : mMaterials)
+        {
+            if (m.StreamId1 == (int)change.Texture)
+            {
+                m.DiffuseTexture1 = resource;
+            }
+            if (m.StreamId2 == (int)change.Texture)
+            {
+                m.DiffuseTexture2 = resource;
+            }
+        }
+        if (mLightmapStreamId == (int)change.Texture)
+            mLightmapTexture = resource;
+    }
+
+    mMipChanges.clear();
+    mMipTargets.clear();
+}
+
+// Заполняет texture (мипы [newMip, end), создан PrepareTextureStreaming). Мипы,
+// которых не было в старом ресурсе, грузятся из источника (память или отображённый
+// DDS), остальные копируются GPU -> GPU. oldMip == MipCount означает, что старого
+// ресурса нет. Старый к этому моменту в COPY_SOURCE, новый в COPY_DEST - переходы
+// ставит граф кадра.
+void DirectXApp::RecordTextureMipChange(UINT id, UINT oldMip, UINT newMip, const MipTarget& target)
+{
+    const Microsoft::WRL::ComPtr<ID3D12Resource>& texture = target.Texture;
+    StreamedTexture& st = mStreamedTextures[id];
+    UINT newMipLevels = st.MipCount - newMip;
+    UINT oldMipLevels = st.MipCount - oldMip;
+    D3D12_RESOURCE_DESC texDesc = texture->GetDesc();
+
+    // ===== НОВЫЕ МИПЫ ИЗ ИСТОЧНИКА =====
+    // В каждом слое это подресурсы [0, uploadCount) нового ресурса
+    UINT uploadCount = oldMip > newMip ? oldMip - newMip : 0;
+    if (uploadCount > 0)
+    {
+        UINT layoutCount = uploadCount * st.ArraySize;
+        std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(layoutCount);
+        std::vector<UINT> numRows(layoutCount);
+        std::vector<UINT64> rowSizes(layoutCount);
+        UINT64 uploadSize = 0;
+
+        for (UINT slice = 0; slice < st.ArraySize; slice++)
+        {
+            UINT64 sliceBytes = 0;
+            device->GetCopyableFootprints(
+                &texDesc, slice * newMipLevels, uploadCount, uploadSize,
+                &layouts[slice * uploadCount], &numRows[slice * uploadCount], &rowSizes[slice * uploadCount],
+                &sliceBytes);
+
+            uploadSize += (sliceBytes + D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1) &
+                ~(UINT64)(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1);
+        }
+
+        UploadAllocation upload = AllocateUpload(uploadSize, UploadTextureAlignment);
+
+        for (UINT slice = 0; slice < st.ArraySize; slice++)
+        {
+            for (UINT i = 0; i < uploadCount; i++)
+            {
+                UINT layout = slice * uploadCount + i;
+                UINT srcIndex = (newMip + i) + slice * st.MipCount;
+                const uint8_t* src = st.SubresourceData(srcIndex);
+                UINT srcRowPitch = st.Subresources[srcIndex].RowPitch;
+                BYTE* dest = upload.Mapped + layouts[layout].Offset;
+
+                mTextureBytesTouched += (uint64_t)srcRowPitch * numRows[layout] + rowSizes[layout] * numRows[layout];
+
+                // BGR8 из TGA дополняется альфой сразу в upload-буфере
+                if (newMip + i < st.FileMips && st.FileBytesPerPixel == 3)
+                {
+                    for (UINT y = 0; y < numRows[layout]; y++)
+                    {
+                        TgaRowToBGRA(
+                            src + y * srcRowPitch,
+                            layouts[layout].Footprint.Width,
+                            3,
+                            dest + y * layouts[layout].Footprint.RowPitch);
+                    }
+                    continue;
+                }
+
+                // Совпал шаг строк - подресурс копируется одним куском
+                if (layouts[layout].Footprint.RowPitch == srcRowPitch)
+                {
+                    memcpy(dest, src, (size_t)srcRowPitch * numRows[layout]);
+                    continue;
+                }
+
+                for (UINT y = 0; y < numRows[layout]; y++)
+                {
+                    memcpy(
+                        dest + y * layouts[layout].Footprint.RowPitch,
+                        src + y * srcRowPitch,
+                        (size_t)rowSizes[layout]);
+                }
+            }
+        }
+
+        for (UINT slice = 0; slice < st.ArraySize; slice++)
+        {
+            for (UINT i = 0; i < uploadCount; i++)
+            {
+                D3D12_TEXTURE_COPY_LOCATION dst = {};
+                dst.pResource = texture.Get();
+                dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+                dst.SubresourceIndex = i + slice * newMipLevels;
+
+                D3D12_TEXTURE_COPY_LOCATION src = {};
+                src.pResource = upload.Resource;
+                src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+                src.PlacedFootprint = layouts[slice * uploadCount + i];
+                src.PlacedFootprint.Offset += upload.Offset;
+
+                mCommandList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+            }
+        }
+    }
+
+    // ===== РЕЗИДЕНТНЫЕ МИПЫ ИЗ СТАРОГО РЕСУРСА =====
+    if (st.Resource)
+    {
+        for (UINT slice = 0; slice < st.ArraySize; slice++)
+        {
+            for (UINT mip = max(newMip, oldMip); mip < st.MipCount; mip++)
+            {
+                D3D12_TEXTURE_COPY_LOCATION dst = {};
+                dst.pResource = texture.Get();
+                dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+                dst.SubresourceIndex = (mip - newMip) + slice * newMipLevels;
+
+                D3D12_TEXTURE_COPY_LOCATION src = {};
+                src.pResource = st.Resource.Get();
+                src.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+                src.SubresourceIndex = (mip - oldMip) + slice * oldMipLevels;
+
+                mCommandList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+            }
+        }
+
+        mRetiredResources.Retire(st.Resource, mFrameScheduler.PendingFenceValue());
+        mRetiredAllocations.Retire(st.Memory, mFrameScheduler.PendingFenceValue());
+    }
+
+    st.Resource = texture;
+    st.Memory = target.Memory;
+}
+
+// =========== Software Rasterizer ===========
+// CPU-копии текстур материалов: BGRA8 из того же источника, что и у GPU.
+// Сжатые DDS не раскодируются - такие слоты остаются пустыми (белый цвет).
+void DirectXApp::BuildSoftTextures()
+{
+    mSoftTextures.assign(mMaterials.size() * 2, SoftTexture());
+    UINT unsupported = 0;
+
+    auto build = [&](int streamId, const float color[3], SoftTexture& out)
+    {
+        if (streamId < 0)
+        {
+            // Карты нет: 1x1 цвета материала, как gColor1/gColor2 в шейдере
+            out.Width = 1;
+            out.Height = 1;
+            out.Mips.push_back({
+                (uint8_t)(color[2] * 255.0f),
+                (uint8_t)(color[1] * 255.0f),
+                (uint8_t)(color[0] * 255.0f),
+                255 });
+            return;
+        }
+
+        const StreamedTexture& streamed = mStreamedTextures[streamId];
+        if (streamed.Format != DXGI_FORMAT_B8G8R8A8_UNORM || streamed.ArraySize != 1)
+        {
+            unsupported++;
+            return;
+        }
+
+        out.Width = streamed.Width;
+        out.Height = streamed.Height;
+        out.Mips.resize(streamed.MipCount);
+
+        for (UINT mip = 0; mip < streamed.MipCount; mip++)
+        {
+            const DdsSubresource& sub = streamed.Subresources[mip];
+            const uint8_t* src = streamed.SubresourceData(mip);
+            UINT bytesPerPixel = mip < streamed.FileMips && streamed.FileBytesPerPixel != 0
+                ? streamed.FileBytesPerPixel : 4;
+
+            std::vector<uint8_t>& dst = out.Mips[mip];
+            dst.resize((size_t)sub.Width * sub.Height * 4);
+            for (UINT row = 0; row < sub.Height; row++)
+            {
+                TgaRowToBGRA(src + (size_t)row * sub.RowPitch, sub.Width, bytesPerPixel,
+                    dst.data() + (size_t)row * sub.Width * 4);
+            }
+        }
+    };
+
+    for (size_t m = 0; m < mMaterials.size(); m++)
+    {
+        build(mMaterials[m].StreamId1, mMaterials[m].Color1, mSoftTextures[m * 2 + 0]);
+        build(mMaterials[m].StreamId2, mMaterials[m].Color2, mSoftTextures[m * 2 + 1]);
+    }
+
+    if (unsupported > 0)
+    {
+        std::string msg = "Software rasterizer: " + std::to_string(unsupported) + " textures without CPU copy\n";
+        OutputDebugStringA(msg.c_str());
+    }
+}
+
+void DirectXApp::RenderSoftFrame()
+{
+    if (mSoftTextures.empty())
+        BuildSoftTextures();
+
+    if (!mSoftRasterizer ||
+        mSoftRasterizer->Width() != (uint32_t)mClientWidth ||
+        mSoftRasterizer->Height() != (uint32_t)mClientHeight)
+    {
+        mSoftRasterizer = std::make_unique<SoftRasterizer>(mJobs, mClientWidth, mClientHeight);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    SoftConstants constants;
+    XMFLOAT4X4 worldViewProj;
+    XMStoreFloat4x4(&worldViewProj, XMLoadFloat4x4(&mWorld) * XMLoadFloat4x4(&mViewProj));
+    memcpy(constants.WorldViewProj, worldViewProj.m, sizeof(constants.WorldViewProj));
+    constants.UVTransform[0] = mFrameConstants.mUVTransform.x;
+    constants.UVTransform[1] = mFrameConstants.mUVTransform.y;
+    constants.UVTransform[2] = mFrameConstants.mUVTransform.z;
+    constants.UVTransform[3] = mFrameConstants.mUVTransform.w;
+    constants.BlendFactor = mFrameConstants.mBlendFactor.x;
+
+    // Отрисовки в порядке очереди GPU; экземпляры стресс-сцены пропускаются
+    std::vector<SoftDraw> draws;
+    for (const RenderItem& item : mRenderQueue.Items())
+    {
+        const Submesh& sm = mSubmeshes[item.DrawIndex];
+        if (item.InstanceCount > 0 || sm.MaterialIndex < 0)
+            continue;
+
+        SoftDraw draw;
+        draw.IndexStart = sm.IndexStart;
+        draw.IndexCount = sm.IndexCount;
+        draw.Texture1 = &mSoftTextures[sm.MaterialIndex * 2 + 0];
+        draw.Texture2 = &mSoftTextures[sm.MaterialIndex * 2 + 1];
+        draws.push_back(draw);
+    }
+
+    SoftMesh mesh;
+    mesh.Vertices = reinterpret_cast<const uint8_t*>(mCpuVertices.data());
+    mesh.VertexStride = sizeof(Vertex);
+    mesh.PositionOffset = offsetof(Vertex, position);
+    mesh.TexcoordOffset = offsetof(Vertex, texcoord);
+    mesh.VertexCount = (uint32_t)mCpuVertices.size();
+    mesh.Indices = mCpuIndices.data();
+
+    // Цвет очистки как в Draw: (0.53, 0.81, 0.98) в BGRA8
+    mSoftRasterizer->Clear(0xFF87CFFAu);
+    mSoftRasterizer->Render(mesh, constants, draws.data(), draws.size());
+
+    mSoftFrameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const SoftRasterStats& stats = mSoftRasterizer->Stats();
+    std::string msg = "Software frame: " + std::to_string(mSoftFrameMs) + " ms (vertices " +
+        std::to_string(stats.TransformUs) + " us, binning " + std::to_string(stats.BinUs) + " us, raster " +
+        std::to_string(stats.RasterUs) + " us), " + std::to_string(stats.Triangles) + " triangles, " +
+        std::to_string(stats.Pixels) + " pixels\n";
+    OutputDebugStringA(msg.c_str());
+
+    if (!mSoftRasterizer->SaveTga("../frame_cpu.tga"))
+        OutputDebugStringA("Failed to save ../frame_cpu.tga\n");
+}
@@ -0,0 +1,402 @@
+﻿#include "../h/FrameGraph.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+    bool IsWriteState(FrameGraphState state)
+    {
+        return state == FrameGraphState::RenderTarget ||
+            state == FrameGraphState::DepthWrite ||
+            state == FrameGraphState::CopyDest ||
+            state == FrameGraphState::UnorderedAccess;
+    }
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+void FrameGraph::Reset()
+{
+    mPasses.clear();
+    mResources.clear();
+    mOrder.clear();
+    mFinalBarriers.clear();
+    mHeapAlignment = 1;
+    mStats = {};
+}
+
+FrameGraphResource FrameGraph::Import(const std::string& name, FrameGraphState initial, FrameGraphState finalState)
+{
+    Resource r;
+    r.Name = name;
+    r.Imported = true;
+    r.Initial = initial;
+    r.Final = finalState;
+    mResources.push_back(r);
+    return (FrameGraphResource)(mResources.size() - 1);
+}
+
+FrameGraphResource FrameGraph::CreateTransient(const std::string& name, uint64_t sizeBytes, uint64_t alignment)
+{
+    Resource r;
+    r.Name = name;
+    r.Size = sizeBytes;
+    r.Alignment = (std::max)(alignment, (uint64_t)1);
+    mResources.push_back(r);
+    return (FrameGraphResource)(mResources.size() - 1);
+}
+
+FrameGraphPass FrameGraph::AddPass(const std::string& name, std::function<void()> execute, bool sideEffect)
+{
+    Pass p;
+    p.Name = name;
+    p.Execute = std::move(execute);
+    p.SideEffect = sideEffect;
+    mPasses.push_back(std::move(p));
+    return (FrameGraphPass)(mPasses.size() - 1);
+}
+
+void FrameGraph::Read(FrameGraphPass pass, FrameGraphResource resource, FrameGraphState state)
+{
+    AddUse(pass, resource, state, false);
+}
+
+void FrameGraph::Write(FrameGraphPass pass, FrameGraphResource resource, FrameGraphState state)
+{
+    AddUse(pass, resource, state, true);
+}
+
+// Одно состояние на ресурс внутри прохода: чтение и запись одной цели (глубина,
+// смешивание) объединяются в одно использование с флагом записи
+void FrameGraph::AddUse(FrameGraphPass pass, FrameGraphResource resource, FrameGraphState state, bool write)
+{
+    Pass& p = mPasses[pass];
+
+    for (Use& use : p.Uses)
+    {
+        if (use.Resource != resource)
+            continue;
+
+        if (use.State != state)
+        {
+            throw std::runtime_error(
+                "Frame graph: pass " + p.Name + " uses " + mResources[resource].Name + " in two states");
+        }
+
+        use.Write = use.Write || write;
+        return;
+    }
+
+    p.Uses.push_back({ resource, state, write });
+}
+
+void FrameGraph::Compile()
+{
+    mOrder.clear();
+    mFinalBarriers.clear();
+    mHeapAlignment = 1;
+    mStats = {};
+
+    CullPasses();
+    ComputeLifetimes();
+    PlaceTransients();
+    BuildBarriers();
+
+    mStats.Passes = (uint32_t)mOrder.size();
+    mStats.CulledPasses = (uint32_t)(mPasses.size() - mOrder.size());
+
+    for (FrameGraphPass p : mOrder)
+    {
+        mStats.Barriers += (uint32_t)mPasses[p].Barriers.size();
+        mStats.Batches += mPasses[p].Barriers.empty() ? 0 : 1;
+    }
+    mStats.Barriers += (uint32_t)mFinalBarriers.size();
+    mStats.Batches += mFinalBarriers.empty() ? 0 : 1;
+}
+
+// С конца: нужный проход делает нужными всё, что он читает, - писавшие это
+// раньше тоже остаются. Запись в нужный ресурс оставляет и запись перед ней:
+// цель рендера дописывается, а не заменяется.
+void FrameGraph::CullPasses()
+{
+    std::vector<bool> needed(mResources.size(), false);
+    for (size_t r = 0; r < mResources.size(); r++)
+    {
+        needed[r] = mResources[r].Imported && mResources[r].Final != FrameGraphState::Undefined;
+    }
+
+    for (size_t i = mPasses.size(); i-- > 0;)
+    {
+        Pass& p = mPasses[i];
+        p.Barriers.clear();
+
+        bool live = p.SideEffect;
+        for (const Use& use : p.Uses)
+        {
+            live = live || (use.Write && needed[use.Resource]);
+        }
+
+        p.Culled = !live;
+        if (!live)
+            continue;
+
+        for (const Use& use : p.Uses)
+        {
+            needed[use.Resource] = true;
+        }
+    }
+
+    for (size_t i = 0; i < mPasses.size(); i++)
+    {
+        if (!mPasses[i].Culled)
+            mOrder.push_back((FrameGraphPass)i);
+    }
+}
+
+void FrameGraph::ComputeLifetimes()
+{
+    for (Resource& r : mResources)
+    {
+        r.First = Invalid;
+        r.Last = Invalid;
+        r.Home = r.Initial;
+        r.Offset = Invalid;
+    }
+
+    for (uint32_t i = 0; i < (uint32_t)mOrder.size(); i++)
+    {
+        for (const Use& use : mPasses[mOrder[i]].Uses)
+        {
+            Resource& r = mResources[use.Resource];
+
+            if (r.First == Invalid)
+            {
+                r.First = i;
+
+                if (!r.Imported)
+                {
+                    if (!use.Write || !IsWriteState(use.State))
+                    {
+                        throw std::runtime_error(
+                            "Frame graph: transient " + r.Name + " is read before pass " +
+                            mPasses[mOrder[i]].Name + " writes it");
+                    }
+                    r.Home = use.State;
+                }
+            }
+            r.Last = i;
+        }
+    }
+}
+
+// Жадная раскладка: от больших к меньшим, каждый - на наименьшее смещение, где
+// он не задевает уже разложенные ресурсы с пересекающимся временем жизни.
+// Кандидаты - ноль и концы таких ресурсов.
+void FrameGraph::PlaceTransients()
+{
+    std::vector<FrameGraphResource> sorted;
+    for (size_t r = 0; r < mResources.size(); r++)
+    {
+        if (!mResources[r].Imported && mResources[r].First != Invalid)
+            sorted.push_back((FrameGraphResource)r);
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [this](FrameGraphResource a, FrameGraphResource b)
+    {
+        const Resource& ra = mResources[a];
+        const Resource& rb = mResources[b];
+        if (ra.Size != rb.Size)
+            return ra.Size > rb.Size;
+        if (ra.First != rb.First)
+            return ra.First < rb.First;
+        return a < b;
+    });
+
+    std::vector<FrameGraphResource> placed;
+    std::vector<uint64_t> candidates;
+
+    for (FrameGraphResource index : sorted)
+    {
+        Resource& r = mResources[index];
+
+        auto livesWith = [&r](const Resource& other)
+        {
+            return other.First <= r.Last && r.First <= other.Last;
+        };
+
+        candidates.assign(1, 0);
+        for (FrameGraphResource other : placed)
+        {
+            const Resource& o = mResources[other];
+            if (livesWith(o))
+                candidates.push_back(AlignUp(o.Offset + o.Size, r.Alignment));
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        for (uint64_t offset : candidates)
+        {
+            bool fits = true;
+            for (FrameGraphResource other : placed)
+            {
+                const Resource& o = mResources[other];
+                if (livesWith(o) && offset < o.Offset + o.Size && o.Offset < offset + r.Size)
+                {
+                    fits = false;
+                    break;
+                }
+            }
+
+            if (fits)
+            {
+                r.Offset = offset;
+                break;
+            }
+        }
+
+        placed.push_back(index);
+
+        mHeapAlignment = (std::max)(mHeapAlignment, r.Alignment);
+        mStats.HeapBytes = (std::max)(mStats.HeapBytes, r.Offset + r.Size);
+        mStats.TransientBytes += r.Size;
+        mStats.Transients++;
+    }
+}
+
+// Пачка перед проходом: сначала возврат отработавших временных в домашнее
+// состояние (пока их память ещё их), затем наложение новых, затем переходы
+// самого прохода. Первый переход импортированного ресурса ничего в кадре не
+// ждёт: если своя пачка прохода пуста, он дописывается в ближайшую более раннюю,
+// а не становится отдельным вызовом.
+void FrameGraph::BuildBarriers()
+{
+    std::vector<FrameGraphState> state(mResources.size());
+    for (size_t r = 0; r < mResources.size(); r++)
+    {
+        state[r] = mResources[r].Home;
+    }
+
+    auto restore = [&](uint32_t position, std::vector<FrameGraphBarrier>& out)
+    {
+        for (size_t r = 0; r < mResources.size(); r++)
+        {
+            const Resource& res = mResources[r];
+            if (res.Imported || res.Last == Invalid || res.Last >= position || state[r] == res.Home)
+                continue;
+
+            FrameGraphBarrier b;
+            b.Resource = (FrameGraphResource)r;
+            b.From = state[r];
+            b.To = res.Home;
+            out.push_back(b);
+            state[r] = res.Home;
+        }
+    };
+
+    std::vector<FrameGraphBarrier> hoisted;
+
+    for (uint32_t i = 0; i < (uint32_t)mOrder.size(); i++)
+    {
+        Pass& p = mPasses[mOrder[i]];
+        hoisted.clear();
+
+        restore(i, p.Barriers);
+
+        for (const Use& use : p.Uses)
+        {
+            const Resource& r = mResources[use.Resource];
+            if (r.Imported || r.First != i)
+                continue;
+
+            // Предыдущий владелец памяти известен, если он один; иначе - любой
+            bool overlaps = false;
+            uint32_t earlier = 0;
+            FrameGraphResource before = Invalid;
+
+            for (size_t o = 0; o < mResources.size(); o++)
+            {
+                const Resource& other = mResources[o];
+                if (o == use.Resource || other.Imported || other.Offset == Invalid)
+                    continue;
+                if (!(r.Offset < other.Offset + other.Size && other.Offset < r.Offset + r.Size))
+                    continue;
+
+                overlaps = true;
+                if (other.Last < i)
+                {
+                    earlier++;
+                    before = (FrameGraphResource)o;
+                }
+            }
+
+            if (!overlaps)
+                continue;
+
+            FrameGraphBarrier b;
+            b.Type = FrameGraphBarrier::Kind::Aliasing;
+            b.Resource = use.Resource;
+            b.Before = earlier == 1 ? before : Invalid;
+            p.Barriers.push_back(b);
+        }
+
+        for (const Use& use : p.Uses)
+        {
+            if (state[use.Resource] == use.State)
+                continue;
+
+            FrameGraphBarrier b;
+            b.Resource = use.Resource;
+            b.From = state[use.Resource];
+            b.To = use.State;
+            state[use.Resource] = use.State;
+
+            const Resource& r = mResources[use.Resource];
+            if (r.Imported && r.First == i)
+                hoisted.push_back(b);
+            else
+                p.Barriers.push_back(b);
+        }
+
+        std::vector<FrameGraphBarrier>* target = &p.Barriers;
+        for (uint32_t j = i; j-- > 0 && target->empty();)
+        {
+            if (!mPasses[mOrder[j]].Barriers.empty())
+                target = &mPasses[mOrder[j]].Barriers;
+        }
+        if (target->empty())
+            target = &p.Barriers;
+
+        target->insert(target->end(), hoisted.begin(), hoisted.end());
+    }
+
+    restore((uint32_t)mOrder.size(), mFinalBarriers);
+
+    for (size_t r = 0; r < mResources.size(); r++)
+    {
+        const Resource& res = mResources[r];
+        if (!res.Imported || res.Final == FrameGraphState::Undefined || state[r] == res.Final)
+            continue;
+
+        FrameGraphBarrier b;
+        b.Resource = (FrameGraphResource)r;
+        b.From = state[r];
+        b.To = res.Final;
+        mFinalBarriers.push_back(b);
+    }
+}
+
+void FrameGraph::Execute(const std::function<void(const FrameGraphBarrier*, size_t)>& recordBarriers) const
+{
+    for (FrameGraphPass index : mOrder)
+    {
+        const Pass& p = mPasses[index];
+
+        if (!p.Barriers.empty())
+            recordBarriers(p.Barriers.data(), p.Barriers.size());
+
+        if (p.Execute)
+            p.Execute();
+    }
+}
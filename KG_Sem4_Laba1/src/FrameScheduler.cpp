@@ -0,0 +1,25 @@
+﻿#include "../h/FrameScheduler.h"
+
+FrameScheduler::FrameScheduler(uint32_t frameCount)
+    : mSlotFences(frameCount > 0 ? frameCount : 1, 0)
+{
+}
+
+uint64_t FrameScheduler::BeginFrame(uint64_t completedValue)
+{
+    uint64_t waitValue = mSlotFences[mSlot];
+    if (waitValue <= completedValue)
+        return 0;
+
+    mStats.FramesWaited++;
+    return waitValue;
+}
+
+uint64_t FrameScheduler::EndFrame()
+{
+    uint64_t value = Signal();
+    mSlotFences[mSlot] = value;
+    mSlot = (mSlot + 1) % FrameCount();
+    mStats.FramesSubmitted++;
+    return value;
+}
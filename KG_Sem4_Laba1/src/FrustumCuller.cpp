@@ -0,0 +1,160 @@
+﻿#include "../h/FrustumCuller.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define FRUSTUM_CULLER_SSE 1
+#endif
+
+void ExtractFrustumPlanes(const float m[4][4], FrustumPlanes& out)
+{
+    // Столбец j матрицы даёт clip-координату j: left = w + x, right = w - x, ...
+    for (int i = 0; i < 4; i++)
+    {
+        float x = m[i][0];
+        float y = m[i][1];
+        float z = m[i][2];
+        float w = m[i][3];
+
+        out.Planes[0][i] = w + x; // left
+        out.Planes[1][i] = w - x; // right
+        out.Planes[2][i] = w + y; // bottom
+        out.Planes[3][i] = w - y; // top
+        out.Planes[4][i] = z;     // near
+        out.Planes[5][i] = w - z; // far
+    }
+}
+
+void FrustumCuller::Clear()
+{
+    mCenterX.clear();
+    mCenterY.clear();
+    mCenterZ.clear();
+    mExtentX.clear();
+    mExtentY.clear();
+    mExtentZ.clear();
+    mCount = 0;
+}
+
+uint32_t FrustumCuller::Add(const Aabb& box)
+{
+    uint32_t index = mCount++;
+
+    // Хвост до кратного 4 заполнен пустыми боксами - они всегда отсекаются
+    if (index % 4 == 0)
+    {
+        size_t size = mCenterX.size() + 4;
+        mCenterX.resize(size, 0.0f);
+        mCenterY.resize(size, 0.0f);
+        mCenterZ.resize(size, 0.0f);
+        mExtentX.resize(size, -FLT_MAX / 4);
+        mExtentY.resize(size, -FLT_MAX / 4);
+        mExtentZ.resize(size, -FLT_MAX / 4);
+    }
+
+    Set(index, box);
+    return index;
+}
+
+void FrustumCuller::Set(uint32_t index, const Aabb& box)
+{
+    if (box.IsEmpty())
+    {
+        mCenterX[index] = mCenterY[index] = mCenterZ[index] = 0.0f;
+        mExtentX[index] = mExtentY[index] = mExtentZ[index] = -FLT_MAX / 4;
+        return;
+    }
+
+    mCenterX[index] = (box.Min[0] + box.Max[0]) * 0.5f;
+    mCenterY[index] = (box.Min[1] + box.Max[1]) * 0.5f;
+    mCenterZ[index] = (box.Min[2] + box.Max[2]) * 0.5f;
+    mExtentX[index] = (box.Max[0] - box.Min[0]) * 0.5f;
+    mExtentY[index] = (box.Max[1] - box.Min[1]) * 0.5f;
+    mExtentZ[index] = (box.Max[2] - box.Min[2]) * 0.5f;
+}
+
+// Бокс снаружи, если центр дальше за плоскостью, чем проекция полуразмера на нормаль
+void FrustumCuller::CullScalar(const FrustumPlanes& frustum, std::vector<uint32_t>& visible, const uint64_t* mask) const
+{
+    visible.clear();
+
+    for (uint32_t i = 0; i < mCount; i++)
+    {
+        if (mask && ((mask[i / 64] >> (i % 64)) & 1) == 0)
+            continue;
+
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++)
+        {
+            const float* plane = frustum.Planes[p];
+            // Скобки - как в SSE-версии, чтобы округление и результат совпадали
+            float distance = (plane[0] * mCenterX[i] + plane[1] * mCenterY[i]) + (plane[2] * mCenterZ[i] + plane[3]);
+            float radius = std::fabs(plane[0]) * mExtentX[i] + std::fabs(plane[1]) * mExtentY[i] + std::fabs(plane[2]) * mExtentZ[i];
+            inside = distance + radius >= 0.0f;
+        }
+
+        if (inside)
+            visible.push_back(i);
+    }
+}
+
+void FrustumCuller::Cull(const FrustumPlanes& frustum, std::vector<uint32_t>& visible, const uint64_t* mask) const
+{
+#ifdef FRUSTUM_CULLER_SSE
+    visible.clear();
+
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    __m128 absX[6], absY[6], absZ[6];
+    for (int p = 0; p < 6; p++)
+    {
+        planeX[p] = _mm_set1_ps(frustum.Planes[p][0]);
+        planeY[p] = _mm_set1_ps(frustum.Planes[p][1]);
+        planeZ[p] = _mm_set1_ps(frustum.Planes[p][2]);
+        planeW[p] = _mm_set1_ps(frustum.Planes[p][3]);
+        absX[p] = _mm_set1_ps(std::fabs(frustum.Planes[p][0]));
+        absY[p] = _mm_set1_ps(std::fabs(frustum.Planes[p][1]));
+        absZ[p] = _mm_set1_ps(std::fabs(frustum.Planes[p][2]));
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+
+    for (uint32_t base = 0; base < mCount; base += 4)
+    {
+        // base кратно 4 - четвёрка битов маски не пересекает границу слова
+        int allowed = mask ? (int)((mask[base / 64] >> (base % 64)) & 0xF) : 0xF;
+        if (allowed == 0)
+            continue;
+
+        __m128 cx = _mm_loadu_ps(&mCenterX[base]);
+        __m128 cy = _mm_loadu_ps(&mCenterY[base]);
+        __m128 cz = _mm_loadu_ps(&mCenterZ[base]);
+        __m128 ex = _mm_loadu_ps(&mExtentX[base]);
+        __m128 ey = _mm_loadu_ps(&mExtentY[base]);
+        __m128 ez = _mm_loadu_ps(&mExtentZ[base]);
+
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+                _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+            __m128 radius = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)),
+                _mm_mul_ps(absZ[p], ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+        }
+
+        int lanes = _mm_movemask_ps(inside) & allowed;
+        while (lanes != 0)
+        {
+            int lane = 0;
+            while ((lanes & (1 << lane)) == 0)
+                lane++;
+            lanes &= lanes - 1;
+            if (base + lane < mCount)
+                visible.push_back(base + lane);
+        }
+    }
+#else
+    CullScalar(frustum, visible, mask);
+#endif
+}
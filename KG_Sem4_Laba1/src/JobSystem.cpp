@@ -0,0 +1,297 @@
+﻿#include "../h/JobSystem.h"
+#include <algorithm>
+
+namespace
+{
+    const uint32_t NotInSystem = UINT32_MAX;
+    const uint32_t SpinsBeforeSleep = 64;
+
+    // Участник текущего потока: система и номер дека
+    thread_local const JobSystem* tSystem = nullptr;
+    thread_local uint32_t tIndex = NotInSystem;
+}
+
+// =========== Work-Stealing Deque ===========
+// Порядки памяти - по Lê, Pop, Cohen, Zappa Nardelli, "Correct and Efficient
+// Work-Stealing for Weak Memory Models" (PPoPP 2013)
+bool WorkStealingDeque::Push(Job* job)
+{
+    int64_t b = mBottom.load(std::memory_order_relaxed);
+    int64_t t = mTop.load(std::memory_order_acquire);
+    if (b - t >= Capacity)
+        return false;
+
+    // release на самой ячейке: вор, прочитавший указатель, видит и задачу
+    mJobs[b & (Capacity - 1)].store(job, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_release);
+    mBottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+Job* WorkStealingDeque::Pop()
+{
+    int64_t b = mBottom.load(std::memory_order_relaxed) - 1;
+    mBottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = mTop.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+        mBottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = mJobs[b & (Capacity - 1)].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        // Последняя задача - состязаемся с ворами
+        if (!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        mBottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* WorkStealingDeque::Steal()
+{
+    int64_t t = mTop.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = mBottom.load(std::memory_order_acquire);
+
+    if (t >= b)
+        return nullptr;
+
+    Job* job = mJobs[t & (Capacity - 1)].load(std::memory_order_acquire);
+    if (!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+// =========== Job System ===========
+JobSystem::JobSystem(uint32_t workerCount)
+{
+    if (workerCount == 0)
+        workerCount = (std::max)(std::thread::hardware_concurrency(), 2u) - 1;
+
+    for (uint32_t i = 0; i <= workerCount; i++)
+        mDeques.push_back(std::make_unique<WorkStealingDeque>());
+
+    tSystem = this;
+    tIndex = 0;
+
+    for (uint32_t i = 1; i <= workerCount; i++)
+        mWorkers.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mQuit = true;
+    }
+    mWake.notify_all();
+
+    for (auto& worker : mWorkers)
+        worker.join();
+
+    if (tSystem == this)
+    {
+        tSystem = nullptr;
+        tIndex = NotInSystem;
+    }
+}
+
+uint32_t JobSystem::CurrentIndex() const
+{
+    return tSystem == this ? tIndex : NotInSystem;
+}
+
+void JobSystem::Run(std::function<void()> task, JobCounter* counter)
+{
+    if (counter)
+        counter->mValue.fetch_add(1, std::memory_order_relaxed);
+
+    Submit(new Job{ std::move(task), counter });
+}
+
+void JobSystem::RunAfter(JobCounter& dependency, std::function<void()> task, JobCounter* counter)
+{
+    if (counter)
+        counter->mValue.fetch_add(1, std::memory_order_relaxed);
+
+    Job* job = new Job{ std::move(task), counter };
+    {
+        std::lock_guard<std::mutex> lock(dependency.mMutex);
+        if (!dependency.IsDone())
+        {
+            dependency.mContinuations.push_back(job);
+            return;
+        }
+    }
+    Submit(job);
+}
+
+void JobSystem::Submit(Job* job)
+{
+    uint32_t self = CurrentIndex();
+    if (self == NotInSystem)
+    {
+        std::lock_guard<std::mutex> lock(mInjectMutex);
+        mInjected.push_back(job);
+        mInjectedCount.store((uint32_t)mInjected.size());
+    }
+    else if (!mDeques[self]->Push(job))
+    {
+        // Дек полон - выполняем сразу, это тоже продвигает работу
+        Execute(job);
+        return;
+    }
+
+    mQueued.fetch_add(1);
+    if (mSleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mWake.notify_one();
+    }
+}
+
+void JobSystem::Execute(Job* job)
+{
+    job->Task();
+    mExecuted.fetch_add(1, std::memory_order_relaxed);
+
+    JobCounter* counter = job->Counter;
+    delete job;
+
+    if (!counter)
+        return;
+
+    // Под мьютексом: Wait перед возвратом берёт его же, так что счётчик
+    // не разрушится, пока мы его трогаем
+    std::vector<Job*> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->mMutex);
+        if (counter->mValue.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            ready.swap(counter->mContinuations);
+    }
+
+    for (Job* next : ready)
+        Submit(next);
+}
+
+Job* JobSystem::FindJob(uint32_t self)
+{
+    Job* job = nullptr;
+
+    if (self != NotInSystem)
+        job = mDeques[self]->Pop();
+
+    if (!job && mInjectedCount.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(mInjectMutex);
+        if (!mInjected.empty())
+        {
+            job = mInjected.back();
+            mInjected.pop_back();
+            mInjectedCount.store((uint32_t)mInjected.size());
+        }
+    }
+
+    // Кража: обходим чужие деки, начиная с соседа
+    uint32_t count = (uint32_t)mDeques.size();
+    uint32_t start = self == NotInSystem ? 0 : self + 1;
+    for (uint32_t i = 0; !job && i < count; i++)
+    {
+        uint32_t victim = (start + i) % count;
+        if (victim == self)
+            continue;
+
+        job = mDeques[victim]->Steal();
+        if (job)
+            mStolen.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (job)
+        mQueued.fetch_sub(1);
+    return job;
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+    uint32_t self = CurrentIndex();
+
+    while (!counter.IsDone())
+    {
+        Job* job = FindJob(self);
+        if (job)
+            Execute(job);
+        else
+            std::this_thread::yield();
+    }
+
+    // Дожидаемся, пока последний Execute отпустит счётчик
+    std::lock_guard<std::mutex> lock(counter.mMutex);
+}
+
+void JobSystem::ParallelFor(uint32_t count, const std::function<void(uint32_t begin, uint32_t end)>& body, uint32_t grain)
+{
+    if (count == 0)
+        return;
+
+    if (grain == 0)
+        grain = (std::max)(count / (ThreadCount() * 4), 1u);
+
+    if (count <= grain)
+    {
+        body(0, count);
+        return;
+    }
+
+    // end считается от остатка: begin + grain может переполниться у count около UINT32_MAX
+    JobCounter counter;
+    for (uint32_t begin = 0, end = 0; begin < count; begin = end)
+    {
+        end = begin + (std::min)(grain, count - begin);
+        Run([&body, begin, end] { body(begin, end); }, &counter);
+    }
+    Wait(counter);
+}
+
+JobSystemStats JobSystem::Stats() const
+{
+    JobSystemStats stats;
+    stats.Executed = mExecuted.load(std::memory_order_relaxed);
+    stats.Stolen = mStolen.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void JobSystem::WorkerLoop(uint32_t index)
+{
+    tSystem = this;
+    tIndex = index;
+
+    uint32_t idleSpins = 0;
+
+    while (!mQuit.load())
+    {
+        Job* job = FindJob(index);
+        if (job)
+        {
+            Execute(job);
+            idleSpins = 0;
+            continue;
+        }
+
+        if (++idleSpins < SpinsBeforeSleep)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mSleeping.fetch_add(1);
+        mWake.wait(lock, [this] { return mQuit.load() || mQueued.load() > 0; });
+        mSleeping.fetch_sub(1);
+        idleSpins = 0;
+    }
+}
@@ -0,0 +1,1106 @@
+﻿#include "../h/LightmapBaker.h"
+#include "../h/DdsLoader.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+#include <unordered_map>
+
+namespace
+{
+    const uint32_t NoChart = UINT32_MAX;
+    const uint32_t NoTexel = UINT32_MAX;
+    const uint32_t NoDraw = UINT32_MAX;
+
+    const uint32_t MaxPackAttempts = 24;    // Плотность уменьшается на 10% за попытку
+    const float ConservativeReach = 1.5f;   // Тексели у края треугольника, читаемые билинейной выборкой
+    const float RayBias = 0.1f;             // Отступ начала лучей, в размерах текселя
+    const float Pi = 3.14159265f;
+    const float LuminanceSigma = 4.0f;      // Допуск разницы яркостей в à-trous, в стандартных отклонениях
+
+    // splitmix64: генератор на тексель, дешевле mt19937 на миллионы текселей
+    struct Rng
+    {
+        uint64_t State;
+
+        explicit Rng(uint64_t seed) : State(seed) {}
+
+        float Next()
+        {
+            uint64_t z = (State += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            z ^= z >> 31;
+            return (float)(z >> 40) * (1.0f / 16777216.0f);
+        }
+    };
+
+    struct PointKey
+    {
+        uint32_t Bits[3];
+
+        bool operator==(const PointKey& other) const
+        {
+            return Bits[0] == other.Bits[0] && Bits[1] == other.Bits[1] && Bits[2] == other.Bits[2];
+        }
+    };
+
+    struct PointKeyHash
+    {
+        size_t operator()(const PointKey& key) const
+        {
+            uint64_t h = key.Bits[0];
+            h = h * 0x9E3779B97F4A7C15ull ^ key.Bits[1];
+            h = h * 0x9E3779B97F4A7C15ull ^ key.Bits[2];
+            return (size_t)(h ^ (h >> 29));
+        }
+    };
+
+    float Dot(const float a[3], const float b[3])
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    void Cross(const float a[3], const float b[3], float out[3])
+    {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    float Normalize(float v[3])
+    {
+        float length = std::sqrt(Dot(v, v));
+        if (length > 0.0f)
+        {
+            for (int k = 0; k < 3; k++)
+                v[k] /= length;
+        }
+        return length;
+    }
+
+    // Ортонормированный базис вокруг n (Duff et al. 2017)
+    void Basis(const float n[3], float t[3], float b[3])
+    {
+        float sign = std::copysign(1.0f, n[2]);
+        float a = -1.0f / (sign + n[2]);
+        float c = n[0] * n[1] * a;
+        t[0] = 1.0f + sign * n[0] * n[0] * a;
+        t[1] = sign * c;
+        t[2] = -sign * n[0];
+        b[0] = c;
+        b[1] = sign + n[1] * n[1] * a;
+        b[2] = -n[1];
+    }
+
+    void FromLocal(const float n[3], float x, float y, float z, float out[3])
+    {
+        float t[3], b[3];
+        Basis(n, t, b);
+        for (int k = 0; k < 3; k++)
+            out[k] = t[k] * x + b[k] * y + n[k] * z;
+    }
+
+    // Направление в конусе вокруг axis (диск солнца)
+    void ConeSample(const float axis[3], float cosMax, Rng& rng, float out[3])
+    {
+        float cosTheta = 1.0f - rng.Next() * (1.0f - cosMax);
+        float sinTheta = std::sqrt((std::max)(0.0f, 1.0f - cosTheta * cosTheta));
+        float phi = 2.0f * Pi * rng.Next();
+        FromLocal(axis, std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta, out);
+    }
+
+    // Полусфера вокруг n с плотностью cos: оценка освещённости - среднее по лучам
+    void CosineSample(const float n[3], Rng& rng, float out[3])
+    {
+        float u = rng.Next();
+        float r = std::sqrt(u);
+        float phi = 2.0f * Pi * rng.Next();
+        FromLocal(n, std::cos(phi) * r, std::sin(phi) * r, std::sqrt((std::max)(0.0f, 1.0f - u)), out);
+    }
+
+    // Точка прямоугольника: луч к ней и освещённость от неё, умноженная на scale
+    bool AreaSample(
+        const LightmapAreaLight& light, const float origin[3], const float normal[3], float scale, Rng& rng,
+        Ray& ray, float weight[3])
+    {
+        float u = rng.Next(), v = rng.Next();
+        float dir[3];
+        for (int k = 0; k < 3; k++)
+            dir[k] = light.Corner[k] + light.EdgeU[k] * u + light.EdgeV[k] * v - origin[k];
+
+        float distance = Normalize(dir);
+        float lightNormal[3];
+        Cross(light.EdgeU, light.EdgeV, lightNormal);
+        float area = Normalize(lightNormal);
+
+        float cosSurface = Dot(normal, dir);
+        float cosLight = -Dot(lightNormal, dir);
+        if (distance <= 0.0f || cosSurface <= 0.0f || cosLight <= 0.0f)
+            return false;
+
+        for (int k = 0; k < 3; k++)
+            ray.Origin[k] = origin[k];
+        for (int k = 0; k < 3; k++)
+            ray.Dir[k] = dir[k];
+        ray.MaxT = distance * (1.0f - 1e-3f);
+
+        // У самого источника 1/d^2 не даёт выбросов больше, чем от сотой доли площади
+        float g = cosSurface * cosLight * area / (std::max)(distance * distance, area * 0.01f) * scale;
+        for (int k = 0; k < 3; k++)
+            weight[k] = light.Color[k] * g;
+        return true;
+    }
+
+    const float* VertexFloat3(const LightmapMesh& mesh, uint32_t vertex, size_t offset)
+    {
+        return reinterpret_cast<const float*>(mesh.Vertices + vertex * mesh.VertexStride + offset);
+    }
+
+    // Нормаль поверхности в точке (u, v) треугольника по нормалям вершин
+    void InterpolatedNormal(const LightmapMesh& mesh, uint32_t triangle, float u, float v, float out[3])
+    {
+        const float* n0 = VertexFloat3(mesh, mesh.Indices[triangle * 3 + 0], mesh.NormalOffset);
+        const float* n1 = VertexFloat3(mesh, mesh.Indices[triangle * 3 + 1], mesh.NormalOffset);
+        const float* n2 = VertexFloat3(mesh, mesh.Indices[triangle * 3 + 2], mesh.NormalOffset);
+        for (int k = 0; k < 3; k++)
+            out[k] = n0[k] * (1.0f - u - v) + n1[k] * u + n2[k] * v;
+        Normalize(out);
+    }
+
+    float GeometricNormal(const LightmapMesh& mesh, uint32_t triangle, float out[3])
+    {
+        const float* p0 = VertexFloat3(mesh, mesh.Indices[triangle * 3 + 0], mesh.PositionOffset);
+        const float* p1 = VertexFloat3(mesh, mesh.Indices[triangle * 3 + 1], mesh.PositionOffset);
+        const float* p2 = VertexFloat3(mesh, mesh.Indices[triangle * 3 + 2], mesh.PositionOffset);
+        float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        Cross(e1, e2, out);
+        return Normalize(out);
+    }
+
+    // Ближайшая к (px, py) точка отрезка; возвращает квадрат расстояния
+    float ClosestOnSegment(float px, float py, float ax, float ay, float bx, float by, float& qx, float& qy)
+    {
+        float dx = bx - ax, dy = by - ay;
+        float lengthSq = dx * dx + dy * dy;
+        float t = lengthSq > 0.0f ? std::clamp(((px - ax) * dx + (py - ay) * dy) / lengthSq, 0.0f, 1.0f) : 0.0f;
+        qx = ax + dx * t;
+        qy = ay + dy * t;
+        return (px - qx) * (px - qx) + (py - qy) * (py - qy);
+    }
+
+    struct TraceScratch
+    {
+        std::vector<Ray> Rays;
+        std::vector<RayHit> Hits;
+        std::vector<float> Weights;     // RGB на луч: вклад, если луч не перекрыт
+        std::vector<Ray> Bounces;       // Второй пакет и его вклады
+        std::vector<float> BounceWeights;
+        std::vector<uint32_t> BounceSamples;    // Выборка отскока, к которой относится луч
+        std::vector<float> SampleLuminance;     // Яркость каждой выборки отскока - для дисперсии
+        std::vector<uint32_t> Subset;
+        std::vector<Ray> SubRays;
+        std::vector<RayHit> SubHits;
+    };
+
+    // Ближайшие непрозрачные пересечения: за SeeThrough луч продолжается с шагом step.
+    // Начала лучей сдвигаются, T у попаданий - от нового начала
+    uint64_t TraceOpaque(
+        const TriangleBvh& bvh, const std::vector<uint8_t>& seeThrough, uint32_t layers, float step,
+        TraceScratch& s)
+    {
+        size_t count = s.Rays.size();
+        s.Hits.resize(count);
+        if (count == 0)
+            return 0;
+
+        bvh.Intersect(s.Rays.data(), count, s.Hits.data());
+        uint64_t cast = count;
+
+        for (uint32_t layer = 0; layer < layers; layer++)
+        {
+            s.Subset.clear();
+            s.SubRays.clear();
+            for (uint32_t i = 0; i < count; i++)
+            {
+                RayHit& hit = s.Hits[i];
+                if (!hit.IsHit() || !seeThrough[hit.Triangle])
+                    continue;
+
+                Ray& ray = s.Rays[i];
+                float advance = hit.T + step;
+                for (int k = 0; k < 3; k++)
+                    ray.Origin[k] += ray.Dir[k] * advance;
+                hit = RayHit();
+
+                if (ray.MaxT != FLT_MAX)
+                {
+                    ray.MaxT -= advance;
+                    if (ray.MaxT <= 0.0f)
+                        continue;
+                }
+
+                s.Subset.push_back(i);
+                s.SubRays.push_back(ray);
+            }
+
+            if (s.Subset.empty())
+                break;
+
+            s.SubHits.resize(s.SubRays.size());
+            bvh.Intersect(s.SubRays.data(), s.SubRays.size(), s.SubHits.data());
+            cast += s.SubRays.size();
+
+            for (size_t k = 0; k < s.Subset.size(); k++)
+                s.Hits[s.Subset[k]] = s.SubHits[k];
+        }
+
+        return cast;
+    }
+
+    float Luminance(const float rgb[3])
+    {
+        return 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2];
+    }
+
+    uint8_t EncodeUnorm(float value)
+    {
+        return (uint8_t)(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+}
+
+// =========== Unwrap ===========
+void LightmapBaker::Unwrap(const LightmapMesh& mesh, const LightmapUnwrapDesc& desc, std::vector<LightmapUv>& outUvs)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    mUnwrap = desc;
+    mStats = {};
+    uint32_t triangles = (uint32_t)(mesh.IndexCount / 3);
+
+    // Совпадающие позиции разных вершин - одна точка: по ним ищутся общие рёбра
+    std::unordered_map<PointKey, uint32_t, PointKeyHash> points;
+    std::vector<uint32_t> cornerPoints((size_t)triangles * 3);
+    for (size_t c = 0; c < cornerPoints.size(); c++)
+    {
+        PointKey key;
+        memcpy(key.Bits, VertexFloat3(mesh, mesh.Indices[c], mesh.PositionOffset), sizeof(key.Bits));
+        cornerPoints[c] = points.emplace(key, (uint32_t)points.size()).first->second;
+    }
+
+    std::vector<float> normals((size_t)triangles * 3, 0.0f);
+    double area = 0.0;
+    for (uint32_t t = 0; t < triangles; t++)
+        area += 0.5 * GeometricNormal(mesh, t, &normals[(size_t)t * 3]);
+
+    // Соседи по рёбрам (CSR). Ребро может быть общим для многих треугольников
+    // (двусторонние стены): соседи все, лишних отсеет проверка нормалей
+    std::vector<std::pair<uint64_t, uint32_t>> edges;
+    edges.reserve((size_t)triangles * 3);
+    for (uint32_t t = 0; t < triangles; t++)
+    {
+        for (uint32_t e = 0; e < 3; e++)
+        {
+            uint32_t a = cornerPoints[t * 3 + e];
+            uint32_t b = cornerPoints[t * 3 + (e + 1) % 3];
+            if (a != b)
+                edges.emplace_back((uint64_t)(std::min)(a, b) << 32 | (std::max)(a, b), t);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    std::vector<uint32_t> neighbourStart(triangles + 1, 0);
+    std::vector<uint32_t> neighbours;
+    for (int fill = 0; fill < 2; fill++)
+    {
+        std::vector<uint32_t> cursor(neighbourStart.begin(), neighbourStart.end() - 1);
+        for (size_t g = 0; g < edges.size();)
+        {
+            size_t end = g + 1;
+            while (end < edges.size() && edges[end].first == edges[g].first)
+                end++;
+
+            for (size_t i = g; i < end; i++)
+            {
+                for (size_t j = g; j < end; j++)
+                {
+                    if (edges[i].second == edges[j].second)
+                        continue;
+                    if (fill)
+                        neighbours[cursor[edges[i].second]++] = edges[j].second;
+                    else
+                        neighbourStart[edges[i].second + 1]++;
+                }
+            }
+            g = end;
+        }
+
+        if (!fill)
+        {
+            for (uint32_t t = 0; t < triangles; t++)
+                neighbourStart[t + 1] += neighbourStart[t];
+            neighbours.resize(neighbourStart[triangles]);
+        }
+    }
+
+    // Начальная плотность заполняет Fill страниц; не уложились - она уменьшается.
+    // Мелкие треугольники занимают минимум текселей при любой плотности, поэтому
+    // после MaxPackAttempts страниц может стать больше MaxPages
+    float capacity = (float)desc.PageSize * desc.PageSize * desc.MaxPages * desc.Fill;
+    float density = area > 0.0 ? std::sqrt(capacity / (float)area) : 1.0f;
+    for (uint32_t attempt = 0; ; attempt++)
+    {
+        BuildCharts(mesh, normals, neighbourStart, neighbours, density);
+        if (Pack() || attempt + 1 == MaxPackAttempts)
+            break;
+        density *= 0.9f;
+    }
+
+    mStats.Charts = (uint32_t)mCharts.size();
+    mStats.TexelsPerUnit = density;
+
+    // Текселы углов и UV вершин: центр текселя (x + 0.5) совпадает с краем карты
+    mCornerTexels.assign((size_t)triangles * 6, 0.0f);
+    outUvs.assign(mesh.VertexCount, LightmapUv());
+    float invSize = 1.0f / desc.PageSize;
+
+    for (const Chart& chart : mCharts)
+    {
+        for (uint32_t i = 0; i < chart.TriangleCount; i++)
+        {
+            uint32_t t = mChartTriangles[chart.FirstTriangle + i];
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                uint32_t c = t * 3 + k;
+                const float* p = VertexFloat3(mesh, mesh.Indices[c], mesh.PositionOffset);
+                float x = chart.X + 0.5f + (Dot(p, chart.Axis[0]) - chart.Min[0]) * chart.Density;
+                float y = chart.Y + 0.5f + (Dot(p, chart.Axis[1]) - chart.Min[1]) * chart.Density;
+                mCornerTexels[(size_t)c * 2 + 0] = x;
+                mCornerTexels[(size_t)c * 2 + 1] = y;
+
+                LightmapUv& uv = outUvs[mesh.Indices[c]];
+                uv.U = x * invSize;
+                uv.V = y * invSize;
+                uv.Page = (float)chart.Page;
+            }
+        }
+    }
+
+    mStats.UnwrapMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Карта растёт от первого треугольника через рёбра, пока нормали близки к его
+// нормали (тогда проекция на её плоскость не выворачивает треугольники) и пока
+// карта помещается в страницу при плотности density
+void LightmapBaker::BuildCharts(
+    const LightmapMesh& mesh, const std::vector<float>& normals, const std::vector<uint32_t>& neighbourStart,
+    const std::vector<uint32_t>& neighbours, float density)
+{
+    uint32_t triangles = (uint32_t)(normals.size() / 3);
+    float maxTexels = (float)(mUnwrap.PageSize - 2 * mUnwrap.Gutter - 1);
+    float maxExtent = maxTexels / density;
+
+    mCharts.clear();
+    mChartTriangles.clear();
+    mTriangleChart.assign(triangles, NoChart);
+    std::vector<uint32_t> queue;
+
+    for (uint32_t seed = 0; seed < triangles; seed++)
+    {
+        if (mTriangleChart[seed] != NoChart)
+            continue;
+
+        uint32_t chartIndex = (uint32_t)mCharts.size();
+        Chart chart;
+        chart.FirstTriangle = (uint32_t)mChartTriangles.size();
+
+        float n[3] = { normals[seed * 3 + 0], normals[seed * 3 + 1], normals[seed * 3 + 2] };
+        if (Dot(n, n) == 0.0f)
+            n[1] = 1.0f;
+
+        // Ось x - горизонталь плоскости карты (у пола и потолка - мировая x):
+        // стены и пол ложатся в атлас без поворота
+        float up[3] = { 0.0f, 1.0f, 0.0f };
+        if (std::fabs(n[1]) > 0.99f)
+        {
+            up[1] = 0.0f;
+            up[2] = 1.0f;
+        }
+        Cross(up, n, chart.Axis[0]);
+        Normalize(chart.Axis[0]);
+        Cross(n, chart.Axis[0], chart.Axis[1]);
+
+        chart.Min[0] = chart.Min[1] = FLT_MAX;
+        chart.Max[0] = chart.Max[1] = -FLT_MAX;
+
+        queue.clear();
+        queue.push_back(seed);
+        mTriangleChart[seed] = chartIndex;
+
+        for (size_t q = 0; q < queue.size(); q++)
+        {
+            uint32_t t = queue[q];
+
+            float min[2] = { chart.Min[0], chart.Min[1] };
+            float max[2] = { chart.Max[0], chart.Max[1] };
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                const float* p = VertexFloat3(mesh, mesh.Indices[t * 3 + k], mesh.PositionOffset);
+                for (int a = 0; a < 2; a++)
+                {
+                    float s = Dot(p, chart.Axis[a]);
+                    min[a] = (std::min)(min[a], s);
+                    max[a] = (std::max)(max[a], s);
+                }
+            }
+
+            // Первый треугольник входит всегда: слишком большой получит меньшую плотность
+            if (t != seed && (max[0] - min[0] > maxExtent || max[1] - min[1] > maxExtent))
+            {
+                mTriangleChart[t] = NoChart;
+                continue;
+            }
+
+            memcpy(chart.Min, min, sizeof(min));
+            memcpy(chart.Max, max, sizeof(max));
+            mChartTriangles.push_back(t);
+
+            for (uint32_t k = neighbourStart[t]; k < neighbourStart[t + 1]; k++)
+            {
+                uint32_t neighbour = neighbours[k];
+                if (mTriangleChart[neighbour] != NoChart ||
+                    Dot(&normals[(size_t)neighbour * 3], n) < mUnwrap.ChartCos)
+                    continue;
+
+                mTriangleChart[neighbour] = chartIndex;
+                queue.push_back(neighbour);
+            }
+        }
+
+        chart.TriangleCount = (uint32_t)mChartTriangles.size() - chart.FirstTriangle;
+
+        float extent = (std::max)(chart.Max[0] - chart.Min[0], chart.Max[1] - chart.Min[1]);
+        chart.Density = extent * density > maxTexels ? maxTexels / extent : density;
+        chart.Width = (uint32_t)std::ceil((chart.Max[0] - chart.Min[0]) * chart.Density) + 1 + mUnwrap.Gutter;
+        chart.Height = (uint32_t)std::ceil((chart.Max[1] - chart.Min[1]) * chart.Density) + 1 + mUnwrap.Gutter;
+
+        mCharts.push_back(chart);
+    }
+}
+
+// Полки: карты от высоких к низким слева направо, отступ Gutter у краёв страницы
+// и справа/снизу от каждой карты. false - не хватило MaxPages
+bool LightmapBaker::Pack()
+{
+    std::vector<uint32_t> order(mCharts.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b)
+    {
+        if (mCharts[a].Height != mCharts[b].Height)
+            return mCharts[a].Height > mCharts[b].Height;
+        if (mCharts[a].Width != mCharts[b].Width)
+            return mCharts[a].Width > mCharts[b].Width;
+        return a < b;
+    });
+
+    uint32_t size = mUnwrap.PageSize;
+    uint32_t gutter = mUnwrap.Gutter;
+    uint32_t page = 0, x = gutter, y = gutter, shelf = 0;
+
+    for (uint32_t i : order)
+    {
+        Chart& chart = mCharts[i];
+        if (x + chart.Width > size)
+        {
+            x = gutter;
+            y += shelf;
+            shelf = 0;
+        }
+        if (y + chart.Height > size)
+        {
+            page++;
+            x = gutter;
+            y = gutter;
+            shelf = 0;
+        }
+
+        chart.X = x;
+        chart.Y = y;
+        chart.Page = page;
+        x += chart.Width;
+        shelf = (std::max)(shelf, chart.Height);
+    }
+
+    mStats.Pages = mCharts.empty() ? 0 : page + 1;
+    return mStats.Pages <= mUnwrap.MaxPages;
+}
+
+// =========== Bake ===========
+void LightmapBaker::Bake(
+    const LightmapMesh& mesh, const TriangleBvh& bvh, const std::vector<LightmapDraw>& draws,
+    const std::vector<LightmapAreaLight>& areaLights, const LightmapBakeDesc& desc, JobSystem& jobs)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    mStats.Rays = 0;
+    mStats.TraceMs = 0.0;
+    mStats.DenoiseMs = 0.0;
+
+    Rasterize(mesh);
+    mStats.Texels = (uint32_t)mTexels.size();
+
+    // Точка, нормали и начало лучей текселя
+    jobs.ParallelFor((uint32_t)mTexels.size(), [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; i++)
+        {
+            Texel& texel = mTexels[i];
+            const float* p0 = VertexFloat3(mesh, mesh.Indices[texel.Triangle * 3 + 0], mesh.PositionOffset);
+            const float* p1 = VertexFloat3(mesh, mesh.Indices[texel.Triangle * 3 + 1], mesh.PositionOffset);
+            const float* p2 = VertexFloat3(mesh, mesh.Indices[texel.Triangle * 3 + 2], mesh.PositionOffset);
+            for (int k = 0; k < 3; k++)
+                texel.Position[k] = p0[k] + (p1[k] - p0[k]) * texel.B1 + (p2[k] - p0[k]) * texel.B2;
+
+            float geometric[3];
+            GeometricNormal(mesh, texel.Triangle, geometric);
+            InterpolatedNormal(mesh, texel.Triangle, texel.B1, texel.B2, texel.Normal);
+            if (Dot(texel.Normal, texel.Normal) == 0.0f)
+                memcpy(texel.Normal, geometric, sizeof(geometric));
+
+            // Геометрическая нормаль - на ту же сторону, что и нормаль вершин
+            float side = Dot(geometric, texel.Normal) < 0.0f ? -1.0f : 1.0f;
+            texel.Size = 1.0f / mCharts[mTriangleChart[texel.Triangle]].Density;
+            for (int k = 0; k < 3; k++)
+                texel.Offset[k] = texel.Position[k] + geometric[k] * side * texel.Size * RayBias;
+        }
+    }, 1024);
+
+    auto traceStart = std::chrono::steady_clock::now();
+    TraceTexels(mesh, bvh, draws, areaLights, desc, jobs);
+    mStats.TraceMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - traceStart).count();
+
+    auto denoiseStart = std::chrono::steady_clock::now();
+    Denoise(desc.DenoisePasses, jobs);
+    mStats.DenoiseMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - denoiseStart).count();
+
+    BuildMips(desc, jobs);
+
+    mStats.BakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    mStats.RaysPerSecond = mStats.TraceMs > 0.0 ? mStats.Rays / (mStats.TraceMs * 1e-3) : 0.0;
+}
+
+// Тексель покрыт, если его центр в треугольнике или не дальше ConservativeReach
+// от него (его читает билинейная выборка у края); из нескольких треугольников
+// тексель берёт ближайший. Карты разделены Gutter = 2, и чужие тексели не задеваются
+void LightmapBaker::Rasterize(const LightmapMesh& mesh)
+{
+    uint32_t size = mUnwrap.PageSize;
+    size_t pagePixels = (size_t)size * size;
+    uint32_t triangles = (uint32_t)(mesh.IndexCount / 3);
+
+    mPixelTexels.assign(pagePixels * mStats.Pages, NoTexel);
+    mTexels.clear();
+
+    for (uint32_t t = 0; t < triangles; t++)
+    {
+        const float* c = &mCornerTexels[(size_t)t * 6];
+        float x0 = c[0], y0 = c[1], x1 = c[2], y1 = c[3], x2 = c[4], y2 = c[5];
+        float area2 = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+        if (std::fabs(area2) < 1e-8f)
+            continue;
+
+        size_t pageBase = (size_t)mCharts[mTriangleChart[t]].Page * pagePixels;
+        int minX = (std::max)((int)std::floor((std::min)({ x0, x1, x2 }) - ConservativeReach), 0);
+        int minY = (std::max)((int)std::floor((std::min)({ y0, y1, y2 }) - ConservativeReach), 0);
+        int maxX = (std::min)((int)std::ceil((std::max)({ x0, x1, x2 }) + ConservativeReach), (int)size - 1);
+        int maxY = (std::min)((int)std::ceil((std::max)({ y0, y1, y2 }) + ConservativeReach), (int)size - 1);
+
+        for (int py = minY; py <= maxY; py++)
+        {
+            for (int px = minX; px <= maxX; px++)
+            {
+                float cx = px + 0.5f, cy = py + 0.5f;
+                float b1 = ((cx - x0) * (y2 - y0) - (x2 - x0) * (cy - y0)) / area2;
+                float b2 = ((x1 - x0) * (cy - y0) - (cx - x0) * (y1 - y0)) / area2;
+                float distance = 0.0f;
+
+                if (b1 < 0.0f || b2 < 0.0f || b1 + b2 > 1.0f)
+                {
+                    float qx, qy, bestX = 0.0f, bestY = 0.0f;
+                    float best = ClosestOnSegment(cx, cy, x0, y0, x1, y1, bestX, bestY);
+                    float d = ClosestOnSegment(cx, cy, x1, y1, x2, y2, qx, qy);
+                    if (d < best) { best = d; bestX = qx; bestY = qy; }
+                    d = ClosestOnSegment(cx, cy, x2, y2, x0, y0, qx, qy);
+                    if (d < best) { best = d; bestX = qx; bestY = qy; }
+
+                    distance = std::sqrt(best);
+                    if (distance > ConservativeReach)
+                        continue;
+
+                    b1 = std::clamp(((bestX - x0) * (y2 - y0) - (x2 - x0) * (bestY - y0)) / area2, 0.0f, 1.0f);
+                    b2 = std::clamp(((x1 - x0) * (bestY - y0) - (bestX - x0) * (y1 - y0)) / area2, 0.0f, 1.0f - b1);
+                }
+
+                uint32_t pixel = (uint32_t)(pageBase + (size_t)py * size + px);
+                uint32_t& slot = mPixelTexels[pixel];
+                if (slot == NoTexel)
+                {
+                    slot = (uint32_t)mTexels.size();
+                    mTexels.emplace_back();
+                }
+                else if (mTexels[slot].Distance <= distance)
+                {
+                    continue;
+                }
+
+                Texel& texel = mTexels[slot];
+                texel.Pixel = pixel;
+                texel.Triangle = t;
+                texel.B1 = b1;
+                texel.B2 = b2;
+                texel.Distance = distance;
+            }
+        }
+    }
+}
+
+// Из текселя - пакеты лучей от одной точки (BVH обходит их по 4 через SSE):
+// солнце в пределах диска, точки прямоугольных источников, отскок по косинусу.
+// Отскок, попавший в освещённую сторону, несёт её прямой свет одним лучом
+// к солнцу и одним к случайному источнику; промах - свет неба
+void LightmapBaker::TraceTexels(
+    const LightmapMesh& mesh, const TriangleBvh& bvh, const std::vector<LightmapDraw>& draws,
+    const std::vector<LightmapAreaLight>& areaLights, const LightmapBakeDesc& desc, JobSystem& jobs)
+{
+    uint32_t triangles = (uint32_t)(mesh.IndexCount / 3);
+    std::vector<uint32_t> triangleDraws(triangles, NoDraw);
+    std::vector<uint8_t> seeThrough(triangles, 0);
+    for (uint32_t d = 0; d < (uint32_t)draws.size(); d++)
+    {
+        uint32_t end = (std::min)(draws[d].FirstTriangle + draws[d].TriangleCount, triangles);
+        for (uint32_t t = draws[d].FirstTriangle; t < end; t++)
+        {
+            triangleDraws[t] = d;
+            seeThrough[t] = draws[d].SeeThrough ? 1 : 0;
+        }
+    }
+
+    float sun[3] = { desc.SunDirection[0], desc.SunDirection[1], desc.SunDirection[2] };
+    Normalize(sun);
+    float sunCos = std::cos(desc.SunAngle);
+    uint32_t lightCount = (uint32_t)areaLights.size();
+    float defaultAlbedo[3] = { 0.5f, 0.5f, 0.5f };
+
+    mDirect.assign(mTexels.size() * 3, 0.0f);
+    mIndirect.assign(mTexels.size() * 3, 0.0f);
+    mVariance.assign(mTexels.size(), 0.0f);
+    std::atomic<uint64_t> rays{ 0 };
+
+    jobs.ParallelFor((uint32_t)mTexels.size(), [&](uint32_t begin, uint32_t end)
+    {
+        TraceScratch s;
+        uint64_t cast = 0;
+
+        for (uint32_t i = begin; i < end; i++)
+        {
+            const Texel& texel = mTexels[i];
+            Rng rng(desc.Seed * 0xD1B54A32D192ED03ull + i);
+            float step = texel.Size * RayBias;
+
+            s.Rays.clear();
+            s.Weights.clear();
+
+            Ray ray;
+            memcpy(ray.Origin, texel.Offset, sizeof(ray.Origin));
+
+            if (Dot(texel.Normal, sun) > 0.0f)
+            {
+                for (uint32_t k = 0; k < desc.SunSamples; k++)
+                {
+                    ConeSample(sun, sunCos, rng, ray.Dir);
+                    ray.MaxT = FLT_MAX;
+                    float cosSurface = Dot(texel.Normal, ray.Dir);
+                    if (cosSurface <= 0.0f)
+                        continue;
+
+                    s.Rays.push_back(ray);
+                    for (int c = 0; c < 3; c++)
+                        s.Weights.push_back(desc.SunColor[c] * cosSurface / desc.SunSamples);
+                }
+            }
+
+            for (const LightmapAreaLight& light : areaLights)
+            {
+                for (uint32_t k = 0; k < desc.AreaSamples; k++)
+                {
+                    float weight[3];
+                    if (!AreaSample(light, texel.Offset, texel.Normal, 1.0f / desc.AreaSamples, rng, ray, weight))
+                        continue;
+
+                    s.Rays.push_back(ray);
+                    s.Weights.insert(s.Weights.end(), weight, weight + 3);
+                }
+            }
+
+            size_t directRays = s.Rays.size();
+
+            // Ниже самой поверхности (нормаль вершин отклонена от геометрической) - нулевой вклад
+            float lift[3] = {
+                texel.Offset[0] - texel.Position[0],
+                texel.Offset[1] - texel.Position[1],
+                texel.Offset[2] - texel.Position[2] };
+            for (uint32_t k = 0; k < desc.IndirectSamples; k++)
+            {
+                CosineSample(texel.Normal, rng, ray.Dir);
+                ray.MaxT = FLT_MAX;
+                if (Dot(ray.Dir, lift) <= 0.0f)
+                    continue;
+                s.Rays.push_back(ray);
+            }
+
+            cast += TraceOpaque(bvh, seeThrough, desc.SeeThroughLayers, step, s);
+
+            float* direct = &mDirect[(size_t)i * 3];
+            for (size_t r = 0; r < directRays; r++)
+            {
+                if (s.Hits[r].IsHit())
+                    continue;
+                for (int c = 0; c < 3; c++)
+                    direct[c] += s.Weights[r * 3 + c];
+            }
+
+            // Второй пакет: прямой свет в точках попадания отскока
+            float* indirect = &mIndirect[(size_t)i * 3];
+            s.Bounces.clear();
+            s.BounceWeights.clear();
+            s.BounceSamples.clear();
+            s.SampleLuminance.assign(desc.IndirectSamples, 0.0f);
+
+            for (size_t r = directRays; r < s.Rays.size(); r++)
+            {
+                const RayHit& hit = s.Hits[r];
+                const Ray& from = s.Rays[r];
+                uint32_t sample = (uint32_t)(r - directRays);
+                if (!hit.IsHit())
+                {
+                    for (int c = 0; c < 3; c++)
+                        indirect[c] += desc.SkyColor[c];
+                    s.SampleLuminance[sample] = Luminance(desc.SkyColor);
+                    continue;
+                }
+
+                float normal[3];
+                InterpolatedNormal(mesh, hit.Triangle, hit.U, hit.V, normal);
+                if (Dot(normal, from.Dir) >= 0.0f)
+                    continue;   // Изнанка: внутри геометрии света нет
+
+                uint32_t draw = triangleDraws[hit.Triangle];
+                const float* albedo = draw != NoDraw ? draws[draw].Albedo : defaultAlbedo;
+
+                float geometric[3];
+                GeometricNormal(mesh, hit.Triangle, geometric);
+                float side = Dot(geometric, from.Dir) > 0.0f ? -1.0f : 1.0f;
+                uint32_t chart = mTriangleChart[hit.Triangle];
+                float bias = (chart != NoChart ? 1.0f / mCharts[chart].Density : texel.Size) * RayBias;
+
+                Ray bounce;
+                for (int k = 0; k < 3; k++)
+                    bounce.Origin[k] = from.Origin[k] + from.Dir[k] * hit.T + geometric[k] * side * bias;
+
+                if (Dot(normal, sun) > 0.0f)
+                {
+                    ConeSample(sun, sunCos, rng, bounce.Dir);
+                    bounce.MaxT = FLT_MAX;
+                    float cosSurface = Dot(normal, bounce.Dir);
+                    if (cosSurface > 0.0f)
+                    {
+                        s.Bounces.push_back(bounce);
+                        s.BounceSamples.push_back(sample);
+                        for (int c = 0; c < 3; c++)
+                            s.BounceWeights.push_back(albedo[c] * desc.SunColor[c] * cosSurface);
+                    }
+                }
+
+                if (lightCount > 0)
+                {
+                    uint32_t l = (std::min)((uint32_t)(rng.Next() * lightCount), lightCount - 1);
+                    float weight[3];
+                    if (AreaSample(areaLights[l], bounce.Origin, normal, (float)lightCount, rng, bounce, weight))
+                    {
+                        s.Bounces.push_back(bounce);
+                        s.BounceSamples.push_back(sample);
+                        for (int c = 0; c < 3; c++)
+                            s.BounceWeights.push_back(albedo[c] * weight[c]);
+                    }
+                }
+            }
+
+            s.Rays.swap(s.Bounces);
+            s.Weights.swap(s.BounceWeights);
+            cast += TraceOpaque(bvh, seeThrough, desc.SeeThroughLayers, step, s);
+
+            for (size_t r = 0; r < s.Rays.size(); r++)
+            {
+                if (s.Hits[r].IsHit())
+                    continue;
+                for (int c = 0; c < 3; c++)
+                    indirect[c] += s.Weights[r * 3 + c];
+                s.SampleLuminance[s.BounceSamples[r]] += Luminance(&s.Weights[r * 3]);
+            }
+
+            // Дисперсия среднего по выборкам: по ней à-trous отличает шум от перепада
+            if (desc.IndirectSamples > 0)
+            {
+                float n = (float)desc.IndirectSamples;
+                for (int c = 0; c < 3; c++)
+                    indirect[c] /= n;
+
+                float sum = 0.0f, sumSq = 0.0f;
+                for (float l : s.SampleLuminance)
+                {
+                    sum += l;
+                    sumSq += l * l;
+                }
+                float mean = sum / n;
+                mVariance[i] = (std::max)(sumSq / n - mean * mean, 0.0f) / n;
+            }
+        }
+
+        rays += cast;
+    }, 16);
+
+    mStats.Rays = rays;
+}
+
+// À-trous (Dammertz et al. 2010) по непрямой части: ядро B3-сплайна 5x5 с шагом
+// 1, 2, 4...; вес соседа падает с углом между нормалями, расстоянием в мире
+// (соседние в атласе чужие карты и края стен не смешиваются) и разницей
+// яркостей в стандартных отклонениях шума, как в SVGF: перепады, которые шумом
+// не объяснить, не размываются. Дисперсия фильтруется вместе с цветом.
+// Прямой свет не трогается: его тени резкие и шумят мало
+void LightmapBaker::Denoise(uint32_t passes, JobSystem& jobs)
+{
+    static const float Kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+    uint32_t size = mUnwrap.PageSize;
+    size_t pagePixels = (size_t)size * size;
+    std::vector<float> filtered(mIndirect.size());
+    std::vector<float> filteredVariance(mVariance.size());
+
+    for (uint32_t pass = 0; pass < passes; pass++)
+    {
+        int step = 1 << pass;
+
+        jobs.ParallelFor((uint32_t)mTexels.size(), [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                const Texel& texel = mTexels[i];
+                size_t pageBase = texel.Pixel / pagePixels * pagePixels;
+                int x = (int)(texel.Pixel % size);
+                int y = (int)(texel.Pixel % pagePixels / size);
+                float sigma = 2.0f * step * texel.Size;
+                float invSigmaSq = 1.0f / (sigma * sigma);
+                float luminance = Luminance(&mIndirect[(size_t)i * 3]);
+                float invLuminanceSigma = 1.0f / (LuminanceSigma * std::sqrt(mVariance[i]) + 1e-4f);
+
+                float sum[3] = {};
+                float weightSum = 0.0f;
+                float varianceSum = 0.0f;
+
+                for (int dy = -2; dy <= 2; dy++)
+                {
+                    int ny = y + dy * step;
+                    if (ny < 0 || ny >= (int)size)
+                        continue;
+
+                    for (int dx = -2; dx <= 2; dx++)
+                    {
+                        int nx = x + dx * step;
+                        if (nx < 0 || nx >= (int)size)
+                            continue;
+
+                        uint32_t j = mPixelTexels[pageBase + (size_t)ny * size + nx];
+                        if (j == NoTexel)
+                            continue;
+
+                        const Texel& other = mTexels[j];
+                        float w = Dot(texel.Normal, other.Normal);
+                        if (w <= 0.0f)
+                            continue;
+
+                        // cos^32
+                        for (int k = 0; k < 5; k++)
+                            w *= w;
+
+                        float d[3] = {
+                            other.Position[0] - texel.Position[0],
+                            other.Position[1] - texel.Position[1],
+                            other.Position[2] - texel.Position[2] };
+                        float luminanceGap = std::fabs(Luminance(&mIndirect[(size_t)j * 3]) - luminance);
+                        w *= Kernel[dx + 2] * Kernel[dy + 2] *
+                            std::exp(-Dot(d, d) * invSigmaSq - luminanceGap * invLuminanceSigma);
+
+                        for (int c = 0; c < 3; c++)
+                            sum[c] += mIndirect[(size_t)j * 3 + c] * w;
+                        weightSum += w;
+                        varianceSum += mVariance[j] * w * w;
+                    }
+                }
+
+                // Сам тексель всегда с весом > 0
+                for (int c = 0; c < 3; c++)
+                    filtered[(size_t)i * 3 + c] = sum[c] / weightSum;
+                filteredVariance[i] = varianceSum / (weightSum * weightSum);
+            }
+        }, 1024);
+
+        mIndirect.swap(filtered);
+        mVariance.swap(filteredVariance);
+    }
+}
+
+// Мипы взвешены покрытием: пустые тексели не затемняют края карт. Пустые соседи
+// покрытых получают их средний цвет (с нулевой альфой), чтобы билинейная
+// выборка на краю не тянула чёрный
+void LightmapBaker::BuildMips(const LightmapBakeDesc& desc, JobSystem& jobs)
+{
+    uint32_t size = mUnwrap.PageSize;
+    size_t pagePixels = (size_t)size * size;
+    uint32_t pages = mStats.Pages;
+
+    mMipCount = 1;
+    while (size >> mMipCount)
+        mMipCount++;
+    mMips.assign((size_t)pages * mMipCount, {});
+
+    float scale = 1.0f / desc.Range;
+
+    jobs.ParallelFor(pages, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t page = begin; page < end; page++)
+        {
+            std::vector<float> color(pagePixels * 3, 0.0f);
+            std::vector<float> weight(pagePixels, 0.0f);
+
+            for (size_t p = 0; p < pagePixels; p++)
+            {
+                uint32_t t = mPixelTexels[page * pagePixels + p];
+                if (t == NoTexel)
+                    continue;
+                for (int c = 0; c < 3; c++)
+                    color[p * 3 + c] = mDirect[(size_t)t * 3 + c] + mIndirect[(size_t)t * 3 + c];
+                weight[p] = 1.0f;
+            }
+
+            std::vector<float> nextColor, nextWeight;
+            for (uint32_t mip = 0; mip < mMipCount; mip++)
+            {
+                uint32_t w = (std::max)(1u, size >> mip);
+
+                if (mip > 0)
+                {
+                    uint32_t pw = w * 2;
+                    nextColor.assign((size_t)w * w * 3, 0.0f);
+                    nextWeight.assign((size_t)w * w, 0.0f);
+
+                    for (uint32_t y = 0; y < w; y++)
+                    {
+                        for (uint32_t x = 0; x < w; x++)
+                        {
+                            size_t dst = (size_t)y * w + x;
+                            for (uint32_t s = 0; s < 4; s++)
+                            {
+                                size_t src = (size_t)(y * 2 + s / 2) * pw + x * 2 + s % 2;
+                                for (int c = 0; c < 3; c++)
+                                    nextColor[dst * 3 + c] += color[src * 3 + c] * weight[src];
+                                nextWeight[dst] += weight[src];
+                            }
+                            if (nextWeight[dst] > 0.0f)
+                            {
+                                for (int c = 0; c < 3; c++)
+                                    nextColor[dst * 3 + c] /= nextWeight[dst];
+                            }
+                            nextWeight[dst] *= 0.25f;
+                        }
+                    }
+
+                    color.swap(nextColor);
+                    weight.swap(nextWeight);
+                }
+
+                std::vector<uint8_t>& out = mMips[(size_t)page * mMipCount + mip];
+                out.resize((size_t)w * w * 4);
+
+                for (uint32_t y = 0; y < w; y++)
+                {
+                    for (uint32_t x = 0; x < w; x++)
+                    {
+                        size_t p = (size_t)y * w + x;
+                        float rgb[3] = { color[p * 3 + 0], color[p * 3 + 1], color[p * 3 + 2] };
+
+                        if (weight[p] == 0.0f)
+                        {
+                            float count = 0.0f;
+                            rgb[0] = rgb[1] = rgb[2] = 0.0f;
+                            for (int dy = -1; dy <= 1; dy++)
+                            {
+                                for (int dx = -1; dx <= 1; dx++)
+                                {
+                                    int nx = (int)x + dx, ny = (int)y + dy;
+                                    if (nx < 0 || ny < 0 || nx >= (int)w || ny >= (int)w)
+                                        continue;
+                                    size_t n = (size_t)ny * w + nx;
+                                    if (weight[n] == 0.0f)
+                                        continue;
+                                    for (int c = 0; c < 3; c++)
+                                        rgb[c] += color[n * 3 + c];
+                                    count += 1.0f;
+                                }
+                            }
+                            if (count > 0.0f)
+                            {
+                                for (int c = 0; c < 3; c++)
+                                    rgb[c] /= count;
+                            }
+                        }
+
+                        out[p * 4 + 0] = EncodeUnorm(rgb[0] * scale);
+                        out[p * 4 + 1] = EncodeUnorm(rgb[1] * scale);
+                        out[p * 4 + 2] = EncodeUnorm(rgb[2] * scale);
+                        out[p * 4 + 3] = EncodeUnorm(weight[p]);
+                    }
+                }
+            }
+        }
+    }, 1);
+}
+
+bool LightmapBaker::Save(const std::string& path) const
+{
+    if (mMips.empty())
+        return false;
+
+    std::vector<const uint8_t*> subresources;
+    for (const std::vector<uint8_t>& mip : mMips)
+        subresources.push_back(mip.data());
+
+    // Как в ShaderCache: запись во временный файл и переименование
+    std::string tempPath = path + ".part";
+    if (!SaveDDS(tempPath, DdsFormat::R8G8B8A8_UNORM, mUnwrap.PageSize, mUnwrap.PageSize,
+            mMipCount, mStats.Pages, subresources.data()))
+        return false;
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,122 @@
+﻿#include "../h/MipChain.h"
+#include <algorithm>
+
+uint32_t FullMipCount(uint32_t width, uint32_t height)
+{
+    uint32_t mipCount = 1;
+    while (std::max(width, height) > 1)
+    {
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+        ++mipCount;
+    }
+    return mipCount;
+}
+
+void TgaToBGRA(const TgaImage& image, std::vector<uint8_t>& out)
+{
+    size_t pixelCount = size_t(image.width) * image.height;
+    out.resize(pixelCount * 4);
+
+    if (image.channels == 4)
+    {
+        std::copy(image.data.begin(), image.data.begin() + pixelCount * 4, out.begin());
+        return;
+    }
+
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        out[i * 4 + 0] = image.data[i * image.channels + 0];
+        out[i * 4 + 1] = image.data[i * image.channels + 1];
+        out[i * 4 + 2] = image.data[i * image.channels + 2];
+        out[i * 4 + 3] = 255;
+    }
+}
+
+void TgaRowToBGRA(const uint8_t* src, uint32_t width, uint32_t channels, uint8_t* dst)
+{
+    if (channels == 4)
+    {
+        std::copy(src, src + size_t(width) * 4, dst);
+        return;
+    }
+
+    for (uint32_t x = 0; x < width; x++)
+    {
+        dst[x * 4 + 0] = src[x * channels + 0];
+        dst[x * 4 + 1] = src[x * channels + 1];
+        dst[x * 4 + 2] = src[x * channels + 2];
+        dst[x * 4 + 3] = 255;
+    }
+}
+
+void DownsampleTgaToBGRA(const TgaView& view, std::vector<uint8_t>& dst)
+{
+    uint32_t width = view.width;
+    uint32_t height = view.height;
+    uint32_t channels = view.channels;
+    uint32_t nw = std::max(1u, width / 2);
+    uint32_t nh = std::max(1u, height / 2);
+    dst.resize(size_t(nw) * nh * 4);
+
+    for (uint32_t y = 0; y < nh; y++)
+    {
+        const uint8_t* row0 = view.pixels + size_t(std::min(y * 2, height - 1)) * width * channels;
+        const uint8_t* row1 = view.pixels + size_t(std::min(y * 2 + 1, height - 1)) * width * channels;
+        for (uint32_t x = 0; x < nw; x++)
+        {
+            uint32_t x0 = std::min(x * 2, width - 1) * channels;
+            uint32_t x1 = std::min(x * 2 + 1, width - 1) * channels;
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                uint32_t sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+                dst[(size_t(y) * nw + x) * 4 + c] = uint8_t((sum + 2) / 4);
+            }
+
+            uint32_t alpha = channels == 4
+                ? (row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3] + 2) / 4
+                : 255;
+            dst[(size_t(y) * nw + x) * 4 + 3] = uint8_t(alpha);
+        }
+    }
+}
+
+void DownsampleBGRA(const std::vector<uint8_t>& src, uint32_t width, uint32_t height, std::vector<uint8_t>& dst)
+{
+    uint32_t nw = std::max(1u, width / 2);
+    uint32_t nh = std::max(1u, height / 2);
+    dst.resize(size_t(nw) * nh * 4);
+
+    for (uint32_t y = 0; y < nh; y++)
+    {
+        uint32_t y0 = std::min(y * 2, height - 1);
+        uint32_t y1 = std::min(y * 2 + 1, height - 1);
+        for (uint32_t x = 0; x < nw; x++)
+        {
+            uint32_t x0 = std::min(x * 2, width - 1);
+            uint32_t x1 = std::min(x * 2 + 1, width - 1);
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                uint32_t sum = src[(y0 * width + x0) * 4 + c] + src[(y0 * width + x1) * 4 + c] +
+                               src[(y1 * width + x0) * 4 + c] + src[(y1 * width + x1) * 4 + c];
+                dst[(y * nw + x) * 4 + c] = uint8_t((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+void BuildMipChain(const TgaImage& image, std::vector<std::vector<uint8_t>>& mips)
+{
+    uint32_t w = image.width;
+    uint32_t h = image.height;
+
+    mips.resize(FullMipCount(w, h));
+    TgaToBGRA(image, mips[0]);
+
+    for (size_t mip = 1; mip < mips.size(); ++mip)
+    {
+        DownsampleBGRA(mips[mip - 1], w, h, mips[mip]);
+        w = std::max(1u, w / 2);
+        h = std::max(1u, h / 2);
+    }
+}
@@ -0,0 +1,351 @@
+﻿#include "../h/OcclusionCuller.h"
+#include <chrono>
+#include <numeric>
+
+// OCCLUSION_CULLER_NO_SSE - скалярный путь и на x86 (OcclusionCullerScalarTest)
+#if !defined(OCCLUSION_CULLER_NO_SSE) && (defined(_M_X64) || defined(_M_IX86) || defined(__SSE__))
+#include <xmmintrin.h>
+#define OCCLUSION_CULLER_SSE 1
+#endif
+
+namespace
+{
+    // Ближе этого w вершина считается у камеры: такие треугольники в окклюдеры
+    // не идут, а такие боксы всегда видимы
+    const float MinW = 1e-3f;
+
+    const float DepthBias = 1e-5f;
+
+    void TransformPoint(const float m[4][4], float x, float y, float z, float out[4])
+    {
+        for (int j = 0; j < 4; j++)
+            out[j] = x * m[0][j] + y * m[1][j] + z * m[2][j] + m[3][j];
+    }
+}
+
+OcclusionCuller::OcclusionCuller(JobSystem& jobs, double budgetUs)
+    : mBudgetUs(budgetUs)
+    , mJobs(jobs)
+{
+    mMinDepth.emplace_back(Width * Height, 1.0f);
+    mMaxDepth.emplace_back(Width * Height, 1.0f);
+    for (uint32_t w = Width / 2, h = Height / 2; w > 0 && h > 0; w /= 2, h /= 2)
+    {
+        mMinDepth.emplace_back(w * h, 1.0f);
+        mMaxDepth.emplace_back(w * h, 1.0f);
+    }
+
+    // Полоса на каждый поток системы задач; высота полосы кратна 4
+    mBandCount = jobs.ThreadCount();
+    while (mBandCount > 1 && Height / mBandCount < 4)
+        mBandCount--;
+}
+
+void OcclusionCuller::SetOccluderMesh(
+    const float* positions, size_t vertexStride, const uint32_t* indices, size_t indexCount,
+    uint32_t maxTriangles)
+{
+    size_t triangleCount = indexCount / 3;
+    std::vector<float> areas(triangleCount);
+
+    auto vertex = [&](uint32_t index)
+    {
+        return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + index * vertexStride);
+    };
+
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const float* a = vertex(indices[t * 3 + 0]);
+        const float* b = vertex(indices[t * 3 + 1]);
+        const float* c = vertex(indices[t * 3 + 2]);
+
+        float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float nx = e1[1] * e2[2] - e1[2] * e2[1];
+        float ny = e1[2] * e2[0] - e1[0] * e2[2];
+        float nz = e1[0] * e2[1] - e1[1] * e2[0];
+        areas[t] = nx * nx + ny * ny + nz * nz;
+    }
+
+    std::vector<uint32_t> order(triangleCount);
+    std::iota(order.begin(), order.end(), 0u);
+
+    size_t keep = (std::min)(triangleCount, (size_t)maxTriangles);
+    std::partial_sort(order.begin(), order.begin() + keep, order.end(),
+        [&](uint32_t a, uint32_t b) { return areas[a] > areas[b]; });
+
+    mOccluders.clear();
+    mOccluders.reserve(keep * 9);
+    for (size_t i = 0; i < keep; i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            const float* p = vertex(indices[order[i] * 3 + k]);
+            mOccluders.insert(mOccluders.end(), p, p + 3);
+        }
+    }
+
+    mTriangleLimit = (uint32_t)keep;
+}
+
+void OcclusionCuller::Render(const float viewProj[4][4])
+{
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            mViewProj[i][j] = viewProj[i][j];
+
+    // ===== ВЕРШИНЫ В ПИКСЕЛИ =====
+    mTriangles.clear();
+    for (uint32_t t = 0; t < mTriangleLimit; t++)
+    {
+        const float* p = &mOccluders[t * 9];
+        ScreenTriangle tri;
+        bool nearCamera = false;
+
+        for (int k = 0; k < 3; k++)
+        {
+            float clip[4];
+            TransformPoint(mViewProj, p[k * 3 + 0], p[k * 3 + 1], p[k * 3 + 2], clip);
+            if (clip[3] < MinW)
+            {
+                nearCamera = true;
+                break;
+            }
+
+            float invW = 1.0f / clip[3];
+            tri.X[k] = (clip[0] * invW * 0.5f + 0.5f) * Width;
+            tri.Y[k] = (0.5f - clip[1] * invW * 0.5f) * Height;
+            tri.Z[k] = clip[2] * invW;
+        }
+
+        // Без отсечения по ближней плоскости: такой треугольник просто не окклюдер
+        if (!nearCamera)
+            mTriangles.push_back(tri);
+    }
+
+    // ===== РАСТЕРИЗАЦИЯ ПОЛОСАМИ =====
+    mJobs.ParallelFor(mBandCount, [this](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t band = begin; band < end; band++)
+            RasterizeBand(band);
+    }, 1);
+
+    BuildHierarchy();
+
+    mStats.OccluderTriangles = (uint32_t)mTriangles.size();
+    mStats.RenderUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    // Не уложились в бюджет - в следующем кадре меньше окклюдеров, с запасом - больше
+    uint32_t total = (uint32_t)(mOccluders.size() / 9);
+    if (mStats.RenderUs > mBudgetUs)
+        mTriangleLimit = (std::max)(mTriangleLimit * 3 / 4, (std::min)(total, 64u));
+    else if (mStats.RenderUs < mBudgetUs * 0.5)
+        mTriangleLimit = (std::min)(mTriangleLimit + mTriangleLimit / 4 + 1, total);
+}
+
+void OcclusionCuller::RasterizeBand(uint32_t band)
+{
+    uint32_t bandHeight = (Height / mBandCount) & ~3u;
+    int bandY0 = (int)(band * bandHeight);
+    int bandY1 = band + 1 == mBandCount ? (int)Height : bandY0 + (int)bandHeight;
+
+    float* depth = mMinDepth[0].data();
+    std::fill(depth + bandY0 * Width, depth + bandY1 * Width, 1.0f);
+
+    for (const ScreenTriangle& tri : mTriangles)
+    {
+        float x0 = tri.X[0], y0 = tri.Y[0];
+        float x1 = tri.X[1], y1 = tri.Y[1];
+        float x2 = tri.X[2], y2 = tri.Y[2];
+
+        float area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+        if (area == 0.0f)
+            continue;
+
+        // Обе стороны: порядок обхода приводим к положительной площади
+        float sign = area > 0.0f ? 1.0f : -1.0f;
+        area *= sign;
+
+        int minX = (std::max)((int)std::floor((std::min)({ x0, x1, x2 })), 0);
+        int maxX = (std::min)((int)std::ceil((std::max)({ x0, x1, x2 })), (int)Width - 1);
+        int minY = (std::max)((int)std::floor((std::min)({ y0, y1, y2 })), bandY0);
+        int maxY = (std::min)((int)std::ceil((std::max)({ y0, y1, y2 })), bandY1 - 1);
+        if (minX > maxX || minY > maxY)
+            continue;
+
+        // Рёберные функции E(x, y) = A * x + B * y + C, внутри все >= 0
+        float a0 = sign * (y1 - y2), b0 = sign * (x2 - x1), c0 = sign * (x1 * y2 - x2 * y1);
+        float a1 = sign * (y2 - y0), b1 = sign * (x0 - x2), c1 = sign * (x2 * y0 - x0 * y2);
+        float a2 = sign * (y0 - y1), b2 = sign * (x1 - x0), c2 = sign * (x0 * y1 - x1 * y0);
+
+        // Глубина линейна в экранном пространстве: z = zA * x + zB * y + zC
+        float invArea = 1.0f / area;
+        float zA = (a0 * tri.Z[0] + a1 * tri.Z[1] + a2 * tri.Z[2]) * invArea;
+        float zB = (b0 * tri.Z[0] + b1 * tri.Z[1] + b2 * tri.Z[2]) * invArea;
+        float zC = (c0 * tri.Z[0] + c1 * tri.Z[1] + c2 * tri.Z[2]) * invArea;
+
+        int startX = minX & ~3;
+
+#ifdef OCCLUSION_CULLER_SSE
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            float py = y + 0.5f;
+            __m128 row0 = _mm_set1_ps(b0 * py + c0);
+            __m128 row1 = _mm_set1_ps(b1 * py + c1);
+            __m128 row2 = _mm_set1_ps(b2 * py + c2);
+            __m128 rowZ = _mm_set1_ps(zB * py + zC);
+
+            for (int x = startX; x <= maxX; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a0), px), row0);
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a1), px), row1);
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a2), px), row2);
+
+                __m128 inside = _mm_and_ps(
+                    _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+                    _mm_cmpge_ps(e2, zero));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+
+                __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px), rowZ);
+                float* dst = depth + y * Width + x;
+                __m128 old = _mm_loadu_ps(dst);
+                __m128 nearer = _mm_min_ps(old, z);
+                _mm_storeu_ps(dst, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+            }
+        }
+#else
+        for (int y = minY; y <= maxY; y++)
+        {
+            float py = y + 0.5f;
+            for (int x = startX; x <= maxX; x++)
+            {
+                float px = x + 0.5f;
+                if (a0 * px + b0 * py + c0 < 0.0f ||
+                    a1 * px + b1 * py + c1 < 0.0f ||
+                    a2 * px + b2 * py + c2 < 0.0f)
+                    continue;
+
+                float z = zA * px + zB * py + zC;
+                float& dst = depth[y * Width + x];
+                dst = (std::min)(dst, z);
+            }
+        }
+#endif
+    }
+}
+
+void OcclusionCuller::BuildHierarchy()
+{
+    mMaxDepth[0] = mMinDepth[0];
+
+    uint32_t w = Width;
+    for (size_t level = 1; level < mMinDepth.size(); level++)
+    {
+        uint32_t nw = w / 2;
+        const std::vector<float>& srcMin = mMinDepth[level - 1];
+        const std::vector<float>& srcMax = mMaxDepth[level - 1];
+        std::vector<float>& dstMin = mMinDepth[level];
+        std::vector<float>& dstMax = mMaxDepth[level];
+
+        for (size_t i = 0; i < dstMin.size(); i++)
+        {
+            size_t x = (i % nw) * 2;
+            size_t y = (i / nw) * 2;
+            size_t s0 = y * w + x;
+            size_t s1 = s0 + w;
+
+            dstMin[i] = (std::min)({ srcMin[s0], srcMin[s0 + 1], srcMin[s1], srcMin[s1 + 1] });
+            dstMax[i] = (std::max)({ srcMax[s0], srcMax[s0 + 1], srcMax[s1], srcMax[s1 + 1] });
+        }
+
+        w = nw;
+    }
+}
+
+// Спуск по иерархии: если везде окклюдеры ближе бокса - перекрыт, если где-то
+// все окклюдеры дальше - виден, иначе уточняем на уровне ниже
+bool OcclusionCuller::IsVisible(const Aabb& box)
+{
+    mStats.Tested++;
+
+    if (box.IsEmpty())
+        return true;
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float boxZ = FLT_MAX;
+
+    for (int corner = 0; corner < 8; corner++)
+    {
+        float clip[4];
+        TransformPoint(mViewProj,
+            (corner & 1) ? box.Max[0] : box.Min[0],
+            (corner & 2) ? box.Max[1] : box.Min[1],
+            (corner & 4) ? box.Max[2] : box.Min[2],
+            clip);
+
+        if (clip[3] < MinW)
+            return true;
+
+        float invW = 1.0f / clip[3];
+        float sx = (clip[0] * invW * 0.5f + 0.5f) * Width;
+        float sy = (0.5f - clip[1] * invW * 0.5f) * Height;
+        minX = (std::min)(minX, sx);
+        maxX = (std::max)(maxX, sx);
+        minY = (std::min)(minY, sy);
+        maxY = (std::max)(maxY, sy);
+        boxZ = (std::min)(boxZ, clip[2] * invW);
+    }
+
+    int x0 = (std::max)((int)std::floor(minX), 0);
+    int y0 = (std::max)((int)std::floor(minY), 0);
+    int x1 = (std::min)((int)std::ceil(maxX), (int)Width - 1);
+    int y1 = (std::min)((int)std::ceil(maxY), (int)Height - 1);
+    if (x0 > x1 || y0 > y1)
+        return true;
+
+    boxZ -= DepthBias;
+
+    // Верхний уровень - где бокс занимает не больше 2x2 текселей, нижний - 8x8
+    int topLevel = 0;
+    while (topLevel + 1 < (int)mMinDepth.size() && ((x1 >> topLevel) - (x0 >> topLevel) > 1 || (y1 >> topLevel) - (y0 >> topLevel) > 1))
+        topLevel++;
+
+    int bottomLevel = 0;
+    while (bottomLevel < topLevel && ((x1 >> bottomLevel) - (x0 >> bottomLevel) > 7 || (y1 >> bottomLevel) - (y0 >> bottomLevel) > 7))
+        bottomLevel++;
+
+    for (int level = topLevel; level >= bottomLevel; level--)
+    {
+        uint32_t levelWidth = Width >> level;
+        const std::vector<float>& minDepth = mMinDepth[level];
+        const std::vector<float>& maxDepth = mMaxDepth[level];
+
+        bool allOccluded = true;
+        for (int ty = y0 >> level; ty <= (y1 >> level); ty++)
+        {
+            for (int tx = x0 >> level; tx <= (x1 >> level); tx++)
+            {
+                size_t t = ty * levelWidth + tx;
+                if (minDepth[t] > boxZ)
+                    return true;
+                if (maxDepth[t] >= boxZ)
+                    allOccluded = false;
+            }
+        }
+
+        if (allOccluded)
+        {
+            mStats.Occluded++;
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,32 @@
+﻿#include "../h/ParallelRecorder.h"
+#include <algorithm>
+
+void SplitDraws(size_t count, uint32_t maxSlices, size_t minPerSlice, std::vector<DrawSlice>& out)
+{
+    out.clear();
+
+    size_t sliceCount = (std::max)(minPerSlice, (size_t)1);
+    sliceCount = (std::min)(count / sliceCount, (size_t)maxSlices);
+    sliceCount = (std::max)(sliceCount, (size_t)1);
+
+    // Первые count % sliceCount кусков на одну отрисовку длиннее
+    size_t base = count / sliceCount;
+    size_t extra = count % sliceCount;
+    size_t begin = 0;
+
+    for (size_t i = 0; i < sliceCount; i++)
+    {
+        size_t length = base + (i < extra ? 1 : 0);
+        out.push_back({ begin, begin + length });
+        begin += length;
+    }
+}
+
+void ParallelRecorder::Record(const std::vector<DrawSlice>& slices, const RecordFn& record)
+{
+    mJobs.ParallelFor((uint32_t)slices.size(), [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t slice = begin; slice < end; slice++)
+            record(slice, slices[slice]);
+    }, 1);
+}
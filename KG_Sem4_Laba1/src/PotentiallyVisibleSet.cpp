@@ -0,0 +1,431 @@
+﻿#include "../h/PotentiallyVisibleSet.h"
+#include "../h/ShaderCache.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+namespace
+{
+    const uint32_t PvsMagic = 0x31535650; // "PVS1"
+    const uint32_t NoDraw = UINT32_MAX;
+
+    struct PvsHeader
+    {
+        uint32_t Magic = PvsMagic;
+        uint32_t DrawCount = 0;
+        uint64_t Key = 0;
+        float Origin[3] = {};
+        float CellSize = 0.0f;
+        uint32_t Dims[3] = {};
+        uint32_t RowCount = 0;
+        uint64_t Checksum = 0;
+    };
+
+    // Расстояние между боксами (0 - пересекаются)
+    float BoxGap(const Aabb& a, const float min[3], const float max[3])
+    {
+        float sum = 0.0f;
+        for (int k = 0; k < 3; k++)
+        {
+            float d = (std::max)({ a.Min[k] - max[k], min[k] - a.Max[k], 0.0f });
+            sum += d * d;
+        }
+        return std::sqrt(sum);
+    }
+
+    uint32_t CountVisible(const uint64_t* row, uint32_t words)
+    {
+        uint32_t count = 0;
+        for (uint32_t w = 0; w < words; w++)
+            count += (uint32_t)std::popcount(row[w]);
+        return count;
+    }
+}
+
+void PotentiallyVisibleSet::Bake(
+    const TriangleBvh& bvh, const std::vector<PvsDraw>& draws, const Aabb& bounds,
+    const PvsBakeDesc& desc, JobSystem& jobs)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    mStats = {};
+    mCellSize = desc.CellSize;
+    for (int k = 0; k < 3; k++)
+    {
+        mOrigin[k] = bounds.Min[k];
+        mDims[k] = (std::max)((uint32_t)std::ceil((bounds.Max[k] - bounds.Min[k]) / mCellSize), 1u);
+    }
+    mDrawCount = (uint32_t)draws.size();
+    mWords = (mDrawCount + 63) / 64;
+
+    uint32_t cells = mDims[0] * mDims[1] * mDims[2];
+
+    // Треугольник BVH -> отрисовка; треугольники вне отрисовок ничего не отмечают
+    uint32_t triangleCount = 0;
+    for (const PvsDraw& draw : draws)
+        triangleCount = (std::max)(triangleCount, draw.FirstTriangle + draw.TriangleCount);
+
+    std::vector<uint32_t> triangleDraws(triangleCount, NoDraw);
+    for (uint32_t d = 0; d < mDrawCount; d++)
+    {
+        std::fill_n(triangleDraws.begin() + draws[d].FirstTriangle, draws[d].TriangleCount, d);
+    }
+
+    // Проходима ячейка, под центром которой есть пол (или крыша)
+    std::vector<uint8_t> walkable(cells, 0);
+    jobs.ParallelFor(cells, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t c = begin; c < end; c++)
+        {
+            uint32_t xyz[3] = { c % mDims[0], c / mDims[0] % mDims[1], c / (mDims[0] * mDims[1]) };
+
+            Ray ray;
+            for (int k = 0; k < 3; k++)
+                ray.Origin[k] = mOrigin[k] + (xyz[k] + 0.5f) * mCellSize;
+            ray.Dir[0] = 0.0f;
+            ray.Dir[1] = -1.0f;
+            ray.Dir[2] = 0.0f;
+            walkable[c] = bvh.Intersect(ray).IsHit() ? 1 : 0;
+        }
+    }, 64);
+
+    std::vector<uint64_t> rows((size_t)cells * mWords, 0);
+    std::atomic<uint64_t> rays{ 0 };
+    jobs.ParallelFor(cells, [&](uint32_t begin, uint32_t end)
+    {
+        uint64_t cast = 0;
+        for (uint32_t c = begin; c < end; c++)
+        {
+            if (walkable[c])
+                cast += BakeCell(bvh, draws, triangleDraws, desc, c, &rows[(size_t)c * mWords]);
+        }
+        rays += cast;
+    }, 1);
+
+    // Расширение соседями: из рядом стоящей точки видно то же самое, а лучи
+    // из ячейки, чей центр в колонне или стене, видят меньше, чем камера у её края
+    if (desc.Dilation > 0)
+    {
+        std::vector<uint64_t> dilated(rows.size(), 0);
+        int reach = (int)desc.Dilation;
+
+        jobs.ParallelFor(cells, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t c = begin; c < end; c++)
+            {
+                if (!walkable[c])
+                    continue;
+
+                int x = (int)(c % mDims[0]), y = (int)(c / mDims[0] % mDims[1]), z = (int)(c / (mDims[0] * mDims[1]));
+                uint64_t* row = &dilated[(size_t)c * mWords];
+
+                for (int nz = (std::max)(z - reach, 0); nz <= (std::min)(z + reach, (int)mDims[2] - 1); nz++)
+                    for (int ny = (std::max)(y - reach, 0); ny <= (std::min)(y + reach, (int)mDims[1] - 1); ny++)
+                        for (int nx = (std::max)(x - reach, 0); nx <= (std::min)(x + reach, (int)mDims[0] - 1); nx++)
+                        {
+                            const uint64_t* neighbour = &rows[(size_t)CellIndex(nx, ny, nz) * mWords];
+                            for (uint32_t w = 0; w < mWords; w++)
+                                row[w] |= neighbour[w];
+                        }
+            }
+        }, 16);
+
+        rows.swap(dilated);
+    }
+
+    Compress(rows, walkable, (uint32_t)(desc.MergeSlack * mDrawCount));
+
+    mStats.Rays = rays;
+    mStats.BakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t PotentiallyVisibleSet::BakeCell(
+    const TriangleBvh& bvh, const std::vector<PvsDraw>& draws, const std::vector<uint32_t>& triangleDraws,
+    const PvsBakeDesc& desc, uint32_t cell, uint64_t* row) const
+{
+    uint32_t xyz[3] = { cell % mDims[0], cell / mDims[0] % mDims[1], cell / (mDims[0] * mDims[1]) };
+    float cellMin[3], cellMax[3];
+    for (int k = 0; k < 3; k++)
+    {
+        cellMin[k] = mOrigin[k] + xyz[k] * mCellSize;
+        cellMax[k] = cellMin[k] + mCellSize;
+    }
+
+    // Отрисовки вплотную к ячейке видны всегда: мелкие у самой камеры лучи
+    // пропускают чаще всего, а заметнее всего пропажа именно их
+    for (uint32_t d = 0; d < mDrawCount; d++)
+    {
+        if (BoxGap(draws[d].Bounds, cellMin, cellMax) <= mCellSize)
+            row[d / 64] |= 1ull << (d % 64);
+    }
+
+    // Своя последовательность у каждой ячейки: результат не зависит от числа потоков
+    std::mt19937 random(desc.Seed * 0x9E3779B9u ^ cell);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const float Pi = 3.14159265f;
+    const float Step = mCellSize * 1e-3f;
+
+    const uint32_t Batch = 256;
+    Ray rays[Batch];
+    RayHit hits[Batch];
+    uint64_t cast = 0;
+
+    for (uint32_t done = 0; done < desc.RaysPerCell; done += Batch)
+    {
+        uint32_t count = (std::min)(Batch, desc.RaysPerCell - done);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            Ray& ray = rays[i];
+            for (int k = 0; k < 3; k++)
+                ray.Origin[k] = cellMin[k] + unit(random) * mCellSize;
+
+            // Равномерно по сфере
+            float y = 2.0f * unit(random) - 1.0f;
+            float phi = 2.0f * Pi * unit(random);
+            float r = std::sqrt((std::max)(1.0f - y * y, 0.0f));
+            ray.Dir[0] = r * std::cos(phi);
+            ray.Dir[1] = y;
+            ray.Dir[2] = r * std::sin(phi);
+            ray.MaxT = FLT_MAX;
+        }
+
+        // Сквозь SeeThrough луч продолжается от точки попадания
+        for (uint32_t layer = 0; count > 0 && layer <= desc.SeeThroughLayers; layer++)
+        {
+            bvh.Intersect(rays, count, hits);
+            cast += count;
+
+            uint32_t next = 0;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if (!hits[i].IsHit() || hits[i].Triangle >= triangleDraws.size())
+                    continue;
+
+                uint32_t d = triangleDraws[hits[i].Triangle];
+                if (d == NoDraw)
+                    continue;
+
+                row[d / 64] |= 1ull << (d % 64);
+                if (!draws[d].SeeThrough)
+                    continue;
+
+                Ray& ray = rays[next++];
+                ray = rays[i];
+                for (int k = 0; k < 3; k++)
+                    ray.Origin[k] += ray.Dir[k] * (hits[i].T + Step);
+            }
+            count = next;
+        }
+    }
+
+    return cast;
+}
+
+// Соседние ячейки видят почти одно и то же, но выборка лучей делает их строки
+// чуть разными. Строка сливается со строкой уже обработанного соседа,
+// если объединение добавит любой ячейке этой строки не больше maxExtra отрисовок:
+// объединение только расширяет видимость и остаётся консервативным.
+// Непроходимые ячейки строк не получают.
+void PotentiallyVisibleSet::Compress(
+    const std::vector<uint64_t>& rows, const std::vector<uint8_t>& walkableCells, uint32_t maxExtra)
+{
+    uint32_t cells = mDims[0] * mDims[1] * mDims[2];
+    mCellRows.assign(cells, 0);
+    mRows.clear();
+
+    std::vector<uint32_t> minVisible;   // Наименьшая своя видимость среди ячеек строки
+
+    for (uint32_t c = 0; c < cells; c++)
+    {
+        if (!walkableCells[c])
+            continue;
+
+        const uint64_t* row = &rows[(size_t)c * mWords];
+        uint32_t own = CountVisible(row, mWords);
+
+        int x = (int)(c % mDims[0]), y = (int)(c / mDims[0] % mDims[1]), z = (int)(c / (mDims[0] * mDims[1]));
+
+        // Уже обработанные из 26 соседей: слой z - 1 и начало своего слоя
+        uint32_t best = 0;
+        uint32_t bestVisible = UINT32_MAX;
+        for (int dz = -1; dz <= 0; dz++)
+            for (int dy = -1; dy <= (dz < 0 ? 1 : 0); dy++)
+                for (int dx = -1; dx <= (dz < 0 || dy < 0 ? 1 : -1); dx++)
+                {
+                    int nx = x + dx, ny = y + dy, nz = z + dz;
+                    if (nx < 0 || ny < 0 || nz < 0 || nx >= (int)mDims[0] || ny >= (int)mDims[1])
+                        continue;
+
+                    uint32_t candidate = mCellRows[CellIndex(nx, ny, nz)];
+                    if (candidate == 0 || candidate == best)
+                        continue;
+
+                    const uint64_t* shared = &mRows[(size_t)(candidate - 1) * mWords];
+                    uint32_t visible = 0;
+                    for (uint32_t w = 0; w < mWords; w++)
+                        visible += (uint32_t)std::popcount(shared[w] | row[w]);
+
+                    uint32_t floor = (std::min)(minVisible[candidate - 1], own);
+                    if (visible - floor <= maxExtra && visible < bestVisible)
+                    {
+                        best = candidate;
+                        bestVisible = visible;
+                    }
+                }
+
+        if (best != 0)
+        {
+            uint64_t* shared = &mRows[(size_t)(best - 1) * mWords];
+            for (uint32_t w = 0; w < mWords; w++)
+                shared[w] |= row[w];
+            minVisible[best - 1] = (std::min)(minVisible[best - 1], own);
+            mCellRows[c] = best;
+            continue;
+        }
+
+        mRows.insert(mRows.end(), row, row + mWords);
+        minVisible.push_back(own);
+        mCellRows[c] = (uint32_t)minVisible.size();
+    }
+
+    FillStats();
+}
+
+void PotentiallyVisibleSet::FillStats()
+{
+    mStats.Cells = mDims[0] * mDims[1] * mDims[2];
+    mStats.Draws = mDrawCount;
+    mStats.UniqueRows = mWords > 0 ? (uint32_t)(mRows.size() / mWords) : 0;
+    mStats.RawBytes = (uint64_t)mStats.Cells * mWords * sizeof(uint64_t);
+    mStats.StoredBytes = (uint64_t)mCellRows.size() * sizeof(uint32_t) + mRows.size() * sizeof(uint64_t);
+
+    double visible = 0.0;
+    mStats.WalkableCells = 0;
+    for (uint32_t row : mCellRows)
+    {
+        if (row == 0)
+            continue;
+
+        mStats.WalkableCells++;
+        if (mDrawCount > 0)
+            visible += (double)CountVisible(&mRows[(size_t)(row - 1) * mWords], mWords) / mDrawCount;
+    }
+    mStats.AverageVisible = mStats.WalkableCells > 0 ? visible / mStats.WalkableCells : 0.0;
+}
+
+bool PotentiallyVisibleSet::Save(const std::string& path, uint64_t key) const
+{
+    PvsHeader header;
+    header.DrawCount = mDrawCount;
+    header.Key = key;
+    memcpy(header.Origin, mOrigin, sizeof(mOrigin));
+    header.CellSize = mCellSize;
+    memcpy(header.Dims, mDims, sizeof(mDims));
+    header.RowCount = mWords > 0 ? (uint32_t)(mRows.size() / mWords) : 0;
+
+    // Сумма и по заголовку (с нулевым Checksum): битое начало сетки или размер
+    // ячейки иначе загрузились бы молча
+    ContentHash checksum;
+    checksum.Add(&header, sizeof(header));
+    checksum.Add(mCellRows.data(), mCellRows.size() * sizeof(uint32_t));
+    checksum.Add(mRows.data(), mRows.size() * sizeof(uint64_t));
+    header.Checksum = checksum.Value();
+
+    // Как в ShaderCache: запись во временный файл и переименование
+    std::string tempPath = path + ".part";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(mCellRows.data()), (std::streamsize)(mCellRows.size() * sizeof(uint32_t)));
+        file.write(reinterpret_cast<const char*>(mRows.data()), (std::streamsize)(mRows.size() * sizeof(uint64_t)));
+        if (!file)
+            return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+bool PotentiallyVisibleSet::Load(const std::string& path, uint64_t key)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    PvsHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.Magic != PvsMagic || header.Key != key || header.CellSize <= 0.0f)
+        return false;
+
+    uint64_t cells = (uint64_t)header.Dims[0] * header.Dims[1] * header.Dims[2];
+    uint32_t words = (header.DrawCount + 63) / 64;
+    if (cells == 0 || cells > (1ull << 26) || (uint64_t)header.RowCount * words > (1ull << 28))
+        return false;
+
+    std::vector<uint32_t> cellRows((size_t)cells);
+    std::vector<uint64_t> rowData((size_t)header.RowCount * words);
+    if (!file.read(reinterpret_cast<char*>(cellRows.data()), (std::streamsize)(cellRows.size() * sizeof(uint32_t))) ||
+        !file.read(reinterpret_cast<char*>(rowData.data()), (std::streamsize)(rowData.size() * sizeof(uint64_t))))
+        return false;
+
+    PvsHeader hashed = header;
+    hashed.Checksum = 0;
+    ContentHash checksum;
+    checksum.Add(&hashed, sizeof(hashed));
+    checksum.Add(cellRows.data(), cellRows.size() * sizeof(uint32_t));
+    checksum.Add(rowData.data(), rowData.size() * sizeof(uint64_t));
+    if (checksum.Value() != header.Checksum)
+        return false;
+
+    for (uint32_t row : cellRows)
+    {
+        if (row > header.RowCount)
+            return false;
+    }
+
+    memcpy(mOrigin, header.Origin, sizeof(mOrigin));
+    mCellSize = header.CellSize;
+    memcpy(mDims, header.Dims, sizeof(mDims));
+    mDrawCount = header.DrawCount;
+    mWords = words;
+    mCellRows.swap(cellRows);
+    mRows.swap(rowData);
+
+    mStats = {};
+    FillStats();
+
+    return true;
+}
+
+const uint64_t* PotentiallyVisibleSet::VisibleSet(const float position[3]) const
+{
+    if (mRows.empty())
+        return nullptr;
+
+    uint32_t xyz[3];
+    for (int k = 0; k < 3; k++)
+    {
+        float f = (position[k] - mOrigin[k]) / mCellSize;
+        if (!(f >= 0.0f) || f >= (float)mDims[k])
+            return nullptr;
+        xyz[k] = (uint32_t)f;
+    }
+
+    uint32_t row = mCellRows[CellIndex(xyz[0], xyz[1], xyz[2])];
+    return row != 0 ? &mRows[(size_t)(row - 1) * mWords] : nullptr;
+}
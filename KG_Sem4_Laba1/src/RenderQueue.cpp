@@ -0,0 +1,81 @@
+﻿#include "../h/RenderQueue.h"
+#include <algorithm>
+
+namespace
+{
+    const size_t RadixSortThreshold = 512;
+}
+
+uint64_t MakeDrawKey(uint32_t pass, uint32_t pso, uint32_t material, float depth01)
+{
+    const uint32_t depthMax = (1u << DrawKeyDepthBits) - 1;
+    float clamped = (std::min)((std::max)(depth01, 0.0f), 1.0f);
+    uint32_t depth = (uint32_t)(clamped * depthMax);
+
+    return (uint64_t(pass & ((1u << DrawKeyPassBits) - 1)) << DrawKeyPassShift) |
+        (uint64_t(pso & ((1u << DrawKeyPsoBits) - 1)) << DrawKeyPsoShift) |
+        (uint64_t(material & ((1u << DrawKeyMaterialBits) - 1)) << DrawKeyMaterialShift) |
+        (uint64_t(depth) << DrawKeyDepthShift);
+}
+
+void RenderQueue::Sort()
+{
+    mLastSortPasses = 0;
+
+    size_t count = mItems.size();
+    if (count < 2)
+        return;
+
+    // На паре сотен отрисовок гистограммы дороже самой сортировки
+    if (count < RadixSortThreshold)
+    {
+        std::stable_sort(mItems.begin(), mItems.end(), [](const RenderItem& a, const RenderItem& b)
+        {
+            return a.Key < b.Key;
+        });
+        return;
+    }
+
+    // Гистограммы всех восьми байтов за один проход
+    uint32_t histograms[8][256] = {};
+    for (const RenderItem& item : mItems)
+    {
+        for (int b = 0; b < 8; b++)
+            histograms[b][(item.Key >> (b * 8)) & 0xFF]++;
+    }
+
+    mScratch.resize(count);
+    RenderItem* src = mItems.data();
+    RenderItem* dst = mScratch.data();
+
+    for (int b = 0; b < 8; b++)
+    {
+        uint32_t* histogram = histograms[b];
+
+        // Все ключи с одинаковым байтом - проход ничего не переставит
+        uint32_t firstByte = (mItems[0].Key >> (b * 8)) & 0xFF;
+        if (histogram[firstByte] == count)
+            continue;
+
+        uint32_t offsets[256];
+        uint32_t sum = 0;
+        for (int i = 0; i < 256; i++)
+        {
+            offsets[i] = sum;
+            sum += histogram[i];
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t digit = (src[i].Key >> (b * 8)) & 0xFF;
+            dst[offsets[digit]++] = src[i];
+        }
+
+        std::swap(src, dst);
+        mLastSortPasses++;
+    }
+
+    // Нечётное число проходов оставило результат в mScratch
+    if (src != mItems.data())
+        mItems.swap(mScratch);
+}
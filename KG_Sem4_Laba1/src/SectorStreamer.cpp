@@ -0,0 +1,532 @@
+﻿#include "../h/SectorStreamer.h"
+#include "../h/ShaderCache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    const uint32_t SectorMagic = 0x31434553; // "SEC1"
+    const uint32_t NoVertex = UINT32_MAX;
+
+    struct SectorHeader
+    {
+        uint32_t Magic = SectorMagic;
+        uint32_t Sector = 0;
+        uint64_t Key = 0;
+        uint32_t VertexStride = 0;
+        uint32_t VertexCount = 0;
+        uint32_t IndexCount = 0;
+        uint32_t Reserved = 0;
+        uint64_t Checksum = 0;
+    };
+
+    double Milliseconds(std::chrono::steady_clock::duration d)
+    {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+}
+
+SectorStreamer::~SectorStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQuit = true;
+    }
+    mWake.notify_all();
+    if (mThread.joinable())
+        mThread.join();
+}
+
+void SectorStreamer::Partition(
+    const float* positions, size_t stride, std::vector<uint32_t>& indices,
+    std::vector<Submesh>& submeshes, const SectorGridDesc& desc)
+{
+    auto position = [&](uint32_t vertex)
+    {
+        return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + (size_t)vertex * stride);
+    };
+
+    // Центры треугольников и их границы в плоскости XZ
+    size_t triangleCount = indices.size() / 3;
+    mInfos.clear();
+    if (triangleCount == 0)
+        return;
+
+    std::vector<float> centers(triangleCount * 2);
+    float minX = FLT_MAX, minZ = FLT_MAX, maxX = -FLT_MAX, maxZ = -FLT_MAX;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        float x = 0.0f, z = 0.0f;
+        for (int k = 0; k < 3; k++)
+        {
+            const float* p = position(indices[t * 3 + k]);
+            x += p[0];
+            z += p[2];
+        }
+        centers[t * 2 + 0] = x / 3.0f;
+        centers[t * 2 + 1] = z / 3.0f;
+        minX = (std::min)(minX, centers[t * 2 + 0]);
+        maxX = (std::max)(maxX, centers[t * 2 + 0]);
+        minZ = (std::min)(minZ, centers[t * 2 + 1]);
+        maxZ = (std::max)(maxZ, centers[t * 2 + 1]);
+    }
+
+    uint32_t perAxis = (std::max)(desc.SectorsPerAxis, 1u);
+    float size = (std::max)(maxX - minX, maxZ - minZ) / perAxis;
+    if (!(size > 0.0f))
+        size = 1.0f;
+    uint32_t dimX = (std::min)((uint32_t)((maxX - minX) / size) + 1, perAxis);
+    uint32_t dimZ = (std::min)((uint32_t)((maxZ - minZ) / size) + 1, perAxis);
+
+    auto cellOf = [&](size_t t)
+    {
+        uint32_t x = (std::min)((uint32_t)((centers[t * 2 + 0] - minX) / size), dimX - 1);
+        uint32_t z = (std::min)((uint32_t)((centers[t * 2 + 1] - minZ) / size), dimZ - 1);
+        return z * dimX + x;
+    };
+
+    // Номера секторов - непустым ячейкам по порядку
+    std::vector<uint32_t> cellSector(dimX * dimZ, UINT32_MAX);
+    for (size_t t = 0; t < triangleCount; t++)
+        cellSector[cellOf(t)] = 0;
+    uint32_t sectorCount = 0;
+    for (uint32_t& sector : cellSector)
+    {
+        if (sector == 0)
+            sector = sectorCount++;
+    }
+
+    // Треугольники сабмеша сортируются по сектору устойчиво - куски идут подряд
+    std::vector<uint32_t> sorted;
+    sorted.reserve(indices.size());
+    std::vector<Submesh> pieces;
+    std::vector<uint32_t> order;
+
+    for (const Submesh& sm : submeshes)
+    {
+        uint32_t first = sm.IndexStart / 3;
+        uint32_t count = sm.IndexCount / 3;
+
+        order.resize(count);
+        for (uint32_t i = 0; i < count; i++)
+            order[i] = first + i;
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+        {
+            return cellSector[cellOf(a)] < cellSector[cellOf(b)];
+        });
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t sector = cellSector[cellOf(order[i])];
+            if (i == 0 || sector != pieces.back().Sector)
+            {
+                Submesh piece = sm;
+                piece.IndexStart = (uint32_t)sorted.size();
+                piece.IndexCount = 0;
+                piece.Bounds = Aabb();
+                piece.Sector = sector;
+                pieces.push_back(piece);
+            }
+
+            for (int k = 0; k < 3; k++)
+                sorted.push_back(indices[(size_t)order[i] * 3 + k]);
+            pieces.back().IndexCount += 3;
+        }
+    }
+
+    indices.swap(sorted);
+    submeshes.swap(pieces);
+    mInfos.assign(sectorCount, SectorInfo());
+}
+
+bool SectorStreamer::Build(
+    const uint8_t* vertices, size_t vertexStride, const std::vector<uint32_t>& indices,
+    std::vector<Submesh>& submeshes, const std::string& directory, uint64_t key)
+{
+    mDirectory = directory;
+    mKey = key;
+    mVertexStride = vertexStride;
+    mWrittenFiles = 0;
+
+    for (uint32_t i = 0; i < (uint32_t)submeshes.size(); i++)
+        mInfos[submeshes[i].Sector].Draws.push_back(i);
+
+    size_t vertexCount = 0;
+    for (uint32_t index : indices)
+        vertexCount = (std::max)(vertexCount, (size_t)index + 1);
+    std::vector<uint32_t> remap(vertexCount, NoVertex);
+
+    bool ok = true;
+    for (uint32_t s = 0; s < (uint32_t)mInfos.size(); s++)
+    {
+        SectorInfo& info = mInfos[s];
+        SectorData data;
+        std::vector<uint32_t> used;
+
+        // Вершины сектора в порядке первого использования
+        for (uint32_t draw : info.Draws)
+        {
+            Submesh& sm = submeshes[draw];
+            sm.SectorIndexStart = (uint32_t)data.Indices.size();
+
+            for (uint32_t i = sm.IndexStart; i < sm.IndexStart + sm.IndexCount; i++)
+            {
+                uint32_t vertex = indices[i];
+                if (remap[vertex] == NoVertex)
+                {
+                    remap[vertex] = (uint32_t)used.size();
+                    used.push_back(vertex);
+                }
+                data.Indices.push_back(remap[vertex]);
+            }
+
+            if (!sm.Bounds.IsEmpty())
+            {
+                info.Bounds.Extend(sm.Bounds.Min[0], sm.Bounds.Min[1], sm.Bounds.Min[2]);
+                info.Bounds.Extend(sm.Bounds.Max[0], sm.Bounds.Max[1], sm.Bounds.Max[2]);
+            }
+            if (sm.MaterialIndex >= 0)
+                info.Materials.push_back((uint32_t)sm.MaterialIndex);
+        }
+
+        std::sort(info.Materials.begin(), info.Materials.end());
+        info.Materials.erase(std::unique(info.Materials.begin(), info.Materials.end()), info.Materials.end());
+
+        info.VertexCount = (uint32_t)used.size();
+        info.IndexCount = (uint32_t)data.Indices.size();
+        info.FileBytes = sizeof(SectorHeader) + (uint64_t)info.VertexCount * vertexStride +
+            (uint64_t)info.IndexCount * sizeof(uint32_t);
+
+        for (uint32_t vertex : used)
+            remap[vertex] = NoVertex;
+
+        data.Vertices.resize(used.size() * vertexStride);
+        for (size_t i = 0; i < used.size(); i++)
+            memcpy(&data.Vertices[i * vertexStride], vertices + (size_t)used[i] * vertexStride, vertexStride);
+
+        SectorHeader header;
+        header.Sector = s;
+        header.Key = key;
+        header.VertexStride = (uint32_t)vertexStride;
+        header.VertexCount = info.VertexCount;
+        header.IndexCount = info.IndexCount;
+
+        ContentHash checksum;
+        checksum.Add(data.Vertices.data(), data.Vertices.size());
+        checksum.Add(data.Indices.data(), data.Indices.size() * sizeof(uint32_t));
+        header.Checksum = checksum.Value();
+
+        // Файл прошлого запуска годится, только если его заголовок совпадает
+        // целиком, с контрольной суммой: совпадения размера мало. Целостность
+        // самих данных проверяет ReadSector при загрузке
+        std::string path = SectorPath(s);
+        std::error_code ec;
+        if (std::filesystem::file_size(path, ec) == info.FileBytes && !ec)
+        {
+            SectorHeader existing;
+            std::ifstream file(path, std::ios::binary);
+            if (file.read(reinterpret_cast<char*>(&existing), sizeof(existing)) &&
+                memcmp(&existing, &header, sizeof(header)) == 0)
+                continue;
+        }
+
+        // Как в ShaderCache: запись во временный файл и переименование
+        std::string tempPath = path + ".part";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(data.Vertices.data()), (std::streamsize)data.Vertices.size());
+            file.write(reinterpret_cast<const char*>(data.Indices.data()), (std::streamsize)(data.Indices.size() * sizeof(uint32_t)));
+            if (!file)
+            {
+                ok = false;
+                continue;
+            }
+        }
+
+        std::filesystem::rename(tempPath, path, ec);
+        if (ec)
+        {
+            std::filesystem::remove(tempPath, ec);
+            ok = false;
+            continue;
+        }
+        mWrittenFiles++;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mSectors.assign(mInfos.size(), SectorSlot());
+    mQueue.clear();
+    mStats = {};
+    mStats.Sectors = (uint32_t)mInfos.size();
+    mWindowStart = std::chrono::steady_clock::now();
+    mWindowBytes = 0;
+    return ok;
+}
+
+std::string SectorStreamer::SectorPath(uint32_t sector) const
+{
+    return mDirectory + "/" + std::to_string(mKey) + "." + std::to_string(sector) + ".sector";
+}
+
+bool SectorStreamer::ReadSector(uint32_t sector, SectorData& out) const
+{
+    const SectorInfo& info = mInfos[sector];
+
+    std::ifstream file(SectorPath(sector), std::ios::binary);
+    if (!file)
+        return false;
+
+    SectorHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.Magic != SectorMagic || header.Key != mKey || header.Sector != sector ||
+        header.VertexStride != mVertexStride || header.VertexCount != info.VertexCount ||
+        header.IndexCount != info.IndexCount)
+        return false;
+
+    out.Vertices.resize((size_t)header.VertexCount * header.VertexStride);
+    out.Indices.resize(header.IndexCount);
+    if (!file.read(reinterpret_cast<char*>(out.Vertices.data()), (std::streamsize)out.Vertices.size()) ||
+        !file.read(reinterpret_cast<char*>(out.Indices.data()), (std::streamsize)(out.Indices.size() * sizeof(uint32_t))))
+        return false;
+
+    ContentHash checksum;
+    checksum.Add(out.Vertices.data(), out.Vertices.size());
+    checksum.Add(out.Indices.data(), out.Indices.size() * sizeof(uint32_t));
+    return checksum.Value() == header.Checksum;
+}
+
+void SectorStreamer::StartThread()
+{
+    if (!mThread.joinable())
+        mThread = std::thread([this] { IoLoop(); });
+}
+
+// Ближайший запрошенный читается без блокировки; если за это время сектор
+// стал не нужен, прочитанное выбрасывается
+void SectorStreamer::IoLoop()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    for (;;)
+    {
+        mWake.wait(lock, [this] { return mQuit || !mQueue.empty(); });
+        if (mQuit)
+            return;
+
+        uint32_t sector = mQueue.back();
+        mQueue.pop_back();
+        SectorSlot& slot = mSectors[sector];
+        slot.State = SectorState::Loading;
+        slot.Cancelled = false;
+
+        lock.unlock();
+        SectorData data;
+        bool ok = ReadSector(sector, data);
+        lock.lock();
+
+        if (!ok)
+        {
+            slot.State = SectorState::Failed;
+            slot.FailedAt = std::chrono::steady_clock::now();
+            mStats.Failures++;
+            continue;
+        }
+
+        mReadBytes += mInfos[sector].FileBytes;
+        if (slot.Cancelled)
+        {
+            slot.State = SectorState::Unloaded;
+            continue;
+        }
+
+        slot.Data = std::move(data);
+        slot.State = SectorState::Ready;
+    }
+}
+
+void SectorStreamer::Deliver(uint32_t sector, std::chrono::steady_clock::time_point now)
+{
+    SectorSlot& slot = mSectors[sector];
+    slot.State = SectorState::Resident;
+    mArrived.push_back(sector);
+
+    mStats.Loads++;
+    mStats.ResidentBytes += mInfos[sector].FileBytes;
+    mStats.LastLatencyMs = Milliseconds(now - slot.Requested);
+    mStats.MaxLatencyMs = (std::max)(mStats.MaxLatencyMs, mStats.LastLatencyMs);
+}
+
+void SectorStreamer::Evict(uint32_t sector)
+{
+    SectorSlot& slot = mSectors[sector];
+    slot.State = SectorState::Unloaded;
+    slot.Data = SectorData();
+    mEvicted.push_back(sector);
+
+    mStats.Unloads++;
+    mStats.ResidentBytes -= mInfos[sector].FileBytes;
+}
+
+// Расстояние сектора - меньшее из расстояний до камеры и до её положения
+// через LookAhead: впереди по ходу данные запрашиваются раньше, а позади
+// не выгружаются, пока камера не отошла и от них
+void SectorStreamer::Update(const float eye[3], const float velocity[3])
+{
+    auto now = std::chrono::steady_clock::now();
+    float ahead[3];
+    for (int k = 0; k < 3; k++)
+        ahead[k] = eye[k] + velocity[k] * mDesc.LookAhead;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mArrived.clear();
+    mEvicted.clear();
+    mQueue.clear();
+    mOrder.clear();
+    mStats.Missing = 0;
+    mStats.Pending = 0;
+
+    for (uint32_t s = 0; s < (uint32_t)mInfos.size(); s++)
+    {
+        const Aabb& bounds = mInfos[s].Bounds;
+        SectorSlot& slot = mSectors[s];
+        float current = bounds.Distance(eye[0], eye[1], eye[2]);
+        slot.Distance = (std::min)(current, bounds.Distance(ahead[0], ahead[1], ahead[2]));
+
+        bool wanted = slot.Distance < mDesc.LoadRadius;
+        bool unwanted = slot.Distance > mDesc.UnloadRadius;
+
+        switch (slot.State)
+        {
+        case SectorState::Unloaded:
+            if (wanted)
+            {
+                slot.State = SectorState::Queued;
+                slot.Requested = now;
+            }
+            break;
+        case SectorState::Queued:
+            if (unwanted)
+                slot.State = SectorState::Unloaded;
+            break;
+        case SectorState::Loading:
+            slot.Cancelled = unwanted;
+            break;
+        case SectorState::Ready:
+            if (unwanted)
+            {
+                slot.State = SectorState::Unloaded;
+                slot.Data = SectorData();
+            }
+            break;
+        case SectorState::Resident:
+            if (unwanted)
+                Evict(s);
+            break;
+        case SectorState::Failed:
+            // Файл могли перестроить или диск мог ответить со второго раза:
+            // повтор не чаще RetryDelay, ушедший далеко сектор начинает заново
+            if (unwanted)
+                slot.State = SectorState::Unloaded;
+            else if (wanted && Milliseconds(now - slot.FailedAt) >= mDesc.RetryDelay * 1000.0)
+            {
+                slot.State = SectorState::Queued;
+                slot.Requested = now;
+            }
+            break;
+        }
+
+        if (slot.State == SectorState::Queued)
+            mQueue.push_back(s);
+        if (slot.State == SectorState::Ready)
+            mOrder.push_back(s);
+        if (slot.State == SectorState::Queued || slot.State == SectorState::Loading || slot.State == SectorState::Ready)
+            mStats.Pending++;
+        if (current < mDesc.VisibleRadius && slot.State != SectorState::Resident && slot.State != SectorState::Failed)
+            mStats.Missing++;
+    }
+
+    // Поток берёт с конца - ближние в конец
+    std::sort(mQueue.begin(), mQueue.end(), [this](uint32_t a, uint32_t b)
+    {
+        return mSectors[a].Distance > mSectors[b].Distance;
+    });
+
+    // Готовые выдаются от ближних, пока не набран ArrivalBytes (хотя бы один)
+    std::sort(mOrder.begin(), mOrder.end(), [this](uint32_t a, uint32_t b)
+    {
+        return mSectors[a].Distance < mSectors[b].Distance;
+    });
+    uint64_t arrivalBytes = 0;
+    for (uint32_t s : mOrder)
+    {
+        if (arrivalBytes > 0 && arrivalBytes + mInfos[s].FileBytes > mDesc.ArrivalBytes)
+            break;
+        arrivalBytes += mInfos[s].FileBytes;
+        Deliver(s, now);
+        mStats.Pending--;
+    }
+
+    if (mStats.Missing > 0)
+        mStats.Hitches++;
+
+    mStats.ReadBytes = mReadBytes;
+    mStats.Resident = 0;
+    for (const SectorSlot& slot : mSectors)
+        mStats.Resident += slot.State == SectorState::Resident ? 1 : 0;
+
+    double windowMs = Milliseconds(now - mWindowStart);
+    if (windowMs >= 1000.0)
+    {
+        mStats.ReadMBps = (double)(mReadBytes - mWindowBytes) / (1024.0 * 1024.0) / (windowMs / 1000.0);
+        mWindowBytes = mReadBytes;
+        mWindowStart = now;
+    }
+
+    if (!mQueue.empty())
+    {
+        StartThread();
+        mWake.notify_one();
+    }
+}
+
+void SectorStreamer::LoadNow(const float eye[3])
+{
+    auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mArrived.clear();
+    mEvicted.clear();
+
+    for (uint32_t s = 0; s < (uint32_t)mInfos.size(); s++)
+    {
+        SectorSlot& slot = mSectors[s];
+        if (slot.State != SectorState::Unloaded ||
+            mInfos[s].Bounds.Distance(eye[0], eye[1], eye[2]) >= mDesc.LoadRadius)
+            continue;
+
+        slot.Requested = now;
+        if (!ReadSector(s, slot.Data))
+        {
+            slot.State = SectorState::Failed;
+            slot.FailedAt = std::chrono::steady_clock::now();
+            slot.Data = SectorData();
+            mStats.Failures++;
+            continue;
+        }
+
+        mReadBytes += mInfos[s].FileBytes;
+        Deliver(s, std::chrono::steady_clock::now());
+        mStats.Resident++;
+    }
+
+    mStats.ReadBytes = mReadBytes;
+}
+
+SectorData SectorStreamer::TakeData(uint32_t sector)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return std::move(mSectors[sector].Data);
+}
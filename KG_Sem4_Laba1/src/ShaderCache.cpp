@@ -0,0 +1,222 @@
+﻿#include "../h/ShaderCache.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+namespace
+{
+    const uint32_t CacheMagic = 0x31434853; // "SHC1"
+
+    struct CacheHeader
+    {
+        uint32_t Magic = CacheMagic;
+        uint32_t Reserved = 0;
+        uint64_t Key = 0;
+        uint64_t Size = 0;
+        uint64_t Checksum = 0;
+    };
+
+    bool ReadFile(const std::filesystem::path& path, std::string& out)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+
+        std::ostringstream data;
+        data << file.rdbuf();
+        out = data.str();
+        return true;
+    }
+
+    // Имена из строк вида #include "x" и #include <x>
+    void FindIncludes(const std::string& source, std::vector<std::string>& out)
+    {
+        size_t pos = 0;
+        while ((pos = source.find("#include", pos)) != std::string::npos)
+        {
+            pos += 8;
+            size_t open = source.find_first_of("\"<\n", pos);
+            if (open == std::string::npos || source[open] == '\n')
+                continue;
+
+            char closeChar = source[open] == '"' ? '"' : '>';
+            size_t close = source.find_first_of(std::string(1, closeChar) + "\n", open + 1);
+            if (close == std::string::npos || source[close] == '\n')
+                continue;
+
+            out.push_back(source.substr(open + 1, close - open - 1));
+            pos = close;
+        }
+    }
+
+    bool HashSource(const std::filesystem::path& path, std::set<std::filesystem::path>& visited, ContentHash& hash)
+    {
+        std::filesystem::path normal = path.lexically_normal();
+        if (!visited.insert(normal).second)
+            return true;
+
+        std::string source;
+        if (!ReadFile(normal, source))
+            return false;
+
+        hash.Add(source);
+
+        std::vector<std::string> includes;
+        FindIncludes(source, includes);
+        for (const auto& name : includes)
+        {
+            // Чего нет рядом с файлом - системный заголовок компилятора, его версию задаёт профиль
+            std::filesystem::path included = normal.parent_path() / name;
+            std::error_code ec;
+            if (std::filesystem::exists(included, ec))
+                HashSource(included, visited, hash);
+            else
+                hash.Add(name);
+        }
+        return true;
+    }
+}
+
+void ContentHash::Add(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        mHash ^= bytes[i];
+        mHash *= 1099511628211ull;
+    }
+}
+
+void ContentHash::Add(const std::string& text)
+{
+    Add((uint64_t)text.size());
+    Add(text.data(), text.size());
+}
+
+ShaderCache::ShaderCache(std::string directory)
+    : mDirectory(std::move(directory))
+{
+    std::error_code ec;
+    std::filesystem::create_directories(mDirectory, ec);
+}
+
+uint64_t ShaderCache::HashKey(const ShaderKey& key)
+{
+    ContentHash hash;
+    std::set<std::filesystem::path> visited;
+    if (!HashSource(key.SourcePath, visited, hash))
+        return 0;
+
+    hash.Add((uint64_t)key.Defines.size());
+    for (const auto& define : key.Defines)
+    {
+        hash.Add(define.Name);
+        hash.Add(define.Value);
+    }
+    hash.Add(key.EntryPoint);
+    hash.Add(key.Target);
+    hash.Add((uint64_t)key.Flags);
+
+    return hash.Value() != 0 ? hash.Value() : 1;
+}
+
+std::string ShaderCache::PathFor(uint64_t key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return (std::filesystem::path(mDirectory) / name).string();
+}
+
+bool ShaderCache::Load(uint64_t key, std::vector<uint8_t>& blob)
+{
+    std::string path = PathFor(key);
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        Count(&ShaderCacheStats::Misses);
+        return false;
+    }
+
+    // Размер из заголовка сверяем с файлом до выделения: обрезанный или битый
+    // файл не должен заказывать память под несуществующие данные
+    std::error_code ec;
+    uint64_t fileSize = std::filesystem::file_size(path, ec);
+
+    CacheHeader header;
+    bool valid = !ec && (bool)file.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+        header.Magic == CacheMagic && header.Key == key && header.Size == fileSize - sizeof(header);
+
+    if (valid)
+    {
+        blob.resize((size_t)header.Size);
+        valid = (bool)file.read(reinterpret_cast<char*>(blob.data()), (std::streamsize)blob.size());
+    }
+
+    if (valid)
+    {
+        ContentHash checksum;
+        checksum.Add(blob.data(), blob.size());
+        valid = checksum.Value() == header.Checksum;
+    }
+
+    if (!valid)
+    {
+        blob.clear();
+        Count(&ShaderCacheStats::Rejected);
+        Count(&ShaderCacheStats::Misses);
+        return false;
+    }
+
+    Count(&ShaderCacheStats::Hits);
+    return true;
+}
+
+bool ShaderCache::Store(uint64_t key, const void* data, size_t size)
+{
+    CacheHeader header;
+    header.Key = key;
+    header.Size = size;
+
+    ContentHash checksum;
+    checksum.Add(data, size);
+    header.Checksum = checksum.Value();
+
+    // Пишем во временный файл и переименовываем: оборванная запись не оставит битый блоб под ключом
+    std::string path = PathFor(key);
+    std::string tempPath = path + ".part";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(static_cast<const char*>(data), (std::streamsize)size);
+        if (!file)
+            return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    Count(&ShaderCacheStats::Stores);
+    return true;
+}
+
+void ShaderCache::Count(uint32_t ShaderCacheStats::* counter)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStats.*counter += 1;
+}
+
+ShaderCacheStats ShaderCache::Stats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
@@ -0,0 +1,646 @@
+﻿#include "../h/SoftRasterizer.h"
+#include "../h/TgaLoader.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// SOFT_RASTERIZER_NO_SSE - скалярный путь и на x86 (SoftRasterizerScalarTest)
+#if !defined(SOFT_RASTERIZER_NO_SSE) && \
+    (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__))
+#include <emmintrin.h>
+#define SOFT_RASTERIZER_SSE 1
+#endif
+
+namespace
+{
+    // Треугольников на порцию раскладки по тайлам: меньше - не окупается своя корзина
+    const uint32_t MinTrianglesPerChunk = 1024;
+
+    // Вершины на экране привязываются к сетке 1/16 пикселя, а рёбра считаются в целых -
+    // точно, поэтому общее ребро закрашивается ровно одним из двух треугольников
+    const int SubpixelBits = 4;
+    const int Subpixel = 1 << SubpixelBits;
+
+    // Охранная полоса: треугольники отсекаются по |x|, |y| <= GuardBand пикселей, тогда
+    // |A|, |B| рёбер не больше 2^19 и функция ребра на тайле умещается в int32
+    const float GuardBand = 16384.0f;
+    const int ClipPlaneCount = 5;
+
+    double MicrosecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Мип по правилу D3D: max(1, размер >> level)
+    uint32_t MipLevel(const SoftTexture* texture, float lodBase)
+    {
+        if (!texture || texture->Mips.size() <= 1)
+            return 0;
+
+        float lod = lodBase + 0.5f * std::log2((float)texture->Width * (float)texture->Height);
+        if (!(lod > 0.0f))
+            return 0;
+
+        return (std::min)((uint32_t)(lod + 0.5f), (uint32_t)texture->Mips.size() - 1);
+    }
+
+    // Билинейная выборка с повтором (как у статического сэмплера s0), BGRA 0..255
+    void SampleBilinear(const SoftTexture* texture, uint32_t level, float u, float v, float out[4])
+    {
+        if (!texture || texture->Mips.empty())
+        {
+            out[0] = out[1] = out[2] = out[3] = 255.0f;
+            return;
+        }
+
+        int w = (int)(std::max)(1u, texture->Width >> level);
+        int h = (int)(std::max)(1u, texture->Height >> level);
+        const uint8_t* texels = texture->Mips[level].data();
+
+        // Сначала в [0, 1): дальние повторы не переполняют int
+        u -= std::floor(u);
+        v -= std::floor(v);
+
+        float fx = u * w - 0.5f;
+        float fy = v * h - 0.5f;
+        float flx = std::floor(fx);
+        float fly = std::floor(fy);
+        float tx = fx - flx;
+        float ty = fy - fly;
+
+        int x0 = (int)flx;
+        int y0 = (int)fly;
+        if (x0 < 0) x0 += w;
+        if (y0 < 0) y0 += h;
+        int x1 = x0 + 1 < w ? x0 + 1 : 0;
+        int y1 = y0 + 1 < h ? y0 + 1 : 0;
+
+        const uint8_t* t00 = texels + ((size_t)y0 * w + x0) * 4;
+        const uint8_t* t10 = texels + ((size_t)y0 * w + x1) * 4;
+        const uint8_t* t01 = texels + ((size_t)y1 * w + x0) * 4;
+        const uint8_t* t11 = texels + ((size_t)y1 * w + x1) * 4;
+
+        for (int c = 0; c < 4; c++)
+        {
+            float top = t00[c] + (t10[c] - t00[c]) * tx;
+            float bottom = t01[c] + (t11[c] - t01[c]) * tx;
+            out[c] = top + (bottom - top) * ty;
+        }
+    }
+}
+
+SoftRasterizer::SoftRasterizer(JobSystem& jobs, uint32_t width, uint32_t height)
+    : mJobs(jobs)
+    , mWidth(width)
+    , mHeight(height)
+    , mPitch((width + 3) & ~3u)
+{
+    mTilesX = (width + TileSize - 1) / TileSize;
+    mTilesY = (height + TileSize - 1) / TileSize;
+
+    mColor.resize((size_t)mPitch * height);
+    mDepth.resize((size_t)mPitch * height);
+    Clear(0xFF000000u);
+}
+
+void SoftRasterizer::Clear(uint32_t bgra, float depth)
+{
+    std::fill(mColor.begin(), mColor.end(), bgra);
+    std::fill(mDepth.begin(), mDepth.end(), depth);
+}
+
+bool SoftRasterizer::SaveTga(const std::string& path) const
+{
+    return SaveTGA(path, (int)mWidth, (int)mHeight,
+        reinterpret_cast<const unsigned char*>(mColor.data()), (size_t)mPitch * 4);
+}
+
+void SoftRasterizer::Render(const SoftMesh& mesh, const SoftConstants& constants, const SoftDraw* draws, size_t drawCount)
+{
+    mStats = SoftRasterStats();
+    mConstants = constants;
+    mDraws = draws;
+    mIndices = mesh.Indices;
+
+    // ===== ВЕРШИНЫ =====
+    auto start = std::chrono::steady_clock::now();
+
+    mClipVertices.resize(mesh.VertexCount);
+    mJobs.ParallelFor(mesh.VertexCount, [this, &mesh](uint32_t begin, uint32_t end)
+    {
+        const float (*m)[4] = mConstants.WorldViewProj;
+        const float* uv = mConstants.UVTransform;
+
+        for (uint32_t i = begin; i < end; i++)
+        {
+            const uint8_t* vertex = mesh.Vertices + (size_t)i * mesh.VertexStride;
+            const float* p = reinterpret_cast<const float*>(vertex + mesh.PositionOffset);
+            const float* t = reinterpret_cast<const float*>(vertex + mesh.TexcoordOffset);
+
+            ClipVertex& out = mClipVertices[i];
+            out.X = p[0] * m[0][0] + p[1] * m[1][0] + p[2] * m[2][0] + m[3][0];
+            out.Y = p[0] * m[0][1] + p[1] * m[1][1] + p[2] * m[2][1] + m[3][1];
+            out.Z = p[0] * m[0][2] + p[1] * m[1][2] + p[2] * m[2][2] + m[3][2];
+            out.W = p[0] * m[0][3] + p[1] * m[1][3] + p[2] * m[2][3] + m[3][3];
+
+            // vout.TexC = vin.TexC * gUVTransform.xy + gUVTransform.zw
+            out.U = t[0] * uv[0] + uv[2];
+            out.V = t[1] * uv[1] + uv[3];
+        }
+    });
+
+    mStats.TransformUs = MicrosecondsSince(start);
+
+    // ===== ОТСЕЧЕНИЕ И РАСКЛАДКА ПО ТАЙЛАМ =====
+    start = std::chrono::steady_clock::now();
+
+    mDrawFirstTriangle.resize(drawCount + 1);
+    mDrawFirstTriangle[0] = 0;
+    for (size_t d = 0; d < drawCount; d++)
+        mDrawFirstTriangle[d + 1] = mDrawFirstTriangle[d] + draws[d].IndexCount / 3;
+
+    uint32_t triangleCount = mDrawFirstTriangle.back();
+    uint32_t tileCount = mTilesX * mTilesY;
+
+    mChunkCount = (std::max)(1u, (std::min)(mJobs.ThreadCount() * 4, triangleCount / MinTrianglesPerChunk));
+    if (mChunkTriangles.size() < mChunkCount)
+        mChunkTriangles.resize(mChunkCount);
+    if (mBins.size() < (size_t)mChunkCount * tileCount)
+        mBins.resize((size_t)mChunkCount * tileCount);
+
+    mJobs.ParallelFor(mChunkCount, [this](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t chunk = begin; chunk < end; chunk++)
+            BinTriangles(chunk);
+    }, 1);
+
+    for (uint32_t chunk = 0; chunk < mChunkCount; chunk++)
+    {
+        mStats.Triangles += (uint32_t)mChunkTriangles[chunk].size();
+        for (uint32_t tile = 0; tile < tileCount; tile++)
+            mStats.BinEntries += (uint32_t)mBins[(size_t)chunk * tileCount + tile].size();
+    }
+
+    mStats.BinUs = MicrosecondsSince(start);
+
+    // ===== РАСТЕРИЗАЦИЯ ТАЙЛОВ =====
+    start = std::chrono::steady_clock::now();
+
+    mPixels = 0;
+    mJobs.ParallelFor(tileCount, [this](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t tile = begin; tile < end; tile++)
+            RasterizeTile(tile);
+    }, 1);
+
+    mStats.Pixels = mPixels;
+    mStats.RasterUs = MicrosecondsSince(start);
+}
+
+void SoftRasterizer::BinTriangles(uint32_t chunk)
+{
+    uint32_t tileCount = mTilesX * mTilesY;
+    uint32_t triangleCount = mDrawFirstTriangle.back();
+    uint32_t begin = (uint32_t)((uint64_t)triangleCount * chunk / mChunkCount);
+    uint32_t end = (uint32_t)((uint64_t)triangleCount * (chunk + 1) / mChunkCount);
+
+    mChunkTriangles[chunk].clear();
+    for (uint32_t tile = 0; tile < tileCount; tile++)
+        mBins[(size_t)chunk * tileCount + tile].clear();
+
+    if (begin == end)
+        return;
+
+    // Охранная полоса в пространстве отсечения: -GuardBand <= экранные x, y <= GuardBand
+    float guardX = 2.0f * GuardBand / mWidth;
+    float guardY = 2.0f * GuardBand / mHeight;
+    auto distance = [guardX, guardY](const ClipVertex& v, int plane)
+    {
+        switch (plane)
+        {
+        case 0: return v.Z;
+        case 1: return v.X + (guardX + 1.0f) * v.W;
+        case 2: return (guardX - 1.0f) * v.W - v.X;
+        case 3: return (guardY + 1.0f) * v.W - v.Y;
+        default: return v.Y + (guardY - 1.0f) * v.W;
+        }
+    };
+
+    // Последняя отрисовка, начинающаяся не позже begin (пустые пропускаются)
+    uint32_t draw = (uint32_t)(std::upper_bound(mDrawFirstTriangle.begin(), mDrawFirstTriangle.end(), begin) -
+        mDrawFirstTriangle.begin()) - 1;
+
+    for (uint32_t t = begin; t < end; t++)
+    {
+        while (t >= mDrawFirstTriangle[draw + 1])
+            draw++;
+
+        uint32_t first = mDraws[draw].IndexStart + (t - mDrawFirstTriangle[draw]) * 3;
+        const ClipVertex& v0 = mClipVertices[mIndices[first + 0]];
+        const ClipVertex& v1 = mClipVertices[mIndices[first + 1]];
+        const ClipVertex& v2 = mClipVertices[mIndices[first + 2]];
+
+        // Все вершины за одной плоскостью пирамиды видимости
+        if ((v0.X < -v0.W && v1.X < -v1.W && v2.X < -v2.W) ||
+            (v0.X > v0.W && v1.X > v1.W && v2.X > v2.W) ||
+            (v0.Y < -v0.W && v1.Y < -v1.W && v2.Y < -v2.W) ||
+            (v0.Y > v0.W && v1.Y > v1.W && v2.Y > v2.W) ||
+            (v0.Z < 0.0f && v1.Z < 0.0f && v2.Z < 0.0f) ||
+            (v0.Z > v0.W && v1.Z > v1.W && v2.Z > v2.W))
+            continue;
+
+        // Отсечение по ближней плоскости z = 0 и охранной полосе (Сазерленд - Ходжман),
+        // внутри полосы остальное отсекают тайлы экрана
+        uint32_t crossed = 0;
+        for (int plane = 0; plane < ClipPlaneCount; plane++)
+        {
+            if (distance(v0, plane) < 0.0f || distance(v1, plane) < 0.0f || distance(v2, plane) < 0.0f)
+                crossed |= 1u << plane;
+        }
+
+        if (crossed == 0)
+        {
+            SetupAndBin(chunk, draw, v0, v1, v2);
+            continue;
+        }
+
+        // Плоскость добавляет многоугольнику не больше одной вершины
+        ClipVertex polygon[2][3 + ClipPlaneCount];
+        polygon[0][0] = v0;
+        polygon[0][1] = v1;
+        polygon[0][2] = v2;
+        int count = 3;
+        int current = 0;
+
+        for (int plane = 0; plane < ClipPlaneCount && count >= 3; plane++)
+        {
+            if (!((crossed >> plane) & 1))
+                continue;
+
+            const ClipVertex* in = polygon[current];
+            ClipVertex* out = polygon[current ^ 1];
+            int outCount = 0;
+
+            for (int i = 0; i < count; i++)
+            {
+                const ClipVertex& a = in[i];
+                const ClipVertex& b = in[(i + 1) % count];
+                float da = distance(a, plane);
+                float db = distance(b, plane);
+                bool aInside = da >= 0.0f;
+                bool bInside = db >= 0.0f;
+
+                if (aInside)
+                    out[outCount++] = a;
+
+                if (aInside != bInside)
+                {
+                    // Всегда от внутренней вершины: у соседнего треугольника та же точка
+                    const ClipVertex& from = aInside ? a : b;
+                    const ClipVertex& to = aInside ? b : a;
+                    float s = aInside ? da / (da - db) : db / (db - da);
+
+                    ClipVertex& c = out[outCount++];
+                    c.X = from.X + (to.X - from.X) * s;
+                    c.Y = from.Y + (to.Y - from.Y) * s;
+                    c.Z = plane == 0 ? 0.0f : from.Z + (to.Z - from.Z) * s;
+                    c.W = from.W + (to.W - from.W) * s;
+                    c.U = from.U + (to.U - from.U) * s;
+                    c.V = from.V + (to.V - from.V) * s;
+                }
+            }
+
+            count = outCount;
+            current ^= 1;
+        }
+
+        for (int i = 1; i + 1 < count; i++)
+            SetupAndBin(chunk, draw, polygon[current][0], polygon[current][i], polygon[current][i + 1]);
+    }
+}
+
+void SoftRasterizer::SetupAndBin(
+    uint32_t chunk, uint32_t draw, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2)
+{
+    const ClipVertex* v[3] = { &v0, &v1, &v2 };
+
+    // Экранные координаты в 1/16 пикселя; после отсечения они уже внутри охранной полосы
+    const float limit = GuardBand * Subpixel;
+    float invW[3];
+    int64_t fx[3], fy[3];
+    for (int i = 0; i < 3; i++)
+    {
+        if (!(v[i]->W > 0.0f))
+            return;
+
+        invW[i] = 1.0f / v[i]->W;
+        float sx = (v[i]->X * invW[i] * 0.5f + 0.5f) * mWidth;
+        float sy = (0.5f - v[i]->Y * invW[i] * 0.5f) * mHeight;
+        fx[i] = (int64_t)std::floor((std::min)((std::max)(sx * Subpixel, -limit), limit) + 0.5f);
+        fy[i] = (int64_t)std::floor((std::min)((std::max)(sy * Subpixel, -limit), limit) + 0.5f);
+    }
+
+    // По часовой стрелке на экране (y вниз) - лицевая, площадь положительна
+    int64_t area = (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fx[2] - fx[0]) * (fy[1] - fy[0]);
+    if (area <= 0)
+        return;
+
+    // Пиксель x закрашивается по центру x + 0.5: бокс пикселей, центры которых в боксе вершин
+    const int64_t half = Subpixel / 2;
+    int64_t minX = ((std::min)({ fx[0], fx[1], fx[2] }) - half + Subpixel - 1) >> SubpixelBits;
+    int64_t maxX = ((std::max)({ fx[0], fx[1], fx[2] }) - half) >> SubpixelBits;
+    int64_t minY = ((std::min)({ fy[0], fy[1], fy[2] }) - half + Subpixel - 1) >> SubpixelBits;
+    int64_t maxY = ((std::max)({ fy[0], fy[1], fy[2] }) - half) >> SubpixelBits;
+
+    SetupTriangle tri;
+    tri.Draw = draw;
+    tri.MinX = (int)(std::max)(minX, (int64_t)0);
+    tri.MinY = (int)(std::max)(minY, (int64_t)0);
+    tri.MaxX = (int)(std::min)(maxX, (int64_t)mWidth - 1);
+    tri.MaxY = (int)(std::min)(maxY, (int64_t)mHeight - 1);
+    if (tri.MinX > tri.MaxX || tri.MinY > tri.MaxY)
+        return;
+
+    // E_i(x, y) = A * x + B * y + C, E_0 - ребро v1 -> v2, E_0(v0) = удвоенная площадь.
+    // Точка на ребре внутри только у левого (E растёт вправо) и верхнего (горизонтальное,
+    // E растёт вниз) - на остальных C уменьшено на 1, и везде проверяется E >= 0
+    for (int i = 0; i < 3; i++)
+    {
+        int j = (i + 1) % 3;
+        int k = (i + 2) % 3;
+        int64_t a = fy[j] - fy[k];
+        int64_t b = fx[k] - fx[j];
+        bool topLeft = a > 0 || (a == 0 && b > 0);
+
+        tri.EdgeA[i] = (int32_t)a;
+        tri.EdgeB[i] = (int32_t)b;
+        tri.EdgeC[i] = fx[j] * fy[k] - fx[k] * fy[j] - (topLeft ? 0 : 1);
+    }
+
+    // Атрибуты считаются от начала координат тайла (x & ~(TileSize-1)), чтобы
+    // у треугольников, уходящих далеко за экран, C не съедало точность
+    int originX = tri.MinX & ~(int)(TileSize - 1);
+    int originY = tri.MinY & ~(int)(TileSize - 1);
+
+    double x[3], y[3];
+    for (int i = 0; i < 3; i++)
+    {
+        x[i] = (double)fx[i] / Subpixel - originX;
+        y[i] = (double)fy[i] / Subpixel - originY;
+    }
+
+    double a[3] = { y[1] - y[2], y[2] - y[0], y[0] - y[1] };
+    double b[3] = { x[2] - x[1], x[0] - x[2], x[1] - x[0] };
+    double c[3] = { x[1] * y[2] - x[2] * y[1], x[2] * y[0] - x[0] * y[2], x[0] * y[1] - x[1] * y[0] };
+    double invArea = 1.0 / (c[0] + c[1] + c[2]);
+
+    // Атрибуты, линейные на экране: z/w, 1/w, u/w, v/w
+    auto plane = [&](const float f0, const float f1, const float f2, float out[3])
+    {
+        out[0] = (float)((a[0] * f0 + a[1] * f1 + a[2] * f2) * invArea);
+        out[1] = (float)((b[0] * f0 + b[1] * f1 + b[2] * f2) * invArea);
+        out[2] = (float)((c[0] * f0 + c[1] * f1 + c[2] * f2) * invArea);
+    };
+
+    plane(v0.Z * invW[0], v1.Z * invW[1], v2.Z * invW[2], tri.Z);
+    plane(invW[0], invW[1], invW[2], tri.InvW);
+    plane(v0.U * invW[0], v1.U * invW[1], v2.U * invW[2], tri.UOverW);
+    plane(v0.V * invW[0], v1.V * invW[1], v2.V * invW[2], tri.VOverW);
+
+    float du1 = v1.U - v0.U, dv1 = v1.V - v0.V;
+    float du2 = v2.U - v0.U, dv2 = v2.V - v0.V;
+    float uvArea = std::fabs(du1 * dv2 - du2 * dv1);
+    float pixelArea = (float)area / (Subpixel * Subpixel);
+    tri.LodBase = uvArea > 0.0f ? 0.5f * std::log2(uvArea / pixelArea) : -100.0f;
+
+    std::vector<SetupTriangle>& triangles = mChunkTriangles[chunk];
+    uint32_t index = (uint32_t)triangles.size();
+    triangles.push_back(tri);
+
+    // В тайл, только если какой-то центр пикселя тайла не снаружи ни одного ребра
+    uint32_t tileCount = mTilesX * mTilesY;
+    for (int ty = tri.MinY / (int)TileSize; ty <= tri.MaxY / (int)TileSize; ty++)
+    {
+        int64_t ry0 = (int64_t)ty * TileSize * Subpixel + half;
+        int64_t ry1 = ((int64_t)(std::min)((ty + 1) * TileSize, mHeight) - 1) * Subpixel + half;
+
+        for (int tx = tri.MinX / (int)TileSize; tx <= tri.MaxX / (int)TileSize; tx++)
+        {
+            int64_t rx0 = (int64_t)tx * TileSize * Subpixel + half;
+            int64_t rx1 = ((int64_t)(std::min)((tx + 1) * TileSize, mWidth) - 1) * Subpixel + half;
+
+            bool outside = false;
+            for (int i = 0; i < 3 && !outside; i++)
+            {
+                int64_t best = tri.EdgeA[i] * (tri.EdgeA[i] > 0 ? rx1 : rx0) +
+                    tri.EdgeB[i] * (tri.EdgeB[i] > 0 ? ry1 : ry0) + tri.EdgeC[i];
+                outside = best < 0;
+            }
+
+            if (!outside)
+                mBins[(size_t)chunk * tileCount + ty * mTilesX + tx].push_back(index);
+        }
+    }
+}
+
+void SoftRasterizer::RasterizeTile(uint32_t tile)
+{
+    uint32_t tileCount = mTilesX * mTilesY;
+    int x0 = (int)((tile % mTilesX) * TileSize);
+    int y0 = (int)((tile / mTilesX) * TileSize);
+    int x1 = (std::min)(x0 + (int)TileSize, (int)mWidth);
+    int y1 = (std::min)(y0 + (int)TileSize, (int)mHeight);
+
+    uint64_t pixels = 0;
+
+    // Порции по порядку - треугольники идут в порядке отрисовок
+    for (uint32_t chunk = 0; chunk < mChunkCount; chunk++)
+    {
+        const std::vector<SetupTriangle>& triangles = mChunkTriangles[chunk];
+        for (uint32_t index : mBins[(size_t)chunk * tileCount + tile])
+            pixels += RasterizeTriangle(triangles[index], x0, y0, x1, y1);
+    }
+
+    mPixels += pixels;
+}
+
+uint64_t SoftRasterizer::RasterizeTriangle(const SetupTriangle& tri, int x0, int y0, int x1, int y1)
+{
+    int minX = (std::max)(tri.MinX, x0);
+    int maxX = (std::min)(tri.MaxX, x1 - 1);
+    int minY = (std::max)(tri.MinY, y0);
+    int maxY = (std::min)(tri.MaxY, y1 - 1);
+    if (minX > maxX || minY > maxY)
+        return 0;
+
+    // Тайл начинается с кратного 4 x, поэтому четвёрки пикселей не выходят из тайла
+    // (у последнего тайла строки - в запас до mPitch, такие пиксели отбрасываются)
+    int startX = minX & ~3;
+    int endX = maxX | 3;
+    float originX = (float)(tri.MinX & ~(int)(TileSize - 1));
+    float originY = (float)(tri.MinY & ~(int)(TileSize - 1));
+
+    // Рёбра на центрах [startX, endX] x [minY, maxY]: ребро, у которого все центры
+    // внутри, дальше не проверяется; все снаружи - треугольника здесь нет. Иначе ребро
+    // проходит через прямоугольник и |E| на нём не больше (|A| + |B|) * 68 * 16 < 2^31
+    const int64_t half = Subpixel / 2;
+    int64_t cx0 = (int64_t)startX * Subpixel + half;
+    int64_t cx1 = (int64_t)endX * Subpixel + half;
+    int64_t cy0 = (int64_t)minY * Subpixel + half;
+    int64_t cy1 = (int64_t)maxY * Subpixel + half;
+
+    int64_t edgeA[3], edgeB[3], edgeC[3];
+    for (int i = 0; i < 3; i++)
+    {
+        edgeA[i] = tri.EdgeA[i];
+        edgeB[i] = tri.EdgeB[i];
+        edgeC[i] = tri.EdgeC[i];
+
+        int64_t low = edgeA[i] * (edgeA[i] > 0 ? cx0 : cx1) + edgeB[i] * (edgeB[i] > 0 ? cy0 : cy1) + edgeC[i];
+        int64_t high = edgeA[i] * (edgeA[i] > 0 ? cx1 : cx0) + edgeB[i] * (edgeB[i] > 0 ? cy1 : cy0) + edgeC[i];
+        if (high < 0)
+            return 0;
+
+        if (low >= 0)
+        {
+            edgeA[i] = 0;
+            edgeB[i] = 0;
+            edgeC[i] = 0;
+        }
+    }
+
+    // Мип на весь треугольник
+    const SoftDraw& draw = mDraws[tri.Draw];
+    uint32_t level1 = MipLevel(draw.Texture1, tri.LodBase);
+    uint32_t level2 = MipLevel(draw.Texture2, tri.LodBase);
+
+    uint64_t pixels = 0;
+
+#ifdef SOFT_RASTERIZER_SSE
+    const __m128i minusOne = _mm_set1_epi32(-1);
+    const __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+    const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+
+    // E в четырёх соседних центрах и шаг на четвёрку
+    __m128i laneE[3], stepE[3];
+    for (int i = 0; i < 3; i++)
+    {
+        int32_t a = (int32_t)(edgeA[i] * Subpixel);
+        laneE[i] = _mm_set_epi32(a * 3, a * 2, a, 0);
+        stepE[i] = _mm_set1_epi32(a * 4);
+    }
+
+    alignas(16) float invW[4], uw[4], vw[4];
+
+    for (int y = minY; y <= maxY; y++)
+    {
+        float py = y + 0.5f - originY;
+        __m128 rowZ = _mm_set1_ps(tri.Z[1] * py + tri.Z[2]);
+
+        int64_t cy = (int64_t)y * Subpixel + half;
+        __m128i e[3];
+        for (int i = 0; i < 3; i++)
+            e[i] = _mm_add_epi32(_mm_set1_epi32((int32_t)(edgeA[i] * cx0 + edgeB[i] * cy + edgeC[i])), laneE[i]);
+
+        for (int x = startX; x <= maxX; x += 4)
+        {
+            // Внутри - все три E >= 0 и пиксель не за maxX
+            __m128i signs = _mm_or_si128(_mm_or_si128(e[0], e[1]), e[2]);
+            __m128i inRange = _mm_cmplt_epi32(lanes, _mm_set1_epi32(maxX - x + 1));
+            __m128 inside = _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(signs, minusOne), inRange));
+
+            for (int i = 0; i < 3; i++)
+                e[i] = _mm_add_epi32(e[i], stepE[i]);
+
+            if (_mm_movemask_ps(inside) == 0)
+                continue;
+
+            __m128 px = _mm_add_ps(_mm_set1_ps(x - originX), laneOffsets);
+            uint32_t index = (uint32_t)y * mPitch + (uint32_t)x;
+            float* depth = mDepth.data() + index;
+            __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.Z[0]), px), rowZ);
+            __m128 old = _mm_loadu_ps(depth);
+            __m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, old));
+
+            int mask = _mm_movemask_ps(pass);
+            if (mask == 0)
+                continue;
+
+            _mm_storeu_ps(depth, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, old)));
+
+            __m128 pyv = _mm_set1_ps(py);
+            _mm_store_ps(invW, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.InvW[0]), px),
+                _mm_mul_ps(_mm_set1_ps(tri.InvW[1]), pyv)), _mm_set1_ps(tri.InvW[2])));
+            _mm_store_ps(uw, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.UOverW[0]), px),
+                _mm_mul_ps(_mm_set1_ps(tri.UOverW[1]), pyv)), _mm_set1_ps(tri.UOverW[2])));
+            _mm_store_ps(vw, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.VOverW[0]), px),
+                _mm_mul_ps(_mm_set1_ps(tri.VOverW[1]), pyv)), _mm_set1_ps(tri.VOverW[2])));
+
+            for (int lane = 0; lane < 4; lane++)
+            {
+                if (mask & (1 << lane))
+                {
+                    ShadePixel(draw, level1, level2, index + lane, invW[lane], uw[lane], vw[lane]);
+                    pixels++;
+                }
+            }
+        }
+    }
+#else
+    for (int y = minY; y <= maxY; y++)
+    {
+        float py = y + 0.5f - originY;
+        int64_t cy = (int64_t)y * Subpixel + half;
+
+        for (int x = minX; x <= maxX; x++)
+        {
+            float px = x + 0.5f - originX;
+            int64_t cx = (int64_t)x * Subpixel + half;
+
+            bool inside = true;
+            for (int i = 0; i < 3 && inside; i++)
+                inside = edgeA[i] * cx + edgeB[i] * cy + edgeC[i] >= 0;
+            if (!inside)
+                continue;
+
+            uint32_t index = (uint32_t)y * mPitch + (uint32_t)x;
+            float z = tri.Z[0] * px + tri.Z[1] * py + tri.Z[2];
+            if (!(z < mDepth[index]))
+                continue;
+
+            mDepth[index] = z;
+            ShadePixel(draw, level1, level2, index,
+                tri.InvW[0] * px + tri.InvW[1] * py + tri.InvW[2],
+                tri.UOverW[0] * px + tri.UOverW[1] * py + tri.UOverW[2],
+                tri.VOverW[0] * px + tri.VOverW[1] * py + tri.VOverW[2]);
+            pixels++;
+        }
+    }
+#endif
+
+    return pixels;
+}
+
+// PS: lerp(gDiffuseMap1.Sample, gDiffuseMap2.Sample, gBlendFactor.x)
+void SoftRasterizer::ShadePixel(
+    const SoftDraw& draw, uint32_t level1, uint32_t level2, uint32_t index, float invW, float uw, float vw)
+{
+    float w = 1.0f / invW;
+    float u = uw * w;
+    float v = vw * w;
+
+    float color1[4], color2[4];
+    SampleBilinear(draw.Texture1, level1, u, v, color1);
+    SampleBilinear(draw.Texture2, level2, u, v, color2);
+
+    uint32_t packed = 0;
+    float blend = mConstants.BlendFactor;
+    for (int c = 0; c < 4; c++)
+    {
+        float value = color1[c] + (color2[c] - color1[c]) * blend + 0.5f;
+        value = (std::min)((std::max)(value, 0.0f), 255.0f);
+        packed |= (uint32_t)value << (c * 8);
+    }
+
+    mColor[index] = packed;
+}
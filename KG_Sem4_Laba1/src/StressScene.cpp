@@ -0,0 +1,104 @@
+﻿#include "../h/StressScene.h"
+#include <cmath>
+
+namespace
+{
+    // xorshift32: распределения std:: отличаются между стандартными библиотеками,
+    // а сцена должна совпадать на всех машинах
+    struct Random
+    {
+        uint32_t State;
+
+        uint32_t Next()
+        {
+            State ^= State << 13;
+            State ^= State >> 17;
+            State ^= State << 5;
+            return State;
+        }
+
+        float Uniform(float lo, float hi)
+        {
+            return lo + (hi - lo) * ((Next() >> 8) * (1.0f / 16777216.0f));
+        }
+    };
+
+    const float Pi = 3.14159265358979f;
+}
+
+void GenerateStressScene(
+    const StressSceneDesc& desc,
+    const std::vector<StressProp>& props,
+    std::vector<InstanceData>& instances,
+    std::vector<InstanceBatch>& batches)
+{
+    instances.clear();
+    batches.clear();
+
+    if (props.empty() || desc.CountX == 0 || desc.CountZ == 0)
+        return;
+
+    Random random = { desc.Seed != 0 ? desc.Seed : 1 };
+
+    struct Placement
+    {
+        uint32_t Prop;
+        InstanceData Data;
+    };
+
+    std::vector<Placement> placements;
+    placements.reserve((size_t)desc.CountX * desc.CountZ);
+
+    float startX = desc.Origin[0] - 0.5f * desc.Spacing * (desc.CountX - 1);
+    float startZ = desc.Origin[2] - 0.5f * desc.Spacing * (desc.CountZ - 1);
+
+    for (uint32_t z = 0; z < desc.CountZ; z++)
+    {
+        for (uint32_t x = 0; x < desc.CountX; x++)
+        {
+            Placement p;
+            p.Prop = random.Next() % (uint32_t)props.size();
+
+            float jitter = desc.Jitter * desc.Spacing;
+            float px = startX + x * desc.Spacing + random.Uniform(-jitter, jitter);
+            float pz = startZ + z * desc.Spacing + random.Uniform(-jitter, jitter);
+            float angle = random.Uniform(0.0f, 2.0f * Pi);
+            float scale = random.Uniform(desc.MinScale, desc.MaxScale);
+
+            // World = T(-center) * S * Ry * T(p): центр пропа встаёт в узел
+            float c = std::cos(angle) * scale;
+            float s = std::sin(angle) * scale;
+            const float* center = props[p.Prop].Center;
+
+            float (*m)[4] = p.Data.World;
+            m[0][0] = c;    m[0][1] = 0.0f;  m[0][2] = -s;   m[0][3] = 0.0f;
+            m[1][0] = 0.0f; m[1][1] = scale; m[1][2] = 0.0f; m[1][3] = 0.0f;
+            m[2][0] = s;    m[2][1] = 0.0f;  m[2][2] = c;    m[2][3] = 0.0f;
+            m[3][0] = px - (center[0] * c + center[2] * s);
+            m[3][1] = desc.Origin[1] - center[1] * scale;
+            m[3][2] = pz - (-center[0] * s + center[2] * c);
+            m[3][3] = 1.0f;
+
+            placements.push_back(p);
+        }
+    }
+
+    // Группировка по пропу подсчётом: порядок внутри пропа - порядок сетки
+    std::vector<uint32_t> counts(props.size(), 0);
+    for (const Placement& p : placements)
+        counts[p.Prop]++;
+
+    std::vector<uint32_t> offsets(props.size(), 0);
+    uint32_t sum = 0;
+    for (size_t i = 0; i < props.size(); i++)
+    {
+        offsets[i] = sum;
+        if (counts[i] > 0)
+            batches.push_back({ props[i].Submesh, sum, counts[i] });
+        sum += counts[i];
+    }
+
+    instances.resize(placements.size());
+    for (const Placement& p : placements)
+        instances[offsets[p.Prop]++] = p.Data;
+}
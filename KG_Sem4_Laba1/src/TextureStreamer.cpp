@@ -0,0 +1,182 @@
+﻿#include "../h/TextureStreamer.h"
+#include <algorithm>
+#include <cmath>
+
+TextureStreamer::TextureStreamer(uint64_t budgetBytes, uint64_t uploadBytesPerFrame) :
+    mBudgetBytes(budgetBytes),
+    mUploadBytesPerFrame(uploadBytesPerFrame)
+{
+    mStats.BudgetBytes = budgetBytes;
+}
+
+uint32_t TextureStreamer::MipForSize(uint32_t width, uint32_t height, uint32_t maxSize)
+{
+    uint32_t mip = 0;
+    while (std::max(std::max(1u, width >> mip), std::max(1u, height >> mip)) > std::max(1u, maxSize))
+        ++mip;
+    return mip;
+}
+
+uint32_t TextureStreamer::AddTexture(
+    uint32_t width, uint32_t height, uint32_t mipCount, uint32_t bitsPerPixel,
+    uint32_t blockSize, uint32_t startupMip)
+{
+    Texture t;
+    t.Width = width;
+    t.Height = height;
+    t.MipCount = std::max(1u, mipCount);
+    t.BitsPerPixel = bitsPerPixel;
+    t.BlockSize = std::max(1u, blockSize);
+
+    // Мипы из целых блоков идут подряд: после первого такого стороны делятся ровно
+    // пополам, пока остаются кратными блоку. Первый - граница, которую не переходят
+    // повышения, последний - самый грубый допустимый стартовый
+    auto aligned = [&t](uint32_t mip)
+    {
+        return (t.Width >> mip) > 0 && (t.Height >> mip) > 0 &&
+               (t.Width >> mip) % t.BlockSize == 0 && (t.Height >> mip) % t.BlockSize == 0;
+    };
+    while (t.TopMip + 1 < t.MipCount && !aligned(t.TopMip))
+        ++t.TopMip;
+    uint32_t lastAligned = t.TopMip;
+    while (lastAligned + 1 < t.MipCount && aligned(lastAligned + 1))
+        ++lastAligned;
+
+    t.StartupMip = std::clamp(std::min(startupMip, t.MipCount - 1), t.TopMip, lastAligned);
+    t.ResidentMip = t.StartupMip;
+    t.WantedMip = float(t.StartupMip);
+    mTextures.push_back(t);
+
+    uint32_t id = uint32_t(mTextures.size() - 1);
+    for (uint32_t mip = t.StartupMip; mip < t.MipCount; ++mip)
+        mStats.ResidentBytes += MipBytes(id, mip);
+
+    return id;
+}
+
+uint64_t TextureStreamer::MipBytes(uint32_t texture, uint32_t mip) const
+{
+    const Texture& t = mTextures[texture];
+    uint64_t blocksX = (std::max(1u, t.Width >> mip) + t.BlockSize - 1) / t.BlockSize;
+    uint64_t blocksY = (std::max(1u, t.Height >> mip) + t.BlockSize - 1) / t.BlockSize;
+    return blocksX * blocksY * t.BlockSize * t.BlockSize * t.BitsPerPixel / 8;
+}
+
+void TextureStreamer::BeginFrame()
+{
+    // Текстура, которую в этом кадре никто не запросил, может опуститься до стартового мипа
+    for (Texture& t : mTextures)
+        t.WantedMip = float(t.StartupMip);
+}
+
+void TextureStreamer::RequestMip(uint32_t texture, float mip)
+{
+    Texture& t = mTextures[texture];
+    t.WantedMip = std::min(t.WantedMip, std::max(mip, 0.0f));
+}
+
+const std::vector<MipChange>& TextureStreamer::Update()
+{
+    mChanges.clear();
+    mStats.UploadedBytes = 0;
+    mStats.Upgrades = 0;
+    mStats.PendingRequests = 0;
+    mStats.BudgetBytes = mBudgetBytes;
+
+    mUpgradeOrder.clear();
+    mEvictOrder.clear();
+
+    for (uint32_t i = 0; i < mTextures.size(); ++i)
+    {
+        Texture& t = mTextures[i];
+        t.FrameStartMip = t.ResidentMip;
+        t.TargetMip = std::max(t.TopMip, std::min(t.StartupMip, uint32_t(std::floor(t.WantedMip))));
+
+        if (t.TargetMip < t.ResidentMip)
+            mUpgradeOrder.push_back(i);
+        else if (t.TargetMip > t.ResidentMip)
+            mEvictOrder.push_back(i);
+    }
+
+    // Вытесняем в первую очередь самую избыточную детализацию
+    std::sort(mEvictOrder.begin(), mEvictOrder.end(),
+        [this](uint32_t a, uint32_t b)
+        {
+            uint32_t excessA = mTextures[a].TargetMip - mTextures[a].ResidentMip;
+            uint32_t excessB = mTextures[b].TargetMip - mTextures[b].ResidentMip;
+            if (excessA != excessB)
+                return excessA > excessB;
+            return MipBytes(a, mTextures[a].ResidentMip) > MipBytes(b, mTextures[b].ResidentMip);
+        });
+
+    // Бюджет мог уменьшиться с прошлого кадра
+    EvictFor(0);
+
+    // Сначала самые недогруженные, при равенстве - те, что дешевле догрузить
+    std::sort(mUpgradeOrder.begin(), mUpgradeOrder.end(),
+        [this](uint32_t a, uint32_t b)
+        {
+            uint32_t gapA = mTextures[a].ResidentMip - mTextures[a].TargetMip;
+            uint32_t gapB = mTextures[b].ResidentMip - mTextures[b].TargetMip;
+            if (gapA != gapB)
+                return gapA > gapB;
+            return MipBytes(a, mTextures[a].ResidentMip - 1) < MipBytes(b, mTextures[b].ResidentMip - 1);
+        });
+
+    // По одному мипу на текстуру за проход, пока есть бюджет загрузки
+    bool progress = true;
+    while (progress)
+    {
+        progress = false;
+        for (uint32_t i : mUpgradeOrder)
+        {
+            Texture& t = mTextures[i];
+            if (t.ResidentMip <= t.TargetMip)
+                continue;
+
+            uint64_t cost = MipBytes(i, t.ResidentMip - 1);
+
+            // Мип крупнее лимита кадра пропускаем только первым, иначе он не загрузится никогда
+            if (mStats.UploadedBytes > 0 && mStats.UploadedBytes + cost > mUploadBytesPerFrame)
+                continue;
+            if (!EvictFor(cost))
+                continue;
+
+            t.ResidentMip--;
+            mStats.ResidentBytes += cost;
+            mStats.UploadedBytes += cost;
+            mStats.Upgrades++;
+            progress = true;
+        }
+    }
+
+    for (uint32_t i = 0; i < mTextures.size(); ++i)
+    {
+        const Texture& t = mTextures[i];
+        if (t.TargetMip < t.ResidentMip)
+            mStats.PendingRequests++;
+        if (t.ResidentMip != t.FrameStartMip)
+            mChanges.push_back({ i, t.FrameStartMip, t.ResidentMip });
+    }
+
+    return mChanges;
+}
+
+bool TextureStreamer::EvictFor(uint64_t bytes)
+{
+    for (uint32_t i : mEvictOrder)
+    {
+        if (mStats.ResidentBytes + bytes <= mBudgetBytes)
+            break;
+
+        Texture& t = mTextures[i];
+        while (t.ResidentMip < t.TargetMip && mStats.ResidentBytes + bytes > mBudgetBytes)
+        {
+            mStats.ResidentBytes -= MipBytes(i, t.ResidentMip);
+            t.ResidentMip++;
+            mStats.Evictions++;
+        }
+    }
+
+    return mStats.ResidentBytes + bytes <= mBudgetBytes;
+}
@@ -20,4 +20,89 @@ bool LoadTGA(const std::string& filename, TgaImage& outImage)
     file.read((char*)outImage.data.data(), imageSize);
 
     return true;
-}
\ No newline at end of file
+}
+
+bool ParseTGA(const unsigned char* data, size_t size, TgaView& outView)
+{
+    if (size < 18)
+        return false;
+
+    int idLength = data[0];
+    int colorMapType = data[1];
+    int imageType = data[2];
+
+    if (colorMapType != 0 || imageType != 2)
+        return false;
+
+    outView.width = data[12] | (data[13] << 8);
+    outView.height = data[14] | (data[15] << 8);
+    outView.channels = data[16] / 8;
+
+    if (outView.width == 0 || outView.height == 0 ||
+        (outView.channels != 3 && outView.channels != 4))
+        return false;
+
+    size_t offset = 18 + size_t(idLength);
+    size_t imageSize = size_t(outView.width) * outView.height * outView.channels;
+    if (size < offset + imageSize)
+        return false;
+
+    outView.pixels = data + offset;
+    return true;
+}
+
+TgaAlphaKind ClassifyTgaAlpha(const TgaView& view)
+{
+    if (view.channels != 4)
+        return TgaAlphaOpaque;
+
+    // Почти пустое и почти непрозрачное - края маски после сжатия и ресэмплинга
+    const unsigned char Low = 16;
+    const unsigned char High = 239;
+
+    size_t texels = size_t(view.width) * view.height;
+    size_t partial = 0;
+    bool cut = false;
+    for (size_t i = 0; i < texels; i++)
+    {
+        unsigned char alpha = view.pixels[i * 4 + 3];
+        partial += (alpha > Low && alpha < High) ? 1 : 0;
+        cut |= alpha < High;
+    }
+
+    if (partial * TgaTranslucentShare > texels)
+        return TgaAlphaTranslucent;
+    return cut ? TgaAlphaMask : TgaAlphaOpaque;
+}
+
+bool SaveTGA(const std::string& filename, int width, int height, const unsigned char* bgra, size_t rowPitch)
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+
+    unsigned char header[18] = {};
+    header[2] = 2; // несжатый truecolor
+    header[12] = (unsigned char)(width & 0xFF);
+    header[13] = (unsigned char)(width >> 8);
+    header[14] = (unsigned char)(height & 0xFF);
+    header[15] = (unsigned char)(height >> 8);
+    header[16] = 24;
+    header[17] = 0x20; // первая строка - верхняя
+    file.write((const char*)header, 18);
+
+    std::vector<unsigned char> row(size_t(width) * 3);
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char* src = bgra + size_t(y) * rowPitch;
+        for (int x = 0; x < width; x++)
+        {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        file.write((const char*)row.data(), row.size());
+    }
+
+    return (bool)file;
+}
@@ -0,0 +1,377 @@
+﻿#include "../h/TlsfAllocator.h"
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+TlsfAllocator::TlsfAllocator(uint64_t capacity, uint64_t granularity)
+{
+    mGranularity = std::bit_ceil((std::max)(granularity, (uint64_t)1));
+    mCapacity = capacity / mGranularity * mGranularity;
+
+    for (auto& row : mHeads)
+    {
+        std::fill(std::begin(row), std::end(row), None);
+    }
+
+    if (mCapacity > 0)
+    {
+        uint32_t block = NewBlock();
+        mBlocks[block].Offset = 0;
+        mBlocks[block].Size = mCapacity;
+        InsertFree(block);
+    }
+}
+
+// Размер в гранулах: меньше SlCount - точные корзины первой строки, дальше
+// строка - степень двойки, столбец - её шестнадцатая доля
+void TlsfAllocator::Mapping(uint64_t size, uint32_t& fl, uint32_t& sl) const
+{
+    uint64_t n = size / mGranularity;
+    if (n < SlCount)
+    {
+        fl = 0;
+        sl = (uint32_t)n;
+        return;
+    }
+
+    uint32_t log = (uint32_t)std::bit_width(n) - 1;
+    fl = log - SlLog2 + 1;
+    sl = (uint32_t)(n >> (log - SlLog2)) - SlCount;
+}
+
+// Ищется размер с запасом на выравнивание, округлённый вверх до начала следующей
+// корзины: любой блок из найденной корзины подходит без обхода списка. Если таких
+// нет, подходящий блок ещё может лежать в корзинах между size и запасом (почти
+// полная куча, выделение всей кучи) - их списки обходятся с проверкой настоящего
+// выравнивания, не больше MaxFallbackVisits блоков
+uint32_t TlsfAllocator::FindFree(uint64_t size, uint64_t alignment) const
+{
+    uint64_t search = size + (alignment - mGranularity);
+    uint64_t n = search / mGranularity;
+    if (n >= SlCount)
+    {
+        uint32_t log = (uint32_t)std::bit_width(n) - 1;
+        n += (1ull << (log - SlLog2)) - 1;
+    }
+
+    uint32_t fl, sl;
+    Mapping(n * mGranularity, fl, sl);
+
+    uint32_t slMap = fl < FlCount ? mSlBitmap[fl] & (~0u << sl) : 0;
+    uint64_t flMap = fl + 1 < FlCount ? mFlBitmap & (~0ull << (fl + 1)) : 0;
+    if (slMap == 0 && flMap != 0)
+    {
+        fl = (uint32_t)std::countr_zero(flMap);
+        slMap = mSlBitmap[fl];
+    }
+
+    if (slMap != 0 && search <= mCapacity)
+        return mHeads[fl][(uint32_t)std::countr_zero(slMap)];
+
+    uint32_t lastFl, lastSl;
+    Mapping(size, fl, sl);
+    Mapping((std::min)(search, mCapacity), lastFl, lastSl);
+
+    uint32_t visits = 0;
+    for (; fl <= lastFl; fl++, sl = 0)
+    {
+        uint32_t map = mSlBitmap[fl] & (~0u << sl);
+        if (fl == lastFl)
+            map &= lastSl + 1 < SlCount ? (1u << (lastSl + 1)) - 1 : ~0u;
+
+        for (; map != 0; map &= map - 1)
+        {
+            for (uint32_t b = mHeads[fl][std::countr_zero(map)]; b != None; b = mBlocks[b].NextFree)
+            {
+                const Block& block = mBlocks[b];
+                if (AlignUp(block.Offset, alignment) + size <= block.Offset + block.Size)
+                    return b;
+                if (++visits == MaxFallbackVisits)
+                    return None;
+            }
+        }
+    }
+    return None;
+}
+
+void TlsfAllocator::InsertFree(uint32_t block)
+{
+    Block& b = mBlocks[block];
+    uint32_t fl, sl;
+    Mapping(b.Size, fl, sl);
+
+    b.Free = true;
+    b.PrevFree = None;
+    b.NextFree = mHeads[fl][sl];
+    if (b.NextFree != None)
+        mBlocks[b.NextFree].PrevFree = block;
+
+    mHeads[fl][sl] = block;
+    mSlBitmap[fl] |= 1u << sl;
+    mFlBitmap |= 1ull << fl;
+    mFreeBlocks++;
+}
+
+void TlsfAllocator::RemoveFree(uint32_t block)
+{
+    Block& b = mBlocks[block];
+    uint32_t fl, sl;
+    Mapping(b.Size, fl, sl);
+
+    if (b.PrevFree != None)
+        mBlocks[b.PrevFree].NextFree = b.NextFree;
+    else
+        mHeads[fl][sl] = b.NextFree;
+
+    if (b.NextFree != None)
+        mBlocks[b.NextFree].PrevFree = b.PrevFree;
+
+    if (mHeads[fl][sl] == None)
+    {
+        mSlBitmap[fl] &= ~(1u << sl);
+        if (mSlBitmap[fl] == 0)
+            mFlBitmap &= ~(1ull << fl);
+    }
+
+    b.Free = false;
+    b.PrevFree = None;
+    b.NextFree = None;
+    mFreeBlocks--;
+}
+
+uint32_t TlsfAllocator::NewBlock()
+{
+    if (!mUnusedBlocks.empty())
+    {
+        uint32_t block = mUnusedBlocks.back();
+        mUnusedBlocks.pop_back();
+        mBlocks[block] = Block();
+        return block;
+    }
+
+    mBlocks.push_back(Block());
+    return (uint32_t)(mBlocks.size() - 1);
+}
+
+void TlsfAllocator::ReleaseBlock(uint32_t block)
+{
+    mBlocks[block] = Block();
+    mUnusedBlocks.push_back(block);
+}
+
+void TlsfAllocator::SplitTail(uint32_t block, uint64_t offset)
+{
+    uint32_t tail = NewBlock();
+    Block& b = mBlocks[block];
+    Block& t = mBlocks[tail];
+
+    t.Offset = offset;
+    t.Size = b.Offset + b.Size - offset;
+    t.PrevPhys = block;
+    t.NextPhys = b.NextPhys;
+    if (t.NextPhys != None)
+        mBlocks[t.NextPhys].PrevPhys = tail;
+
+    b.Size = offset - b.Offset;
+    b.NextPhys = tail;
+
+    InsertFree(tail);
+}
+
+// Блок ищется с запасом на выравнивание. Соседи свободного блока заняты, поэтому
+// отступ спереди и остаток сзади становятся свободными блоками без слияния.
+TlsfAllocation TlsfAllocator::Allocate(uint64_t size, uint64_t alignment)
+{
+    // Больше кучи всё равно не выделить, а округление вверх тогда не переполняется
+    if (size > mCapacity || alignment > mCapacity)
+    {
+        mFailures++;
+        return {};
+    }
+
+    alignment = std::bit_ceil((std::max)(alignment, mGranularity));
+    size = AlignUp((std::max)(size, (uint64_t)1), mGranularity);
+
+    uint32_t block = FindFree(size, alignment);
+    if (block == None)
+    {
+        mFailures++;
+        return {};
+    }
+
+    RemoveFree(block);
+
+    uint64_t offset = mBlocks[block].Offset;
+    uint64_t aligned = AlignUp(offset, alignment);
+    if (aligned > offset)
+    {
+        // Отступ остаётся за блоком перед ним: отрезаем выделяемую часть как хвост
+        SplitTail(block, aligned);
+        RemoveFree(mBlocks[block].NextPhys);
+        uint32_t padding = block;
+        block = mBlocks[block].NextPhys;
+        InsertFree(padding);
+    }
+
+    if (mBlocks[block].Size > size)
+        SplitTail(block, aligned + size);
+
+    Block& b = mBlocks[block];
+    mUsedBytes += b.Size;
+    mAllocations++;
+
+    TlsfAllocation allocation;
+    allocation.Offset = b.Offset;
+    allocation.Size = b.Size;
+    allocation.Block = block;
+    return allocation;
+}
+
+void TlsfAllocator::Free(const TlsfAllocation& allocation)
+{
+    if (!allocation.Valid())
+        return;
+
+    uint32_t block = allocation.Block;
+    mUsedBytes -= mBlocks[block].Size;
+    mAllocations--;
+
+    uint32_t next = mBlocks[block].NextPhys;
+    if (next != None && mBlocks[next].Free)
+    {
+        RemoveFree(next);
+        mBlocks[block].Size += mBlocks[next].Size;
+        mBlocks[block].NextPhys = mBlocks[next].NextPhys;
+        if (mBlocks[block].NextPhys != None)
+            mBlocks[mBlocks[block].NextPhys].PrevPhys = block;
+        ReleaseBlock(next);
+    }
+
+    uint32_t prev = mBlocks[block].PrevPhys;
+    if (prev != None && mBlocks[prev].Free)
+    {
+        RemoveFree(prev);
+        mBlocks[prev].Size += mBlocks[block].Size;
+        mBlocks[prev].NextPhys = mBlocks[block].NextPhys;
+        if (mBlocks[prev].NextPhys != None)
+            mBlocks[mBlocks[prev].NextPhys].PrevPhys = prev;
+        ReleaseBlock(block);
+        block = prev;
+    }
+
+    InsertFree(block);
+}
+
+TlsfStats TlsfAllocator::Stats() const
+{
+    TlsfStats stats;
+    stats.Capacity = mCapacity;
+    stats.UsedBytes = mUsedBytes;
+    stats.FreeBytes = mCapacity - mUsedBytes;
+    stats.Allocations = mAllocations;
+    stats.FreeBlocks = mFreeBlocks;
+    stats.Failures = mFailures;
+
+    // Самый большой свободный - в старшей непустой корзине
+    if (mFlBitmap != 0)
+    {
+        uint32_t fl = (uint32_t)std::bit_width(mFlBitmap) - 1;
+        uint32_t sl = (uint32_t)std::bit_width(mSlBitmap[fl]) - 1;
+
+        for (uint32_t b = mHeads[fl][sl]; b != None; b = mBlocks[b].NextFree)
+        {
+            stats.LargestFreeBlock = (std::max)(stats.LargestFreeBlock, mBlocks[b].Size);
+        }
+    }
+
+    return stats;
+}
+
+bool TlsfAllocator::Validate() const
+{
+    std::vector<bool> unused(mBlocks.size(), false);
+    for (uint32_t b : mUnusedBlocks)
+    {
+        unused[b] = true;
+    }
+
+    // Физическая цепочка: от нулевого смещения без дыр до конца кучи
+    uint32_t first = None;
+    for (uint32_t b = 0; b < (uint32_t)mBlocks.size(); b++)
+    {
+        if (!unused[b] && mBlocks[b].PrevPhys == None)
+        {
+            if (first != None)
+                return false;
+            first = b;
+        }
+    }
+
+    uint64_t offset = 0;
+    uint64_t used = 0;
+    uint32_t freeCount = 0;
+    uint32_t usedCount = 0;
+    uint32_t prev = None;
+
+    for (uint32_t b = first; b != None; b = mBlocks[b].NextPhys)
+    {
+        const Block& block = mBlocks[b];
+        if (unused[b] || block.Offset != offset || block.Size == 0 ||
+            block.Size % mGranularity != 0 || block.PrevPhys != prev)
+            return false;
+
+        if (block.Free)
+        {
+            if (prev != None && mBlocks[prev].Free)
+                return false;
+            freeCount++;
+        }
+        else
+        {
+            used += block.Size;
+            usedCount++;
+        }
+
+        offset += block.Size;
+        prev = b;
+    }
+
+    if (offset != mCapacity || used != mUsedBytes || usedCount != mAllocations || freeCount != mFreeBlocks)
+        return false;
+
+    // Корзины: блоки в своих списках, маски совпадают с непустыми списками
+    uint32_t listed = 0;
+    for (uint32_t fl = 0; fl < FlCount; fl++)
+    {
+        for (uint32_t sl = 0; sl < SlCount; sl++)
+        {
+            bool bit = (mSlBitmap[fl] >> sl) & 1;
+            if (bit != (mHeads[fl][sl] != None))
+                return false;
+
+            uint32_t prevFree = None;
+            for (uint32_t b = mHeads[fl][sl]; b != None; b = mBlocks[b].NextFree)
+            {
+                uint32_t bfl, bsl;
+                Mapping(mBlocks[b].Size, bfl, bsl);
+                if (!mBlocks[b].Free || bfl != fl || bsl != sl || mBlocks[b].PrevFree != prevFree)
+                    return false;
+
+                prevFree = b;
+                listed++;
+            }
+        }
+
+        if (((mFlBitmap >> fl) & 1) != (mSlBitmap[fl] != 0))
+            return false;
+    }
+
+    return listed == mFreeBlocks;
+}
@@ -0,0 +1,219 @@
+﻿#include "../h/TransparentSorter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+    // Биты float в порядке возрастания числа, затем инверсия: дальние - первыми
+    uint32_t FarFirstKey(float depth)
+    {
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        bits = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+        return ~bits;
+    }
+}
+
+void TransparentSorter::Begin()
+{
+    for (const Entry& e : mAdded)
+    {
+        mSlot[e.Id] = 0;
+    }
+    mAdded.clear();
+}
+
+void TransparentSorter::Add(uint32_t id, float depth)
+{
+    if (id >= mSlot.size())
+        mSlot.resize((size_t)id + 1, 0);
+
+    // Повторный Add того же id в кадре обновляет глубину
+    if (mSlot[id] != 0)
+    {
+        mAdded[mSlot[id] - 1].Key = FarFirstKey(depth);
+        return;
+    }
+
+    mAdded.push_back({ FarFirstKey(depth), id });
+    mSlot[id] = (uint32_t)mAdded.size();
+}
+
+void TransparentSorter::Sort()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    mStats = {};
+    mStats.Items = (uint32_t)mAdded.size();
+
+    // Прошлый порядок без исчезнувших - отдельно от новых. Взятые из
+    // прошлого порядка помечаются старшим битом слота
+    const uint32_t Taken = 0x80000000u;
+    mEntries.clear();
+    for (uint32_t id : mOrder)
+    {
+        if (id >= mSlot.size() || mSlot[id] == 0 || (mSlot[id] & Taken))
+            continue;
+
+        mEntries.push_back(mAdded[mSlot[id] - 1]);
+        mSlot[id] |= Taken;
+    }
+
+    mFresh.clear();
+    for (const Entry& e : mAdded)
+    {
+        if (mSlot[e.Id] & Taken)
+        {
+            mSlot[e.Id] &= ~Taken;
+            continue;
+        }
+
+        mFresh.push_back(e);
+    }
+    mStats.NewItems = (uint32_t)mFresh.size();
+
+    // Почти всё новое (первый кадр, телепорт) - подсказки нет
+    if (mFresh.size() * FreshRatio > mAdded.size())
+    {
+        mEntries.insert(mEntries.end(), mFresh.begin(), mFresh.end());
+        RadixSort();
+        mStats.Radix = true;
+    }
+    else
+    {
+        // Спуск стоит в среднем mMovesPerDescent сдвигов: если спусков больше,
+        // чем бюджет вмещает, вставки не начинаются. Счёт обрывается на пороге -
+        // при резком повороте не нужно пробегать весь порядок
+        uint64_t budget = (uint64_t)MovesPerItem * mEntries.size();
+        uint64_t limit = (uint64_t)(budget / mMovesPerDescent);
+        uint64_t descents = 0;
+        for (size_t i = 1; i < mEntries.size() && descents <= limit; i++)
+        {
+            descents += mEntries[i - 1].Key > mEntries[i].Key ? 1 : 0;
+        }
+        mStats.Descents = (uint32_t)descents;
+
+        if (descents > limit)
+        {
+            // Один дальний сдвиг мог раздуть замер: без вставок он бы не
+            // пересматривался, поэтому каждый такой кадр он стягивается к исходному
+            mMovesPerDescent = (std::max)((float)MovesPerDescent, mMovesPerDescent * 0.5f);
+            mStats.Predicted = true;
+            RadixSort();
+            mStats.Radix = true;
+        }
+        else
+        {
+            // Замер идёт и по брошенным вставкам: следующий кадр того же
+            // поворота откажется от них сразу. Ниже исходной оценки порог не
+            // опускается - иначе после спокойных кадров разворот не распознать
+            uint32_t sorted = 0;
+            bool finished = InsertionSort(budget, sorted);
+            if (sorted != 0)
+                mMovesPerDescent = (std::max)((float)MovesPerDescent, (float)mStats.Moves / (float)sorted);
+
+            if (!finished)
+            {
+                RadixSort();
+                mStats.Radix = true;
+            }
+        }
+
+        // Новых мало: вставки каждого в конец стоили бы по O(n), а слияние
+        // отсортированных отдельно - O(n) на всех. Прежние при равенстве раньше.
+        if (!mFresh.empty())
+        {
+            auto byKey = [](const Entry& a, const Entry& b) { return a.Key < b.Key; };
+            std::stable_sort(mFresh.begin(), mFresh.end(), byKey);
+
+            mScratch.resize(mEntries.size() + mFresh.size());
+            std::merge(mEntries.begin(), mEntries.end(), mFresh.begin(), mFresh.end(), mScratch.begin(), byKey);
+            mEntries.swap(mScratch);
+        }
+    }
+
+    mOrder.resize(mEntries.size());
+    for (size_t i = 0; i < mEntries.size(); i++)
+    {
+        mOrder[i] = mEntries[i].Id;
+    }
+
+    mStats.Us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// false - бюджет сдвигов исчерпан; массив при этом остаётся перестановкой исходного
+// descents - сколько спусков успели устранить
+bool TransparentSorter::InsertionSort(uint64_t budget, uint32_t& descents)
+{
+    Entry* items = mEntries.data();
+    size_t count = mEntries.size();
+
+    for (size_t i = 1; i < count; i++)
+    {
+        if (items[i - 1].Key <= items[i].Key)
+            continue;
+
+        Entry e = items[i];
+        size_t j = i;
+        while (j > 0 && items[j - 1].Key > e.Key)
+        {
+            items[j] = items[j - 1];
+            j--;
+        }
+        items[j] = e;
+
+        descents++;
+        mStats.Moves += i - j;
+        if (mStats.Moves > budget)
+            return false;
+    }
+
+    return true;
+}
+
+void TransparentSorter::RadixSort()
+{
+    size_t count = mEntries.size();
+    if (count < 2)
+        return;
+
+    uint32_t histograms[4][256] = {};
+    for (const Entry& e : mEntries)
+    {
+        for (int b = 0; b < 4; b++)
+            histograms[b][(e.Key >> (b * 8)) & 0xFF]++;
+    }
+
+    mScratch.resize(count);
+    Entry* src = mEntries.data();
+    Entry* dst = mScratch.data();
+
+    for (int b = 0; b < 4; b++)
+    {
+        uint32_t* histogram = histograms[b];
+
+        // Байт одинаковый у всех - проход ничего не переставит
+        if (histogram[(src[0].Key >> (b * 8)) & 0xFF] == count)
+            continue;
+
+        uint32_t offsets[256];
+        uint32_t sum = 0;
+        for (int i = 0; i < 256; i++)
+        {
+            offsets[i] = sum;
+            sum += histogram[i];
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t digit = (src[i].Key >> (b * 8)) & 0xFF;
+            dst[offsets[digit]++] = src[i];
+        }
+
+        std::swap(src, dst);
+    }
+
+    if (src != mEntries.data())
+        mEntries.swap(mScratch);
+}
@@ -0,0 +1,782 @@
+﻿#include "../h/TriangleBvh.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+// TRIANGLE_BVH_NO_SSE - скалярный путь и на x86 (TriangleBvhScalarTest)
+#if !defined(TRIANGLE_BVH_NO_SSE) && (defined(_M_X64) || defined(_M_IX86) || defined(__SSE__))
+#include <xmmintrin.h>
+#define TRIANGLE_BVH_SSE 1
+#endif
+
+namespace
+{
+    const uint32_t BinCount = 12;
+    const uint32_t MaxLeafSize = 8;
+    const float TraversalCost = 1.0f;
+    const float TriangleEpsilon = 1e-8f;
+
+    float SurfaceArea(const float mn[3], const float mx[3])
+    {
+        float dx = mx[0] - mn[0];
+        float dy = mx[1] - mn[1];
+        float dz = mx[2] - mn[2];
+        return 2.0f * (dx * dy + dy * dz + dz * dx);
+    }
+
+    // Ближайшая точка треугольника abc к p (Ericson, Real-Time Collision Detection 5.1.5)
+    void ClosestPointOnTriangle(const float p[3], const float a[3], const float b[3], const float c[3], float out[3])
+    {
+        float ab[3], ac[3], ap[3];
+        for (int i = 0; i < 3; i++)
+        {
+            ab[i] = b[i] - a[i];
+            ac[i] = c[i] - a[i];
+            ap[i] = p[i] - a[i];
+        }
+
+        auto dot = [](const float x[3], const float y[3]) { return x[0] * y[0] + x[1] * y[1] + x[2] * y[2]; };
+        auto set = [&](float u, float v, float w)
+        {
+            for (int i = 0; i < 3; i++)
+                out[i] = a[i] * u + b[i] * v + c[i] * w;
+        };
+
+        float d1 = dot(ab, ap);
+        float d2 = dot(ac, ap);
+        if (d1 <= 0.0f && d2 <= 0.0f) { set(1, 0, 0); return; }
+
+        float bp[3] = { p[0] - b[0], p[1] - b[1], p[2] - b[2] };
+        float d3 = dot(ab, bp);
+        float d4 = dot(ac, bp);
+        if (d3 >= 0.0f && d4 <= d3) { set(0, 1, 0); return; }
+
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        {
+            float v = d1 / (d1 - d3);
+            set(1 - v, v, 0);
+            return;
+        }
+
+        float cp[3] = { p[0] - c[0], p[1] - c[1], p[2] - c[2] };
+        float d5 = dot(ab, cp);
+        float d6 = dot(ac, cp);
+        if (d6 >= 0.0f && d5 <= d6) { set(0, 0, 1); return; }
+
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        {
+            float w = d2 / (d2 - d6);
+            set(1 - w, 0, w);
+            return;
+        }
+
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        {
+            float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+            set(0, 1 - w, w);
+            return;
+        }
+
+        float denom = 1.0f / (va + vb + vc);
+        float v = vb * denom;
+        float w = vc * denom;
+        set(1 - v - w, v, w);
+    }
+}
+
+// =========== Build ===========
+void TriangleBvh::Build(
+    const float* positions, size_t vertexStride, const uint32_t* indices, size_t indexCount,
+    JobSystem* jobs)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    uint32_t triangleCount = (uint32_t)(indexCount / 3);
+
+    auto vertex = [&](uint32_t index)
+    {
+        return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + index * vertexStride);
+    };
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        mCentroids[axis].resize(triangleCount);
+        mBoundsMin[axis].resize(triangleCount);
+        mBoundsMax[axis].resize(triangleCount);
+    }
+
+    mTriangleIds.resize(triangleCount);
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        const float* a = vertex(indices[t * 3 + 0]);
+        const float* b = vertex(indices[t * 3 + 1]);
+        const float* c = vertex(indices[t * 3 + 2]);
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            mBoundsMin[axis][t] = (std::min)({ a[axis], b[axis], c[axis] });
+            mBoundsMax[axis][t] = (std::max)({ a[axis], b[axis], c[axis] });
+            mCentroids[axis][t] = (mBoundsMin[axis][t] + mBoundsMax[axis][t]) * 0.5f;
+        }
+
+        mTriangleIds[t] = t;
+    }
+
+    // Верхние уровни делятся здесь, поддеревья строятся задачами в свои
+    // массивы и потом склеиваются со сдвигом индексов правых детей.
+    // Глубина с запасом: по четыре поддерева на поток, чтобы кража выравнивала нагрузку.
+    uint32_t parallelDepth = 0;
+    uint32_t threadCount = jobs ? jobs->ThreadCount() : 1;
+    while (threadCount > 1 && (1u << parallelDepth) < threadCount * 4)
+        parallelDepth++;
+
+    struct Builder
+    {
+        const TriangleBvh* Bvh;
+        JobSystem* Jobs;
+        uint32_t ParallelDepth;
+
+        std::vector<Node> Run(uint32_t first, uint32_t count, uint32_t depth) const
+        {
+            std::vector<Node> nodes;
+            uint32_t mid = 0;
+
+            if (depth >= ParallelDepth || count <= MaxLeafSize || !Bvh->SplitRange(first, count, depth, mid))
+            {
+                if (count > 0)
+                    Bvh->BuildSubtree(nodes, first, count, depth);
+                return nodes;
+            }
+
+            std::vector<Node> left;
+            JobCounter leftDone;
+            Jobs->Run([&] { left = Run(first, mid - first, depth + 1); }, &leftDone);
+            std::vector<Node> right = Run(mid, first + count - mid, depth + 1);
+            Jobs->Wait(leftDone);
+
+            Node root = {};
+            Bvh->ComputeBounds(first, count, root.Min, root.Max);
+            root.RightOrFirst = 1 + (uint32_t)left.size();
+            root.Count = 0;
+
+            nodes.reserve(1 + left.size() + right.size());
+            nodes.push_back(root);
+            for (Node node : left)
+            {
+                if (node.Count == 0)
+                    node.RightOrFirst += 1;
+                nodes.push_back(node);
+            }
+            for (Node node : right)
+            {
+                if (node.Count == 0)
+                    node.RightOrFirst += root.RightOrFirst;
+                nodes.push_back(node);
+            }
+            return nodes;
+        }
+    };
+
+    Builder builder = { this, jobs, parallelDepth };
+    mNodes = builder.Run(0, triangleCount, 0);
+
+    // Глубина листьев: правые дети - со стеком, левый всегда следующий узел
+    mDepth = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> pending;
+    if (!mNodes.empty())
+        pending.push_back({ 0u, 0u });
+    while (!pending.empty())
+    {
+        auto [index, depth] = pending.back();
+        pending.pop_back();
+        while (mNodes[index].Count == 0)
+        {
+            depth++;
+            pending.push_back({ mNodes[index].RightOrFirst, depth });
+            index++;
+        }
+        mDepth = (std::max)(mDepth, depth);
+    }
+    assert(mDepth <= MaxDepth);
+
+    // Треугольники в порядке листьев
+    for (int axis = 0; axis < 3; axis++)
+    {
+        mV0[axis].resize(triangleCount);
+        mE1[axis].resize(triangleCount);
+        mE2[axis].resize(triangleCount);
+    }
+
+    for (uint32_t i = 0; i < triangleCount; i++)
+    {
+        uint32_t t = mTriangleIds[i];
+        const float* a = vertex(indices[t * 3 + 0]);
+        const float* b = vertex(indices[t * 3 + 1]);
+        const float* c = vertex(indices[t * 3 + 2]);
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            mV0[axis][i] = a[axis];
+            mE1[axis][i] = b[axis] - a[axis];
+            mE2[axis][i] = c[axis] - a[axis];
+        }
+    }
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        mCentroids[axis] = std::vector<float>();
+        mBoundsMin[axis] = std::vector<float>();
+        mBoundsMax[axis] = std::vector<float>();
+    }
+
+    mBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TriangleBvh::ComputeBounds(uint32_t first, uint32_t count, float outMin[3], float outMax[3]) const
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        outMin[axis] = FLT_MAX;
+        outMax[axis] = -FLT_MAX;
+    }
+
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        uint32_t t = mTriangleIds[i];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            outMin[axis] = (std::min)(outMin[axis], mBoundsMin[axis][t]);
+            outMax[axis] = (std::max)(outMax[axis], mBoundsMax[axis][t]);
+        }
+    }
+}
+
+void TriangleBvh::BuildSubtree(std::vector<Node>& nodes, uint32_t first, uint32_t count, uint32_t depth) const
+{
+    assert(depth <= MaxDepth);
+
+    uint32_t index = (uint32_t)nodes.size();
+    nodes.push_back({});
+    ComputeBounds(first, count, nodes[index].Min, nodes[index].Max);
+
+    uint32_t mid = 0;
+    if (count <= 2 || !SplitRange(first, count, depth, mid))
+    {
+        nodes[index].RightOrFirst = first;
+        nodes[index].Count = count;
+        return;
+    }
+
+    BuildSubtree(nodes, first, mid - first, depth + 1);
+    nodes[index].RightOrFirst = (uint32_t)nodes.size();
+    nodes[index].Count = 0;
+    BuildSubtree(nodes, mid, first + count - mid, depth + 1);
+}
+
+// Пополам по центрам вдоль самой длинной оси: глубина растёт не больше чем на log2(count)
+void TriangleBvh::SplitMedian(uint32_t first, uint32_t count, uint32_t& mid) const
+{
+    float centroidMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float centroidMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        uint32_t t = mTriangleIds[i];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            centroidMin[axis] = (std::min)(centroidMin[axis], mCentroids[axis][t]);
+            centroidMax[axis] = (std::max)(centroidMax[axis], mCentroids[axis][t]);
+        }
+    }
+
+    int axis = 0;
+    for (int k = 1; k < 3; k++)
+    {
+        if (centroidMax[k] - centroidMin[k] > centroidMax[axis] - centroidMin[axis])
+            axis = k;
+    }
+
+    const std::vector<float>& centroids = mCentroids[axis];
+    auto* ids = const_cast<uint32_t*>(mTriangleIds.data());
+    mid = first + count / 2;
+    std::nth_element(ids + first, ids + mid, ids + first + count, [&](uint32_t a, uint32_t b)
+    {
+        return centroids[a] < centroids[b];
+    });
+}
+
+// SAH по корзинам вдоль каждой оси. false - выгоднее оставить лист. Перекошенные
+// разбиения (геометрически разнесённые треугольники) отщепляют по нескольку
+// треугольников за уровень - за MedianDepth делим медианой
+bool TriangleBvh::SplitRange(uint32_t first, uint32_t count, uint32_t depth, uint32_t& mid) const
+{
+    if (depth >= MedianDepth)
+    {
+        if (count <= 2)
+            return false;
+
+        SplitMedian(first, count, mid);
+        return true;
+    }
+
+    float centroidMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float centroidMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    float boundsMin[3], boundsMax[3];
+    ComputeBounds(first, count, boundsMin, boundsMax);
+
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        uint32_t t = mTriangleIds[i];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            centroidMin[axis] = (std::min)(centroidMin[axis], mCentroids[axis][t]);
+            centroidMax[axis] = (std::max)(centroidMax[axis], mCentroids[axis][t]);
+        }
+    }
+
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    uint32_t bestBin = 0;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        if (extent <= 0.0f)
+            continue;
+
+        float scale = BinCount / extent;
+
+        struct Bin
+        {
+            float Min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+            float Max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+            uint32_t Count = 0;
+        };
+        Bin bins[BinCount];
+
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            uint32_t t = mTriangleIds[i];
+            uint32_t b = (std::min)((uint32_t)((mCentroids[axis][t] - centroidMin[axis]) * scale), BinCount - 1);
+            bins[b].Count++;
+            for (int k = 0; k < 3; k++)
+            {
+                bins[b].Min[k] = (std::min)(bins[b].Min[k], mBoundsMin[k][t]);
+                bins[b].Max[k] = (std::max)(bins[b].Max[k], mBoundsMax[k][t]);
+            }
+        }
+
+        // Площади и количества слева и справа от каждой границы
+        float leftArea[BinCount - 1], rightArea[BinCount - 1];
+        uint32_t leftCount[BinCount - 1], rightCount[BinCount - 1];
+
+        Bin accum;
+        for (uint32_t b = 0; b < BinCount - 1; b++)
+        {
+            accum.Count += bins[b].Count;
+            for (int k = 0; k < 3; k++)
+            {
+                accum.Min[k] = (std::min)(accum.Min[k], bins[b].Min[k]);
+                accum.Max[k] = (std::max)(accum.Max[k], bins[b].Max[k]);
+            }
+            leftCount[b] = accum.Count;
+            leftArea[b] = accum.Count > 0 ? SurfaceArea(accum.Min, accum.Max) : 0.0f;
+        }
+
+        accum = Bin();
+        for (uint32_t b = BinCount - 1; b > 0; b--)
+        {
+            accum.Count += bins[b].Count;
+            for (int k = 0; k < 3; k++)
+            {
+                accum.Min[k] = (std::min)(accum.Min[k], bins[b].Min[k]);
+                accum.Max[k] = (std::max)(accum.Max[k], bins[b].Max[k]);
+            }
+            rightCount[b - 1] = accum.Count;
+            rightArea[b - 1] = accum.Count > 0 ? SurfaceArea(accum.Min, accum.Max) : 0.0f;
+        }
+
+        for (uint32_t b = 0; b < BinCount - 1; b++)
+        {
+            if (leftCount[b] == 0 || rightCount[b] == 0)
+                continue;
+
+            float cost = leftArea[b] * leftCount[b] + rightArea[b] * rightCount[b];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    float parentArea = SurfaceArea(boundsMin, boundsMax);
+    float splitCost = parentArea > 0.0f ? TraversalCost + bestCost / parentArea : FLT_MAX;
+
+    if (bestAxis < 0 || splitCost >= (float)count)
+    {
+        if (count <= MaxLeafSize)
+            return false;
+
+        // Все центры совпали или SAH против - делим пополам, чтобы лист не разросся
+        mid = first + count / 2;
+        return true;
+    }
+
+    float scale = BinCount / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+    const std::vector<float>& centroids = mCentroids[bestAxis];
+    float minCentroid = centroidMin[bestAxis];
+
+    auto* ids = const_cast<uint32_t*>(mTriangleIds.data());
+    uint32_t* split = std::partition(ids + first, ids + first + count, [&](uint32_t t)
+    {
+        return (std::min)((uint32_t)((centroids[t] - minCentroid) * scale), BinCount - 1) <= bestBin;
+    });
+
+    mid = (uint32_t)(split - ids);
+    return true;
+}
+
+// =========== Queries ===========
+bool TriangleBvh::RightIsNearer(uint32_t nodeIndex, const float dir[3]) const
+{
+    const Node& left = mNodes[nodeIndex + 1];
+    const Node& right = mNodes[mNodes[nodeIndex].RightOrFirst];
+
+    int axis = 0;
+    float bestSeparation = -1.0f;
+    float separation[3];
+    for (int k = 0; k < 3; k++)
+    {
+        separation[k] = (right.Min[k] + right.Max[k]) - (left.Min[k] + left.Max[k]);
+        if (std::fabs(separation[k]) > bestSeparation)
+        {
+            bestSeparation = std::fabs(separation[k]);
+            axis = k;
+        }
+    }
+
+    return separation[axis] * dir[axis] < 0.0f;
+}
+
+RayHit TriangleBvh::Intersect(const Ray& ray) const
+{
+    RayHit hit;
+    Intersect(&ray, 1, &hit);
+    return hit;
+}
+
+void TriangleBvh::Intersect(const Ray* rays, size_t count, RayHit* hits) const
+{
+    for (size_t i = 0; i < count; i += 4)
+        IntersectPacket(rays + i, (uint32_t)(std::min)(count - i, (size_t)4), hits + i);
+}
+
+void TriangleBvh::IntersectPacket(const Ray* rays, uint32_t count, RayHit* hits) const
+{
+    for (uint32_t lane = 0; lane < count; lane++)
+        hits[lane] = RayHit();
+
+    if (mNodes.empty())
+        return;
+
+#ifdef TRIANGLE_BVH_SSE
+    // Пакет SoA; пустые дорожки получают MaxT = -1 и ни во что не попадают
+    alignas(16) float ox[4], oy[4], oz[4], dx[4], dy[4], dz[4], ix[4], iy[4], iz[4], tmax[4];
+    for (uint32_t lane = 0; lane < 4; lane++)
+    {
+        const Ray& ray = rays[lane < count ? lane : 0];
+        ox[lane] = ray.Origin[0];
+        oy[lane] = ray.Origin[1];
+        oz[lane] = ray.Origin[2];
+        dx[lane] = ray.Dir[0];
+        dy[lane] = ray.Dir[1];
+        dz[lane] = ray.Dir[2];
+        ix[lane] = 1.0f / (ray.Dir[0] != 0.0f ? ray.Dir[0] : 1e-30f);
+        iy[lane] = 1.0f / (ray.Dir[1] != 0.0f ? ray.Dir[1] : 1e-30f);
+        iz[lane] = 1.0f / (ray.Dir[2] != 0.0f ? ray.Dir[2] : 1e-30f);
+        tmax[lane] = lane < count ? ray.MaxT : -1.0f;
+    }
+
+    const float leadDir[3] = { dx[0], dy[0], dz[0] };
+
+    const __m128 rox = _mm_load_ps(ox), roy = _mm_load_ps(oy), roz = _mm_load_ps(oz);
+    const __m128 rdx = _mm_load_ps(dx), rdy = _mm_load_ps(dy), rdz = _mm_load_ps(dz);
+    const __m128 rix = _mm_load_ps(ix), riy = _mm_load_ps(iy), riz = _mm_load_ps(iz);
+    __m128 bestT = _mm_load_ps(tmax);
+    __m128 bestU = _mm_setzero_ps();
+    __m128 bestV = _mm_setzero_ps();
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 epsilonSq = _mm_set1_ps(TriangleEpsilon * TriangleEpsilon);
+    const __m128 epsilon = _mm_set1_ps(TriangleEpsilon);
+
+    // Номер треугольника хранится в битах float, без SSE2
+    __m128 bestId = _mm_cmpeq_ps(zero, zero);
+
+    uint32_t stack[MaxDepth];
+    uint32_t stackSize = 0;
+    uint32_t nodeIndex = 0;
+
+    for (;;)
+    {
+        const Node& node = mNodes[nodeIndex];
+
+        // Луч - бокс, слэбы
+        __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Min[0]), rox), rix);
+        __m128 t2x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Max[0]), rox), rix);
+        __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Min[1]), roy), riy);
+        __m128 t2y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Max[1]), roy), riy);
+        __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Min[2]), roz), riz);
+        __m128 t2z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Max[2]), roz), riz);
+
+        __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t1x, t2x), _mm_min_ps(t1y, t2y)), _mm_min_ps(t1z, t2z));
+        __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t1x, t2x), _mm_max_ps(t1y, t2y)), _mm_max_ps(t1z, t2z));
+        __m128 boxHit = _mm_and_ps(
+            _mm_cmple_ps(_mm_max_ps(tNear, zero), tFar),
+            _mm_cmple_ps(tNear, bestT));
+
+        if (_mm_movemask_ps(boxHit) != 0)
+        {
+            if (node.Count == 0)
+            {
+                if (RightIsNearer(nodeIndex, leadDir))
+                {
+                    stack[stackSize++] = nodeIndex + 1;
+                    nodeIndex = node.RightOrFirst;
+                }
+                else
+                {
+                    stack[stackSize++] = node.RightOrFirst;
+                    nodeIndex++;
+                }
+                continue;
+            }
+
+            // Луч - треугольник (Моллер - Трумбор), 4 луча против одного треугольника
+            for (uint32_t i = node.RightOrFirst; i < node.RightOrFirst + node.Count; i++)
+            {
+                __m128 e1x = _mm_set1_ps(mE1[0][i]), e1y = _mm_set1_ps(mE1[1][i]), e1z = _mm_set1_ps(mE1[2][i]);
+                __m128 e2x = _mm_set1_ps(mE2[0][i]), e2y = _mm_set1_ps(mE2[1][i]), e2z = _mm_set1_ps(mE2[2][i]);
+
+                __m128 px = _mm_sub_ps(_mm_mul_ps(rdy, e2z), _mm_mul_ps(rdz, e2y));
+                __m128 py = _mm_sub_ps(_mm_mul_ps(rdz, e2x), _mm_mul_ps(rdx, e2z));
+                __m128 pz = _mm_sub_ps(_mm_mul_ps(rdx, e2y), _mm_mul_ps(rdy, e2x));
+                __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+                __m128 invDet = _mm_div_ps(one, det);
+
+                __m128 tx = _mm_sub_ps(rox, _mm_set1_ps(mV0[0][i]));
+                __m128 ty = _mm_sub_ps(roy, _mm_set1_ps(mV0[1][i]));
+                __m128 tz = _mm_sub_ps(roz, _mm_set1_ps(mV0[2][i]));
+                __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+
+                __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+                __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+                __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+                __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rdx, qx), _mm_mul_ps(rdy, qy)), _mm_mul_ps(rdz, qz)), invDet);
+                __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+                __m128 hit = _mm_cmpgt_ps(_mm_mul_ps(det, det), epsilonSq);
+                hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+                hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+                hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+                hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, epsilon));
+                hit = _mm_and_ps(hit, _mm_cmplt_ps(t, bestT));
+
+                if (_mm_movemask_ps(hit) == 0)
+                    continue;
+
+                float idBits;
+                std::memcpy(&idBits, &mTriangleIds[i], sizeof(idBits));
+                __m128 id = _mm_set1_ps(idBits);
+                bestT = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, bestT));
+                bestU = _mm_or_ps(_mm_and_ps(hit, u), _mm_andnot_ps(hit, bestU));
+                bestV = _mm_or_ps(_mm_and_ps(hit, v), _mm_andnot_ps(hit, bestV));
+                bestId = _mm_or_ps(_mm_and_ps(hit, id), _mm_andnot_ps(hit, bestId));
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+        nodeIndex = stack[--stackSize];
+    }
+
+    alignas(16) float outT[4], outU[4], outV[4];
+    alignas(16) uint32_t outId[4];
+    _mm_store_ps(outT, bestT);
+    _mm_store_ps(outU, bestU);
+    _mm_store_ps(outV, bestV);
+    _mm_store_ps(reinterpret_cast<float*>(outId), bestId);
+
+    for (uint32_t lane = 0; lane < count; lane++)
+    {
+        if (outId[lane] == UINT32_MAX)
+            continue;
+
+        hits[lane].T = outT[lane];
+        hits[lane].U = outU[lane];
+        hits[lane].V = outV[lane];
+        hits[lane].Triangle = outId[lane];
+    }
+#else
+    for (uint32_t lane = 0; lane < count; lane++)
+    {
+        const Ray& ray = rays[lane];
+        RayHit& best = hits[lane];
+        best.T = ray.MaxT;
+
+        float inv[3];
+        for (int k = 0; k < 3; k++)
+            inv[k] = 1.0f / (ray.Dir[k] != 0.0f ? ray.Dir[k] : 1e-30f);
+
+        uint32_t stack[MaxDepth];
+        uint32_t stackSize = 0;
+        uint32_t nodeIndex = 0;
+
+        for (;;)
+        {
+            const Node& node = mNodes[nodeIndex];
+
+            float tNear = 0.0f, tFar = best.T;
+            for (int k = 0; k < 3; k++)
+            {
+                float t1 = (node.Min[k] - ray.Origin[k]) * inv[k];
+                float t2 = (node.Max[k] - ray.Origin[k]) * inv[k];
+                tNear = (std::max)(tNear, (std::min)(t1, t2));
+                tFar = (std::min)(tFar, (std::max)(t1, t2));
+            }
+
+            if (tNear <= tFar)
+            {
+                if (node.Count == 0)
+                {
+                    if (RightIsNearer(nodeIndex, ray.Dir))
+                    {
+                        stack[stackSize++] = nodeIndex + 1;
+                        nodeIndex = node.RightOrFirst;
+                    }
+                    else
+                    {
+                        stack[stackSize++] = node.RightOrFirst;
+                        nodeIndex++;
+                    }
+                    continue;
+                }
+
+                for (uint32_t i = node.RightOrFirst; i < node.RightOrFirst + node.Count; i++)
+                {
+                    const float e1[3] = { mE1[0][i], mE1[1][i], mE1[2][i] };
+                    const float e2[3] = { mE2[0][i], mE2[1][i], mE2[2][i] };
+                    float p[3] = {
+                        ray.Dir[1] * e2[2] - ray.Dir[2] * e2[1],
+                        ray.Dir[2] * e2[0] - ray.Dir[0] * e2[2],
+                        ray.Dir[0] * e2[1] - ray.Dir[1] * e2[0] };
+                    float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+                    if (std::fabs(det) <= TriangleEpsilon)
+                        continue;
+
+                    float invDet = 1.0f / det;
+                    float s[3] = { ray.Origin[0] - mV0[0][i], ray.Origin[1] - mV0[1][i], ray.Origin[2] - mV0[2][i] };
+                    float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+                    float q[3] = {
+                        s[1] * e1[2] - s[2] * e1[1],
+                        s[2] * e1[0] - s[0] * e1[2],
+                        s[0] * e1[1] - s[1] * e1[0] };
+                    float v = (ray.Dir[0] * q[0] + ray.Dir[1] * q[1] + ray.Dir[2] * q[2]) * invDet;
+                    float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+
+                    if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > TriangleEpsilon && t < best.T)
+                    {
+                        best.T = t;
+                        best.U = u;
+                        best.V = v;
+                        best.Triangle = mTriangleIds[i];
+                    }
+                }
+            }
+
+            if (stackSize == 0)
+                break;
+            nodeIndex = stack[--stackSize];
+        }
+
+        if (!best.IsHit())
+            best.T = FLT_MAX;
+    }
+#endif
+}
+
+bool TriangleBvh::ResolveSphere(float center[3], float radius, int iterations) const
+{
+    if (mNodes.empty())
+        return false;
+
+    bool moved = false;
+
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        bool pushed = false;
+
+        uint32_t stack[MaxDepth];
+        uint32_t stackSize = 0;
+        uint32_t nodeIndex = 0;
+
+        for (;;)
+        {
+            const Node& node = mNodes[nodeIndex];
+
+            bool overlaps = true;
+            for (int k = 0; k < 3; k++)
+            {
+                if (center[k] + radius < node.Min[k] || center[k] - radius > node.Max[k])
+                    overlaps = false;
+            }
+
+            if (overlaps)
+            {
+                if (node.Count == 0)
+                {
+                    stack[stackSize++] = node.RightOrFirst;
+                    nodeIndex++;
+                    continue;
+                }
+
+                for (uint32_t i = node.RightOrFirst; i < node.RightOrFirst + node.Count; i++)
+                {
+                    float a[3] = { mV0[0][i], mV0[1][i], mV0[2][i] };
+                    float b[3] = { a[0] + mE1[0][i], a[1] + mE1[1][i], a[2] + mE1[2][i] };
+                    float c[3] = { a[0] + mE2[0][i], a[1] + mE2[1][i], a[2] + mE2[2][i] };
+
+                    float closest[3];
+                    ClosestPointOnTriangle(center, a, b, c, closest);
+
+                    float d[3] = { center[0] - closest[0], center[1] - closest[1], center[2] - closest[2] };
+                    float distSq = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+                    if (distSq >= radius * radius || distSq <= 1e-12f)
+                        continue;
+
+                    float dist = std::sqrt(distSq);
+                    float push = (radius - dist) / dist;
+                    for (int k = 0; k < 3; k++)
+                        center[k] += d[k] * push;
+                    pushed = true;
+                }
+            }
+
+            if (stackSize == 0)
+                break;
+            nodeIndex = stack[--stackSize];
+        }
+
+        if (!pushed)
+            break;
+        moved = true;
+    }
+
+    return moved;
+}
@@ -0,0 +1,66 @@
+﻿#include "../h/UploadRing.h"
+
+UploadRing::UploadRing(uint64_t capacity)
+    : mCapacity(capacity)
+{
+}
+
+uint64_t UploadRing::Allocate(uint64_t size, uint64_t alignment)
+{
+    if (mUsed == 0)
+        mHead = 0;
+
+    uint64_t tail = (mHead + mCapacity - mUsed) % mCapacity;
+    uint64_t offset = (mHead + alignment - 1) & ~(alignment - 1);
+    uint64_t padding = offset - mHead;
+
+    if (mUsed > 0 && tail >= mHead)
+    {
+        // Свободно только [head, tail)
+        if (offset + size > tail)
+        {
+            mStats.Failures++;
+            return InvalidOffset;
+        }
+    }
+    else if (offset + size > mCapacity)
+    {
+        // Не влезло до конца буфера - хвост буфера пропускаем и начинаем с нуля
+        padding = mCapacity - mHead;
+        offset = 0;
+        if (size > (mUsed > 0 ? tail : mCapacity))
+        {
+            mStats.Failures++;
+            return InvalidOffset;
+        }
+        mStats.Wraps++;
+    }
+
+    mUsed += padding + size;
+    mOpenBytes += padding + size;
+    mHead = (offset + size) % mCapacity;
+
+    mStats.Allocations++;
+    if (mUsed > mStats.PeakUsed)
+        mStats.PeakUsed = mUsed;
+
+    return offset;
+}
+
+void UploadRing::FinishFrame(uint64_t fenceValue)
+{
+    if (mOpenBytes == 0)
+        return;
+
+    mBatches.push_back({ fenceValue, mOpenBytes });
+    mOpenBytes = 0;
+}
+
+void UploadRing::Reclaim(uint64_t completedValue)
+{
+    while (!mBatches.empty() && mBatches.front().FenceValue <= completedValue)
+    {
+        mUsed -= mBatches.front().Bytes;
+        mBatches.pop_front();
+    }
+}
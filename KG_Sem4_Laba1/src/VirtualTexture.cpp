@@ -0,0 +1,414 @@
+﻿#include "../h/VirtualTexture.h"
+#include "../h/MipChain.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    constexpr uint32_t VtMagic = 0x58455456; // 'VTEX'
+    constexpr uint32_t VtVersion = 1;
+
+    uint32_t KeyMip(uint64_t packedKey)
+    {
+        return uint32_t(packedKey >> 32) & 0xFF;
+    }
+}
+
+uint32_t VtMipCount(uint32_t width, uint32_t height)
+{
+    uint32_t mipCount = 1;
+    while (std::max(width >> (mipCount - 1), height >> (mipCount - 1)) > VtTileSize)
+        ++mipCount;
+    return mipCount;
+}
+
+uint32_t VtTilesX(uint32_t width, uint32_t mip)
+{
+    return (std::max(1u, width >> mip) + VtTileSize - 1) / VtTileSize;
+}
+
+uint32_t VtTilesY(uint32_t height, uint32_t mip)
+{
+    return (std::max(1u, height >> mip) + VtTileSize - 1) / VtTileSize;
+}
+
+// =========== Tile File ===========
+bool BakeTileFile(const TgaImage& image, const std::string& outPath)
+{
+    if (image.width <= 0 || image.height <= 0 || (image.channels != 3 && image.channels != 4))
+        return false;
+
+    std::ofstream file(outPath, std::ios::binary);
+    if (!file)
+        return false;
+
+    TileFileHeader header;
+    header.Magic = VtMagic;
+    header.Version = VtVersion;
+    header.Width = image.width;
+    header.Height = image.height;
+    header.TileSize = VtTileSize;
+    header.Border = VtTileBorder;
+    header.MipCount = VtMipCount(header.Width, header.Height);
+    file.write((const char*)&header, sizeof(header));
+
+    uint32_t w = header.Width;
+    uint32_t h = header.Height;
+    std::vector<uint8_t> level;
+    TgaToBGRA(image, level);
+
+    std::vector<uint8_t> next;
+    std::vector<uint8_t> tile(VtTileBytes);
+
+    for (uint32_t mip = 0; mip < header.MipCount; ++mip)
+    {
+        if (mip > 0)
+        {
+            DownsampleBGRA(level, w, h, next);
+            level.swap(next);
+            w = std::max(1u, w / 2);
+            h = std::max(1u, h / 2);
+        }
+
+        uint32_t tilesX = VtTilesX(header.Width, mip);
+        uint32_t tilesY = VtTilesY(header.Height, mip);
+
+        for (uint32_t ty = 0; ty < tilesY; ty++)
+        {
+            for (uint32_t tx = 0; tx < tilesX; tx++)
+            {
+                // Рамка и хвост за краем изображения берутся clamp-ом
+                for (uint32_t py = 0; py < VtPaddedTileSize; py++)
+                {
+                    int sy = std::clamp(int(ty * VtTileSize + py) - int(VtTileBorder), 0, int(h) - 1);
+                    for (uint32_t px = 0; px < VtPaddedTileSize; px++)
+                    {
+                        int sx = std::clamp(int(tx * VtTileSize + px) - int(VtTileBorder), 0, int(w) - 1);
+                        memcpy(&tile[(py * VtPaddedTileSize + px) * 4], &level[(sy * w + sx) * 4], 4);
+                    }
+                }
+                file.write((const char*)tile.data(), VtTileBytes);
+            }
+        }
+    }
+
+    return bool(file);
+}
+
+bool TileFile::Open(const std::string& path)
+{
+    mFile.open(path, std::ios::binary);
+    if (!mFile)
+        return false;
+
+    mFile.read((char*)&mHeader, sizeof(mHeader));
+    if (!mFile || mHeader.Magic != VtMagic || mHeader.Version != VtVersion ||
+        mHeader.TileSize != VtTileSize || mHeader.Border != VtTileBorder)
+        return false;
+
+    mMipFirstTile.resize(mHeader.MipCount);
+    uint32_t first = 0;
+    for (uint32_t mip = 0; mip < mHeader.MipCount; ++mip)
+    {
+        mMipFirstTile[mip] = first;
+        first += VtTilesX(mHeader.Width, mip) * VtTilesY(mHeader.Height, mip);
+    }
+
+    return true;
+}
+
+bool TileFile::ReadTile(uint32_t mip, uint32_t x, uint32_t y, void* dst)
+{
+    if (mip >= mHeader.MipCount)
+        return false;
+
+    uint64_t tileIndex = mMipFirstTile[mip] + uint64_t(y) * VtTilesX(mHeader.Width, mip) + x;
+    mFile.seekg(std::streamoff(sizeof(TileFileHeader) + tileIndex * VtTileBytes));
+    mFile.read((char*)dst, VtTileBytes);
+    return bool(mFile);
+}
+
+// =========== Physical Tile Cache ===========
+TileCache::TileCache(uint32_t slotCount) :
+    mSlots(slotCount)
+{
+    mFreeSlots.reserve(slotCount);
+    for (uint32_t i = slotCount; i > 0; --i)
+        mFreeSlots.push_back(i - 1);
+    mLookup.reserve(slotCount);
+}
+
+uint32_t TileCache::Find(uint64_t key) const
+{
+    auto it = mLookup.find(key);
+    return it != mLookup.end() ? it->second : InvalidSlot;
+}
+
+void TileCache::Touch(uint32_t slot, uint64_t frame)
+{
+    mSlots[slot].LastUsed = frame;
+    if (mHead == slot)
+        return;
+    Unlink(slot);
+    PushFront(slot);
+}
+
+uint32_t TileCache::Allocate(uint64_t key, uint64_t frame, bool pinned, uint64_t& evictedKey)
+{
+    evictedKey = UINT64_MAX;
+    uint32_t slot = InvalidSlot;
+
+    if (!mFreeSlots.empty())
+    {
+        slot = mFreeSlots.back();
+        mFreeSlots.pop_back();
+    }
+    else
+    {
+        // С хвоста LRU: закреплённые тайлы пропускаем, тайлы текущего кадра не трогаем
+        for (uint32_t s = mTail; s != InvalidSlot; s = mSlots[s].Prev)
+        {
+            if (mSlots[s].LastUsed >= frame)
+                return InvalidSlot;
+            if (!mSlots[s].Pinned)
+            {
+                slot = s;
+                break;
+            }
+        }
+        if (slot == InvalidSlot)
+            return InvalidSlot;
+
+        evictedKey = mSlots[slot].Key;
+        mLookup.erase(evictedKey);
+        Unlink(slot);
+    }
+
+    Slot& s = mSlots[slot];
+    s.Key = key;
+    s.LastUsed = frame;
+    s.Used = true;
+    s.Pinned = pinned;
+    PushFront(slot);
+    mLookup[key] = slot;
+    return slot;
+}
+
+void TileCache::Unlink(uint32_t slot)
+{
+    Slot& s = mSlots[slot];
+    if (s.Prev != InvalidSlot)
+        mSlots[s.Prev].Next = s.Next;
+    else
+        mHead = s.Next;
+
+    if (s.Next != InvalidSlot)
+        mSlots[s.Next].Prev = s.Prev;
+    else
+        mTail = s.Prev;
+
+    s.Prev = s.Next = InvalidSlot;
+}
+
+void TileCache::PushFront(uint32_t slot)
+{
+    Slot& s = mSlots[slot];
+    s.Prev = InvalidSlot;
+    s.Next = mHead;
+    if (mHead != InvalidSlot)
+        mSlots[mHead].Prev = slot;
+    mHead = slot;
+    if (mTail == InvalidSlot)
+        mTail = slot;
+}
+
+// =========== Virtual Texture System ===========
+VirtualTextureSystem::VirtualTextureSystem(uint32_t cacheSlotsX, uint32_t cacheSlotsY, uint32_t maxUploadsPerFrame) :
+    mCache(cacheSlotsX * cacheSlotsY),
+    mSlotsX(cacheSlotsX),
+    mMaxUploadsPerFrame(maxUploadsPerFrame)
+{
+    // В записи таблицы страниц на координату слота отводится 8 бит
+    if (cacheSlotsX == 0 || cacheSlotsY == 0 || cacheSlotsX > 256 || cacheSlotsY > 256)
+        throw std::runtime_error("Virtual texture cache must be 1..256 tiles per side");
+}
+
+uint16_t VirtualTextureSystem::AddTexture(uint32_t width, uint32_t height)
+{
+    TextureInfo tex;
+    tex.Width = width;
+    tex.Height = height;
+    tex.MipCount = VtMipCount(width, height);
+    tex.PageTable.resize(tex.MipCount);
+    for (uint32_t mip = 0; mip < tex.MipCount; ++mip)
+        tex.PageTable[mip].assign(VtTilesX(width, mip) * VtTilesY(height, mip), 0);
+
+    mTextures.push_back(std::move(tex));
+    return uint16_t(mTextures.size() - 1);
+}
+
+const std::vector<TileUpload>& VirtualTextureSystem::Update(const uint64_t* feedback, size_t count)
+{
+    ++mFrame;
+    mUploads.clear();
+    mStats = {};
+    mStats.FeedbackEntries = (uint32_t)count;
+
+    // ===== Дедупликация: сортировка + подсчёт повторов =====
+    mScratchKeys.assign(feedback, feedback + count);
+    std::sort(mScratchKeys.begin(), mScratchKeys.end());
+
+    mRequests.clear();
+    for (size_t i = 0; i < mScratchKeys.size();)
+    {
+        size_t j = i;
+        while (j < mScratchKeys.size() && mScratchKeys[j] == mScratchKeys[i])
+            ++j;
+
+        TileKey key = TileKey::Unpack(mScratchKeys[i]);
+        if (key.Texture < mTextures.size())
+        {
+            const TextureInfo& tex = mTextures[key.Texture];
+            if (key.Mip < tex.MipCount && key.X < VtTilesX(tex.Width, key.Mip) && key.Y < VtTilesY(tex.Height, key.Mip))
+            {
+                // Родители нужны как запасной вариант, пока нужный мип не загружен
+                for (uint32_t mip = key.Mip; mip < tex.MipCount; ++mip)
+                {
+                    TileKey parent = key;
+                    parent.Mip = uint8_t(mip);
+                    parent.X = uint16_t(key.X >> (mip - key.Mip));
+                    parent.Y = uint16_t(key.Y >> (mip - key.Mip));
+                    mRequests.push_back({ parent.Pack(), uint32_t(j - i) });
+                }
+            }
+        }
+        i = j;
+    }
+
+    std::sort(mRequests.begin(), mRequests.end(),
+        [](const Request& a, const Request& b) { return a.Key < b.Key; });
+
+    size_t uniqueEnd = 0;
+    for (size_t i = 0; i < mRequests.size(); ++i)
+    {
+        if (uniqueEnd > 0 && mRequests[uniqueEnd - 1].Key == mRequests[i].Key)
+            mRequests[uniqueEnd - 1].Count += mRequests[i].Count;
+        else
+            mRequests[uniqueEnd++] = mRequests[i];
+    }
+    mRequests.resize(uniqueEnd);
+    mStats.UniqueRequests = (uint32_t)uniqueEnd;
+
+    // ===== Попадания продлевают жизнь тайлам, промахи идут в очередь =====
+    size_t missEnd = 0;
+    for (const Request& r : mRequests)
+    {
+        uint32_t slot = mCache.Find(r.Key);
+        if (slot != TileCache::InvalidSlot)
+        {
+            mCache.Touch(slot, mFrame);
+            ++mStats.CacheHits;
+        }
+        else
+        {
+            mRequests[missEnd++] = r;
+        }
+    }
+    mRequests.resize(missEnd);
+
+    // ===== Приоритет: грубые мипы первыми, затем по числу запросов =====
+    std::sort(mRequests.begin(), mRequests.end(),
+        [](const Request& a, const Request& b)
+        {
+            uint32_t mipA = KeyMip(a.Key);
+            uint32_t mipB = KeyMip(b.Key);
+            if (mipA != mipB)
+                return mipA > mipB;
+            if (a.Count != b.Count)
+                return a.Count > b.Count;
+            return a.Key < b.Key;
+        });
+
+    for (const Request& r : mRequests)
+    {
+        if (mUploads.size() >= mMaxUploadsPerFrame)
+        {
+            ++mStats.Deferred;
+            continue;
+        }
+
+        TileKey key = TileKey::Unpack(r.Key);
+        TextureInfo& tex = mTextures[key.Texture];
+
+        // Самый грубый мип закрепляем, чтобы у текстуры всегда был запасной вариант
+        uint64_t evictedKey = UINT64_MAX;
+        uint32_t slot = mCache.Allocate(r.Key, mFrame, key.Mip + 1u == tex.MipCount, evictedKey);
+        if (slot == TileCache::InvalidSlot)
+        {
+            ++mStats.Deferred;
+            continue;
+        }
+
+        if (evictedKey != UINT64_MAX)
+        {
+            ++mStats.Evictions;
+            mTextures[TileKey::Unpack(evictedKey).Texture].Changed = true;
+        }
+
+        tex.Changed = true;
+        mUploads.push_back({ key, slot });
+    }
+    mStats.Uploads = (uint32_t)mUploads.size();
+
+    for (uint16_t i = 0; i < mTextures.size(); ++i)
+    {
+        if (mTextures[i].Changed)
+            RebuildPageTable(i);
+    }
+
+    return mUploads;
+}
+
+const std::vector<uint32_t>& VirtualTextureSystem::PageTable(uint16_t texture, uint32_t mip) const
+{
+    return mTextures[texture].PageTable[mip];
+}
+
+void VirtualTextureSystem::RebuildPageTable(uint16_t texture)
+{
+    TextureInfo& tex = mTextures[texture];
+
+    // От грубого мипа к мелкому: нерезидентный тайл наследует запись родителя
+    for (int mip = int(tex.MipCount) - 1; mip >= 0; --mip)
+    {
+        uint32_t tilesX = VtTilesX(tex.Width, mip);
+        uint32_t tilesY = VtTilesY(tex.Height, mip);
+        uint32_t parentTilesX = mip + 1 < int(tex.MipCount) ? VtTilesX(tex.Width, mip + 1) : 0;
+        std::vector<uint32_t>& entries = tex.PageTable[mip];
+
+        for (uint32_t y = 0; y < tilesY; ++y)
+        {
+            for (uint32_t x = 0; x < tilesX; ++x)
+            {
+                TileKey key;
+                key.Texture = texture;
+                key.Mip = uint8_t(mip);
+                key.X = uint16_t(x);
+                key.Y = uint16_t(y);
+
+                uint32_t slot = mCache.Find(key.Pack());
+                uint32_t entry = 0;
+                if (slot != TileCache::InvalidSlot)
+                    entry = SlotX(slot) | (SlotY(slot) << 8) | (uint32_t(mip) << 16) | (1u << 24);
+                else if (parentTilesX != 0)
+                    entry = tex.PageTable[mip + 1][(y / 2) * parentTilesX + x / 2];
+
+                entries[y * tilesX + x] = entry;
+            }
+        }
+    }
+
+    tex.Changed = false;
+    tex.Dirty = true;
+}
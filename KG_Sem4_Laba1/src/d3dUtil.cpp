@@ -9,39 +9,24 @@ namespace d3dUtil
         const std::string& entrypoint,
         const std::string& target)
     {
-        UINT compileFlags = 0;
-#ifdef _DEBUG
-        compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif
-
         Microsoft::WRL::ComPtr<ID3DBlob> byteCode = nullptr;
-        Microsoft::WRL::ComPtr<ID3DBlob> errors;
+        std::string errors;
 
-        HRESULT hr = D3DCompileFromFile(
-            filename.c_str(),
-            defines,
-            D3D_COMPILE_STANDARD_FILE_INCLUDE,
-            entrypoint.c_str(),
-            target.c_str(),
-            compileFlags,
-            0,
-            &byteCode,
-            &errors
-        );
+        HRESULT hr = TryCompileShader(filename, defines, entrypoint, target, byteCode, errors);
 
-        if (errors != nullptr)
+        if (!errors.empty())
         {
             std::string errorStr = "Shader Compile Error:\n";
-            errorStr += (char*)errors->GetBufferPointer();
+            errorStr += errors;
             OutputDebugStringA(errorStr.c_str());
         }
 
         if (FAILED(hr))
         {
-            if (errors)
+            if (!errors.empty())
             {
                 MessageBoxA(0,
-                    (char*)errors->GetBufferPointer(),
+                    errors.c_str(),
                     "Shader Compile Error",
                     MB_OK);
             }
@@ -50,6 +35,43 @@ namespace d3dUtil
         return byteCode;
     }
 
+    HRESULT TryCompileShader(
+        const std::wstring& filename,
+        const D3D_SHADER_MACRO* defines,
+        const std::string& entrypoint,
+        const std::string& target,
+        Microsoft::WRL::ComPtr<ID3DBlob>& byteCode,
+        std::string& errors)
+    {
+        Microsoft::WRL::ComPtr<ID3DBlob> errorBlob;
+
+        HRESULT hr = D3DCompileFromFile(
+            filename.c_str(),
+            defines,
+            D3D_COMPILE_STANDARD_FILE_INCLUDE,
+            entrypoint.c_str(),
+            target.c_str(),
+            ShaderCompileFlags(),
+            0,
+            &byteCode,
+            &errorBlob
+        );
+
+        if (errorBlob != nullptr)
+            errors = (char*)errorBlob->GetBufferPointer();
+
+        return hr;
+    }
+
+    UINT ShaderCompileFlags()
+    {
+        UINT compileFlags = 0;
+#ifdef _DEBUG
+        compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+        return compileFlags;
+    }
+
     UINT CalcConstantBufferByteSize(UINT byteSize)
     {
         // Constant buffers must be a multiple of 256 bytes.
@@ -2,52 +2,224 @@
 cbuffer ObjectConstants : register(b0)
 {
     float4x4 gWorldViewProj;
+    float4x4 gWorldView;   // В INSTANCED - только View
     float4 gUVTransform; // xy = scale, zw = offset
-    float4 gBlendFactor; // x = blend factor (0-1) для интерполяции текстур
+    float4 gBlendFactor; // x = blend factor (0-1) для интерполяции текстур, y = порог ALPHA_TEST
+    float4 gColor1;      // Цвет материала вместо gDiffuseMap1 (без HAS_MAP1)
+    float4 gColor2;      // Цвет материала вместо gDiffuseMap2 (без HAS_MAP2)
+    float4 gClusterTile; // xy = плиток на пиксель, z/w = масштаб и сдвиг слоя по log(z)
+    float4 gClusterGrid; // xyz = число кластеров, w = ambient
+    float4 gLightmap;    // x = 1 - свет из лайтмапа вместо ambient, y = Range
+    float4 gVirtual;     // xy = размер виртуальной текстуры, z = ячеек обратной связи в строке, w = метка кадра
 };
 
+#ifdef INSTANCED
+// Мировые матрицы экземпляров; root SRV уже смещён на первый экземпляр отрисовки,
+// а gWorldViewProj в этом варианте - только ViewProj
+struct InstanceData
+{
+    row_major float4x4 World;
+};
+
+StructuredBuffer<InstanceData> gInstances : register(t0, space1);
+#endif
+
+// Перестановки PS по возможностям материала (MaterialFeature в Material.h):
+// HAS_MAP1 / HAS_MAP2 - карта вместо цвета из констант, ALPHA_TEST - отсечение
+// по альфе первой карты, VIRTUAL_TEXTURE - первая карта из тайлов виртуальной
+// текстуры. Отсутствующая карта не объявляется и не читается.
+#ifdef HAS_MAP1
 Texture2D gDiffuseMap1 : register(t0);
+#endif
+#ifdef HAS_MAP2
 Texture2D gDiffuseMap2 : register(t1);
+#endif
 SamplerState gSampler : register(s0);
 
+// Лайтмапы (LightmapBaker): страницы атласа массивом, RGB - освещённость / Range
+Texture2DArray gLightmapAtlas : register(t0, space3);
+SamplerState gLightmapSampler : register(s1);
+
+#ifdef VIRTUAL_TEXTURE
+// Виртуальная текстура (VirtualTexture.h): тайлы 128x128 с рамкой 4 в физическом
+// кэше, таблица страниц - мипы друг под другом, запись x | y << 8 | mip << 16 | valid << 24
+static const float VtTileSize = 128.0f;
+static const float VtTileBorder = 4.0f;
+static const float VtPaddedTileSize = 136.0f;
+
+Texture2D gVtCache : register(t0, space4);
+Texture2D<uint> gVtPageTable : register(t1, space4);
+SamplerState gVtSampler : register(s2);
+
+// Ячейка 8x8 пикселей: тайл (x | y << 12 | mip << 24) и метка кадра, который его хотел
+RWStructuredBuffer<uint2> gVtFeedback : register(u0);
+
+float4 SampleVirtual(float2 uv, uint2 pixel)
+{
+    uint2 size = (uint2)gVirtual.xy;
+    uint mipCount = 1;
+    while (max(size.x >> (mipCount - 1), size.y >> (mipCount - 1)) > (uint)VtTileSize)
+        mipCount++;
+
+    // Мип по производным, как у аппаратной выборки
+    float2 texels = uv * gVirtual.xy;
+    float2 dx = ddx(texels);
+    float2 dy = ddy(texels);
+    float lod = 0.5f * log2(max(max(dot(dx, dx), dot(dy, dy)), 1.0f));
+    uint mip = min((uint)lod, mipCount - 1);
+
+    // Строка начала мипа в таблице страниц
+    uint row = 0;
+    for (uint m = 0; m < mip; m++)
+        row += (max(size.y >> m, 1u) + 127) / 128;
+
+    float2 wrapped = frac(uv);
+    uint2 tiles = (max(size >> mip, 1u) + 127) / 128;
+    uint2 tile = min((uint2)(wrapped * gVirtual.xy / (VtTileSize * exp2((float)mip))), tiles - 1);
+
+    // Один пиксель ячейки за кадр, пиксель ячейки меняется от кадра к кадру
+    uint stamp = (uint)gVirtual.w;
+    uint jitter = stamp & 63;
+    if ((pixel.x & 7) == (jitter & 7) && (pixel.y & 7) == (jitter >> 3))
+        gVtFeedback[(pixel.y >> 3) * (uint)gVirtual.z + (pixel.x >> 3)] = uint2(tile.x | tile.y << 12 | mip << 24, stamp);
+
+    // Нерезидентный тайл указывает на ближайшего загруженного предка
+    uint entry = gVtPageTable.Load(int3(tile.x, row + tile.y, 0));
+    if ((entry >> 24) == 0)
+        return gColor1;
+
+    float entryMip = (float)((entry >> 16) & 0xFF);
+    float2 slot = float2(entry & 0xFF, (entry >> 8) & 0xFF);
+    float2 inMip = wrapped * gVirtual.xy / exp2(entryMip);
+    float2 inTile = inMip - floor(inMip / VtTileSize) * VtTileSize;
+
+    float2 cacheSize;
+    gVtCache.GetDimensions(cacheSize.x, cacheSize.y);
+    return gVtCache.SampleLevel(gVtSampler, (slot * VtPaddedTileSize + VtTileBorder + inTile) / cacheSize, 0);
+}
+#endif
+
+// Кластерное освещение (ClusteredLights): источники в пространстве вида,
+// на кластер - смещение и число его источников в gLightIndices
+struct LightData
+{
+    float3 Position;
+    float Radius;
+    float3 Color;
+    float Intensity;
+};
+
+StructuredBuffer<LightData> gLights : register(t0, space2);
+StructuredBuffer<uint2> gClusters : register(t1, space2);
+StructuredBuffer<uint> gLightIndices : register(t2, space2);
+
 struct VertexIn
 {
     float3 PosL : POSITION;
     float3 NormalL : NORMAL;
     float2 TexC : TEXCOORD;
+    float3 LightmapUv : TEXCOORD1;  // u, v, страница
 };
 
 struct VertexOut
 {
     float4 PosH : SV_POSITION;
-    float3 NormalW : NORMAL;
+    float3 PosV : POSITION;
+    float3 NormalV : NORMAL;
     float2 TexC : TEXCOORD;
+    float3 LightmapUv : TEXCOORD1;
 };
 
+#ifdef INSTANCED
+VertexOut VS(VertexIn vin, uint instanceId : SV_InstanceID)
+{
+    VertexOut vout;
+
+    float4x4 world = gInstances[instanceId].World;
+    float4 posW = mul(float4(vin.PosL, 1.0f), world);
+    vout.PosH = mul(posW, gWorldViewProj);
+    vout.PosV = mul(posW, gWorldView).xyz;
+    vout.NormalV = mul(mul(vin.NormalL, (float3x3)world), (float3x3)gWorldView);
+#else
 VertexOut VS(VertexIn vin)
 {
     VertexOut vout;
 
     // Transform to homogeneous clip space
     vout.PosH = mul(float4(vin.PosL, 1.0f), gWorldViewProj);
+    vout.PosV = mul(float4(vin.PosL, 1.0f), gWorldView).xyz;
 
-    // Pass normal through (assuming world is identity for now)
-    vout.NormalW = vin.NormalL;
+    // Мир без неравномерного масштаба - нормаль той же матрицей
+    vout.NormalV = mul(vin.NormalL, (float3x3)gWorldView);
+#endif
 
     // Apply UV transformation: scale then offset
     vout.TexC = vin.TexC * gUVTransform.xy + gUVTransform.zw;
+    vout.LightmapUv = vin.LightmapUv;
 
     return vout;
 }
 
+// Фон (ambient или лайтмап) плюс источники кластера пикселя: Ламберт с затуханием до нуля на радиусе
+float3 ClusterLighting(float3 posV, float3 normalV, float2 pixel, float3 background)
+{
+    uint3 grid = (uint3)gClusterGrid.xyz;
+    uint3 cell;
+    cell.xy = min((uint2)(pixel * gClusterTile.xy), grid.xy - 1);
+    cell.z = (uint)clamp(log(max(posV.z, 1e-4f)) * gClusterTile.z + gClusterTile.w, 0.0f, gClusterGrid.z - 1.0f);
+
+    uint2 range = gClusters[(cell.z * grid.y + cell.y) * grid.x + cell.x];
+    float3 n = normalize(normalV);
+    float3 light = background;
+
+    for (uint i = 0; i < range.y; i++)
+    {
+        LightData l = gLights[gLightIndices[range.x + i]];
+        float3 toLight = l.Position - posV;
+        float distance = length(toLight);
+        float falloff = saturate(1.0f - distance / l.Radius);
+
+        light += l.Color * l.Intensity * falloff * falloff * saturate(dot(n, toLight / max(distance, 1e-4f)));
+    }
+
+    return light;
+}
+
+// Обратная связь виртуальной текстуры - только от пикселей, прошедших тест глубины
+#if defined(VIRTUAL_TEXTURE) && !defined(ALPHA_TEST)
+[earlydepthstencil]
+#endif
 float4 PS(VertexOut pin) : SV_Target
 {
-    // Sample both textures
+#if defined(VIRTUAL_TEXTURE)
+    float4 texColor1 = SampleVirtual(pin.TexC, (uint2)pin.PosH.xy);
+#elif defined(HAS_MAP1)
     float4 texColor1 = gDiffuseMap1.Sample(gSampler, pin.TexC);
+#else
+    float4 texColor1 = gColor1;
+#endif
+
+#ifdef ALPHA_TEST
+    // Маски в непрозрачном проходе режутся по 0.5; у смешиваемых порог низкий -
+    // отсекаются только почти пустые тексели
+    clip(texColor1.a - gBlendFactor.y);
+#endif
+
+#ifdef HAS_MAP2
     float4 texColor2 = gDiffuseMap2.Sample(gSampler, pin.TexC);
+#else
+    float4 texColor2 = gColor2;
+#endif
 
     // Linear interpolation between two textures
     float4 finalColor = lerp(texColor1, texColor2, gBlendFactor.x);
 
+    // Запечённый свет - одна выборка; экземпляры и сцена без лайтмапа берут ambient
+    float3 background = gClusterGrid.w;
+    if (gLightmap.x > 0.0f)
+        background = gLightmapAtlas.Sample(gLightmapSampler, pin.LightmapUv).rgb * gLightmap.y;
+
+    finalColor.rgb *= ClusterLighting(pin.PosV, pin.NormalV, pin.PosH.xy, background);
+
     return finalColor;
 }
\ No newline at end of file
@@ -0,0 +1,14 @@
+﻿#pragma once
+#include <cstdio>
+#include <cstdlib>
+
+// Проверка в тестах: при провале - файл, строка, условие и выход с кодом 1
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            std::exit(1); \
+        } \
+    } while (0)
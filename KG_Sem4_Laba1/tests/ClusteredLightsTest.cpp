@@ -0,0 +1,311 @@
+﻿#include "ClusteredLights.h"
+#include "Check.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    uint32_t gRandom = 1;
+
+    uint32_t NextRandom()
+    {
+        gRandom = gRandom * 1664525u + 1013904223u;
+        return gRandom;
+    }
+
+    float Random(float from, float to)
+    {
+        return from + (to - from) * (float(NextRandom() >> 8) / float(1 << 24));
+    }
+
+    // Как XMMatrixLookToLH: камера в eye, поворот yaw вокруг y и pitch вокруг x
+    void MakeView(const float eye[3], float yaw, float pitch, float view[4][4])
+    {
+        float sy = std::sin(yaw), cy = std::cos(yaw);
+        float sp = std::sin(pitch), cp = std::cos(pitch);
+        float forward[3] = { sy * cp, -sp, cy * cp };
+        float right[3] = { cy, 0.0f, -sy };
+        float up[3] = { sy * sp, cp, cy * sp };
+
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+                view[i][j] = 0.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            view[i][0] = right[i];
+            view[i][1] = up[i];
+            view[i][2] = forward[i];
+        }
+        view[3][0] = -(right[0] * eye[0] + right[1] * eye[1] + right[2] * eye[2]);
+        view[3][1] = -(up[0] * eye[0] + up[1] * eye[1] + up[2] * eye[2]);
+        view[3][2] = -(forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2]);
+        view[3][3] = 1.0f;
+    }
+
+    void ToView(const float view[4][4], const float world[3], float out[3])
+    {
+        for (int j = 0; j < 3; j++)
+            out[j] = world[0] * view[0][j] + world[1] * view[1][j] + world[2] * view[2][j] + view[3][j];
+    }
+
+    // Границы слоя по z: экспоненциально от Near до Far, всё ближе Near - в нулевом
+    float SliceNear(const ClusterGridDesc& grid, uint32_t z)
+    {
+        return z == 0 ? 0.0f : grid.Near * std::pow(grid.Far / grid.Near, (float)z / grid.CountZ);
+    }
+
+    // Точка кластера по долям (u, v, w) внутри него, в пространстве вида; y плиток растёт вниз
+    void ClusterPoint(const ClusterGridDesc& grid, uint32_t x, uint32_t y, uint32_t z,
+        float u, float v, float w, float out[3])
+    {
+        float z0 = SliceNear(grid, z);
+        float z1 = SliceNear(grid, z + 1);
+        out[2] = z0 + (z1 - z0) * w;
+        out[0] = (-1.0f + 2.0f * (x + u) / grid.CountX) * grid.TanHalfFovX * out[2];
+        out[1] = (1.0f - 2.0f * (y + v) / grid.CountY) * grid.TanHalfFovY * out[2];
+    }
+
+    // Квадрат расстояния от точки до бокса кластера (по восьми углам)
+    float DistanceToClusterBox(const ClusterGridDesc& grid, uint32_t x, uint32_t y, uint32_t z, const float p[3])
+    {
+        float lo[3] = { 1e30f, 1e30f, 1e30f };
+        float hi[3] = { -1e30f, -1e30f, -1e30f };
+        for (int corner = 0; corner < 8; corner++)
+        {
+            float c[3];
+            ClusterPoint(grid, x, y, z, float(corner & 1), float((corner >> 1) & 1), float(corner >> 2), c);
+            for (int i = 0; i < 3; i++)
+            {
+                lo[i] = (std::min)(lo[i], c[i]);
+                hi[i] = (std::max)(hi[i], c[i]);
+            }
+        }
+
+        float d2 = 0.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            float d = (std::max)((std::max)(lo[i] - p[i], p[i] - hi[i]), 0.0f);
+            d2 += d * d;
+        }
+        return d2;
+    }
+
+    struct Scene
+    {
+        ClusterGridDesc Grid;
+        float View[4][4];
+        std::vector<PointLight> Lights;   // Intensity - номер источника
+    };
+
+    // Источники вокруг камеры: от мелких до задевающих сотни кластеров, часть - за
+    // камерой и через её ближнюю плоскость
+    Scene MakeScene(uint32_t countX, uint32_t countY, uint32_t countZ, uint32_t lightCount)
+    {
+        Scene scene;
+        scene.Grid.CountX = countX;
+        scene.Grid.CountY = countY;
+        scene.Grid.CountZ = countZ;
+        scene.Grid.TanHalfFovY = Random(0.3f, 1.2f);
+        scene.Grid.TanHalfFovX = scene.Grid.TanHalfFovY * Random(1.0f, 2.0f);
+        scene.Grid.Near = Random(0.2f, 2.0f);
+        scene.Grid.Far = Random(40.0f, 120.0f);
+        scene.Grid.MaxLightsPerCluster = 1024;
+
+        float eye[3] = { Random(-50.0f, 50.0f), Random(-10.0f, 10.0f), Random(-50.0f, 50.0f) };
+        MakeView(eye, Random(-3.14f, 3.14f), Random(-1.0f, 1.0f), scene.View);
+
+        for (uint32_t i = 0; i < lightCount; i++)
+        {
+            PointLight light;
+            float spread = i % 8 == 0 ? 3.0f : scene.Grid.Far;
+            for (int j = 0; j < 3; j++)
+                light.Position[j] = eye[j] + Random(-spread, spread);
+            uint32_t kind = NextRandom() % 10;
+            light.Radius = kind < 5 ? Random(0.05f, 2.0f) : (kind < 9 ? Random(2.0f, 15.0f) : Random(15.0f, 60.0f));
+            light.Intensity = (float)i;
+            scene.Lights.push_back(light);
+        }
+        return scene;
+    }
+
+    std::vector<uint32_t> ClusterList(const ClusteredLights& clustered, uint32_t cluster)
+    {
+        const std::vector<uint32_t>& ranges = clustered.Ranges();
+        const std::vector<uint32_t>& indices = clustered.Indices();
+        return std::vector<uint32_t>(indices.begin() + ranges[cluster * 2], indices.begin() + ranges[cluster * 2] + ranges[cluster * 2 + 1]);
+    }
+
+    // Диапазоны подряд без дыр, номера в списке - по возрастанию, без повторов
+    void CheckLayout(const ClusteredLights& clustered)
+    {
+        const ClusterGridDesc& grid = clustered.Grid();
+        uint32_t clusters = grid.CountX * grid.CountY * grid.CountZ;
+        const std::vector<uint32_t>& ranges = clustered.Ranges();
+        const ClusterStats& stats = clustered.Stats();
+        CHECK(ranges.size() == clusters * 2);
+        CHECK(stats.Clusters == clusters);
+        CHECK(stats.Indices == clustered.Indices().size());
+        CHECK(stats.VisibleLights == clustered.Lights().size());
+
+        uint32_t offset = 0, nonEmpty = 0;
+        for (uint32_t c = 0; c < clusters; c++)
+        {
+            CHECK(ranges[c * 2] == offset);
+            CHECK(ranges[c * 2 + 1] <= grid.MaxLightsPerCluster);
+            offset += ranges[c * 2 + 1];
+            nonEmpty += ranges[c * 2 + 1] > 0 ? 1 : 0;
+
+            std::vector<uint32_t> list = ClusterList(clustered, c);
+            for (size_t i = 0; i < list.size(); i++)
+            {
+                CHECK(list[i] < clustered.Lights().size());
+                if (i > 0)
+                    CHECK(list[i - 1] < list[i]);
+            }
+        }
+        CHECK(offset == clustered.Indices().size());
+        CHECK(nonEmpty == stats.NonEmptyClusters);
+    }
+}
+
+// Перебором: источник, чья сфера накрывает хоть одну точку кластера, есть в его
+// списке; каждый источник списка задевает хотя бы бокс кластера; ZScale/ZBias
+// переводят z точки в её слой
+static void TestBruteForce(uint32_t countX, uint32_t countY, uint32_t countZ, uint32_t lightCount)
+{
+    Scene scene = MakeScene(countX, countY, countZ, lightCount);
+    const ClusterGridDesc& grid = scene.Grid;
+
+    JobSystem jobs(2);
+    ClusteredLights clustered(jobs);
+    clustered.SetGrid(grid);
+    clustered.Build(scene.View, scene.Lights.data(), scene.Lights.size());
+    CheckLayout(clustered);
+    CHECK(clustered.Stats().Overflows == 0);
+    CHECK(clustered.Stats().Lights == lightCount);
+
+    // Видимые источники - в пространстве вида и с сохранёнными свойствами
+    const std::vector<ClusterLight>& lights = clustered.Lights();
+    std::vector<int> visibleIndex(lightCount, -1);
+    std::vector<float> viewPos(lightCount * 3);
+    for (uint32_t i = 0; i < lightCount; i++)
+        ToView(scene.View, scene.Lights[i].Position, &viewPos[i * 3]);
+    for (uint32_t v = 0; v < lights.size(); v++)
+    {
+        uint32_t id = (uint32_t)lights[v].Intensity;
+        CHECK(id < lightCount && visibleIndex[id] < 0);
+        visibleIndex[id] = (int)v;
+        CHECK(lights[v].Radius == scene.Lights[id].Radius);
+        for (int j = 0; j < 3; j++)
+            CHECK(std::fabs(lights[v].Position[j] - viewPos[id * 3 + j]) < 1e-3f);
+    }
+
+    const float Samples[] = { 0.01f, 0.35f, 0.65f, 0.99f };
+    uint32_t required = 0;
+    for (uint32_t z = 0; z < grid.CountZ; z++)
+    {
+        for (uint32_t y = 0; y < grid.CountY; y++)
+        {
+            for (uint32_t x = 0; x < grid.CountX; x++)
+            {
+                uint32_t cluster = x + grid.CountX * (y + grid.CountY * z);
+                std::vector<uint32_t> list = ClusterList(clustered, cluster);
+
+                for (float u : Samples)
+                    for (float v : Samples)
+                        for (float w : Samples)
+                        {
+                            float p[3];
+                            ClusterPoint(grid, x, y, z, u, v, w, p);
+
+                            float slice = p[2] > 0.0f ? std::log(p[2]) * clustered.ZScale() + clustered.ZBias() : 0.0f;
+                            CHECK((uint32_t)std::clamp(std::floor(slice), 0.0f, (float)(grid.CountZ - 1)) == z);
+
+                            for (uint32_t i = 0; i < lightCount; i++)
+                            {
+                                float dx = p[0] - viewPos[i * 3 + 0];
+                                float dy = p[1] - viewPos[i * 3 + 1];
+                                float dz = p[2] - viewPos[i * 3 + 2];
+                                float r = scene.Lights[i].Radius * 0.999f;
+                                if (dx * dx + dy * dy + dz * dz > r * r)
+                                    continue;
+
+                                CHECK(visibleIndex[i] >= 0);
+                                CHECK(std::binary_search(list.begin(), list.end(), (uint32_t)visibleIndex[i]));
+                                required++;
+                            }
+                        }
+
+                for (uint32_t v : list)
+                {
+                    float r = lights[v].Radius;
+                    CHECK(DistanceToClusterBox(grid, x, y, z, lights[v].Position) <= r * r * 1.001f + 1e-4f);
+                }
+            }
+        }
+    }
+
+    // Перебор действительно что-то проверил
+    CHECK(required > 0);
+    CHECK(clustered.Stats().NonEmptyClusters > 0);
+}
+
+// Переполненный кластер хранит первые MaxLightsPerCluster источников полного
+// списка, лишние - в Overflows; результат не зависит от числа потоков
+static void TestOverflowAndThreads()
+{
+    Scene scene = MakeScene(12, 7, 16, 600);
+
+    JobSystem single(0);
+    ClusteredLights full(single);
+    full.SetGrid(scene.Grid);
+    full.Build(scene.View, scene.Lights.data(), scene.Lights.size());
+    CHECK(full.Stats().Overflows == 0);
+
+    JobSystem jobs(3);
+    ClusteredLights parallel(jobs);
+    parallel.SetGrid(scene.Grid);
+    parallel.Build(scene.View, scene.Lights.data(), scene.Lights.size());
+    CHECK(parallel.Ranges() == full.Ranges());
+    CHECK(parallel.Indices() == full.Indices());
+
+    ClusterGridDesc capped = scene.Grid;
+    capped.MaxLightsPerCluster = 4;
+    parallel.SetGrid(capped);
+    parallel.Build(scene.View, scene.Lights.data(), scene.Lights.size());
+    CheckLayout(parallel);
+
+    uint32_t clusters = capped.CountX * capped.CountY * capped.CountZ;
+    uint32_t overflows = 0;
+    for (uint32_t c = 0; c < clusters; c++)
+    {
+        std::vector<uint32_t> all = ClusterList(full, c);
+        std::vector<uint32_t> kept = ClusterList(parallel, c);
+        CHECK(kept.size() == (std::min)(all.size(), (size_t)4));
+        CHECK(std::equal(kept.begin(), kept.end(), all.begin()));
+        overflows += (uint32_t)(all.size() - kept.size());
+    }
+    CHECK(overflows > 0);
+    CHECK(parallel.Stats().Overflows == overflows);
+
+    // Смена сетки обратно и пустой кадр
+    parallel.SetGrid(scene.Grid);
+    parallel.Build(scene.View, scene.Lights.data(), scene.Lights.size());
+    CHECK(parallel.Indices() == full.Indices());
+    parallel.Build(scene.View, nullptr, 0);
+    CheckLayout(parallel);
+    CHECK(parallel.Indices().empty() && parallel.Stats().NonEmptyClusters == 0);
+}
+
+int main()
+{
+    TestBruteForce(16, 9, 24, 120);
+    TestBruteForce(7, 5, 11, 300);
+    TestBruteForce(1, 1, 1, 50);
+    for (int i = 0; i < 6; i++)
+        TestBruteForce(5 + NextRandom() % 12, 3 + NextRandom() % 8, 4 + NextRandom() % 20, 150);
+    TestOverflowAndThreads();
+    std::printf("ClusteredLightsTest: OK\n");
+    return 0;
+}
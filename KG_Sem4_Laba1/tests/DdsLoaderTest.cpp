@@ -0,0 +1,115 @@
+﻿#include "DdsLoader.h"
+#include "Check.h"
+#include <cstring>
+#include <vector>
+
+// Файлы собираются в памяти: magic, DDS_HEADER (124 байта), DDS_HEADER_DXT10
+
+namespace
+{
+    constexpr uint32_t HeaderOffset = 4;
+    constexpr uint32_t Dx10Offset = 4 + 124;
+    constexpr uint32_t DataOffset = Dx10Offset + 20;
+    constexpr uint32_t MiscTextureCube = 0x4;
+
+    void Put(std::vector<uint8_t>& file, size_t offset, uint32_t value)
+    {
+        memcpy(&file[offset], &value, 4);
+    }
+
+    std::vector<uint8_t> MakeDds(
+        uint32_t format, uint32_t width, uint32_t height, uint32_t mipCount,
+        uint32_t arraySize, uint32_t miscFlag, size_t dataBytes)
+    {
+        std::vector<uint8_t> file(DataOffset + dataBytes, 0);
+        Put(file, 0, 0x20534444);                       // 'DDS '
+        Put(file, HeaderOffset + 0, 124);               // Size
+        Put(file, HeaderOffset + 4, 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000);
+        Put(file, HeaderOffset + 8, height);
+        Put(file, HeaderOffset + 12, width);
+        Put(file, HeaderOffset + 24, mipCount);
+        Put(file, HeaderOffset + 72, 32);               // PixelFormat.Size
+        Put(file, HeaderOffset + 76, 0x4);              // DDPF_FOURCC
+        Put(file, HeaderOffset + 80, 0x30315844);       // 'DX10'
+        Put(file, HeaderOffset + 104, 0x1000);          // DDSCAPS_TEXTURE
+        Put(file, Dx10Offset + 0, format);
+        Put(file, Dx10Offset + 4, 3);                   // TEXTURE2D
+        Put(file, Dx10Offset + 8, miscFlag);
+        Put(file, Dx10Offset + 12, arraySize);
+        return file;
+    }
+
+    bool Parse(const std::vector<uint8_t>& file, DdsImage& image)
+    {
+        return ParseDDS(file.data(), file.size(), image);
+    }
+}
+
+// Раскладка BC1: мипы меньше блока занимают целый блок
+static void TestBlockLayout()
+{
+    // 16x16, 8x8, 4x4, 2x2, 1x1: 16 + 4 + 1 + 1 + 1 блоков по 8 байт
+    std::vector<uint8_t> file = MakeDds(DdsFormat::BC1_UNORM, 16, 16, 5, 1, 0, 23 * 8);
+
+    DdsImage image;
+    CHECK(Parse(file, image));
+    CHECK(image.MipCount == 5 && image.ArraySize == 1 && image.Subresources.size() == 5);
+    CHECK(image.Subresources[0].Offset == DataOffset);
+    CHECK(image.Subresources[0].RowPitch == 32 && image.Subresources[0].NumRows == 4);
+    CHECK(image.Subresources[3].Width == 2 && image.Subresources[3].RowPitch == 8 && image.Subresources[3].NumRows == 1);
+    CHECK(image.Subresources[4].Offset == DataOffset + 22 * 8);
+
+    // На байт короче - отказ
+    file.pop_back();
+    CHECK(!Parse(file, image));
+}
+
+// Кубический массив: слой за слоем, в слое вся цепочка
+static void TestCubeArray()
+{
+    size_t slice = 4 * 4 * 4 + 2 * 2 * 4 + 4;
+    std::vector<uint8_t> file = MakeDds(DdsFormat::R8G8B8A8_UNORM, 4, 4, 3, 2, MiscTextureCube, slice * 12);
+
+    DdsImage image;
+    CHECK(Parse(file, image));
+    CHECK(image.IsCubemap && image.ArraySize == 12 && image.Subresources.size() == 36);
+    CHECK(image.Subresources[3].Offset == DataOffset + slice);
+    CHECK(image.Subresources[35].Offset == DataOffset + slice * 12 - 4);
+}
+
+// Заголовки, которые D3D12 всё равно не создаст, отвергаются до выделения памяти
+static void TestRejectedHeaders()
+{
+    DdsImage image;
+
+    CHECK(!Parse(MakeDds(DdsFormat::R8G8B8A8_UNORM, 0, 16, 1, 1, 0, 1024), image));
+    CHECK(!Parse(MakeDds(DdsFormat::R8G8B8A8_UNORM, 16384 + 1, 1, 1, 1, 0, 65540), image));
+    CHECK(!Parse(MakeDds(DdsFormat::R8G8B8A8_UNORM, 1, 0x80000000u, 1, 1, 0, 64), image));
+
+    // Массивы: 2048 слоёв предел, для кубов - 2048 / 6 кубов; ArraySize * 6 не переполняется
+    CHECK(!Parse(MakeDds(DdsFormat::R8G8B8A8_UNORM, 1, 1, 1, 2049, 0, 2049 * 4), image));
+    CHECK(!Parse(MakeDds(DdsFormat::R8G8B8A8_UNORM, 1, 1, 1, 342, MiscTextureCube, 342 * 6 * 4), image));
+    CHECK(!Parse(MakeDds(DdsFormat::R8G8B8A8_UNORM, 1, 1, 1, 0x2AAAAAABu, MiscTextureCube, 64), image));
+    CHECK(Parse(MakeDds(DdsFormat::R8G8B8A8_UNORM, 1, 1, 1, 341, MiscTextureCube, 341 * 6 * 4), image));
+    CHECK(image.ArraySize == 2046);
+
+    // Максимальный заголовок с пустыми данными: отказ по размеру, без reserve на миллионы подресурсов
+    CHECK(!Parse(MakeDds(DdsFormat::R8G8B8A8_UNORM, 16384, 16384, 15, 2048, 0, 64), image));
+    CHECK(image.Subresources.capacity() == 0);
+
+    // BC: верхний мип только целыми блоками
+    CHECK(!Parse(MakeDds(DdsFormat::BC7_UNORM, 18, 16, 1, 1, 0, 5 * 4 * 16), image));
+    CHECK(!Parse(MakeDds(DdsFormat::BC1_UNORM, 16, 2, 1, 1, 0, 4 * 8), image));
+
+    // Мипов больше полной цепочки
+    CHECK(!Parse(MakeDds(DdsFormat::R8G8B8A8_UNORM, 4, 4, 4, 1, 0, 1024), image));
+}
+
+int main()
+{
+    TestBlockLayout();
+    TestCubeArray();
+    TestRejectedHeaders();
+    std::printf("DdsLoaderTest: OK\n");
+    return 0;
+}
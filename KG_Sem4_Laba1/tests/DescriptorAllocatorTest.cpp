@@ -0,0 +1,198 @@
+﻿#include "DescriptorAllocator.h"
+#include "Check.h"
+#include <algorithm>
+#include <vector>
+
+// Освобождение сливает диапазон с левым, правым или обоими соседями
+static void TestCoalescing()
+{
+    DescriptorAllocator allocator(16, 8);
+    uint32_t a = allocator.AllocatePersistent(4);
+    uint32_t b = allocator.AllocatePersistent(4);
+    uint32_t c = allocator.AllocatePersistent(4);
+    CHECK(a == 0 && b == 4 && c == 8);
+    CHECK(allocator.Stats().FreeRanges == 1 && allocator.Stats().LargestFreeRange == 4);
+
+    // Без соседей
+    allocator.FreePersistent(a, 4);
+    CHECK(allocator.Stats().FreeRanges == 2);
+
+    // С правым: [8, 12) + [12, 16)
+    allocator.FreePersistent(c, 4);
+    CHECK(allocator.Stats().FreeRanges == 2 && allocator.Stats().LargestFreeRange == 8);
+
+    // С обоими: всё снова одним куском
+    allocator.FreePersistent(b, 4);
+    CHECK(allocator.Stats().FreeRanges == 1 && allocator.Stats().LargestFreeRange == 16);
+    CHECK(allocator.Stats().PersistentUsed == 0);
+
+    // С левым: [0, 4) свободен, освобождаем [4, 6) при занятом [6, 16)
+    CHECK(allocator.AllocatePersistent(16) == 0);
+    allocator.FreePersistent(0, 4);
+    allocator.FreePersistent(4, 2);
+    CHECK(allocator.Stats().FreeRanges == 1 && allocator.Stats().LargestFreeRange == 6);
+    CHECK(allocator.Stats().PersistentUsed == 10);
+}
+
+// Лучший подходящий: маленький запрос не дробит большой свободный кусок
+static void TestBestFit()
+{
+    DescriptorAllocator allocator(32, 8);
+    uint32_t a = allocator.AllocatePersistent(5);
+    allocator.AllocatePersistent(1);
+    uint32_t b = allocator.AllocatePersistent(2);
+    allocator.AllocatePersistent(1);
+    // Свободно: [0, 5), [6, 8), [9, 32)
+    allocator.FreePersistent(a, 5);
+    allocator.FreePersistent(b, 2);
+
+    CHECK(allocator.AllocatePersistent(2) == 6);
+    CHECK(allocator.AllocatePersistent(3) == 0);
+    CHECK(allocator.AllocatePersistent(20) == 9);
+    CHECK(allocator.AllocatePersistent(4) == DescriptorAllocator::InvalidOffset);
+    CHECK(allocator.AllocatePersistent(0) == DescriptorAllocator::InvalidOffset);
+    CHECK(allocator.Stats().Failures == 1);
+}
+
+// Верхняя граница занятого: столько дескрипторов копируется при росте
+static void TestHighWater()
+{
+    DescriptorAllocator allocator(16, 8);
+    CHECK(allocator.PersistentHighWater() == 0);
+
+    uint32_t a = allocator.AllocatePersistent(4);
+    allocator.AllocatePersistent(4);
+    uint32_t c = allocator.AllocatePersistent(4);
+    CHECK(allocator.PersistentHighWater() == 12);
+
+    allocator.FreePersistent(c, 4);
+    CHECK(allocator.PersistentHighWater() == 8);
+
+    // Дыра в начале границу не двигает
+    allocator.FreePersistent(a, 4);
+    CHECK(allocator.PersistentHighWater() == 8);
+
+    allocator.AllocatePersistent(8);
+    CHECK(allocator.PersistentHighWater() == 16);
+    CHECK(allocator.Stats().FreeRanges == 1);
+}
+
+// Случайные выделения и освобождения против карты занятости: диапазоны не
+// пересекаются, свободные куски максимальны (соседние всегда слиты)
+static void TestRandomAgainstModel()
+{
+    const uint32_t capacity = 512;
+    DescriptorAllocator allocator(capacity, 8);
+    std::vector<bool> used(capacity, false);
+
+    struct Range
+    {
+        uint32_t Offset;
+        uint32_t Count;
+    };
+    std::vector<Range> live;
+    uint32_t random = 99;
+    auto next = [&random]() { random = random * 1664525u + 1013904223u; return random >> 8; };
+
+    for (int step = 0; step < 20000; step++)
+    {
+        if (live.empty() || next() % 100 < 55)
+        {
+            uint32_t count = 1 + next() % 24;
+            uint32_t offset = allocator.AllocatePersistent(count);
+            if (offset == DescriptorAllocator::InvalidOffset)
+                continue;
+
+            CHECK(offset + count <= capacity);
+            for (uint32_t i = offset; i < offset + count; i++)
+            {
+                CHECK(!used[i]);
+                used[i] = true;
+            }
+            live.push_back({ offset, count });
+        }
+        else
+        {
+            size_t index = next() % live.size();
+            Range range = live[index];
+            live[index] = live.back();
+            live.pop_back();
+
+            allocator.FreePersistent(range.Offset, range.Count);
+            for (uint32_t i = range.Offset; i < range.Offset + range.Count; i++)
+                used[i] = false;
+        }
+
+        uint32_t runs = 0, largest = 0, run = 0, usedCount = 0, highWater = 0;
+        for (uint32_t i = 0; i < capacity; i++)
+        {
+            if (used[i])
+            {
+                usedCount++;
+                highWater = i + 1;
+                run = 0;
+                continue;
+            }
+            if (run++ == 0)
+                runs++;
+            largest = (std::max)(largest, run);
+        }
+
+        DescriptorAllocatorStats stats = allocator.Stats();
+        CHECK(stats.FreeRanges == runs);
+        CHECK(stats.LargestFreeRange == largest);
+        CHECK(stats.PersistentUsed == usedCount);
+        CHECK(allocator.PersistentHighWater() == highWater);
+    }
+}
+
+// Рост: постоянные диапазоны остаются на местах, кольцо начинается заново
+static void TestResize()
+{
+    DescriptorAllocator allocator(8, 16);
+    uint32_t a = allocator.AllocatePersistent(6);
+    CHECK(allocator.AllocatePersistent(4) == DescriptorAllocator::InvalidOffset);
+
+    CHECK(allocator.AllocateTransient(10) == 0);
+    allocator.FinishFrame(1);
+    CHECK(allocator.AllocateTransient(4) == 10);
+    CHECK(allocator.AllocateTransient(8) == DescriptorAllocator::InvalidOffset);
+    CHECK(allocator.Stats().TransientUsed == 14);
+
+    allocator.Resize(32, 64);
+    DescriptorAllocatorStats stats = allocator.Stats();
+    CHECK(stats.Grows == 1);
+    CHECK(stats.PersistentCapacity == 32 && stats.PersistentUsed == 6);
+    CHECK(stats.TransientCapacity == 64 && stats.TransientUsed == 0);
+
+    // Хвост [6, 8) слился с добавленным [8, 32)
+    CHECK(stats.FreeRanges == 1 && stats.LargestFreeRange == 26);
+    CHECK(allocator.AllocatePersistent(26) == 6);
+    allocator.FreePersistent(a, 6);
+    CHECK(allocator.PersistentHighWater() == 32);
+
+    // Старые порции кольца забыты: fence 1 ничего не освобождает и не ломает счёт
+    CHECK(allocator.AllocateTransient(40) == 0);
+    allocator.Reclaim(1);
+    CHECK(allocator.Stats().TransientUsed == 40);
+    allocator.FinishFrame(2);
+    CHECK(allocator.AllocateTransient(24) == 40);
+    CHECK(allocator.AllocateTransient(1) == DescriptorAllocator::InvalidOffset);
+    allocator.Reclaim(2);
+    CHECK(allocator.Stats().TransientUsed == 24);
+
+    // Меньшая постоянная ёмкость не отбирает уже выданное
+    allocator.Resize(4, 64);
+    CHECK(allocator.PersistentCapacity() == 32);
+}
+
+int main()
+{
+    TestCoalescing();
+    TestBestFit();
+    TestHighWater();
+    TestRandomAgainstModel();
+    TestResize();
+    std::printf("DescriptorAllocatorTest: OK\n");
+    return 0;
+}
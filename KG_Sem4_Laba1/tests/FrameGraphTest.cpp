@@ -0,0 +1,473 @@
+﻿#include "FrameGraph.h"
+#include "Check.h"
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    using State = FrameGraphState;
+    using Kind = FrameGraphBarrier::Kind;
+
+    uint32_t gRandom = 1;
+
+    uint32_t NextRandom()
+    {
+        gRandom = gRandom * 1664525u + 1013904223u;
+        return gRandom >> 8;
+    }
+
+    // Использования, как их объявил тест: граф своих наружу не отдаёт
+    struct DeclaredUse
+    {
+        FrameGraphPass Pass;
+        FrameGraphResource Resource;
+        State UseState;
+    };
+
+    struct Recorder
+    {
+        FrameGraph Graph;
+        std::vector<DeclaredUse> Uses;
+
+        void Read(FrameGraphPass pass, FrameGraphResource resource, State state)
+        {
+            Graph.Read(pass, resource, state);
+            Uses.push_back({ pass, resource, state });
+        }
+
+        void Write(FrameGraphPass pass, FrameGraphResource resource, State state)
+        {
+            Graph.Write(pass, resource, state);
+            Uses.push_back({ pass, resource, state });
+        }
+    };
+
+    bool RangesOverlap(const FrameGraph& graph, FrameGraphResource a, FrameGraphResource b, const std::vector<uint64_t>& sizes)
+    {
+        uint64_t oa = graph.TransientOffset(a);
+        uint64_t ob = graph.TransientOffset(b);
+        return oa < ob + sizes[b] && ob < oa + sizes[a];
+    }
+
+    // Проигрывает барьеры по Order(): From каждого перехода - текущее состояние,
+    // каждое использование видит своё состояние, после FinalBarriers импортированные -
+    // в конечном, временные - в домашнем. Наложение - ровно в первом проходе
+    // временного, который делит память с другим; Before - единственный прежний владелец
+    void CheckBarriers(const Recorder& r, const std::vector<State>& initial, const std::vector<State>& finals,
+        const std::vector<uint64_t>& sizes)
+    {
+        const FrameGraph& graph = r.Graph;
+        const std::vector<FrameGraphPass>& order = graph.Order();
+        size_t count = graph.ResourceCount();
+
+        // Время жизни по позициям в Order()
+        std::vector<uint32_t> first(count, FrameGraph::Invalid), last(count, FrameGraph::Invalid);
+        for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+        {
+            for (const DeclaredUse& use : r.Uses)
+            {
+                if (use.Pass != order[i])
+                    continue;
+                if (first[use.Resource] == FrameGraph::Invalid)
+                    first[use.Resource] = i;
+                last[use.Resource] = i;
+            }
+        }
+
+        std::vector<State> state(count);
+        for (FrameGraphResource res = 0; res < count; res++)
+        {
+            state[res] = graph.IsTransient(res) ? graph.HomeState(res) : initial[res];
+            if (graph.IsTransient(res))
+                CHECK((graph.TransientOffset(res) == FrameGraph::Invalid) == (first[res] == FrameGraph::Invalid));
+        }
+
+        std::vector<bool> aliased(count, false);
+        auto apply = [&](const std::vector<FrameGraphBarrier>& barriers, uint32_t position)
+        {
+            for (const FrameGraphBarrier& b : barriers)
+            {
+                if (b.Type == Kind::Transition)
+                {
+                    CHECK(b.From != b.To);
+                    CHECK(state[b.Resource] == b.From);
+                    state[b.Resource] = b.To;
+                    continue;
+                }
+
+                // Наложение: в первом проходе ресурса, раньше его переходов
+                CHECK(graph.IsTransient(b.Resource));
+                CHECK(first[b.Resource] == position);
+                CHECK(!aliased[b.Resource]);
+                aliased[b.Resource] = true;
+
+                uint32_t earlier = 0;
+                FrameGraphResource before = FrameGraph::Invalid;
+                for (FrameGraphResource o = 0; o < count; o++)
+                {
+                    if (o == b.Resource || !graph.IsTransient(o) || first[o] == FrameGraph::Invalid)
+                        continue;
+                    if (RangesOverlap(graph, b.Resource, o, sizes) && last[o] < position)
+                    {
+                        earlier++;
+                        before = o;
+                    }
+                }
+                CHECK(b.Before == (earlier == 1 ? before : FrameGraph::Invalid));
+            }
+        };
+
+        for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+        {
+            apply(graph.Barriers(order[i]), i);
+            for (const DeclaredUse& use : r.Uses)
+            {
+                if (use.Pass == order[i])
+                    CHECK(state[use.Resource] == use.UseState);
+            }
+        }
+        apply(graph.FinalBarriers(), (uint32_t)order.size());
+
+        for (FrameGraphResource res = 0; res < count; res++)
+        {
+            if (!graph.IsTransient(res))
+            {
+                if (finals[res] != State::Undefined)
+                    CHECK(state[res] == finals[res]);
+                continue;
+            }
+
+            CHECK(state[res] == graph.HomeState(res));
+            if (first[res] == FrameGraph::Invalid)
+                continue;
+
+            // Наложение есть, если память ресурса делит хоть кто-то
+            bool shares = false;
+            for (FrameGraphResource o = 0; o < count; o++)
+            {
+                if (o != res && graph.IsTransient(o) && first[o] != FrameGraph::Invalid)
+                    shares = shares || RangesOverlap(graph, res, o, sizes);
+            }
+            CHECK(aliased[res] == shares);
+        }
+    }
+
+    // Живущие одновременно временные не делят память; смещения выровнены, куча вмещает всех
+    void CheckPlacement(const Recorder& r, const std::vector<uint64_t>& sizes, const std::vector<uint64_t>& alignments)
+    {
+        const FrameGraph& graph = r.Graph;
+        const std::vector<FrameGraphPass>& order = graph.Order();
+        size_t count = graph.ResourceCount();
+
+        std::vector<uint32_t> first(count, FrameGraph::Invalid), last(count, 0);
+        for (uint32_t i = 0; i < (uint32_t)order.size(); i++)
+        {
+            for (const DeclaredUse& use : r.Uses)
+            {
+                if (use.Pass != order[i])
+                    continue;
+                if (first[use.Resource] == FrameGraph::Invalid)
+                    first[use.Resource] = i;
+                last[use.Resource] = i;
+            }
+        }
+
+        uint64_t end = 0;
+        uint64_t total = 0;
+        for (FrameGraphResource a = 0; a < count; a++)
+        {
+            if (!graph.IsTransient(a) || first[a] == FrameGraph::Invalid)
+                continue;
+
+            CHECK(graph.TransientOffset(a) % alignments[a] == 0);
+            CHECK(graph.HeapAlignment() % alignments[a] == 0);
+            end = (std::max)(end, graph.TransientOffset(a) + sizes[a]);
+            total += sizes[a];
+
+            for (FrameGraphResource b = a + 1; b < count; b++)
+            {
+                if (!graph.IsTransient(b) || first[b] == FrameGraph::Invalid)
+                    continue;
+                bool together = first[a] <= last[b] && first[b] <= last[a];
+                CHECK(!(together && RangesOverlap(graph, a, b, sizes)));
+            }
+        }
+
+        CHECK(graph.HeapSize() == end);
+        CHECK(graph.Stats().TransientBytes == total);
+    }
+}
+
+// Кадр DirectXApp: стриминг -> очистка -> сцена, глубина - временная цель.
+// Первый переход back buffer уходит в пачку стриминга, глубина создаётся сразу
+// в DEPTH_WRITE (домашнее состояние) и переходов не требует
+static void TestAppFrame()
+{
+    Recorder r;
+    FrameGraph& graph = r.Graph;
+
+    FrameGraphResource backBuffer = graph.Import("BackBuffer", State::Present, State::Present);
+    FrameGraphResource depth = graph.CreateTransient("Depth", 4u << 20, 64u << 10);
+    FrameGraphResource mip = graph.Import("Mip", State::CopyDest, State::ShaderRead);
+    FrameGraphResource old = graph.Import("Mip (old)", State::ShaderRead);
+
+    int executed = 0;
+    FrameGraphPass streaming = graph.AddPass("Streaming", [&executed] { executed |= 1; });
+    r.Read(streaming, old, State::CopySource);
+    r.Write(streaming, mip, State::CopyDest);
+
+    FrameGraphPass clear = graph.AddPass("Clear", [&executed] { executed |= 2; });
+    r.Write(clear, backBuffer, State::RenderTarget);
+    r.Write(clear, depth, State::DepthWrite);
+
+    FrameGraphPass scene = graph.AddPass("Scene", [&executed] { executed |= 4; });
+    r.Write(scene, backBuffer, State::RenderTarget);
+    r.Write(scene, depth, State::DepthWrite);
+    r.Read(scene, mip, State::ShaderRead);
+
+    graph.Compile();
+
+    CHECK(graph.Order().size() == 3);
+    CHECK(graph.HomeState(depth) == State::DepthWrite);
+    CHECK(graph.TransientOffset(depth) == 0);
+    CHECK(graph.HeapSize() == (4u << 20));
+
+    // Стриминг: старый мип в источник копий и (поднятый) back buffer в RT
+    const std::vector<FrameGraphBarrier>& first = graph.Barriers(streaming);
+    CHECK(first.size() == 2);
+    CHECK(first[0].Resource == old && first[0].From == State::ShaderRead && first[0].To == State::CopySource);
+    CHECK(first[1].Resource == backBuffer && first[1].From == State::Present && first[1].To == State::RenderTarget);
+    CHECK(graph.Barriers(clear).empty());
+
+    // Сцена: новый мип в SRV; глубина без барьеров; в конце back buffer в Present
+    const std::vector<FrameGraphBarrier>& sceneBarriers = graph.Barriers(scene);
+    CHECK(sceneBarriers.size() == 1);
+    CHECK(sceneBarriers[0].Resource == mip && sceneBarriers[0].To == State::ShaderRead);
+
+    const std::vector<FrameGraphBarrier>& finals = graph.FinalBarriers();
+    CHECK(finals.size() == 1);
+    CHECK(finals[0].Resource == backBuffer && finals[0].From == State::RenderTarget && finals[0].To == State::Present);
+
+    CHECK(graph.Stats().Batches == 3);
+    CHECK(graph.Stats().Transients == 1);
+
+    std::vector<uint32_t> batches;
+    graph.Execute([&batches](const FrameGraphBarrier*, size_t count) { batches.push_back((uint32_t)count); });
+    CHECK(executed == 7);
+    CHECK((batches == std::vector<uint32_t>{ 2, 1 }));
+
+    CheckBarriers(r, { State::Present, State::Undefined, State::CopyDest, State::ShaderRead },
+        { State::Present, State::Undefined, State::ShaderRead, State::Undefined }, { 0, 4u << 20, 0, 0 });
+}
+
+// Цепочка: A пишется и читается, затем B на месте A, C живёт поверх обоих.
+// Перед первым проходом B: возврат A домой, затем наложение B (Before = A)
+static void TestAliasingChain()
+{
+    Recorder r;
+    FrameGraph& graph = r.Graph;
+
+    FrameGraphResource output = graph.Import("Output", State::Present, State::Present);
+    FrameGraphResource a = graph.CreateTransient("A", 1000, 256);
+    FrameGraphResource b = graph.CreateTransient("B", 900, 512);
+    FrameGraphResource c = graph.CreateTransient("C", 100, 64);
+
+    FrameGraphPass p0 = graph.AddPass("WriteA", nullptr);
+    r.Write(p0, a, State::RenderTarget);
+    r.Write(p0, c, State::UnorderedAccess);
+
+    FrameGraphPass p1 = graph.AddPass("ReadA", nullptr);
+    r.Read(p1, a, State::ShaderRead);
+    r.Write(p1, output, State::RenderTarget);
+
+    FrameGraphPass p2 = graph.AddPass("WriteB", nullptr);
+    r.Write(p2, b, State::RenderTarget);
+
+    FrameGraphPass p3 = graph.AddPass("ReadB", nullptr);
+    r.Read(p3, b, State::ShaderRead);
+    r.Read(p3, c, State::ShaderRead);
+    r.Write(p3, output, State::RenderTarget);
+
+    graph.Compile();
+
+    CHECK(graph.TransientOffset(a) == 0);
+    CHECK(graph.TransientOffset(b) == 0);
+    CHECK(graph.TransientOffset(c) == 1024);
+    CHECK(graph.HeapSize() == 1124);
+    CHECK(graph.HeapAlignment() == 512);
+    CHECK(graph.Stats().TransientBytes == 2000);
+
+    const std::vector<FrameGraphBarrier>& barriers = graph.Barriers(p2);
+    CHECK(barriers.size() == 2);
+    CHECK(barriers[0].Type == Kind::Transition && barriers[0].Resource == a);
+    CHECK(barriers[0].From == State::ShaderRead && barriers[0].To == State::RenderTarget);
+    CHECK(barriers[1].Type == Kind::Aliasing && barriers[1].Resource == b && barriers[1].Before == a);
+
+    CheckBarriers(r, { State::Present, State::Undefined, State::Undefined, State::Undefined },
+        { State::Present, State::Undefined, State::Undefined, State::Undefined }, { 0, 1000, 900, 100 });
+    CheckPlacement(r, { 0, 1000, 900, 100 }, { 1, 256, 512, 64 });
+}
+
+// Проход без нужного результата выбрасывается, его временный не получает памяти;
+// ошибки объявления - исключения
+static void TestCullingAndErrors()
+{
+    {
+        FrameGraph graph;
+        FrameGraphResource output = graph.Import("Output", State::Present, State::Present);
+        FrameGraphResource unused = graph.CreateTransient("Unused", 4096, 4096);
+
+        FrameGraphPass dead = graph.AddPass("Dead", nullptr);
+        graph.Write(dead, unused, State::RenderTarget);
+        FrameGraphPass live = graph.AddPass("Live", nullptr);
+        graph.Write(live, output, State::RenderTarget);
+        FrameGraphPass effect = graph.AddPass("SideEffect", nullptr, true);
+
+        graph.Compile();
+        CHECK(graph.IsCulled(dead) && !graph.IsCulled(live) && !graph.IsCulled(effect));
+        CHECK(graph.TransientOffset(unused) == FrameGraph::Invalid);
+        CHECK(graph.HeapSize() == 0);
+        CHECK(graph.Stats().CulledPasses == 1);
+    }
+
+    {
+        FrameGraph graph;
+        FrameGraphResource transient = graph.CreateTransient("T", 64, 1);
+        FrameGraphPass pass = graph.AddPass("ReadFirst", nullptr, true);
+        graph.Read(pass, transient, State::ShaderRead);
+
+        bool thrown = false;
+        try
+        {
+            graph.Compile();
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+
+    {
+        FrameGraph graph;
+        FrameGraphResource output = graph.Import("Output", State::Present);
+        FrameGraphPass pass = graph.AddPass("TwoStates", nullptr, true);
+        graph.Write(pass, output, State::RenderTarget);
+
+        bool thrown = false;
+        try
+        {
+            graph.Read(pass, output, State::ShaderRead);
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+}
+
+// Случайные графы: цепочки временных с разными размерами и выравниваниями,
+// импортированные с конечными состояниями и без, проходы с побочным эффектом
+static void TestRandomGraphs()
+{
+    const State readStates[] = { State::ShaderRead, State::CopySource, State::DepthRead, State::VertexBuffer };
+    const State writeStates[] = { State::RenderTarget, State::DepthWrite, State::UnorderedAccess, State::CopyDest };
+    const State importStates[] = { State::Present, State::ShaderRead, State::CopyDest, State::RenderTarget };
+
+    Recorder reused;
+    for (int iteration = 0; iteration < 3000; iteration++)
+    {
+        // Нечётные - один и тот же граф после Reset: ёмкость остаётся, прошлый кадр - нет
+        Recorder fresh;
+        Recorder& r = iteration % 2 ? reused : fresh;
+        r.Graph.Reset();
+        r.Uses.clear();
+
+        uint32_t importCount = 1 + NextRandom() % 3;
+        uint32_t transientCount = NextRandom() % 9;
+        std::vector<State> initial, finals;
+        std::vector<uint64_t> sizes, alignments;
+
+        for (uint32_t i = 0; i < importCount; i++)
+        {
+            State start = importStates[NextRandom() % 4];
+            State end = NextRandom() % 3 ? importStates[NextRandom() % 4] : State::Undefined;
+            r.Graph.Import("Import", start, end);
+            initial.push_back(start);
+            finals.push_back(end);
+            sizes.push_back(0);
+            alignments.push_back(1);
+        }
+
+        std::vector<FrameGraphResource> transients;
+        std::vector<bool> written;
+        for (uint32_t i = 0; i < transientCount; i++)
+        {
+            uint64_t alignment = 1ull << (NextRandom() % 17);
+            uint64_t size = 1 + NextRandom() % 70000;
+            transients.push_back(r.Graph.CreateTransient("Transient", size, alignment));
+            written.push_back(false);
+            initial.push_back(State::Undefined);
+            finals.push_back(State::Undefined);
+            sizes.push_back(size);
+            alignments.push_back(alignment);
+        }
+
+        uint32_t passCount = 1 + NextRandom() % 12;
+        for (uint32_t p = 0; p < passCount; p++)
+        {
+            FrameGraphPass pass = r.Graph.AddPass("Pass", nullptr, NextRandom() % 8 == 0);
+            std::vector<FrameGraphResource> used;
+            uint32_t useCount = 1 + NextRandom() % 4;
+
+            for (uint32_t u = 0; u < useCount; u++)
+            {
+                bool useTransient = !transients.empty() && NextRandom() % 3 != 0;
+                FrameGraphResource resource = useTransient
+                    ? transients[NextRandom() % transients.size()]
+                    : NextRandom() % importCount;
+
+                bool already = false;
+                for (FrameGraphResource x : used)
+                    already = already || x == resource;
+                if (already)
+                    continue;
+                used.push_back(resource);
+
+                // Временный сначала пишется
+                bool write = NextRandom() % 2 == 0;
+                if (useTransient && !written[resource - importCount])
+                    write = true;
+
+                State state = write ? writeStates[NextRandom() % 4] : readStates[NextRandom() % 4];
+                if (write)
+                {
+                    r.Write(pass, resource, state);
+                    if (useTransient)
+                        written[resource - importCount] = true;
+                }
+                else
+                {
+                    r.Read(pass, resource, state);
+                }
+            }
+        }
+
+        r.Graph.Compile();
+
+        CheckPlacement(r, sizes, alignments);
+        CheckBarriers(r, initial, finals, sizes);
+    }
+}
+
+int main()
+{
+    TestAppFrame();
+    TestAliasingChain();
+    TestCullingAndErrors();
+    TestRandomGraphs();
+
+    std::printf("FrameGraphTest: OK\n");
+    return 0;
+}
@@ -0,0 +1,194 @@
+﻿#include "FrameScheduler.h"
+#include "Check.h"
+#include <deque>
+#include <string>
+#include <vector>
+
+// Очередь-заглушка вместо ID3D12CommandQueue + ID3D12Fence: Signal ставит значение
+// в очередь, GPU "выполняет" их по одному, Wait прогоняет очередь до нужного значения
+
+namespace
+{
+    struct FakeQueue
+    {
+        std::deque<uint64_t> Pending;
+        uint64_t Completed = 0;
+
+        void Signal(uint64_t value)
+        {
+            CHECK(Pending.empty() || Pending.back() < value);
+            CHECK(value > Completed);
+            Pending.push_back(value);
+        }
+
+        void Step()
+        {
+            if (!Pending.empty())
+            {
+                Completed = Pending.front();
+                Pending.pop_front();
+            }
+        }
+
+        void Wait(uint64_t value)
+        {
+            while (Completed < value)
+            {
+                CHECK(!Pending.empty());
+                Step();
+            }
+        }
+    };
+}
+
+// Первые FrameCount кадров слоты свободны, дальше кадр ждёт значение своего слота
+static void TestSlotWaitValues()
+{
+    FrameScheduler scheduler(3);
+    FakeQueue queue;
+
+    for (uint32_t frame = 0; frame < 3; frame++)
+    {
+        CHECK(scheduler.CurrentSlot() == frame);
+        CHECK(scheduler.BeginFrame(queue.Completed) == 0);
+        CHECK(scheduler.PendingFenceValue() == frame + 1);
+        uint64_t value = scheduler.EndFrame();
+        CHECK(value == frame + 1);
+        queue.Signal(value);
+    }
+
+    // GPU стоит: четвёртый кадр в слоте 0 ждёт значение первого
+    CHECK(scheduler.CurrentSlot() == 0);
+    CHECK(scheduler.BeginFrame(queue.Completed) == 1);
+    CHECK(scheduler.Stats().FramesWaited == 1);
+
+    // Первый кадр завершён - ждать нечего, слот 1 ещё занят
+    queue.Step();
+    CHECK(scheduler.BeginFrame(queue.Completed) == 0);
+    queue.Signal(scheduler.EndFrame());
+    CHECK(scheduler.BeginFrame(queue.Completed) == 2);
+
+    // Внеочередной Signal (полный сброс очереди) сдвигает значения следующих кадров
+    uint64_t flush = scheduler.Signal();
+    CHECK(flush == 5);
+    queue.Signal(flush);
+    queue.Wait(flush);
+    CHECK(scheduler.BeginFrame(queue.Completed) == 0);
+    CHECK(scheduler.EndFrame() == 6);
+    CHECK(scheduler.LastSignaled() == 6);
+    CHECK(scheduler.Stats().FramesSubmitted == 5);
+}
+
+// GPU отстаёт на разное число кадров: после ожидания слот свободен, а CPU
+// никогда не уходит вперёд больше чем на FrameCount кадров
+static void TestSimulatedLag()
+{
+    const uint32_t frameCount = 3;
+    FrameScheduler scheduler(frameCount);
+    FakeQueue queue;
+
+    std::vector<uint64_t> slotLastValue(frameCount, 0);
+    uint32_t random = 12345;
+    uint64_t waits = 0;
+
+    for (uint32_t frame = 0; frame < 1000; frame++)
+    {
+        random = random * 1664525u + 1013904223u;
+        uint32_t gpuSteps = (random >> 16) % 3; // 0..2 кадра за кадр CPU
+        for (uint32_t i = 0; i < gpuSteps; i++)
+            queue.Step();
+
+        uint32_t slot = scheduler.CurrentSlot();
+        uint64_t wait = scheduler.BeginFrame(queue.Completed);
+        if (wait != 0)
+        {
+            CHECK(wait == slotLastValue[slot]);
+            CHECK(wait > queue.Completed);
+            waits++;
+            queue.Wait(wait);
+        }
+        CHECK(queue.Completed >= slotLastValue[slot]);
+        CHECK(queue.Pending.size() <= frameCount - 1);
+
+        uint64_t value = scheduler.EndFrame();
+        CHECK(value == slotLastValue[slot] + frameCount || slotLastValue[slot] == 0);
+        slotLastValue[slot] = value;
+        queue.Signal(value);
+    }
+
+    CHECK(waits > 0);
+    CHECK(scheduler.Stats().FramesWaited == waits);
+    CHECK(scheduler.Stats().FramesSubmitted == 1000);
+}
+
+// Collect снимает только завершённый префикс и в порядке Retire
+static void TestRetireQueueOrder()
+{
+    FenceRetireQueue<std::string> queue;
+    queue.Retire("a", 1);
+    queue.Retire("b", 2);
+    queue.Retire("c", 2);
+    queue.Retire("d", 4);
+
+    std::vector<std::string> released;
+    auto release = [&released](std::string& item) { released.push_back(item); };
+
+    CHECK(queue.Collect(0, release) == 0);
+    CHECK(released.empty());
+
+    CHECK(queue.Collect(2, release) == 3);
+    CHECK((released == std::vector<std::string>{ "a", "b", "c" }));
+    CHECK(queue.Size() == 1);
+
+    CHECK(queue.Collect(3, release) == 0);
+    queue.Retire("e", 5);
+    CHECK(queue.Collect(5, release) == 2);
+    CHECK((released == std::vector<std::string>{ "a", "b", "c", "d", "e" }));
+    CHECK(queue.Size() == 0);
+
+    // Без release - просто освобождение
+    FenceRetireQueue<int> plain;
+    plain.Retire(1, 7);
+    plain.Retire(2, 8);
+    CHECK(plain.Collect(7) == 1 && plain.Size() == 1);
+    plain.Clear();
+    CHECK(plain.Size() == 0);
+}
+
+// Ресурсы, отданные кадром, освобождаются только когда GPU дошёл до его fence
+static void TestRetireWithScheduler()
+{
+    FrameScheduler scheduler(2);
+    FakeQueue queue;
+    FenceRetireQueue<uint32_t> retired;
+    std::vector<uint32_t> released;
+
+    for (uint32_t frame = 0; frame < 10; frame++)
+    {
+        queue.Wait(scheduler.BeginFrame(queue.Completed));
+        retired.Collect(queue.Completed, [&](uint32_t& item) { released.push_back(item); });
+
+        // Кадр освобождает объект, который GPU читал в этом кадре
+        retired.Retire(frame, scheduler.PendingFenceValue());
+        queue.Signal(scheduler.EndFrame());
+
+        for (uint32_t item : released)
+            CHECK(item + 1 <= queue.Completed);
+    }
+
+    queue.Wait(scheduler.LastSignaled());
+    retired.Collect(queue.Completed, [&](uint32_t& item) { released.push_back(item); });
+    CHECK(released.size() == 10);
+    for (uint32_t i = 0; i < 10; i++)
+        CHECK(released[i] == i);
+}
+
+int main()
+{
+    TestSlotWaitValues();
+    TestSimulatedLag();
+    TestRetireQueueOrder();
+    TestRetireWithScheduler();
+    std::printf("FrameSchedulerTest: OK\n");
+    return 0;
+}
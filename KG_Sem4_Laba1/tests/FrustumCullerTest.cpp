@@ -0,0 +1,177 @@
+﻿#include "FrustumCuller.h"
+#include "Check.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    uint32_t gRandom = 1;
+
+    uint32_t NextRandom()
+    {
+        gRandom = gRandom * 1664525u + 1013904223u;
+        return gRandom;
+    }
+
+    float Random01()
+    {
+        return float(NextRandom() >> 8) / float(1 << 24);
+    }
+
+    float Random(float from, float to)
+    {
+        return from + (to - from) * Random01();
+    }
+
+    void Multiply(const float a[4][4], const float b[4][4], float out[4][4])
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                out[i][j] = 0.0f;
+                for (int k = 0; k < 4; k++)
+                    out[i][j] += a[i][k] * b[k][j];
+            }
+        }
+    }
+
+    // Как XMMatrixLookToLH * XMMatrixPerspectiveFovLH: камера в eye, поворот yaw вокруг y
+    void MakeViewProj(const float eye[3], float yaw, float fovY, float aspect, float zn, float zf, float out[4][4])
+    {
+        float s = std::sin(yaw);
+        float c = std::cos(yaw);
+        float right[3] = { c, 0.0f, -s };
+        float up[3] = { 0.0f, 1.0f, 0.0f };
+        float forward[3] = { s, 0.0f, c };
+
+        float view[4][4] = {};
+        for (int i = 0; i < 3; i++)
+        {
+            view[i][0] = right[i];
+            view[i][1] = up[i];
+            view[i][2] = forward[i];
+        }
+        view[3][0] = -(right[0] * eye[0] + right[1] * eye[1] + right[2] * eye[2]);
+        view[3][1] = -(up[0] * eye[0] + up[1] * eye[1] + up[2] * eye[2]);
+        view[3][2] = -(forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2]);
+        view[3][3] = 1.0f;
+
+        float ys = 1.0f / std::tan(fovY * 0.5f);
+        float range = zf / (zf - zn);
+        float proj[4][4] = {};
+        proj[0][0] = ys / aspect;
+        proj[1][1] = ys;
+        proj[2][2] = range;
+        proj[2][3] = 1.0f;
+        proj[3][2] = -range * zn;
+
+        Multiply(view, proj, out);
+    }
+
+    Aabb MakeBox(float x, float y, float z, float half)
+    {
+        Aabb box;
+        box.Extend(x - half, y - half, z - half);
+        box.Extend(x + half, y + half, z + half);
+        return box;
+    }
+}
+
+// Боксы перед камерой, позади, сбоку и за дальней плоскостью
+static void TestKnownBoxes()
+{
+    float eye[3] = { 0.0f, 0.0f, 0.0f };
+    float viewProj[4][4];
+    MakeViewProj(eye, 0.0f, 1.0f, 1.0f, 1.0f, 100.0f, viewProj);
+
+    FrustumPlanes frustum;
+    ExtractFrustumPlanes(viewProj, frustum);
+
+    FrustumCuller culler;
+    culler.Add(MakeBox(0.0f, 0.0f, 10.0f, 1.0f));    // 0: в центре
+    culler.Add(MakeBox(0.0f, 0.0f, -10.0f, 1.0f));   // 1: сзади
+    culler.Add(MakeBox(50.0f, 0.0f, 10.0f, 1.0f));   // 2: справа
+    culler.Add(MakeBox(0.0f, 0.0f, 150.0f, 1.0f));   // 3: дальше far
+    culler.Add(MakeBox(0.0f, 0.0f, 100.5f, 1.0f));   // 4: пересекает far
+    culler.Add(Aabb());                              // 5: пустой
+
+    std::vector<uint32_t> visible;
+    culler.Cull(frustum, visible);
+    CHECK((visible == std::vector<uint32_t>{ 0, 4 }));
+
+    culler.CullScalar(frustum, visible);
+    CHECK((visible == std::vector<uint32_t>{ 0, 4 }));
+
+    // Маска снимает бокс 0
+    uint64_t mask = ~uint64_t(1);
+    culler.Cull(frustum, visible, &mask);
+    CHECK((visible == std::vector<uint32_t>{ 4 }));
+}
+
+// SSE и скалярная версии дают одинаковые списки на случайных боксах и камерах,
+// с маской и без, при числе боксов не кратном 4
+static void TestSimdMatchesScalar()
+{
+    FrustumCuller culler;
+    const uint32_t count = 10007;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (i % 97 == 0)
+        {
+            culler.Add(Aabb());
+            continue;
+        }
+        culler.Add(MakeBox(Random(-200.0f, 200.0f), Random(-50.0f, 50.0f), Random(-200.0f, 200.0f), Random(0.01f, 20.0f)));
+    }
+
+    std::vector<uint64_t> mask((count + 63) / 64);
+    std::vector<uint32_t> simd, scalar;
+    uint64_t totalVisible = 0;
+
+    for (int camera = 0; camera < 64; camera++)
+    {
+        float eye[3] = { Random(-150.0f, 150.0f), Random(-20.0f, 20.0f), Random(-150.0f, 150.0f) };
+        float viewProj[4][4];
+        MakeViewProj(eye, Random(0.0f, 6.2831853f), Random(0.5f, 1.6f), Random(1.0f, 2.4f), Random(0.1f, 2.0f), Random(50.0f, 400.0f), viewProj);
+
+        FrustumPlanes frustum;
+        ExtractFrustumPlanes(viewProj, frustum);
+
+        culler.Cull(frustum, simd);
+        culler.CullScalar(frustum, scalar);
+        CHECK(simd == scalar);
+        totalVisible += simd.size();
+
+        for (uint64_t& word : mask)
+            word = (uint64_t(NextRandom()) << 32) | NextRandom();
+        culler.Cull(frustum, simd, mask.data());
+        culler.CullScalar(frustum, scalar, mask.data());
+        CHECK(simd == scalar);
+        for (uint32_t index : simd)
+            CHECK((mask[index / 64] >> (index % 64)) & 1);
+    }
+
+    // Камеры видели и что-то, и не всё
+    CHECK(totalVisible > 0);
+    CHECK(totalVisible < uint64_t(count) * 64);
+
+    // Set меняет бокс на месте
+    culler.Set(count - 1, MakeBox(0.0f, 0.0f, 0.0f, 1000.0f));
+    float eye[3] = { 0.0f, 0.0f, 0.0f };
+    float viewProj[4][4];
+    MakeViewProj(eye, 0.0f, 1.0f, 1.0f, 1.0f, 100.0f, viewProj);
+    FrustumPlanes frustum;
+    ExtractFrustumPlanes(viewProj, frustum);
+    culler.Cull(frustum, simd);
+    CHECK(!simd.empty() && simd.back() == count - 1);
+}
+
+int main()
+{
+    TestKnownBoxes();
+    TestSimdMatchesScalar();
+    std::printf("FrustumCullerTest: OK\n");
+    return 0;
+}
@@ -0,0 +1,220 @@
+﻿#include "JobSystem.h"
+#include "Check.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Владелец кладёт задачи в свой дек и сам же их снимает, пока три рабочих крадут:
+// гонка Pop и Steal за последнюю задачу не должна ни терять, ни дублировать задачи
+static void TestStealRace()
+{
+    JobSystem jobs(3);
+    const uint32_t jobCount = 3000;
+    std::unique_ptr<std::atomic<uint32_t>[]> runs(new std::atomic<uint32_t>[jobCount]);
+
+    for (int round = 0; round < 200; round++)
+    {
+        for (uint32_t i = 0; i < jobCount; i++)
+            runs[i] = 0;
+
+        JobCounter counter;
+        uint32_t count = 1 + (round * 37) % jobCount;
+        for (uint32_t i = 0; i < count; i++)
+            jobs.Run([&runs, i] { runs[i].fetch_add(1, std::memory_order_relaxed); }, &counter);
+        jobs.Wait(counter);
+
+        for (uint32_t i = 0; i < count; i++)
+            CHECK(runs[i].load() == 1);
+    }
+
+    CHECK(jobs.Stats().Stolen > 0);
+}
+
+// Больше задач, чем ёмкость дека: лишние выполняются сразу, но тоже ровно один раз
+static void TestDequeOverflow()
+{
+    JobSystem jobs(1);
+    const uint32_t jobCount = WorkStealingDeque::Capacity * 3;
+    std::unique_ptr<std::atomic<uint32_t>[]> runs(new std::atomic<uint32_t>[jobCount]);
+    for (uint32_t i = 0; i < jobCount; i++)
+        runs[i] = 0;
+
+    JobCounter counter;
+    for (uint32_t i = 0; i < jobCount; i++)
+        jobs.Run([&runs, i] { runs[i]++; }, &counter);
+    jobs.Wait(counter);
+
+    for (uint32_t i = 0; i < jobCount; i++)
+        CHECK(runs[i].load() == 1);
+}
+
+// Задача ждёт свои вложенные задачи: Wait внутри задачи выполняет чужую работу
+static void TestNestedWait()
+{
+    JobSystem jobs(3);
+    std::atomic<uint32_t> leaves{ 0 };
+
+    JobCounter root;
+    for (int outer = 0; outer < 16; outer++)
+    {
+        jobs.Run([&jobs, &leaves]
+        {
+            JobCounter inner;
+            for (int i = 0; i < 64; i++)
+            {
+                jobs.Run([&jobs, &leaves]
+                {
+                    JobCounter innermost;
+                    for (int k = 0; k < 4; k++)
+                        jobs.Run([&leaves] { leaves++; }, &innermost);
+                    jobs.Wait(innermost);
+                }, &inner);
+            }
+            jobs.Wait(inner);
+        }, &root);
+    }
+    jobs.Wait(root);
+
+    CHECK(leaves.load() == 16 * 64 * 4);
+}
+
+// RunAfter: цепочка стадий, каждая видит результат предыдущей полностью
+static void TestContinuations()
+{
+    JobSystem jobs(3);
+
+    const int stages = 8;
+    const int width = 32;
+    std::vector<std::atomic<int>> done(stages);
+    std::vector<std::unique_ptr<JobCounter>> counters;
+    for (int s = 0; s < stages; s++)
+        counters.push_back(std::make_unique<JobCounter>());
+
+    std::atomic<int> violations{ 0 };
+    for (int s = 0; s < stages; s++)
+    {
+        for (int i = 0; i < width; i++)
+        {
+            auto task = [&done, &violations, s, width]
+            {
+                if (s > 0 && done[s - 1].load() != width)
+                    violations++;
+                done[s]++;
+            };
+
+            if (s == 0)
+                jobs.Run(task, counters[s].get());
+            else
+                jobs.RunAfter(*counters[s - 1], task, counters[s].get());
+        }
+    }
+    jobs.Wait(*counters[stages - 1]);
+
+    CHECK(violations.load() == 0);
+    for (int s = 0; s < stages; s++)
+        CHECK(done[s].load() == width);
+
+    // Зависимость уже выполнена - задача ставится сразу
+    JobCounter finished;
+    JobCounter after;
+    std::atomic<bool> ran{ false };
+    jobs.RunAfter(finished, [&ran] { ran = true; }, &after);
+    jobs.Wait(after);
+    CHECK(ran.load());
+
+    // Продолжение, поставленное изнутри задачи на счётчик ещё идущих задач
+    JobCounter first, second;
+    std::atomic<int> order{ 0 };
+    std::atomic<int> secondSaw{ -1 };
+    jobs.Run([&]
+    {
+        for (int i = 0; i < 10; i++)
+            jobs.Run([&order] { order++; }, &first);
+        jobs.RunAfter(first, [&] { secondSaw = order.load(); }, &second);
+    }, &second);
+    jobs.Wait(second);
+    CHECK(secondSaw.load() == 10);
+}
+
+// Задачи от потока вне системы идут через общую очередь
+static void TestExternalThread()
+{
+    JobSystem jobs(2);
+    std::atomic<int> sum{ 0 };
+
+    std::thread outside([&]
+    {
+        JobCounter counter;
+        for (int i = 1; i <= 100; i++)
+            jobs.Run([&sum, i] { sum += i; }, &counter);
+        jobs.Wait(counter);
+    });
+    outside.join();
+
+    CHECK(sum.load() == 5050);
+}
+
+// ParallelFor: куски по порядку покрывают [0, count) без пересечений при любом grain
+static void TestParallelForGrains()
+{
+    JobSystem jobs(3);
+
+    struct Case
+    {
+        uint32_t Count;
+        uint32_t Grain;
+    };
+    const Case cases[] = {
+        { 0, 0 }, { 1, 0 }, { 1, 1 }, { 7, 0 }, { 7, 1 }, { 7, 3 }, { 7, 7 }, { 7, 8 },
+        { 7, UINT32_MAX }, { 1000, 0 }, { 1000, 999 }, { 1000, 1 }, { 4096 * 3, 1 },
+    };
+
+    for (const Case& c : cases)
+    {
+        std::vector<std::atomic<uint32_t>> hits(c.Count);
+        std::atomic<uint32_t> calls{ 0 };
+        std::atomic<uint32_t> badRange{ 0 };
+
+        jobs.ParallelFor(c.Count, [&](uint32_t begin, uint32_t end)
+        {
+            calls++;
+            uint32_t grain = c.Grain == 0 ? (std::max)(c.Count / (jobs.ThreadCount() * 4), 1u) : c.Grain;
+            if (begin >= end || end > c.Count || end - begin > grain)
+                badRange++;
+            for (uint32_t i = begin; i < end && i < c.Count; i++)
+                hits[i]++;
+        }, c.Grain);
+
+        CHECK(badRange.load() == 0);
+        for (uint32_t i = 0; i < c.Count; i++)
+            CHECK(hits[i].load() == 1);
+        if (c.Count == 0)
+            CHECK(calls.load() == 0);
+        if (c.Grain >= c.Count && c.Count > 0)
+            CHECK(calls.load() == 1);
+    }
+
+    // count около UINT32_MAX и grain больше половины: begin + grain переполнился бы
+    std::atomic<uint64_t> covered{ 0 };
+    std::atomic<uint32_t> calls{ 0 };
+    jobs.ParallelFor(UINT32_MAX, [&](uint32_t begin, uint32_t end)
+    {
+        covered += end - begin;
+        calls++;
+    }, 0x80000001u);
+    CHECK(covered.load() == UINT32_MAX);
+    CHECK(calls.load() == 2);
+}
+
+int main()
+{
+    TestStealRace();
+    TestDequeOverflow();
+    TestNestedWait();
+    TestContinuations();
+    TestExternalThread();
+    TestParallelForGrains();
+    std::printf("JobSystemTest: OK\n");
+    return 0;
+}
@@ -0,0 +1,383 @@
+﻿#include "LightmapBaker.h"
+#include "DdsLoader.h"
+#include "Check.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <vector>
+
+namespace
+{
+    uint32_t gRandom = 1;
+
+    uint32_t NextRandom()
+    {
+        gRandom = gRandom * 1664525u + 1013904223u;
+        return gRandom;
+    }
+
+    float Random(float from, float to)
+    {
+        return from + (to - from) * (float(NextRandom() >> 8) / float(1 << 24));
+    }
+
+    struct TestVertex
+    {
+        float Position[3];
+        float Normal[3];
+    };
+
+    // Вершины у каждого угла свои, как у LoadOBJ
+    struct Mesh
+    {
+        std::vector<TestVertex> Vertices;
+        std::vector<uint32_t> Indices;
+
+        void AddQuad(const float a[3], const float b[3], const float c[3], const float d[3], const float n[3])
+        {
+            const float* corners[6] = { a, b, c, a, c, d };
+            for (const float* p : corners)
+            {
+                TestVertex v;
+                memcpy(v.Position, p, sizeof(v.Position));
+                memcpy(v.Normal, n, sizeof(v.Normal));
+                Indices.push_back((uint32_t)Vertices.size());
+                Vertices.push_back(v);
+            }
+        }
+
+        void AddBox(float x0, float y0, float z0, float x1, float y1, float z1)
+        {
+            float p[8][3];
+            for (int corner = 0; corner < 8; corner++)
+            {
+                p[corner][0] = (corner & 1) ? x1 : x0;
+                p[corner][1] = (corner & 2) ? y1 : y0;
+                p[corner][2] = (corner & 4) ? z1 : z0;
+            }
+            const float nx[3] = { -1, 0, 0 }, px[3] = { 1, 0, 0 };
+            const float ny[3] = { 0, -1, 0 }, py[3] = { 0, 1, 0 };
+            const float nz[3] = { 0, 0, -1 }, pz[3] = { 0, 0, 1 };
+            AddQuad(p[0], p[4], p[6], p[2], nx);
+            AddQuad(p[1], p[3], p[7], p[5], px);
+            AddQuad(p[0], p[1], p[5], p[4], ny);
+            AddQuad(p[2], p[6], p[7], p[3], py);
+            AddQuad(p[0], p[2], p[3], p[1], nz);
+            AddQuad(p[4], p[5], p[7], p[6], pz);
+        }
+
+        LightmapMesh View() const
+        {
+            LightmapMesh mesh;
+            mesh.Vertices = reinterpret_cast<const uint8_t*>(Vertices.data());
+            mesh.VertexStride = sizeof(TestVertex);
+            mesh.PositionOffset = offsetof(TestVertex, Position);
+            mesh.NormalOffset = offsetof(TestVertex, Normal);
+            mesh.VertexCount = (uint32_t)Vertices.size();
+            mesh.Indices = Indices.data();
+            mesh.IndexCount = Indices.size();
+            return mesh;
+        }
+    };
+
+    uint32_t FindRoot(std::vector<uint32_t>& parent, uint32_t i)
+    {
+        while (parent[i] != i)
+            i = parent[i] = parent[parent[i]];
+        return i;
+    }
+
+    // Пиксель лайтмапы под точкой p треугольника t (по UV его вершин)
+    void PixelAt(const Mesh& mesh, const std::vector<LightmapUv>& uvs, uint32_t t, const float p[3], uint32_t size,
+        uint32_t& x, uint32_t& y)
+    {
+        const float* a = mesh.Vertices[mesh.Indices[t * 3 + 0]].Position;
+        const float* b = mesh.Vertices[mesh.Indices[t * 3 + 1]].Position;
+        const float* c = mesh.Vertices[mesh.Indices[t * 3 + 2]].Position;
+
+        // Треугольники проверяемой сцены лежат в y = 0: барицентрические по xz
+        float area = (b[0] - a[0]) * (c[2] - a[2]) - (c[0] - a[0]) * (b[2] - a[2]);
+        float w1 = ((p[0] - a[0]) * (c[2] - a[2]) - (c[0] - a[0]) * (p[2] - a[2])) / area;
+        float w2 = ((b[0] - a[0]) * (p[2] - a[2]) - (p[0] - a[0]) * (b[2] - a[2])) / area;
+        CHECK(w1 >= 0.0f && w2 >= 0.0f && w1 + w2 <= 1.0f);
+
+        const LightmapUv& ua = uvs[mesh.Indices[t * 3 + 0]];
+        const LightmapUv& ub = uvs[mesh.Indices[t * 3 + 1]];
+        const LightmapUv& uc = uvs[mesh.Indices[t * 3 + 2]];
+        x = (uint32_t)((ua.U + (ub.U - ua.U) * w1 + (uc.U - ua.U) * w2) * size);
+        y = (uint32_t)((ua.V + (ub.V - ua.V) * w1 + (uc.V - ua.V) * w2) * size);
+    }
+
+    std::vector<uint8_t> ReadBytes(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+}
+
+// Все углы карт - внутри страниц с отступом Gutter, прямоугольники карт разных
+// страниц и одной не ближе Gutter, треугольники не накрывают один тексель дважды
+static void TestUnwrapPacking()
+{
+    Mesh mesh;
+    for (int i = 0; i < 60; i++)
+    {
+        float x = Random(-50.0f, 50.0f), y = Random(0.0f, 10.0f), z = Random(-50.0f, 50.0f);
+        mesh.AddBox(x, y, z, x + Random(0.5f, 12.0f), y + Random(0.5f, 12.0f), z + Random(0.5f, 12.0f));
+    }
+    const float g0[3] = { -60, 0, -60 }, g1[3] = { 60, 0, -60 }, g2[3] = { 60, 0, 60 }, g3[3] = { -60, 0, 60 };
+    const float up[3] = { 0, 1, 0 };
+    mesh.AddQuad(g0, g3, g2, g1, up);
+
+    LightmapUnwrapDesc desc;
+    desc.PageSize = 128;
+    desc.MaxPages = 3;
+    LightmapBaker baker;
+    std::vector<LightmapUv> uvs;
+    baker.Unwrap(mesh.View(), desc, uvs);
+
+    const LightmapStats& stats = baker.Stats();
+    CHECK(uvs.size() == mesh.Vertices.size());
+    CHECK(stats.Charts == 60 * 6 + 1);
+    CHECK(stats.Pages > 1 && stats.Pages <= desc.MaxPages);
+    CHECK(stats.TexelsPerUnit > 0.0f);
+
+    // Карты - компоненты треугольников с общими углами в атласе
+    uint32_t triangles = (uint32_t)(mesh.Indices.size() / 3);
+    std::vector<uint32_t> parent(triangles);
+    std::iota(parent.begin(), parent.end(), 0u);
+    for (uint32_t a = 0; a < triangles; a++)
+        for (uint32_t b = a + 1; b < triangles; b++)
+            for (int i = 0; i < 3; i++)
+                for (int j = 0; j < 3; j++)
+                {
+                    const LightmapUv& ua = uvs[mesh.Indices[a * 3 + i]];
+                    const LightmapUv& ub = uvs[mesh.Indices[b * 3 + j]];
+                    if (ua.U == ub.U && ua.V == ub.V && ua.Page == ub.Page)
+                        parent[FindRoot(parent, a)] = FindRoot(parent, b);
+                }
+
+    struct Rect
+    {
+        float Min[2] = { 1e30f, 1e30f };
+        float Max[2] = { -1e30f, -1e30f };
+        float Page = -1.0f;
+    };
+    std::vector<Rect> rects(triangles);
+    float size = (float)desc.PageSize;
+    const float Epsilon = 1e-3f;
+
+    for (uint32_t t = 0; t < triangles; t++)
+    {
+        Rect& rect = rects[FindRoot(parent, t)];
+        for (int k = 0; k < 3; k++)
+        {
+            const LightmapUv& uv = uvs[mesh.Indices[t * 3 + k]];
+            float x = uv.U * size, y = uv.V * size;
+            CHECK(uv.Page >= 0.0f && uv.Page < (float)stats.Pages && uv.Page == std::floor(uv.Page));
+            CHECK(x >= desc.Gutter + 0.5f - Epsilon && x <= size - desc.Gutter - 0.5f + Epsilon);
+            CHECK(y >= desc.Gutter + 0.5f - Epsilon && y <= size - desc.Gutter - 0.5f + Epsilon);
+            CHECK(rect.Page < 0.0f || rect.Page == uv.Page);
+            rect.Page = uv.Page;
+            rect.Min[0] = (std::min)(rect.Min[0], x);
+            rect.Min[1] = (std::min)(rect.Min[1], y);
+            rect.Max[0] = (std::max)(rect.Max[0], x);
+            rect.Max[1] = (std::max)(rect.Max[1], y);
+        }
+    }
+
+    std::vector<uint32_t> charts;
+    for (uint32_t t = 0; t < triangles; t++)
+    {
+        if (FindRoot(parent, t) == t)
+            charts.push_back(t);
+    }
+    CHECK(charts.size() == stats.Charts);
+
+    // Между картами на странице - не меньше Gutter пустых текселей
+    for (size_t i = 0; i < charts.size(); i++)
+        for (size_t j = i + 1; j < charts.size(); j++)
+        {
+            const Rect& a = rects[charts[i]];
+            const Rect& b = rects[charts[j]];
+            if (a.Page != b.Page)
+                continue;
+            float gapX = (std::max)(b.Min[0] - a.Max[0], a.Min[0] - b.Max[0]);
+            float gapY = (std::max)(b.Min[1] - a.Max[1], a.Min[1] - b.Max[1]);
+            CHECK((std::max)(gapX, gapY) >= desc.Gutter + 1.0f - Epsilon);
+        }
+
+    // Центр текселя строго внутри не больше чем одного треугольника
+    std::vector<uint8_t> covered((size_t)desc.PageSize * desc.PageSize * stats.Pages, 0);
+    for (uint32_t t = 0; t < triangles; t++)
+    {
+        float x[3], y[3];
+        for (int k = 0; k < 3; k++)
+        {
+            x[k] = uvs[mesh.Indices[t * 3 + k]].U * size;
+            y[k] = uvs[mesh.Indices[t * 3 + k]].V * size;
+        }
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        CHECK(std::fabs(area) > 0.0f);
+        float sign = area < 0.0f ? -1.0f : 1.0f;
+        size_t page = (size_t)uvs[mesh.Indices[t * 3]].Page;
+
+        for (int py = (int)std::floor((std::min)({ y[0], y[1], y[2] })); py <= (int)std::ceil((std::max)({ y[0], y[1], y[2] })); py++)
+            for (int px = (int)std::floor((std::min)({ x[0], x[1], x[2] })); px <= (int)std::ceil((std::max)({ x[0], x[1], x[2] })); px++)
+            {
+                float cx = px + 0.5f, cy = py + 0.5f;
+                bool inside = true;
+                for (int k = 0; k < 3; k++)
+                {
+                    int a = k, b = (k + 1) % 3;
+                    float edge = sign * ((x[b] - x[a]) * (cy - y[a]) - (y[b] - y[a]) * (cx - x[a]));
+                    inside = inside && edge > Epsilon;
+                }
+                if (!inside)
+                    continue;
+                uint8_t& texel = covered[(page * desc.PageSize + py) * desc.PageSize + px];
+                CHECK(texel == 0);
+                texel = 1;
+            }
+    }
+}
+
+// Под навесом солнце не светит: запекание только прямого света даёт там ноль,
+// полное - только непрямой свет (небо и отскок), меньше освещённого пола
+static void TestShadowGetsIndirectOnly()
+{
+    Mesh mesh;
+    const float g0[3] = { -10, 0, -10 }, g1[3] = { 10, 0, -10 }, g2[3] = { 10, 0, 10 }, g3[3] = { -10, 0, 10 };
+    const float up[3] = { 0, 1, 0 };
+    mesh.AddQuad(g0, g1, g2, g3, up);      // Треугольники (g0, g1, g2) и (g0, g2, g3): z > x - второй
+    mesh.AddBox(-3.0f, 2.0f, -3.0f, 3.0f, 3.0f, 3.0f);
+
+    LightmapUnwrapDesc unwrap;
+    unwrap.PageSize = 128;
+    unwrap.MaxPages = 1;
+    LightmapBaker baker;
+    std::vector<LightmapUv> uvs;
+    baker.Unwrap(mesh.View(), unwrap, uvs);
+    CHECK(baker.Stats().Pages == 1);
+
+    TriangleBvh bvh;
+    bvh.Build(mesh.Vertices[0].Position, sizeof(TestVertex), mesh.Indices.data(), mesh.Indices.size(), nullptr);
+    std::vector<LightmapDraw> draws(1);
+    draws[0].TriangleCount = (uint32_t)(mesh.Indices.size() / 3);
+
+    LightmapBakeDesc desc;
+    desc.SunDirection[0] = 0.0f;
+    desc.SunDirection[1] = 1.0f;
+    desc.SunDirection[2] = 0.0f;
+    desc.SunColor[0] = desc.SunColor[1] = desc.SunColor[2] = 1.0f;
+
+    const float shadowed[3] = { -1.0f, 0.0f, 1.0f };
+    const float lit[3] = { -8.0f, 0.0f, 8.0f };
+    uint32_t size = baker.PageSize();
+    uint32_t sx, sy, lx, ly;
+    PixelAt(mesh, uvs, 1, shadowed, size, sx, sy);
+    PixelAt(mesh, uvs, 1, lit, size, lx, ly);
+
+    JobSystem jobs(3);
+    LightmapBakeDesc directOnly = desc;
+    directOnly.IndirectSamples = 0;
+    directOnly.DenoisePasses = 0;
+    baker.Bake(mesh.View(), bvh, draws, {}, directOnly, jobs);
+
+    const uint8_t* pixels = baker.PagePixels(0);
+    const uint8_t* s = &pixels[((size_t)sy * size + sx) * 4];
+    const uint8_t* l = &pixels[((size_t)ly * size + lx) * 4];
+    CHECK(s[0] == 0 && s[1] == 0 && s[2] == 0 && s[3] == 255);
+    // Солнце в зените: освещённость 1 при Range 4
+    for (int c = 0; c < 3; c++)
+        CHECK(std::abs((int)l[c] - 64) <= 1);
+    CHECK(l[3] == 255);
+    uint8_t litDirect = l[0];
+
+    baker.Bake(mesh.View(), bvh, draws, {}, desc, jobs);
+    pixels = baker.PagePixels(0);
+    s = &pixels[((size_t)sy * size + sx) * 4];
+    l = &pixels[((size_t)ly * size + lx) * 4];
+    for (int c = 0; c < 3; c++)
+        CHECK(s[c] > 0 && s[c] < l[c]);
+    CHECK(l[0] >= litDirect);
+
+    const LightmapStats& stats = baker.Stats();
+    CHECK(stats.Texels > 0 && stats.Rays > 0 && stats.RaysPerSecond > 0.0);
+}
+
+// Save пишет массив страниц с цепочкой мипов, который разбирает ParseDDS
+static void TestSaveRoundTrip()
+{
+    Mesh mesh;
+    for (int i = 0; i < 30; i++)
+    {
+        float x = Random(-20.0f, 20.0f), z = Random(-20.0f, 20.0f);
+        mesh.AddBox(x, 0.0f, z, x + Random(1.0f, 6.0f), Random(1.0f, 6.0f), z + Random(1.0f, 6.0f));
+    }
+
+    LightmapUnwrapDesc unwrap;
+    unwrap.PageSize = 64;
+    unwrap.MaxPages = 3;
+    LightmapBaker baker;
+    CHECK(!baker.Save((std::filesystem::temp_directory_path() / "LightmapBakerTest.empty.dds").string()));
+
+    std::vector<LightmapUv> uvs;
+    baker.Unwrap(mesh.View(), unwrap, uvs);
+    CHECK(baker.PageCount() > 1);
+
+    TriangleBvh bvh;
+    bvh.Build(mesh.Vertices[0].Position, sizeof(TestVertex), mesh.Indices.data(), mesh.Indices.size(), nullptr);
+    std::vector<LightmapDraw> draws(1);
+    draws[0].TriangleCount = (uint32_t)(mesh.Indices.size() / 3);
+    LightmapBakeDesc desc;
+    desc.IndirectSamples = 8;
+    JobSystem jobs(1);
+    baker.Bake(mesh.View(), bvh, draws, {}, desc, jobs);
+
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "LightmapBakerTest.dds";
+    CHECK(baker.Save(path.string()));
+    CHECK(!std::filesystem::exists(path.string() + ".part"));
+    std::vector<uint8_t> bytes = ReadBytes(path);
+    std::filesystem::remove(path);
+
+    DdsImage image;
+    CHECK(ParseDDS(bytes.data(), bytes.size(), image));
+    CHECK(image.Format == DdsFormat::R8G8B8A8_UNORM);
+    CHECK(image.Width == 64 && image.Height == 64);
+    CHECK(image.MipCount == 7);
+    CHECK(image.ArraySize == baker.PageCount());
+    CHECK(!image.IsCubemap);
+    CHECK(image.Subresources.size() == (size_t)image.MipCount * image.ArraySize);
+
+    for (uint32_t page = 0; page < image.ArraySize; page++)
+    {
+        for (uint32_t mip = 0; mip < image.MipCount; mip++)
+        {
+            const DdsSubresource& sub = image.Subresources[page * image.MipCount + mip];
+            CHECK(sub.Width == (64u >> mip) && sub.Height == (64u >> mip));
+            CHECK(sub.RowPitch == sub.Width * 4 && sub.NumRows == sub.Height);
+            CHECK(sub.Offset + (size_t)sub.RowPitch * sub.NumRows <= bytes.size());
+        }
+
+        const DdsSubresource& top = image.Subresources[page * image.MipCount];
+        CHECK(memcmp(&bytes[top.Offset], baker.PagePixels(page), (size_t)64 * 64 * 4) == 0);
+
+        // Последний мип 1x1 - покрытие страницы в альфе
+        const DdsSubresource& last = image.Subresources[page * image.MipCount + image.MipCount - 1];
+        CHECK(bytes[last.Offset + 3] > 0);
+    }
+}
+
+int main()
+{
+    TestUnwrapPacking();
+    TestShadowGetsIndirectOnly();
+    TestSaveRoundTrip();
+    std::printf("LightmapBakerTest: OK\n");
+    return 0;
+}
@@ -0,0 +1,290 @@
+﻿#include "OcclusionCuller.h"
+#include "Check.h"
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+    uint32_t gRandom = 1;
+
+    uint32_t NextRandom()
+    {
+        gRandom = gRandom * 1664525u + 1013904223u;
+        return gRandom;
+    }
+
+    float Random(float from, float to)
+    {
+        return from + (to - from) * (float(NextRandom() >> 8) / float(1 << 24));
+    }
+
+    const float Near = 0.1f;
+    const float Far = 1000.0f;
+    const float Aspect = float(OcclusionCuller::Width) / float(OcclusionCuller::Height);
+
+    // Камера в начале координат смотрит вдоль +z, fov 90 градусов (XMMatrixPerspectiveFovLH)
+    void MakeViewProj(float out[4][4])
+    {
+        float range = Far / (Far - Near);
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+                out[i][j] = 0.0f;
+        out[0][0] = 1.0f / Aspect;
+        out[1][1] = 1.0f;
+        out[2][2] = range;
+        out[2][3] = 1.0f;
+        out[3][2] = -range * Near;
+    }
+
+    // Точка в пиксели и глубину, как в OcclusionCuller
+    void Project(const float p[3], float& sx, float& sy, float& sz)
+    {
+        float range = Far / (Far - Near);
+        float w = p[2];
+        sx = (p[0] / (Aspect * w) * 0.5f + 0.5f) * OcclusionCuller::Width;
+        sy = (0.5f - p[1] / w * 0.5f) * OcclusionCuller::Height;
+        sz = (p[2] * range - range * Near) / w;
+    }
+
+    Aabb MakeBox(float x0, float y0, float z0, float x1, float y1, float z1)
+    {
+        Aabb box;
+        box.Extend(x0, y0, z0);
+        box.Extend(x1, y1, z1);
+        return box;
+    }
+
+    // Стена - прямоугольник на плоскости z из двух треугольников
+    struct Scene
+    {
+        std::vector<float> Positions;
+        std::vector<uint32_t> Indices;
+
+        void AddWall(float x0, float y0, float x1, float y1, float z)
+        {
+            uint32_t base = (uint32_t)(Positions.size() / 3);
+            float corners[4][3] = { { x0, y0, z }, { x1, y0, z }, { x1, y1, z }, { x0, y1, z } };
+            for (auto& c : corners)
+                Positions.insert(Positions.end(), c, c + 3);
+            uint32_t quad[6] = { 0, 1, 2, 0, 2, 3 };
+            for (uint32_t i : quad)
+                Indices.push_back(base + i);
+        }
+
+        void Load(OcclusionCuller& culler, uint32_t maxTriangles) const
+        {
+            culler.SetOccluderMesh(Positions.data(), 3 * sizeof(float), Indices.data(), Indices.size(), maxTriangles);
+        }
+    };
+
+    // Точка точно видна: перед ней нет треугольника ближе, и до ребра любого
+    // треугольника на экране не меньше полутора пикселей (иначе всё решает
+    // покрытие центра пикселя, и результат не определён)
+    bool IsPointClearlyVisible(const Scene& scene, const float p[3])
+    {
+        if (p[2] < Near * 2.0f)
+            return false;
+
+        float px, py, pz;
+        Project(p, px, py, pz);
+        if (px < 0.0f || py < 0.0f || px >= OcclusionCuller::Width || py >= OcclusionCuller::Height)
+            return false;
+
+        for (size_t t = 0; t < scene.Indices.size(); t += 3)
+        {
+            float x[3], y[3], z[3];
+            for (int k = 0; k < 3; k++)
+                Project(&scene.Positions[scene.Indices[t + k] * 3], x[k], y[k], z[k]);
+
+            float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+            float sign = area < 0.0f ? -1.0f : 1.0f;
+
+            bool farOutside = false;
+            float bary[3];
+            for (int k = 0; k < 3; k++)
+            {
+                int a = (k + 1) % 3, b = (k + 2) % 3;
+                float edge = sign * ((x[b] - x[a]) * (py - y[a]) - (y[b] - y[a]) * (px - x[a]));
+                float length = std::sqrt((x[b] - x[a]) * (x[b] - x[a]) + (y[b] - y[a]) * (y[b] - y[a]));
+                if (edge < -1.5f * length)
+                    farOutside = true;
+                bary[k] = edge / std::fabs(area);
+            }
+            if (farOutside)
+                continue;
+
+            // Точка над треугольником или у его края: видна, только если он дальше
+            float depth = bary[0] * z[0] + bary[1] * z[1] + bary[2] * z[2];
+            if (depth <= pz + 1e-3f)
+                return false;
+        }
+        return true;
+    }
+
+    // Сетка точек на гранях бокса
+    bool IsBoxClearlyVisible(const Scene& scene, const Aabb& box)
+    {
+        const int Steps = 6;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int u = (axis + 1) % 3, v = (axis + 2) % 3;
+            for (int side = 0; side < 2; side++)
+            {
+                for (int i = 0; i <= Steps; i++)
+                {
+                    for (int j = 0; j <= Steps; j++)
+                    {
+                        float p[3];
+                        p[axis] = side ? box.Max[axis] : box.Min[axis];
+                        p[u] = box.Min[u] + (box.Max[u] - box.Min[u]) * i / Steps;
+                        p[v] = box.Min[v] + (box.Max[v] - box.Min[v]) * j / Steps;
+                        if (IsPointClearlyVisible(scene, p))
+                            return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+}
+
+static void TestWall()
+{
+    JobSystem jobs(0);
+    OcclusionCuller culler(jobs, 1e9);
+
+    Scene scene;
+    scene.AddWall(-5.0f, -3.0f, 5.0f, 3.0f, 10.0f);
+    scene.Load(culler, 16);
+
+    float viewProj[4][4];
+    MakeViewProj(viewProj);
+    culler.Render(viewProj);
+    CHECK(culler.Stats().OccluderTriangles == 2);
+
+    // За стеной
+    CHECK(!culler.IsVisible(MakeBox(-2.0f, -1.0f, 15.0f, 2.0f, 1.0f, 17.0f)));
+    CHECK(!culler.IsVisible(MakeBox(-8.0f, -4.0f, 30.0f, 8.0f, 4.0f, 40.0f)));
+    // Вплотную за стеной (зазор больше DepthBias)
+    CHECK(!culler.IsVisible(MakeBox(-1.0f, -1.0f, 10.5f, 1.0f, 1.0f, 11.0f)));
+
+    // Перед стеной и пересекающий её
+    CHECK(culler.IsVisible(MakeBox(-2.0f, -1.0f, 5.0f, 2.0f, 1.0f, 6.0f)));
+    CHECK(culler.IsVisible(MakeBox(-1.0f, -1.0f, 9.0f, 1.0f, 1.0f, 11.0f)));
+
+    // Выступает за край стены (сбоку и сверху) на много пикселей
+    CHECK(culler.IsVisible(MakeBox(3.0f, -1.0f, 15.0f, 9.0f, 1.0f, 16.0f)));
+    CHECK(culler.IsVisible(MakeBox(-1.0f, 2.0f, 15.0f, 1.0f, 6.0f, 16.0f)));
+    // Целиком сбоку от стены
+    CHECK(culler.IsVisible(MakeBox(12.0f, -1.0f, 15.0f, 14.0f, 1.0f, 16.0f)));
+
+    // Пересекает ближнюю плоскость, лежит между камерой и ближней плоскостью, за камерой
+    CHECK(culler.IsVisible(MakeBox(-1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 3.0f)));
+    CHECK(culler.IsVisible(MakeBox(-0.01f, -0.01f, 0.02f, 0.01f, 0.01f, 0.05f)));
+    CHECK(culler.IsVisible(MakeBox(-1.0f, -1.0f, -5.0f, 1.0f, 1.0f, -3.0f)));
+    // Вне экрана и пустой
+    CHECK(culler.IsVisible(MakeBox(100.0f, -1.0f, 15.0f, 101.0f, 1.0f, 16.0f)));
+    CHECK(culler.IsVisible(Aabb()));
+
+    CHECK(culler.Stats().Tested == 13);
+    CHECK(culler.Stats().Occluded == 3);
+    culler.ResetStats();
+    CHECK(culler.Stats().Tested == 0 && culler.Stats().Occluded == 0);
+}
+
+// Стена, пересекающая ближнюю плоскость, не окклюдер; лимит оставляет крупнейшие треугольники
+static void TestOccluderSelection()
+{
+    JobSystem jobs(0);
+    float viewProj[4][4];
+    MakeViewProj(viewProj);
+    Aabb hidden = MakeBox(-2.0f, -1.0f, 15.0f, 2.0f, 1.0f, 17.0f);
+
+    {
+        OcclusionCuller culler(jobs, 1e9);
+        Scene scene;
+        scene.AddWall(-5.0f, -3.0f, 5.0f, 3.0f, 10.0f);
+        for (auto& p : scene.Positions)
+            if (p == 10.0f)
+                p = -1.0f;
+        scene.Positions[2] = 10.0f;
+        scene.Load(culler, 16);
+        culler.Render(viewProj);
+        CHECK(culler.IsVisible(hidden));
+    }
+
+    {
+        OcclusionCuller culler(jobs, 1e9);
+        Scene scene;
+        for (int i = 0; i < 20; i++)
+            scene.AddWall(20.0f + i, 0.0f, 20.1f + i, 0.1f, 10.0f);
+        scene.AddWall(-5.0f, -3.0f, 5.0f, 3.0f, 10.0f);
+        scene.Load(culler, 2);
+        culler.Render(viewProj);
+        CHECK(culler.Stats().OccluderTriangles == 2);
+        CHECK(!culler.IsVisible(hidden));
+    }
+}
+
+// Случайные стены и боксы: точно видимый бокс не отсекается, а результат
+// с полосами по 4 потокам совпадает с одной полосой
+static void TestRandomScenes()
+{
+    JobSystem single(0);
+    JobSystem multi(3);
+    float viewProj[4][4];
+    MakeViewProj(viewProj);
+
+    uint32_t occluded = 0, clearlyVisible = 0;
+    for (int sceneIndex = 0; sceneIndex < 40; sceneIndex++)
+    {
+        Scene scene;
+        int wallCount = 1 + NextRandom() % 6;
+        for (int w = 0; w < wallCount; w++)
+        {
+            float z = Random(3.0f, 40.0f);
+            float x = Random(-z, z), y = Random(-z * 0.5f, z * 0.5f);
+            float sx = Random(0.1f, 0.6f) * z, sy = Random(0.1f, 0.6f) * z;
+            scene.AddWall(x - sx, y - sy, x + sx, y + sy, z);
+        }
+
+        OcclusionCuller a(single, 1e9);
+        OcclusionCuller b(multi, 1e9);
+        scene.Load(a, 64);
+        scene.Load(b, 64);
+        a.Render(viewProj);
+        b.Render(viewProj);
+
+        for (int i = 0; i < 200; i++)
+        {
+            float z = Random(1.0f, 60.0f);
+            float cx = Random(-z, z), cy = Random(-z * 0.5f, z * 0.5f);
+            float size = Random(0.05f, 0.3f) * z;
+            Aabb box = MakeBox(cx - size, cy - size * 0.5f, z, cx + size, cy + size * 0.5f, z + size);
+
+            bool visible = a.IsVisible(box);
+            CHECK(visible == b.IsVisible(box));
+            if (!visible)
+                occluded++;
+            if (IsBoxClearlyVisible(scene, box))
+            {
+                clearlyVisible++;
+                CHECK(visible);
+            }
+        }
+    }
+
+    // Проверка не вырождена: есть и отсечённые, и точно видимые
+    CHECK(occluded > 100);
+    CHECK(clearlyVisible > 100);
+}
+
+int main()
+{
+    TestWall();
+    TestOccluderSelection();
+    TestRandomScenes();
+    std::printf("OcclusionCullerTest: OK\n");
+    return 0;
+}
@@ -0,0 +1,130 @@
+﻿#include "ParallelRecorder.h"
+#include "Check.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+static std::vector<size_t> Lengths(const std::vector<DrawSlice>& slices)
+{
+    std::vector<size_t> lengths;
+    for (const DrawSlice& s : slices)
+        lengths.push_back(s.Count());
+    return lengths;
+}
+
+// Крайние случаи и распределение остатка
+static void TestSplitEdgeCases()
+{
+    std::vector<DrawSlice> slices;
+
+    // Пустая очередь - один пустой кусок
+    SplitDraws(0, 8, 16, slices);
+    CHECK(slices.size() == 1 && slices[0].Begin == 0 && slices[0].End == 0);
+
+    // Меньше minPerSlice - один кусок на всё
+    SplitDraws(5, 8, 16, slices);
+    CHECK(slices.size() == 1 && slices[0].Begin == 0 && slices[0].End == 5);
+
+    // Ровно minPerSlice - тоже один
+    SplitDraws(16, 8, 16, slices);
+    CHECK(slices.size() == 1);
+
+    // 10 по минимум 3 в не более чем 4 куска: 3 куска, остаток - первому
+    SplitDraws(10, 4, 3, slices);
+    CHECK((Lengths(slices) == std::vector<size_t>{ 4, 3, 3 }));
+
+    // Упор в maxSlices: 103 на 4 - остаток 3 на первые три куска
+    SplitDraws(103, 4, 1, slices);
+    CHECK((Lengths(slices) == std::vector<size_t>{ 26, 26, 26, 25 }));
+
+    // minPerSlice = 0 считается единицей, maxSlices = 0 - одним куском
+    SplitDraws(3, 8, 0, slices);
+    CHECK((Lengths(slices) == std::vector<size_t>{ 1, 1, 1 }));
+    SplitDraws(3, 0, 1, slices);
+    CHECK((Lengths(slices) == std::vector<size_t>{ 3 }));
+}
+
+// Свойства на переборе: куски по порядку покрывают очередь, их не больше maxSlices,
+// каждый не короче minPerSlice (кроме единственного), длины отличаются не больше чем на 1
+static void TestSplitProperties()
+{
+    std::vector<DrawSlice> slices;
+    for (size_t count = 0; count < 300; count++)
+    {
+        for (uint32_t maxSlices = 1; maxSlices <= 16; maxSlices++)
+        {
+            for (size_t minPerSlice = 1; minPerSlice <= 40; minPerSlice += 3)
+            {
+                SplitDraws(count, maxSlices, minPerSlice, slices);
+                CHECK(!slices.empty() && slices.size() <= maxSlices);
+                CHECK(slices.front().Begin == 0 && slices.back().End == count);
+
+                for (size_t i = 0; i < slices.size(); i++)
+                {
+                    if (i > 0)
+                        CHECK(slices[i].Begin == slices[i - 1].End);
+                    if (slices.size() > 1)
+                        CHECK(slices[i].Count() >= minPerSlice);
+                    CHECK(slices[i].Count() <= slices[0].Count());
+                    CHECK(slices[i].Count() + 1 >= slices[0].Count());
+                    if (i > 0)
+                        CHECK(slices[i].Count() <= slices[i - 1].Count());
+                }
+
+                // Кусков столько, сколько позволяет минимум
+                CHECK(slices.size() == (std::min)((std::max)(count / minPerSlice, size_t(1)), size_t(maxSlices)));
+            }
+        }
+    }
+}
+
+// Заглушка записи: каждый кусок пишет индексы своих отрисовок в свой "командный
+// список"; списки в порядке кусков дают исходный порядок
+static void TestRecordOrder()
+{
+    JobSystem jobs(3);
+    ParallelRecorder recorder(jobs);
+    CHECK(recorder.MaxSlices() == 4);
+
+    for (size_t count : { size_t(0), size_t(7), size_t(1000), size_t(12345) })
+    {
+        std::vector<DrawSlice> slices;
+        SplitDraws(count, recorder.MaxSlices() * 2, 8, slices);
+
+        std::vector<std::vector<size_t>> lists(slices.size());
+        std::vector<std::atomic<int>> calls(slices.size());
+
+        recorder.Record(slices, [&](uint32_t slice, const DrawSlice& range)
+        {
+            calls[slice]++;
+            CHECK(range.Begin == slices[slice].Begin && range.End == slices[slice].End);
+            for (size_t draw = range.Begin; draw < range.End; draw++)
+                lists[slice].push_back(draw);
+        });
+
+        std::vector<size_t> submitted;
+        for (size_t slice = 0; slice < slices.size(); slice++)
+        {
+            CHECK(calls[slice] == 1);
+            submitted.insert(submitted.end(), lists[slice].begin(), lists[slice].end());
+        }
+
+        CHECK(submitted.size() == count);
+        for (size_t i = 0; i < submitted.size(); i++)
+            CHECK(submitted[i] == i);
+    }
+
+    // Пустой список кусков - запись ничего не вызывает
+    bool called = false;
+    recorder.Record({}, [&](uint32_t, const DrawSlice&) { called = true; });
+    CHECK(!called);
+}
+
+int main()
+{
+    TestSplitEdgeCases();
+    TestSplitProperties();
+    TestRecordOrder();
+    std::printf("ParallelRecorderTest: OK\n");
+    return 0;
+}
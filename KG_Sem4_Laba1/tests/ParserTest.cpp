@@ -0,0 +1,135 @@
+﻿#include "Parser.h"
+#include "Check.h"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace
+{
+    std::string WriteTemp(const std::string& name, const std::string& text)
+    {
+        std::string path = (std::filesystem::temp_directory_path() / name).string();
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << text;
+        return path;
+    }
+
+    bool Near(float a, float b)
+    {
+        return std::fabs(a - b) < 1e-5f;
+    }
+
+    bool Near(const ObjFloat3& v, float x, float y, float z)
+    {
+        return Near(v.x, x) && Near(v.y, y) && Near(v.z, z);
+    }
+}
+
+// Форматы граней, триангуляция веером, разбиение по usemtl, масштаб и центрирование
+static void TestLoadObj()
+{
+    std::string path = WriteTemp("ParserTest.obj",
+        "# комментарий\n"
+        "mtllib ParserTest.mtl\n"
+        "v 0 0 0\n"
+        "v 100 0 0\n"
+        "v 100 100 0\n"
+        "v 0 100 0\n"
+        "v 0 0 200\n"
+        "vt 0.25 0.5\n"
+        "vt 1 0\n"
+        "vt 1 1\n"
+        "vn 0 0 1\n"
+        "vn 1 0 0\n"
+        "usemtl wall  \n"
+        "f 1/1/1 2/2/1 3/3/2 4/2/1\n"
+        "usemtl floor\n"
+        "f 1//2 2//2 5//2\n"
+        "f 3/2 4/3 5/1\n"
+        "f 1 2 3\n");
+
+    std::vector<ObjVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Submesh> submeshes;
+    CHECK(LoadOBJ(path, vertices, indices, submeshes));
+
+    // Четырёхугольник - два треугольника, остальные по одному
+    CHECK(vertices.size() == 15 && indices.size() == 15);
+    for (uint32_t i = 0; i < indices.size(); i++)
+        CHECK(indices[i] == i);
+
+    CHECK(submeshes.size() == 2);
+    CHECK(submeshes[0].MaterialName == "wall" && submeshes[0].IndexStart == 0 && submeshes[0].IndexCount == 6);
+    CHECK(submeshes[1].MaterialName == "floor" && submeshes[1].IndexStart == 6 && submeshes[1].IndexCount == 9);
+
+    // Бокс (0..1, 0..1, 0..2) после масштаба 0.01, центр - (0.5, 0.5, 1)
+    CHECK(Near(vertices[0].position, -0.5f, -0.5f, -1.0f));
+    CHECK(Near(vertices[2].position, 0.5f, 0.5f, -1.0f));
+    CHECK(Near(vertices[5].position, -0.5f, 0.5f, -1.0f));
+    CHECK(Near(vertices[8].position, -0.5f, -0.5f, 1.0f));
+
+    // Веер: (1, 2, 3), (1, 3, 4)
+    CHECK(Near(vertices[3].position, vertices[0].position.x, vertices[0].position.y, vertices[0].position.z));
+    CHECK(Near(vertices[4].position, vertices[2].position.x, vertices[2].position.y, vertices[2].position.z));
+
+    // v/vt/vn
+    CHECK(Near(vertices[0].texcoord.x, 0.25f) && Near(vertices[0].texcoord.y, 0.5f));
+    CHECK(Near(vertices[2].normal, 1.0f, 0.0f, 0.0f));
+
+    // v//vn - первая текстурная координата, v/vt - первая нормаль, v - обе первые
+    CHECK(Near(vertices[6].texcoord.x, 0.25f) && Near(vertices[6].normal, 1.0f, 0.0f, 0.0f));
+    CHECK(Near(vertices[9].texcoord.x, 1.0f) && Near(vertices[9].normal, 0.0f, 0.0f, 1.0f));
+    CHECK(Near(vertices[12].texcoord.y, 0.5f) && Near(vertices[12].normal, 0.0f, 0.0f, 1.0f));
+
+    std::filesystem::remove(path);
+
+    // Нет файла или нет ни одной грани
+    CHECK(!LoadOBJ(path, vertices, indices, submeshes));
+    path = WriteTemp("ParserTest.obj", "v 0 0 0\n");
+    CHECK(!LoadOBJ(path, vertices, indices, submeshes));
+    std::filesystem::remove(path);
+}
+
+static void TestLoadMtl()
+{
+    std::string path = WriteTemp("ParserTest.mtl",
+        "# Sponza\n"
+        "Kd 0 0 0\n"
+        "newmtl wall\n"
+        "\tKd 0.5 0.25 1 # цвет\n"
+        "\tmap_Kd textures/wall.tga\n"
+        "\tmap_d textures/wall_mask.tga  \n"
+        "\n"
+        "newmtl floor  \n"
+        "    map_Kd2 textures/floor2.tga   \n"
+        "newmtl empty\n");
+
+    std::vector<ParsedMaterial> materials;
+    CHECK(LoadMTL(path, materials));
+    CHECK(materials.size() == 3);
+
+    CHECK(materials[0].Name == "wall");
+    CHECK(materials[0].DiffuseMap == "textures/wall.tga");
+    CHECK(materials[0].AlphaMap == "textures/wall_mask.tga");
+    CHECK(materials[0].DiffuseMap2.empty());
+    CHECK(Near(materials[0].Kd, 0.5f, 0.25f, 1.0f));
+
+    CHECK(materials[1].Name == "floor");
+    CHECK(materials[1].DiffuseMap.empty() && materials[1].DiffuseMap2 == "textures/floor2.tga");
+    CHECK(Near(materials[1].Kd, 1.0f, 1.0f, 1.0f));
+
+    CHECK(materials[2].Name == "empty");
+    std::filesystem::remove(path);
+
+    materials.clear();
+    CHECK(!LoadMTL(path, materials));
+}
+
+int main()
+{
+    TestLoadObj();
+    TestLoadMtl();
+    std::printf("ParserTest: OK\n");
+    return 0;
+}
@@ -0,0 +1,299 @@
+﻿#include "PotentiallyVisibleSet.h"
+#include "Check.h"
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace
+{
+    // Три комнаты вдоль x, 6 x 3 x 6: A и B разделены стеной с проёмом,
+    // B и C - сплошной стеной. Каждая стена, пол и предмет - отдельная отрисовка-бокс
+    struct Scene
+    {
+        std::vector<float> Positions;
+        std::vector<uint32_t> Indices;
+        std::vector<PvsDraw> Draws;
+        TriangleBvh Bvh;
+        Aabb Bounds;
+
+        uint32_t AddBox(float x0, float y0, float z0, float x1, float y1, float z1)
+        {
+            uint32_t base = (uint32_t)(Positions.size() / 3);
+            PvsDraw draw;
+            draw.FirstTriangle = (uint32_t)(Indices.size() / 3);
+            draw.TriangleCount = 12;
+            for (int corner = 0; corner < 8; corner++)
+            {
+                float p[3] = { (corner & 1) ? x1 : x0, (corner & 2) ? y1 : y0, (corner & 4) ? z1 : z0 };
+                Positions.insert(Positions.end(), p, p + 3);
+                draw.Bounds.Extend(p[0], p[1], p[2]);
+            }
+
+            const uint32_t faces[6][4] = {
+                { 0, 2, 6, 4 }, { 1, 5, 7, 3 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 1, 3, 2 }, { 4, 6, 7, 5 } };
+            for (const auto& f : faces)
+            {
+                uint32_t quad[6] = { f[0], f[1], f[2], f[0], f[2], f[3] };
+                for (uint32_t i : quad)
+                    Indices.push_back(base + i);
+            }
+
+            Draws.push_back(draw);
+            return (uint32_t)Draws.size() - 1;
+        }
+
+        uint32_t DoorwayTarget = 0;     // В B напротив проёма
+        uint32_t HiddenTarget = 0;      // В C за сплошной стеной
+
+        Scene()
+        {
+            const float T = 0.1f;   // Полутолщина стен
+            AddBox(-T, -2 * T, -T, 18 + T, 0, 6 + T);       // пол
+            AddBox(-T, 3, -T, 18 + T, 3 + 2 * T, 6 + T);    // потолок
+            AddBox(-2 * T, 0, -T, 0, 3, 6 + T);             // наружные стены
+            AddBox(18, 0, -T, 18 + 2 * T, 3, 6 + T);
+            AddBox(-T, 0, -2 * T, 18 + T, 3, 0);
+            AddBox(-T, 0, 6, 18 + T, 3, 6 + 2 * T);
+
+            // A | B: проём z 2..4 высотой 2
+            AddBox(6 - T, 0, 0, 6 + T, 3, 2);
+            AddBox(6 - T, 0, 4, 6 + T, 3, 6);
+            AddBox(6 - T, 2, 2, 6 + T, 3, 4);
+            // B | C: сплошная
+            AddBox(12 - T, 0, 0, 12 + T, 3, 6);
+
+            DoorwayTarget = AddBox(8, 0, 2.5f, 10, 1, 3.5f);
+            HiddenTarget = AddBox(14, 0, 2, 16, 1, 4);
+
+            Bvh.Build(Positions.data(), 3 * sizeof(float), Indices.data(), Indices.size(), nullptr);
+            Bounds.Extend(0, 0, 0);
+            Bounds.Extend(18, 3, 6);
+        }
+    };
+
+    bool HasBit(const uint64_t* row, uint32_t draw)
+    {
+        return (row[draw / 64] >> (draw % 64)) & 1;
+    }
+
+    void CellCenter(uint32_t x, uint32_t y, uint32_t z, float out[3])
+    {
+        out[0] = x + 0.5f;
+        out[1] = y + 0.5f;
+        out[2] = z + 0.5f;
+    }
+
+    std::vector<uint8_t> ReadBytes(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    void WriteBytes(const std::filesystem::path& path, const std::vector<uint8_t>& bytes)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(bytes.data()), (std::streamsize)bytes.size());
+    }
+}
+
+// Из A видна цель в B через проём, но не цель в C за сплошной стеной
+static void TestWallAndDoorway(const Scene& scene, JobSystem& jobs)
+{
+    PvsBakeDesc desc;
+    desc.CellSize = 1.0f;
+    desc.MergeSlack = 0.0f;
+    PotentiallyVisibleSet pvs;
+    pvs.Bake(scene.Bvh, scene.Draws, scene.Bounds, desc, jobs);
+
+    CHECK(pvs.DrawCount() == scene.Draws.size());
+    CHECK(pvs.Stats().Cells == 18 * 3 * 6);
+    CHECK(pvs.Stats().WalkableCells == pvs.Stats().Cells);
+    CHECK(pvs.Stats().Rays >= (uint64_t)pvs.Stats().Cells * desc.RaysPerCell);
+
+    // Из A и из B (кроме соседей стены B | C, их строки расширены строками C)
+    // цели в C не видно
+    for (uint32_t z = 0; z < 6; z++)
+        for (uint32_t y = 0; y < 3; y++)
+            for (uint32_t x = 0; x < 10; x++)
+            {
+                float p[3];
+                CellCenter(x, y, z, p);
+                const uint64_t* row = pvs.VisibleSet(p);
+                CHECK(row != nullptr);
+                CHECK(!HasBit(row, scene.HiddenTarget));
+            }
+
+    // Напротив проёма цель в B видна, из самой C - видна цель в C
+    for (uint32_t x = 0; x < 5; x++)
+    {
+        float p[3];
+        CellCenter(x, 0, 3, p);
+        CHECK(HasBit(pvs.VisibleSet(p), scene.DoorwayTarget));
+        CellCenter(x + 12, 0, 3, p);
+        CHECK(HasBit(pvs.VisibleSet(p), scene.HiddenTarget));
+    }
+
+    // Пол и потолок видны отовсюду
+    float p[3];
+    CellCenter(2, 1, 1, p);
+    CHECK(HasBit(pvs.VisibleSet(p), 0) && HasBit(pvs.VisibleSet(p), 1));
+}
+
+// Слияние строк только добавляет биты: каждая ячейка видит не меньше,
+// чем без слияния, и не больше чем на MergeSlack отрисовок
+static void TestConservativeMerge(const Scene& scene, JobSystem& jobs)
+{
+    PvsBakeDesc desc;
+    desc.CellSize = 1.0f;
+    desc.RaysPerCell = 512;
+
+    PotentiallyVisibleSet exact;
+    desc.MergeSlack = 0.0f;
+    exact.Bake(scene.Bvh, scene.Draws, scene.Bounds, desc, jobs);
+
+    PotentiallyVisibleSet merged;
+    desc.MergeSlack = 0.25f;
+    merged.Bake(scene.Bvh, scene.Draws, scene.Bounds, desc, jobs);
+    uint32_t maxExtra = (uint32_t)(desc.MergeSlack * scene.Draws.size());
+
+    CHECK(merged.Stats().UniqueRows < exact.Stats().UniqueRows);
+    CHECK(merged.Stats().StoredBytes < exact.Stats().StoredBytes);
+    CHECK(merged.Stats().AverageVisible >= exact.Stats().AverageVisible);
+
+    uint32_t words = (exact.DrawCount() + 63) / 64;
+    uint32_t widened = 0;
+    for (uint32_t z = 0; z < 6; z++)
+        for (uint32_t y = 0; y < 3; y++)
+            for (uint32_t x = 0; x < 18; x++)
+            {
+                float p[3];
+                CellCenter(x, y, z, p);
+                const uint64_t* own = exact.VisibleSet(p);
+                const uint64_t* row = merged.VisibleSet(p);
+                uint32_t ownCount = 0, rowCount = 0;
+                for (uint32_t w = 0; w < words; w++)
+                {
+                    CHECK((own[w] & ~row[w]) == 0);
+                    ownCount += (uint32_t)std::popcount(own[w]);
+                    rowCount += (uint32_t)std::popcount(row[w]);
+                }
+                CHECK(rowCount <= ownCount + maxExtra);
+                widened += rowCount > ownCount ? 1 : 0;
+            }
+    CHECK(widened > 0);
+
+    // Запекание не зависит от числа потоков
+    JobSystem single(0);
+    PotentiallyVisibleSet again;
+    again.Bake(scene.Bvh, scene.Draws, scene.Bounds, desc, single);
+    CHECK(again.Stats().UniqueRows == merged.Stats().UniqueRows);
+    for (uint32_t x = 0; x < 18; x++)
+    {
+        float p[3];
+        CellCenter(x, 1, 2, p);
+        CHECK(memcmp(again.VisibleSet(p), merged.VisibleSet(p), words * sizeof(uint64_t)) == 0);
+    }
+}
+
+// Save и Load дают те же строки; чужой ключ, битый или обрезанный файл не грузится
+static void TestSaveLoad(const Scene& scene, JobSystem& jobs)
+{
+    PvsBakeDesc desc;
+    desc.CellSize = 1.0f;
+    desc.RaysPerCell = 256;
+    PotentiallyVisibleSet pvs;
+    pvs.Bake(scene.Bvh, scene.Draws, scene.Bounds, desc, jobs);
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "PotentiallyVisibleSetTest";
+    std::filesystem::create_directories(dir);
+    std::string path = (dir / "scene.pvs").string();
+    CHECK(pvs.Save(path, 7));
+
+    PotentiallyVisibleSet loaded;
+    CHECK(loaded.IsEmpty());
+    CHECK(!loaded.Load(path, 8));
+    CHECK(loaded.IsEmpty());
+    CHECK(loaded.Load(path, 7));
+    CHECK(loaded.DrawCount() == pvs.DrawCount());
+    CHECK(loaded.Stats().UniqueRows == pvs.Stats().UniqueRows);
+    CHECK(loaded.Stats().StoredBytes == pvs.Stats().StoredBytes);
+    CHECK(loaded.Stats().AverageVisible == pvs.Stats().AverageVisible);
+
+    uint32_t words = (pvs.DrawCount() + 63) / 64;
+    for (uint32_t z = 0; z < 6; z++)
+        for (uint32_t y = 0; y < 3; y++)
+            for (uint32_t x = 0; x < 18; x++)
+            {
+                float p[3];
+                CellCenter(x, y, z, p);
+                CHECK(memcmp(loaded.VisibleSet(p), pvs.VisibleSet(p), words * sizeof(uint64_t)) == 0);
+            }
+
+    // Перевёрнутый байт в заголовке (каждый) или в таблице ячеек и строках
+    std::vector<uint8_t> bytes = ReadBytes(path);
+    for (size_t i = 0; i < bytes.size(); i += i < 64 ? 1 : 61)
+    {
+        std::vector<uint8_t> broken = bytes;
+        broken[i] ^= 0x10;
+        WriteBytes(path, broken);
+        PotentiallyVisibleSet other;
+        CHECK(!other.Load(path, 7));
+        CHECK(other.IsEmpty());
+    }
+    bytes.pop_back();
+    WriteBytes(path, bytes);
+    CHECK(!loaded.Load(path, 7));
+    CHECK(!loaded.Load((dir / "missing.pvs").string(), 7));
+
+    // Неудачная загрузка не портит загруженное раньше
+    float p[3];
+    CellCenter(3, 1, 3, p);
+    CHECK(memcmp(loaded.VisibleSet(p), pvs.VisibleSet(p), words * sizeof(uint64_t)) == 0);
+
+    std::filesystem::remove_all(dir);
+}
+
+// Вне сетки и в непроходимых ячейках - nullptr (видимо всё)
+static void TestOutsideGrid(const Scene& scene, JobSystem& jobs)
+{
+    PotentiallyVisibleSet pvs;
+    float p[3] = { 1.0f, 1.0f, 1.0f };
+    CHECK(pvs.VisibleSet(p) == nullptr);
+
+    // Бокс запекания шире сцены: за наружной стеной x = 18 пола нет,
+    // ячейки там непроходимы
+    Aabb bounds = scene.Bounds;
+    bounds.Extend(20.0f, 3.0f, 6.0f);
+    PvsBakeDesc desc;
+    desc.CellSize = 1.0f;
+    desc.RaysPerCell = 64;
+    pvs.Bake(scene.Bvh, scene.Draws, bounds, desc, jobs);
+    CHECK(pvs.Stats().Cells == 20 * 3 * 6);
+    CHECK(pvs.Stats().WalkableCells < pvs.Stats().Cells);
+
+    CHECK(pvs.VisibleSet(p) != nullptr);
+    float outside[][3] = {
+        { -0.01f, 1.0f, 1.0f }, { 1.0f, -0.01f, 1.0f }, { 1.0f, 1.0f, -0.01f },
+        { 20.0f, 1.0f, 1.0f }, { 1.0f, 3.0f, 1.0f }, { 1.0f, 1.0f, 6.0f },
+        { 1e30f, 1.0f, 1.0f }, { NAN, 1.0f, 1.0f },
+        { 19.5f, 1.0f, 1.0f },  // За стеной x = 18, пола нет
+    };
+    for (const auto& q : outside)
+        CHECK(pvs.VisibleSet(q) == nullptr);
+}
+
+int main()
+{
+    Scene scene;
+    JobSystem jobs(3);
+
+    TestWallAndDoorway(scene, jobs);
+    TestConservativeMerge(scene, jobs);
+    TestSaveLoad(scene, jobs);
+    TestOutsideGrid(scene, jobs);
+    std::printf("PotentiallyVisibleSetTest: OK\n");
+    return 0;
+}
@@ -0,0 +1,153 @@
+﻿#include "RenderQueue.h"
+#include "Check.h"
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    uint32_t gRandom = 1;
+
+    uint32_t NextRandom()
+    {
+        gRandom = gRandom * 1664525u + 1013904223u;
+        return gRandom;
+    }
+
+    uint64_t NextRandom64()
+    {
+        return (uint64_t(NextRandom()) << 32) | NextRandom();
+    }
+
+    // Очередь из keys, DrawIndex - порядок Add; сравнение с std::stable_sort по ключу
+    uint32_t SortAndCompare(const std::vector<uint64_t>& keys)
+    {
+        RenderQueue queue;
+        std::vector<RenderItem> expected;
+        for (uint32_t i = 0; i < keys.size(); i++)
+        {
+            queue.Add(keys[i], i, i * 3, i % 5);
+            expected.push_back({ keys[i], i, i * 3, i % 5 });
+        }
+
+        queue.Sort();
+        std::stable_sort(expected.begin(), expected.end(), [](const RenderItem& a, const RenderItem& b)
+        {
+            return a.Key < b.Key;
+        });
+
+        const std::vector<RenderItem>& items = queue.Items();
+        CHECK(items.size() == expected.size());
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            CHECK(items[i].Key == expected[i].Key);
+            CHECK(items[i].DrawIndex == expected[i].DrawIndex);
+            CHECK(items[i].FirstInstance == expected[i].FirstInstance);
+            CHECK(items[i].InstanceCount == expected[i].InstanceCount);
+        }
+        return queue.LastSortPasses();
+    }
+
+    // Ключи как у кадра: немного проходов и PSO, материалы и глубины с повторами
+    std::vector<uint64_t> FrameKeys(size_t count)
+    {
+        std::vector<uint64_t> keys(count);
+        for (uint64_t& key : keys)
+        {
+            key = MakeDrawKey(NextRandom() % 3, NextRandom() % 12, NextRandom() % 40,
+                float(NextRandom() % 64) / 63.0f);
+        }
+        return keys;
+    }
+}
+
+// 511 - ещё std::stable_sort, 512 и 100K - поразрядная
+static void TestMatchesStableSort()
+{
+    for (size_t count : { size_t(0), size_t(1), size_t(2), size_t(511), size_t(512), size_t(100000) })
+    {
+        uint32_t passes = SortAndCompare(FrameKeys(count));
+        CHECK(count >= 512 ? passes > 0 : passes == 0);
+
+        std::vector<uint64_t> keys(count);
+        for (uint64_t& key : keys)
+            key = NextRandom64();
+        SortAndCompare(keys);
+    }
+
+    // Много одинаковых ключей: устойчивость держит порядок Add
+    std::vector<uint64_t> keys(100000);
+    for (uint64_t& key : keys)
+        key = NextRandom() % 4;
+    CHECK(SortAndCompare(keys) == 1);
+}
+
+// Одинаковые у всех байты пропускаются; нечётное число проходов оставляет
+// результат в запасном массиве - он должен вернуться в очередь
+static void TestByteSkip()
+{
+    // Меняются первые varying байтов списка - постоянные остаются между ними
+    const uint32_t Bytes[8] = { 1, 3, 5, 7, 0, 2, 4, 6 };
+    for (uint32_t varying : { 1u, 2u, 3u, 5u, 8u })
+    {
+        std::vector<uint64_t> keys(2000);
+        for (uint64_t& key : keys)
+        {
+            key = 0x5A5A5A5A5A5A5A5Aull;
+            for (uint32_t b = 0; b < varying; b++)
+            {
+                key &= ~(0xFFull << (Bytes[b] * 8));
+                key |= uint64_t(NextRandom() % 7) << (Bytes[b] * 8);
+            }
+        }
+        CHECK(SortAndCompare(keys) == varying);
+    }
+
+    // Все ключи равны - ни одного прохода, порядок прежний
+    std::vector<uint64_t> same(1000, 42);
+    CHECK(SortAndCompare(same) == 0);
+
+    // Повторная сортировка уже отсортированной очереди ничего не меняет
+    RenderQueue queue;
+    for (uint64_t key : FrameKeys(3000))
+        queue.Add(key, 0);
+    queue.Sort();
+    std::vector<RenderItem> first = queue.Items();
+    queue.Sort();
+    for (size_t i = 0; i < first.size(); i++)
+        CHECK(queue.Items()[i].Key == first[i].Key);
+}
+
+static void TestDrawKey()
+{
+    uint64_t key = MakeDrawKey(3, 200, 40000, 0.5f);
+    CHECK(DrawKeyPass(key) == 3);
+    CHECK(DrawKeyPso(key) == 200);
+    CHECK(DrawKeyMaterial(key) == 40000);
+    CHECK(((key >> DrawKeyDepthShift) & ((1u << DrawKeyDepthBits) - 1)) == uint32_t(0.5f * ((1u << DrawKeyDepthBits) - 1)));
+    CHECK((key & ((1u << DrawKeyDepthShift) - 1)) == 0);
+    CHECK(DrawKeyPassShift + DrawKeyPassBits == 64);
+
+    // Поля обрезаются по своей ширине и не задевают соседние
+    uint64_t wide = MakeDrawKey(0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu, 1.0f);
+    CHECK(wide == ~((1ull << DrawKeyDepthShift) - 1));
+    CHECK(MakeDrawKey(16 + 2, 256 + 7, 65536 + 9, 0.0f) == MakeDrawKey(2, 7, 9, 0.0f));
+
+    // Глубина за пределами 0..1 обрезается
+    CHECK(MakeDrawKey(1, 1, 1, -5.0f) == MakeDrawKey(1, 1, 1, 0.0f));
+    CHECK(MakeDrawKey(1, 1, 1, 7.0f) == MakeDrawKey(1, 1, 1, 1.0f));
+
+    // Старшие поля важнее: проход, затем PSO, материал и ближние раньше дальних
+    CHECK(MakeDrawKey(0, 255, 65535, 1.0f) < MakeDrawKey(1, 0, 0, 0.0f));
+    CHECK(MakeDrawKey(1, 4, 65535, 1.0f) < MakeDrawKey(1, 5, 0, 0.0f));
+    CHECK(MakeDrawKey(1, 4, 9, 1.0f) < MakeDrawKey(1, 4, 10, 0.0f));
+    CHECK(MakeDrawKey(1, 4, 9, 0.25f) < MakeDrawKey(1, 4, 9, 0.26f));
+}
+
+int main()
+{
+    TestMatchesStableSort();
+    TestByteSkip();
+    TestDrawKey();
+    std::printf("RenderQueueTest: OK\n");
+    return 0;
+}
@@ -0,0 +1,483 @@
+﻿#include "SectorStreamer.h"
+#include "Check.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    // Позиция и UV, как у меша сцены - сабмеш не обязан начинаться с позиции
+    struct TestVertex
+    {
+        float Position[3];
+        float Uv[2];
+    };
+
+    const uint32_t Tiles = 8;       // Плиток 100x100 по стороне, сектор - 2x2 плитки
+    const float TileSize = 100.0f;
+    const float Still[3] = { 0.0f, 0.0f, 0.0f };
+
+    std::filesystem::path TestDirectory()
+    {
+        return std::filesystem::temp_directory_path() / "SectorStreamerTest";
+    }
+
+    std::vector<uint8_t> ReadBytes(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    void WriteBytes(const std::filesystem::path& path, const std::vector<uint8_t>& bytes)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(bytes.data()), (std::streamsize)bytes.size());
+    }
+
+    std::filesystem::path SectorFile(uint64_t key, uint32_t sector)
+    {
+        return TestDirectory() / (std::to_string(key) + "." + std::to_string(sector) + ".sector");
+    }
+
+    // Пол из плиток по два треугольника; сабмеши чередуют плитки, чтобы
+    // каждый распался на куски по секторам
+    struct World
+    {
+        std::vector<TestVertex> Vertices;
+        std::vector<uint32_t> Indices;
+        std::vector<Submesh> Submeshes;
+
+        World()
+        {
+            std::vector<uint32_t> tiles[2];
+            for (uint32_t z = 0; z < Tiles; z++)
+            {
+                for (uint32_t x = 0; x < Tiles; x++)
+                {
+                    uint32_t base = (uint32_t)Vertices.size();
+                    for (uint32_t k = 0; k < 4; k++)
+                    {
+                        TestVertex v;
+                        v.Position[0] = (x + (k & 1)) * TileSize;
+                        v.Position[1] = 0.0f;
+                        v.Position[2] = (z + (k >> 1)) * TileSize;
+                        v.Uv[0] = float(x * 2 + (k & 1));
+                        v.Uv[1] = float(z * 2 + (k >> 1));
+                        Vertices.push_back(v);
+                    }
+                    uint32_t quad[6] = { base, base + 2, base + 1, base + 1, base + 2, base + 3 };
+                    tiles[(x + z) % 2].insert(tiles[(x + z) % 2].end(), quad, quad + 6);
+                }
+            }
+
+            for (int m = 0; m < 2; m++)
+            {
+                Submesh sm;
+                sm.IndexStart = (uint32_t)Indices.size();
+                sm.IndexCount = (uint32_t)tiles[m].size();
+                sm.MaterialIndex = m;
+                Indices.insert(Indices.end(), tiles[m].begin(), tiles[m].end());
+                Submeshes.push_back(sm);
+            }
+        }
+
+        // Partition, границы кусков (их считает вызывающий) и Build
+        bool Stream(SectorStreamer& streamer, uint64_t key)
+        {
+            SectorGridDesc grid;
+            grid.SectorsPerAxis = 4;
+            streamer.Partition(Vertices[0].Position, sizeof(TestVertex), Indices, Submeshes, grid);
+            for (Submesh& sm : Submeshes)
+            {
+                for (uint32_t i = sm.IndexStart; i < sm.IndexStart + sm.IndexCount; i++)
+                {
+                    const float* p = Vertices[Indices[i]].Position;
+                    sm.Bounds.Extend(p[0], p[1], p[2]);
+                }
+            }
+            std::filesystem::create_directories(TestDirectory());
+            return streamer.Build(
+                reinterpret_cast<const uint8_t*>(Vertices.data()), sizeof(TestVertex), Indices, Submeshes,
+                TestDirectory().string(), key);
+        }
+    };
+
+    // Update, пока поток не дочитает всё запрошенное; выданное и выгруженное
+    // отражается в resident
+    void Settle(SectorStreamer& streamer, const float eye[3], const float velocity[3], std::set<uint32_t>& resident)
+    {
+        for (int i = 0; i < 5000; i++)
+        {
+            streamer.Update(eye, velocity);
+            for (uint32_t sector : streamer.Evicted())
+                CHECK(resident.erase(sector) == 1);
+            for (uint32_t sector : streamer.Arrived())
+            {
+                CHECK(resident.insert(sector).second);
+                streamer.TakeData(sector);
+            }
+            CHECK(streamer.Stats().Resident == resident.size());
+            if (streamer.Stats().Pending == 0)
+                return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        CHECK(!"streaming did not settle");
+    }
+
+    uint32_t SectorAt(const SectorStreamer& streamer, float x, float z)
+    {
+        for (uint32_t s = 0; s < streamer.SectorCount(); s++)
+        {
+            const Aabb& b = streamer.Sector(s).Bounds;
+            if (x > b.Min[0] && x < b.Max[0] && z > b.Min[2] && z < b.Max[2])
+                return s;
+        }
+        CHECK(!"no sector");
+        return 0;
+    }
+}
+
+// Partition не теряет треугольников, Build и чтение сектора восстанавливают
+// те же вершины для каждого куска
+static void TestRoundTrip()
+{
+    World world;
+    std::vector<std::array<uint32_t, 3>> before;
+    for (size_t t = 0; t < world.Indices.size(); t += 3)
+        before.push_back({ world.Indices[t], world.Indices[t + 1], world.Indices[t + 2] });
+
+    SectorStreamer streamer;
+    CHECK(world.Stream(streamer, 1));
+    CHECK(streamer.SectorCount() == 16);
+    CHECK(streamer.WrittenFiles() == 16);
+    CHECK(world.Submeshes.size() == 32);
+
+    std::vector<std::array<uint32_t, 3>> after;
+    for (size_t t = 0; t < world.Indices.size(); t += 3)
+        after.push_back({ world.Indices[t], world.Indices[t + 1], world.Indices[t + 2] });
+    std::sort(before.begin(), before.end());
+    std::sort(after.begin(), after.end());
+    CHECK(before == after);
+
+    // Сектор - 2x2 плитки, в нём оба материала
+    for (uint32_t s = 0; s < streamer.SectorCount(); s++)
+    {
+        const SectorInfo& info = streamer.Sector(s);
+        CHECK(info.Bounds.Max[0] - info.Bounds.Min[0] == 2 * TileSize);
+        CHECK(info.Bounds.Max[2] - info.Bounds.Min[2] == 2 * TileSize);
+        CHECK(info.Draws.size() == 2);
+        CHECK(info.Materials == std::vector<uint32_t>({ 0, 1 }));
+        CHECK(info.VertexCount == 16 && info.IndexCount == 24);
+    }
+
+    SectorStreamingDesc desc;
+    desc.LoadRadius = 1e9f;
+    streamer.SetDesc(desc);
+    float eye[3] = { 0.0f, 0.0f, 0.0f };
+    streamer.LoadNow(eye);
+    CHECK(streamer.Arrived().size() == 16);
+    CHECK(streamer.Stats().Resident == 16);
+
+    uint64_t bytes = 0;
+    for (uint32_t s = 0; s < streamer.SectorCount(); s++)
+    {
+        const SectorInfo& info = streamer.Sector(s);
+        SectorData data = streamer.TakeData(s);
+        CHECK(data.Vertices.size() == info.VertexCount * sizeof(TestVertex));
+        CHECK(data.Indices.size() == info.IndexCount);
+        bytes += info.FileBytes;
+
+        for (uint32_t draw : info.Draws)
+        {
+            const Submesh& sm = world.Submeshes[draw];
+            CHECK(sm.Sector == s);
+            for (uint32_t i = 0; i < sm.IndexCount; i++)
+            {
+                uint32_t local = data.Indices[sm.SectorIndexStart + i];
+                CHECK(local < info.VertexCount);
+                CHECK(memcmp(&data.Vertices[local * sizeof(TestVertex)], &world.Vertices[world.Indices[sm.IndexStart + i]], sizeof(TestVertex)) == 0);
+            }
+        }
+    }
+    CHECK(streamer.Stats().ReadBytes == bytes);
+    CHECK(streamer.Stats().ResidentBytes == bytes);
+}
+
+// Ближе LoadRadius - загружен, дальше UnloadRadius - выгружен, между ними
+// остаётся как был; скорость добавляет точку через LookAhead
+static void TestRadii()
+{
+    World world;
+    SectorStreamer streamer;
+    CHECK(world.Stream(streamer, 2));
+
+    SectorStreamingDesc desc;
+    desc.LoadRadius = 150.0f;
+    desc.UnloadRadius = 350.0f;
+    desc.VisibleRadius = 0.0f;
+    desc.LookAhead = 0.5f;
+    streamer.SetDesc(desc);
+
+    std::set<uint32_t> resident;
+    std::vector<bool> previous(streamer.SectorCount(), false);
+    uint32_t random = 1;
+    auto next = [&](float range)
+    {
+        random = random * 1664525u + 1013904223u;
+        return float(random >> 8) / float(1 << 24) * range;
+    };
+
+    uint32_t kept = 0;
+    for (int step = 0; step < 60; step++)
+    {
+        float eye[3] = { next(1000.0f) - 100.0f, next(100.0f), next(1000.0f) - 100.0f };
+        float velocity[3] = { 0.0f, 0.0f, 0.0f };
+        if (step % 3 == 0)
+        {
+            velocity[0] = next(1200.0f) - 600.0f;
+            velocity[2] = next(1200.0f) - 600.0f;
+        }
+        float ahead[3] = { eye[0] + velocity[0] * desc.LookAhead, eye[1], eye[2] + velocity[2] * desc.LookAhead };
+        Settle(streamer, eye, velocity, resident);
+
+        for (uint32_t s = 0; s < streamer.SectorCount(); s++)
+        {
+            const Aabb& b = streamer.Sector(s).Bounds;
+            float distance = (std::min)(b.Distance(eye[0], eye[1], eye[2]), b.Distance(ahead[0], ahead[1], ahead[2]));
+            bool isResident = resident.count(s) != 0;
+            if (distance < desc.LoadRadius)
+                CHECK(isResident);
+            else if (distance > desc.UnloadRadius)
+                CHECK(!isResident);
+            else
+            {
+                CHECK(isResident == previous[s]);
+                kept += isResident ? 1 : 0;
+            }
+            previous[s] = isResident;
+        }
+    }
+    CHECK(kept > 0);
+    CHECK(streamer.Stats().Failures == 0);
+
+    // Далеко от мира: без скорости ничего не нужно, со скоростью к миру -
+    // грузится то, куда камера придёт
+    float far[3] = { -1000.0f, 0.0f, 100.0f };
+    Settle(streamer, far, Still, resident);
+    CHECK(resident.empty());
+
+    float toward[3] = { 2000.0f, 0.0f, 0.0f };
+    Settle(streamer, far, toward, resident);
+    CHECK(resident.size() == 2);
+    CHECK(resident.count(SectorAt(streamer, 100.0f, 100.0f)) == 1);
+    CHECK(resident.count(SectorAt(streamer, 100.0f, 300.0f)) == 1);
+}
+
+// Сектор, ставший ненужным во время чтения, не выдаётся. Чтобы застать
+// поток внутри чтения, файл сектора подменяется каналом: поток открыл его
+// (и ждёт данных), когда открытие на запись прошло
+static void TestCancelWhileLoading()
+{
+    World world;
+    SectorStreamer streamer;
+    CHECK(world.Stream(streamer, 3));
+
+    SectorStreamingDesc desc;
+    desc.LoadRadius = 50.0f;
+    desc.UnloadRadius = 300.0f;
+    streamer.SetDesc(desc);
+
+    float eye[3] = { 100.0f, 0.0f, 100.0f };
+    float away[3] = { 100.0f, 0.0f, 5000.0f };
+    uint32_t sector = SectorAt(streamer, eye[0], eye[2]);
+    std::filesystem::path path = SectorFile(3, sector);
+    std::vector<uint8_t> bytes = ReadBytes(path);
+    std::filesystem::remove(path);
+    CHECK(mkfifo(path.c_str(), 0600) == 0);
+
+    streamer.Update(eye, Still);
+    CHECK(streamer.Arrived().empty() && streamer.Stats().Pending == 1);
+
+    int fd = -1;
+    for (int i = 0; i < 5000 && fd < 0; i++)
+    {
+        fd = open(path.c_str(), O_WRONLY | O_NONBLOCK);
+        if (fd < 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(fd >= 0);
+    CHECK(fcntl(fd, F_SETFL, 0) == 0);
+
+    streamer.Update(away, Still);
+    CHECK(streamer.Stats().Pending == 1);
+    CHECK(write(fd, bytes.data(), bytes.size()) == (ssize_t)bytes.size());
+    close(fd);
+
+    std::set<uint32_t> resident;
+    Settle(streamer, away, Still, resident);
+    CHECK(resident.empty());
+    CHECK(streamer.Stats().Loads == 0 && streamer.Stats().Failures == 0);
+    CHECK(streamer.Stats().ReadBytes == streamer.Sector(sector).FileBytes);
+
+    // Обычный файл снова - и сектор грузится как обычно
+    std::filesystem::remove(path);
+    WriteBytes(path, bytes);
+    Settle(streamer, eye, Still, resident);
+    CHECK(resident.size() == 1 && resident.count(sector) == 1);
+}
+
+// За Update выдаётся не больше ArrivalBytes (но хотя бы один сектор), ближние первыми
+static void TestArrivalLimit()
+{
+    World world;
+    SectorStreamer streamer;
+    CHECK(world.Stream(streamer, 4));
+
+    SectorStreamingDesc desc;
+    desc.LoadRadius = 1e9f;
+    desc.UnloadRadius = 2e9f;
+    desc.ArrivalBytes = 1;
+    streamer.SetDesc(desc);
+
+    float eye[3] = { 0.0f, 0.0f, 0.0f };
+    uint32_t updates = 0;
+    std::set<uint32_t> arrived;
+    for (int i = 0; i < 5000 && arrived.size() < streamer.SectorCount(); i++)
+    {
+        streamer.Update(eye, Still);
+        CHECK(streamer.Arrived().size() <= 1);
+        for (uint32_t sector : streamer.Arrived())
+            CHECK(arrived.insert(sector).second);
+        updates += streamer.Arrived().empty() ? 0 : 1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(updates == streamer.SectorCount());
+
+    // Три сектора за Update: пока поток читает, готовые копятся
+    SectorStreamer limited;
+    CHECK(world.Stream(limited, 4));
+    CHECK(limited.WrittenFiles() == 0);
+    uint64_t sectorBytes = limited.Sector(0).FileBytes;
+    desc.ArrivalBytes = sectorBytes * 3;
+    limited.SetDesc(desc);
+
+    uint32_t full = 0;
+    arrived.clear();
+    limited.Update(eye, Still);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    for (int i = 0; i < 5000 && arrived.size() < limited.SectorCount(); i++)
+    {
+        limited.Update(eye, Still);
+        uint64_t bytes = 0;
+        float last = 0.0f;
+        for (uint32_t sector : limited.Arrived())
+        {
+            const SectorInfo& info = limited.Sector(sector);
+            bytes += info.FileBytes;
+            float distance = info.Bounds.Distance(eye[0], eye[1], eye[2]);
+            CHECK(distance >= last);
+            last = distance;
+            CHECK(arrived.insert(sector).second);
+        }
+        CHECK(bytes <= desc.ArrivalBytes);
+        full += limited.Arrived().size() == 3 ? 1 : 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(arrived.size() == limited.SectorCount());
+    CHECK(full > 0);
+}
+
+// Файл с тем же размером, но другим содержимым Build перезаписывает; сектор
+// с битым файлом запрашивается снова через RetryDelay
+static void TestStaleAndFailedFiles()
+{
+    World world;
+    {
+        SectorStreamer streamer;
+        CHECK(world.Stream(streamer, 5));
+        CHECK(streamer.WrittenFiles() == 16);
+    }
+
+    // Тот же ключ, размер файлов прежний, но у одной плитки другие UV
+    World moved;
+    moved.Vertices[0].Uv[0] = 42.0f;
+    SectorStreamer streamer;
+    CHECK(moved.Stream(streamer, 5));
+    CHECK(streamer.WrittenFiles() == 1);
+
+    SectorStreamingDesc desc;
+    desc.LoadRadius = 50.0f;
+    desc.UnloadRadius = 300.0f;
+    desc.VisibleRadius = 50.0f;
+    desc.RetryDelay = 0.5f;
+    streamer.SetDesc(desc);
+
+    float eye[3] = { 50.0f, 0.0f, 50.0f };
+    uint32_t sector = SectorAt(streamer, eye[0], eye[2]);
+    streamer.LoadNow(eye);
+    CHECK(streamer.Arrived().size() == 1 && streamer.Arrived()[0] == sector);
+    SectorData data = streamer.TakeData(sector);
+    bool found = false;
+    for (size_t v = 0; v < data.Vertices.size(); v += sizeof(TestVertex))
+        found |= memcmp(&data.Vertices[v], &moved.Vertices[0], sizeof(TestVertex)) == 0;
+    CHECK(found);
+
+    // Испорченный байт данных ловит контрольная сумма при чтении
+    float away[3] = { 50.0f, 0.0f, 5000.0f };
+    std::set<uint32_t> resident = { sector };
+    Settle(streamer, away, Still, resident);
+    CHECK(resident.empty());
+
+    std::filesystem::path path = SectorFile(5, sector);
+    std::vector<uint8_t> bytes = ReadBytes(path);
+    std::vector<uint8_t> broken = bytes;
+    broken.back() ^= 0x5A;
+    WriteBytes(path, broken);
+
+    Settle(streamer, eye, Still, resident);
+    CHECK(resident.empty());
+    CHECK(streamer.Stats().Failures == 1);
+    CHECK(streamer.Stats().Missing == 0);
+
+    // До RetryDelay повтора нет, после - сектор читается заново
+    WriteBytes(path, bytes);
+    Settle(streamer, eye, Still, resident);
+    CHECK(resident.empty() && streamer.Stats().Failures == 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    Settle(streamer, eye, Still, resident);
+    CHECK(resident.size() == 1 && resident.count(sector) == 1);
+    CHECK(streamer.Stats().Failures == 1);
+
+    // Испорченный заголовок при том же размере - Build перезаписывает файл
+    broken = bytes;
+    broken[8] ^= 0x01;
+    WriteBytes(path, broken);
+    SectorStreamer rebuilt;
+    CHECK(moved.Stream(rebuilt, 5));
+    CHECK(rebuilt.WrittenFiles() == 1);
+    CHECK(ReadBytes(path) == bytes);
+}
+
+int main()
+{
+    std::filesystem::remove_all(TestDirectory());
+
+    TestRoundTrip();
+    TestRadii();
+    TestCancelWhileLoading();
+    TestArrivalLimit();
+    TestStaleAndFailedFiles();
+
+    std::filesystem::remove_all(TestDirectory());
+    std::printf("SectorStreamerTest: OK\n");
+    return 0;
+}
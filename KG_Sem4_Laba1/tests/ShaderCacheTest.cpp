@@ -0,0 +1,189 @@
+﻿#include "ShaderCache.h"
+#include "Check.h"
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::filesystem::path TestDirectory()
+    {
+        return std::filesystem::temp_directory_path() / "ShaderCacheTest";
+    }
+
+    void WriteText(const std::filesystem::path& path, const std::string& text)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << text;
+    }
+
+    std::vector<uint8_t> ReadBytes(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    void WriteBytes(const std::filesystem::path& path, const std::vector<uint8_t>& bytes)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(bytes.data()), (std::streamsize)bytes.size());
+    }
+
+    std::filesystem::path BlobPath(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return TestDirectory() / "cache" / name;
+    }
+}
+
+// Ключ зависит от исходника, всех вложенных #include и параметров компиляции
+static void TestHashKey()
+{
+    std::filesystem::path dir = TestDirectory() / "src";
+    std::filesystem::create_directories(dir / "inc");
+
+    WriteText(dir / "main.hlsl", "#include \"inc/common.hlsli\"\n#include <system.h>\nfloat4 PS() : SV_Target { return Common(); }\n");
+    WriteText(dir / "inc" / "common.hlsli", "#include \"deep.hlsli\"\nfloat4 Common() { return Deep(); }\n");
+    WriteText(dir / "inc" / "deep.hlsli", "#include \"common.hlsli\"\nfloat4 Deep() { return 1; }\n");
+
+    ShaderKey key;
+    key.SourcePath = (dir / "main.hlsl").string();
+    key.Defines = { { "ALPHA_TEST", "1" } };
+    key.EntryPoint = "PS";
+    key.Target = "ps_5_1";
+
+    // Цикл common <-> deep не зацикливает обход
+    uint64_t base = ShaderCache::HashKey(key);
+    CHECK(base != 0);
+    CHECK(ShaderCache::HashKey(key) == base);
+
+    // Изменение файла через два уровня #include меняет ключ
+    WriteText(dir / "inc" / "deep.hlsli", "#include \"common.hlsli\"\nfloat4 Deep() { return 2; }\n");
+    uint64_t changed = ShaderCache::HashKey(key);
+    CHECK(changed != base);
+
+    // Вернули содержимое - вернулся ключ
+    WriteText(dir / "inc" / "deep.hlsli", "#include \"common.hlsli\"\nfloat4 Deep() { return 1; }\n");
+    CHECK(ShaderCache::HashKey(key) == base);
+
+    ShaderKey other = key;
+    other.Defines[0].Value = "0";
+    CHECK(ShaderCache::HashKey(other) != base);
+
+    other = key;
+    other.Defines = { { "ALPHA_TES", "T1" } };
+    CHECK(ShaderCache::HashKey(other) != base);
+
+    other = key;
+    other.EntryPoint = "VS";
+    CHECK(ShaderCache::HashKey(other) != base);
+
+    other = key;
+    other.Target = "ps_6_0";
+    CHECK(ShaderCache::HashKey(other) != base);
+
+    other = key;
+    other.Flags = 1;
+    CHECK(ShaderCache::HashKey(other) != base);
+
+    other = key;
+    other.SourcePath = (dir / "missing.hlsl").string();
+    CHECK(ShaderCache::HashKey(other) == 0);
+}
+
+// Промах, запись, попадание
+static void TestHitMiss()
+{
+    ShaderCache cache((TestDirectory() / "cache").string());
+    std::vector<uint8_t> blob;
+
+    CHECK(!cache.Load(0x1234, blob));
+    CHECK(cache.Stats().Misses == 1 && cache.Stats().Rejected == 0);
+
+    std::vector<uint8_t> bytecode(1000);
+    for (size_t i = 0; i < bytecode.size(); i++)
+        bytecode[i] = uint8_t(i * 7);
+    CHECK(cache.Store(0x1234, bytecode.data(), bytecode.size()));
+    CHECK(!std::filesystem::exists(BlobPath(0x1234).string() + ".part"));
+
+    CHECK(cache.Load(0x1234, blob));
+    CHECK(blob == bytecode);
+
+    // Пустой блоб - тоже запись
+    CHECK(cache.Store(0x5678, nullptr, 0));
+    CHECK(cache.Load(0x5678, blob) && blob.empty());
+
+    ShaderCacheStats stats = cache.Stats();
+    CHECK(stats.Hits == 2 && stats.Misses == 1 && stats.Stores == 2);
+}
+
+// Обрезанный, испорченный и чужой файл - промах с отказом, а не мусорный байткод
+static void TestCorruptFiles()
+{
+    ShaderCache cache((TestDirectory() / "cache").string());
+    std::vector<uint8_t> bytecode(4096, 0xAB);
+    CHECK(cache.Store(0x1000, bytecode.data(), bytecode.size()));
+    std::vector<uint8_t> good = ReadBytes(BlobPath(0x1000));
+
+    std::vector<uint8_t> blob;
+    uint32_t rejected = 0;
+    auto expectRejected = [&](const std::vector<uint8_t>& file)
+    {
+        WriteBytes(BlobPath(0x1000), file);
+        blob.assign(3, 1);
+        CHECK(!cache.Load(0x1000, blob));
+        CHECK(blob.empty());
+        CHECK(cache.Stats().Rejected == ++rejected);
+    };
+
+    // Обрезан посреди данных и посреди заголовка, пустой файл
+    expectRejected(std::vector<uint8_t>(good.begin(), good.end() - 1));
+    expectRejected(std::vector<uint8_t>(good.begin(), good.begin() + 10));
+    expectRejected({});
+
+    // Лишний байт в конце
+    std::vector<uint8_t> longer = good;
+    longer.push_back(0);
+    expectRejected(longer);
+
+    // Байт данных испорчен - не сходится контрольная сумма
+    std::vector<uint8_t> flipped = good;
+    flipped[flipped.size() / 2] ^= 0x10;
+    expectRejected(flipped);
+
+    // Неверная сигнатура
+    std::vector<uint8_t> badMagic = good;
+    badMagic[0] ^= 0xFF;
+    expectRejected(badMagic);
+
+    // Заголовок обещает гигабайты - отказ без выделения
+    std::vector<uint8_t> huge = good;
+    uint64_t size = uint64_t(1) << 40;
+    memcpy(&huge[16], &size, sizeof(size));
+    expectRejected(huge);
+
+    // Файл другого ключа под этим именем
+    CHECK(cache.Store(0x2000, bytecode.data(), bytecode.size()));
+    expectRejected(ReadBytes(BlobPath(0x2000)));
+
+    // Перезапись исправляет
+    CHECK(cache.Store(0x1000, bytecode.data(), bytecode.size()));
+    CHECK(cache.Load(0x1000, blob) && blob == bytecode);
+}
+
+int main()
+{
+    std::error_code ec;
+    std::filesystem::remove_all(TestDirectory(), ec);
+
+    TestHashKey();
+    TestHitMiss();
+    TestCorruptFiles();
+
+    std::filesystem::remove_all(TestDirectory(), ec);
+    std::printf("ShaderCacheTest: OK\n");
+    return 0;
+}
@@ -0,0 +1,351 @@
+﻿#include "SoftRasterizer.h"
+#include "Check.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Собирается дважды: SoftRasterizerTest (SSE там, где есть) и SoftRasterizerScalarTest
+// (SOFT_RASTERIZER_NO_SSE) - проверки одни и те же для обоих путей растеризации
+namespace
+{
+    const uint32_t ClearColor = 0xFF000000u;
+
+    uint32_t gRandom = 1;
+
+    uint32_t NextRandom()
+    {
+        gRandom = gRandom * 1664525u + 1013904223u;
+        return gRandom;
+    }
+
+    float Random(float from, float to)
+    {
+        return from + (to - from) * (float(NextRandom() >> 8) / float(1 << 24));
+    }
+
+    struct TestVertex
+    {
+        float Position[3];
+        float Texcoord[2];
+    };
+
+    // Треугольники без общих вершин: у каждого своя глубина
+    struct TestScene
+    {
+        std::vector<TestVertex> Vertices;
+        std::vector<uint32_t> Indices;
+
+        // Вершины в NDC (y вверх); порядок выправляется до лицевого (по часовой на экране)
+        void AddTriangle(const float a[2], const float b[2], const float c[2], float z)
+        {
+            const float* v[3] = { a, b, c };
+            float cross = (b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1]);
+            if (cross > 0.0f)
+            {
+                v[1] = c;
+                v[2] = b;
+            }
+
+            for (int i = 0; i < 3; i++)
+            {
+                Indices.push_back((uint32_t)Vertices.size());
+                Vertices.push_back({ { v[i][0], v[i][1], z }, { 0.5f, 0.5f } });
+            }
+        }
+
+        SoftMesh Mesh() const
+        {
+            SoftMesh mesh;
+            mesh.Vertices = reinterpret_cast<const uint8_t*>(Vertices.data());
+            mesh.VertexStride = sizeof(TestVertex);
+            mesh.PositionOffset = offsetof(TestVertex, Position);
+            mesh.TexcoordOffset = offsetof(TestVertex, Texcoord);
+            mesh.VertexCount = (uint32_t)Vertices.size();
+            mesh.Indices = Indices.data();
+            return mesh;
+        }
+    };
+
+    // Вершины уже в пространстве отсечения: w = 1
+    SoftConstants IdentityConstants()
+    {
+        SoftConstants constants;
+        for (int i = 0; i < 4; i++)
+            constants.WorldViewProj[i][i] = 1.0f;
+        return constants;
+    }
+
+    void Render(SoftRasterizer& raster, const TestScene& scene, const SoftDraw* draws, size_t drawCount,
+        const SoftConstants& constants = IdentityConstants())
+    {
+        raster.Clear(ClearColor);
+        raster.Render(scene.Mesh(), constants, draws, drawCount);
+    }
+
+    void Render(SoftRasterizer& raster, const TestScene& scene)
+    {
+        SoftDraw draw;
+        draw.IndexCount = (uint32_t)scene.Indices.size();
+        Render(raster, scene, &draw, 1);
+    }
+
+    // Каждый пиксель закрашен: не остался цвет очистки
+    bool AllCovered(const SoftRasterizer& raster)
+    {
+        for (uint32_t y = 0; y < raster.Height(); y++)
+        {
+            for (uint32_t x = 0; x < raster.Width(); x++)
+            {
+                if (raster.Color()[(size_t)y * raster.Pitch() + x] == ClearColor)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    SoftTexture SolidTexture(uint8_t b, uint8_t g, uint8_t r)
+    {
+        SoftTexture texture;
+        texture.Width = 1;
+        texture.Height = 1;
+        texture.Mips.push_back({ b, g, r, 255 });
+        return texture;
+    }
+
+    // Пиксель -> NDC
+    void PixelToNdc(const SoftRasterizer& raster, float x, float y, float out[2])
+    {
+        out[0] = x / raster.Width() * 2.0f - 1.0f;
+        out[1] = 1.0f - y / raster.Height() * 2.0f;
+    }
+}
+
+// Веер на весь экран с центром ровно в центре пикселя: рёбра сходятся в одной точке
+// выборки и проходят через тайлы во всех направлениях. Каждый следующий треугольник
+// ближе предыдущего, так что пиксель, закрашенный дважды, дважды пройдёт тест глубины
+// и попадёт в Stats().Pixels: покрытие ровно одно, если Pixels == width * height
+static void TestFanCoversEveryPixelOnce(JobSystem& jobs, uint32_t width, uint32_t height)
+{
+    SoftRasterizer raster(jobs, width, height);
+
+    const int Slices = 997;
+    float center[2];
+    PixelToNdc(raster, (float)(width / 3) + 0.5f, (float)(height * 2 / 3) + 0.5f, center);
+
+    // Точки обода общие у соседних треугольников (одни и те же float)
+    std::vector<float> rim((Slices + 1) * 2);
+    for (int i = 0; i <= Slices; i++)
+    {
+        float angle = 6.2831853f * (i % Slices) / Slices;
+        rim[i * 2 + 0] = 4.0f * std::cos(angle);
+        rim[i * 2 + 1] = 4.0f * std::sin(angle);
+    }
+
+    TestScene scene;
+    for (int i = 0; i < Slices; i++)
+        scene.AddTriangle(center, &rim[i * 2], &rim[i * 2 + 2], 0.9f - 0.8f * i / Slices);
+
+    Render(raster, scene);
+    CHECK(raster.Stats().Triangles == (uint32_t)Slices);
+    CHECK(AllCovered(raster));
+    CHECK(raster.Stats().Pixels == (uint64_t)width * height);
+}
+
+// Сетка со сдвинутыми узлами, часть из них - ровно в центрах пикселей, квады
+// режутся по диагоналям в обе стороны. Та же проверка ровно одного покрытия
+static void TestJitteredGridCoversEveryPixelOnce(JobSystem& jobs, uint32_t width, uint32_t height)
+{
+    SoftRasterizer raster(jobs, width, height);
+
+    const int Cells = 23;
+    std::vector<float> nodes((Cells + 1) * (Cells + 1) * 2);
+    for (int y = 0; y <= Cells; y++)
+    {
+        for (int x = 0; x <= Cells; x++)
+        {
+            float* node = &nodes[(y * (Cells + 1) + x) * 2];
+            float px = (x - 1.0f) * (width + 2.0f * width / Cells) / (Cells - 2);
+            float py = (y - 1.0f) * (height + 2.0f * height / Cells) / (Cells - 2);
+            if (x > 0 && x < Cells && y > 0 && y < Cells)
+            {
+                if ((x + y) % 3 == 0)
+                {
+                    px = std::floor(px) + 0.5f;
+                    py = std::floor(py) + 0.5f;
+                }
+                else
+                {
+                    px += Random(-0.3f, 0.3f) * width / Cells;
+                    py += Random(-0.3f, 0.3f) * height / Cells;
+                }
+            }
+            PixelToNdc(raster, px, py, node);
+        }
+    }
+
+    TestScene scene;
+    int triangle = 0;
+    int total = Cells * Cells * 2;
+    for (int y = 0; y < Cells; y++)
+    {
+        for (int x = 0; x < Cells; x++)
+        {
+            const float* n00 = &nodes[(y * (Cells + 1) + x) * 2];
+            const float* n10 = &nodes[(y * (Cells + 1) + x + 1) * 2];
+            const float* n01 = &nodes[((y + 1) * (Cells + 1) + x) * 2];
+            const float* n11 = &nodes[((y + 1) * (Cells + 1) + x + 1) * 2];
+
+            if ((x + y) % 2 == 0)
+            {
+                scene.AddTriangle(n00, n10, n11, 0.9f - 0.8f * triangle++ / total);
+                scene.AddTriangle(n00, n11, n01, 0.9f - 0.8f * triangle++ / total);
+            }
+            else
+            {
+                scene.AddTriangle(n00, n10, n01, 0.9f - 0.8f * triangle++ / total);
+                scene.AddTriangle(n10, n11, n01, 0.9f - 0.8f * triangle++ / total);
+            }
+        }
+    }
+
+    Render(raster, scene);
+    CHECK(AllCovered(raster));
+    CHECK(raster.Stats().Pixels == (uint64_t)width * height);
+}
+
+// Задняя грань не рисуется; при равной глубине остаётся первая отрисовка (LESS)
+static void TestCullingAndDepthTie(JobSystem& jobs)
+{
+    SoftRasterizer raster(jobs, 67, 45);
+    SoftTexture red = SolidTexture(0, 0, 255);
+    SoftTexture blue = SolidTexture(255, 0, 0);
+
+    const float a[2] = { -3.0f, -3.0f };
+    const float b[2] = { -3.0f, 3.0f };
+    const float c[2] = { 3.0f, 0.0f };
+
+    TestScene scene;
+    scene.AddTriangle(a, b, c, 0.5f);
+    scene.AddTriangle(a, b, c, 0.5f);
+
+    SoftDraw draws[2];
+    draws[0].IndexCount = 3;
+    draws[0].Texture1 = &red;
+    draws[0].Texture2 = &red;
+    draws[1].IndexStart = 3;
+    draws[1].IndexCount = 3;
+    draws[1].Texture1 = &blue;
+    draws[1].Texture2 = &blue;
+
+    Render(raster, scene, draws, 2);
+    CHECK(AllCovered(raster));
+    CHECK(raster.Stats().Pixels == 67u * 45u);
+    CHECK(raster.Color()[0] == 0xFFFF0000u);
+    CHECK(raster.Color()[44 * raster.Pitch() + 66] == 0xFFFF0000u);
+    CHECK(std::fabs(raster.Depth()[10 * raster.Pitch() + 20] - 0.5f) < 1e-6f);
+
+    // Тот же треугольник задом наперёд
+    std::swap(scene.Indices[1], scene.Indices[2]);
+    Render(raster, scene, draws, 1);
+    CHECK(raster.Stats().Triangles == 0);
+    CHECK(raster.Stats().Pixels == 0);
+    CHECK(raster.Color()[0] == ClearColor);
+}
+
+// lerp(Texture1, Texture2, BlendFactor); без текстуры - белый
+static void TestBlendFactor(JobSystem& jobs)
+{
+    SoftRasterizer raster(jobs, 16, 16);
+    SoftTexture red = SolidTexture(0, 0, 200);
+    SoftTexture blue = SolidTexture(100, 0, 0);
+
+    const float a[2] = { -3.0f, -3.0f };
+    const float b[2] = { -3.0f, 3.0f };
+    const float c[2] = { 3.0f, 0.0f };
+    TestScene scene;
+    scene.AddTriangle(a, b, c, 0.5f);
+
+    SoftDraw draw;
+    draw.IndexCount = 3;
+    draw.Texture1 = &red;
+    draw.Texture2 = &blue;
+
+    SoftConstants constants = IdentityConstants();
+    constants.BlendFactor = 0.25f;
+    Render(raster, scene, &draw, 1, constants);
+    CHECK(raster.Color()[5 * raster.Pitch() + 7] == 0xFF960019u); // b 25, g 0, r 150
+
+    draw.Texture1 = nullptr;
+    draw.Texture2 = nullptr;
+    Render(raster, scene, &draw, 1, constants);
+    CHECK(raster.Color()[5 * raster.Pitch() + 7] == 0xFFFFFFFFu);
+}
+
+// Случайные перекрывающиеся треугольники, часть пересекает ближнюю плоскость:
+// несколько порций раскладки и потоков дают тот же кадр, что и один поток
+static void TestThreadCountDoesNotChangeImage(JobSystem& single, JobSystem& many)
+{
+    const uint32_t Width = 211;
+    const uint32_t Height = 157;
+
+    TestScene scene;
+    for (int i = 0; i < 6000; i++)
+    {
+        float a[2] = { Random(-1.2f, 1.2f), Random(-1.2f, 1.2f) };
+        float b[2] = { a[0] + Random(-0.3f, 0.3f), a[1] + Random(-0.3f, 0.3f) };
+        float c[2] = { a[0] + Random(-0.3f, 0.3f), a[1] + Random(-0.3f, 0.3f) };
+        scene.AddTriangle(a, b, c, Random(0.0f, 1.0f));
+    }
+    for (size_t i = 0; i < scene.Vertices.size(); i += 7)
+        scene.Vertices[i].Position[2] = -0.2f;
+
+    SoftTexture texture;
+    texture.Width = 2;
+    texture.Height = 2;
+    texture.Mips.push_back({ 0, 0, 255, 255, 0, 255, 0, 255, 255, 0, 0, 255, 255, 255, 255, 255 });
+    texture.Mips.push_back({ 128, 128, 128, 255 });
+    for (size_t i = 0; i < scene.Vertices.size(); i++)
+    {
+        scene.Vertices[i].Texcoord[0] = scene.Vertices[i].Position[0] * 3.0f;
+        scene.Vertices[i].Texcoord[1] = scene.Vertices[i].Position[1] * 3.0f;
+    }
+
+    SoftDraw draws[3];
+    draws[0].IndexCount = 5000 * 3;
+    draws[0].Texture1 = &texture;
+    draws[1].IndexStart = draws[0].IndexCount;
+    draws[1].IndexCount = 0;
+    draws[2].IndexStart = draws[0].IndexCount;
+    draws[2].IndexCount = 1000 * 3;
+    draws[2].Texture2 = &texture;
+
+    SoftRasterizer first(single, Width, Height);
+    SoftRasterizer second(many, Width, Height);
+    Render(first, scene, draws, 3);
+    Render(second, scene, draws, 3);
+
+    CHECK(first.Stats().Triangles > 3000);
+    CHECK(first.Stats().Triangles == second.Stats().Triangles);
+    CHECK(first.Stats().Pixels == second.Stats().Pixels);
+    CHECK(first.Color() == second.Color());
+    CHECK(std::memcmp(first.Depth().data(), second.Depth().data(), first.Depth().size() * sizeof(float)) == 0);
+}
+
+int main()
+{
+    JobSystem single(1);
+    JobSystem many(3);
+
+    // Размеры не кратны ни тайлу, ни четвёрке пикселей
+    TestFanCoversEveryPixelOnce(single, 64, 64);
+    TestFanCoversEveryPixelOnce(single, 301, 203);
+    TestFanCoversEveryPixelOnce(many, 130, 67);
+    TestJitteredGridCoversEveryPixelOnce(single, 301, 203);
+    TestJitteredGridCoversEveryPixelOnce(many, 97, 131);
+    TestCullingAndDepthTie(many);
+    TestBlendFactor(single);
+    TestThreadCountDoesNotChangeImage(single, many);
+
+    std::printf("SoftRasterizerTest: OK\n");
+    return 0;
+}
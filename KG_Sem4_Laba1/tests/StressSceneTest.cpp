@@ -0,0 +1,152 @@
+﻿#include "StressScene.h"
+#include "Check.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    // Пропы с разными центрами: по тому, куда матрица переносит центр, видно, чей это экземпляр
+    std::vector<StressProp> MakeProps(uint32_t count)
+    {
+        std::vector<StressProp> props(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            props[i].Submesh = 100 + i * 7;
+            props[i].Center[0] = 3.0f * i - 5.0f;
+            props[i].Center[1] = 10.0f + 4.0f * i;
+            props[i].Center[2] = 2.0f - 1.5f * i;
+        }
+        return props;
+    }
+
+    void Transform(const float p[3], const InstanceData& instance, float out[3])
+    {
+        for (int j = 0; j < 3; j++)
+            out[j] = p[0] * instance.World[0][j] + p[1] * instance.World[1][j] + p[2] * instance.World[2][j] + instance.World[3][j];
+    }
+
+    bool Same(const std::vector<InstanceData>& a, const std::vector<InstanceData>& b)
+    {
+        return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(InstanceData)) == 0;
+    }
+}
+
+static void TestDeterminism()
+{
+    std::vector<StressProp> props = MakeProps(5);
+    StressSceneDesc desc;
+    desc.CountX = 40;
+    desc.CountZ = 30;
+
+    std::vector<InstanceData> first, second;
+    std::vector<InstanceBatch> firstBatches, secondBatches;
+    desc.Seed = 1234;
+    GenerateStressScene(desc, props, first, firstBatches);
+    GenerateStressScene(desc, props, second, secondBatches);
+    CHECK(first.size() == 1200);
+    CHECK(Same(first, second));
+    CHECK(firstBatches.size() == secondBatches.size());
+    for (size_t i = 0; i < firstBatches.size(); i++)
+    {
+        CHECK(firstBatches[i].Submesh == secondBatches[i].Submesh);
+        CHECK(firstBatches[i].FirstInstance == secondBatches[i].FirstInstance);
+        CHECK(firstBatches[i].InstanceCount == secondBatches[i].InstanceCount);
+    }
+
+    // Другой seed - другая сцена, но того же размера
+    desc.Seed = 1235;
+    GenerateStressScene(desc, props, second, secondBatches);
+    CHECK(second.size() == first.size());
+    CHECK(!Same(first, second));
+
+    // Нулевой seed заменяется единицей
+    desc.Seed = 0;
+    GenerateStressScene(desc, props, first, firstBatches);
+    desc.Seed = 1;
+    GenerateStressScene(desc, props, second, secondBatches);
+    CHECK(Same(first, second));
+
+    // Без пропов или с пустой сеткой - пусто, прошлое содержимое стирается
+    GenerateStressScene(desc, {}, first, firstBatches);
+    CHECK(first.empty() && firstBatches.empty());
+    desc.CountZ = 0;
+    GenerateStressScene(desc, props, second, secondBatches);
+    CHECK(second.empty() && secondBatches.empty());
+}
+
+// Партии подряд по возрастанию пропа, без пустых; центр пропа каждого
+// экземпляра встаёт в свой узел сетки, и каждый узел занят ровно одним
+static void TestBatches()
+{
+    std::vector<StressProp> props = MakeProps(7);
+    StressSceneDesc desc;
+    desc.Seed = 99;
+    desc.CountX = 23;
+    desc.CountZ = 17;
+    desc.Spacing = 10.0f;
+    desc.Origin[0] = 100.0f;
+    desc.Origin[1] = -20.0f;
+    desc.Origin[2] = 50.0f;
+
+    std::vector<InstanceData> instances;
+    std::vector<InstanceBatch> batches;
+    GenerateStressScene(desc, props, instances, batches);
+    CHECK(instances.size() == desc.CountX * desc.CountZ);
+
+    std::vector<uint32_t> nodeHits(instances.size(), 0);
+    uint32_t next = 0;
+    size_t prop = 0;
+    for (const InstanceBatch& batch : batches)
+    {
+        CHECK(batch.FirstInstance == next);
+        CHECK(batch.InstanceCount > 0);
+        next += batch.InstanceCount;
+
+        while (prop < props.size() && props[prop].Submesh != batch.Submesh)
+            prop++;
+        CHECK(prop < props.size());
+
+        float startX = desc.Origin[0] - 0.5f * desc.Spacing * (desc.CountX - 1);
+        float startZ = desc.Origin[2] - 0.5f * desc.Spacing * (desc.CountZ - 1);
+        for (uint32_t i = batch.FirstInstance; i < batch.FirstInstance + batch.InstanceCount; i++)
+        {
+            const InstanceData& instance = instances[i];
+            float center[3];
+            Transform(props[prop].Center, instance, center);
+            CHECK(std::fabs(center[1] - desc.Origin[1]) < 1e-3f);
+
+            float gx = (center[0] - startX) / desc.Spacing;
+            float gz = (center[2] - startZ) / desc.Spacing;
+            long x = std::lround(gx);
+            long z = std::lround(gz);
+            CHECK(x >= 0 && x < (long)desc.CountX && z >= 0 && z < (long)desc.CountZ);
+            CHECK(std::fabs(gx - x) <= desc.Jitter + 1e-3f && std::fabs(gz - z) <= desc.Jitter + 1e-3f);
+            nodeHits[z * desc.CountX + x]++;
+
+            // Поворот вокруг Y и масштаб в заданных пределах
+            float scale = instance.World[1][1];
+            CHECK(scale >= desc.MinScale && scale <= desc.MaxScale);
+            CHECK(std::fabs(instance.World[0][0] * instance.World[0][0] + instance.World[0][2] * instance.World[0][2] - scale * scale) < 1e-3f);
+            CHECK(instance.World[0][1] == 0.0f && instance.World[2][1] == 0.0f && instance.World[3][3] == 1.0f);
+        }
+        prop++;
+    }
+    CHECK(next == instances.size());
+    for (uint32_t hits : nodeHits)
+        CHECK(hits == 1);
+
+    // Больше пропов, чем узлов: у части пропов партий нет
+    desc.CountX = 2;
+    desc.CountZ = 2;
+    GenerateStressScene(desc, MakeProps(50), instances, batches);
+    CHECK(instances.size() == 4 && batches.size() <= 4);
+}
+
+int main()
+{
+    TestDeterminism();
+    TestBatches();
+    std::printf("StressSceneTest: OK\n");
+    return 0;
+}
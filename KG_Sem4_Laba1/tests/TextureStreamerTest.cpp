@@ -0,0 +1,80 @@
+﻿#include "TextureStreamer.h"
+#include "Check.h"
+
+constexpr uint64_t Unlimited = uint64_t(1) << 40;
+
+// Мипы BC меньше блока 4x4 всё равно занимают целый блок
+static void TestBlockMipBytes()
+{
+    TextureStreamer streamer(Unlimited, Unlimited);
+    uint32_t bc1 = streamer.AddTexture(16, 16, 5, 4, 4, 0);
+    uint32_t bc7 = streamer.AddTexture(16, 16, 5, 8, 4, 0);
+    uint32_t rgba = streamer.AddTexture(16, 16, 5, 32, 1, 0);
+
+    CHECK(streamer.MipBytes(bc1, 0) == 128);
+    CHECK(streamer.MipBytes(bc1, 2) == 8);
+    CHECK(streamer.MipBytes(bc1, 3) == 8);
+    CHECK(streamer.MipBytes(bc1, 4) == 8);
+    CHECK(streamer.MipBytes(bc7, 4) == 16);
+    CHECK(streamer.MipBytes(rgba, 3) == 16);
+    CHECK(streamer.MipBytes(rgba, 4) == 4);
+
+    // Весь резидентный объём с нулевого мипа
+    CHECK(streamer.Stats().ResidentBytes == (128 + 32 + 8 + 8 + 8) + (256 + 64 + 16 + 16 + 16) + (1024 + 256 + 64 + 16 + 4));
+}
+
+// Стартовый мип BC - из целых блоков, даже если по размеру просится грубее
+static void TestStartupMipAligned()
+{
+    TextureStreamer streamer(Unlimited, Unlimited);
+
+    // 64 -> 32 -> 16 -> 8 -> 4 -> 2 -> 1: грубее четвёртого нельзя
+    uint32_t pow2 = streamer.AddTexture(64, 64, 7, 4, 4, 6);
+    CHECK(streamer.StartupMip(pow2) == 4 && streamer.ResidentMip(pow2) == 4);
+
+    // 40 -> 20 -> 10: грубее первого нельзя
+    uint32_t odd = streamer.AddTexture(40, 40, 6, 4, 4, 3);
+    CHECK(streamer.StartupMip(odd) == 1);
+
+    // Без сжатия ограничений нет
+    uint32_t rgba = streamer.AddTexture(40, 40, 6, 32, 1, 3);
+    CHECK(streamer.StartupMip(rgba) == 3);
+}
+
+// Повышения не переходят к мипу, который не кратен блоку
+static void TestUpgradesStopAtTopMip()
+{
+    TextureStreamer streamer(Unlimited, Unlimited);
+
+    // 8x9 -> 4x4 -> 2x2 -> 1x1: кратен блоку только первый мип
+    uint32_t tex = streamer.AddTexture(8, 9, 4, 4, 4, 3);
+    CHECK(streamer.StartupMip(tex) == 1);
+
+    for (int frame = 0; frame < 8; frame++)
+    {
+        streamer.BeginFrame();
+        streamer.RequestMip(tex, 0.0f);
+        streamer.Update();
+        CHECK(streamer.ResidentMip(tex) == 1);
+    }
+    CHECK(streamer.Stats().PendingRequests == 0);
+
+    // Обычная цепочка доходит до нулевого мипа по одному за кадр
+    uint32_t pow2 = streamer.AddTexture(64, 64, 7, 4, 4, 4);
+    for (int frame = 0; frame < 8; frame++)
+    {
+        streamer.BeginFrame();
+        streamer.RequestMip(pow2, 0.0f);
+        streamer.Update();
+    }
+    CHECK(streamer.ResidentMip(pow2) == 0);
+}
+
+int main()
+{
+    TestBlockMipBytes();
+    TestStartupMipAligned();
+    TestUpgradesStopAtTopMip();
+    std::printf("TextureStreamerTest: OK\n");
+    return 0;
+}
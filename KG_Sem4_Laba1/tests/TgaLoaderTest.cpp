@@ -0,0 +1,102 @@
+﻿#include "TgaLoader.h"
+#include "Check.h"
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    // Несжатый truecolor TGA в памяти: alpha(x, y) - альфа текселя
+    template <typename AlphaFn>
+    std::vector<unsigned char> MakeTga(int width, int height, int channels, AlphaFn alpha)
+    {
+        std::vector<unsigned char> file(18 + size_t(width) * height * channels, 0);
+        file[2] = 2;
+        file[12] = (unsigned char)(width & 0xFF);
+        file[13] = (unsigned char)(width >> 8);
+        file[14] = (unsigned char)(height & 0xFF);
+        file[15] = (unsigned char)(height >> 8);
+        file[16] = (unsigned char)(channels * 8);
+
+        unsigned char* pixels = file.data() + 18;
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                unsigned char* p = pixels + (size_t(y) * width + x) * channels;
+                p[0] = 10;
+                p[1] = 20;
+                p[2] = 30;
+                if (channels == 4)
+                    p[3] = alpha(x, y);
+            }
+        }
+        return file;
+    }
+
+    TgaAlphaKind Classify(const std::vector<unsigned char>& file)
+    {
+        TgaView view;
+        CHECK(ParseTGA(file.data(), file.size(), view));
+        return ClassifyTgaAlpha(view);
+    }
+}
+
+static void TestParse()
+{
+    auto file = MakeTga(5, 3, 4, [](int, int) { return (unsigned char)255; });
+    TgaView view;
+    CHECK(ParseTGA(file.data(), file.size(), view));
+    CHECK(view.width == 5 && view.height == 3 && view.channels == 4);
+    CHECK(view.pixels == file.data() + 18);
+
+    // Обрезанный файл, RLE и палитра не разбираются
+    CHECK(!ParseTGA(file.data(), file.size() - 1, view));
+    CHECK(!ParseTGA(file.data(), 17, view));
+    auto rle = file;
+    rle[2] = 10;
+    CHECK(!ParseTGA(rle.data(), rle.size(), view));
+    auto mapped = file;
+    mapped[1] = 1;
+    CHECK(!ParseTGA(mapped.data(), mapped.size(), view));
+}
+
+// Маски с мягкими краями (листья, цепь) - Mask, стекло и ткань - Translucent
+static void TestClassify()
+{
+    CHECK(Classify(MakeTga(16, 16, 3, [](int, int) { return (unsigned char)0; })) == TgaAlphaOpaque);
+    CHECK(Classify(MakeTga(16, 16, 4, [](int, int) { return (unsigned char)255; })) == TgaAlphaOpaque);
+    CHECK(Classify(MakeTga(16, 16, 4, [](int, int) { return (unsigned char)250; })) == TgaAlphaOpaque);
+
+    // Полосы 0/255, как у цепи
+    CHECK(Classify(MakeTga(64, 64, 4, [](int x, int) { return (unsigned char)((x / 8) % 2 ? 255 : 0); })) == TgaAlphaMask);
+
+    // Круг со сглаженной каймой в 4 текселя: промежуточных около 10%
+    auto disc = [](int x, int y)
+    {
+        float r = std::sqrt(float((x - 64) * (x - 64) + (y - 64) * (y - 64)));
+        float a = (48.0f - r) / 4.0f;
+        a = a < 0.0f ? 0.0f : (a > 1.0f ? 1.0f : a);
+        return (unsigned char)(a * 255.0f + 0.5f);
+    };
+    CHECK(Classify(MakeTga(128, 128, 4, disc)) == TgaAlphaMask);
+
+    // Ровная половинная альфа и плавный градиент
+    CHECK(Classify(MakeTga(32, 32, 4, [](int, int) { return (unsigned char)128; })) == TgaAlphaTranslucent);
+    CHECK(Classify(MakeTga(256, 4, 4, [](int x, int) { return (unsigned char)x; })) == TgaAlphaTranslucent);
+
+    // Ровно на пороге доли - ещё маска, тексель сверх - уже полупрозрачная
+    const int texels = 64 * 64;
+    int partial = texels / TgaTranslucentShare;
+    auto share = [&](int x, int y) { return (unsigned char)(y * 64 + x < partial ? 100 : 0); };
+    CHECK(Classify(MakeTga(64, 64, 4, share)) == TgaAlphaMask);
+    partial++;
+    CHECK(Classify(MakeTga(64, 64, 4, share)) == TgaAlphaTranslucent);
+}
+
+int main()
+{
+    TestParse();
+    TestClassify();
+    std::printf("TgaLoaderTest: OK\n");
+    return 0;
+}
@@ -0,0 +1,287 @@
+﻿#include "TlsfAllocator.h"
+#include "Check.h"
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace
+{
+    uint64_t gRandom = 1;
+
+    uint64_t NextRandom()
+    {
+        gRandom = gRandom * 6364136223846793005ull + 1442695040888963407ull;
+        return gRandom >> 17;
+    }
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Живые выделения по смещению: пересечения, выравнивание и учёт байт
+    struct Model
+    {
+        const TlsfAllocator& Allocator;
+        std::map<uint64_t, TlsfAllocation> Live = {};
+        uint64_t Used = 0;
+
+        void Add(const TlsfAllocation& a, uint64_t size, uint64_t alignment)
+        {
+            uint64_t granularity = Allocator.Granularity();
+            CHECK(a.Valid());
+            CHECK(a.Size == AlignUp((std::max)(size, (uint64_t)1), granularity));
+            CHECK(a.Offset % (std::max)(alignment, granularity) == 0);
+            CHECK(a.Offset + a.Size <= Allocator.Capacity());
+
+            auto next = Live.lower_bound(a.Offset);
+            if (next != Live.end())
+                CHECK(a.Offset + a.Size <= next->first);
+            if (next != Live.begin())
+            {
+                auto prev = std::prev(next);
+                CHECK(prev->first + prev->second.Size <= a.Offset);
+            }
+
+            Live[a.Offset] = a;
+            Used += a.Size;
+        }
+
+        void Remove(std::map<uint64_t, TlsfAllocation>::iterator it)
+        {
+            Used -= it->second.Size;
+            Live.erase(it);
+        }
+
+        void Check() const
+        {
+            CHECK(Allocator.Validate());
+            TlsfStats stats = Allocator.Stats();
+            CHECK(stats.UsedBytes == Used);
+            CHECK(stats.Allocations == (uint32_t)Live.size());
+            CHECK(stats.FreeBytes == Allocator.Capacity() - Used);
+            CHECK(stats.LargestFreeBlock <= stats.FreeBytes);
+        }
+    };
+
+    // Отказ честный: блок, которого хватило бы с округлением до следующей корзины,
+    // нашёлся бы (округление - не больше 1/16 размера)
+    void CheckFailure(const TlsfAllocator& allocator, uint64_t size, uint64_t alignment)
+    {
+        uint64_t granularity = allocator.Granularity();
+        uint64_t search = AlignUp((std::max)(size, (uint64_t)1), granularity) +
+            ((std::max)(alignment, granularity) - granularity);
+        CHECK(allocator.Stats().LargestFreeBlock < search + search / 16 + granularity);
+    }
+}
+
+// Вся куча одним выделением, затем отказ; после освобождения - снова один блок
+static void TestFullHeap()
+{
+    TlsfAllocator allocator(1000000 + 100, 256);
+    CHECK(allocator.Capacity() == 1000192 - 256);
+    CHECK(allocator.Validate());
+
+    TlsfAllocation all = allocator.Allocate(allocator.Capacity(), 1);
+    CHECK(all.Valid() && all.Offset == 0 && all.Size == allocator.Capacity());
+    CHECK(allocator.Validate());
+
+    TlsfStats stats = allocator.Stats();
+    CHECK(stats.FreeBytes == 0 && stats.FreeBlocks == 0 && stats.LargestFreeBlock == 0);
+    CHECK(stats.Fragmentation() == 0.0);
+
+    CHECK(!allocator.Allocate(1, 1).Valid());
+    CHECK(allocator.Stats().Failures == 1);
+    CHECK(allocator.Validate());
+
+    allocator.Free(all);
+    stats = allocator.Stats();
+    CHECK(stats.FreeBlocks == 1 && stats.LargestFreeBlock == allocator.Capacity());
+    CHECK(allocator.Validate());
+
+    // Больше кучи и размеры у края uint64: отказ без переполнения
+    CHECK(!allocator.Allocate(allocator.Capacity() + 1, 1).Valid());
+    CHECK(!allocator.Allocate(UINT64_MAX, 1).Valid());
+    CHECK(!allocator.Allocate(UINT64_MAX - 100, 4096).Valid());
+    CHECK(!allocator.Allocate(1, 1ull << 63).Valid());
+    CHECK(allocator.Stats().Failures == 5);
+    CHECK(allocator.Validate());
+
+    // Пустая куча
+    TlsfAllocator empty(100, 4096);
+    CHECK(empty.Capacity() == 0);
+    CHECK(!empty.Allocate(1, 1).Valid());
+    CHECK(empty.Validate());
+}
+
+// Куча до отказа одинаковыми кусками, дыры через один, обратное слияние
+static void TestExhaustion()
+{
+    const uint64_t Piece = 4096;
+    TlsfAllocator allocator(64 * Piece, 4096);
+
+    std::vector<TlsfAllocation> pieces;
+    for (;;)
+    {
+        TlsfAllocation a = allocator.Allocate(Piece, Piece);
+        if (!a.Valid())
+            break;
+        pieces.push_back(a);
+        CHECK(allocator.Validate());
+    }
+    CHECK(pieces.size() == 64);
+    CHECK(allocator.Stats().FreeBytes == 0);
+
+    for (size_t i = 0; i < pieces.size(); i += 2)
+    {
+        allocator.Free(pieces[i]);
+        CHECK(allocator.Validate());
+    }
+
+    // Половина свободна, но только кусками по одному
+    TlsfStats stats = allocator.Stats();
+    CHECK(stats.FreeBytes == 32 * Piece && stats.FreeBlocks == 32 && stats.LargestFreeBlock == Piece);
+    CHECK(stats.Fragmentation() > 0.9);
+    CHECK(!allocator.Allocate(2 * Piece, Piece).Valid());
+    CHECK(allocator.Allocate(Piece, Piece).Valid());
+    CHECK(allocator.Validate());
+
+    TlsfAllocator drained(64 * Piece, 4096);
+    pieces.clear();
+    for (int i = 0; i < 64; i++)
+        pieces.push_back(drained.Allocate(Piece, 1));
+    for (size_t i = 1; i < pieces.size(); i += 2)
+        drained.Free(pieces[i]);
+    for (size_t i = 0; i < pieces.size(); i += 2)
+    {
+        drained.Free(pieces[i]);
+        CHECK(drained.Validate());
+    }
+    CHECK(drained.Stats().FreeBlocks == 1 && drained.Stats().LargestFreeBlock == 64 * Piece);
+}
+
+// Каждое выравнивание от 1 байта до 64 КБ: отступ перед блоком - свободный блок,
+// после освобождения он сливается обратно
+static void TestAlignments()
+{
+    TlsfAllocator allocator(1 << 20, 1);
+
+    for (uint64_t alignment = 1; alignment <= 65536; alignment *= 2)
+    {
+        TlsfAllocation head = allocator.Allocate(3, 1);
+        TlsfAllocation aligned = allocator.Allocate(5, alignment);
+        CHECK(head.Valid() && aligned.Valid());
+        CHECK(aligned.Offset % alignment == 0);
+        CHECK(aligned.Size == 5);
+        CHECK(allocator.Validate());
+
+        // 3 байта, затем отступ до выравнивания, затем выделение и остаток
+        uint32_t expectedFree = aligned.Offset > 3 ? 2 : 1;
+        CHECK(allocator.Stats().FreeBlocks == expectedFree);
+
+        allocator.Free(head);
+        allocator.Free(aligned);
+        CHECK(allocator.Validate());
+        CHECK(allocator.Stats().FreeBlocks == 1);
+    }
+}
+
+// Случайные выделения и освобождения с проверкой Validate после каждой операции.
+// Фазы то заполняют кучу до отказов, то опустошают её до нуля; на пустой куче -
+// выделение всей кучи
+static void TestFuzz(uint64_t capacity, uint64_t granularity, int steps)
+{
+    TlsfAllocator allocator(capacity, granularity);
+    Model model{ allocator };
+    bool filling = true;
+    uint32_t failuresInRow = 0;
+    uint32_t fullHeaps = 0;
+    uint32_t exhausted = 0;
+
+    for (int step = 0; step < steps; step++)
+    {
+        bool allocate = filling ? NextRandom() % 8 != 0 : NextRandom() % 8 == 0;
+        if (model.Live.empty())
+            allocate = true;
+
+        if (allocate)
+        {
+            uint64_t alignment = 1ull << (NextRandom() % 17);
+            uint64_t size;
+            switch (NextRandom() % 4)
+            {
+            case 0: size = NextRandom() % 64; break;
+            case 1: size = NextRandom() % 4096; break;
+            case 2: size = NextRandom() % (capacity / 16 + 1); break;
+            default: size = (std::max)(allocator.Stats().LargestFreeBlock, (uint64_t)2) - NextRandom() % 3; break;
+            }
+
+            TlsfAllocation a = allocator.Allocate(size, alignment);
+            if (a.Valid())
+            {
+                model.Add(a, size, alignment);
+                failuresInRow = 0;
+            }
+            else
+            {
+                CheckFailure(allocator, size, alignment);
+                if (++failuresInRow == 16)
+                {
+                    filling = false;
+                    exhausted++;
+                }
+            }
+        }
+        else
+        {
+            auto it = model.Live.begin();
+            std::advance(it, NextRandom() % model.Live.size());
+            allocator.Free(it->second);
+            model.Remove(it);
+
+            if (model.Live.empty())
+            {
+                filling = true;
+                CHECK(allocator.Validate());
+                CHECK(allocator.Stats().FreeBlocks == 1 && allocator.Stats().LargestFreeBlock == allocator.Capacity());
+
+                TlsfAllocation all = allocator.Allocate(allocator.Capacity(), NextRandom() % 2 ? 1 : 65536);
+                CHECK(all.Valid() && all.Offset == 0);
+                CHECK(!allocator.Allocate(1, 1).Valid());
+                CHECK(allocator.Validate());
+                allocator.Free(all);
+                fullHeaps++;
+            }
+        }
+
+        model.Check();
+    }
+
+    // Обе крайности действительно пройдены
+    CHECK(exhausted > 0);
+    CHECK(fullHeaps > 0);
+
+    for (auto it = model.Live.begin(); it != model.Live.end(); it = model.Live.begin())
+    {
+        allocator.Free(it->second);
+        model.Remove(it);
+        model.Check();
+    }
+    CHECK(allocator.Stats().FreeBlocks == 1);
+}
+
+int main()
+{
+    TestFullHeap();
+    TestExhaustion();
+    TestAlignments();
+
+    // Гранулярность 1 байт, 4 КБ (кучи DirectXApp) и не степень двойки (округляется)
+    TestFuzz(1 << 20, 1, 40000);
+    TestFuzz(64ull << 20, 4096, 40000);
+    TestFuzz(1000003, 48, 40000);
+    TestFuzz(300000, 1, 40000);
+
+    std::printf("TlsfAllocatorTest: OK\n");
+    return 0;
+}
@@ -0,0 +1,184 @@
+﻿#include "TransparentSorter.h"
+#include "Check.h"
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    uint32_t gRandom = 1;
+
+    uint32_t NextRandom()
+    {
+        gRandom = gRandom * 1664525u + 1013904223u;
+        return gRandom;
+    }
+
+    float Random(float from, float to)
+    {
+        return from + (to - from) * (float(NextRandom() >> 8) / float(1 << 24));
+    }
+
+    // Кадр: depths[id] < 0 - отрисовки нет
+    void SortFrame(TransparentSorter& sorter, const std::vector<float>& depths)
+    {
+        sorter.Begin();
+        for (uint32_t id = 0; id < depths.size(); id++)
+        {
+            if (depths[id] >= 0.0f)
+                sorter.Add(id, depths[id]);
+        }
+        sorter.Sort();
+    }
+
+    // Ровно отрисовки кадра, от дальних к ближним
+    void CheckOrder(const TransparentSorter& sorter, const std::vector<float>& depths)
+    {
+        const std::vector<uint32_t>& order = sorter.Order();
+        size_t present = std::count_if(depths.begin(), depths.end(), [](float d) { return d >= 0.0f; });
+        CHECK(order.size() == present);
+        CHECK(sorter.Stats().Items == present);
+
+        std::vector<bool> seen(depths.size(), false);
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            CHECK(order[i] < depths.size() && depths[order[i]] >= 0.0f && !seen[order[i]]);
+            seen[order[i]] = true;
+            if (i > 0)
+                CHECK(depths[order[i - 1]] >= depths[order[i]]);
+        }
+    }
+}
+
+// Первый кадр - поразрядно, мелкое дрожание - вставками, разворот - поразрядно
+// без единого сдвига, остановка - снова вставки
+static void TestModes()
+{
+    const uint32_t count = 10000;
+    TransparentSorter sorter;
+    std::vector<float> depths(count);
+    for (float& d : depths)
+        d = Random(1.0f, 1000.0f);
+
+    SortFrame(sorter, depths);
+    CheckOrder(sorter, depths);
+    CHECK(sorter.Stats().Radix && sorter.Stats().NewItems == count);
+
+    for (float& d : depths)
+        d += Random(-0.01f, 0.01f);
+    SortFrame(sorter, depths);
+    CheckOrder(sorter, depths);
+    CHECK(!sorter.Stats().Radix && sorter.Stats().NewItems == 0);
+
+    for (float& d : depths)
+        d = 1001.0f - d;
+    SortFrame(sorter, depths);
+    CheckOrder(sorter, depths);
+    CHECK(sorter.Stats().Radix && sorter.Stats().Predicted);
+    CHECK(sorter.Stats().Moves == 0);
+    CHECK(sorter.Stats().Descents < count / 2);
+
+    SortFrame(sorter, depths);
+    CheckOrder(sorter, depths);
+    CHECK(!sorter.Stats().Radix && sorter.Stats().Moves == 0 && sorter.Stats().Descents == 0);
+}
+
+// Дальние сдвиги: вставки бросаются на бюджете, следующий такой же кадр
+// отказывается от них заранее по замеру
+static void TestLongShifts()
+{
+    const uint32_t count = 4096;
+    TransparentSorter sorter;
+    std::vector<float> depths(count);
+    for (uint32_t id = 0; id < count; id++)
+        depths[id] = float(count - id);
+    SortFrame(sorter, depths);
+
+    // Каждый 64-й переезжает в самое начало: спусков мало, сдвигов много
+    for (int frame = 0; frame < 2; frame++)
+    {
+        for (uint32_t id = frame; id < count; id += 64)
+            depths[id] += float(count);
+        SortFrame(sorter, depths);
+        CheckOrder(sorter, depths);
+        CHECK(sorter.Stats().Radix);
+        CHECK(sorter.Stats().Predicted == (frame == 1));
+    }
+
+    // Спокойные кадры возвращают вставки
+    SortFrame(sorter, depths);
+    CheckOrder(sorter, depths);
+    CHECK(!sorter.Stats().Radix);
+}
+
+// Равные глубины сохраняют порядок прошлого кадра в обоих режимах, новые -
+// после прежних
+static void TestStability()
+{
+    TransparentSorter sorter;
+    std::vector<float> depths(2000, 5.0f);
+    SortFrame(sorter, depths);
+    std::vector<uint32_t> first = sorter.Order();
+
+    for (int frame = 0; frame < 3; frame++)
+    {
+        SortFrame(sorter, depths);
+        CHECK(sorter.Order() == first);
+    }
+
+    depths.push_back(5.0f);
+    SortFrame(sorter, depths);
+    CHECK(sorter.Order().size() == first.size() + 1);
+    CHECK(std::equal(first.begin(), first.end(), sorter.Order().begin()));
+    CHECK(sorter.Order().back() == 2000);
+
+    // Повторный Add обновляет глубину, а не добавляет вторую запись
+    sorter.Begin();
+    sorter.Add(7, 1.0f);
+    sorter.Add(3, 2.0f);
+    sorter.Add(7, 3.0f);
+    sorter.Sort();
+    CHECK(sorter.Order().size() == 2 && sorter.Order()[0] == 7 && sorter.Order()[1] == 3);
+}
+
+// Случайные кадры: дрожание, повороты, появление и исчезновение отрисовок
+static void TestFuzz()
+{
+    const uint32_t ids = 3000;
+    TransparentSorter sorter;
+    std::vector<float> depths(ids, -1.0f);
+    uint32_t radix = 0, predicted = 0, insertion = 0;
+
+    for (int frame = 0; frame < 400; frame++)
+    {
+        uint32_t kind = NextRandom() % 8;
+        float jitter = kind < 5 ? 0.05f : (kind < 7 ? 20.0f : 1000.0f);
+        for (float& d : depths)
+        {
+            if (NextRandom() % 100 < (kind == 6 ? 30u : 2u))
+                d = d < 0.0f ? Random(0.0f, 1000.0f) : -1.0f;
+            else if (d >= 0.0f)
+                d = (std::max)(0.0f, d + Random(-jitter, jitter));
+        }
+
+        SortFrame(sorter, depths);
+        CheckOrder(sorter, depths);
+        const TransparentSortStats& stats = sorter.Stats();
+        radix += stats.Radix ? 1 : 0;
+        predicted += stats.Predicted ? 1 : 0;
+        insertion += stats.Radix ? 0 : 1;
+        if (stats.Predicted)
+            CHECK(stats.Moves == 0);
+    }
+
+    CHECK(radix > 0 && predicted > 0 && insertion > 0);
+}
+
+int main()
+{
+    TestModes();
+    TestLongShifts();
+    TestStability();
+    TestFuzz();
+    std::printf("TransparentSorterTest: OK\n");
+    return 0;
+}
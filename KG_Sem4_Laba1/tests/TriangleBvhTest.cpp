@@ -0,0 +1,409 @@
+﻿#include "TriangleBvh.h"
+#include "Check.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    uint32_t gRandom = 1;
+
+    uint32_t NextRandom()
+    {
+        gRandom = gRandom * 1664525u + 1013904223u;
+        return gRandom;
+    }
+
+    float Random(float from, float to)
+    {
+        return from + (to - from) * (float(NextRandom() >> 8) / float(1 << 24));
+    }
+
+    // Вершины с шагом в 5 float (позиция + UV), как у вершин приложения с лишними полями
+    const size_t Stride = 5;
+
+    struct Mesh
+    {
+        std::vector<float> Vertices;
+        std::vector<uint32_t> Indices;
+
+        void Add(const float a[3], const float b[3], const float c[3])
+        {
+            for (const float* p : { a, b, c })
+            {
+                Indices.push_back((uint32_t)(Vertices.size() / Stride));
+                Vertices.insert(Vertices.end(), { p[0], p[1], p[2], 0.0f, 0.0f });
+            }
+        }
+
+        const float* Vertex(uint32_t triangle, int corner) const
+        {
+            return &Vertices[Indices[triangle * 3 + corner] * Stride];
+        }
+
+        uint32_t TriangleCount() const { return (uint32_t)(Indices.size() / 3); }
+
+        void Build(TriangleBvh& bvh, JobSystem* jobs) const
+        {
+            bvh.Build(Vertices.data(), Stride * sizeof(float), Indices.data(), Indices.size(), jobs);
+        }
+    };
+
+    // Случайные треугольники в кубе и сетка-пол с выступами
+    Mesh MakeSoup(uint32_t count)
+    {
+        Mesh mesh;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            float center[3] = { Random(-50.0f, 50.0f), Random(-50.0f, 50.0f), Random(-50.0f, 50.0f) };
+            float size = Random(0.2f, 6.0f);
+            float v[3][3];
+            for (int k = 0; k < 3; k++)
+                for (int j = 0; j < 3; j++)
+                    v[k][j] = center[j] + Random(-size, size);
+            mesh.Add(v[0], v[1], v[2]);
+        }
+        return mesh;
+    }
+
+    // Три луча из треугольников вдоль осей на расстояниях 1e18 * 0.8^i: корзины
+    // SAH отщепляют от такого ряда по нескольку штук за уровень, а сужается при
+    // этом только одна ось из трёх. Без ограничения глубина выходит за 70
+    Mesh MakeGeometric(uint32_t perAxis)
+    {
+        Mesh mesh;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (uint32_t i = 0; i < perAxis; i++)
+            {
+                float x = 1e18f * std::pow(0.8f, (float)i);
+                float size = x * 0.01f;
+                float corners[3][3] = { { x, -size, -size }, { x, size, -size }, { x + size, 0.0f, size } };
+
+                float v[3][3];
+                for (int k = 0; k < 3; k++)
+                    for (int j = 0; j < 3; j++)
+                        v[k][(j + axis) % 3] = corners[k][j];
+                mesh.Add(v[0], v[1], v[2]);
+            }
+        }
+        return mesh;
+    }
+
+    // Тот же Моллер - Трумбор, что и в TriangleBvh, по всем треугольникам
+    RayHit BruteForce(const Mesh& mesh, const Ray& ray)
+    {
+        RayHit best;
+        best.T = ray.MaxT;
+        for (uint32_t t = 0; t < mesh.TriangleCount(); t++)
+        {
+            const float* a = mesh.Vertex(t, 0);
+            const float* b = mesh.Vertex(t, 1);
+            const float* c = mesh.Vertex(t, 2);
+            float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            float p[3] = {
+                ray.Dir[1] * e2[2] - ray.Dir[2] * e2[1],
+                ray.Dir[2] * e2[0] - ray.Dir[0] * e2[2],
+                ray.Dir[0] * e2[1] - ray.Dir[1] * e2[0] };
+            float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+            if (std::fabs(det) <= 1e-8f)
+                continue;
+
+            float invDet = 1.0f / det;
+            float s[3] = { ray.Origin[0] - a[0], ray.Origin[1] - a[1], ray.Origin[2] - a[2] };
+            float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+            float q[3] = {
+                s[1] * e1[2] - s[2] * e1[1],
+                s[2] * e1[0] - s[0] * e1[2],
+                s[0] * e1[1] - s[1] * e1[0] };
+            float v = (ray.Dir[0] * q[0] + ray.Dir[1] * q[1] + ray.Dir[2] * q[2]) * invDet;
+            float d = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+
+            if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && d > 1e-8f && d < best.T)
+            {
+                best.T = d;
+                best.U = u;
+                best.V = v;
+                best.Triangle = t;
+            }
+        }
+        if (!best.IsHit())
+            best.T = FLT_MAX;
+        return best;
+    }
+
+    // Одинаковые треугольник и t; при разных треугольниках - совпадающая глубина
+    // (общее ребро или пересекающиеся треугольники)
+    void CheckSameHit(const RayHit& hit, const RayHit& expected)
+    {
+        CHECK(hit.IsHit() == expected.IsHit());
+        if (!hit.IsHit())
+        {
+            CHECK(hit.T == FLT_MAX);
+            return;
+        }
+
+        CHECK(std::fabs(hit.T - expected.T) <= 1e-4f * (std::max)(1.0f, expected.T));
+        if (hit.Triangle == expected.Triangle)
+        {
+            CHECK(std::fabs(hit.U - expected.U) <= 1e-4f);
+            CHECK(std::fabs(hit.V - expected.V) <= 1e-4f);
+        }
+    }
+
+    // Из точек внутри сцены во все стороны, часть - вдоль осей (нулевые компоненты
+    // направления) и с ограниченной MaxT
+    std::vector<Ray> MakeRays(uint32_t count, float extent)
+    {
+        std::vector<Ray> rays(count);
+        for (Ray& ray : rays)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                ray.Origin[k] = Random(-extent, extent);
+                ray.Dir[k] = Random(-1.0f, 1.0f);
+            }
+            uint32_t kind = NextRandom() % 8;
+            if (kind == 0)
+            {
+                int axis = NextRandom() % 3;
+                for (int k = 0; k < 3; k++)
+                    ray.Dir[k] = k == axis ? (NextRandom() % 2 ? 1.0f : -1.0f) : 0.0f;
+            }
+            else if (kind == 1)
+            {
+                ray.MaxT = Random(0.5f, 20.0f);
+            }
+        }
+        return rays;
+    }
+
+    void CheckRays(const TriangleBvh& bvh, const Mesh& mesh, const std::vector<Ray>& rays)
+    {
+        std::vector<RayHit> hits(rays.size());
+        bvh.Intersect(rays.data(), rays.size(), hits.data());
+
+        uint32_t hitCount = 0;
+        for (size_t i = 0; i < rays.size(); i++)
+        {
+            RayHit expected = BruteForce(mesh, rays[i]);
+            CheckSameHit(hits[i], expected);
+            CheckSameHit(bvh.Intersect(rays[i]), expected);
+            hitCount += expected.IsHit() ? 1 : 0;
+        }
+
+        // Выборка задела и попадания, и промахи
+        CHECK(hitCount > 0 && hitCount < rays.size());
+    }
+
+    float DistanceSqToTriangle(const float p[3], const float a[3], const float b[3], const float c[3])
+    {
+        auto sub = [](const float x[3], const float y[3], float out[3]) { for (int k = 0; k < 3; k++) out[k] = x[k] - y[k]; };
+        auto dot = [](const float x[3], const float y[3]) { return x[0] * y[0] + x[1] * y[1] + x[2] * y[2]; };
+
+        // Внутри проекции на плоскость - расстояние до плоскости, иначе до ближайшего ребра
+        float e1[3], e2[3], ap[3];
+        sub(b, a, e1);
+        sub(c, a, e2);
+        sub(p, a, ap);
+        float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        float nn = dot(n, n);
+        float d = dot(ap, n) / nn;
+        float proj[3] = { ap[0] - n[0] * d, ap[1] - n[1] * d, ap[2] - n[2] * d };
+
+        float d00 = dot(e1, e1), d01 = dot(e1, e2), d11 = dot(e2, e2);
+        float d20 = dot(proj, e1), d21 = dot(proj, e2);
+        float denom = d00 * d11 - d01 * d01;
+        float v = (d11 * d20 - d01 * d21) / denom;
+        float w = (d00 * d21 - d01 * d20) / denom;
+        if (v >= 0.0f && w >= 0.0f && v + w <= 1.0f)
+            return d * d * nn;
+
+        auto segment = [&](const float s0[3], const float s1[3])
+        {
+            float seg[3], sp[3];
+            sub(s1, s0, seg);
+            sub(p, s0, sp);
+            float t = std::clamp(dot(sp, seg) / dot(seg, seg), 0.0f, 1.0f);
+            float diff[3] = { sp[0] - seg[0] * t, sp[1] - seg[1] * t, sp[2] - seg[2] * t };
+            return dot(diff, diff);
+        };
+        return (std::min)({ segment(a, b), segment(b, c), segment(c, a) });
+    }
+
+    float MinDistanceSq(const Mesh& mesh, const float p[3])
+    {
+        float best = FLT_MAX;
+        for (uint32_t t = 0; t < mesh.TriangleCount(); t++)
+            best = (std::min)(best, DistanceSqToTriangle(p, mesh.Vertex(t, 0), mesh.Vertex(t, 1), mesh.Vertex(t, 2)));
+        return best;
+    }
+}
+
+static void TestRays()
+{
+    Mesh mesh = MakeSoup(3000);
+    TriangleBvh bvh;
+    mesh.Build(bvh, nullptr);
+    CHECK(bvh.TriangleCount() == 3000);
+    CHECK(bvh.Depth() <= TriangleBvh::MaxDepth);
+
+    // Нечётное число лучей - последний пакет неполный
+    CheckRays(bvh, mesh, MakeRays(2003, 60.0f));
+
+    // Параллельная сборка даёт те же ответы
+    JobSystem jobs(3);
+    TriangleBvh parallel;
+    mesh.Build(parallel, &jobs);
+    CHECK(parallel.TriangleCount() == 3000);
+    CheckRays(parallel, mesh, MakeRays(1001, 60.0f));
+}
+
+// Неполные пакеты пишут только свои count попаданий
+static void TestPartialPackets()
+{
+    Mesh mesh = MakeSoup(500);
+    TriangleBvh bvh;
+    mesh.Build(bvh, nullptr);
+
+    std::vector<Ray> rays = MakeRays(11, 40.0f);
+    for (size_t count = 1; count <= rays.size(); count++)
+    {
+        std::vector<RayHit> hits(count + 4);
+        for (RayHit& hit : hits)
+        {
+            hit.T = -7.0f;
+            hit.Triangle = 12345;
+        }
+
+        bvh.Intersect(rays.data(), count, hits.data());
+        for (size_t i = 0; i < count; i++)
+            CheckSameHit(hits[i], BruteForce(mesh, rays[i]));
+        for (size_t i = count; i < hits.size(); i++)
+            CHECK(hits[i].T == -7.0f && hits[i].Triangle == 12345);
+    }
+
+    // Пустой BVH: промахи, сфере не во что упираться
+    TriangleBvh empty;
+    empty.Build(nullptr, Stride * sizeof(float), nullptr, 0, nullptr);
+    CHECK(empty.NodeCount() == 0);
+    RayHit miss = empty.Intersect(rays[0]);
+    CHECK(!miss.IsHit() && miss.T == FLT_MAX);
+    float center[3] = { 0.0f, 0.0f, 0.0f };
+    CHECK(!empty.ResolveSphere(center, 1.0f, 4));
+}
+
+// Перекошенное разбиение упирается в MedianDepth - ниже идёт медиана, стек
+// обхода не переполняется, и обход по-прежнему находит ближайшие попадания
+static void TestDepthLimit()
+{
+    const uint32_t perAxis = 700;
+    Mesh mesh = MakeGeometric(perAxis);
+    TriangleBvh bvh;
+    mesh.Build(bvh, nullptr);
+    CHECK(bvh.Depth() <= TriangleBvh::MaxDepth);
+    CHECK(bvh.Depth() > TriangleBvh::MedianDepth);
+
+    // Лучи в центры случайных треугольников с расстояния в десяток их размеров.
+    // Дальше 120-го треугольники мельче порога вырожденности Моллера - Трумбора
+    std::vector<Ray> rays;
+    for (uint32_t i = 0; i < 403; i++)
+    {
+        uint32_t target = NextRandom() % 120;
+        target += (NextRandom() % 3) * perAxis;
+        float centroid[3], size = 0.0f;
+        for (int k = 0; k < 3; k++)
+        {
+            centroid[k] = (mesh.Vertex(target, 0)[k] + mesh.Vertex(target, 1)[k] + mesh.Vertex(target, 2)[k]) / 3.0f;
+            size = (std::max)(size, std::fabs(mesh.Vertex(target, 1)[k] - mesh.Vertex(target, 0)[k]));
+        }
+
+        Ray ray;
+        for (int k = 0; k < 3; k++)
+            ray.Dir[k] = Random(-1.0f, 1.0f);
+        for (int k = 0; k < 3; k++)
+            ray.Origin[k] = centroid[k] - ray.Dir[k] * 10.0f * size;
+        rays.push_back(ray);
+    }
+
+    std::vector<RayHit> hits(rays.size());
+    bvh.Intersect(rays.data(), rays.size(), hits.data());
+    uint32_t hitCount = 0;
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        RayHit expected = BruteForce(mesh, rays[i]);
+        CheckSameHit(hits[i], expected);
+        hitCount += expected.IsHit() ? 1 : 0;
+    }
+    CHECK(hitCount > rays.size() / 2);
+
+    // Сфера у треугольника ряда выталкивается из него
+    uint32_t target = 60;
+    const float* a = mesh.Vertex(target, 0);
+    float size = std::fabs(a[1]);
+    float center[3] = { a[0], 0.0f, 0.0f };
+    float radius = 2.0f * size;
+    CHECK(bvh.ResolveSphere(center, radius, 8));
+    CHECK(MinDistanceSq(mesh, center) >= radius * radius * 0.99f);
+}
+
+// Сфера, задевшая треугольники, выталкивается; нетронутая остаётся на месте
+static void TestResolveSphere()
+{
+    // Пол из двух треугольников и стена у x = 5
+    Mesh mesh;
+    float f0[3] = { -20.0f, 0.0f, -20.0f }, f1[3] = { 20.0f, 0.0f, -20.0f };
+    float f2[3] = { 20.0f, 0.0f, 20.0f }, f3[3] = { -20.0f, 0.0f, 20.0f };
+    mesh.Add(f0, f2, f1);
+    mesh.Add(f0, f3, f2);
+    float w0[3] = { 5.0f, 0.0f, -20.0f }, w1[3] = { 5.0f, 10.0f, -20.0f };
+    float w2[3] = { 5.0f, 10.0f, 20.0f }, w3[3] = { 5.0f, 0.0f, 20.0f };
+    mesh.Add(w0, w1, w2);
+    mesh.Add(w0, w2, w3);
+
+    TriangleBvh bvh;
+    mesh.Build(bvh, nullptr);
+
+    for (int i = 0; i < 500; i++)
+    {
+        const float radius = 1.0f;
+        float center[3] = { Random(-10.0f, 4.9f), Random(0.05f, 3.0f), Random(-15.0f, 15.0f) };
+        float original[3] = { center[0], center[1], center[2] };
+        bool penetrating = MinDistanceSq(mesh, center) < radius * radius * 0.999f;
+
+        bool moved = bvh.ResolveSphere(center, radius, 8);
+        CHECK(moved == penetrating);
+        if (!moved)
+        {
+            CHECK(center[0] == original[0] && center[1] == original[1] && center[2] == original[2]);
+            continue;
+        }
+
+        // Центр остался по свою сторону пола и стены, сфера их не касается
+        CHECK(center[1] > 0.0f && center[0] < 5.0f);
+        CHECK(MinDistanceSq(mesh, center) >= radius * radius * 0.99f);
+    }
+
+    // Случайная каша: после выталкивания проникновение не растёт
+    Mesh soup = MakeSoup(400);
+    TriangleBvh soupBvh;
+    soup.Build(soupBvh, nullptr);
+    for (int i = 0; i < 200; i++)
+    {
+        float center[3] = { Random(-50.0f, 50.0f), Random(-50.0f, 50.0f), Random(-50.0f, 50.0f) };
+        float before = MinDistanceSq(soup, center);
+        bool moved = soupBvh.ResolveSphere(center, 0.7f, 4);
+        CHECK(moved == (before < 0.7f * 0.7f * 0.999f) || (before >= 0.7f * 0.7f * 0.999f && before < 0.7f * 0.7f * 1.001f));
+    }
+}
+
+int main()
+{
+    TestRays();
+    TestPartialPackets();
+    TestDepthLimit();
+    TestResolveSphere();
+    std::printf("TriangleBvhTest: OK\n");
+    return 0;
+}
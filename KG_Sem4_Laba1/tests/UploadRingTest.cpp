@@ -0,0 +1,140 @@
+﻿#include "UploadRing.h"
+#include "Check.h"
+#include <algorithm>
+#include <vector>
+
+// Перенос в начало, пропуск хвоста буфера и полное кольцо по шагам
+static void TestWrapAndFull()
+{
+    UploadRing ring(1024);
+
+    CHECK(ring.Allocate(600, 1) == 0);
+    ring.FinishFrame(1);
+    CHECK(ring.Allocate(300, 1) == 600);
+    ring.FinishFrame(2);
+    ring.Reclaim(1);
+    CHECK(ring.UsedBytes() == 300);
+
+    // [900, 1024) мал: пропуск 124 байт входит в занятое, выделение - с нуля
+    CHECK(ring.Allocate(200, 1) == 0);
+    CHECK(ring.UsedBytes() == 300 + 124 + 200);
+    CHECK(ring.Stats().Wraps == 1);
+
+    // Свободно только [200, 600); пропуск на выравнивание тоже занят
+    CHECK(ring.Allocate(500, 1) == UploadRing::InvalidOffset);
+    CHECK(ring.Allocate(256, 256) == 256);
+    CHECK(ring.UsedBytes() == 300 + 124 + 200 + 56 + 256);
+
+    // Выравнивание упирается в хвост
+    CHECK(ring.Allocate(1, 1024) == UploadRing::InvalidOffset);
+    CHECK(ring.Allocate(88, 8) == 512);
+    CHECK(ring.UsedBytes() == 1024);
+
+    // Голова догнала хвост: tail >= head при непустом кольце
+    CHECK(ring.Allocate(1, 1) == UploadRing::InvalidOffset);
+    CHECK(ring.Stats().Failures == 3);
+
+    // Незакрытая порция не освобождается
+    ring.Reclaim(2);
+    CHECK(ring.UsedBytes() == 1024 - 300);
+    ring.FinishFrame(3);
+    ring.Reclaim(3);
+    CHECK(ring.UsedBytes() == 0);
+
+    // Пустое кольцо начинается с нуля, больше ёмкости не выделить
+    CHECK(ring.Allocate(16, 16) == 0);
+    CHECK(ring.Allocate(2048, 1) == UploadRing::InvalidOffset);
+}
+
+// Случайные выделения, кадры и отстающий GPU: живые выделения никогда не
+// пересекаются, выровнены и не выходят за буфер
+static void TestRandomStress()
+{
+    const uint64_t capacity = 64 * 1024;
+
+    struct Live
+    {
+        uint64_t Offset;
+        uint64_t Size;
+        uint64_t Fence;
+    };
+
+    UploadRing ring(capacity);
+    std::vector<Live> live;
+    std::vector<Live> open;
+    uint64_t fence = 0;
+    uint64_t completed = 0;
+    uint32_t random = 7;
+    auto next = [&random]() { random = random * 1664525u + 1013904223u; return random >> 8; };
+
+    for (int step = 0; step < 200000; step++)
+    {
+        uint32_t action = next() % 100;
+
+        if (action < 80)
+        {
+            uint64_t size = 1 + next() % (capacity / 6);
+            uint64_t alignment = uint64_t(1) << (next() % 10);
+            uint64_t offset = ring.Allocate(size, alignment);
+            if (offset == UploadRing::InvalidOffset)
+                continue;
+
+            CHECK(offset % alignment == 0);
+            CHECK(offset + size <= capacity);
+            for (const std::vector<Live>* list : { &live, &open })
+            {
+                for (const Live& a : *list)
+                    CHECK(offset + size <= a.Offset || a.Offset + a.Size <= offset);
+            }
+            open.push_back({ offset, size, 0 });
+        }
+        else if (action < 92)
+        {
+            ++fence;
+            ring.FinishFrame(fence);
+            for (Live& a : open)
+                a.Fence = fence;
+            live.insert(live.end(), open.begin(), open.end());
+            open.clear();
+        }
+        else
+        {
+            // GPU отстаёт на 0..2 кадра
+            uint64_t lag = next() % 3;
+            completed = (std::max)(completed, fence > lag ? fence - lag : 0);
+            ring.Reclaim(completed);
+            std::vector<Live> kept;
+            for (const Live& a : live)
+            {
+                if (a.Fence > completed)
+                    kept.push_back(a);
+            }
+            live.swap(kept);
+        }
+
+        uint64_t liveBytes = 0;
+        for (const Live& a : live)
+            liveBytes += a.Size;
+        for (const Live& a : open)
+            liveBytes += a.Size;
+        CHECK(ring.UsedBytes() >= liveBytes);
+        CHECK(ring.UsedBytes() <= capacity);
+    }
+
+    const UploadRingStats& stats = ring.Stats();
+    CHECK(stats.Wraps > 100);
+    CHECK(stats.Failures > 100);
+    CHECK(stats.PeakUsed == capacity || stats.PeakUsed > capacity - capacity / 6);
+
+    ring.FinishFrame(++fence);
+    ring.Reclaim(fence);
+    CHECK(ring.UsedBytes() == 0);
+}
+
+int main()
+{
+    TestWrapAndFull();
+    TestRandomStress();
+    std::printf("UploadRingTest: OK\n");
+    return 0;
+}
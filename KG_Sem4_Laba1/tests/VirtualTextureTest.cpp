@@ -0,0 +1,235 @@
+﻿#include "VirtualTexture.h"
+#include "Check.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+// Синтетическая обратная связь: вместо GPU кадр "запрашивает" заданные тайлы
+
+namespace
+{
+    uint64_t Key(uint16_t texture, uint32_t mip, uint32_t x, uint32_t y)
+    {
+        TileKey key;
+        key.Texture = texture;
+        key.Mip = uint8_t(mip);
+        key.X = uint16_t(x);
+        key.Y = uint16_t(y);
+        return key.Pack();
+    }
+
+    uint32_t EntryMip(uint32_t entry)
+    {
+        return (entry >> 16) & 0xFF;
+    }
+
+    bool EntryValid(uint32_t entry)
+    {
+        return (entry >> 24) != 0;
+    }
+
+    bool HasUpload(const std::vector<TileUpload>& uploads, uint32_t mip, uint32_t x, uint32_t y)
+    {
+        for (const TileUpload& u : uploads)
+        {
+            if (u.Key.Mip == mip && u.Key.X == x && u.Key.Y == y)
+                return true;
+        }
+        return false;
+    }
+}
+
+// Тайловый файл: тайлы с рамкой, за краем изображения - clamp
+static void TestTileFile()
+{
+    TgaImage image;
+    image.width = 200;
+    image.height = 150;
+    image.channels = 3;
+    image.data.resize(size_t(image.width) * image.height * 3);
+    for (int y = 0; y < image.height; y++)
+    {
+        for (int x = 0; x < image.width; x++)
+        {
+            unsigned char* p = &image.data[(size_t(y) * image.width + x) * 3];
+            p[0] = uint8_t(x);
+            p[1] = uint8_t(y);
+            p[2] = uint8_t(x + y);
+        }
+    }
+
+    std::string path = (std::filesystem::temp_directory_path() / "VirtualTextureTest.vtex").string();
+    CHECK(BakeTileFile(image, path));
+
+    TileFile file;
+    CHECK(file.Open(path));
+    CHECK(file.Header().Width == 200 && file.Header().Height == 150);
+    CHECK(file.Header().MipCount == VtMipCount(200, 150));
+    CHECK(file.Header().MipCount == 2);
+
+    std::vector<uint8_t> tile(VtTileBytes);
+    auto pixel = [&](uint32_t px, uint32_t py) { return &tile[(py * VtPaddedTileSize + px) * 4]; };
+
+    // Тайл (1, 1) мипа 0: x 128..199, y 128..149, дальше - край
+    CHECK(file.ReadTile(0, 1, 1, tile.data()));
+    for (uint32_t py = 0; py < VtPaddedTileSize; py++)
+    {
+        for (uint32_t px = 0; px < VtPaddedTileSize; px++)
+        {
+            int sx = std::clamp(int(128 + px) - int(VtTileBorder), 0, 199);
+            int sy = std::clamp(int(128 + py) - int(VtTileBorder), 0, 149);
+            const uint8_t* p = pixel(px, py);
+            CHECK(p[0] == uint8_t(sx) && p[1] == uint8_t(sy) && p[2] == uint8_t(sx + sy) && p[3] == 255);
+        }
+    }
+
+    // Единственный тайл мипа 1 (100x75): рамка слева сверху повторяет угловой пиксель
+    CHECK(file.ReadTile(1, 0, 0, tile.data()));
+    CHECK(memcmp(pixel(0, 0), pixel(VtTileBorder, VtTileBorder), 4) == 0);
+    CHECK(memcmp(pixel(VtTileBorder + 99, VtTileBorder), pixel(VtPaddedTileSize - 1, VtTileBorder), 4) == 0);
+
+    CHECK(!file.ReadTile(2, 0, 0, tile.data()));
+    std::filesystem::remove(path);
+}
+
+// Повторы тайла сливаются в один запрос, вместе с ним запрашиваются все родители
+static void TestDeduplication()
+{
+    VirtualTextureSystem vt(8, 8, 64);
+    uint16_t tex = vt.AddTexture(1024, 1024);
+    CHECK(vt.MipCount(tex) == 4);
+
+    std::vector<uint64_t> feedback(1000, Key(tex, 0, 5, 3));
+    feedback.push_back(Key(tex, 9, 0, 0));    // Мипа нет
+    feedback.push_back(Key(tex, 0, 8, 0));    // За краем
+    feedback.push_back(Key(7, 0, 0, 0));      // Текстуры нет
+
+    std::vector<TileUpload> uploads = vt.Update(feedback.data(), feedback.size());
+    CHECK(vt.Stats().FeedbackEntries == 1003);
+    CHECK(vt.Stats().UniqueRequests == 4);
+    CHECK(vt.Stats().CacheHits == 0);
+    CHECK(uploads.size() == 4);
+
+    // Грубые мипы первыми
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        CHECK(uploads[i].Key.Mip == 3 - i);
+        CHECK(uploads[i].Key.X == (5u >> (3 - i)) && uploads[i].Key.Y == (3u >> (3 - i)));
+    }
+
+    // Все слоты разные
+    for (size_t i = 0; i < uploads.size(); i++)
+        for (size_t j = i + 1; j < uploads.size(); j++)
+            CHECK(uploads[i].Slot != uploads[j].Slot);
+
+    // Второй кадр с тем же запросом - одни попадания
+    uploads = vt.Update(feedback.data(), feedback.size());
+    CHECK(uploads.empty());
+    CHECK(vt.Stats().CacheHits == 4);
+    CHECK(vt.Stats().Uploads == 0);
+}
+
+// Бюджет загрузок: лишнее откладывается; внутри мипа - по числу запросов
+static void TestUploadBudget()
+{
+    VirtualTextureSystem vt(8, 8, 2);
+    uint16_t tex = vt.AddTexture(512, 512);
+    CHECK(vt.MipCount(tex) == 3);
+
+    // Мип 0: (0,0) x1, (3,3) x5, (1,0) x3. Мип 1: (1,1) - 5 запросов, (0,0) - 4
+    std::vector<uint64_t> feedback;
+    feedback.push_back(Key(tex, 0, 0, 0));
+    feedback.insert(feedback.end(), 5, Key(tex, 0, 3, 3));
+    feedback.insert(feedback.end(), 3, Key(tex, 0, 1, 0));
+
+    std::vector<TileUpload> uploads = vt.Update(feedback.data(), feedback.size());
+    CHECK(vt.Stats().UniqueRequests == 6);
+    CHECK(uploads.size() == 2);
+    CHECK(vt.Stats().Deferred == 4);
+    CHECK(uploads[0].Key.Mip == 2);
+    CHECK(HasUpload(uploads, 1, 1, 1));
+
+    uploads = vt.Update(feedback.data(), feedback.size());
+    CHECK(vt.Stats().CacheHits == 2);
+    CHECK(vt.Stats().Deferred == 2);
+    CHECK(uploads.size() == 2);
+    CHECK(uploads[0].Key.Mip == 1 && uploads[0].Key.X == 0 && uploads[0].Key.Y == 0);
+    CHECK(uploads[1].Key.Mip == 0 && uploads[1].Key.X == 3 && uploads[1].Key.Y == 3);
+
+    uploads = vt.Update(feedback.data(), feedback.size());
+    CHECK(uploads.size() == 2);
+    CHECK(uploads[0].Key.Mip == 0 && uploads[0].Key.X == 1 && uploads[0].Key.Y == 0);
+    CHECK(uploads[1].Key.Mip == 0 && uploads[1].Key.X == 0 && uploads[1].Key.Y == 0);
+    CHECK(vt.Stats().Deferred == 0);
+
+    uploads = vt.Update(feedback.data(), feedback.size());
+    CHECK(uploads.empty());
+    CHECK(vt.Stats().CacheHits == 6);
+}
+
+// Вытеснение LRU: закреплённый грубый мип и тайлы текущего кадра не трогаются,
+// таблица страниц у вытесненного тайла откатывается на родителя
+static void TestEviction()
+{
+    VirtualTextureSystem vt(2, 2, 16);
+    uint16_t tex = vt.AddTexture(256, 256);
+    CHECK(vt.MipCount(tex) == 2);
+
+    uint64_t frame1 = Key(tex, 0, 0, 0);
+    uint64_t frame2 = Key(tex, 0, 1, 0);
+    uint64_t frame3 = Key(tex, 0, 0, 1);
+    uint64_t frame4 = Key(tex, 0, 1, 1);
+
+    CHECK(vt.Update(&frame1, 1).size() == 2);
+    CHECK(vt.IsPageTableDirty(tex));
+    vt.ClearPageTableDirty(tex);
+    CHECK(vt.Update(&frame2, 1).size() == 1);
+    CHECK(vt.Update(&frame3, 1).size() == 1);
+    CHECK(vt.Stats().Evictions == 0);
+
+    const std::vector<uint32_t>& mip0 = vt.PageTable(tex, 0);
+    const std::vector<uint32_t>& mip1 = vt.PageTable(tex, 1);
+    CHECK(EntryValid(mip1[0]) && EntryMip(mip1[0]) == 1);
+    CHECK(EntryValid(mip0[0]) && EntryMip(mip0[0]) == 0);
+    CHECK(mip0[3] == mip1[0]);   // (1,1) ещё не загружен - запись родителя
+
+    // Кэш полон: вытесняется самый старый незакреплённый - (0,0) из первого кадра
+    std::vector<TileUpload> uploads = vt.Update(&frame4, 1);
+    CHECK(uploads.size() == 1);
+    CHECK(vt.Stats().Evictions == 1);
+    CHECK(vt.IsPageTableDirty(tex));
+    CHECK(EntryMip(mip0[3]) == 0);
+    CHECK(mip0[0] == mip1[0]);
+    CHECK(vt.SlotX(uploads[0].Slot) == (mip0[3] & 0xFF) && vt.SlotY(uploads[0].Slot) == ((mip0[3] >> 8) & 0xFF));
+
+    // Все четыре тайла в одном кадре: три в кэше, четвёртому места нет -
+    // вытеснять тайлы этого кадра нельзя, запрос откладывается
+    uint64_t all[] = { frame1, frame2, frame3, frame4 };
+    uploads = vt.Update(all, 4);
+    CHECK(uploads.empty());
+    CHECK(vt.Stats().CacheHits == 4);
+    CHECK(vt.Stats().Deferred == 1);
+    CHECK(vt.Stats().Evictions == 0);
+
+    // Тайлы мипа 0 вытесняют друг друга, закреплённый грубый мип остаётся
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        uint64_t key = Key(tex, 0, i & 1, i >> 1);
+        vt.Update(&key, 1);
+    }
+    CHECK(EntryValid(mip1[0]) && EntryMip(mip1[0]) == 1);
+    uint64_t coarse = Key(tex, 1, 0, 0);
+    vt.Update(&coarse, 1);
+    CHECK(vt.Stats().CacheHits == 1);
+}
+
+int main()
+{
+    TestTileFile();
+    TestDeduplication();
+    TestUploadBudget();
+    TestEviction();
+    std::printf("VirtualTextureTest: OK\n");
+    return 0;
+}
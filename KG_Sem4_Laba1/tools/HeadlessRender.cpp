@@ -0,0 +1,231 @@
+﻿#include "Parser.h"
+#include "SoftRasterizer.h"
+#include "MipChain.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// HeadlessRender [obj = ../assets/sponza.obj] [tga = frame_cpu.tga] [ширина = 800] [высота = 600]
+//                [x y z yaw pitch = 0 0 0 0 0]
+// Кадр без окна и D3D: сцена грузится тем же LoadOBJ/LoadMTL (mtl - рядом с obj, с тем же
+// именем), рисуется SoftRasterizer с камерой и проекцией DirectXApp и пишется в TGA.
+// Карты - только TGA; материал без карты - 1x1 цвета Kd (вторая - 1 - Kd), как BuildSoftTextures
+
+namespace
+{
+    struct Vec3
+    {
+        float x, y, z;
+    };
+
+    Vec3 Cross(const Vec3& a, const Vec3& b)
+    {
+        return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+    }
+
+    float Dot(const Vec3& a, const Vec3& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    Vec3 Normalize(const Vec3& v)
+    {
+        float length = std::sqrt(Dot(v, v));
+        return { v.x / length, v.y / length, v.z / length };
+    }
+
+    // XMMatrixLookAtLH(eye, eye + forward, up) * XMMatrixPerspectiveFovLH(pi/4, aspect, 0.1, 1000),
+    // forward - как в DirectXApp::Update из yaw и pitch
+    void MakeViewProj(const Vec3& eye, float yaw, float pitch, float aspect, float out[4][4])
+    {
+        Vec3 forward = Normalize({ std::cos(pitch) * std::cos(yaw), std::sin(pitch), std::cos(pitch) * std::sin(yaw) });
+        Vec3 right = Normalize(Cross({ 0.0f, 1.0f, 0.0f }, forward));
+        Vec3 up = Cross(forward, right);
+
+        float view[4][4] = {
+            { right.x, up.x, forward.x, 0.0f },
+            { right.y, up.y, forward.y, 0.0f },
+            { right.z, up.z, forward.z, 0.0f },
+            { -Dot(right, eye), -Dot(up, eye), -Dot(forward, eye), 1.0f },
+        };
+
+        const float zn = 0.1f;
+        const float zf = 1000.0f;
+        float yScale = 1.0f / std::tan(0.5f * 0.25f * 3.14159265f);
+        float proj[4][4] = {
+            { yScale / aspect, 0.0f, 0.0f, 0.0f },
+            { 0.0f, yScale, 0.0f, 0.0f },
+            { 0.0f, 0.0f, zf / (zf - zn), 1.0f },
+            { 0.0f, 0.0f, -zn * zf / (zf - zn), 0.0f },
+        };
+
+        for (int i = 0; i < 4; i++)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                out[i][j] = 0.0f;
+                for (int k = 0; k < 4; k++)
+                    out[i][j] += view[i][k] * proj[k][j];
+            }
+        }
+    }
+
+    bool EndsWith(const std::string& text, const std::string& suffix)
+    {
+        if (text.size() < suffix.size())
+            return false;
+
+        for (size_t i = 0; i < suffix.size(); i++)
+        {
+            char c = text[text.size() - suffix.size() + i];
+            if (c >= 'A' && c <= 'Z')
+                c = (char)(c - 'A' + 'a');
+            if (c != suffix[i])
+                return false;
+        }
+        return true;
+    }
+
+    // Карта или цвет; false - карта есть, но её не прочитать (остаётся белой)
+    bool BuildTexture(const std::string& path, const ObjFloat3& color, SoftTexture& out)
+    {
+        if (path.empty())
+        {
+            out.Width = 1;
+            out.Height = 1;
+            out.Mips.push_back({
+                (uint8_t)(color.z * 255.0f),
+                (uint8_t)(color.y * 255.0f),
+                (uint8_t)(color.x * 255.0f),
+                255 });
+            return true;
+        }
+
+        TgaImage image;
+        if (!EndsWith(path, ".tga") || !LoadTGA(path, image))
+            return false;
+
+        out.Width = (uint32_t)image.width;
+        out.Height = (uint32_t)image.height;
+        BuildMipChain(image, out.Mips);
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string objPath = argc > 1 ? argv[1] : "../assets/sponza.obj";
+    std::string outPath = argc > 2 ? argv[2] : "frame_cpu.tga";
+    uint32_t width = argc > 3 ? (uint32_t)std::atoi(argv[3]) : 800;
+    uint32_t height = argc > 4 ? (uint32_t)std::atoi(argv[4]) : 600;
+
+    Vec3 eye = { 0.0f, 0.0f, 0.0f };
+    float yaw = 0.0f;
+    float pitch = 0.0f;
+    if (argc > 9)
+    {
+        eye = { (float)std::atof(argv[5]), (float)std::atof(argv[6]), (float)std::atof(argv[7]) };
+        yaw = (float)std::atof(argv[8]);
+        pitch = (float)std::atof(argv[9]);
+    }
+
+    if (width == 0 || height == 0)
+    {
+        std::fprintf(stderr, "Bad frame size %ux%u\n", width, height);
+        return 1;
+    }
+
+    // Пути в mtl - от папки obj, как "../assets/" + карта в DirectXApp::Initialize
+    size_t slash = objPath.find_last_of("/\\");
+    std::string directory = slash == std::string::npos ? "" : objPath.substr(0, slash + 1);
+    size_t dot = objPath.find_last_of('.');
+    std::string mtlPath = (dot == std::string::npos || (slash != std::string::npos && dot < slash)
+        ? objPath : objPath.substr(0, dot)) + ".mtl";
+
+    std::vector<ObjVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Submesh> submeshes;
+    if (!LoadOBJ(objPath, vertices, indices, submeshes))
+    {
+        std::fprintf(stderr, "Failed to load OBJ: %s\n", objPath.c_str());
+        return 1;
+    }
+
+    std::vector<ParsedMaterial> materials;
+    if (!LoadMTL(mtlPath, materials))
+        std::fprintf(stderr, "Failed to load MTL file: %s\n", mtlPath.c_str());
+
+    // По две текстуры на материал, как mSoftTextures
+    std::vector<SoftTexture> textures(materials.size() * 2);
+    uint32_t unsupported = 0;
+    for (size_t m = 0; m < materials.size(); m++)
+    {
+        const ParsedMaterial& p = materials[m];
+        ObjFloat3 second = { 1.0f - p.Kd.x, 1.0f - p.Kd.y, 1.0f - p.Kd.z };
+
+        if (!BuildTexture(p.DiffuseMap.empty() ? "" : directory + p.DiffuseMap, p.Kd, textures[m * 2 + 0]))
+            unsupported++;
+        if (!BuildTexture(p.DiffuseMap2.empty() ? "" : directory + p.DiffuseMap2, second, textures[m * 2 + 1]))
+            unsupported++;
+    }
+
+    // Сабмеши по порядку файла; без материала не рисуются, как в RenderSoftFrame
+    std::vector<SoftDraw> draws;
+    for (const Submesh& sm : submeshes)
+    {
+        int material = -1;
+        for (size_t m = 0; m < materials.size() && material < 0; m++)
+        {
+            if (materials[m].Name == sm.MaterialName)
+                material = (int)m;
+        }
+        if (material < 0)
+            continue;
+
+        SoftDraw draw;
+        draw.IndexStart = sm.IndexStart;
+        draw.IndexCount = sm.IndexCount;
+        draw.Texture1 = textures[material * 2 + 0].Mips.empty() ? nullptr : &textures[material * 2 + 0];
+        draw.Texture2 = textures[material * 2 + 1].Mips.empty() ? nullptr : &textures[material * 2 + 1];
+        draws.push_back(draw);
+    }
+
+    SoftMesh mesh;
+    mesh.Vertices = reinterpret_cast<const uint8_t*>(vertices.data());
+    mesh.VertexStride = sizeof(ObjVertex);
+    mesh.PositionOffset = offsetof(ObjVertex, position);
+    mesh.TexcoordOffset = offsetof(ObjVertex, texcoord);
+    mesh.VertexCount = (uint32_t)vertices.size();
+    mesh.Indices = indices.data();
+
+    SoftConstants constants;
+    MakeViewProj(eye, yaw, pitch, (float)width / (float)height, constants.WorldViewProj);
+
+    JobSystem jobs;
+    SoftRasterizer raster(jobs, width, height);
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Цвет очистки как в Draw: (0.53, 0.81, 0.98) в BGRA8
+    raster.Clear(0xFF87CFFAu);
+    raster.Render(mesh, constants, draws.data(), draws.size());
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const SoftRasterStats& stats = raster.Stats();
+    std::printf("Software frame: %.3f ms (vertices %.0f us, binning %.0f us, raster %.0f us), %u triangles, %llu pixels\n",
+        ms, stats.TransformUs, stats.BinUs, stats.RasterUs, stats.Triangles, (unsigned long long)stats.Pixels);
+    if (unsupported > 0)
+        std::printf("%u textures are not TGA or failed to load, drawn white\n", unsupported);
+
+    if (!raster.SaveTga(outPath))
+    {
+        std::fprintf(stderr, "Failed to save %s\n", outPath.c_str());
+        return 1;
+    }
+
+    std::printf("Saved %s\n", outPath.c_str());
+    return 0;
+}